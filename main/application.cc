@@ -2,19 +2,43 @@
 #include "board.h"
 #include "display.h"
 #include "system_info.h"
+#include "boot_profile.h"
+#include "telemetry.h"
+#include "turn_latency.h"
+#if CONFIG_SOAK_TEST
+#include "soak_test.h"
+#endif
+#include "dns_cache.h"
+#include "memory_budget.h"
 #include "audio_codec.h"
 #include "mqtt_protocol.h"
 #include "websocket_protocol.h"
+#include "json_scanner.h"
 #include "assets/lang_config.h"
 #include "mcp_server.h"
 #include "assets.h"
 #include "settings.h"
+#include "i2c_scheduler.h"
+#include "power_governor.h"
+#include "task_manifest.h"
+#if CONFIG_LP_VOICE_WAKE
+#include "lp_voice_wake.h"
+#endif
+#if CONFIG_DISPLAY_MIRROR
+#include "lvgl_display.h"
+#endif
+#if CONFIG_TTS_CACHE
+#include "tts_cache.h"
+#endif
 
 #if CONFIG_ENABLE_WIFI_PENTEST
 #include "wifi_pentest/wifi_pentest_mcp_tools.h"
 #endif
 
+#include <cctype>
 #include <cstring>
+#include <algorithm>
+#include <ctime>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
@@ -48,6 +72,29 @@ Application::Application() {
         .skip_unhandled_events = true
     };
     esp_timer_create(&clock_timer_args, &clock_timer_handle_);
+
+#if CONFIG_WAKE_WORD_PRECONNECT
+    esp_timer_create_args_t preconnect_timer_args = {
+        .callback = [](void* arg) {
+            Application* app = (Application*)arg;
+            app->Schedule([app]() {
+                if (!app->preconnected_) {
+                    return;
+                }
+                app->preconnected_ = false;
+                if (app->GetDeviceState() == kDeviceStateIdle && app->protocol_ && app->protocol_->IsAudioChannelOpened()) {
+                    ESP_LOGI(TAG, "No wake word followed, closing the speculative audio channel");
+                    app->protocol_->CloseAudioChannel();
+                }
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "preconnect_timer",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&preconnect_timer_args, &preconnect_timer_handle_);
+#endif
 }
 
 Application::~Application() {
@@ -55,6 +102,10 @@ Application::~Application() {
         esp_timer_stop(clock_timer_handle_);
         esp_timer_delete(clock_timer_handle_);
     }
+    if (preconnect_timer_handle_ != nullptr) {
+        esp_timer_stop(preconnect_timer_handle_);
+        esp_timer_delete(preconnect_timer_handle_);
+    }
     vEventGroupDelete(event_group_);
 
 #if CONFIG_ENABLE_WEB_DISPLAY_SERVER
@@ -107,52 +158,133 @@ void Application::Initialize() {
         }
         return std::string("{\"type\":\"full_state\",\"data\":{}}");
     });
+    web_display_server_->SetResumeCallback([this](uint32_t epoch, uint32_t seq, bool binary, std::vector<std::string>& frames) {
+        return display_bridge_->GetDeltasSince(epoch, seq, binary, frames);
+    });
+#if CONFIG_DISPLAY_MIRROR
+    if (auto lvgl_display = dynamic_cast<LvglDisplay*>(board.GetDisplay())) {
+        web_display_server_->SetMirrorCallback([this, lvgl_display](bool wanted) {
+            if (!wanted) {
+                lvgl_display->StopMirror();
+                return;
+            }
+            lvgl_display->StartMirror([this](std::string&& frame) {
+                web_display_server_->BroadcastMirrorFrame(frame);
+            });
+        });
+    }
+#endif
+    web_display_server_->SetGetMcpStatsCallback([]() {
+        return McpServer::GetInstance().GetStatsJson();
+    });
+#if CONFIG_AUDIO_CAPTURE
+    web_display_server_->SetAudioCaptureCallback([this](const WebDisplayServer::ChunkWriter& write) {
+        return audio_service_.GetCapture()->Export(write);
+    });
+#endif
+#if CONFIG_WEB_AUDIO_MONITOR
+    audio_service_.SetAudioMonitor([this](bool uplink, const AudioStreamPacket& packet) {
+        web_display_server_->BroadcastAudioFrame(uplink, packet.sample_rate, packet.frame_duration,
+            packet.payload_data(), packet.payload_size());
+    });
+#endif
     ESP_LOGI("Application", "Web Display Server created, will start when network connects");
 #endif
 
     display->SetupUI();
     // Print board name/version info
     display->SetChatMessage("system", SystemInfo::GetUserAgent().c_str());
+    BootProfile::Mark("display_setup_ui");
+
+    // Fonts, emoji and speech models load while the codec and the network come up
+    StartApplyAssets();
 
     // Setup the audio service
     auto codec = board.GetAudioCodec();
     audio_service_.Initialize(codec);
-    audio_service_.Start();
+    BootProfile::Mark("codec");
+#if CONFIG_LP_VOICE_WAKE
+    // Woken by the LP core, the wake word engine starts on what it heard
+    audio_service_.SetWakeWordPreroll(LpVoiceWake::TakePreroll());
+#endif
 
     AudioServiceCallbacks callbacks;
     callbacks.on_send_queue_available = [this]() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_AUDIO);
     };
     callbacks.on_wake_word_detected = [this](const std::string& wake_word) {
+#if CONFIG_TURN_LATENCY_REPORT
+        TurnLatency::GetInstance().MarkWakeWord();
+#endif
         xEventGroupSetBits(event_group_, MAIN_EVENT_WAKE_WORD_DETECTED);
     };
+#if CONFIG_WAKE_WORD_PRECONNECT
+    callbacks.on_wake_word_candidate = [this]() {
+        Schedule([this]() {
+            HandleWakeWordCandidate();
+        });
+    };
+#endif
     callbacks.on_vad_change = [this](bool speaking) {
+#if CONFIG_TURN_LATENCY_REPORT
+        if (!speaking && GetDeviceState() == kDeviceStateListening) {
+            TurnLatency::GetInstance().MarkSpeechEnd();
+        }
+#endif
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
+#if CONFIG_TURN_LATENCY_REPORT
+    callbacks.on_first_stream_frame = []() {
+        TurnLatency::GetInstance().Mark(kTurnLatencyFirstAudio);
+    };
+    callbacks.on_output_silent = [](int64_t silent_us) {
+        TurnLatency::GetInstance().Mark(kTurnLatencyAbortToSilence, silent_us);
+    };
+#endif
+    callbacks.on_command_detected = [this](const WakeWordCommand& command) {
+        Schedule([this, command]() {
+            HandleLocalCommand(command);
+        });
+    };
     audio_service_.SetCallbacks(callbacks);
+    AddDefaultLocalCommands();
 
     // Add state change listeners
+    state_machine_.SetDeferredDispatcher([this](int listener_id, DeviceState old_state, DeviceState new_state) {
+        Schedule([this, listener_id, old_state, new_state]() {
+            state_machine_.RunDeferredListener(listener_id, old_state, new_state);
+        }, kSchedulePriorityLow);
+    });
     state_machine_.AddStateChangeListener([this](DeviceState old_state, DeviceState new_state) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_STATE_CHANGED);
     });
+    /* LED animations restart on every state, they must not hold up the audio path of the transition */
+    state_machine_.AddStateChangeListener([](DeviceState old_state, DeviceState new_state) {
+        Board::GetInstance().GetLed()->OnStateChanged();
+    }, true);
+    /* Idle is when the power save level is LOW_POWER, only the clock and status icons change then */
+    state_machine_.AddStateChangeListener([](DeviceState old_state, DeviceState new_state) {
+        auto display = Board::GetInstance().GetDisplay();
+        display->SetFrameRate(new_state == kDeviceStateIdle ? kDisplayFrameRateIdle : kDisplayFrameRateFull);
+    }, true);
+    /* A camera may stream through a session so take_photo answers at once, it sleeps otherwise */
+    state_machine_.AddStateChangeListener([](DeviceState old_state, DeviceState new_state) {
+        auto camera = Board::GetInstance().GetCamera();
+        if (camera != nullptr) {
+            camera->SetSessionActive(new_state == kDeviceStateConnecting || new_state == kDeviceStateListening ||
+                                     new_state == kDeviceStateSpeaking);
+        }
+    }, true);
 
     // Start the clock timer to update the status bar
-    esp_timer_start_periodic(clock_timer_handle_, 1000000);
-
-    // Add MCP common tools (only once during initialization)
-    auto& mcp_server = McpServer::GetInstance();
-    mcp_server.AddCommonTools();
-    mcp_server.AddUserOnlyTools();
-
-#if CONFIG_ENABLE_WIFI_PENTEST
-    // Register WiFi pentest tools
-    xiaozhi::WifiPentestMcpTools::RegisterTools(mcp_server);
-#endif
+    UpdateClockTimer();
 
     // Set network event callback for UI updates and network state handling
     board.SetNetworkEventCallback([this](NetworkEvent event, const std::string& data) {
         auto display = GetDisplay();
-        
+        // The network part of the device status changed
+        Board::InvalidateDeviceStatus();
+
         switch (event) {
             case NetworkEvent::Scanning:
                 display->ShowNotification(Lang::Strings::SCANNING_WIFI, 30000);
@@ -206,8 +338,29 @@ void Application::Initialize() {
         }
     });
 
-    // Start network asynchronously
+    /* Start the network first, Wi-Fi association runs while the rest of the startup is done */
     board.StartNetwork();
+    BootProfile::Mark("network_start");
+
+    audio_service_.Start();
+    // The popup plays on every wake up, have it decoded before the first one
+    audio_service_.PreloadSound(Lang::Sounds::OGG_POPUP);
+    BootProfile::Mark("audio_start");
+
+    // Add MCP common tools (only once during initialization)
+    auto& mcp_server = McpServer::GetInstance();
+    mcp_server.AddCommonTools();
+    mcp_server.AddUserOnlyTools();
+
+#if CONFIG_ENABLE_WIFI_PENTEST
+    // Register WiFi pentest tools
+    xiaozhi::WifiPentestMcpTools::RegisterTools(mcp_server);
+#endif
+    BootProfile::Mark("mcp");
+
+#if CONFIG_SOAK_TEST
+    SoakTest::GetInstance().Start();
+#endif
 
     // Update the status bar immediately to show the network state
     display->UpdateStatusBar(true);
@@ -220,9 +373,11 @@ void Application::Run() {
     const EventBits_t ALL_EVENTS = 
         MAIN_EVENT_SCHEDULE |
         MAIN_EVENT_SEND_AUDIO |
+        MAIN_EVENT_SEND_TEXT |
         MAIN_EVENT_WAKE_WORD_DETECTED |
         MAIN_EVENT_VAD_CHANGE |
         MAIN_EVENT_CLOCK_TICK |
+        MAIN_EVENT_STATUS_CHANGED |
         MAIN_EVENT_ERROR |
         MAIN_EVENT_NETWORK_CONNECTED |
         MAIN_EVENT_NETWORK_DISCONNECTED |
@@ -270,7 +425,12 @@ void Application::Run() {
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
+                bool sent = protocol_ && protocol_->TransmitAudio(*packet);
+                if (sent) {
+                    audio_service_.MarkPacketSent(*packet);
+                }
+                audio_service_.ReleasePacket(std::move(packet));
+                if (!sent) {
                     break;
                 }
             }
@@ -288,29 +448,63 @@ void Application::Run() {
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
+            RunScheduledTasks();
+        }
+
+        /* Queued MCP text goes out one message per pass, after the audio was drained */
+        if (protocol_ && protocol_->HasQueuedText()) {
+            protocol_->SendQueuedText();
+            if (protocol_->HasQueuedText()) {
+                xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_TEXT);
             }
         }
 
+        if (bits & MAIN_EVENT_STATUS_CHANGED) {
+            GetDisplay()->UpdateStatusBar(true);
+            McpServer::GetInstance().NotifyStatusChanged();
+        }
+
         if (bits & MAIN_EVENT_CLOCK_TICK) {
             clock_ticks_++;
             auto display = GetDisplay();
-            display->UpdateStatusBar();
+            // An idle tick comes once a minute, refresh everything while at it
+            bool idle_tick = !esp_timer_is_active(clock_timer_handle_);
+            display->UpdateStatusBar(idle_tick);
         
-            // Print debug info every 10 seconds
+            // Print debug info every 10 ticks
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
             }
+            MemoryBudget::GetInstance().Check();
+            audio_service_.ReleaseIdleResources();
+#if CONFIG_TELEMETRY
+            if (Telemetry::GetInstance().Tick()) {
+                SendMcpMessage(Telemetry::GetInstance().GetNotification());
+            }
+#endif
+#if CONFIG_AUDIO_TASK_MONITOR
+            if (clock_ticks_ % CONFIG_AUDIO_TASK_MONITOR_INTERVAL == 0) {
+                audio_service_.GetTaskMonitor().Sample();
+            }
+#endif
+#if CONFIG_AUDIO_LATENCY_TRACE
+            if (clock_ticks_ % CONFIG_AUDIO_LATENCY_TRACE_PRINT_INTERVAL == 0) {
+                audio_service_.GetLatencyTracer().PrintSummary();
+            }
+#endif
+            // Battery and signal have no change events of their own
+            McpServer::GetInstance().NotifyStatusChanged();
+            if (idle_tick) {
+                UpdateClockTimer();
+            }
         }
     }
 }
 
 void Application::HandleNetworkConnectedEvent() {
     ESP_LOGI(TAG, "Network connected");
+    BootProfile::Mark("network_connected");
+    DnsCache::GetInstance().Start();
     auto state = GetDeviceState();
 
 #if CONFIG_ENABLE_WEB_DISPLAY_SERVER
@@ -332,12 +526,12 @@ void Application::HandleNetworkConnectedEvent() {
             return;
         }
 
-        xTaskCreate([](void* arg) {
+        TaskManifest::Create("activation", [](void* arg) {
             Application* app = static_cast<Application*>(arg);
             app->ActivationTask();
             app->activation_task_handle_ = nullptr;
-            vTaskDelete(NULL);
-        }, "activation", 4096 * 2, this, 2, &activation_task_handle_);
+            TaskManifest::Exit();
+        }, this, &activation_task_handle_);
     }
 
     // Update the status bar immediately to show the network state
@@ -352,6 +546,7 @@ void Application::HandleNetworkDisconnectedEvent() {
         ESP_LOGI(TAG, "Closing audio channel due to network disconnection");
         protocol_->CloseAudioChannel();
     }
+    DnsCache::GetInstance().Stop();
 
 #if CONFIG_ENABLE_WEB_DISPLAY_SERVER
     // Stop Web Display Server when network is lost
@@ -368,6 +563,8 @@ void Application::HandleNetworkDisconnectedEvent() {
 
 void Application::HandleActivationDoneEvent() {
     ESP_LOGI(TAG, "Activation done");
+    BootProfile::Mark("activation_done");
+    BootProfile::PrintTable();
 
     SystemInfo::PrintHeapStats();
     SetDeviceState(kDeviceStateIdle);
@@ -381,6 +578,8 @@ void Application::HandleActivationDoneEvent() {
 
     // Release OTA object after activation is complete
     ota_.reset();
+    // The check version response may have brought new server addresses
+    DnsCache::GetInstance().Start();
     auto& board = Board::GetInstance();
     board.SetPowerSaveLevel(PowerSaveLevel::LOW_POWER);
 
@@ -396,9 +595,11 @@ void Application::ActivationTask() {
 
     // Check for new assets version
     CheckAssetsVersion();
+    BootProfile::Mark("assets_check");
 
     // Check for new firmware version
     CheckNewVersion();
+    BootProfile::Mark("ota_check");
 
     // Initialize the protocol
     InitializeProtocol();
@@ -407,6 +608,34 @@ void Application::ActivationTask() {
     xEventGroupSetBits(event_group_, MAIN_EVENT_ACTIVATION_DONE);
 }
 
+/*
+ * Apply the assets in the background when no download is pending, the activation task only
+ * waits for it. With a pending download the activation task applies them after downloading.
+ */
+void Application::StartApplyAssets() {
+    auto& assets = Assets::GetInstance();
+    if (!assets.partition_valid()) {
+        xEventGroupSetBits(event_group_, MAIN_EVENT_ASSETS_APPLIED);
+        return;
+    }
+    {
+        Settings settings("assets", false);
+        if (!settings.GetString("download_url").empty()) {
+            xEventGroupSetBits(event_group_, MAIN_EVENT_ASSETS_APPLIED);
+            return;
+        }
+    }
+
+    assets_applied_at_boot_ = true;
+    TaskManifest::Create("apply_assets", [](void* arg) {
+        Application* app = static_cast<Application*>(arg);
+        Assets::GetInstance().Apply();
+        BootProfile::Mark("assets");
+        xEventGroupSetBits(app->event_group_, MAIN_EVENT_ASSETS_APPLIED);
+        TaskManifest::Exit();
+    }, this);
+}
+
 void Application::CheckAssetsVersion() {
     // Only allow CheckAssetsVersion to be called once
     if (assets_version_checked_) {
@@ -418,6 +647,14 @@ void Application::CheckAssetsVersion() {
     auto display = GetDisplay();
     auto& assets = Assets::GetInstance();
 
+    // The assets may still be applying in the background
+    xEventGroupWaitBits(event_group_, MAIN_EVENT_ASSETS_APPLIED, pdFALSE, pdTRUE, portMAX_DELAY);
+    if (assets_applied_at_boot_) {
+        display->SetChatMessage("system", "");
+        display->SetEmotion("microchip_ai");
+        return;
+    }
+
     if (!assets.partition_valid()) {
         ESP_LOGW(TAG, "Assets partition is disabled for board %s", BOARD_NAME);
         return;
@@ -465,6 +702,81 @@ void Application::CheckAssetsVersion() {
     display->SetEmotion("microchip_ai");
 }
 
+void Application::UpdateAssets(const std::string& url) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (assets_update_task_ != nullptr) {
+        ESP_LOGW(TAG, "An assets update is already running");
+        return;
+    }
+    assets_update_url_ = url;
+    TaskManifest::Create("assets_update", [](void* arg) {
+        auto app = static_cast<Application*>(arg);
+        app->AssetsUpdateTask();
+        std::lock_guard<std::mutex> lock(app->mutex_);
+        app->assets_update_task_ = nullptr;
+        TaskManifest::Exit();
+    }, this, &assets_update_task_);
+}
+
+/*
+ * Hot update of the assets: the device waits for the conversation to end, stops the wake word
+ * and the prompts that read from the partition, and Assets::HotUpdate() swaps the display
+ * resources. Back in idle the wake word starts again on the models that stayed mapped.
+ */
+void Application::AssetsUpdateTask() {
+    std::string url;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        url = assets_update_url_;
+    }
+    // A wake word between the check and the transition makes it fail, then it waits for the next idle
+    while (!audio_service_.IsIdle() || GetDeviceState() != kDeviceStateIdle || !SetDeviceState(kDeviceStateUpgrading)) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+    {
+        Settings settings("assets", true);
+        settings.EraseKey("download_url");
+    }
+
+    auto display = GetDisplay();
+    auto& board = Board::GetInstance();
+    audio_service_.EnableWakeWordDetection(false);
+    audio_service_.EnableVoiceProcessing(false);
+    // A frame already read may still be in the wake word engine
+    vTaskDelay(pdMS_TO_TICKS(100));
+    audio_service_.ForgetCachedSounds();
+
+    board.SetPowerSaveLevel(PowerSaveLevel::PERFORMANCE);
+    display->SetStatus(Lang::Strings::LOADING_ASSETS);
+    display->SetChatMessage("system", Lang::Strings::PLEASE_WAIT);
+    bool models_changed = false;
+    bool success = Assets::GetInstance().HotUpdate(url, [this, display](int progress, size_t speed) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
+        Schedule([display, message = std::string(buffer)]() {
+            display->SetChatMessage("system", message.c_str());
+        });
+    }, models_changed);
+    board.SetPowerSaveLevel(PowerSaveLevel::LOW_POWER);
+
+    if (models_changed) {
+        // The old models are gone from the flash, the wake word can not start on them again
+        ESP_LOGW(TAG, "Rebooting to load the new speech models");
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        Reboot();
+        return;
+    }
+    if (!success) {
+        Alert(Lang::Strings::ERROR, Lang::Strings::DOWNLOAD_ASSETS_FAILED, "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
+        vTaskDelay(pdMS_TO_TICKS(2000));
+    }
+    SetDeviceState(kDeviceStateIdle);
+    if (success) {
+        ESP_LOGI(TAG, "Assets updated without a reboot");
+        audio_service_.PlaySound(Lang::Sounds::OGG_SUCCESS);
+    }
+}
+
 void Application::CheckNewVersion() {
     const int MAX_RETRY = 10;
     int retry_count = 0;
@@ -503,13 +815,21 @@ void Application::CheckNewVersion() {
         retry_delay = 10; // Reset retry delay
 
         if (ota_->HasNewVersion()) {
-            if (UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion())) {
+#if CONFIG_OTA_BACKGROUND_UPGRADE
+            // The device starts as usual and the download runs behind it
+            background_upgrade_ = {ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion(), ota_->GetPatchUrl(),
+                ota_->GetFirmwareSha256()};
+            StartBackgroundUpgrade();
+#else
+            if (UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion(), ota_->GetPatchUrl(),
+                ota_->GetFirmwareSha256())) {
                 return; // This line will never be reached after reboot
             }
             // If upgrade failed, continue to normal operation
+#endif
         }
 
-        // No new version, mark the current version as valid
+        // The running version works, mark it as valid
         ota_->MarkCurrentVersionValid();
         if (!ota_->HasActivationCode() && !ota_->HasActivationChallenge()) {
             // Exit the loop if done checking new version
@@ -540,6 +860,75 @@ void Application::CheckNewVersion() {
     }
 }
 
+void Application::StartBackgroundUpgrade() {
+    if (background_upgrade_task_ != nullptr || upgrade_pending_) {
+        return;
+    }
+    ESP_LOGI(TAG, "Downloading firmware %s in the background", background_upgrade_.version.c_str());
+    background_upgrade_cancel_ = false;
+    TaskManifest::Create("background_ota", [](void* arg) {
+        auto app = static_cast<Application*>(arg);
+        app->BackgroundUpgradeTask();
+        app->background_upgrade_task_ = nullptr;
+        TaskManifest::Exit();
+    }, this, &background_upgrade_task_);
+}
+
+/*
+ * Runs on the download task before every read: waits while the device speaks, and leaves gaps
+ * between reads while the audio channel is in use so the conversation keeps the bandwidth.
+ */
+bool Application::PaceBackgroundUpgrade() {
+    while (!background_upgrade_cancel_) {
+        auto state = GetDeviceState();
+        if (state == kDeviceStateSpeaking) {
+            vTaskDelay(pdMS_TO_TICKS(200));
+            continue;
+        }
+        if (state == kDeviceStateConnecting || state == kDeviceStateListening || audio_service_.IsVoiceDetected()) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_OTA_BACKGROUND_THROTTLE_MS));
+        }
+        return !background_upgrade_cancel_;
+    }
+    return false;
+}
+
+void Application::BackgroundUpgradeTask() {
+    const int MAX_ATTEMPTS = 3;
+    auto pace = [this]() { return PaceBackgroundUpgrade(); };
+    auto& upgrade = background_upgrade_;
+    for (int attempt = 1; attempt <= MAX_ATTEMPTS; attempt++) {
+        // A long pause may drop the connection, the next attempt starts over
+        bool success = false;
+        if (!upgrade.patch_url.empty()) {
+            success = Ota::Upgrade(upgrade.patch_url, nullptr, true, upgrade.sha256, pace);
+        }
+        if (!success && !background_upgrade_cancel_) {
+            success = Ota::Upgrade(upgrade.url, nullptr, false, upgrade.sha256, pace);
+        }
+        if (success) {
+            ESP_LOGI(TAG, "Firmware %s is ready, rebooting once idle", upgrade.version.c_str());
+            upgrade_pending_ = true;
+            PowerGovernor::GetInstance().AddIdleStage(CONFIG_OTA_BACKGROUND_REBOOT_IDLE_SECONDS, [this]() {
+                Schedule([this]() {
+                    if (GetDeviceState() == kDeviceStateIdle) {
+                        Reboot();
+                    }
+                });
+            });
+            return;
+        }
+        if (background_upgrade_cancel_) {
+            ESP_LOGI(TAG, "Background firmware download cancelled");
+            return;
+        }
+        ESP_LOGW(TAG, "Background firmware download failed (%d/%d)", attempt, MAX_ATTEMPTS);
+        for (int i = 0; i < 60 && !background_upgrade_cancel_; i++) {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+    }
+}
+
 void Application::InitializeProtocol() {
     auto& board = Board::GetInstance();
     auto display = GetDisplay();
@@ -566,12 +955,22 @@ void Application::InitializeProtocol() {
     });
     
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
-        if (GetDeviceState() == kDeviceStateSpeaking) {
+        bool accepted = GetDeviceState() == kDeviceStateSpeaking;
+#if CONFIG_AUDIO_DECODE_AHEAD
+        accepted = accepted || stream_prepared_;
+#endif
+        if (accepted) {
+#if CONFIG_TTS_CACHE
+            TtsCache::GetInstance().Record(*packet);
+#endif
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
+        } else {
+            audio_service_.ReleasePacket(std::move(packet));
         }
     });
     
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
+        BootProfile::Mark("audio_channel");
         board.SetPowerSaveLevel(PowerSaveLevel::PERFORMANCE);
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
@@ -581,24 +980,59 @@ void Application::InitializeProtocol() {
     
     protocol_->OnAudioChannelClosed([this, &board]() {
         board.SetPowerSaveLevel(PowerSaveLevel::LOW_POWER);
+#if CONFIG_TURN_LATENCY_REPORT
+        TurnLatency::GetInstance().EndSession();
+#endif
+#if CONFIG_TTS_CACHE
+        TtsCache::GetInstance().Cancel();
+#endif
         Schedule([this]() {
+            protocol_->LogTransmitStats();
             auto display = GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
         });
     });
     
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
+#if CONFIG_TURN_LATENCY_REPORT
+    protocol_->OnLatencyReport([]() {
+        return TurnLatency::GetInstance().TakeReportJson();
+    });
+#endif
+
+    protocol_->OnIncomingMessage([this, display](const IncomingMessage& message) {
+        if (message.type == "tts") {
+            if (message.state == "start") {
+#if CONFIG_TURN_LATENCY_REPORT
+                TurnLatency::GetInstance().Mark(kTurnLatencyTtsStart);
+#endif
+                assistant_message_open_ = false;
+#if CONFIG_AUDIO_DECODE_AHEAD
+                // The audio that arrives before the main task switches to speaking is decoded, not dropped
+                if (GetDeviceState() != kDeviceStateSpeaking) {
+                    audio_service_.PrepareStream();
+                    stream_prepared_ = true;
+                }
+#endif
                 Schedule([this]() {
                     aborted_ = false;
+#if CONFIG_AUDIO_DECODE_AHEAD
+                    // Already speaking, no state change takes the held stream over
+                    if (stream_prepared_ && GetDeviceState() == kDeviceStateSpeaking) {
+                        stream_prepared_ = false;
+                        audio_service_.StartStream();
+                        return;
+                    }
+#endif
                     SetDeviceState(kDeviceStateSpeaking);
+#if CONFIG_AUDIO_DECODE_AHEAD
+                    // Refused by the state machine, the audio decoded ahead must not play
+                    if (GetDeviceState() != kDeviceStateSpeaking && stream_prepared_.exchange(false)) {
+                        audio_service_.ResetDecoder();
+                    }
+#endif
                 });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
+            } else if (message.state == "stop") {
                 Schedule([this]() {
                     if (GetDeviceState() == kDeviceStateSpeaking) {
                         if (listening_mode_ == kListeningModeManualStop) {
@@ -608,36 +1042,56 @@ void Application::InitializeProtocol() {
                         }
                     }
                 });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
+            } else if (message.state == "sentence_start" && !message.text.empty()) {
+                auto text = JsonScanner::Unescape(message.text);
+                ESP_LOGI(TAG, "<< %s", text.c_str());
+                if (!assistant_message_open_) {
+                    assistant_message_open_ = true;
+                    display->Post([display, text = std::move(text)]() {
+                        display->SetChatMessage("assistant", text.c_str());
+                    }, kDisplayCommandKeyAssistantMessage);
+                } else {
+                    // Latin sentences need a space between them
+                    if (isalnum((unsigned char)text[0])) {
+                        text.insert(text.begin(), ' ');
+                    }
+                    /* Every delta has to reach the display, so it is never replaced in the queue */
+                    display->Post([display, text = std::move(text)]() {
+                        display->AppendChatMessage("assistant", text.c_str());
                     });
                 }
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
+        } else if (message.type == "stt") {
+#if CONFIG_TURN_LATENCY_REPORT
+            TurnLatency::GetInstance().Mark(kTurnLatencyStt);
+#endif
+            if (!message.text.empty()) {
+                auto text = JsonScanner::Unescape(message.text);
+                ESP_LOGI(TAG, ">> %s", text.c_str());
+                display->Post([display, text = std::move(text)]() {
+                    display->SetChatMessage("user", text.c_str());
+                }, kDisplayCommandKeyUserMessage);
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
+        } else if (message.type == "llm") {
+            if (!message.emotion.empty()) {
+                display->Post([display, emotion = JsonScanner::Unescape(message.emotion)]() {
+                    display->SetEmotion(emotion.c_str());
+                }, kDisplayCommandKeyEmotion);
             }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+        } else if (message.type == "mcp") {
+            /* Only the MCP body needs a cJSON tree */
+            auto payload = cJSON_ParseWithLength(message.payload.data(), message.payload.size());
+            if (cJSON_IsObject(payload) || cJSON_IsArray(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
-        } else if (strcmp(type->valuestring, "system") == 0) {
+            cJSON_Delete(payload);
+        }
+    });
+
+    protocol_->OnIncomingJson([this, display](const cJSON* root) {
+        // Parse JSON data
+        auto type = cJSON_GetObjectItem(root, "type");
+        if (strcmp(type->valuestring, "system") == 0) {
             auto command = cJSON_GetObjectItem(root, "command");
             if (cJSON_IsString(command)) {
                 ESP_LOGI(TAG, "System command: %s", command->valuestring);
@@ -664,12 +1118,43 @@ void Application::InitializeProtocol() {
             auto payload = cJSON_GetObjectItem(root, "payload");
             ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
             if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
+                display->Post([display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
                     display->SetChatMessage("system", payload_str.c_str());
                 });
             } else {
                 ESP_LOGW(TAG, "Invalid custom message format: missing payload");
             }
+#endif
+#if CONFIG_TTS_CACHE
+        } else if (strcmp(type->valuestring, "tts_cache") == 0) {
+            auto state = cJSON_GetObjectItem(root, "state");
+            auto hash = cJSON_GetObjectItem(root, "hash");
+            auto& cache = TtsCache::GetInstance();
+            if (!cJSON_IsString(state)) {
+                ESP_LOGW(TAG, "tts_cache message requires state");
+            } else if (strcmp(state->valuestring, "store") == 0 && cJSON_IsString(hash)) {
+                // The audio of the phrase follows on this task, so recording starts before it arrives
+                cache.BeginStore(hash->valuestring, protocol_->server_sample_rate(), protocol_->server_frame_duration());
+            } else if (strcmp(state->valuestring, "end") == 0) {
+                cache.EndStore();
+            } else if (strcmp(state->valuestring, "play") == 0 && cJSON_IsString(hash) &&
+                TtsCache::ValidHash(hash->valuestring)) {
+                /* Scheduled behind the tts start, which enters the speaking state */
+                Schedule([this, hash = std::string(hash->valuestring)]() {
+                    if (GetDeviceState() != kDeviceStateSpeaking) {
+                        return;
+                    }
+                    TtsCache::GetInstance().Play(hash, &audio_service_, [this, hash](bool played) {
+                        Schedule([this, hash, played]() {
+                            if (protocol_) {
+                                protocol_->SendTtsCacheStatus(hash, played ? "done" : "miss");
+                            }
+                        });
+                    });
+                });
+            } else {
+                ESP_LOGW(TAG, "Invalid tts_cache message");
+            }
 #endif
         } else {
             ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
@@ -682,7 +1167,7 @@ void Application::InitializeProtocol() {
 void Application::ShowActivationCode(const std::string& code, const std::string& message) {
     struct digit_sound {
         char digit;
-        const std::string_view& sound;
+        const Lang::Sound& sound;
     };
     static const std::array<digit_sound, 10> digit_sounds{{
         digit_sound{'0', Lang::Sounds::OGG_0},
@@ -734,6 +1219,12 @@ void Application::ToggleChatState() {
 }
 
 void Application::StartListening() {
+#if CONFIG_PUSH_TO_TALK_PREROLL
+    // Buffer the mic from the press on, the channel opens several main loop hops later
+    if (GetDeviceState() == kDeviceStateIdle) {
+        audio_service_.StartTalkPreroll();
+    }
+#endif
     xEventGroupSetBits(event_group_, MAIN_EVENT_START_LISTENING);
 }
 
@@ -787,7 +1278,7 @@ void Application::ContinueOpenAudioChannel(ListeningMode mode) {
     }
 
     if (!protocol_->IsAudioChannelOpened()) {
-        if (!protocol_->OpenAudioChannel()) {
+        if (!OpenAudioChannel()) {
             return;
         }
     }
@@ -795,6 +1286,21 @@ void Application::ContinueOpenAudioChannel(ListeningMode mode) {
     SetListeningMode(mode);
 }
 
+/*
+ * Wi-Fi stays in its deepest power save while only the wake word is running. It is left
+ * before the handshake, so the TLS and hello round trips are not stretched by beacon
+ * intervals. OnAudioChannelClosed() goes back to power save, and so does a failed open.
+ */
+bool Application::OpenAudioChannel() {
+    auto& board = Board::GetInstance();
+    board.SetPowerSaveLevel(PowerSaveLevel::PERFORMANCE);
+    if (!protocol_->OpenAudioChannel()) {
+        board.SetPowerSaveLevel(PowerSaveLevel::LOW_POWER);
+        return false;
+    }
+    return true;
+}
+
 void Application::HandleStartListeningEvent() {
     auto state = GetDeviceState();
     
@@ -838,15 +1344,80 @@ void Application::HandleStopListeningEvent() {
     } else if (state == kDeviceStateListening) {
         if (protocol_) {
             protocol_->SendStopListening();
+#if CONFIG_TURN_LATENCY_REPORT
+            TurnLatency::GetInstance().MarkSpeechEnd();
+#endif
         }
         SetDeviceState(kDeviceStateIdle);
     }
 }
 
+/*
+ * Speech started while waiting for the wake word: open the audio channel now, so the
+ * TLS handshake and hello exchange overlap with the rest of the wake word.
+ */
+void Application::HandleWakeWordCandidate() {
+    if (GetDeviceState() != kDeviceStateIdle || !protocol_ || preconnected_ || protocol_->IsAudioChannelOpened()) {
+        return;
+    }
+    ESP_LOGI(TAG, "Wake word candidate, pre-connecting the audio channel");
+    if (!OpenAudioChannel()) {
+        return;
+    }
+    preconnected_ = true;
+    esp_timer_stop(preconnect_timer_handle_);
+    esp_timer_start_once(preconnect_timer_handle_, CONFIG_WAKE_WORD_PRECONNECT_TIMEOUT_MS * 1000);
+}
+
+void Application::AddLocalCommand(const std::string& action, std::function<void()> handler) {
+    local_commands_[action] = std::move(handler);
+}
+
+// Device controls that work without the server, bound to the "action" of the model commands
+void Application::AddDefaultLocalCommands() {
+    auto change_volume = [](int delta) {
+        auto& board = Board::GetInstance();
+        auto codec = board.GetAudioCodec();
+        int volume = std::clamp(codec->output_volume() + delta, 0, 100);
+        codec->SetOutputVolume(volume);
+        board.GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+    };
+    AddLocalCommand("volume_up", [change_volume]() { change_volume(10); });
+    AddLocalCommand("volume_down", [change_volume]() { change_volume(-10); });
+    AddLocalCommand("stop", [this]() {
+        auto state = GetDeviceState();
+        if (state == kDeviceStateSpeaking) {
+            AbortSpeaking(kAbortReasonNone);
+        } else if (state == kDeviceStateListening && protocol_) {
+            protocol_->CloseAudioChannel();
+        }
+    });
+}
+
+void Application::HandleLocalCommand(const WakeWordCommand& command) {
+    auto it = local_commands_.find(command.action);
+    if (it == local_commands_.end()) {
+        ESP_LOGW(TAG, "No handler for local command %s (%s)", command.command.c_str(), command.action.c_str());
+        return;
+    }
+    ESP_LOGI(TAG, "Local command: %s (%s), confidence %.2f, %d ms after onset", command.command.c_str(),
+        command.action.c_str(), command.confidence, command.latency_ms);
+    it->second();
+}
+
+void Application::CancelPreconnect() {
+    if (preconnected_) {
+        preconnected_ = false;
+        esp_timer_stop(preconnect_timer_handle_);
+    }
+}
+
 void Application::HandleWakeWordDetectedEvent() {
     if (!protocol_) {
         return;
     }
+    // A channel opened on the candidate is kept for this conversation
+    CancelPreconnect();
 
     auto state = GetDeviceState();
     auto wake_word = audio_service_.GetLastWakeWord();
@@ -857,6 +1428,8 @@ void Application::HandleWakeWordDetectedEvent() {
         auto wake_word = audio_service_.GetLastWakeWord();
 
         if (!protocol_->IsAudioChannelOpened()) {
+            // Leave Wi-Fi power save right away, the handshake is next
+            Board::GetInstance().SetPowerSaveLevel(PowerSaveLevel::PERFORMANCE);
             SetDeviceState(kDeviceStateConnecting);
             // Schedule to let the state change be processed first (UI update),
             // then continue with OpenAudioChannel which may block for ~1 second
@@ -896,17 +1469,21 @@ void Application::ContinueWakeWordInvoke(const std::string& wake_word) {
     }
 
     if (!protocol_->IsAudioChannelOpened()) {
-        if (!protocol_->OpenAudioChannel()) {
+        if (!OpenAudioChannel()) {
             audio_service_.EnableWakeWordDetection(true);
             return;
         }
     }
+#if CONFIG_TURN_LATENCY_REPORT
+    TurnLatency::GetInstance().Mark(kTurnLatencyWakeToChannel);
+#endif
 
     ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_SEND_WAKE_WORD_DATA
     // Encode and send the wake word data to the server
     while (auto packet = audio_service_.PopWakeWordPacket()) {
-        protocol_->SendAudio(std::move(packet));
+        protocol_->TransmitAudio(*packet);
+        audio_service_.ReleasePacket(std::move(packet));
     }
     // Set the chat state to wake word detected
     protocol_->SendWakeWordDetected(wake_word);
@@ -925,11 +1502,25 @@ void Application::ContinueWakeWordInvoke(const std::string& wake_word) {
 void Application::HandleStateChangedEvent() {
     DeviceState new_state = state_machine_.GetState();
     clock_ticks_ = 0;
+    UpdateClockTimer();
+    McpServer::GetInstance().NotifyStatusChanged();
+    // The idle stages count from the last state change
+    PowerGovernor::GetInstance().NotifyActivity();
+    if (new_state != kDeviceStateIdle) {
+        CancelPreconnect();
+    }
+#if CONFIG_AUDIO_DECODE_AHEAD
+    // The reply never got to speaking, its audio is dropped again
+    if (new_state != kDeviceStateSpeaking) {
+        stream_prepared_ = false;
+    }
+#endif
+#if CONFIG_AUDIO_STREAM_PLAYER
+    // Music and radio give way to the conversation, a wake word pauses them too
+    audio_service_.PauseStream(new_state != kDeviceStateIdle);
+#endif
 
-    auto& board = Board::GetInstance();
     auto display = GetDisplay();
-    auto led = board.GetLed();
-    led->OnStateChanged();
 
     switch (new_state) {
         case kDeviceStateUnknown:
@@ -949,6 +1540,8 @@ void Application::HandleStateChangedEvent() {
             display->SetStatus(Lang::Strings::LISTENING);
             display->SetEmotion("neutral");
 
+            // Realtime listening streams all along, its silences are thinned
+            audio_service_.EnableUplinkSilenceGate(listening_mode_ == kListeningModeRealtime);
             // Make sure the audio processor is running
             if (play_popup_on_listening_ || !audio_service_.IsAudioProcessorRunning()) {
                 // For auto mode, wait for playback queue to be empty before enabling voice processing
@@ -984,6 +1577,13 @@ void Application::HandleStateChangedEvent() {
                 // Only AFE wake word can be detected in speaking mode
                 audio_service_.EnableWakeWordDetection(audio_service_.IsAfeWakeWord());
             }
+#if CONFIG_AUDIO_DECODE_AHEAD
+            // The voice processing is off, the frames decoded ahead may play now
+            if (stream_prepared_.exchange(false)) {
+                audio_service_.StartStream();
+                break;
+            }
+#endif
             audio_service_.ResetDecoder();
             break;
         case kDeviceStateWifiConfiguring:
@@ -996,19 +1596,103 @@ void Application::HandleStateChangedEvent() {
     }
 }
 
-void Application::Schedule(std::function<void()>&& callback) {
+void Application::Schedule(MainTask&& callback, SchedulePriority priority) {
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
+        main_tasks_[priority].push_back(std::move(callback));
     }
     xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
 }
 
+/*
+ * The clock tick runs only as often as it is needed: every second during a session, at the
+ * next minute for the idle clock and not at all in standby, so the CPU can stay in light sleep.
+ */
+void Application::UpdateClockTimer() {
+    esp_timer_stop(clock_timer_handle_);
+    if (standby_) {
+        return;
+    }
+    if (GetDeviceState() != kDeviceStateIdle) {
+        esp_timer_start_periodic(clock_timer_handle_, 1000000);
+        return;
+    }
+    time_t now = time(NULL);
+    esp_timer_start_once(clock_timer_handle_, (60 - now % 60) * 1000000ULL);
+}
+
+void Application::RefreshStatusBar() {
+    xEventGroupSetBits(event_group_, MAIN_EVENT_STATUS_CHANGED);
+}
+
+void Application::SetStandby(bool standby) {
+    Schedule([this, standby]() {
+        if (standby_ == standby) {
+            return;
+        }
+        standby_ = standby;
+        ESP_LOGI(TAG, "Standby: %d", standby);
+        UpdateClockTimer();
+        // Battery and charger registers are polled once a minute while nobody looks at them
+        I2cScheduler::GetInstance().SetSlowPolling(standby);
+        if (!standby) {
+            GetDisplay()->UpdateStatusBar(true);
+        }
+    });
+}
+
+/*
+ * Runs the tasks pending on entry, one at a time from the highest priority queue, so a task
+ * scheduled meanwhile at a higher priority still goes ahead of older display updates.
+ */
+void Application::RunScheduledTasks() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (auto& queue : main_tasks_) {
+        count += queue.size();
+    }
+    while (count-- > 0) {
+        auto queue = std::find_if(main_tasks_.begin(), main_tasks_.end(),
+            [](const std::deque<MainTask>& queue) { return !queue.empty(); });
+        if (queue == main_tasks_.end()) {
+            break;
+        }
+        auto callback = std::move(queue->front());
+        queue->pop_front();
+        lock.unlock();
+        callback();
+        lock.lock();
+    }
+    for (auto& queue : main_tasks_) {
+        if (!queue.empty()) {
+            xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
+            break;
+        }
+    }
+}
+
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
+    McpServer::GetInstance().CancelToolCalls();
+#if CONFIG_TTS_CACHE
+    TtsCache::GetInstance().Cancel();
+#endif
+    int played_ms = -1;
+#if CONFIG_TURN_LATENCY_REPORT
+    TurnLatency::GetInstance().MarkAbort();
+#endif
+#if CONFIG_AUDIO_BARGE_IN_FLUSH
+    /* Cut the speaker off now instead of letting the DMA buffers drain */
+    if (reason == kAbortReasonWakeWordDetected) {
+        played_ms = audio_service_.AbortPlayback();
+    }
+#endif
+#if CONFIG_TURN_LATENCY_REPORT
+    audio_service_.WatchForSilence();
+#endif
     if (protocol_) {
-        protocol_->SendAbortSpeaking(reason);
+        protocol_->SendAbortSpeaking(reason, played_ms);
     }
 }
 
@@ -1034,13 +1718,23 @@ void Application::Reboot() {
     esp_restart();
 }
 
-bool Application::UpgradeFirmware(const std::string& url, const std::string& version) {
+bool Application::UpgradeFirmware(const std::string& url, const std::string& version, const std::string& patch_url,
+    const std::string& sha256) {
     auto& board = Board::GetInstance();
     auto display = GetDisplay();
 
     std::string upgrade_url = url;
     std::string version_info = version.empty() ? "(Manual upgrade)" : version;
 
+    // Both would write the same partition, the foreground upgrade takes over
+    if (background_upgrade_task_ != nullptr) {
+        ESP_LOGI(TAG, "Stopping the background firmware download");
+        background_upgrade_cancel_ = true;
+        while (background_upgrade_task_ != nullptr) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+    }
+
     // Close audio channel if it's open
     if (protocol_ && protocol_->IsAudioChannelOpened()) {
         ESP_LOGI(TAG, "Closing audio channel before firmware upgrade");
@@ -1060,13 +1754,23 @@ bool Application::UpgradeFirmware(const std::string& url, const std::string& ver
     audio_service_.Stop();
     vTaskDelay(pdMS_TO_TICKS(1000));
 
-    bool upgrade_success = Ota::Upgrade(upgrade_url, [this, display](int progress, size_t speed) {
+    auto progress_callback = [this, display](int progress, size_t speed) {
         char buffer[32];
         snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
         Schedule([display, message = std::string(buffer)]() {
             display->SetChatMessage("system", message.c_str());
         });
-    });
+    };
+    bool upgrade_success = false;
+    if (!patch_url.empty()) {
+        upgrade_success = Ota::Upgrade(patch_url, progress_callback, true, sha256);
+        if (!upgrade_success) {
+            ESP_LOGW(TAG, "Patch upgrade failed, downloading the full image");
+        }
+    }
+    if (!upgrade_success) {
+        upgrade_success = Ota::Upgrade(upgrade_url, progress_callback, false, sha256);
+    }
 
     if (!upgrade_success) {
         // Upgrade failed, restart audio service and continue running
@@ -1109,7 +1813,7 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     } else if (state == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
-        });
+        }, kSchedulePriorityHigh);
     } else if (state == kDeviceStateListening) {   
         Schedule([this]() {
             if (protocol_) {
@@ -1136,7 +1840,7 @@ bool Application::CanEnterSleepMode() {
     return true;
 }
 
-void Application::SendMcpMessage(const std::string& payload) {
+void Application::SendMcpMessage(std::string payload) {
     // Always schedule to run in main task for thread safety
     Schedule([this, payload = std::move(payload)]() {
         if (protocol_) {
@@ -1145,6 +1849,15 @@ void Application::SendMcpMessage(const std::string& payload) {
     });
 }
 
+void Application::SetMcpCbor(bool enable) {
+    // Ordered with SendMcpMessage(), replies already scheduled keep their encoding
+    Schedule([this, enable]() {
+        if (protocol_) {
+            protocol_->SetMcpCbor(enable);
+        }
+    });
+}
+
 void Application::SetAecMode(AecMode mode) {
     aec_mode_ = mode;
     Schedule([this]() {
@@ -1172,8 +1885,16 @@ void Application::SetAecMode(AecMode mode) {
     });
 }
 
-void Application::PlaySound(const std::string_view& sound) {
-    audio_service_.PlaySound(sound);
+void Application::PlaySound(const std::string_view& sound, bool priority) {
+    audio_service_.PlaySound(sound, priority);
+}
+
+void Application::ReconnectProtocol() {
+    Schedule([this]() {
+        if (protocol_) {
+            protocol_->SwitchNetwork();
+        }
+    });
 }
 
 void Application::ResetProtocol() {
@@ -10,12 +10,17 @@
 #include <mutex>
 #include <deque>
 #include <memory>
+#include <array>
+#include <functional>
+#include <atomic>
+#include <unordered_map>
 
 #include "protocol.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state.h"
 #include "device_state_machine.h"
+#include "small_function.h"
 
 #if CONFIG_ENABLE_WEB_DISPLAY_SERVER
 #include "web_display_server/web_display_server.h"
@@ -36,8 +41,22 @@
 #define MAIN_EVENT_START_LISTENING      (1 << 10)
 #define MAIN_EVENT_STOP_LISTENING       (1 << 11)
 #define MAIN_EVENT_STATE_CHANGED        (1 << 12)
+#define MAIN_EVENT_SEND_TEXT            (1 << 13)
+#define MAIN_EVENT_STATUS_CHANGED       (1 << 14)
+// Not waited for by Run(), the activation task waits for it
+#define MAIN_EVENT_ASSETS_APPLIED       (1 << 15)
 
 
+// Tasks of a higher priority run first, even when they are scheduled later
+enum SchedulePriority {
+    kSchedulePriorityHigh,      // E.g. aborting speech
+    kSchedulePriorityNormal,
+    kSchedulePriorityLow,       // Display updates
+    kSchedulePriorityCount
+};
+
+using MainTask = SmallFunction<void(), 32>;
+
 enum AecMode {
     kAecOff,
     kAecOnDeviceSide,
@@ -80,7 +99,7 @@ public:
     /**
      * Schedule a callback to be executed in the main task
      */
-    void Schedule(std::function<void()>&& callback);
+    void Schedule(MainTask&& callback, SchedulePriority priority = kSchedulePriorityNormal);
 
     /**
      * Alert with status, message, emotion and optional sound
@@ -110,12 +129,27 @@ public:
 
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
-    bool UpgradeFirmware(const std::string& url, const std::string& version = "");
+    /**
+     * Runs handler on the main task when the wake word model recognizes a command with this
+     * action, without the server. volume_up, volume_down and stop are built in.
+     */
+    void AddLocalCommand(const std::string& action, std::function<void()> handler);
+    bool UpgradeFirmware(const std::string& url, const std::string& version = "", const std::string& patch_url = "",
+        const std::string& sha256 = "");
+    // Downloads and applies new assets without a reboot, once the device is idle. Thread safe
+    void UpdateAssets(const std::string& url);
     bool CanEnterSleepMode();
-    void SendMcpMessage(const std::string& payload);
+    // Redraw the status bar after a change, e.g. of the volume or the charging state
+    void RefreshStatusBar();
+    // In standby (display off) the clock tick stops until the device wakes up
+    void SetStandby(bool standby);
+    bool IsStandby() const { return standby_; }
+    void SendMcpMessage(std::string payload);
+    // MCP messages as CBOR frames from now on, if the protocol supports it
+    void SetMcpCbor(bool enable);
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
-    void PlaySound(const std::string_view& sound);
+    void PlaySound(const std::string_view& sound, bool priority = false);
     AudioService& GetAudioService() { return audio_service_; }
 
     /**
@@ -130,15 +164,24 @@ public:
      */
     void ResetProtocol();
 
+    /**
+     * Called by the board after it moved to another network interface
+     * The connections of the old interface are dropped, the next ones use Board::GetNetwork()
+     */
+    void ReconnectProtocol();
+
 private:
     Application();
     ~Application();
 
     std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    std::array<std::deque<MainTask>, kSchedulePriorityCount> main_tasks_;
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
+    // Audio channel opened on a wake word candidate, closed by the timer unless the wake word is confirmed
+    esp_timer_handle_t preconnect_timer_handle_ = nullptr;
+    bool preconnected_ = false;
     DeviceStateMachine state_machine_;
     ListeningMode listening_mode_ = kListeningModeAutoStop;
     AecMode aec_mode_ = kAecOff;
@@ -153,13 +196,38 @@ private:
 
     bool has_server_time_ = false;
     bool aborted_ = false;
+    // Later sentences of a TTS reply continue its message, only touched by the incoming message callback
+    bool assistant_message_open_ = false;
     bool assets_version_checked_ = false;
+    // Set when the assets were applied during boot instead of by the activation task
+    bool assets_applied_at_boot_ = false;
     bool play_popup_on_listening_ = false;  // Flag to play popup sound after state changes to listening
     int clock_ticks_ = 0;
+    std::atomic<bool> standby_{false};
+#if CONFIG_AUDIO_DECODE_AHEAD
+    // A reply started, its audio is decoded ahead until the speaking state takes it over
+    std::atomic<bool> stream_prepared_{false};
+#endif
     TaskHandle_t activation_task_handle_ = nullptr;
+    TaskHandle_t assets_update_task_ = nullptr;
+    std::string assets_update_url_;
+    // CONFIG_OTA_BACKGROUND_UPGRADE: the version check result, kept after ota_ is released
+    struct BackgroundUpgrade {
+        std::string url;
+        std::string version;
+        std::string patch_url;
+        std::string sha256;
+    } background_upgrade_;
+    TaskHandle_t background_upgrade_task_ = nullptr;
+    std::atomic<bool> background_upgrade_cancel_{false};
+    // Downloaded and set as the boot partition, waiting for the device to be idle
+    std::atomic<bool> upgrade_pending_{false};
+    std::unordered_map<std::string, std::function<void()>> local_commands_;
 
 
     // Event handlers
+    void RunScheduledTasks();
+    void UpdateClockTimer();
     void HandleStateChangedEvent();
     void HandleToggleChatEvent();
     void HandleStartListeningEvent();
@@ -168,6 +236,11 @@ private:
     void HandleNetworkDisconnectedEvent();
     void HandleActivationDoneEvent();
     void HandleWakeWordDetectedEvent();
+    void HandleWakeWordCandidate();
+    void CancelPreconnect();
+    void AddDefaultLocalCommands();
+    void HandleLocalCommand(const WakeWordCommand& command);
+    bool OpenAudioChannel();
     void ContinueOpenAudioChannel(ListeningMode mode);
     void ContinueWakeWordInvoke(const std::string& wake_word);
 
@@ -175,8 +248,13 @@ private:
     void ActivationTask();
 
     // Helper methods
+    void StartApplyAssets();
     void CheckAssetsVersion();
+    void AssetsUpdateTask();
     void CheckNewVersion();
+    void StartBackgroundUpgrade();
+    void BackgroundUpgradeTask();
+    bool PaceBackgroundUpgrade();
     void InitializeProtocol();
     void ShowActivationCode(const std::string& code, const std::string& message);
     void SetListeningMode(ListeningMode mode);
@@ -5,6 +5,10 @@
 #include "lvgl_theme.h"
 #include "emote_display.h"
 #include "expression_emote.h"
+#include "settings.h"
+#include "assets/lang_config.h"
+#include "task_manifest.h"
+#include "http_pool.h"
 #if HAVE_LVGL
 #include "display/lcd_display.h"
 #include <spi_flash_mmap.h>
@@ -12,12 +16,27 @@
 
 #include <esp_log.h>
 #include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
 #include <cbin_font.h>
+#include <algorithm>
+#include <cstring>
 
 
 #define TAG "Assets"
 #define PARTITION_LABEL "assets"
+// Written by build_default_assets.py, the CRC32 of each table entry, 0 for itself
+#define ASSET_CHECKSUMS_FILE "asset_checksums.bin"
+// Mapped at a time by the background verification
+#define VERIFY_WINDOW_SIZE (1024 * 1024)
+// Download blocks, one is read from the network while the other is written
+#define DOWNLOAD_BUFFER_COUNT 2
+#define DOWNLOAD_BUFFER_SIZE (16 * 1024)
+#define DOWNLOAD_ERASE_BLOCK_SIZE (64 * 1024)
+// How much has to be written before the resume offset is saved again
+#define DOWNLOAD_RESUME_SAVE_INTERVAL (256 * 1024)
 
 struct mmap_assets_table {
     char asset_name[32];          /*!< Name of the asset */
@@ -51,7 +70,68 @@ bool Assets::FindPartition(Assets* assets) {
 }
 
 bool Assets::Apply() {
-    return strategy_ ? strategy_->Apply(this) : false;
+    if (!strategy_ || !strategy_->Apply(this)) {
+        return false;
+    }
+    ApplyLanguage();
+    return true;
+}
+
+/*
+ * Runs on the audio service's first use of the models. srmodel_load() only indexes the packed
+ * file, the log shows whether every model file is still read in place from the mapping.
+ */
+srmodel_list_t* Assets::LoadModels() {
+    int64_t start = esp_timer_get_time();
+    size_t psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    models_list_ = srmodel_load(static_cast<uint8_t*>(models_data_));
+    if (models_list_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to load srmodels.bin");
+        return nullptr;
+    }
+    int psram_used = (int)psram - (int)heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    ESP_LOGI(TAG, "Parsed %d speech models in %d us, %d bytes of PSRAM", models_list_->num,
+        (int)(esp_timer_get_time() - start), psram_used);
+
+    auto begin = static_cast<const char*>(models_data_);
+    auto end = begin + models_size_;
+    for (int i = 0; i < models_list_->num; i++) {
+        auto model = models_list_->model_data != nullptr ? models_list_->model_data[i] : nullptr;
+        size_t bytes = 0;
+        bool in_place = model != nullptr;
+        for (int j = 0; model != nullptr && j < model->num; j++) {
+            bytes += model->sizes[j];
+            in_place = in_place && model->data[j] >= begin && model->data[j] + model->sizes[j] <= end;
+        }
+        ESP_LOGI(TAG, "Model %s: %u KB, %s", models_list_->model_name[i], bytes / 1024,
+            in_place ? "in place" : "copied");
+    }
+    return models_list_;
+}
+
+bool Assets::HotUpdate(const std::string& url, std::function<void(int progress, size_t speed)> progress_callback,
+    bool& models_changed) {
+    if (strategy_) {
+        strategy_->ReleaseResources(this);
+    }
+    if (models_list_ == nullptr) {
+        // Not parsed yet, the new index hands its own models to the audio service
+        Application::GetInstance().GetAudioService().SetModelsLoader(nullptr);
+        models_data_ = nullptr;
+    }
+    models_crc_ = models_list_ != nullptr
+        ? esp_rom_crc32_le(0, static_cast<const uint8_t*>(models_data_), models_size_) : 0;
+    // Unless the new index has the same models, the ones loaded are gone from the flash
+    models_changed_ = models_list_ != nullptr;
+    bool success = Download(url, progress_callback);
+    if (success) {
+        hot_updating_ = true;
+        success = Apply();
+        hot_updating_ = false;
+    }
+    // A failed download leaves the partition rewritten halfway, the models can not be trusted either
+    models_changed = models_changed_ || (!success && models_list_ != nullptr);
+    return success;
 }
 
 bool Assets::InitializePartition() {
@@ -59,6 +139,8 @@ bool Assets::InitializePartition() {
 }
 
 void Assets::UnApplyPartition() {
+    // The strings may point into the mapping
+    Lang::ResetStrings();
     if (strategy_) {
         strategy_->UnApplyPartition(this);
     }
@@ -68,6 +150,154 @@ bool Assets::GetAssetData(const std::string& name, void*& ptr, size_t& size) {
     return strategy_ ? strategy_->GetAssetData(this, name, ptr, size) : false;
 }
 
+std::vector<std::pair<std::string, std::string>> Assets::ReadLanguageFiles() {
+    std::vector<std::pair<std::string, std::string>> files;
+    void* ptr = nullptr;
+    size_t size = 0;
+    if (!partition_valid_ || !GetAssetData("index.json", ptr, size)) {
+        return files;
+    }
+    cJSON* root = cJSON_ParseWithLength(static_cast<char*>(ptr), size);
+    if (root == nullptr) {
+        return files;
+    }
+    cJSON* locales = cJSON_GetObjectItem(root, "locales");
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, locales) {
+        if (cJSON_IsString(item)) {
+            files.emplace_back(item->string, item->valuestring);
+        }
+    }
+    cJSON_Delete(root);
+    return files;
+}
+
+std::vector<std::string> Assets::GetLanguages() {
+    std::vector<std::string> languages;
+    for (auto& file : ReadLanguageFiles()) {
+        languages.push_back(file.first);
+    }
+    return languages;
+}
+
+void Assets::ApplyLanguage() {
+    Settings settings("assets", false);
+    std::string language = settings.GetString("language");
+    if (language.empty() || language == Lang::BUILTIN_CODE) {
+        Lang::ResetStrings();
+        return;
+    }
+    for (auto& file : ReadLanguageFiles()) {
+        if (file.first != language) {
+            continue;
+        }
+        void* ptr = nullptr;
+        size_t size = 0;
+        if (GetAssetData(file.second, ptr, size) && Lang::LoadStrings(ptr, size)) {
+            ESP_LOGI(TAG, "Language %s loaded from %s", language.c_str(), file.second.c_str());
+            return;
+        }
+        break;
+    }
+    ESP_LOGW(TAG, "No string table for language %s, using %s", language.c_str(), Lang::BUILTIN_CODE);
+    Lang::ResetStrings();
+}
+
+#define STRING_TABLE_MAGIC 0x4254534C  // "LSTB", see gen_lang.py
+#define STRING_TABLE_VERSION 1
+
+bool Lang::LoadStrings(const void* table, size_t size) {
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t count;
+        uint32_t code_offset;
+    } __attribute__((packed));
+    struct Entry {
+        uint32_t key_offset;
+        uint32_t value_offset;
+    } __attribute__((packed));
+
+    auto base = static_cast<const char*>(table);
+    Header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, base, sizeof(header));
+    // Every offset is checked against the size, the last string ends the table
+    if (header.magic != STRING_TABLE_MAGIC || header.version != STRING_TABLE_VERSION ||
+        sizeof(header) + header.count * sizeof(Entry) > size || base[size - 1] != '\0' ||
+        header.code_offset >= size) {
+        ESP_LOGE(TAG, "Invalid string table");
+        return false;
+    }
+    auto entry_at = [base](int index) {
+        Entry entry;
+        memcpy(&entry, base + sizeof(Header) + index * sizeof(Entry), sizeof(entry));
+        return entry;
+    };
+    for (int i = 0; i < header.count; i++) {
+        Entry entry = entry_at(i);
+        if (entry.key_offset >= size || entry.value_offset >= size) {
+            ESP_LOGE(TAG, "Invalid string table entry %d", i);
+            return false;
+        }
+    }
+
+    // Both are sorted by key, keys the table lacks keep the built-in string
+    int missing = 0;
+    for (auto& string : STRING_TABLE) {
+        int low = 0;
+        int high = header.count - 1;
+        const char* value = nullptr;
+        while (low <= high) {
+            int middle = (low + high) / 2;
+            Entry entry = entry_at(middle);
+            int order = strcmp(base + entry.key_offset, string.key);
+            if (order == 0) {
+                value = base + entry.value_offset;
+                break;
+            } else if (order < 0) {
+                low = middle + 1;
+            } else {
+                high = middle - 1;
+            }
+        }
+        if (value == nullptr) {
+            missing++;
+        }
+        *string.value = value != nullptr ? value : string.builtin;
+    }
+    CODE = base + header.code_offset;
+    if (missing > 0) {
+        ESP_LOGW(TAG, "%d strings missing from the %s table", missing, CODE);
+    }
+    return true;
+}
+
+void Lang::ResetStrings() {
+    for (auto& string : STRING_TABLE) {
+        *string.value = string.builtin;
+    }
+    CODE = BUILTIN_CODE;
+}
+
+Lang::Sound::operator std::string_view() const {
+#if CONFIG_SOUNDS_IN_ASSETS
+    // An assets partition being downloaded is not valid, the built-in prompts still play
+    auto& assets = Assets::GetInstance();
+    void* ptr = nullptr;
+    size_t size = 0;
+    if (assets.partition_valid() && assets.GetAssetData(asset, ptr, size)) {
+        return std::string_view(static_cast<const char*>(ptr), size);
+    }
+    if (builtin.empty()) {
+        ESP_LOGW(TAG, "The sound %s is not in the assets", asset);
+    }
+#endif
+    return builtin;
+}
+
 bool Assets::LoadSrmodelsFromIndex(Assets* assets, cJSON* root) {
     void* ptr = nullptr;
     size_t size = 0;
@@ -92,21 +322,32 @@ bool Assets::LoadSrmodelsFromIndex(Assets* assets, cJSON* root) {
     if (cJSON_IsString(srmodels)) {
         std::string srmodels_file = srmodels->valuestring;
         if (assets->GetAssetData(srmodels_file, ptr, size)) {
+            if (assets->hot_updating_ && assets->models_list_ != nullptr) {
+                // The running engines were built on the old models, they can not be swapped under them
+                assets->models_changed_ = ptr != assets->models_data_ || size != assets->models_size_ ||
+                    esp_rom_crc32_le(0, static_cast<const uint8_t*>(ptr), size) != assets->models_crc_;
+                if (assets->models_changed_) {
+                    ESP_LOGW(TAG, "The speech models changed, they load after a reboot");
+                }
+                if (need_delete_root) {
+                    cJSON_Delete(root);
+                }
+                return !assets->models_changed_;
+            }
             if (assets->models_list_ != nullptr) {
                 esp_srmodel_deinit(assets->models_list_);
                 assets->models_list_ = nullptr;
             }
-            assets->models_list_ = srmodel_load(static_cast<uint8_t*>(ptr));
-            if (assets->models_list_ != nullptr) {
-                auto& app = Application::GetInstance();
-                app.GetAudioService().SetModelsList(assets->models_list_);
-                if (need_delete_root) {
-                    cJSON_Delete(root);
-                }
-                return true;
-            } else {
-                ESP_LOGE(TAG, "Failed to load srmodels.bin");
+            assets->models_data_ = ptr;
+            assets->models_size_ = size;
+            // Parsed when the wake word is first enabled, off the boot path
+            Application::GetInstance().GetAudioService().SetModelsLoader([assets]() {
+                return assets->LoadModels();
+            });
+            if (need_delete_root) {
+                cJSON_Delete(root);
             }
+            return true;
         } else {
             ESP_LOGE(TAG, "The srmodels file %s is not found", srmodels_file.c_str());
         }
@@ -118,7 +359,6 @@ bool Assets::LoadSrmodelsFromIndex(Assets* assets, cJSON* root) {
     return false;
 }
 
-#if HAVE_LVGL
 uint32_t Assets::LvglStrategy::CalculateChecksum(const char* data, uint32_t length) {
     uint32_t checksum = 0;
     for (uint32_t i = 0; i < length; i++) {
@@ -127,87 +367,277 @@ uint32_t Assets::LvglStrategy::CalculateChecksum(const char* data, uint32_t leng
     return checksum & 0xFFFF;
 }
 
+#if HAVE_LVGL
+
+// Compares a name with a table entry, which is only NUL terminated when shorter than the field
+static int CompareAssetName(const std::string& name, const mmap_assets_table& item) {
+    if (name.size() > sizeof(item.asset_name)) {
+        int result = strncmp(name.c_str(), item.asset_name, sizeof(item.asset_name));
+        return result != 0 ? result : 1;
+    }
+    return strncmp(name.c_str(), item.asset_name, sizeof(item.asset_name));
+}
+
 bool Assets::LvglStrategy::InitializePartition(Assets* assets) {
+    bool download_verified = assets->download_verified_;
+    assets->download_verified_ = false;
     assets->partition_valid_ = false;
-    assets_.clear();
+    table_ = nullptr;
+    table_size_ = 0;
+    asset_checksums_ = nullptr;
 
     if (!Assets::FindPartition(assets)) {
         return false;
     }
+    partition_ = assets->partition_;
 
     int free_pages = spi_flash_mmap_get_free_pages(SPI_FLASH_MMAP_DATA);
-    uint32_t storage_size = free_pages * 64 * 1024;
-    ESP_LOGI(TAG, "The storage free size is %ld KB", storage_size / 1024);
+    ESP_LOGI(TAG, "The storage free size is %d KB", free_pages * 64);
     ESP_LOGI(TAG, "The partition size is %ld KB", assets->partition_->size / 1024);
-    if (storage_size < assets->partition_->size) {
-        ESP_LOGE(TAG, "The free size %ld KB is less than assets partition required %ld KB", storage_size / 1024, assets->partition_->size / 1024);
-        return false;
-    }
 
-    esp_err_t err = esp_partition_mmap(assets->partition_, 0, assets->partition_->size, ESP_PARTITION_MMAP_DATA, (const void**)&mmap_root_, &mmap_handle_);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to mmap assets partition: %s", esp_err_to_name(err));
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto header = MapRegion(0, 12);
+    if (header == nullptr) {
         return false;
     }
 
     assets->partition_valid_ = true;
 
-    uint32_t stored_files = *(uint32_t*)(mmap_root_ + 0);
-    uint32_t stored_chksum = *(uint32_t*)(mmap_root_ + 4);
-    uint32_t stored_len = *(uint32_t*)(mmap_root_ + 8);
+    uint32_t stored_files = *(uint32_t*)(header + 0);
+    uint32_t stored_chksum = *(uint32_t*)(header + 4);
+    uint32_t stored_len = *(uint32_t*)(header + 8);
 
-    if (stored_len > assets->partition_->size - 12) {
+    if (stored_len > assets->partition_->size - 12 || stored_files * sizeof(mmap_assets_table) > stored_len) {
         ESP_LOGD(TAG, "The stored_len (0x%lx) is greater than the partition size (0x%lx) - 12", stored_len, assets->partition_->size);
         return false;
     }
 
-    auto start_time = esp_timer_get_time();
-    uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + 12, stored_len);
-    auto end_time = esp_timer_get_time();
-    ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
-
-    if (calculated_checksum != stored_chksum) {
-        ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
+    table_ = (const mmap_assets_table*)MapRegion(12, stored_files * sizeof(mmap_assets_table));
+    if (table_ == nullptr) {
         return false;
     }
+    table_size_ = stored_files;
+    data_offset_ = 12 + stored_files * sizeof(mmap_assets_table);
+    table_sorted_ = true;
+    for (uint32_t i = 1; i < table_size_; i++) {
+        if (strncmp(table_[i - 1].asset_name, table_[i].asset_name, sizeof(table_[i].asset_name)) >= 0) {
+            table_sorted_ = false;
+            break;
+        }
+    }
+    verified_.assign(table_size_, false);
 
+    auto checksums = FindAsset(ASSET_CHECKSUMS_FILE);
+    if (checksums != nullptr && checksums->asset_size == table_size_ * sizeof(uint32_t)) {
+        asset_checksums_ = (const uint32_t*)MapRegion(data_offset_ + checksums->asset_offset + 2, checksums->asset_size);
+    }
+    ESP_LOGI(TAG, "The assets table has %lu files, %s, %s", table_size_, table_sorted_ ? "sorted" : "unsorted",
+             asset_checksums_ != nullptr ? "verified on first use" : "verified now");
+
+    if (asset_checksums_ == nullptr) {
+        // Older partitions have no per asset checksums, check everything before use as before,
+        // unless the download just summed the same bytes on their way to the flash
+        if (download_verified) {
+            ESP_LOGI(TAG, "The checksum was verified during download");
+        } else if (VerifyPartition(stored_chksum, stored_len) != kVerifyMatch) {
+            table_size_ = 0;
+            return false;
+        }
+        checksum_valid_ = true;
+        return true;
+    }
+
+    // Each asset is checked when first used, the whole partition in the background
     checksum_valid_ = true;
+    verify_cancel_ = false;
+    verify_checksum_ = stored_chksum;
+    verify_length_ = stored_len;
+    TaskManifest::Create("assets_verify", [](void* arg) {
+        auto self = static_cast<Assets::LvglStrategy*>(arg);
+        auto result = self->VerifyPartition(self->verify_checksum_, self->verify_length_);
+        {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            if (result == kVerifyMismatch) {
+                self->checksum_valid_ = false;
+            }
+            self->verify_task_ = nullptr;
+        }
+        TaskManifest::Exit();
+    }, this, &verify_task_);
+    return true;
+}
 
-    for (uint32_t i = 0; i < stored_files; i++) {
-        auto item = (const mmap_assets_table*)(mmap_root_ + 12 + i * sizeof(mmap_assets_table));
-        auto asset = Asset{
-            .size = static_cast<size_t>(item->asset_size),
-            .offset = static_cast<size_t>(12 + sizeof(mmap_assets_table) * stored_files + item->asset_offset)
-        };
-        assets_[item->asset_name] = asset;
+// Maps the pages around a region, a window already covering it is reused. Called with mutex_ held.
+const char* Assets::LvglStrategy::MapRegion(uint32_t offset, uint32_t size) {
+    uint32_t start = offset & ~(SPI_FLASH_MMU_PAGE_SIZE - 1);
+    uint32_t end = std::min<uint32_t>((offset + size + SPI_FLASH_MMU_PAGE_SIZE - 1) & ~(SPI_FLASH_MMU_PAGE_SIZE - 1),
+                                      partition_->size);
+    if (offset + size > partition_->size) {
+        ESP_LOGE(TAG, "The region 0x%lx+0x%lx is outside the assets partition", offset, size);
+        return nullptr;
     }
-    return checksum_valid_;
+    for (auto& window : windows_) {
+        if (window.offset <= start && window.offset + window.size >= end) {
+            return window.ptr + (offset - window.offset);
+        }
+    }
+
+    MmapWindow window = {.offset = start, .size = end - start};
+    esp_err_t err = esp_partition_mmap(partition_, start, end - start, ESP_PARTITION_MMAP_DATA,
+                                       (const void**)&window.ptr, &window.handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mmap assets 0x%lx+0x%lx: %s", start, end - start, esp_err_to_name(err));
+        return nullptr;
+    }
+    windows_.push_back(window);
+    ESP_LOGD(TAG, "Mapped assets 0x%lx+0x%lx, %u windows", start, end - start, windows_.size());
+    return window.ptr + (offset - start);
+}
+
+// Sums the stored data through a small temporary window, like CalculateChecksum over the whole partition
+Assets::LvglStrategy::VerifyResult Assets::LvglStrategy::VerifyPartition(uint32_t stored_chksum, uint32_t stored_len) {
+    auto start_time = esp_timer_get_time();
+    uint32_t checksum = 0;
+    uint32_t position = 12;
+    uint32_t end = 12 + stored_len;
+    while (position < end) {
+        if (verify_cancel_) {
+            return kVerifyCancelled;
+        }
+        uint32_t start = position & ~(SPI_FLASH_MMU_PAGE_SIZE - 1);
+        uint32_t length = std::min<uint32_t>(VERIFY_WINDOW_SIZE, end - start);
+        const char* ptr = nullptr;
+        esp_partition_mmap_handle_t handle;
+        if (esp_partition_mmap(partition_, start, length, ESP_PARTITION_MMAP_DATA, (const void**)&ptr, &handle) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to mmap assets for verification");
+            return kVerifyCancelled;
+        }
+        checksum += CalculateChecksum(ptr + (position - start), start + length - position);
+        esp_partition_munmap(handle);
+        position = start + length;
+    }
+    checksum &= 0xFFFF;
+    ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((esp_timer_get_time() - start_time) / 1000));
+    if (checksum != stored_chksum) {
+        ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", checksum, stored_chksum);
+        return kVerifyMismatch;
+    }
+    return kVerifyMatch;
+}
+
+// The table entry of an asset, nullptr when there is none. Called with mutex_ held.
+const mmap_assets_table* Assets::LvglStrategy::FindAsset(const std::string& name) const {
+    if (table_sorted_) {
+        uint32_t low = 0;
+        uint32_t high = table_size_;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            int result = CompareAssetName(name, table_[mid]);
+            if (result == 0) {
+                return &table_[mid];
+            }
+            if (result < 0) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < table_size_; i++) {
+        if (CompareAssetName(name, table_[i]) == 0) {
+            return &table_[i];
+        }
+    }
+    return nullptr;
 }
 
 void Assets::LvglStrategy::UnApplyPartition(Assets* assets) {
-    if (mmap_handle_ != 0) {
-        esp_partition_munmap(mmap_handle_);
-        mmap_handle_ = 0;
-        mmap_root_ = nullptr;
+    // The verification maps the partition too, it has to end before the partition is rewritten
+    verify_cancel_ = true;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (verify_task_ == nullptr) {
+                break;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The speech models run straight from the mapping, their pages stay mapped while they are loaded
+    auto models = static_cast<const char*>(assets->models_data_);
+    auto in_use = [&](const MmapWindow& window) {
+        return assets->models_list_ != nullptr && models < window.ptr + window.size &&
+               models + assets->models_size_ > window.ptr;
+    };
+    for (auto it = windows_.begin(); it != windows_.end();) {
+        if (in_use(*it)) {
+            ++it;
+            continue;
+        }
+        esp_partition_munmap(it->handle);
+        it = windows_.erase(it);
     }
     checksum_valid_ = false;
-    assets_.clear();
+    table_ = nullptr;
+    table_size_ = 0;
+    asset_checksums_ = nullptr;
+    verified_.clear();
+}
+
+void Assets::LvglStrategy::ReleaseResources(Assets* assets) {
+    auto& theme_manager = LvglThemeManager::GetInstance();
+    for (auto name : {"light", "dark"}) {
+        auto theme = theme_manager.GetTheme(name);
+        if (theme == nullptr) {
+            continue;
+        }
+        if (builtin_text_font_ != nullptr) {
+            theme->set_text_font(builtin_text_font_);
+        }
+        theme->set_emoji_collection(nullptr);
+        theme->set_background_image(nullptr);
+    }
+
+    // Restyled with the built-in font and no background, the emotion falls back to an icon
+    auto display = Board::GetInstance().GetDisplay();
+    if (display->GetTheme() != nullptr) {
+        display->SetTheme(display->GetTheme());
+    }
+    display->ClearChatMessages();
+    display->SetEmotion("neutral");
     (void)assets; // Unused parameter
 }
 
 bool Assets::LvglStrategy::GetAssetData(Assets* assets, const std::string& name, void*& ptr, size_t& size) {
-    auto asset = assets_.find(name);
-    if (asset == assets_.end()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto item = FindAsset(name);
+    if (item == nullptr) {
+        return false;
+    }
+    auto data = MapRegion(data_offset_ + item->asset_offset, item->asset_size + 2);
+    if (data == nullptr) {
         return false;
     }
-    auto data = (const char*)(mmap_root_ + asset->second.offset);
     if (data[0] != 'Z' || data[1] != 'Z') {
         ESP_LOGE(TAG, "The asset %s is not valid with magic %02x%02x", name.c_str(), data[0], data[1]);
         return false;
     }
 
+    uint32_t index = item - table_;
+    if (asset_checksums_ != nullptr && !verified_[index] && name != ASSET_CHECKSUMS_FILE) {
+        uint32_t checksum = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(data + 2), item->asset_size);
+        if (checksum != asset_checksums_[index]) {
+            ESP_LOGE(TAG, "The asset %s is corrupted, checksum 0x%lx, expected 0x%lx", name.c_str(), checksum, asset_checksums_[index]);
+            return false;
+        }
+        verified_[index] = true;
+    }
+
     ptr = static_cast<void*>(const_cast<char*>(data + 2));
-    size = asset->second.size;
+    size = item->asset_size;
     return true;
 }
 
@@ -248,6 +678,23 @@ bool Assets::LvglStrategy::Apply(Assets* assets) {
                 ESP_LOGE(TAG, "Failed to load fonts.bin");
                 return false;
             }
+            // A font subset by build_default_assets.py leaves rare characters to the built-in font
+            auto base_theme = light_theme != nullptr ? light_theme : dark_theme;
+            if (builtin_text_font_ == nullptr && base_theme != nullptr &&
+                std::dynamic_pointer_cast<LvglBuiltInFont>(base_theme->text_font()) != nullptr) {
+                builtin_text_font_ = base_theme->text_font();
+            }
+            if (builtin_text_font_ != nullptr) {
+                text_font->SetFallback(builtin_text_font_->font());
+            }
+            // The locale's most frequent characters, listed by build_default_assets.py
+            cJSON* glyph_warmup = cJSON_GetObjectItem(root, "glyph_warmup");
+            void* warmup_ptr = nullptr;
+            size_t warmup_size = 0;
+            if (cJSON_IsString(glyph_warmup) && assets->GetAssetData(glyph_warmup->valuestring, warmup_ptr, warmup_size)) {
+                DisplayLockGuard lock(Board::GetInstance().GetDisplay());
+                text_font->Warmup(std::string_view(static_cast<const char*>(warmup_ptr), warmup_size));
+            }
             if (light_theme != nullptr) {
                 light_theme->set_text_font(text_font);
             }
@@ -423,135 +870,567 @@ bool Assets::EmoteStrategy::Apply(Assets* assets) {
     return true;
 }
 
+/*
+ * Writes the downloaded blocks on its own task, so the next block is read from the network
+ * while this one is erased and written. Erases run ahead of the writes, a 64 KB block at a
+ * time where the offset is aligned, single sectors otherwise.
+ */
+class AssetsFlashWriter {
+public:
+    AssetsFlashWriter(const esp_partition_t* partition, size_t offset, size_t end)
+        : partition_(partition), written_(offset), erased_(offset), end_(end) {
+        sector_size_ = esp_partition_get_main_flash_sector_size();
+        free_queue_ = xQueueCreate(DOWNLOAD_BUFFER_COUNT, sizeof(char*));
+        filled_queue_ = xQueueCreate(DOWNLOAD_BUFFER_COUNT + 1, sizeof(Block));
+        done_ = xSemaphoreCreateBinary();
+        for (int i = 0; i < DOWNLOAD_BUFFER_COUNT; i++) {
+            // The flash driver bounces PSRAM buffers through internal RAM itself
+            buffers_[i] = (char*)heap_caps_malloc(DOWNLOAD_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (buffers_[i] == nullptr) {
+                buffers_[i] = (char*)heap_caps_malloc(DOWNLOAD_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            }
+            if (buffers_[i] == nullptr) {
+                ESP_LOGE(TAG, "Failed to allocate buffer");
+                return;
+            }
+            xQueueSend(free_queue_, &buffers_[i], 0);
+        }
+        started_ = TaskManifest::Create("assets_writer", [](void* arg) {
+            static_cast<AssetsFlashWriter*>(arg)->WriterTask();
+        }, this) == pdPASS;
+    }
+
+    ~AssetsFlashWriter() {
+        Finish();
+        for (int i = 0; i < DOWNLOAD_BUFFER_COUNT; i++) {
+            heap_caps_free(buffers_[i]);
+        }
+        vQueueDelete(free_queue_);
+        vQueueDelete(filled_queue_);
+        vSemaphoreDelete(done_);
+    }
+
+    bool valid() const { return started_; }
+    bool failed() const { return failed_; }
+    // Everything below this is in flash
+    size_t written() const { return written_; }
+
+    // Waits for a free buffer of DOWNLOAD_BUFFER_SIZE
+    char* Acquire() {
+        char* buffer = nullptr;
+        xQueueReceive(free_queue_, &buffer, portMAX_DELAY);
+        return buffer;
+    }
+
+    // Queues the buffer for writing at the end of what was queued before
+    void Submit(char* buffer, size_t length) {
+        Block block = {buffer, length};
+        xQueueSend(filled_queue_, &block, portMAX_DELAY);
+    }
+
+    // Waits until everything queued is written
+    void Finish() {
+        if (!started_ || finished_) {
+            return;
+        }
+        finished_ = true;
+        Block block = {nullptr, 0};
+        xQueueSend(filled_queue_, &block, portMAX_DELAY);
+        xSemaphoreTake(done_, portMAX_DELAY);
+    }
+
+private:
+    struct Block {
+        char* data;
+        size_t length;
+    };
+
+    const esp_partition_t* partition_;
+    size_t sector_size_;
+    std::atomic<size_t> written_;
+    size_t erased_;
+    size_t end_;
+    char* buffers_[DOWNLOAD_BUFFER_COUNT] = {};
+    QueueHandle_t free_queue_;
+    QueueHandle_t filled_queue_;
+    SemaphoreHandle_t done_;
+    bool started_ = false;
+    bool finished_ = false;
+    std::atomic<bool> failed_ = false;
+
+    bool EraseUpTo(size_t offset) {
+        while (erased_ < offset) {
+            size_t size = sector_size_;
+            if (erased_ % DOWNLOAD_ERASE_BLOCK_SIZE == 0 && erased_ + DOWNLOAD_ERASE_BLOCK_SIZE <= end_) {
+                size = DOWNLOAD_ERASE_BLOCK_SIZE;
+            }
+            if (erased_ + size > partition_->size) {
+                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", erased_ + size, partition_->size);
+                return false;
+            }
+            esp_err_t err = esp_partition_erase_range(partition_, erased_, size);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to erase %u bytes at offset %u: %s", size, erased_, esp_err_to_name(err));
+                return false;
+            }
+            erased_ += size;
+        }
+        return true;
+    }
+
+    void WriterTask() {
+        Block block;
+        while (xQueueReceive(filled_queue_, &block, portMAX_DELAY) == pdPASS && block.data != nullptr) {
+            if (!failed_ && block.length > 0) {
+                size_t offset = written_;
+                if (!EraseUpTo(offset + block.length)) {
+                    failed_ = true;
+                } else {
+                    esp_err_t err = esp_partition_write(partition_, offset, block.data, block.length);
+                    if (err != ESP_OK) {
+                        ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", offset, esp_err_to_name(err));
+                        failed_ = true;
+                    } else {
+                        written_ = offset + block.length;
+                    }
+                }
+            }
+            xQueueSend(free_queue_, &block.data, portMAX_DELAY);
+        }
+        xSemaphoreGive(done_);
+        TaskManifest::Exit();
+    }
+};
+
+/*
+ * Reads an assets image over HTTP Range requests, a seek to anywhere but the current position
+ * opens a new request.
+ */
+class AssetsRangeReader {
+public:
+    explicit AssetsRangeReader(const std::string& url) : url_(url) {}
+
+    // False when the server does not serve ranges for the file
+    bool Read(size_t offset, void* buffer, size_t length) {
+        if (http_ == nullptr || offset != position_) {
+            if (http_ != nullptr) {
+                http_->Close();
+            }
+            http_ = HttpPool::GetInstance().CreateStreamingHttp(0);
+            http_->SetHeader("Range", "bytes=" + std::to_string(offset) + "-");
+            if (!http_->Open("GET", url_) || http_->GetStatusCode() != 206) {
+                ESP_LOGW(TAG, "Range request at %u failed, status code: %d", offset, http_->GetStatusCode());
+                http_.reset();
+                return false;
+            }
+            position_ = offset;
+        }
+        size_t done = 0;
+        while (done < length) {
+            int ret = http_->Read(static_cast<char*>(buffer) + done, length - done);
+            if (ret <= 0) {
+                ESP_LOGE(TAG, "Failed to read HTTP data at %u", position_);
+                http_.reset();
+                return false;
+            }
+            done += ret;
+            position_ += ret;
+        }
+        bytes_read_ += length;
+        return true;
+    }
+
+    size_t bytes_read() const { return bytes_read_; }
+
+private:
+    std::string url_;
+    std::unique_ptr<Http> http_;
+    size_t position_ = 0;
+    size_t bytes_read_ = 0;
+};
+
+// The header, table and per asset CRCs of an assets image
+struct AssetsImageIndex {
+    uint32_t files = 0;
+    uint32_t checksum = 0;
+    uint32_t length = 0;
+    std::vector<mmap_assets_table> table;
+    std::vector<uint32_t> crcs;
+
+    uint32_t data_offset() const { return 12 + files * sizeof(mmap_assets_table); }
+    uint32_t size() const { return 12 + length; }
+
+    // Reads through read(offset, buffer, length), false when the image has no per asset CRCs
+    template <typename Read>
+    bool Load(Read&& read, size_t max_size) {
+        uint32_t header[3];
+        if (!read(0, header, sizeof(header))) {
+            return false;
+        }
+        files = header[0];
+        checksum = header[1];
+        length = header[2];
+        if (length > max_size - 12 || files * sizeof(mmap_assets_table) > length) {
+            return false;
+        }
+        table.resize(files);
+        if (!read(12, table.data(), files * sizeof(mmap_assets_table))) {
+            return false;
+        }
+        for (auto& item : table) {
+            if (strncmp(item.asset_name, ASSET_CHECKSUMS_FILE, sizeof(item.asset_name)) == 0 &&
+                item.asset_size == files * sizeof(uint32_t)) {
+                crcs.resize(files);
+                return read(data_offset() + item.asset_offset + 2, crcs.data(), item.asset_size);
+            }
+        }
+        return false;
+    }
+};
+
+/*
+ * Rewrites the partition into the new image sector by sector, taking each asset from the old
+ * image when an asset with the same size and CRC is still in flash and downloading the rest.
+ * Sectors whose content does not change are not erased. The header sector is erased first
+ * and written last, so an interrupted update leaves no index pointing at mixed content.
+ */
+Assets::DeltaResult Assets::DownloadDelta(const std::string& url, std::function<void(int progress, size_t speed)> progress_callback) {
+    {
+        // An interrupted full download has left the old image unusable
+        Settings settings("assets", false);
+        if (!settings.GetString("resume_url").empty()) {
+            return kDeltaUnavailable;
+        }
+    }
+
+    AssetsImageIndex old_index;
+    auto read_flash = [this](size_t offset, void* buffer, size_t length) {
+        return esp_partition_read(partition_, offset, buffer, length) == ESP_OK;
+    };
+    if (!old_index.Load(read_flash, partition_->size)) {
+        return kDeltaUnavailable;
+    }
+
+    AssetsRangeReader reader(url);
+    AssetsImageIndex new_index;
+    if (!new_index.Load([&reader](size_t offset, void* buffer, size_t length) {
+            return reader.Read(offset, buffer, length);
+        }, partition_->size)) {
+        return kDeltaUnavailable;
+    }
+    if (new_index.size() > partition_->size) {
+        return kDeltaUnavailable;
+    }
+
+    const size_t sector_size = esp_partition_get_main_flash_sector_size();
+    std::vector<uint8_t> sector(sector_size);
+    std::vector<uint8_t> current(sector_size);
+
+    // Where each new asset comes from, the old assets are checked against their CRC first
+    struct Segment {
+        uint32_t offset;
+        uint32_t length;
+        int32_t old_offset;  // -1 to download
+    };
+    std::vector<Segment> segments;
+    segments.push_back({0, new_index.data_offset(), -1});
+    size_t reused_bytes = 0;
+    for (uint32_t i = 0; i < new_index.files; i++) {
+        auto& item = new_index.table[i];
+        Segment segment = {new_index.data_offset() + item.asset_offset, item.asset_size + 2, -1};
+        for (uint32_t j = 0; new_index.crcs[i] != 0 && j < old_index.files; j++) {
+            auto& old_item = old_index.table[j];
+            if (old_item.asset_size != item.asset_size || old_index.crcs[j] != new_index.crcs[i]) {
+                continue;
+            }
+            uint32_t old_offset = old_index.data_offset() + old_item.asset_offset;
+            uint32_t crc = 0;
+            bool ok = true;
+            for (uint32_t done = 0; ok && done < old_item.asset_size; done += sector_size) {
+                uint32_t length = std::min<uint32_t>(sector_size, old_item.asset_size - done);
+                ok = read_flash(old_offset + 2 + done, sector.data(), length);
+                crc = esp_rom_crc32_le(crc, sector.data(), length);
+            }
+            if (ok && crc == new_index.crcs[i]) {
+                segment.old_offset = old_offset;
+                reused_bytes += segment.length;
+                break;
+            }
+        }
+        segments.push_back(segment);
+    }
+    std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) {
+        return a.offset < b.offset;
+    });
+    ESP_LOGI(TAG, "Delta update: %u of %lu bytes are kept from the current assets", reused_bytes, new_index.size());
+
+    // From here on the old image is being replaced
+    size_t sector_count = (new_index.size() + sector_size - 1) / sector_size;
+    std::vector<bool> rewritten((partition_->size + sector_size - 1) / sector_size, false);
+    std::vector<uint8_t> old_header(sector_size);
+    if (!read_flash(0, old_header.data(), sector_size) || esp_partition_erase_range(partition_, 0, sector_size) != ESP_OK) {
+        return kDeltaFailed;
+    }
+    // The old header sector is only in RAM now
+    auto read_old = [&](uint32_t offset, uint8_t* buffer, uint32_t length) {
+        if (offset < sector_size) {
+            uint32_t n = std::min<uint32_t>(length, sector_size - offset);
+            memcpy(buffer, old_header.data() + offset, n);
+            offset += n;
+            buffer += n;
+            length -= n;
+        }
+        return length == 0 || read_flash(offset, buffer, length);
+    };
+    auto old_intact = [&](uint32_t offset, uint32_t length) {
+        for (uint32_t s = std::max<uint32_t>(offset / sector_size, 1); s <= (offset + length - 1) / sector_size; s++) {
+            if (rewritten[s]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    auto last_calc_time = esp_timer_get_time();
+    size_t last_bytes_read = reader.bytes_read();
+    for (size_t n = 1; n <= sector_count; n++) {
+        // The header sector goes last
+        size_t s = n % sector_count;
+        uint32_t start = s * sector_size;
+        uint32_t end = std::min<uint32_t>(start + sector_size, new_index.size());
+        memset(sector.data(), 0xFF, sector_size);
+
+        auto segment = std::upper_bound(segments.begin(), segments.end(), start, [](uint32_t offset, const Segment& segment) {
+            return offset < segment.offset;
+        });
+        if (segment != segments.begin()) {
+            segment--;
+        }
+        for (; segment != segments.end() && segment->offset < end; segment++) {
+            uint32_t from = std::max(start, segment->offset);
+            uint32_t to = std::min(end, segment->offset + segment->length);
+            if (from >= to) {
+                continue;
+            }
+            uint8_t* buffer = sector.data() + (from - start);
+            bool ok = false;
+            if (segment->old_offset >= 0) {
+                uint32_t old_offset = segment->old_offset + (from - segment->offset);
+                ok = old_intact(old_offset, to - from) && read_old(old_offset, buffer, to - from);
+            }
+            if (!ok && !reader.Read(from, buffer, to - from)) {
+                return kDeltaFailed;
+            }
+        }
+
+        bool unchanged = s != 0 && read_flash(start, current.data(), sector_size) &&
+                         memcmp(current.data(), sector.data(), sector_size) == 0;
+        if (!unchanged) {
+            if (s != 0 && esp_partition_erase_range(partition_, start, sector_size) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to erase sector at offset %lu", start);
+                return kDeltaFailed;
+            }
+            if (esp_partition_write(partition_, start, sector.data(), sector_size) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to write to assets partition at offset %lu", start);
+                return kDeltaFailed;
+            }
+            rewritten[s] = true;
+        }
+
+        if (esp_timer_get_time() - last_calc_time >= 1000000 || n == sector_count) {
+            size_t progress = n * 100 / sector_count;
+            size_t speed = reader.bytes_read() - last_bytes_read;
+            ESP_LOGI(TAG, "Delta progress: %u%%, downloaded %u bytes, speed: %u B/s", progress, reader.bytes_read(), speed);
+            if (progress_callback) {
+                progress_callback(progress, speed);
+            }
+            last_calc_time = esp_timer_get_time();
+            last_bytes_read = reader.bytes_read();
+        }
+    }
+
+    ESP_LOGI(TAG, "Delta update completed, downloaded %u of %lu bytes", reader.bytes_read(), new_index.size());
+    return kDeltaDone;
+}
+
 bool Assets::Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback) {
     ESP_LOGI(TAG, "Downloading new version of assets from %s", url.c_str());
 
     // 取消当前资源分区的内存映射
     UnApplyPartition();
 
+    // Only the assets that changed are downloaded when both images carry per asset CRCs
+    switch (DownloadDelta(url, progress_callback)) {
+        case kDeltaDone:
+            if (!InitializePartition()) {
+                ESP_LOGE(TAG, "Failed to re-initialize assets partition");
+                return false;
+            }
+            return true;
+        case kDeltaFailed:
+            return false;
+        case kDeltaUnavailable:
+            break;
+    }
+
+    // An interrupted download of the same file continues where the flash was last known good
+    size_t resume_offset = 0;
+    size_t resume_size = 0;
+    {
+        Settings settings("assets", false);
+        if (settings.GetString("resume_url") == url) {
+            resume_offset = settings.GetInt("resume_offset", 0);
+            resume_size = settings.GetInt("resume_size", 0);
+        }
+    }
+    if (resume_offset >= resume_size) {
+        resume_offset = 0;
+    }
+
     // 下载新的资源文件
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
+    auto http = HttpPool::GetInstance().CreateStreamingHttp(0);
+    if (resume_offset > 0) {
+        http->SetHeader("Range", "bytes=" + std::to_string(resume_offset) + "-");
+    }
     
     if (!http->Open("GET", url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
     }
 
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get assets, status code: %d", http->GetStatusCode());
+    int status_code = http->GetStatusCode();
+    if (status_code == 200) {
+        // The server ignored the range, or there was nothing to resume
+        resume_offset = 0;
+    } else if (status_code != 206 || resume_offset == 0) {
+        ESP_LOGE(TAG, "Failed to get assets, status code: %d", status_code);
         return false;
     }
 
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
+    size_t content_length = resume_offset + http->GetBodyLength();
+    if (content_length == resume_offset) {
         ESP_LOGE(TAG, "Failed to get content length");
         return false;
     }
+    if (resume_offset > 0 && content_length != resume_size) {
+        // The file changed since the last attempt
+        ESP_LOGW(TAG, "Assets size changed from %u to %u, downloading again", resume_size, content_length);
+        http->Close();
+        Settings settings("assets", true);
+        settings.EraseKey("resume_url");
+        return Download(url, progress_callback);
+    }
 
     if (content_length > partition_->size) {
         ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", content_length, partition_->size);
         return false;
     }
 
-    // 定义扇区大小为4KB（ESP32的标准扇区大小）
-    const size_t SECTOR_SIZE = esp_partition_get_main_flash_sector_size();
-    
-    // 计算需要擦除的扇区数量
-    size_t sectors_to_erase = (content_length + SECTOR_SIZE - 1) / SECTOR_SIZE; // 向上取整
-    size_t total_erase_size = sectors_to_erase * SECTOR_SIZE;
-    
-    ESP_LOGI(TAG, "Sector size: %u, content length: %u, sectors to erase: %u, total erase size: %u", 
-             SECTOR_SIZE, content_length, sectors_to_erase, total_erase_size);
-    
-    // 写入新的资源文件到分区，一边erase一边写入
-    char* buffer = (char*)heap_caps_malloc(SECTOR_SIZE, MALLOC_CAP_INTERNAL);
-    if (buffer == nullptr) {
-        ESP_LOGE(TAG, "Failed to allocate buffer");
+    if (resume_offset > 0) {
+        ESP_LOGI(TAG, "Resuming assets download at %u of %u bytes", resume_offset, content_length);
+    } else {
+        Settings settings("assets", true);
+        settings.SetString("resume_url", url);
+        settings.SetInt("resume_size", content_length);
+        settings.SetInt("resume_offset", 0);
+    }
+
+    AssetsFlashWriter writer(partition_, resume_offset, content_length);
+    if (!writer.valid()) {
         return false;
     }
-    size_t total_written = 0;
-    size_t recent_written = 0;
-    size_t current_sector = 0;
+
+    size_t total_read = resume_offset;
+    size_t saved_offset = resume_offset;
+    size_t recent_read = 0;
     auto last_calc_time = esp_timer_get_time();
-    
-    while (true) {
-        int ret = http->Read(buffer, SECTOR_SIZE);
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            heap_caps_free(buffer);
-            return false;
-        }
+    bool read_ok = true;
+    // The partition checksum is summed while the writer task is busy with the previous block,
+    // a resumed download missed the start and leaves it to InitializePartition()
+    bool summing = resume_offset == 0;
+    uint32_t image_header[3] = {};  // files, checksum, length
+    uint32_t checksum = 0;
 
-        if (ret == 0) {
-            break;
+    while (total_read < content_length && !writer.failed()) {
+        // Fill a whole buffer, so flash writes stay large
+        char* buffer = writer.Acquire();
+        size_t length = 0;
+        while (length < DOWNLOAD_BUFFER_SIZE && total_read + length < content_length) {
+            int ret = http->Read(buffer + length, DOWNLOAD_BUFFER_SIZE - length);
+            if (ret <= 0) {
+                if (ret < 0) {
+                    ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+                }
+                read_ok = false;
+                break;
+            }
+            length += ret;
         }
-
-        // 检查是否需要擦除新的扇区
-        size_t write_end_offset = total_written + ret;
-        size_t needed_sectors = (write_end_offset + SECTOR_SIZE - 1) / SECTOR_SIZE;
-        
-        // 擦除需要的新扇区
-        while (current_sector < needed_sectors) {
-            size_t sector_start = current_sector * SECTOR_SIZE;
-            size_t sector_end = (current_sector + 1) * SECTOR_SIZE;
-            
-            // 确保擦除范围不超过分区大小
-            if (sector_end > partition_->size) {
-                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", sector_end, partition_->size);
-                heap_caps_free(buffer);
-                return false;
+        if (summing) {
+            if (total_read == 0) {
+                summing = length >= sizeof(image_header);
+                memcpy(image_header, buffer, std::min(length, sizeof(image_header)));
             }
-            
-            ESP_LOGD(TAG, "Erasing sector %u (offset: %u, size: %u)", current_sector, sector_start, SECTOR_SIZE);
-            esp_err_t err = esp_partition_erase_range(partition_, sector_start, SECTOR_SIZE);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to erase sector %u at offset %u: %s", current_sector, sector_start, esp_err_to_name(err));
-                heap_caps_free(buffer);
-                return false;
+            size_t begin = std::max<size_t>(total_read, sizeof(image_header));
+            size_t end = std::min<size_t>(total_read + length, sizeof(image_header) + image_header[2]);
+            if (summing && begin < end) {
+                checksum += LvglStrategy::CalculateChecksum(buffer + (begin - total_read), end - begin);
             }
-            
-            current_sector++;
         }
-
-        // 写入数据到分区
-        esp_err_t err = esp_partition_write(partition_, total_written, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", total_written, esp_err_to_name(err));
-            heap_caps_free(buffer);
-            return false;
+        writer.Submit(buffer, length);
+        total_read += length;
+        recent_read += length;
+        if (!read_ok) {
+            break;
         }
 
-        total_written += ret;
-        recent_written += ret;
+        // Remember what is safely in flash now and then, not on every block to spare the NVS
+        size_t written = writer.written() / DOWNLOAD_ERASE_BLOCK_SIZE * DOWNLOAD_ERASE_BLOCK_SIZE;
+        if (written >= saved_offset + DOWNLOAD_RESUME_SAVE_INTERVAL) {
+            Settings settings("assets", true);
+            settings.SetInt("resume_offset", written);
+            saved_offset = written;
+        }
 
         // 计算进度和速度
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || total_written == content_length || ret == 0) {
-            size_t progress = total_written * 100 / content_length;
-            size_t speed = recent_written; // 每秒的字节数
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s, Sectors erased: %u", 
-                     progress, total_written, content_length, speed, current_sector);
+        if (esp_timer_get_time() - last_calc_time >= 1000000 || total_read == content_length) {
+            size_t progress = total_read * 100 / content_length;
+            size_t speed = recent_read; // 每秒的字节数
+            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s, Written: %u",
+                     progress, total_read, content_length, speed, writer.written());
             if (progress_callback) {
                 progress_callback(progress, speed);
             }
             last_calc_time = esp_timer_get_time();
-            recent_written = 0; // 重置最近写入的字节数
+            recent_read = 0; // 重置最近读取的字节数
         }
     }
-    
+
     http->Close();
-    heap_caps_free(buffer);
+    writer.Finish();
 
+    size_t total_written = writer.written();
     if (total_written != content_length) {
         ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", total_written, content_length);
+        Settings settings("assets", true);
+        settings.SetInt("resume_offset", total_written / DOWNLOAD_ERASE_BLOCK_SIZE * DOWNLOAD_ERASE_BLOCK_SIZE);
         return false;
     }
 
-    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes, total sectors erased: %u", 
-             total_written, current_sector);
+    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes", total_written);
+    download_verified_ = summing && sizeof(image_header) + image_header[2] <= total_written &&
+                         (checksum & 0xFFFF) == image_header[1];
 
     // 重新初始化资源分区
-    if (!InitializePartition()) {
+    bool initialized = InitializePartition();
+    {
+        // A complete file that does not verify is downloaded from the start next time
+        Settings settings("assets", true);
+        settings.EraseKey("resume_url");
+        settings.EraseKey("resume_size");
+        settings.EraseKey("resume_offset");
+    }
+    if (!initialized) {
         ESP_LOGE(TAG, "Failed to re-initialize assets partition");
         return false;
     }
@@ -4,21 +4,24 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #include <cJSON.h>
 #include <esp_partition.h>
 #include <model_path.h>
-#include <map>
-#include <string>
 
 #if HAVE_LVGL
 #include <spi_flash_mmap.h>
 #endif
 
-struct Asset {
-    size_t size;
-    size_t offset;
-};
+// An entry of the table at the start of the assets partition
+struct mmap_assets_table;
+class LvglFont;
 
 class Assets {
 public:
@@ -30,7 +33,18 @@ public:
 
     bool Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback);
     bool Apply();
+    /*
+     * Download() and Apply() while the device runs, with the wake word and voice processing stopped
+     * by the caller. The display drops the fonts, emoji and images of the old partition first and
+     * rebuilds them from the new index. The speech models stay mapped and keep running when the new
+     * image has the same ones at the same place; otherwise models_changed is set and the new models
+     * only load after a reboot, the old ones must not run again.
+     */
+    bool HotUpdate(const std::string& url, std::function<void(int progress, size_t speed)> progress_callback,
+        bool& models_changed);
     bool GetAssetData(const std::string& name, void*& ptr, size_t& size);
+    // Locales with a string table in the assets, switched to at runtime by the "language" setting
+    std::vector<std::string> GetLanguages();
 
     inline bool partition_valid() const { return partition_valid_; }
     inline std::string default_assets_url() const { return default_assets_url_; }
@@ -40,10 +54,18 @@ private:
     Assets(const Assets&) = delete;
     Assets& operator=(const Assets&) = delete;
 
+    enum DeltaResult { kDeltaDone, kDeltaFailed, kDeltaUnavailable };
+
     bool InitializePartition();
     void UnApplyPartition();
+    // kDeltaUnavailable when nothing was written and a full download is needed
+    DeltaResult DownloadDelta(const std::string& url, std::function<void(int progress, size_t speed)> progress_callback);
     static bool FindPartition(Assets* assets);
     static bool LoadSrmodelsFromIndex(Assets* assets, cJSON* root = nullptr);
+    // Code -> file of the string tables in index.json
+    std::vector<std::pair<std::string, std::string>> ReadLanguageFiles();
+    void ApplyLanguage();
+    srmodel_list_t* LoadModels();
   
     class AssetStrategy {
     public:
@@ -52,6 +74,8 @@ private:
         virtual bool InitializePartition(Assets* assets) = 0;
         virtual void UnApplyPartition(Assets* assets) = 0;
         virtual bool GetAssetData(Assets* assets, const std::string& name, void*& ptr, size_t& size) = 0;
+        // Before a hot update: nothing outside the strategy may point into the partition afterwards
+        virtual void ReleaseResources(Assets* assets) {}
     };
     
     class LvglStrategy : public AssetStrategy {
@@ -60,12 +84,42 @@ private:
         bool InitializePartition(Assets* assets) override;
         void UnApplyPartition(Assets* assets) override;
         bool GetAssetData(Assets* assets, const std::string& name, void*& ptr, size_t& size) override;
-    private:
+        void ReleaseResources(Assets* assets) override;
+        // The 16-bit sum of the header, also taken over a download as it streams in
         static uint32_t CalculateChecksum(const char* data, uint32_t length);
-        std::map<std::string, Asset> assets_;
-        esp_partition_mmap_handle_t mmap_handle_ = 0;
-        const char* mmap_root_ = nullptr;
+    private:
+        enum VerifyResult { kVerifyMatch, kVerifyMismatch, kVerifyCancelled };
+        // Only the pages of the table and of the assets in use are mapped
+        struct MmapWindow {
+            uint32_t offset;
+            uint32_t size;
+            const char* ptr;
+            esp_partition_mmap_handle_t handle;
+        };
+
+        const char* MapRegion(uint32_t offset, uint32_t size);
+        const mmap_assets_table* FindAsset(const std::string& name) const;
+        VerifyResult VerifyPartition(uint32_t stored_chksum, uint32_t stored_len);
+
+        const esp_partition_t* partition_ = nullptr;
+        std::mutex mutex_;
+        std::vector<MmapWindow> windows_;
+        // The asset table is read in place from the mmapped partition
+        const mmap_assets_table* table_ = nullptr;
+        uint32_t table_size_ = 0;
+        uint32_t data_offset_ = 0;
+        // Tables packed by build_default_assets.py are sorted by name, others are scanned
+        bool table_sorted_ = false;
+        // Per asset checksums, nullptr for partitions packed without them
+        const uint32_t* asset_checksums_ = nullptr;
+        std::vector<bool> verified_;
         bool checksum_valid_ = false;
+        TaskHandle_t verify_task_ = nullptr;
+        std::atomic<bool> verify_cancel_ = false;
+        uint32_t verify_checksum_ = 0;
+        uint32_t verify_length_ = 0;
+        // The theme font before the assets replaced it, restored by ReleaseResources()
+        std::shared_ptr<LvglFont> builtin_text_font_;
     };
     
     class EmoteStrategy : public AssetStrategy {
@@ -82,8 +136,17 @@ private:
 protected:
     const esp_partition_t* partition_ = nullptr;
     bool partition_valid_ = false;
+    // Set by a full download whose bytes matched the header checksum, taken by the next InitializePartition()
+    bool download_verified_ = false;
     std::string default_assets_url_;
     srmodel_list_t* models_list_ = nullptr;
+    // Where models_list_ is parsed from, its mapping outlives UnApplyPartition() once parsed
+    void* models_data_ = nullptr;
+    size_t models_size_ = 0;
+    // During HotUpdate(): the CRC of the models in use, and whether the new image has other ones
+    bool hot_updating_ = false;
+    uint32_t models_crc_ = 0;
+    bool models_changed_ = false;
 };
 
 #endif
@@ -0,0 +1,61 @@
+#include "aec_reference_delay.h"
+
+#include <cmath>
+#include <cstdlib>
+
+void AecReferenceDelay::SetDelay(int samples, int channels) {
+    delay_ = samples;
+    channels_ = channels;
+    int delayed_channels = samples > 0 ? 1 : channels - 1;
+    history_.assign(std::abs(samples) * delayed_channels, 0);
+    position_ = 0;
+}
+
+void AecReferenceDelay::Apply(int16_t* data, size_t frames) {
+    if (delay_ == 0 || channels_ < 2) {
+        return;
+    }
+    // The reference alone, or every microphone
+    int first = delay_ > 0 ? channels_ - 1 : 0;
+    int last = delay_ > 0 ? channels_ : channels_ - 1;
+    for (size_t i = 0; i < frames; i++) {
+        int16_t* frame = data + i * channels_;
+        for (int ch = first; ch < last; ch++) {
+            int16_t sample = history_[position_];
+            history_[position_] = frame[ch];
+            frame[ch] = sample;
+            position_ = (position_ + 1) % history_.size();
+        }
+    }
+}
+
+bool AecReferenceDelay::Estimate(const int16_t* mic, const int16_t* ref, size_t count, int max_lag,
+                                 float min_score, int& lag, float& score) {
+    double mic_energy = 0, ref_energy = 0;
+    for (size_t i = 0; i < count; i++) {
+        mic_energy += (double)mic[i] * mic[i];
+        ref_energy += (double)ref[i] * ref[i];
+    }
+    if (mic_energy == 0 || ref_energy == 0) {
+        return false;
+    }
+
+    float best = 0;
+    int best_lag = 0;
+    for (int l = -max_lag; l <= max_lag; l++) {
+        size_t begin = l < 0 ? -l : 0;
+        size_t end = l > 0 ? count - l : count;
+        float sum = 0;
+        for (size_t n = begin; n < end; n++) {
+            sum += (float)mic[n + l] * ref[n];
+        }
+        // The polarity of the speaker wiring does not matter
+        if (std::fabs(sum) > best) {
+            best = std::fabs(sum);
+            best_lag = l;
+        }
+    }
+    lag = best_lag;
+    score = best / std::sqrt(mic_energy * ref_energy);
+    return score >= min_score;
+}
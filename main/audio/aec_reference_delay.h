@@ -0,0 +1,45 @@
+#ifndef AEC_REFERENCE_DELAY_H
+#define AEC_REFERENCE_DELAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Aligns the playback reference channel of input_reference() codecs with the microphones
+ * before the AFE sees them. The echo reaches the microphones some milliseconds after the
+ * reference, depending on the board and the I2S buffering; the AEC converges fastest when
+ * that lag is small and fixed.
+ *
+ * A positive delay holds the reference back, a negative one the microphones (a reference
+ * trailing its echo cannot be cancelled at all). The delay is measured once by playing a
+ * sweep and cross-correlating, see Estimate(), and stored in the "audio" settings.
+ *
+ * Not thread-safe: Apply() runs on the audio input task, SetDelay() only while it is idle.
+ */
+class AecReferenceDelay {
+public:
+    // Lag the AFE is left with, the reference a little ahead of its echo
+    static constexpr int kMarginSamples = 16000 / 1000 * 2;
+
+    // In samples at 16 kHz, `channels` interleaved with the reference last
+    void SetDelay(int samples, int channels);
+    int delay() const { return delay_; }
+
+    // In place, on interleaved 16 kHz frames
+    void Apply(int16_t* data, size_t frames);
+
+    // Lag of the echo in `mic` behind `ref`, within +-max_lag samples. Returns false when the
+    // peak of the normalized cross-correlation stays below min_score (no echo to be found)
+    static bool Estimate(const int16_t* mic, const int16_t* ref, size_t count, int max_lag,
+                         float min_score, int& lag, float& score);
+
+private:
+    int delay_ = 0;
+    int channels_ = 1;
+    // History of the delayed channels, |delay_| frames of them
+    std::vector<int16_t> history_;
+    size_t position_ = 0;
+};
+
+#endif // AEC_REFERENCE_DELAY_H
@@ -0,0 +1,133 @@
+#include "audio_capture.h"
+
+#include <esp_log.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "AudioCapture"
+
+// Frames interleaved per WAV chunk
+#define EXPORT_BLOCK_FRAMES 512
+
+AudioCapture::AudioCapture(int seconds) {
+    for (auto& track : tracks_) {
+        track = std::make_unique<PcmRing>(AUDIO_CAPTURE_SAMPLE_RATE * seconds);
+    }
+}
+
+void AudioCapture::WriteInput(const int16_t* data, size_t samples, int channels, bool has_reference) {
+    if (exporting_) {
+        return;
+    }
+    if (channels == 1) {
+        tracks_[kTrackMic]->Write(data, samples);
+        return;
+    }
+    size_t frames = samples / channels;
+    auto& scratch = scratch_[kTrackMic];
+    scratch.resize(frames);
+    for (size_t i = 0; i < frames; i++) {
+        scratch[i] = data[i * channels];
+    }
+    tracks_[kTrackMic]->Write(scratch.data(), frames);
+    if (has_reference) {
+        for (size_t i = 0; i < frames; i++) {
+            scratch[i] = data[i * channels + channels - 1];
+        }
+        tracks_[kTrackReference]->Write(scratch.data(), frames);
+    }
+}
+
+void AudioCapture::Write(Track track, const int16_t* data, size_t samples, int sample_rate) {
+    if (exporting_ || samples == 0) {
+        return;
+    }
+    if (sample_rate == AUDIO_CAPTURE_SAMPLE_RATE) {
+        tracks_[track]->Write(data, samples);
+        return;
+    }
+
+    // Linear interpolation is plenty for listening back, only the playback track comes here
+    uint32_t step = ((uint64_t)sample_rate << 16) / AUDIO_CAPTURE_SAMPLE_RATE;
+    auto& scratch = scratch_[track];
+    scratch.clear();
+    uint32_t phase = playback_phase_;
+    while ((phase >> 16) < samples) {
+        size_t index = phase >> 16;
+        int32_t frac = phase & 0xFFFF;
+        int32_t a = index == 0 ? playback_last_ : data[index - 1];
+        int32_t b = data[index];
+        scratch.push_back((int16_t)(a + (((b - a) * frac) >> 16)));
+        phase += step;
+    }
+    playback_phase_ = phase - ((uint32_t)samples << 16);
+    playback_last_ = data[samples - 1];
+    tracks_[track]->Write(scratch.data(), scratch.size());
+}
+
+static void PutLe16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void PutLe32(uint8_t* p, uint32_t v) {
+    PutLe16(p, v & 0xFFFF);
+    PutLe16(p + 2, v >> 16);
+}
+
+bool AudioCapture::Export(const std::function<bool(const void* data, size_t len)>& write) {
+    if (exporting_.exchange(true)) {
+        return false;
+    }
+
+    size_t frames = 0;
+    std::array<size_t, kTrackCount> padding;
+    for (auto& track : tracks_) {
+        frames = std::max(frames, track->size());
+    }
+    for (int i = 0; i < kTrackCount; i++) {
+        padding[i] = frames - tracks_[i]->size();
+    }
+    ESP_LOGI(TAG, "Exporting %u ms of %d tracks", (unsigned)(frames * 1000 / AUDIO_CAPTURE_SAMPLE_RATE), (int)kTrackCount);
+
+    uint32_t data_bytes = frames * kTrackCount * sizeof(int16_t);
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    PutLe32(header + 4, 36 + data_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    PutLe32(header + 16, 16);
+    PutLe16(header + 20, 1);  // PCM
+    PutLe16(header + 22, kTrackCount);
+    PutLe32(header + 24, AUDIO_CAPTURE_SAMPLE_RATE);
+    PutLe32(header + 28, AUDIO_CAPTURE_SAMPLE_RATE * kTrackCount * sizeof(int16_t));
+    PutLe16(header + 32, kTrackCount * sizeof(int16_t));
+    PutLe16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    PutLe32(header + 40, data_bytes);
+    bool ok = write(header, sizeof(header));
+
+    std::vector<int16_t> track_block(EXPORT_BLOCK_FRAMES);
+    std::vector<int16_t> block(EXPORT_BLOCK_FRAMES * kTrackCount);
+    for (size_t done = 0; ok && done < frames; ) {
+        size_t n = std::min<size_t>(EXPORT_BLOCK_FRAMES, frames - done);
+        for (int t = 0; t < kTrackCount; t++) {
+            // Shorter tracks start with silence, so all of them end together
+            size_t silent = std::min(n, padding[t]);
+            std::fill(track_block.begin(), track_block.begin() + silent, 0);
+            padding[t] -= silent;
+            tracks_[t]->Read(track_block.data() + silent, n - silent);
+            for (size_t i = 0; i < n; i++) {
+                block[i * kTrackCount + t] = track_block[i];
+            }
+        }
+        ok = write(block.data(), n * kTrackCount * sizeof(int16_t));
+        done += n;
+    }
+
+    for (auto& track : tracks_) {
+        track->Clear();
+    }
+    exporting_ = false;
+    return ok;
+}
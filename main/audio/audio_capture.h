@@ -0,0 +1,54 @@
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "pcm_ring.h"
+
+#define AUDIO_CAPTURE_SAMPLE_RATE 16000
+
+/*
+ * Records the last few seconds of the audio pipeline into PSRAM rings, one per track, for
+ * field debugging without a UDP sink. Every track is kept as 16 kHz mono, the playback is
+ * converted on the way in. Each writer touches only its own track, so the cost on the audio
+ * tasks is one copy per chunk.
+ *
+ * Export() writes the tracks as one 4-channel WAV, aligned at the newest sample. Writes are
+ * dropped while it runs, and the rings are empty afterwards.
+ */
+class AudioCapture {
+public:
+    enum Track {
+        kTrackMic,
+        kTrackReference,
+        kTrackProcessed,
+        kTrackPlayback,
+        kTrackCount,
+    };
+
+    explicit AudioCapture(int seconds);
+
+    // Splits interleaved input into the mic (first channel) and reference (last channel) tracks
+    void WriteInput(const int16_t* data, size_t samples, int channels, bool has_reference);
+    void Write(Track track, const int16_t* data, size_t samples, int sample_rate = AUDIO_CAPTURE_SAMPLE_RATE);
+
+    // write returns false to stop, e.g. when the client went away
+    bool Export(const std::function<bool(const void* data, size_t len)>& write);
+
+private:
+    std::array<std::unique_ptr<PcmRing>, kTrackCount> tracks_;
+    // Per track scratch for channel extraction and rate conversion, only its writer uses it
+    std::array<std::vector<int16_t>, kTrackCount> scratch_;
+    // Position of the playback rate conversion, in 16.16 fixed point input samples
+    uint32_t playback_phase_ = 0;
+    int16_t playback_last_ = 0;
+    std::atomic<bool> exporting_{false};
+};
+
+#endif // AUDIO_CAPTURE_H
@@ -1,11 +1,20 @@
 #include "audio_codec.h"
 #include "board.h"
 #include "settings.h"
+#include "application.h"
+#include "audio_hot.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
 #include <cstring>
 #include <driver/i2s_common.h>
 
+// An overflow only counts within this long of the last read / write, an idle channel overflows all the time
+#define OVERFLOW_ACTIVE_WINDOW_MS 200
+// Volume units per register write of a ramp, about 2.5 dB on the default curve
+#define VOLUME_RAMP_STEP 5
+
 #define TAG "AudioCodec"
 
 AudioCodec::AudioCodec() {
@@ -14,11 +23,47 @@ AudioCodec::AudioCodec() {
 AudioCodec::~AudioCodec() {
 }
 
-void AudioCodec::OutputData(std::vector<int16_t>& data) {
-    Write(data.data(), data.size());
+void AUDIO_HOT AudioCodec::OutputData(std::vector<int16_t>& data) {
+    int samples = data.size();
+    if (output_headroom_ > 1) {
+        data.resize(samples * output_headroom_);
+    }
+    last_write_ms_.store((uint32_t)(esp_timer_get_time() / 1000), std::memory_order_relaxed);
+    WriteInPlace(data.data(), samples);
+}
+
+int AUDIO_HOT AudioCodec::WriteInPlace(int16_t* data, int samples) {
+    return Write(data, samples);
 }
 
-bool AudioCodec::InputData(std::vector<int16_t>& data) {
+void AudioCodec::FlushOutput(std::vector<int16_t>& fade) {
+    if (tx_handle_ == nullptr || !output_enabled_) {
+        return;
+    }
+    /* Without expansion the samples already match the slot format */
+    if (output_headroom_ == 1) {
+        RestartOutput(fade.data(), fade.size() * sizeof(int16_t));
+    } else {
+        RestartOutput(nullptr, 0);
+    }
+}
+
+void AudioCodec::RestartOutput(const void* data, size_t bytes) {
+    static const uint8_t silence[256] = {};
+    ESP_ERROR_CHECK(i2s_channel_disable(tx_handle_));
+    size_t loaded = 0;
+    if (bytes > 0) {
+        ESP_ERROR_CHECK(i2s_channel_preload_data(tx_handle_, data, bytes, &loaded));
+    }
+    /* The DMA restarts from the first descriptor, overwrite every stale sample */
+    do {
+        ESP_ERROR_CHECK(i2s_channel_preload_data(tx_handle_, silence, sizeof(silence), &loaded));
+    } while (loaded == sizeof(silence));
+    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
+}
+
+bool AUDIO_HOT AudioCodec::InputData(std::vector<int16_t>& data) {
+    last_read_ms_.store((uint32_t)(esp_timer_get_time() / 1000), std::memory_order_relaxed);
     int samples = Read(data.data(), data.size());
     if (samples > 0) {
         return true;
@@ -37,12 +82,92 @@ void AudioCodec::Start() {
     ESP_LOGI(TAG, "Audio codec started");
 }
 
+void AudioCodec::StartOutputClock() {
+    if (tx_handle_ == nullptr) {
+        return;
+    }
+    /* Callbacks can only be registered on a stopped channel */
+    bool running = i2s_channel_disable(tx_handle_) == ESP_OK;
+    i2s_event_callbacks_t callbacks = {};
+    callbacks.on_sent = OnOutputSent;
+    if (count_output_underruns_) {
+        callbacks.on_send_q_ovf = OnOutputOverflow;
+    }
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(tx_handle_, &callbacks, this));
+    if (running) {
+        ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
+    }
+}
+
+void AudioCodec::StartOverflowCounters() {
+    // Registering replaces all callbacks of a channel, the output clock keeps its on_sent
+    count_output_underruns_ = true;
+    StartOutputClock();
+    if (rx_handle_ == nullptr || rx_handle_ == tx_handle_) {
+        return;
+    }
+    bool running = i2s_channel_disable(rx_handle_) == ESP_OK;
+    i2s_event_callbacks_t callbacks = {};
+    callbacks.on_recv_q_ovf = OnInputOverflow;
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(rx_handle_, &callbacks, this));
+    if (running) {
+        ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
+    }
+}
+
+// The oldest DMA buffer was overwritten before i2s_channel_write() refilled it
+bool IRAM_ATTR AudioCodec::OnOutputOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    auto codec = static_cast<AudioCodec*>(user_ctx);
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (now_ms - codec->last_write_ms_.load(std::memory_order_relaxed) < OVERFLOW_ACTIVE_WINDOW_MS) {
+        codec->output_underruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return false;
+}
+
+// Received samples were dropped because i2s_channel_read() did not keep up
+bool IRAM_ATTR AudioCodec::OnInputOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    auto codec = static_cast<AudioCodec*>(user_ctx);
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (now_ms - codec->last_read_ms_.load(std::memory_order_relaxed) < OVERFLOW_ACTIVE_WINDOW_MS) {
+        codec->input_overruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return false;
+}
+
+bool IRAM_ATTR AudioCodec::OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    auto codec = static_cast<AudioCodec*>(user_ctx);
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&codec->output_clock_lock_);
+    codec->output_sent_us_ = now;
+    portEXIT_CRITICAL_ISR(&codec->output_clock_lock_);
+    return false;
+}
+
+void AudioCodec::RampOutputVolume(int from, int to, const std::function<void(int volume)>& set) {
+    int step = to > from ? VOLUME_RAMP_STEP : -VOLUME_RAMP_STEP;
+    for (int volume = from + step; step > 0 ? volume < to : volume > to; volume += step) {
+        set(volume);
+        vTaskDelay(1);
+    }
+    set(to);
+}
+
+int64_t AudioCodec::last_output_sent_us() {
+    portENTER_CRITICAL(&output_clock_lock_);
+    int64_t sent_us = output_sent_us_;
+    portEXIT_CRITICAL(&output_clock_lock_);
+    return sent_us;
+}
+
 void AudioCodec::SetOutputVolume(int volume) {
     output_volume_ = volume;
     ESP_LOGI(TAG, "Set output volume to %d", output_volume_);
     
     Settings settings("audio", true);
     settings.SetInt("output_volume", output_volume_);
+    // The mute icon follows the volume
+    Application::GetInstance().RefreshStatusBar();
 }
 
 void AudioCodec::SetInputGain(float gain) {
@@ -65,3 +190,7 @@ void AudioCodec::EnableOutput(bool enable) {
     output_enabled_ = enable;
     ESP_LOGI(TAG, "Set output enable to %s", enable ? "true" : "false");
 }
+
+void AudioCodec::StandbyOutput() {
+    EnableOutput(false);
+}
@@ -8,11 +8,14 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <atomic>
 
 #include "board.h"
+#include "audio_latency_profile.h"
 
-#define AUDIO_CODEC_DMA_DESC_NUM 6
-#define AUDIO_CODEC_DMA_FRAME_NUM 240
+// Sized by the latency profile selected at boot
+#define AUDIO_CODEC_DMA_DESC_NUM (AudioLatencyProfile::Boot().dma_desc_num)
+#define AUDIO_CODEC_DMA_FRAME_NUM (AudioLatencyProfile::Boot().dma_frame_num)
 
 class AudioCodec {
 public:
@@ -23,10 +26,26 @@ public:
     virtual void SetInputGain(float gain);
     virtual void EnableInput(bool enable);
     virtual void EnableOutput(bool enable);
+    // Turns the output off but keeps the codec configured and clocked with only the PA off, so
+    // EnableOutput(true) resumes in a register write. EnableOutput(false) powers it down fully.
+    // Codecs without a standby power down right away
+    virtual void StandbyOutput();
 
+    // `data` is consumed: codecs may scale and expand it in place before writing it out
     virtual void OutputData(std::vector<int16_t>& data);
     virtual bool InputData(std::vector<int16_t>& data);
+    // Drops the samples still queued in the I2S DMA buffers, the device plays `fade` (consumed like
+    // OutputData) and then silence. Must be called by the task calling OutputData()
+    virtual void FlushOutput(std::vector<int16_t>& fade);
     virtual void Start();
+    // Hooks the I2S DMA completion interrupt, so last_output_sent_us() tracks the speaker
+    void StartOutputClock();
+    // Counts the I2S queue overflows: input DMA not read in time, output DMA not written in time
+    void StartOverflowCounters();
+    inline uint32_t input_overruns() const { return input_overruns_.load(std::memory_order_relaxed); }
+    inline uint32_t output_underruns() const { return output_underruns_.load(std::memory_order_relaxed); }
+    // esp_timer time at which the DMA last finished sending a descriptor, 0 before the first one
+    int64_t last_output_sent_us();
 
     inline bool duplex() const { return duplex_; }
     inline bool input_reference() const { return input_reference_; }
@@ -38,6 +57,8 @@ public:
     inline float input_gain() const { return input_gain_; }
     inline bool input_enabled() const { return input_enabled_; }
     inline bool output_enabled() const { return output_enabled_; }
+    inline bool output_standby() const { return output_standby_; }
+    inline int output_headroom() const { return output_headroom_; }
 
 protected:
     i2s_chan_handle_t tx_handle_ = nullptr;
@@ -47,15 +68,41 @@ protected:
     bool input_reference_ = false;
     bool input_enabled_ = false;
     bool output_enabled_ = false;
+    bool output_standby_ = false;
     int input_sample_rate_ = 0;
     int output_sample_rate_ = 0;
     int input_channels_ = 1;
     int output_channels_ = 1;
     int output_volume_ = 70;
     float input_gain_ = 0.0;
+    // int16 slots per output sample that WriteInPlace() may use (e.g. 2 for 32-bit I2S slots)
+    int output_headroom_ = 1;
+    portMUX_TYPE output_clock_lock_ = portMUX_INITIALIZER_UNLOCKED;
+    int64_t output_sent_us_ = 0;
+    std::atomic<uint32_t> input_overruns_{0};
+    std::atomic<uint32_t> output_underruns_{0};
+    std::atomic<uint32_t> last_read_ms_{0};
+    std::atomic<uint32_t> last_write_ms_{0};
 
     virtual int Read(int16_t* dest, int samples) = 0;
     virtual int Write(const int16_t* data, int samples) = 0;
+    /*
+     * Zero-copy variant of Write(): `data` holds `samples` samples followed by room for
+     * samples * output_headroom_ int16 values, so volume and channel / bit-width expansion
+     * can be done in place right before i2s_channel_write(). Defaults to Write().
+     */
+    virtual int WriteInPlace(int16_t* data, int samples);
+    // Restarts the TX channel with `bytes` of samples in the I2S slot format, followed by silence
+    void RestartOutput(const void* data, size_t bytes);
+    // Steps a hardware volume from `from` to `to` a few units per tick, a jump of the DAC gain clicks
+    void RampOutputVolume(int from, int to, const std::function<void(int volume)>& set);
+
+private:
+    bool count_output_underruns_ = false;
+
+    static bool OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+    static bool OnOutputOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+    static bool OnInputOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
 };
 
 #endif // _AUDIO_CODEC_H
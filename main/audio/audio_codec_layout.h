@@ -0,0 +1,36 @@
+#ifndef AUDIO_CODEC_LAYOUT_H
+#define AUDIO_CODEC_LAYOUT_H
+
+#include "audio_codec.h"
+
+/*
+ * The input layout of the board's codec as the per-frame audio path sees it. With
+ * CONFIG_AUDIO_CODEC_FIXED_LAYOUT the board pins it in its sdkconfig and these are compile-time
+ * constants, so the sample rate, channel and reference checks of every frame fold away and the
+ * resampler or channel copies a board does not need are not built into the loop. Matches() is
+ * checked once at start, a board whose codec disagrees with its sdkconfig stops there.
+ */
+namespace codec_layout {
+
+#if CONFIG_AUDIO_CODEC_FIXED_LAYOUT
+constexpr int InputSampleRate(const AudioCodec*) { return CONFIG_AUDIO_CODEC_FIXED_INPUT_SAMPLE_RATE; }
+constexpr int InputChannels(const AudioCodec*) { return CONFIG_AUDIO_CODEC_FIXED_INPUT_CHANNELS; }
+#if CONFIG_AUDIO_CODEC_FIXED_INPUT_REFERENCE
+constexpr bool InputReference(const AudioCodec*) { return true; }
+#else
+constexpr bool InputReference(const AudioCodec*) { return false; }
+#endif
+#else
+inline int InputSampleRate(const AudioCodec* codec) { return codec->input_sample_rate(); }
+inline int InputChannels(const AudioCodec* codec) { return codec->input_channels(); }
+inline bool InputReference(const AudioCodec* codec) { return codec->input_reference(); }
+#endif
+
+inline bool Matches(const AudioCodec* codec) {
+    return InputSampleRate(codec) == codec->input_sample_rate() && InputChannels(codec) == codec->input_channels() &&
+        InputReference(codec) == codec->input_reference();
+}
+
+}  // namespace codec_layout
+
+#endif // AUDIO_CODEC_LAYOUT_H
@@ -0,0 +1,106 @@
+#include "audio_dsp.h"
+#include "sdkconfig.h"
+
+#include <algorithm>
+#include <climits>
+
+#if CONFIG_AUDIO_DSP_SIMD
+/* audio_dsp_esp32s3.S, n8 is the number of 8-sample blocks, pointers 16-byte aligned */
+extern "C" void audio_dsp_gain_s16_aes3(const int16_t* src, int16_t* dst, size_t n8, int32_t gain_q15);
+extern "C" void audio_dsp_mix_s16_aes3(const int16_t* src, int16_t* dst, size_t n8, int32_t gain_q15);
+extern "C" void audio_dsp_extract_stereo_s16_aes3(const int16_t* src, int16_t* dst, size_t n8, int channel);
+
+static inline bool IsAligned(const void* ptr) {
+    return ((uintptr_t)ptr & 15) == 0;
+}
+#endif
+
+namespace audio_dsp {
+
+static inline int16_t SaturateS16(int64_t value) {
+    return (int16_t)std::clamp<int64_t>(value, INT16_MIN, INT16_MAX);
+}
+
+void Gain(int16_t* dst, const int16_t* src, size_t count, int32_t gain_q15) {
+    if (gain_q15 == 32768) {
+        if (dst != src) {
+            std::copy(src, src + count, dst);
+        }
+        return;
+    }
+    size_t i = 0;
+#if CONFIG_AUDIO_DSP_SIMD
+    /* Below unity the product never leaves 16 bits, so the non-saturating vector multiply is exact */
+    if (gain_q15 >= 0 && gain_q15 < 32768 && IsAligned(dst) && IsAligned(src)) {
+        size_t n8 = count / 8;
+        audio_dsp_gain_s16_aes3(src, dst, n8, gain_q15);
+        i = n8 * 8;
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = SaturateS16(((int64_t)src[i] * gain_q15) >> 15);
+    }
+}
+
+void MixAdd(int16_t* dst, const int16_t* src, size_t count, int32_t gain_q15) {
+    gain_q15 = std::clamp<int32_t>(gain_q15, 0, 32768);
+    size_t i = 0;
+#if CONFIG_AUDIO_DSP_SIMD
+    if (IsAligned(dst) && IsAligned(src)) {
+        size_t n8 = count / 8;
+        audio_dsp_mix_s16_aes3(src, dst, n8, gain_q15);
+        i = n8 * 8;
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = SaturateS16(dst[i] + (((int32_t)src[i] * gain_q15) >> 15));
+    }
+}
+
+void ExtractChannel(int16_t* dst, const int16_t* src, size_t frames, int channels, int channel) {
+    size_t i = 0;
+#if CONFIG_AUDIO_DSP_SIMD
+    if (channels == 2 && IsAligned(dst) && IsAligned(src)) {
+        size_t n8 = frames / 8;
+        audio_dsp_extract_stereo_s16_aes3(src, dst, n8, channel);
+        i = n8 * 8;
+    }
+#endif
+    for (; i < frames; i++) {
+        dst[i] = src[i * channels + channel];
+    }
+}
+
+void ScaleToS32(int32_t* dst, const int16_t* src, size_t count, int32_t gain_q16, int out_channels) {
+    /* Up to unity the product fits 32 bits (-32768 * 65536 is INT32_MIN), no 64-bit multiply needed */
+    if (gain_q16 >= 0 && gain_q16 <= 65536) {
+        if (out_channels == 1) {
+            for (size_t i = count; i-- > 0;) {
+                dst[i] = (int32_t)src[i] * gain_q16;
+            }
+            return;
+        }
+        for (size_t i = count; i-- > 0;) {
+            int32_t sample = (int32_t)src[i] * gain_q16;
+            for (int c = out_channels - 1; c >= 0; c--) {
+                dst[i * out_channels + c] = sample;
+            }
+        }
+        return;
+    }
+    for (size_t i = count; i-- > 0;) {
+        int64_t value = (int64_t)src[i] * gain_q16;
+        int32_t sample = (int32_t)std::clamp<int64_t>(value, INT32_MIN, INT32_MAX);
+        for (int c = out_channels - 1; c >= 0; c--) {
+            dst[i * out_channels + c] = sample;
+        }
+    }
+}
+
+void ShiftToS16(int16_t* dst, const int32_t* src, size_t count, int shift) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = SaturateS16(src[i] >> shift);
+    }
+}
+
+} // namespace audio_dsp
@@ -0,0 +1,40 @@
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample format kernels shared by the codecs and processors.
+ *
+ * Every kernel has a portable scalar implementation. On ESP32-S3 (CONFIG_AUDIO_DSP_SIMD) the
+ * 16-byte aligned bulk of Gain(), MixAdd() and ExtractChannel() runs on the PIE vector unit
+ * and the tail falls back to the scalar loop, so callers never need to care about alignment
+ * or length.
+ */
+namespace audio_dsp {
+
+// Gains are Q15 fixed point: 32768 is unity, values above it amplify
+inline int32_t GainToQ15(float gain) {
+    return (int32_t)(gain * 32768.0f);
+}
+
+// dst[i] = saturate(src[i] * gain_q15 >> 15), dst may be src
+void Gain(int16_t* dst, const int16_t* src, size_t count, int32_t gain_q15);
+
+// dst[i] = saturate(dst[i] + (src[i] * gain_q15 >> 15)), gain_q15 at most unity
+void MixAdd(int16_t* dst, const int16_t* src, size_t count, int32_t gain_q15);
+
+// Copy one channel out of interleaved frames, dst may be src
+void ExtractChannel(int16_t* dst, const int16_t* src, size_t frames, int channels, int channel);
+
+// Widen to 32-bit I2S slots with a Q16 gain, repeating each sample out_channels times.
+// Runs from the end, so dst may start at src (dst needs count * out_channels * 4 bytes).
+void ScaleToS32(int32_t* dst, const int16_t* src, size_t count, int32_t gain_q16, int out_channels = 1);
+
+// dst[i] = saturate(src[i] >> shift), dst may start at src
+void ShiftToS16(int16_t* dst, const int32_t* src, size_t count, int shift);
+
+} // namespace audio_dsp
+
+#endif // AUDIO_DSP_H
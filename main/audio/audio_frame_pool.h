@@ -0,0 +1,95 @@
+#ifndef AUDIO_FRAME_POOL_H
+#define AUDIO_FRAME_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+/*
+ * A fixed-capacity pool of pre-allocated audio objects (AudioTask / AudioStreamPacket).
+ *
+ * Objects are created once in Initialize() with their buffers reserved to the expected
+ * frame size. Acquire() hands out an object and Release() gives it back with its buffer
+ * capacity intact, so the steady-state audio path does no heap allocation.
+ *
+ * When the pool is exhausted, Acquire() falls back to a fresh allocation and the extra
+ * object is simply freed on Release() if the pool is already full.
+ */
+template <typename T>
+class AudioFramePool {
+public:
+    using Reset = std::function<void(T&)>;
+
+    AudioFramePool() = default;
+    AudioFramePool(const AudioFramePool&) = delete;
+    AudioFramePool& operator=(const AudioFramePool&) = delete;
+
+    /*
+     * Pre-allocates `capacity` objects. `prepare` is called once for every object
+     * (used to reserve buffer capacity), `reset` is called on every Release().
+     */
+    void Initialize(size_t capacity, Reset prepare, Reset reset) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        prepare_ = prepare;
+        reset_ = reset;
+        free_list_.clear();
+        free_list_.reserve(capacity_);
+        for (size_t i = 0; i < capacity_; i++) {
+            auto object = std::make_unique<T>();
+            if (prepare_) {
+                prepare_(*object);
+            }
+            free_list_.push_back(std::move(object));
+        }
+    }
+
+    std::unique_ptr<T> Acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_list_.empty()) {
+                auto object = std::move(free_list_.back());
+                free_list_.pop_back();
+                return object;
+            }
+            misses_++;
+        }
+        auto object = std::make_unique<T>();
+        if (prepare_) {
+            prepare_(*object);
+        }
+        return object;
+    }
+
+    void Release(std::unique_ptr<T>&& object) {
+        if (!object) {
+            return;
+        }
+        if (reset_) {
+            reset_(*object);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_list_.size() < capacity_) {
+            free_list_.push_back(std::move(object));
+        }
+    }
+
+    size_t available() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return free_list_.size();
+    }
+
+    inline size_t capacity() const { return capacity_; }
+    inline uint32_t misses() const { return misses_; }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<T>> free_list_;
+    size_t capacity_ = 0;
+    uint32_t misses_ = 0;
+    Reset prepare_;
+    Reset reset_;
+};
+
+#endif // AUDIO_FRAME_POOL_H
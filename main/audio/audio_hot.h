@@ -0,0 +1,18 @@
+#ifndef AUDIO_HOT_H
+#define AUDIO_HOT_H
+
+#include <esp_attr.h>
+
+/*
+ * Functions every audio frame passes through. With CONFIG_AUDIO_HOT_PATH_IN_IRAM they run from
+ * internal RAM, so a flash cache kept busy by LVGL or the camera no longer stalls them into I2S
+ * overruns. Whole DSP objects are placed by audio_hot.lf instead, with their tables in DRAM.
+ * scripts/audio_iram_report.py lists what ends up in internal RAM and its cost.
+ */
+#if CONFIG_AUDIO_HOT_PATH_IN_IRAM
+#define AUDIO_HOT IRAM_ATTR
+#else
+#define AUDIO_HOT
+#endif
+
+#endif // AUDIO_HOT_H
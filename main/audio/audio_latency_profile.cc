@@ -0,0 +1,74 @@
+#include "audio_latency_profile.h"
+#include "settings.h"
+
+#include <esp_log.h>
+#include <atomic>
+
+#define TAG "AudioLatencyProfile"
+
+#if CONFIG_AUDIO_JITTER_BUFFER
+#define BALANCED_JITTER_MIN_MS CONFIG_AUDIO_JITTER_BUFFER_MIN_MS
+#define BALANCED_JITTER_MAX_MS CONFIG_AUDIO_JITTER_BUFFER_MAX_MS
+#else
+#define BALANCED_JITTER_MIN_MS 60
+#define BALANCED_JITTER_MAX_MS 600
+#endif
+
+static const AudioLatencyProfile kProfiles[] = {
+    {"low-latency", 4, 160, 1, 2, 20, 20, 200},
+    {"balanced", 6, 240, 2, 2, CONFIG_AUDIO_UPLINK_FRAME_DURATION_MS, BALANCED_JITTER_MIN_MS, BALANCED_JITTER_MAX_MS},
+    {"robust", 8, 320, 4, 4, 60, 180, 1200},
+};
+
+static std::atomic<const AudioLatencyProfile*> current_profile{nullptr};
+
+const AudioLatencyProfile* AudioLatencyProfile::Find(const std::string& name) {
+    for (const auto& profile : kProfiles) {
+        if (name == profile.name) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+const AudioLatencyProfile& AudioLatencyProfile::Boot() {
+    static const AudioLatencyProfile* boot = []() {
+        Settings settings("audio", false);
+        auto name = settings.GetString("latency_profile", CONFIG_AUDIO_LATENCY_PROFILE);
+        auto profile = Find(name);
+        if (profile == nullptr) {
+            ESP_LOGW(TAG, "Unknown latency profile %s, using balanced", name.c_str());
+            profile = Find("balanced");
+        }
+        ESP_LOGI(TAG, "Latency profile: %s", profile->name);
+        return profile;
+    }();
+    return *boot;
+}
+
+const AudioLatencyProfile& AudioLatencyProfile::Current() {
+    auto profile = current_profile.load();
+    return profile != nullptr ? *profile : Boot();
+}
+
+const AudioLatencyProfile* AudioLatencyProfile::Select(const std::string& name) {
+    auto profile = Find(name);
+    if (profile == nullptr) {
+        return nullptr;
+    }
+    Settings settings("audio", true);
+    settings.SetString("latency_profile", profile->name);
+    current_profile = profile;
+    return profile;
+}
+
+std::string AudioLatencyProfile::Names() {
+    std::string names;
+    for (const auto& profile : kProfiles) {
+        if (!names.empty()) {
+            names += ", ";
+        }
+        names += profile.name;
+    }
+    return names;
+}
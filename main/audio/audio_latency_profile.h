@@ -0,0 +1,44 @@
+#ifndef AUDIO_LATENCY_PROFILE_H
+#define AUDIO_LATENCY_PROFILE_H
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Named sets of the audio buffering knobs, tuned together:
+ *
+ *   low-latency  shallow DMA, one playback frame, 20 ms uplink frames, short jitter buffer
+ *   balanced     the defaults (6 x 240 DMA, two frames per queue, Kconfig frame and jitter)
+ *   robust       deep DMA and queues and a long jitter buffer, for flaky links
+ *
+ * The selection is kept in the "audio" settings (CONFIG_AUDIO_LATENCY_PROFILE until one is
+ * picked). The queues, uplink frames and jitter buffer follow a new selection right away;
+ * the I2S DMA is allocated when the codec is created, so its geometry comes from the profile
+ * selected at boot.
+ */
+struct AudioLatencyProfile {
+    const char* name;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    int playback_queue;
+    int encode_queue;
+    int uplink_frame_ms;
+    int jitter_min_ms;
+    int jitter_max_ms;
+
+    // nullptr for an unknown name
+    static const AudioLatencyProfile* Find(const std::string& name);
+    // The selection as read at boot, which the DMA buffers were sized for
+    static const AudioLatencyProfile& Boot();
+    // The selection, changed by Select()
+    static const AudioLatencyProfile& Current();
+    // Stores the selection, false for an unknown name. AudioService::SetLatencyProfile() applies it
+    static const AudioLatencyProfile* Select(const std::string& name);
+    // Comma separated names, for the MCP tool description
+    static std::string Names();
+};
+
+// Capacity of the queues, the deepest any profile uses
+#define AUDIO_LATENCY_PROFILE_MAX_QUEUE 4
+
+#endif // AUDIO_LATENCY_PROFILE_H
@@ -0,0 +1,110 @@
+#include "audio_latency_tracer.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+#include <algorithm>
+
+#define TAG "AudioLatency"
+
+#ifndef CONFIG_AUDIO_LATENCY_TRACE_ENTRIES
+#define CONFIG_AUDIO_LATENCY_TRACE_ENTRIES 0
+#endif
+
+static const char* const kStageNames[kLatencyStageCount] = {
+    "i2s_read",
+    "afe_output",
+    "encode_start",
+    "encode_end",
+    "send",
+    "decode",
+    "output",
+};
+
+AudioLatencyTracer::AudioLatencyTracer() {
+    entries_.resize(CONFIG_AUDIO_LATENCY_TRACE_ENTRIES);
+}
+
+void AudioLatencyTracer::Record(AudioLatencyStage stage, int64_t since_origin_us, int64_t since_prev_us) {
+    if (entries_.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = entries_[next_];
+    entry.since_origin_us = (uint32_t)std::clamp<int64_t>(since_origin_us, 0, UINT32_MAX);
+    entry.since_prev_us = (uint32_t)std::clamp<int64_t>(since_prev_us, 0, UINT32_MAX);
+    entry.stage = stage;
+    next_ = (next_ + 1) % entries_.size();
+    count_ = std::min(count_ + 1, entries_.size());
+}
+
+void AudioLatencyTracer::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_ = 0;
+    count_ = 0;
+}
+
+void AudioLatencyTracer::Summarize(AudioLatencyStage stage, Percentiles& total, Percentiles& step) {
+    std::vector<uint32_t> totals;
+    std::vector<uint32_t> steps;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < count_; i++) {
+            auto& entry = entries_[i];
+            if (entry.stage == stage) {
+                totals.push_back(entry.since_origin_us);
+                steps.push_back(entry.since_prev_us);
+            }
+        }
+    }
+
+    auto percentiles = [](std::vector<uint32_t>& values, Percentiles& result) {
+        result.count = values.size();
+        if (values.empty()) {
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        auto at = [&values](int percent) { return values[(values.size() - 1) * percent / 100]; };
+        result.p50 = at(50);
+        result.p95 = at(95);
+        result.p99 = at(99);
+    };
+    percentiles(totals, total);
+    percentiles(steps, step);
+}
+
+std::string AudioLatencyTracer::GetSummaryJson() {
+    cJSON* root = cJSON_CreateObject();
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        Percentiles total, step;
+        Summarize((AudioLatencyStage)i, total, step);
+        if (total.count == 0) {
+            continue;
+        }
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "count", total.count);
+        cJSON_AddNumberToObject(item, "p50_us", total.p50);
+        cJSON_AddNumberToObject(item, "p95_us", total.p95);
+        cJSON_AddNumberToObject(item, "p99_us", total.p99);
+        cJSON_AddNumberToObject(item, "step_p50_us", step.p50);
+        cJSON_AddNumberToObject(item, "step_p95_us", step.p95);
+        cJSON_AddNumberToObject(item, "step_p99_us", step.p99);
+        cJSON_AddItemToObject(root, kStageNames[i], item);
+    }
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+void AudioLatencyTracer::PrintSummary() {
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        Percentiles total, step;
+        Summarize((AudioLatencyStage)i, total, step);
+        if (total.count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-12s n=%-4u total p50/p95/p99 %lu/%lu/%lu us, step %lu/%lu/%lu us", kStageNames[i],
+            (unsigned)total.count, total.p50, total.p95, total.p99, step.p50, step.p95, step.p99);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef AUDIO_LATENCY_TRACER_H
+#define AUDIO_LATENCY_TRACER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include <esp_timer.h>
+
+enum AudioLatencyStage {
+    // Uplink
+    kLatencyStageI2sRead,       // time blocked in AudioCodec::InputData
+    kLatencyStageAfeOutput,     // processor output, relative to the last I2S read
+    kLatencyStageEncodeStart,
+    kLatencyStageEncodeEnd,
+    kLatencyStageSend,          // Protocol::SendAudio returned
+    // Downlink, relative to the packet entering the decode queue
+    kLatencyStageDecode,
+    kLatencyStageOutput,        // AudioCodec::OutputData returned
+    kLatencyStageCount,
+};
+
+/*
+ * Fixed-size in-RAM timeline of per-frame stage timestamps (esp_timer_get_time()).
+ *
+ * Every frame carries the time it entered the pipeline (origin) and the time of its
+ * previous stage. Mark() stores both deltas in a ring, and GetSummaryJson() / PrintSummary()
+ * report p50 / p95 / p99 per stage over the frames still in the ring.
+ *
+ * Without CONFIG_AUDIO_LATENCY_TRACE, Mark() compiles to nothing.
+ */
+class AudioLatencyTracer {
+public:
+    AudioLatencyTracer();
+
+    inline void Mark(AudioLatencyStage stage, int64_t& origin_us, int64_t& last_us) {
+#if CONFIG_AUDIO_LATENCY_TRACE
+        if (origin_us == 0) {
+            return;
+        }
+        int64_t now = esp_timer_get_time();
+        Record(stage, now - origin_us, now - last_us);
+        last_us = now;
+#endif
+    }
+
+    // For stages that measure a duration rather than a position in the pipeline
+    inline void MarkDuration(AudioLatencyStage stage, int64_t duration_us) {
+#if CONFIG_AUDIO_LATENCY_TRACE
+        Record(stage, duration_us, duration_us);
+#endif
+    }
+
+    std::string GetSummaryJson();
+    void PrintSummary();
+    void Clear();
+
+private:
+    struct Entry {
+        uint32_t since_origin_us;
+        uint32_t since_prev_us;
+        uint8_t stage;
+    };
+
+    struct Percentiles {
+        size_t count = 0;
+        uint32_t p50 = 0;
+        uint32_t p95 = 0;
+        uint32_t p99 = 0;
+    };
+
+    std::mutex mutex_;
+    std::vector<Entry> entries_;
+    size_t next_ = 0;
+    size_t count_ = 0;
+
+    void Record(AudioLatencyStage stage, int64_t since_origin_us, int64_t since_prev_us);
+    void Summarize(AudioLatencyStage stage, Percentiles& total, Percentiles& step);
+};
+
+#endif // AUDIO_LATENCY_TRACER_H
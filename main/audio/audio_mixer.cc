@@ -0,0 +1,68 @@
+#include "audio_mixer.h"
+#include "audio_dsp.h"
+
+#include <algorithm>
+#include <climits>
+
+AudioMixer::AudioMixer() {
+    for (auto& gain : gain_q15_) {
+        gain = 32768;
+    }
+    current_q15_.fill(32768);
+}
+
+void AudioMixer::SetGain(Source source, float gain) {
+    gain_q15_[source] = audio_dsp::GainToQ15(std::clamp(gain, 0.0f, 1.0f));
+}
+
+void AudioMixer::SetDucking(float gain) {
+    ducking_q15_ = audio_dsp::GainToQ15(std::clamp(gain, 0.0f, 1.0f));
+}
+
+void AudioMixer::Mix(const Input* inputs, size_t count, std::vector<int16_t>& out) {
+    if (count == 0) {
+        out.clear();
+        return;
+    }
+    int highest = kSourceCount;
+    for (size_t i = 0; i < count; i++) {
+        highest = std::min<int>(highest, inputs[i].source);
+    }
+
+    size_t samples = inputs[0].samples;
+    if (inputs[0].pcm != out.data()) {
+        out.resize(samples);
+    }
+    for (size_t i = 0; i < count; i++) {
+        auto& input = inputs[i];
+        int32_t target = gain_q15_[input.source];
+        if (input.source > highest) {
+            target = (int32_t)(((int64_t)target * ducking_q15_) >> 15);
+        }
+        Apply(input.source, target, out.data(), input.pcm, std::min(input.samples, samples), i > 0);
+    }
+}
+
+void AudioMixer::Apply(Source source, int32_t target_q15, int16_t* dst, const int16_t* src, size_t samples, bool add) {
+    int32_t from_q15 = current_q15_[source];
+    current_q15_[source] = target_q15;
+    if (from_q15 == target_q15 || samples == 0) {
+        if (add) {
+            audio_dsp::MixAdd(dst, src, samples, target_q15);
+        } else {
+            audio_dsp::Gain(dst, src, samples, target_q15);
+        }
+        return;
+    }
+
+    /* Linear ramp to the new gain over this frame */
+    int64_t step = ((int64_t)(target_q15 - from_q15) << 16) / (int64_t)samples;
+    int64_t gain = (int64_t)from_q15 << 16;
+    for (size_t i = 0; i < samples; i++, gain += step) {
+        int32_t value = (int32_t)(((int64_t)src[i] * (gain >> 16)) >> 15);
+        if (add) {
+            value += dst[i];
+        }
+        dst[i] = (int16_t)std::clamp<int32_t>(value, INT16_MIN, INT16_MAX);
+    }
+}
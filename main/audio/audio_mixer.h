@@ -0,0 +1,50 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Mixes the playback sources of the output task into one frame at the codec output rate.
+ *
+ * Sources are prioritized by their id, a lower id wins. While a source is in the mix every
+ * source of lower priority is ducked, and each source also has its own gain. Gain changes
+ * ramp over one frame so ducking does not click.
+ */
+class AudioMixer {
+public:
+    enum Source {
+        kSourceSound,   // Cached UI prompts
+        kSourceStream,  // Server speech and streamed sounds from the Opus decoder
+        kSourceCount,
+    };
+
+    struct Input {
+        Source source;
+        const int16_t* pcm;
+        size_t samples;
+    };
+
+    AudioMixer();
+
+    // Thread safe, gains are 0.0 - 1.0
+    void SetGain(Source source, float gain);
+    // Gain applied to lower priority sources while a higher priority one plays
+    void SetDucking(float gain);
+
+    // Mixes inputs into out, which keeps the length of inputs[0]. inputs[0].pcm may be out.data(),
+    // longer inputs are truncated.
+    void Mix(const Input* inputs, size_t count, std::vector<int16_t>& out);
+
+private:
+    std::array<std::atomic<int32_t>, kSourceCount> gain_q15_;
+    std::array<int32_t, kSourceCount> current_q15_;  // Owned by the mixing task
+    std::atomic<int32_t> ducking_q15_ = 32768;
+
+    void Apply(Source source, int32_t target_q15, int16_t* dst, const int16_t* src, size_t samples, bool add);
+};
+
+#endif // AUDIO_MIXER_H
@@ -13,14 +13,21 @@ public:
     virtual ~AudioProcessor() = default;
     
     virtual void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) = 0;
-    virtual void Feed(std::vector<int16_t>&& data) = 0;
+    // The caller keeps the buffer and reads the next chunk into it, copy what must outlive the call
+    virtual void Feed(const std::vector<int16_t>& data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual bool IsRunning() = 0;
     virtual void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) = 0;
     virtual void OnVadStateChange(std::function<void(bool speaking)> callback) = 0;
+    // Called after the last (possibly partial) output frame of an utterance has been emitted
+    virtual void OnEndOfUtterance(std::function<void()> callback) = 0;
     virtual size_t GetFeedSize() = 0;
     virtual void EnableDeviceAec(bool enable) = 0;
+    // Processing profile in use, for telemetry
+    virtual const char* GetModeName() { return "none"; }
+    // While stopped, frees the processing instance until the next Start(). False if nothing is held
+    virtual bool Release() { return false; }
 };
 
 #endif
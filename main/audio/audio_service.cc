@@ -1,17 +1,16 @@
 #include "audio_service.h"
+#include "audio_dsp.h"
+#include "audio_codec_layout.h"
+#include "audio_hot.h"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <cstring>
-
-#define RATE_CVT_CFG(_src_rate, _dest_rate, _channel)        \
-    (esp_ae_rate_cvt_cfg_t)                                  \
-    {                                                        \
-        .src_rate        = (uint32_t)(_src_rate),            \
-        .dest_rate       = (uint32_t)(_dest_rate),           \
-        .channel         = (uint8_t)(_channel),              \
-        .bits_per_sample = ESP_AUDIO_BIT16,                  \
-        .complexity      = 2,                                \
-        .perf_type       = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,  \
-    }
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cJSON.h>
+#include "settings.h"
+#include "task_manifest.h"
 
 #define OPUS_DEC_CFG(_sample_rate, _frame_duration_ms)                                                    \
     (esp_opus_dec_cfg_t)                                                                                  \
@@ -24,6 +23,9 @@
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
+#if CONFIG_USE_SHARED_AFE
+#include "processors/afe_shared_processor.h"
+#endif
 #else
 #include "processors/no_audio_processor.h"
 #endif
@@ -39,6 +41,11 @@
 
 AudioService::AudioService() {
     event_group_ = xEventGroupCreate();
+#if CONFIG_AUDIO_STREAM_PLAYER
+    stream_player_.OnDataAvailable([this]() {
+        NotifyTask(opus_decoder_task_handle_);
+    });
+#endif
 }
 
 AudioService::~AudioService() {
@@ -48,47 +55,90 @@ AudioService::~AudioService() {
     if (opus_encoder_ != nullptr) {
         esp_opus_enc_close(opus_encoder_);
     }
-    if (opus_decoder_ != nullptr) {
-        esp_opus_dec_close(opus_decoder_);
-    }
-    if (input_resampler_ != nullptr) {
-        esp_ae_rate_cvt_close(input_resampler_);
-    }
-    if (output_resampler_ != nullptr) {
-        esp_ae_rate_cvt_close(output_resampler_);
+    for (auto& slot : decoder_slots_) {
+        if (slot.decoder != nullptr) {
+            esp_opus_dec_close(slot.decoder);
+        }
     }
 }
 
 void AudioService::Initialize(AudioCodec* codec) {
     codec_ = codec;
+    if (!codec_layout::Matches(codec_)) {
+        ESP_LOGE(TAG, "Codec input %d Hz x%d%s does not match CONFIG_AUDIO_CODEC_FIXED_LAYOUT", codec_->input_sample_rate(),
+            codec_->input_channels(), codec_->input_reference() ? " with reference" : "");
+        abort();
+    }
     codec_->Start();
+    codec_->StartOutputClock();
+#if CONFIG_AUDIO_TASK_MONITOR
+    codec_->StartOverflowCounters();
+    task_monitor_.SetCodec(codec_);
+#endif
+#if CONFIG_AUDIO_CAPTURE
+    capture_ = std::make_unique<AudioCapture>(CONFIG_AUDIO_CAPTURE_SECONDS);
+#endif
 
-    esp_opus_dec_cfg_t opus_dec_cfg = OPUS_DEC_CFG(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
-    auto ret = esp_opus_dec_open(&opus_dec_cfg, sizeof(esp_opus_dec_cfg_t), &opus_decoder_);
-    if (opus_decoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", ret);
-    } else {
-        decoder_sample_rate_ = codec->output_sample_rate();
-        decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
-        decoder_frame_size_ = decoder_sample_rate_ / 1000 * OPUS_FRAME_DURATION_MS;
-    }
-    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG();
-    ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
-    if (opus_encoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
-    } else {
-        encoder_sample_rate_ = 16000;
-        encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
-        esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
-        encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
+#if CONFIG_USE_AUDIO_PROCESSOR
+    if (codec_->input_reference()) {
+        Settings settings("audio", false);
+        aec_reference_delay_.SetDelay(settings.GetInt("aec_ref_delay", 0), codec_->input_channels());
+        if (aec_reference_delay_.delay() != 0) {
+            ESP_LOGI(TAG, "AEC reference delay: %d samples", aec_reference_delay_.delay());
+        }
     }
+#endif
+
+    SetDecodeSampleRate(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
+    mixer_.SetDucking(CONFIG_AUDIO_MIXER_DUCKING_PERCENT / 100.0f);
+    OpenEncoder(encoder_settings_);
+#if CONFIG_WAKE_WORD_ENERGY_GATE
+    wake_word_gate_.Initialize(codec->input_channels());
+#endif
+#if CONFIG_PUSH_TO_TALK_PREROLL
+    talk_preroll_ = std::make_unique<PcmRing>(CONFIG_PUSH_TO_TALK_PREROLL_MS * 16 * codec->input_channels());
+#endif
+
+    /* Pre-allocate the audio frames, sized for the largest PCM / Opus frame we expect */
+    size_t pcm_reserve = std::max(codec->output_sample_rate(), 16000) / 1000 * OPUS_FRAME_DURATION_MS * codec->output_channels();
+    audio_task_pool_.Initialize(AUDIO_TASK_POOL_SIZE,
+        [pcm_reserve](AudioTask& task) { task.pcm.reserve(pcm_reserve); },
+        [](AudioTask& task) {
+            task.pcm.clear();
+            task.timestamp = 0;
+            task.flags = 0;
+            task.trace_origin_us = task.trace_last_us = 0;
+            task.latency_marker = false;
+        });
+    size_t payload_reserve = AUDIO_PACKET_HEADROOM + std::max(encoder_outbuf_size_, AUDIO_PACKET_RESERVE_BYTES);
+    uplink_pending_pcm_.reserve(pcm_reserve);
+    audio_packet_pool_.Initialize(AUDIO_PACKET_POOL_SIZE,
+        [payload_reserve](AudioStreamPacket& packet) { packet.payload.reserve(payload_reserve); },
+        [](AudioStreamPacket& packet) {
+            packet.payload.clear();
+            packet.headroom = 0;
+            packet.timestamp = 0;
+            packet.flags = 0;
+            packet.trace_origin_us = packet.trace_last_us = 0;
+        });
+
+#if CONFIG_AUDIO_UPLINK_SILENCE_GATE
+    uplink_gate_ = std::make_unique<UplinkSilenceGate>(CONFIG_AUDIO_UPLINK_SILENCE_HANGOVER_MS,
+        CONFIG_AUDIO_UPLINK_SILENCE_PREROLL_MS, CONFIG_AUDIO_UPLINK_SILENCE_KEEPALIVE_MS,
+        [this](std::unique_ptr<AudioStreamPacket>&& packet) { QueueSendPacket(std::move(packet)); },
+        [this](std::unique_ptr<AudioStreamPacket>&& packet) { audio_packet_pool_.Release(std::move(packet)); });
+#endif
+
+#if CONFIG_AUDIO_JITTER_BUFFER
+    jitter_buffer_ = std::make_unique<JitterBuffer>(CONFIG_AUDIO_JITTER_BUFFER_MIN_MS,
+        CONFIG_AUDIO_JITTER_BUFFER_MAX_MS, JITTER_BUFFER_MAX_PACKETS);
+#endif
+    ApplyLatencyProfile(AudioLatencyProfile::Boot());
 
     if (codec->input_sample_rate() != 16000) {
-        esp_ae_rate_cvt_cfg_t input_resampler_cfg = RATE_CVT_CFG(
-            codec->input_sample_rate(), ESP_AUDIO_SAMPLE_RATE_16K, codec->input_channels());
-        auto resampler_ret = esp_ae_rate_cvt_open(&input_resampler_cfg, &input_resampler_);
-        if (input_resampler_ == nullptr) {
-            ESP_LOGE(TAG, "Failed to create input resampler, error code: %d", resampler_ret);
+        input_resampler_ = std::make_unique<Resampler>(codec->input_sample_rate(), 16000, codec->input_channels());
+        if (!input_resampler_->ok()) {
+            input_resampler_.reset();
         }
     }
 
@@ -98,16 +148,7 @@ void AudioService::Initialize(AudioCodec* codec) {
     audio_processor_ = std::make_unique<NoAudioProcessor>();
 #endif
 
-    audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
-    });
-
-    audio_processor_->OnVadStateChange([this](bool speaking) {
-        voice_detected_ = speaking;
-        if (callbacks_.on_vad_change) {
-            callbacks_.on_vad_change(speaking);
-        }
-    });
+    SetupAudioProcessor();
 
     esp_timer_create_args_t audio_power_timer_args = {
         .callback = [](void* arg) {
@@ -128,42 +169,41 @@ void AudioService::Start() {
 
     esp_timer_start_periodic(audio_power_timer_, 1000000);
 
-#if CONFIG_USE_AUDIO_PROCESSOR
-    /* Start the audio input task */
-    xTaskCreatePinnedToCore([](void* arg) {
+    /* Stacks, priorities and cores come from the task manifest */
+    TaskManifest::Create("audio_input", [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioInputTask();
-        vTaskDelete(NULL);
-    }, "audio_input", 2048 * 3, this, 8, &audio_input_task_handle_, 0);
+        TaskManifest::Exit();
+    }, this, &audio_input_task_handle_);
 
-    /* Start the audio output task */
-    xTaskCreate([](void* arg) {
+    TaskManifest::Create("audio_output", [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioOutputTask();
-        vTaskDelete(NULL);
-    }, "audio_output", 2048 * 2, this, 4, &audio_output_task_handle_);
-#else
-    /* Start the audio input task */
-    xTaskCreate([](void* arg) {
-        AudioService* audio_service = (AudioService*)arg;
-        audio_service->AudioInputTask();
-        vTaskDelete(NULL);
-    }, "audio_input", 2048 * 2, this, 8, &audio_input_task_handle_);
+        TaskManifest::Exit();
+    }, this, &audio_output_task_handle_);
 
-    /* Start the audio output task */
-    xTaskCreate([](void* arg) {
+#if CONFIG_AUDIO_SPLIT_OPUS_CODEC_TASKS
+    /* Start the opus decoder and encoder tasks on separate cores, so decode and encode never delay each other */
+    TaskManifest::Create("opus_decoder", [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->AudioOutputTask();
-        vTaskDelete(NULL);
-    }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
-#endif
+        audio_service->OpusDecoderTask();
+        TaskManifest::Exit();
+    }, this, &opus_decoder_task_handle_);
 
+    TaskManifest::Create("opus_encoder", [](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusEncoderTask();
+        TaskManifest::Exit();
+    }, this, &opus_encoder_task_handle_);
+#else
     /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    TaskManifest::Create("opus_codec", [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->OpusCodecTask();
-        vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 12, this, 2, &opus_codec_task_handle_);
+        TaskManifest::Exit();
+    }, this, &opus_decoder_task_handle_);
+    opus_encoder_task_handle_ = opus_decoder_task_handle_;
+#endif
 }
 
 void AudioService::Stop() {
@@ -171,51 +211,138 @@ void AudioService::Stop() {
     service_stopped_ = true;
     xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
         AS_EVENT_WAKE_WORD_RUNNING |
-        AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+        AS_EVENT_AUDIO_PROCESSOR_RUNNING |
+        AS_EVENT_ENCODE_QUEUE_AVAILABLE |
+        AS_EVENT_DECODE_QUEUE_AVAILABLE |
+        AS_EVENT_PLAYBACK_QUEUE_POPPED);
+
+    audio_encode_queue_.Flush();
+    audio_decode_queue_.Flush();
+    audio_playback_queue_.Flush();
+    audio_testing_queue_.Clear();
+    NotifyTask(opus_decoder_task_handle_);
+    NotifyTask(opus_encoder_task_handle_);
+    NotifyTask(audio_output_task_handle_);
+}
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+void AudioService::NotifyTask(TaskHandle_t task) {
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
 }
 
-bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+void AudioService::OpenEncoder(const OpusEncoderSettings& settings) {
+    if (opus_encoder_ != nullptr) {
+        esp_opus_enc_close(opus_encoder_);
+        opus_encoder_ = nullptr;
+    }
+    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG(settings);
+    auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
+    if (opus_encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
+        return;
+    }
+    encoder_sample_rate_ = 16000;
+    encoder_duration_ms_ = settings.frame_duration_ms;
+    esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
+    encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
+    ESP_LOGI(TAG, "Opus encoder: %d ms, bitrate %d, complexity %d, fec %d", settings.frame_duration_ms,
+        settings.bitrate, settings.complexity, settings.enable_fec);
+}
+
+bool AudioService::SetEncoderSettings(const OpusEncoderSettings& settings) {
+    if ((settings.frame_duration_ms != 20 && settings.frame_duration_ms != 40 && settings.frame_duration_ms != 60) ||
+        (settings.bitrate != 0 && (settings.bitrate < 6000 || settings.bitrate > 510000)) ||
+        settings.complexity < 0 || settings.complexity > 10) {
+        ESP_LOGW(TAG, "Invalid encoder settings: %d ms, bitrate %d, complexity %d", settings.frame_duration_ms,
+            settings.bitrate, settings.complexity);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(encoder_settings_mutex_);
+    encoder_settings_ = settings;
+    uplink_frame_samples_ = 16000 / 1000 * settings.frame_duration_ms;
+    encoder_settings_changed_ = true;
+    NotifyTask(opus_encoder_task_handle_);
+    return true;
+}
+
+bool AudioService::SetLatencyProfile(const std::string& name) {
+    auto profile = AudioLatencyProfile::Select(name);
+    if (profile == nullptr) {
+        return false;
+    }
+    ApplyLatencyProfile(*profile);
+    if (profile != &AudioLatencyProfile::Boot()) {
+        ESP_LOGI(TAG, "Latency profile %s, its I2S DMA depth applies after a reboot", profile->name);
+    }
+    return true;
+}
+
+void AudioService::ApplyLatencyProfile(const AudioLatencyProfile& profile) {
+    encode_queue_limit_ = profile.encode_queue;
+    playback_queue_limit_ = profile.playback_queue;
+    jitter_min_ms_ = profile.jitter_min_ms;
+    jitter_max_ms_ = profile.jitter_max_ms;
+    jitter_range_changed_ = true;
+    // A frame duration from the server hello replaces this one again
+    auto settings = GetEncoderSettings();
+    if (settings.frame_duration_ms != profile.uplink_frame_ms) {
+        settings.frame_duration_ms = profile.uplink_frame_ms;
+        SetEncoderSettings(settings);
+    }
+}
+
+OpusEncoderSettings AudioService::GetEncoderSettings() {
+    std::lock_guard<std::mutex> lock(encoder_settings_mutex_);
+    return encoder_settings_;
+}
+
+bool AUDIO_HOT AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
         codec_->EnableInput(true);
     }
 
-    if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
+    const int input_rate = codec_layout::InputSampleRate(codec_);
+    const int channels = codec_layout::InputChannels(codec_);
+    int64_t read_start_us = esp_timer_get_time();
+    if (input_rate != sample_rate) {
+        data.resize(samples * input_rate / sample_rate * channels);
         if (!codec_->InputData(data)) {
             return false;
         }
-        if (input_resampler_ != nullptr) {
+        if (input_rate != 16000 && input_resampler_ != nullptr) {
             std::lock_guard<std::mutex> lock(input_resampler_mutex_);
-            uint32_t in_sample_num = data.size() / codec_->input_channels();
-            uint32_t output_samples = 0;
-            esp_ae_rate_cvt_get_max_out_sample_num(input_resampler_, in_sample_num, &output_samples);
-            auto resampled = std::vector<int16_t>(output_samples * codec_->input_channels());
-            uint32_t actual_output = output_samples;
-            esp_ae_rate_cvt_process(input_resampler_, (esp_ae_sample_t)data.data(), in_sample_num,
-                                   (esp_ae_sample_t)resampled.data(), &actual_output);
-            resampled.resize(actual_output * codec_->input_channels());
-            data = std::move(resampled);
+            input_resampler_->Process(data, input_resample_buffer_);
+            // Swap instead of move so both buffers keep their capacity for the next frame
+            data.swap(input_resample_buffer_);
         }
     } else {
-        data.resize(samples * codec_->input_channels());
+        data.resize(samples * channels);
         if (!codec_->InputData(data)) {
             return false;
         }
     }
 
+#if CONFIG_USE_AUDIO_PROCESSOR
+    if (codec_layout::InputReference(codec_) && sample_rate == 16000) {
+        aec_reference_delay_.Apply(data.data(), data.size() / channels);
+    }
+#endif
+
     /* Update the last input time */
     last_input_time_ = std::chrono::steady_clock::now();
+    last_input_read_us_ = esp_timer_get_time();
+    latency_tracer_.MarkDuration(kLatencyStageI2sRead, last_input_read_us_ - read_start_us);
     debug_statistics_.input_count++;
 
+#if CONFIG_AUDIO_CAPTURE
+    if (sample_rate == AUDIO_CAPTURE_SAMPLE_RATE) {
+        capture_->WriteInput(data.data(), data.size(), channels, codec_layout::InputReference(codec_));
+    }
+#endif
+
 #if CONFIG_USE_AUDIO_DEBUGGER
     // 音频调试：发送原始音频数据
     if (audio_debugger_ == nullptr) {
@@ -227,10 +354,87 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     return true;
 }
 
-void AudioService::AudioInputTask() {
+#if CONFIG_LP_VOICE_WAKE
+void AudioService::SetWakeWordPreroll(std::vector<int16_t>&& pcm) {
+    // Laid out like the codec input, the reference channels stay silent
+    int channels = codec_->input_channels();
+    wake_word_preroll_.assign(pcm.size() * channels, 0);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        wake_word_preroll_[i * channels] = pcm[i];
+    }
+}
+#endif
+
+void AudioService::FeedWakeWord(const std::vector<int16_t>& data, EventBits_t bits) {
+#if CONFIG_LP_VOICE_WAKE
+    if (!wake_word_preroll_.empty() && (bits & AS_EVENT_WAKE_WORD_RUNNING)) {
+        wake_word_->Feed(wake_word_preroll_);
+        std::vector<int16_t>().swap(wake_word_preroll_);
+    }
+#endif
+#if CONFIG_WAKE_WORD_ENERGY_GATE
+    // Only the idle wait is gated, voice processing needs every chunk
+    if (!(bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING)) {
+        if (!wake_word_gate_.Process(data)) {
+            return;
+        }
+        if (wake_word_gate_.TakeLookback(wake_word_lookback_)) {
+            wake_word_->Feed(wake_word_lookback_);
+        }
+    }
+#endif
+    wake_word_->Feed(data);
+}
+
+#if CONFIG_PUSH_TO_TALK_PREROLL
+void AudioService::StartTalkPreroll() {
+    if (talk_preroll_ == nullptr || IsAudioProcessorRunning()) {
+        return;
+    }
+    talk_preroll_->Clear();
+    xEventGroupSetBits(event_group_, AS_EVENT_TALK_PREROLL_RUNNING);
+}
+
+/*
+ * Every read goes into the ring while the talk pre-roll runs. Once the audio processor is
+ * running, two chunks come out of the ring per chunk read, so it catches up with the live
+ * input in about the time it was buffering, without stalling the input task.
+ */
+void AudioService::FeedTalkPreroll(const std::vector<int16_t>& data, EventBits_t bits) {
+    talk_preroll_->Write(data.data(), data.size());
+    if (!(bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING)) {
+        return;
+    }
+    talk_preroll_chunk_.resize(data.size() * 2);
+    size_t samples = talk_preroll_->Read(talk_preroll_chunk_.data(), talk_preroll_chunk_.size());
+    talk_preroll_chunk_.resize(samples);
+    if (shared_afe_) {
+        wake_word_->Feed(talk_preroll_chunk_);
+    } else {
+        audio_processor_->Feed(talk_preroll_chunk_);
+    }
+    if (talk_preroll_->size() == 0) {
+        xEventGroupClearBits(event_group_, AS_EVENT_TALK_PREROLL_RUNNING);
+        ESP_LOGI(TAG, "Talk pre-roll caught up with the input");
+    }
+}
+#endif
+
+// The consumer's feed chunk, so a read is fed whole and never buffered again
+int AudioService::GetInputFeedSamples(EventBits_t bits) {
+    size_t samples = 0;
+    if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
+        samples = audio_processor_->GetFeedSize();
+    } else if (wake_word_ != nullptr) {
+        samples = wake_word_->GetFeedSize();
+    }
+    return samples > 0 ? samples : 160; // 10ms
+}
+
+void AUDIO_HOT AudioService::AudioInputTask() {
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
-            AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
+            AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_TALK_PREROLL_RUNNING,
             pdFALSE, pdFALSE, portMAX_DELAY);
 
         if (service_stopped_) {
@@ -244,7 +448,7 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.size() * encoder_duration_ms_ >= AUDIO_TESTING_MAX_DURATION_MS) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
@@ -253,12 +457,9 @@ void AudioService::AudioInputTask() {
             int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
-                if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                if (codec_layout::InputChannels(codec_) == 2) {
+                    audio_dsp::ExtractChannel(data.data(), data.data(), data.size() / 2, 2, 0);
+                    data.resize(data.size() / 2);
                 }
                 PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
                 continue;
@@ -266,15 +467,27 @@ void AudioService::AudioInputTask() {
         }
 
         /* Feed the wake word and/or audio processor */
-        if (bits & (AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING)) {
-            int samples = 160; // 10ms
-            std::vector<int16_t> data;
-            if (ReadAudioData(data, 16000, samples)) {
+        if (bits & (AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_TALK_PREROLL_RUNNING)) {
+            // Read one feed chunk into the same buffer every time, both consumers take it by reference
+            auto& data = input_feed_buffer_;
+            if (ReadAudioData(data, 16000, GetInputFeedSamples(bits))) {
+#if CONFIG_PUSH_TO_TALK_PREROLL
+                // The talk button was pressed, the wake word is not needed any more
+                if (bits & AS_EVENT_TALK_PREROLL_RUNNING) {
+                    FeedTalkPreroll(data, bits);
+                    continue;
+                }
+#endif
+                if (shared_afe_) {
+                    // One AFE behind both, fed once
+                    FeedWakeWord(data, bits);
+                    continue;
+                }
                 if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-                    wake_word_->Feed(data);
+                    FeedWakeWord(data, bits);
                 }
                 if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-                    audio_processor_->Feed(std::move(data));
+                    audio_processor_->Feed(data);
                 }
                 continue;
             }
@@ -287,244 +500,744 @@ void AudioService::AudioInputTask() {
     ESP_LOGW(TAG, "Audio input task stopped");
 }
 
-void AudioService::AudioOutputTask() {
+void AUDIO_HOT AudioService::AudioOutputTask() {
+    const size_t cached_frame_samples = codec_->output_sample_rate() / 1000 * OPUS_FRAME_DURATION_MS;
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        std::unique_ptr<AudioTask> task;
+        bool from_stream = false;
+        TickType_t wait = portMAX_DELAY;
+        while (!service_stopped_ && !output_flush_requested_ && !(from_stream = PopPlaybackFrame(task, wait)) &&
+            !PopCachedSoundFrame(task, cached_frame_samples)) {
+            if (silence_watched_.exchange(false) && callbacks_.on_output_silent) {
+                /* The DMA buffers still play what was written last */
+                callbacks_.on_output_silent(std::max<int64_t>(output_drain_us_, esp_timer_get_time()));
+            }
+            ulTaskNotifyTake(pdTRUE, wait);
+        }
         if (service_stopped_) {
             break;
         }
+        if (output_flush_requested_.exchange(false)) {
+            /* Flushed with the playback queue, a popped frame is stale too */
+            if (task != nullptr) {
+                audio_task_pool_.Release(std::move(task));
+            }
+            FlushOutput();
+            continue;
+        }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
-
-        if (!codec_->output_enabled()) {
-            esp_timer_stop(audio_power_timer_);
-            esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-            codec_->EnableOutput(true);
+        /* A slot in the playback queue is free, let the codec task decode the next packet */
+        if (from_stream) {
+            NotifyTask(opus_decoder_task_handle_);
         }
+        xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_QUEUE_POPPED);
+        MixPlaybackFrame(*task, from_stream);
+
+        WakeOutput();
 
+        size_t samples = task->pcm.size();
+        RecordOutput(task->pcm, from_stream);
+#if CONFIG_AUDIO_CAPTURE
+        capture_->Write(AudioCapture::kTrackPlayback, task->pcm.data(), task->pcm.size(), codec_->output_sample_rate());
+#endif
+        int64_t output_us = esp_timer_get_time();
         codec_->OutputData(task->pcm);
+        int64_t render_us = UpdatePlaybackClock(samples);
+        latency_tracer_.Mark(kLatencyStageOutput, task->trace_origin_us, task->trace_last_us);
+#if CONFIG_AUDIO_LATENCY_BENCHMARK
+        if (task->latency_marker) {
+            latency_marker_render_us_ = render_us;
+            latency_marker_output_us_ = output_us;
+        }
+#endif
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
         debug_statistics_.playback_count++;
 
 #if CONFIG_USE_SERVER_AEC
-        /* Record the timestamp for server AEC */
+        /* Record when the frame reaches the speaker for server AEC */
         if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+            std::lock_guard<std::mutex> lock(timestamp_mutex_);
+            render_log_.push_back({task->timestamp, render_us, (int64_t)samples * 1000000 / codec_->output_sample_rate()});
+            if (render_log_.size() > MAX_RENDER_RECORDS) {
+                render_log_.pop_front();
+            }
         }
 #endif
+        audio_task_pool_.Release(std::move(task));
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
 void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
+    while (!service_stopped_) {
+        bool decoded = DecodeNextPacket();
+        bool encoded = EncodeNextTask();
+        if (!decoded && !encoded) {
+            ulTaskNotifyTake(pdTRUE, DecoderWaitTicks());
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus codec task stopped");
+}
+
+#if CONFIG_AUDIO_SPLIT_OPUS_CODEC_TASKS
+void AudioService::OpusDecoderTask() {
+    while (!service_stopped_) {
+        if (!DecodeNextPacket()) {
+            ulTaskNotifyTake(pdTRUE, DecoderWaitTicks());
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus decoder task stopped");
+}
+
+void AudioService::OpusEncoderTask() {
+    while (!service_stopped_) {
+        if (!EncodeNextTask()) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus encoder task stopped");
+}
+#endif
+
+TickType_t AudioService::DecoderWaitTicks() {
+    if (!jitter_buffer_) {
+        return portMAX_DELAY;
+    }
+    /* Wake up when the jitter buffer is due, even if no new packet arrives */
+    int wait_ms = jitter_buffer_->WaitTimeMs(esp_timer_get_time());
+    return wait_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms) + 1;
+}
+
+bool AudioService::PopCachedSoundFrame(std::unique_ptr<AudioTask>& task, size_t samples) {
+    if (!sound_cache_.busy()) {
+        return false;
+    }
+    task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    if (!sound_cache_.NextFrame(task->pcm, samples)) {
+        audio_task_pool_.Release(std::move(task));
+        return false;
+    }
+    return true;
+}
+
+void AudioService::MixPlaybackFrame(AudioTask& task, bool from_stream) {
+    AudioMixer::Input inputs[AudioMixer::kSourceCount];
+    size_t count = 0;
+    if (from_stream) {
+        inputs[count++] = {AudioMixer::kSourceStream, task.pcm.data(), task.pcm.size()};
+        /* A cached prompt plays on top of the stream instead of waiting behind it */
+        if (sound_cache_.busy() && sound_cache_.NextFrame(mix_buffer_, task.pcm.size())) {
+            inputs[count++] = {AudioMixer::kSourceSound, mix_buffer_.data(), mix_buffer_.size()};
+        }
+    } else {
+        inputs[count++] = {AudioMixer::kSourceSound, task.pcm.data(), task.pcm.size()};
+    }
+    mixer_.Mix(inputs, count, task.pcm);
+}
+
+void AudioService::RecordOutput(const std::vector<int16_t>& pcm, bool from_stream) {
+    if (output_history_.empty()) {
+        output_history_.resize(OUTPUT_DMA_SAMPLES);
+    }
+    size_t count = std::min(pcm.size(), output_history_.size());
+    const int16_t* src = pcm.data() + pcm.size() - count;
+    for (size_t i = 0; i < count; i++) {
+        output_history_[output_history_pos_] = src[i];
+        output_history_pos_ = (output_history_pos_ + 1) % output_history_.size();
+    }
+
+    if (from_stream) {
+        output_stream_samples_ += pcm.size();
+    }
+}
+
+/*
+ * Called right after OutputData() returned, returns when the first sample of the frame plays.
+ * A write that had to wait returns right after the DMA finished a descriptor and refilled it,
+ * so the buffers end one DMA length after that interrupt. Otherwise the frame was queued
+ * behind what the DMA still held.
+ */
+int64_t AudioService::UpdatePlaybackClock(size_t samples) {
+    int rate = codec_->output_sample_rate();
+    int64_t now = esp_timer_get_time();
+    int64_t frame_us = (int64_t)samples * 1000000 / rate;
+    int64_t dma_us = (int64_t)OUTPUT_DMA_SAMPLES * 1000000 / rate;
+    int64_t descriptor_us = (int64_t)AUDIO_CODEC_DMA_FRAME_NUM * 1000000 / rate;
+    int64_t sent_us = codec_->last_output_sent_us();
+    int64_t drain;
+    if (sent_us > 0 && now - sent_us < descriptor_us / 2) {
+        drain = sent_us + dma_us;
+    } else {
+        drain = std::min(std::max<int64_t>(output_drain_us_, now) + frame_us, now + dma_us);
+    }
+    output_drain_us_ = drain;
+    return drain - frame_us;
+}
+
+uint32_t AudioService::PlaybackTimestampAt(int64_t time_us) {
+    std::lock_guard<std::mutex> lock(timestamp_mutex_);
+    while (!render_log_.empty() && render_log_.front().render_us + render_log_.front().duration_us <= time_us) {
+        render_log_.pop_front();
+    }
+    if (render_log_.empty() || render_log_.front().render_us > time_us) {
+        return 0;
+    }
+    auto& record = render_log_.front();
+    return record.timestamp + (uint32_t)((time_us - record.render_us) / 1000);
+}
+
+int AudioService::BufferedOutputSamples() {
+    int64_t remaining_us = output_drain_us_ - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        return 0;
+    }
+    return std::min<int64_t>(remaining_us * codec_->output_sample_rate() / 1000000, OUTPUT_DMA_SAMPLES);
+}
+
+void AudioService::FlushOutput() {
+    /* Fade out from the sample being played right now */
+    size_t fade_samples = codec_->output_sample_rate() / 1000 * BARGE_IN_FADE_MS;
+    std::vector<int16_t> fade(fade_samples, 0);
+    size_t buffered = std::min<size_t>(BufferedOutputSamples(), output_history_.size());
+    if (buffered > 0) {
+        size_t start = (output_history_pos_ + output_history_.size() - buffered) % output_history_.size();
+        fade.resize(std::min(fade_samples, buffered));
+        for (size_t i = 0; i < fade.size(); i++) {
+            int32_t gain = (int32_t)((fade.size() - i) * 32768 / fade.size());
+            fade[i] = (int16_t)((output_history_[(start + i) % output_history_.size()] * gain) >> 15);
+        }
+    }
+    codec_->FlushOutput(fade);
+    output_drain_us_ = esp_timer_get_time() + BARGE_IN_FADE_MS * 1000;
+    std::fill(output_history_.begin(), output_history_.end(), 0);
+}
+
+bool AudioService::DecodeNextPacket() {
+    /* Drop the items flushed by ResetDecoder() / Stop() */
+    audio_decode_queue_.Reclaim();
+    if (release_decoder_.exchange(false) && audio_decode_queue_.empty() && !sound_player_.busy()) {
+        ReleaseDecoders();
+    }
+    if (jitter_buffer_ && jitter_buffer_reset_.exchange(false)) {
+        jitter_buffer_->Reset([this](std::unique_ptr<AudioStreamPacket>&& packet) {
+            audio_packet_pool_.Release(std::move(packet));
         });
-        if (service_stopped_) {
-            break;
+        jitter_buffer_size_ = 0;
+    }
+    if (jitter_buffer_ && jitter_range_changed_.exchange(false)) {
+        jitter_buffer_->SetDelayRange(jitter_min_ms_, jitter_max_ms_);
+    }
+    size_t playback_limit = playback_queue_limit_;
+#if CONFIG_AUDIO_DECODE_AHEAD
+    /* A held stream is decoded into the whole queue */
+    if (decode_ahead_held_) {
+        playback_limit = MAX_PLAYBACK_TASKS_IN_QUEUE;
+    }
+#endif
+    if (audio_playback_queue_.size() >= playback_limit) {
+        return false;
+    }
+
+#if CONFIG_AUDIO_LATENCY_BENCHMARK
+    /* The benchmark marker enters the playback queue like a decoded frame */
+    if (latency_marker_requested_.exchange(false)) {
+        auto task = audio_task_pool_.Acquire();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+        task->latency_marker = true;
+        LatencyBenchmark::MakeMarker(task->pcm, codec_->output_sample_rate());
+        latency_marker_queued_us_ = esp_timer_get_time();
+        if (audio_playback_queue_.Push(std::move(task))) {
+            NotifyTask(audio_output_task_handle_);
+        } else {
+            audio_task_pool_.Release(std::move(task));
         }
+        return true;
+    }
+#endif
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
+    /* Local sounds go ahead of the server stream */
+    bool stream_idle = audio_decode_queue_.empty() && jitter_buffer_size_ == 0;
+    if (sound_player_.NextPacket(sound_packet_, stream_idle, codec_->output_sample_rate())) {
+        DecodeToPlaybackQueue(&sound_packet_, ESP_AUDIO_DEC_RECOVERY_NONE);
+        debug_statistics_.decode_count++;
+        return true;
+    }
+    /* Decode missed prompts into the PCM cache while no audio is streaming */
+    if (stream_idle && sound_cache_.load_pending() && !sound_player_.busy()) {
+        sound_cache_.LoadPending(codec_->output_sample_rate());
+    }
+#if CONFIG_AUDIO_STREAM_PLAYER
+    /* The long-form stream fills the gaps between sounds and server audio */
+    if (stream_idle && !sound_player_.busy() && stream_player_.NextPacket(stream_packet_, codec_->output_sample_rate())) {
+        DecodeToPlaybackQueue(&stream_packet_, ESP_AUDIO_DEC_RECOVERY_NONE);
+        return true;
+    }
+#endif
 
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_ != nullptr) {
-                task->pcm.resize(decoder_frame_size_);
-                esp_audio_dec_in_raw_t raw = {
-                    .buffer = (uint8_t *)(packet->payload.data()),
-                    .len = (uint32_t)(packet->payload.size()),
-                    .consumed = 0,
-                    .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
-                };
-                esp_audio_dec_out_frame_t out_frame = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(task->pcm.size() * sizeof(int16_t)),
-                    .decoded_size = 0,
-                };
-                esp_audio_dec_info_t dec_info = {};
-                std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-                auto ret = esp_opus_dec_decode(opus_decoder_, &raw, &out_frame, &dec_info);
-                decoder_lock.unlock();
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    task->pcm.resize(out_frame.decoded_size / sizeof(int16_t));
-                    if (decoder_sample_rate_ != codec_->output_sample_rate() && output_resampler_ != nullptr) {
-                        uint32_t target_size = 0;
-                        esp_ae_rate_cvt_get_max_out_sample_num(output_resampler_, task->pcm.size(), &target_size);
-                        std::vector<int16_t> resampled(target_size);
-                        uint32_t actual_output = target_size;
-                        esp_ae_rate_cvt_process(output_resampler_, (esp_ae_sample_t)task->pcm.data(), task->pcm.size(),
-                                                (esp_ae_sample_t)resampled.data(), &actual_output);
-                        resampled.resize(actual_output);
-                        task->pcm = std::move(resampled);
-                    }
-                    lock.lock();
-                    audio_playback_queue_.push_back(std::move(task));
-                    audio_queue_cv_.notify_all();
-                    debug_statistics_.decode_count++;
-                } else {
-                    ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
-                    lock.lock();
-                }
-            } else {
-                ESP_LOGE(TAG, "Audio decoder is not configured");
-                lock.lock();
-            }
-            debug_statistics_.decode_count++;
+    std::unique_ptr<AudioStreamPacket> packet;
+    if (!jitter_buffer_) {
+        if (!audio_decode_queue_.Pop(packet)) {
+            return false;
         }
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
+        xEventGroupSetBits(event_group_, AS_EVENT_DECODE_QUEUE_AVAILABLE);
+        DecodeToPlaybackQueue(packet.get(), PacketRecovery(packet.get()));
+        audio_packet_pool_.Release(std::move(packet));
+        debug_statistics_.decode_count++;
+        NotifyFirstStreamFrame();
+        return true;
+    }
+
+    /* Move the arrived packets into the jitter buffer, the decode queue keeps the backpressure */
+    bool popped = false;
+    int64_t now = esp_timer_get_time();
+    while (!jitter_buffer_->full() && audio_decode_queue_.Pop(packet)) {
+        popped = true;
+        if (!jitter_buffer_->Push(packet, now)) {
+            ESP_LOGW(TAG, "Drop late audio packet, timestamp: %lu", packet->timestamp);
+            audio_packet_pool_.Release(std::move(packet));
+        }
+    }
+    if (popped) {
+        xEventGroupSetBits(event_group_, AS_EVENT_DECODE_QUEUE_AVAILABLE);
+    }
+
+    const AudioStreamPacket* next = nullptr;
+    auto action = jitter_buffer_->Next(now, packet, next);
+    jitter_buffer_size_ = jitter_buffer_->size();
+    if (action == JitterBuffer::kWait) {
+        return false;
+    }
+    if (action == JitterBuffer::kConceal) {
+        DecodeToPlaybackQueue(next, next != nullptr ? ESP_AUDIO_DEC_RECOVERY_FEC : ESP_AUDIO_DEC_RECOVERY_PLC);
+        debug_statistics_.conceal_count++;
+        return true;
+    }
+    DecodeToPlaybackQueue(packet.get(), PacketRecovery(packet.get()));
+    audio_packet_pool_.Release(std::move(packet));
+    debug_statistics_.decode_count++;
+    NotifyFirstStreamFrame();
+    return true;
+}
+
+bool AudioService::PopPlaybackFrame(std::unique_ptr<AudioTask>& task, TickType_t& wait) {
+    wait = portMAX_DELAY;
+#if CONFIG_AUDIO_DECODE_AHEAD
+    if (decode_ahead_held_ && DecodeAheadHolds(wait)) {
+        return false;
+    }
+#endif
+    return audio_playback_queue_.Pop(task);
+}
+
+#if CONFIG_AUDIO_DECODE_AHEAD
+bool AudioService::DecodeAheadHolds(TickType_t& wait) {
+    int64_t now = esp_timer_get_time();
+    int64_t started = decode_ahead_started_us_;
+    int64_t deadline = started != 0 ? started + CONFIG_AUDIO_DECODE_AHEAD_MS * 1000 :
+        decode_ahead_prepared_us_ + DECODE_AHEAD_MAX_HOLD_MS * 1000;
+    size_t threshold = (size_t)codec_->output_sample_rate() * CONFIG_AUDIO_DECODE_AHEAD_MS / 1000;
+    /* A full queue is all the decoder can get ahead, a short reply may never reach the threshold */
+    bool ready = started != 0 && (decode_ahead_samples_ >= threshold ||
+        audio_playback_queue_.size() >= MAX_PLAYBACK_TASKS_IN_QUEUE);
+    if (ready || now >= deadline) {
+        decode_ahead_held_ = false;
+        ESP_LOGI(TAG, "Stream starts with %u ms decoded ahead", (unsigned)(decode_ahead_samples_ * 1000 / codec_->output_sample_rate()));
+        return false;
+    }
+    wait = pdMS_TO_TICKS((deadline - now) / 1000) + 1;
+    return true;
+}
+
+void AudioService::PrepareStream() {
+    ResetDecoder();
+    decode_ahead_samples_ = 0;
+    decode_ahead_started_us_ = 0;
+    decode_ahead_prepared_us_ = esp_timer_get_time();
+    decode_ahead_held_ = true;
+}
+
+void AudioService::StartStream() {
+    decode_ahead_started_us_ = esp_timer_get_time();
+    NotifyTask(audio_output_task_handle_);
+}
+#endif
+
+void AudioService::NotifyFirstStreamFrame() {
+    if (first_stream_frame_pending_.exchange(false) && callbacks_.on_first_stream_frame) {
+        callbacks_.on_first_stream_frame();
+    }
+}
+
+/* An empty packet marks a frame the transport lost, the decoder fills it with PLC */
+esp_audio_dec_recovery_t AudioService::PacketRecovery(const AudioStreamPacket* packet) {
+    if (packet->payload_size() == 0) {
+        debug_statistics_.conceal_count++;
+        return ESP_AUDIO_DEC_RECOVERY_PLC;
+    }
+    return ESP_AUDIO_DEC_RECOVERY_NONE;
+}
 
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-
-            if (opus_encoder_ != nullptr && task->pcm.size() == encoder_frame_size_) {
-                std::vector<uint8_t> buf(encoder_outbuf_size_);
-                esp_audio_enc_in_frame_t in = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
-                };
-                esp_audio_enc_out_frame_t out = {
-                    .buffer = buf.data(),
-                    .len = (uint32_t)encoder_outbuf_size_,
-                    .encoded_bytes = 0,
-                };
-                auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    packet->payload.assign(buf.data(), buf.data() + out.encoded_bytes);
-
-                    if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                        {
-                            std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                            audio_send_queue_.push_back(std::move(packet));
-                        }
-                        if (callbacks_.on_send_queue_available) {
-                            callbacks_.on_send_queue_available();
-                        }
-                    } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                        std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                        audio_testing_queue_.push_back(std::move(packet));
+/*
+ * Decode one frame into the playback queue. For ESP_AUDIO_DEC_RECOVERY_FEC `packet` is the
+ * packet that follows the missing frame, for ESP_AUDIO_DEC_RECOVERY_PLC it may be null.
+ */
+bool AudioService::DecodeToPlaybackQueue(const AudioStreamPacket* packet, esp_audio_dec_recovery_t recover) {
+    if (packet != nullptr && recover == ESP_AUDIO_DEC_RECOVERY_NONE) {
+        SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+    }
+    if (opus_decoder_ == nullptr) {
+        ESP_LOGE(TAG, "Audio decoder is not configured");
+        return false;
+    }
+    last_decode_us_ = esp_timer_get_time();
+
+    auto task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    if (packet != nullptr && recover == ESP_AUDIO_DEC_RECOVERY_NONE) {
+        task->timestamp = packet->timestamp;
+        task->trace_origin_us = packet->trace_origin_us;
+        task->trace_last_us = packet->trace_last_us;
+    }
+    task->pcm.resize(decoder_frame_size_);
+    esp_audio_dec_in_raw_t raw = {
+        .buffer = packet != nullptr ? (uint8_t *)(packet->payload_data()) : nullptr,
+        .len = packet != nullptr ? (uint32_t)(packet->payload_size()) : 0,
+        .consumed = 0,
+        .frame_recover = recover,
+    };
+    esp_audio_dec_out_frame_t out_frame = {
+        .buffer = (uint8_t *)(task->pcm.data()),
+        .len = (uint32_t)(task->pcm.size() * sizeof(int16_t)),
+        .decoded_size = 0,
+    };
+    esp_audio_dec_info_t dec_info = {};
+    std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
+    auto ret = esp_opus_dec_decode(opus_decoder_, &raw, &out_frame, &dec_info);
+    if (ret != ESP_AUDIO_ERR_OK) {
+        decoder_lock.unlock();
+        ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
+        audio_task_pool_.Release(std::move(task));
+        return false;
+    }
+
+    task->pcm.resize(out_frame.decoded_size / sizeof(int16_t));
+    latency_tracer_.Mark(kLatencyStageDecode, task->trace_origin_us, task->trace_last_us);
+    // The output resampler is switched under decoder_mutex_ by SetDecodeSampleRate()
+    if (decoder_sample_rate_ != codec_->output_sample_rate() && output_resampler_ != nullptr) {
+        output_resampler_->Process(task->pcm, output_resample_buffer_);
+        task->pcm.swap(output_resample_buffer_);
+    }
+    decoder_lock.unlock();
+#if CONFIG_AUDIO_DECODE_AHEAD
+    size_t samples = task->pcm.size();
+#endif
+    if (audio_playback_queue_.Push(std::move(task))) {
+#if CONFIG_AUDIO_DECODE_AHEAD
+        if (decode_ahead_held_) {
+            decode_ahead_samples_ += samples;
+        }
+#endif
+        NotifyTask(audio_output_task_handle_);
+    } else {
+        audio_task_pool_.Release(std::move(task));
+    }
+    debug_statistics_.decode_count++;
+    return true;
+}
+
+bool AudioService::EncodeNextTask() {
+    if (release_encoder_.exchange(false) && opus_encoder_ != nullptr && audio_encode_queue_.empty()) {
+        esp_opus_enc_close(opus_encoder_);
+        opus_encoder_ = nullptr;
+        ESP_LOGI(TAG, "Opus encoder released while idle");
+    }
+    // A released encoder is opened again by the first frame to encode
+    if (encoder_settings_changed_.exchange(false) || (opus_encoder_ == nullptr && !audio_encode_queue_.empty())) {
+        OpenEncoder(GetEncoderSettings());
+    }
+    audio_encode_queue_.Reclaim();
+    if (audio_send_queue_.size() >= MAX_SEND_PACKETS_IN_QUEUE) {
+        return false;
+    }
+    std::unique_ptr<AudioTask> task;
+    if (!audio_encode_queue_.Pop(task)) {
+        return false;
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_ENCODE_QUEUE_AVAILABLE);
+    latency_tracer_.Mark(kLatencyStageEncodeStart, task->trace_origin_us, task->trace_last_us);
+
+    auto packet = audio_packet_pool_.Acquire();
+    packet->frame_duration = encoder_duration_ms_;
+    packet->sample_rate = 16000;
+    packet->timestamp = task->timestamp;
+    packet->flags = task->flags;
+
+    if (opus_encoder_ != nullptr && task->pcm.size() == encoder_frame_size_) {
+        /* Encode straight into the pooled payload buffer, behind the protocol header headroom */
+        packet->headroom = AUDIO_PACKET_HEADROOM;
+        packet->payload.resize(AUDIO_PACKET_HEADROOM + encoder_outbuf_size_);
+        esp_audio_enc_in_frame_t in = {
+            .buffer = (uint8_t *)(task->pcm.data()),
+            .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
+        };
+        esp_audio_enc_out_frame_t out = {
+            .buffer = packet->payload_data(),
+            .len = (uint32_t)encoder_outbuf_size_,
+            .encoded_bytes = 0,
+        };
+        auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
+        if (ret == ESP_AUDIO_ERR_OK) {
+            packet->payload.resize(AUDIO_PACKET_HEADROOM + out.encoded_bytes);
+            latency_tracer_.Mark(kLatencyStageEncodeEnd, task->trace_origin_us, task->trace_last_us);
+            packet->trace_origin_us = task->trace_origin_us;
+            packet->trace_last_us = task->trace_last_us;
+
+            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+                if (uplink_gate_ && uplink_gate_reset_.exchange(false)) {
+                    if (uplink_gate_->suppressed() > 0) {
+                        ESP_LOGI(TAG, "Uplink silence gate suppressed %lu packets", uplink_gate_->suppressed());
                     }
-                    debug_statistics_.encode_count++;
+                    uplink_gate_->Reset();
+                }
+                if (uplink_gate_ && uplink_gate_enabled_) {
+                    /* The AFE VAD is off with device AEC, Opus DTX decides on its own */
+                    bool silent = !voice_detected_ && out.encoded_bytes <= OPUS_DTX_FRAME_MAX_BYTES;
+                    uplink_gate_->Push(std::move(packet), silent);
                 } else {
-                    ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+                    QueueSendPacket(std::move(packet));
                 }
-            } else {
-                ESP_LOGE(TAG, "Failed to encode audio: encoder not configured or invalid frame size (got %u, expected %u)",
-                         task->pcm.size(), encoder_frame_size_);
+            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
+                audio_testing_queue_.Push(std::move(packet));
             }
-            lock.lock();
+            debug_statistics_.encode_count++;
+        } else {
+            ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
         }
+    } else {
+        /* Frames queued before a frame duration change are dropped */
+        ESP_LOGW(TAG, "Failed to encode audio: encoder not configured or invalid frame size (got %u, expected %u)",
+                 task->pcm.size(), encoder_frame_size_);
     }
+    /* packet is still set if it was not queued */
+    audio_packet_pool_.Release(std::move(packet));
+    audio_task_pool_.Release(std::move(task));
+    return true;
+}
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+// Encoder task. A packet the send queue has no room for is returned to the pool
+void AudioService::QueueSendPacket(std::unique_ptr<AudioStreamPacket>&& packet) {
+#if CONFIG_WEB_AUDIO_MONITOR
+    if (audio_monitor_ && packet) {
+        audio_monitor_(true, *packet);
+    }
+#endif
+    if (audio_send_queue_.Push(std::move(packet))) {
+        if (callbacks_.on_send_queue_available) {
+            callbacks_.on_send_queue_available();
+        }
+    } else if (packet) {
+        audio_packet_pool_.Release(std::move(packet));
+    }
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (decoder_sample_rate_ == sample_rate && decoder_duration_ms_ == frame_duration) {
+    if (opus_decoder_ != nullptr && decoder_sample_rate_ == sample_rate && decoder_duration_ms_ == frame_duration) {
         return;
     }
-    std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-    if (opus_decoder_ != nullptr) {
-        esp_opus_dec_close(opus_decoder_);
-        opus_decoder_ = nullptr;
+
+    /* Switch to the warm decoder of this stream, or replace the least recently used one */
+    OpusDecoderSlot* slot = nullptr;
+    OpusDecoderSlot* victim = &decoder_slots_[0];
+    for (auto& candidate : decoder_slots_) {
+        if (candidate.decoder != nullptr && candidate.sample_rate == sample_rate &&
+            candidate.frame_duration == frame_duration) {
+            slot = &candidate;
+            break;
+        }
+        if (victim->decoder != nullptr && (candidate.decoder == nullptr || candidate.last_used < victim->last_used)) {
+            victim = &candidate;
+        }
     }
-    decoder_lock.unlock();
-    esp_opus_dec_cfg_t opus_dec_cfg = OPUS_DEC_CFG(sample_rate, frame_duration);
-    auto ret = esp_opus_dec_open(&opus_dec_cfg, sizeof(esp_opus_dec_cfg_t), &opus_decoder_);
-    if (opus_decoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", ret);
-        return;
+
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+    if (slot == nullptr) {
+        slot = victim;
+        if (slot->decoder != nullptr) {
+            if (slot->decoder == opus_decoder_) {
+                opus_decoder_ = nullptr;
+                output_resampler_ = nullptr;
+            }
+            esp_opus_dec_close(slot->decoder);
+            slot->decoder = nullptr;
+        }
+        esp_opus_dec_cfg_t opus_dec_cfg = OPUS_DEC_CFG(sample_rate, frame_duration);
+        auto ret = esp_opus_dec_open(&opus_dec_cfg, sizeof(esp_opus_dec_cfg_t), &slot->decoder);
+        if (slot->decoder == nullptr) {
+            ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", ret);
+            return;
+        }
+        slot->sample_rate = sample_rate;
+        slot->frame_duration = frame_duration;
+        slot->resampler.reset();
+        if (sample_rate != codec_->output_sample_rate()) {
+            ESP_LOGI(TAG, "Resampling audio from %d to %d", sample_rate, codec_->output_sample_rate());
+            slot->resampler = std::make_unique<Resampler>(sample_rate, codec_->output_sample_rate(), 1);
+            if (!slot->resampler->ok()) {
+                slot->resampler.reset();
+            }
+        }
     }
+    slot->last_used = ++decoder_use_count_;
+    opus_decoder_ = slot->decoder;
+    output_resampler_ = slot->resampler.get();
     decoder_sample_rate_ = sample_rate;
     decoder_duration_ms_ = frame_duration;
     decoder_frame_size_ = decoder_sample_rate_ / 1000 * frame_duration;
+}
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (decoder_sample_rate_ != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", decoder_sample_rate_, codec->output_sample_rate());
-        if (output_resampler_ != nullptr) {
-            esp_ae_rate_cvt_close(output_resampler_);
-            output_resampler_ = nullptr;
+// Decoder task. SetDecodeSampleRate() opens a decoder again for the next packet
+void AudioService::ReleaseDecoders() {
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+    if (opus_decoder_ == nullptr) {
+        return;
+    }
+    for (auto& slot : decoder_slots_) {
+        if (slot.decoder != nullptr) {
+            esp_opus_dec_close(slot.decoder);
+            slot.decoder = nullptr;
         }
-        esp_ae_rate_cvt_cfg_t output_resampler_cfg = RATE_CVT_CFG(
-            decoder_sample_rate_, codec->output_sample_rate(), ESP_AUDIO_MONO);
-        auto resampler_ret = esp_ae_rate_cvt_open(&output_resampler_cfg, &output_resampler_);
-        if (output_resampler_ == nullptr) {
-            ESP_LOGE(TAG, "Failed to create output resampler, error code: %d", resampler_ret);
+        slot.resampler.reset();
+    }
+    opus_decoder_ = nullptr;
+    output_resampler_ = nullptr;
+    ESP_LOGI(TAG, "Opus decoders released while idle");
+}
+
+void AudioService::ReleaseIdleResources() {
+    int64_t now = esp_timer_get_time();
+    // Stopping and starting is also recorded, a short session may fall between two ticks
+    if (xEventGroupGetBits(event_group_) & (AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_AUDIO_TESTING_RUNNING)) {
+        last_uplink_us_ = now;
+    }
+#if CONFIG_AUDIO_IDLE_RELEASE_UPLINK_SECONDS > 0
+    if (last_uplink_us_ >= uplink_released_us_ &&
+            now - last_uplink_us_ >= CONFIG_AUDIO_IDLE_RELEASE_UPLINK_SECONDS * 1000000LL) {
+        uplink_released_us_ = now;
+        // A shared AFE is the wake word's own
+        if (audio_processor_initialized_ && !shared_afe_) {
+            audio_processor_->Release();
         }
+        release_encoder_ = true;
+        NotifyTask(opus_encoder_task_handle_);
+    }
+#endif
+#if CONFIG_AUDIO_IDLE_RELEASE_DECODER_SECONDS > 0
+    if (last_decode_us_ >= decoder_released_us_ && IsIdle() &&
+            now - last_decode_us_ >= CONFIG_AUDIO_IDLE_RELEASE_DECODER_SECONDS * 1000000LL) {
+        decoder_released_us_ = now;
+        release_decoder_ = true;
+        NotifyTask(opus_decoder_task_handle_);
     }
+#endif
 }
 
 void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+    /* Re-chunk the input into uplink frames, the frame duration may change at runtime */
+    size_t frame_samples = uplink_frame_samples_;
+    if (type != uplink_pending_type_) {
+        uplink_pending_pcm_.clear();
+        uplink_pending_type_ = type;
+    }
+    if (uplink_pending_pcm_.empty() && pcm.size() == frame_samples) {
+        PushFrameToEncodeQueue(type, pcm.data(), frame_samples);
+        return;
+    }
+    uplink_pending_pcm_.insert(uplink_pending_pcm_.end(), pcm.begin(), pcm.end());
+    size_t offset = 0;
+    while (uplink_pending_pcm_.size() - offset >= frame_samples) {
+        PushFrameToEncodeQueue(type, uplink_pending_pcm_.data() + offset, frame_samples);
+        offset += frame_samples;
+    }
+    uplink_pending_pcm_.erase(uplink_pending_pcm_.begin(), uplink_pending_pcm_.begin() + offset);
+}
+
+/*
+ * Encode the partial uplink frame at the end of an utterance right away, padded with
+ * silence, and mark it so the server can finalize ASR without waiting for more audio.
+ */
+void AudioService::FlushUplinkFrame() {
+    if (uplink_pending_pcm_.empty() || uplink_pending_type_ != kAudioTaskTypeEncodeToSendQueue) {
+        return;
+    }
+    size_t frame_samples = uplink_frame_samples_;
+    uplink_pending_pcm_.resize(frame_samples, 0);
+    PushFrameToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, uplink_pending_pcm_.data(), frame_samples,
+        AUDIO_PACKET_FLAG_END_OF_UTTERANCE);
+    uplink_pending_pcm_.clear();
+}
+
+void AudioService::PushFrameToEncodeQueue(AudioTaskType type, const int16_t* samples, size_t count, uint8_t flags) {
+    auto task = audio_task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-
-    /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
-        }
-        timestamp_queue_.pop_front();
+    task->flags = flags;
+    task->trace_origin_us = task->trace_last_us = last_input_read_us_;
+    latency_tracer_.Mark(kLatencyStageAfeOutput, task->trace_origin_us, task->trace_last_us);
+    /* Copy into the pooled buffer; the caller keeps its own buffer capacity for the next frame */
+    task->pcm.assign(samples, samples + count);
+
+    /* Tag the frame with the downlink position that played while its first sample was captured */
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        task->timestamp = PlaybackTimestampAt(task->trace_origin_us - (int64_t)count * 1000000 / 16000);
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    /* Push the task to the encode queue, wait for the codec task if it is full */
+    while (audio_encode_queue_.size() >= encode_queue_limit_ || !audio_encode_queue_.Push(std::move(task))) {
+        if (service_stopped_) {
+            audio_task_pool_.Release(std::move(task));
+            return;
+        }
+        xEventGroupWaitBits(event_group_, AS_EVENT_ENCODE_QUEUE_AVAILABLE, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    NotifyTask(opus_encoder_task_handle_);
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+#if CONFIG_AUDIO_LATENCY_TRACE
+    packet->trace_origin_us = packet->trace_last_us = esp_timer_get_time();
+#endif
+#if CONFIG_WEB_AUDIO_MONITOR
+    if (audio_monitor_) {
+        audio_monitor_(false, *packet);
+    }
+#endif
+    std::unique_lock<std::mutex> lock(decode_producer_mutex_);
+    while (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE || !audio_decode_queue_.Push(std::move(packet))) {
+        if (!wait || service_stopped_) {
+            lock.unlock();
+            audio_packet_pool_.Release(std::move(packet));
             return false;
         }
+        xEventGroupWaitBits(event_group_, AS_EVENT_DECODE_QUEUE_AVAILABLE, pdTRUE, pdFALSE, portMAX_DELAY);
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
+    lock.unlock();
+    NotifyTask(opus_decoder_task_handle_);
     return true;
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
+    std::unique_ptr<AudioStreamPacket> packet;
+    if (!audio_send_queue_.Pop(packet)) {
         return nullptr;
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
+    /* A slot in the send queue is free, let the codec task encode the next frame */
+    NotifyTask(opus_encoder_task_handle_);
     return packet;
 }
 
@@ -539,35 +1252,47 @@ const std::string& AudioService::GetLastWakeWord() const {
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
+    auto packet = audio_packet_pool_.Acquire();
     if (wake_word_->GetWakeWordOpus(packet->payload)) {
         return packet;
     }
+    audio_packet_pool_.Release(std::move(packet));
     return nullptr;
 }
 
+std::unique_ptr<AudioStreamPacket> AudioService::AcquirePacket() {
+    return audio_packet_pool_.Acquire();
+}
+
+void AudioService::ReleasePacket(std::unique_ptr<AudioStreamPacket>&& packet) {
+    audio_packet_pool_.Release(std::move(packet));
+}
+
 void AudioService::EnableWakeWordDetection(bool enable) {
+    if (enable) {
+        LoadPendingModels();
+    }
     if (!wake_word_) {
         return;
     }
 
     ESP_LOGD(TAG, "%s wake word detection", enable ? "Enabling" : "Disabling");
     if (enable) {
-        if (!wake_word_initialized_) {
-            if (!wake_word_->Initialize(codec_, models_list_)) {
-                ESP_LOGE(TAG, "Failed to initialize wake word");
-                return;
-            }
-            wake_word_initialized_ = true;
+        if (!InitializeWakeWord()) {
+            ESP_LOGE(TAG, "Failed to initialize wake word");
+            return;
         }
         // Reset input resampler to clear cached data from previous mode (e.g. AudioProcessor)
         // This prevents buffer overflow when switching between different feed sizes
         {
             std::lock_guard<std::mutex> lock(input_resampler_mutex_);
             if (input_resampler_ != nullptr) {
-                esp_ae_rate_cvt_reset(input_resampler_);
+                input_resampler_->Reset();
             }
         }
+#if CONFIG_WAKE_WORD_ENERGY_GATE
+        wake_word_gate_.Reset();
+#endif
         wake_word_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
     } else {
@@ -578,48 +1303,72 @@ void AudioService::EnableWakeWordDetection(bool enable) {
 
 void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
+    last_uplink_us_ = esp_timer_get_time();
+    // Packets held from the previous session must not lead the next one
+    uplink_gate_reset_ = true;
     if (enable) {
+        // The shared AFE is chosen with the models, before the processor is initialized
+        LoadPendingModels();
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, OPUS_MIN_FRAME_DURATION_MS, models_list_);
             audio_processor_initialized_ = true;
         }
 
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        // A shared AFE has been running all along, and so has the input for a talk pre-roll
+        audio_input_need_warmup_ = !shared_afe_ && !(xEventGroupGetBits(event_group_) & AS_EVENT_TALK_PREROLL_RUNNING);
         // Reset input resampler to clear cached data from previous mode (e.g. WakeWord)
         // This prevents buffer overflow when switching between different feed sizes
         {
             std::lock_guard<std::mutex> lock(input_resampler_mutex_);
             if (input_resampler_ != nullptr) {
-                esp_ae_rate_cvt_reset(input_resampler_);
+                input_resampler_->Reset();
             }
         }
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
         audio_processor_->Stop();
-        xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+        // Also a pre-roll whose listening never started
+        xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_TALK_PREROLL_RUNNING);
     }
 }
 
+void AudioService::EnableUplinkSilenceGate(bool enable) {
+    if (uplink_gate_ == nullptr || uplink_gate_enabled_ == enable) {
+        return;
+    }
+    ESP_LOGI(TAG, "%s uplink silence gate", enable ? "Enabling" : "Disabling");
+    uplink_gate_enabled_ = enable;
+    uplink_gate_reset_ = true;
+}
+
 void AudioService::EnableAudioTesting(bool enable) {
     ESP_LOGI(TAG, "%s audio testing", enable ? "Enabling" : "Disabling");
+    last_uplink_us_ = esp_timer_get_time();
     if (enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Move audio_testing_queue_ to audio_decode_queue_ */
+        std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+        audio_decode_queue_.Flush();
+        std::unique_ptr<AudioStreamPacket> packet;
+        while (audio_testing_queue_.Pop(packet)) {
+            if (!audio_decode_queue_.Push(std::move(packet))) {
+                audio_packet_pool_.Release(std::move(packet));
+            }
+        }
+        NotifyTask(opus_decoder_task_handle_);
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
+    LoadPendingModels();
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, OPUS_MIN_FRAME_DURATION_MS, models_list_);
         audio_processor_initialized_ = true;
     }
 
@@ -630,53 +1379,139 @@ void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
-void AudioService::PlaySound(const std::string_view& ogg) {
-    if (!codec_->output_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        codec_->EnableOutput(true);
+void AudioService::PlaySound(const std::string_view& ogg, bool priority) {
+    // A prompt missing from the assets partition has no data
+    if (ogg.empty()) {
+        return;
     }
+    WakeOutput();
 
-    const auto* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
+    /* Cached prompts go straight to the output task and are mixed over the server stream */
+    if (sound_cache_.Cacheable(ogg) && !sound_player_.busy()) {
+        if (sound_cache_.Play(ogg)) {
+            NotifyTask(audio_output_task_handle_);
+            return;
+        }
+        sound_cache_.RequestLoad(ogg);
+    }
+    sound_player_.Play(ogg, priority);
+    NotifyTask(opus_decoder_task_handle_);
+}
 
-    auto demuxer = std::make_unique<OggDemuxer>();
-    demuxer->OnDemuxerFinished([this](const uint8_t* data, int sample_rate, size_t size){
-        auto packet = std::make_unique<AudioStreamPacket>();
-        packet->sample_rate = sample_rate;
-        packet->frame_duration = 60;
-        packet->payload.resize(size);
-        std::memcpy(packet->payload.data(), data, size);
-        PushPacketToDecodeQueue(std::move(packet), true);
-    });
-    demuxer->Reset();
-    demuxer->Process(buf, size);
+void AudioService::StopSound() {
+    sound_player_.Cancel();
+    sound_cache_.Cancel();
+    NotifyTask(opus_decoder_task_handle_);
+}
+
+#if CONFIG_AUDIO_STREAM_PLAYER
+bool AudioService::PlayStream(const std::string& url) {
+    if (!stream_player_.Play(url)) {
+        return false;
+    }
+    WakeOutput();
+    NotifyTask(opus_decoder_task_handle_);
+    return true;
+}
+
+void AudioService::PauseStream(bool paused) {
+    stream_player_.Pause(paused);
+    if (!paused) {
+        NotifyTask(opus_decoder_task_handle_);
+    }
+}
+#endif
+
+void AudioService::ForgetCachedSounds() {
+    StopSound();
+    sound_cache_.Trim(SIZE_MAX);
+}
+
+void AudioService::PreloadSound(const std::string_view& ogg) {
+    if (!ogg.empty() && sound_cache_.Cacheable(ogg)) {
+        sound_cache_.RequestLoad(ogg);
+        NotifyTask(opus_decoder_task_handle_);
+    }
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+#if CONFIG_AUDIO_STREAM_PLAYER
+    if (stream_player_.active()) {
+        return false;
+    }
+#endif
+    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && jitter_buffer_size_ == 0 &&
+        !sound_player_.busy() && !sound_cache_.busy() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
 }
 
 void AudioService::WaitForPlaybackQueueEmpty() {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    audio_queue_cv_.wait(lock, [this]() { 
-        return service_stopped_ || (audio_decode_queue_.empty() && audio_playback_queue_.empty()); 
-    });
+    while (!service_stopped_ && !(audio_decode_queue_.empty() && jitter_buffer_size_ == 0 && !sound_player_.busy() &&
+        !sound_cache_.busy() && audio_playback_queue_.empty())) {
+        xEventGroupWaitBits(event_group_, AS_EVENT_PLAYBACK_QUEUE_POPPED, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-    if (opus_decoder_ != nullptr) {
-        esp_opus_dec_reset(opus_decoder_);
+    for (auto& slot : decoder_slots_) {
+        if (slot.decoder != nullptr) {
+            esp_opus_dec_reset(slot.decoder);
+        }
+        if (slot.resampler != nullptr) {
+            slot.resampler->Reset();
+        }
     }
     decoder_lock.unlock();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(timestamp_mutex_);
+        render_log_.clear();
+    }
+    /* The consumers drop the flushed items on their next wakeup */
+    audio_decode_queue_.Flush();
+    jitter_buffer_reset_ = true;
+    sound_player_.Cancel();
+    sound_cache_.Cancel();
+    audio_playback_queue_.Flush();
+    audio_testing_queue_.Clear();
+    NotifyTask(opus_decoder_task_handle_);
+    NotifyTask(audio_output_task_handle_);
+    xEventGroupSetBits(event_group_, AS_EVENT_DECODE_QUEUE_AVAILABLE | AS_EVENT_PLAYBACK_QUEUE_POPPED);
+    output_stream_samples_ = 0;
+    first_stream_frame_pending_ = true;
+#if CONFIG_AUDIO_DECODE_AHEAD
+    decode_ahead_held_ = false;
+#endif
+}
+
+void AudioService::WatchForSilence() {
+    silence_watched_ = true;
+    NotifyTask(audio_output_task_handle_);
+}
+
+int AudioService::AbortPlayback() {
+    int rate = codec_->output_sample_rate();
+    int64_t heard = std::max<int64_t>(output_stream_samples_ - BufferedOutputSamples(), 0);
+    int played_ms = heard * 1000 / rate;
+    ResetDecoder();
+    output_flush_requested_ = true;
+    NotifyTask(audio_output_task_handle_);
+    ESP_LOGI(TAG, "Playback aborted after %d ms", played_ms);
+    return played_ms;
+}
+
+void AudioService::WakeOutput() {
+    if (codec_->output_enabled()) {
+        return;
+    }
+    bool standby = codec_->output_standby();
+    int64_t start_us = esp_timer_get_time();
+    esp_timer_stop(audio_power_timer_);
+    esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+    codec_->EnableOutput(true);
+    // Counts as output, so a pre-woken speaker does not time out before the reply arrives
+    last_output_time_ = std::chrono::steady_clock::now();
+    ESP_LOGI(TAG, "Output woken from %s in %ld us", standby ? "standby" : "power down",
+        (long)(esp_timer_get_time() - start_us));
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
@@ -687,9 +1522,16 @@ void AudioService::CheckAndUpdateAudioPowerState() {
         codec_->EnableInput(false);
     }
     if (output_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->output_enabled()) {
+#if CONFIG_AUDIO_OUTPUT_STANDBY_SECONDS > 0
+        codec_->StandbyOutput();
+#else
+        codec_->EnableOutput(false);
+#endif
+    } else if (codec_->output_standby() &&
+            output_elapsed > AUDIO_POWER_TIMEOUT_MS + CONFIG_AUDIO_OUTPUT_STANDBY_SECONDS * 1000LL) {
         codec_->EnableOutput(false);
     }
-    if (!codec_->input_enabled() && !codec_->output_enabled()) {
+    if (!codec_->input_enabled() && !codec_->output_enabled() && !codec_->output_standby()) {
         esp_timer_stop(audio_power_timer_);
     }
 }
@@ -702,6 +1544,14 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
         wake_word_ = std::make_unique<CustomWakeWord>();
     } else if (esp_srmodel_filter(models_list_, ESP_WN_PREFIX, NULL) != nullptr) {
         wake_word_ = std::make_unique<AfeWakeWord>();
+#if CONFIG_USE_SHARED_AFE
+        // The wake word's AFE replaces the separate audio processor, before either is initialized
+        if (!audio_processor_initialized_) {
+            audio_processor_ = std::make_unique<AfeSharedProcessor>(static_cast<AfeWakeWord*>(wake_word_.get()));
+            SetupAudioProcessor();
+            shared_afe_ = true;
+        }
+#endif
     } else {
         wake_word_ = nullptr;
     }
@@ -714,12 +1564,308 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
 #endif
 
     if (wake_word_) {
-        wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
-            if (callbacks_.on_wake_word_detected) {
-                callbacks_.on_wake_word_detected(wake_word);
+        SetupWakeWordCallbacks();
+    }
+}
+
+void AudioService::SetModelsLoader(std::function<srmodel_list_t*()> loader) {
+    models_loader_ = std::move(loader);
+}
+
+void AudioService::LoadPendingModels() {
+    if (!models_loader_) {
+        return;
+    }
+    auto loader = std::move(models_loader_);
+    models_loader_ = nullptr;
+    SetModelsList(loader());
+}
+
+/*
+ * Creating the engine is where esp-sr may copy weights out of the mapped partition, so its cost is
+ * logged. Other tasks allocate meanwhile, the memory is an estimate.
+ */
+bool AudioService::InitializeWakeWord() {
+    if (wake_word_initialized_) {
+        return true;
+    }
+    int64_t start = esp_timer_get_time();
+    size_t psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    size_t internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    if (!wake_word_->Initialize(codec_, models_list_)) {
+        return false;
+    }
+    int psram_used = (int)psram - (int)heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    int internal_used = (int)internal - (int)heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    ESP_LOGI(TAG, "Wake word engine ready in %d ms, %d KB PSRAM, %d KB internal",
+        (int)((esp_timer_get_time() - start) / 1000), psram_used / 1024, internal_used / 1024);
+    wake_word_initialized_ = true;
+    return true;
+}
+
+void AudioService::SetupWakeWordCallbacks() {
+    wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+        // The reply comes after a round trip to the server, the speaker is ready by then
+        WakeOutput();
+        if (callbacks_.on_wake_word_detected) {
+            callbacks_.on_wake_word_detected(wake_word);
+        }
+    });
+    wake_word_->OnWakeWordCandidate([this]() {
+        if (callbacks_.on_wake_word_candidate) {
+            callbacks_.on_wake_word_candidate();
+        }
+    });
+    wake_word_->OnCommandDetected([this](const WakeWordCommand& command) {
+        if (callbacks_.on_command_detected) {
+            callbacks_.on_command_detected(command);
+        }
+    });
+}
+
+#if CONFIG_WAKE_WORD_BENCHMARK
+std::string AudioService::RunWakeWordBenchmark(int speed, int max_seconds) {
+    LoadPendingModels();
+    if (!wake_word_) {
+        throw std::runtime_error("No wake word engine");
+    }
+    bool was_running = IsWakeWordRunning();
+    EnableWakeWordDetection(false);
+    if (!InitializeWakeWord()) {
+        throw std::runtime_error("Failed to initialize wake word");
+    }
+
+    const char* engine = "EspWakeWord";
+    const char* prefix = ESP_WN_PREFIX;
+#if CONFIG_IDF_TARGET_ESP32S3 || CONFIG_IDF_TARGET_ESP32P4
+    if (dynamic_cast<CustomWakeWord*>(wake_word_.get()) != nullptr) {
+        engine = "CustomWakeWord";
+        prefix = ESP_MN_PREFIX;
+    } else if (dynamic_cast<AfeWakeWord*>(wake_word_.get()) != nullptr) {
+        engine = "AfeWakeWord";
+    }
+#endif
+    char* model = esp_srmodel_filter(models_list_, prefix, NULL);
+
+    // The benchmark takes over the callbacks, put the live ones back even when it throws
+    WakeWordBenchmark benchmark(wake_word_.get(), codec_->input_channels(), codec_->input_reference());
+    std::string result;
+    try {
+        result = benchmark.Run(engine, model != nullptr ? model : "", speed, max_seconds);
+    } catch (...) {
+        SetupWakeWordCallbacks();
+        throw;
+    }
+    SetupWakeWordCallbacks();
+    if (was_running) {
+        EnableWakeWordDetection(true);
+    }
+    return result;
+}
+#endif
+
+#if CONFIG_AUDIO_LATENCY_BENCHMARK
+#define LATENCY_BENCHMARK_SETTLE_MS 300
+#define LATENCY_BENCHMARK_LISTEN_MS 500
+
+std::string AudioService::RunLatencyBenchmark(int rounds) {
+    // The input task must be idle, the benchmark reads the codec itself
+    bool was_running = IsWakeWordRunning();
+    EnableWakeWordDetection(false);
+    WaitForPlaybackQueueEmpty();
+    if (!codec_->input_enabled()) {
+        codec_->EnableInput(true);
+    }
+    WakeOutput();
+
+    // One DMA descriptor per read, a read that waited returns right as its last sample arrived
+    int rate = codec_->input_sample_rate();
+    int channels = codec_->input_channels();
+    size_t chunk = AUDIO_CODEC_DMA_FRAME_NUM;
+    int64_t chunk_us = (int64_t)chunk * 1000000 / rate;
+    std::vector<int16_t> in(chunk * channels), mic;
+    std::vector<int64_t> read_us;
+    auto read_chunk = [&](bool keep) -> bool {
+        if (!codec_->InputData(in)) {
+            return false;
+        }
+        int64_t now = esp_timer_get_time();
+#if CONFIG_USE_AUDIO_DEBUGGER
+        // The host tool in scripts/acoustic_check shows the same recording
+        if (audio_debugger_ != nullptr) {
+            audio_debugger_->Feed(in);
+        }
+#endif
+        if (keep) {
+            for (size_t i = 0; i < chunk; i++) {
+                mic.push_back(in[i * channels]);
             }
-        });
+            read_us.push_back(now);
+        }
+        return true;
+    };
+
+    std::vector<LatencyBenchmark::Round> results;
+    for (int r = 0; r < rounds; r++) {
+        // Let the previous echo die away and drain what the DMA holds
+        for (int64_t t = 0; t < LATENCY_BENCHMARK_SETTLE_MS * 1000; t += chunk_us) {
+            read_chunk(false);
+        }
+        mic.clear();
+        read_us.clear();
+        latency_marker_output_us_ = 0;
+        latency_marker_requested_ = true;
+        NotifyTask(opus_decoder_task_handle_);
+        for (int64_t t = 0; t < LATENCY_BENCHMARK_LISTEN_MS * 1000; t += chunk_us) {
+            if (!read_chunk(true)) {
+                break;
+            }
+        }
+
+        LatencyBenchmark::Round round;
+        round.queued_us = latency_marker_queued_us_;
+        round.output_us = latency_marker_output_us_;
+        round.render_us = latency_marker_render_us_;
+        size_t offset = 0;
+        if (LatencyBenchmark::FindMarker(mic, rate, offset, round.score) && round.output_us != 0) {
+            size_t c = offset / chunk;
+            round.seen_us = read_us[c];
+            round.heard_us = read_us[c] - (int64_t)(chunk - 1 - offset % chunk) * 1000000 / rate;
+            round.found = true;
+            ESP_LOGI(TAG, "Latency round %d: round trip %lld us, acoustic %lld us", r,
+                round.seen_us - round.queued_us, round.heard_us - round.render_us);
+        } else {
+            ESP_LOGW(TAG, "Latency round %d: marker not heard (score %.2f)", r, round.score);
+        }
+        results.push_back(round);
+    }
+    last_output_time_ = last_input_time_ = std::chrono::steady_clock::now();
+    if (was_running) {
+        EnableWakeWordDetection(true);
+    }
+    return LatencyBenchmark::GetJson(results, rate, codec_->output_sample_rate());
+}
+#endif
+
+#if CONFIG_AEC_DELAY_CALIBRATION
+#define AEC_CALIBRATION_CHUNK_MS 10
+#define AEC_CALIBRATION_SETTLE_MS 200
+#define AEC_CALIBRATION_SWEEP_MS 500
+#define AEC_CALIBRATION_TAIL_MS 300
+#define AEC_CALIBRATION_MAX_LAG_MS 60
+#define AEC_CALIBRATION_MIN_SCORE 0.2f
+
+std::string AudioService::CalibrateAecDelay() {
+    if (!codec_->input_reference()) {
+        throw std::runtime_error("The codec has no playback reference channel");
     }
+    // The input task must be idle, it applies the delay being replaced
+    bool was_running = IsWakeWordRunning();
+    EnableWakeWordDetection(false);
+    WaitForPlaybackQueueEmpty();
+    if (!codec_->input_enabled()) {
+        codec_->EnableInput(true);
+    }
+    WakeOutput();
+
+    // An exponential sweep from 200 Hz to 6 kHz at -12 dBFS, faded in and out over 10 ms
+    int out_rate = codec_->output_sample_rate();
+    int in_rate = codec_->input_sample_rate();
+    int channels = codec_->input_channels();
+    size_t sweep_samples = out_rate / 1000 * AEC_CALIBRATION_SWEEP_MS;
+    size_t fade_samples = out_rate / 100;
+    double f0 = 200, f1 = std::min(6000.0, out_rate * 0.45);
+    double k = std::log(f1 / f0) / sweep_samples;
+    auto sweep_at = [&](size_t i) -> int16_t {
+        if (i >= sweep_samples) {
+            return 0;
+        }
+        double phase = 2 * M_PI * f0 / out_rate * (std::exp(k * i) - 1) / k;
+        double gain = std::min({1.0, (double)i / fade_samples, (double)(sweep_samples - i) / fade_samples});
+        return (int16_t)(8192 * gain * std::sin(phase));
+    };
+
+    // Play and record in turns of one chunk, the DMA buffers keep both running in between
+    size_t out_chunk = out_rate / 1000 * AEC_CALIBRATION_CHUNK_MS;
+    size_t in_chunk = in_rate / 1000 * AEC_CALIBRATION_CHUNK_MS;
+    int settle_chunks = AEC_CALIBRATION_SETTLE_MS / AEC_CALIBRATION_CHUNK_MS;
+    int chunks = settle_chunks + (AEC_CALIBRATION_SWEEP_MS + AEC_CALIBRATION_TAIL_MS) / AEC_CALIBRATION_CHUNK_MS;
+    std::vector<int16_t> mic, ref;
+    mic.reserve(in_chunk * (chunks - settle_chunks));
+    ref.reserve(in_chunk * (chunks - settle_chunks));
+    std::vector<int16_t> out, in(in_chunk * channels);
+    for (int c = 0; c < chunks; c++) {
+        out.assign(out_chunk, 0);
+        if (c >= settle_chunks) {
+            for (size_t i = 0; i < out_chunk; i++) {
+                out[i] = sweep_at((c - settle_chunks) * out_chunk + i);
+            }
+        }
+        codec_->OutputData(out);
+        if (!codec_->InputData(in)) {
+            break;
+        }
+        if (c < settle_chunks) {
+            continue;
+        }
+        for (size_t i = 0; i < in_chunk; i++) {
+            mic.push_back(in[i * channels]);
+            ref.push_back(in[i * channels + channels - 1]);
+        }
+    }
+    last_output_time_ = last_input_time_ = std::chrono::steady_clock::now();
+    if (was_running) {
+        EnableWakeWordDetection(true);
+    }
+
+    int lag = 0;
+    float score = 0;
+    bool found = AecReferenceDelay::Estimate(mic.data(), ref.data(), mic.size(),
+        in_rate / 1000 * AEC_CALIBRATION_MAX_LAG_MS, AEC_CALIBRATION_MIN_SCORE, lag, score);
+    // The delay line runs on the 16 kHz input the AFE gets
+    int delay = lag * 16000 / in_rate - AecReferenceDelay::kMarginSamples;
+    if (found) {
+        aec_reference_delay_.SetDelay(delay, channels);
+        Settings settings("audio", true);
+        settings.SetInt("aec_ref_delay", delay);
+        ESP_LOGI(TAG, "AEC reference delay calibrated: lag %d samples at %d Hz, score %.2f, delay %d",
+            lag, in_rate, score, delay);
+    } else {
+        ESP_LOGW(TAG, "AEC delay calibration found no echo (score %.2f), delay left at %d",
+            score, aec_reference_delay_.delay());
+    }
+
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddBoolToObject(json, "found", found);
+    cJSON_AddNumberToObject(json, "lag_ms", (double)lag * 1000 / in_rate);
+    cJSON_AddNumberToObject(json, "score", std::round(score * 100) / 100);
+    cJSON_AddNumberToObject(json, "delay_samples", aec_reference_delay_.delay());
+    char* str = cJSON_PrintUnformatted(json);
+    std::string result(str);
+    cJSON_free(str);
+    cJSON_Delete(json);
+    return result;
+}
+#endif
+
+void AudioService::SetupAudioProcessor() {
+    audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
+#if CONFIG_AUDIO_CAPTURE
+        capture_->Write(AudioCapture::kTrackProcessed, data.data(), data.size());
+#endif
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+    });
+
+    audio_processor_->OnEndOfUtterance([this]() {
+        FlushUplinkFrame();
+    });
+
+    audio_processor_->OnVadStateChange([this](bool speaking) {
+        voice_detected_ = speaking;
+        if (callbacks_.on_vad_change) {
+            callbacks_.on_vad_change(speaking);
+        }
+    });
 }
 
 bool AudioService::IsAfeWakeWord() {
@@ -2,10 +2,11 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
+#include <array>
 #include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -15,7 +16,6 @@
 #include "esp_audio_enc.h"
 #include "esp_opus_enc.h"
 #include "esp_opus_dec.h"
-#include "esp_ae_rate_cvt.h"
 #include "esp_audio_types.h"
 
 #include "audio_codec.h"
@@ -24,6 +24,29 @@
 #include "wake_word.h"
 #include "protocol.h"
 #include "ogg_demuxer.h"
+#include "audio_frame_pool.h"
+#include "spsc_ring.h"
+#include "jitter_buffer.h"
+#include "audio_latency_tracer.h"
+#include "resampler.h"
+#include "sound_player.h"
+#include "sound_cache.h"
+#if CONFIG_AUDIO_STREAM_PLAYER
+#include "stream_player.h"
+#endif
+#include "audio_mixer.h"
+#if CONFIG_PUSH_TO_TALK_PREROLL
+#include "pcm_ring.h"
+#endif
+#include "wake_word_gate.h"
+#include "audio_task_monitor.h"
+#include "audio_capture.h"
+#include "wake_word_benchmark.h"
+#include "uplink_silence_gate.h"
+#include "latency_benchmark.h"
+#if CONFIG_USE_AUDIO_PROCESSOR
+#include "aec_reference_delay.h"
+#endif
 
 /*
  * There are two types of audio data flow:
@@ -31,18 +54,62 @@
  * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
  * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * With CONFIG_AUDIO_SPLIT_OPUS_CODEC_TASKS the encoder and decoder run in two tasks pinned to different cores.
+ *
+ * Every queue is a lock-free SPSC ring. Consumers sleep on their task notification and
+ * are only woken by the producer of a queue they read from, or when space is freed in a
+ * queue they write to. Producers outside the audio tasks wait on event group bits.
  * 
+ * PlaySound() does not use the Decode Queue, the Opus decoder pulls the packets of local
+ * sounds one at a time from the SoundPlayer, ahead of the server stream. Short prompts found
+ * in the SoundCache skip the decoder, the output task mixes their PCM over the (ducked) stream.
+ *
+ * With CONFIG_AUDIO_STREAM_PLAYER a long-form stream (PlayStream(), music or radio) is pulled
+ * the same way from the StreamPlayer, but only while no sound and no server audio is queued.
+ *
+ * With CONFIG_AUDIO_JITTER_BUFFER the Opus decoder pulls the Decode Queue into an adaptive
+ * jitter buffer, which reorders packets and conceals missing frames with Opus FEC / PLC.
+ *
+ * With CONFIG_AUDIO_DECODE_AHEAD the first frames of a reply are decoded while the application
+ * still switches to speaking (PrepareStream()). They wait in the whole Playback Queue until
+ * StartStream() and enough of them are decoded, then the output starts with a full queue.
+ *
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
  */
 
 #define OPUS_FRAME_DURATION_MS 60
-#define MAX_ENCODE_TASKS_IN_QUEUE 2
-#define MAX_PLAYBACK_TASKS_IN_QUEUE 2
+// The uplink frame duration is negotiable at runtime, the audio processor always emits the smallest one
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#define OPUS_MAX_FRAME_DURATION_MS 60
+// Queue capacities, the latency profile limits how much of them is used
+#define MAX_ENCODE_TASKS_IN_QUEUE AUDIO_LATENCY_PROFILE_MAX_QUEUE
+#define MAX_PLAYBACK_TASKS_IN_QUEUE AUDIO_LATENCY_PROFILE_MAX_QUEUE
 #define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
 #define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
-#define MAX_TIMESTAMPS_IN_QUEUE 3
+#define AUDIO_TESTING_MAX_PACKETS (AUDIO_TESTING_MAX_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+// Downlink frames remembered for server AEC, about two seconds
+#define MAX_RENDER_RECORDS (2000 / OPUS_FRAME_DURATION_MS)
+// Pool sizes cover the queue limits plus the frames in flight inside each task
+#define AUDIO_TASK_POOL_SIZE (AudioLatencyProfile::Boot().encode_queue + AudioLatencyProfile::Boot().playback_queue + 4)
+#define AUDIO_PACKET_POOL_SIZE (MAX_DECODE_PACKETS_IN_QUEUE + MAX_SEND_PACKETS_IN_QUEUE / 2)
+#define AUDIO_PACKET_RESERVE_BYTES 512
+#define JITTER_BUFFER_MAX_PACKETS (MAX_DECODE_PACKETS_IN_QUEUE / 2)
+// A stream prepared for a speaking state that never comes is released after this long
+#define DECODE_AHEAD_MAX_HOLD_MS 1000
+
+#if CONFIG_AUDIO_SOUND_CACHE
+#define SOUND_CACHE_BUDGET_BYTES (CONFIG_AUDIO_SOUND_CACHE_SIZE_KB * 1024)
+#else
+#define SOUND_CACHE_BUDGET_BYTES 0
+#endif
+// Only prompts up to this Ogg size (about 4 s) are decoded into the cache
+#define SOUND_CACHE_MAX_OGG_BYTES 8192
+
+// Samples the speaker DMA buffers hold, and the fade-out applied when they are dropped on barge-in
+#define OUTPUT_DMA_SAMPLES (AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM)
+#define BARGE_IN_FADE_MS 5
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
@@ -51,6 +118,10 @@
 #define AS_EVENT_WAKE_WORD_RUNNING          (1 << 1)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
+#define AS_EVENT_ENCODE_QUEUE_AVAILABLE     (1 << 4)
+#define AS_EVENT_DECODE_QUEUE_AVAILABLE     (1 << 5)
+#define AS_EVENT_PLAYBACK_QUEUE_POPPED      (1 << 6)
+#define AS_EVENT_TALK_PREROLL_RUNNING       (1 << 7)
 
 #define AS_OPUS_GET_FRAME_DRU_ENUM(duration_ms)                   \
     ((duration_ms) == 5 ? ESP_OPUS_ENC_FRAME_DURATION_5_MS :      \
@@ -62,24 +133,43 @@
      (duration_ms) == 100 ? ESP_OPUS_ENC_FRAME_DURATION_100_MS :  \
      (duration_ms) == 120 ? ESP_OPUS_ENC_FRAME_DURATION_120_MS : -1)
 
-#define AS_OPUS_ENC_CONFIG() {                                                                                    \
+#define AS_OPUS_ENC_CONFIG(_settings) {                                                                           \
         .sample_rate        = ESP_AUDIO_SAMPLE_RATE_16K,                                                          \
         .channel            = ESP_AUDIO_MONO,                                                                     \
         .bits_per_sample    = ESP_AUDIO_BIT16,                                                                    \
-        .bitrate            = ESP_OPUS_BITRATE_AUTO,                                                              \
-        .frame_duration     = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(OPUS_FRAME_DURATION_MS),  \
+        .bitrate            = (_settings).bitrate > 0 ? (_settings).bitrate : ESP_OPUS_BITRATE_AUTO,              \
+        .frame_duration     = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM((_settings).frame_duration_ms), \
         .application_mode   = ESP_OPUS_ENC_APPLICATION_AUDIO,                                                     \
-        .complexity         = 0,                                                                                  \
-        .enable_fec         = false,                                                                              \
+        .complexity         = (_settings).complexity,                                                             \
+        .enable_fec         = (_settings).enable_fec,                                                             \
         .enable_dtx         = true,                                                                               \
         .enable_vbr         = true,                                                                               \
     }
 
+// Uplink encoder parameters, advertised in the hello and adjustable by the server
+struct OpusEncoderSettings {
+    int frame_duration_ms = CONFIG_AUDIO_UPLINK_FRAME_DURATION_MS;
+    int bitrate = CONFIG_AUDIO_UPLINK_BITRATE;  // bps, 0 for auto
+    int complexity = CONFIG_AUDIO_UPLINK_COMPLEXITY;
+#if CONFIG_AUDIO_UPLINK_FEC
+    bool enable_fec = true;
+#else
+    bool enable_fec = false;
+#endif
+};
+
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
+    std::function<void(void)> on_wake_word_candidate;
+    // Called on the audio input task
+    std::function<void(const WakeWordCommand&)> on_command_detected;
     std::function<void(bool)> on_vad_change;
     std::function<void(void)> on_audio_testing_queue_full;
+    // Called on the codec task for the first server packet decoded after ResetDecoder()
+    std::function<void(void)> on_first_stream_frame;
+    // Called on the output task once after WatchForSilence(), with the time the speaker goes quiet
+    std::function<void(int64_t silent_us)> on_output_silent;
 };
 
 
@@ -93,6 +183,18 @@ struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    uint8_t flags = 0;  // AUDIO_PACKET_FLAG_*, copied to the encoded packet
+    int64_t trace_origin_us = 0;
+    int64_t trace_last_us = 0;
+    // The marker of the latency benchmark, the output task reports when it plays
+    bool latency_marker = false;
+};
+
+struct AudioQueueDepths {
+    size_t decode;
+    size_t encode;
+    size_t playback;
+    size_t send;
 };
 
 struct DebugStatistics {
@@ -100,6 +202,7 @@ struct DebugStatistics {
     uint32_t decode_count = 0;
     uint32_t encode_count = 0;
     uint32_t playback_count = 0;
+    uint32_t conceal_count = 0;
 };
 
 class AudioService {
@@ -124,15 +227,101 @@ public:
     void EnableVoiceProcessing(bool enable);
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
+    // Thin the uplink during long silences (realtime listening), see UplinkSilenceGate
+    void EnableUplinkSilenceGate(bool enable);
+#if CONFIG_PUSH_TO_TALK_PREROLL
+    // Thread safe, for a talk button callback. Keeps the mic audio from now on and feeds it to the
+    // audio processor first once voice processing starts, so the utterance start is not clipped
+    void StartTalkPreroll();
+#endif
+#if CONFIG_LP_VOICE_WAKE
+    // 16 kHz mono fed to the wake word engine before its first live chunk, call before Start()
+    void SetWakeWordPreroll(std::vector<int16_t>&& pcm);
+#endif
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
-    void PlaySound(const std::string_view& sound);
+    // Queues the sound and returns, a priority sound interrupts the server audio stream
+    void PlaySound(const std::string_view& sound, bool priority = false);
+    void StopSound();
+    // Decode a short prompt into the PCM cache ahead of its first PlaySound()
+    void PreloadSound(const std::string_view& sound);
+    // The PCM cache is keyed by the address of the Ogg data, which a remapped assets partition reuses
+    void ForgetCachedSounds();
+#if CONFIG_AUDIO_STREAM_PLAYER
+    // Thread safe. Plays an Ogg Opus stream from url behind the sounds and the server audio
+    bool PlayStream(const std::string& url);
+    void StopStream() { stream_player_.Stop(); }
+    // The application holds the stream back while the assistant listens or speaks
+    void PauseStream(bool paused);
+    std::string GetStreamStatusJson() { return stream_player_.GetStatusJson(); }
+#endif
+    void SetPlaybackGain(AudioMixer::Source source, float gain) { mixer_.SetGain(source, gain); }
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    // The next time the playback queue runs dry, on_output_silent is called
+    void WatchForSilence();
+    // ResetDecoder() that also drops the audio queued in the speaker DMA buffers after a short fade.
+    // Returns the milliseconds of the stream heard since the last reset, the server truncates its transcript there
+    int AbortPlayback();
+#if CONFIG_AUDIO_DECODE_AHEAD
+    // Thread safe. ResetDecoder() that holds the next stream in the playback queue until StartStream()
+    void PrepareStream();
+    // The held stream plays once CONFIG_AUDIO_DECODE_AHEAD_MS of it is decoded, or that long from now
+    void StartStream();
+#endif
+    // Thread-safe, the encoder is reopened before the next uplink frame. Returns false if the settings are invalid
+    bool SetEncoderSettings(const OpusEncoderSettings& settings);
+    OpusEncoderSettings GetEncoderSettings();
+    // Thread-safe. Stores and applies a latency profile (AudioLatencyProfile), false for an unknown name
+    bool SetLatencyProfile(const std::string& name);
+    // Clock tick. Releases the uplink (encoder, AFE) and then the decoders once idle long enough
+    void ReleaseIdleResources();
     void SetModelsList(srmodel_list_t* models_list);
+    // Parses the models on first use instead, when the wake word or the AFE is first enabled
+    void SetModelsLoader(std::function<srmodel_list_t*()> loader);
+
+    // Borrow / give back packets from the shared packet pool (used by protocols)
+    std::unique_ptr<AudioStreamPacket> AcquirePacket();
+    void ReleasePacket(std::unique_ptr<AudioStreamPacket>&& packet);
+
+    // Called by the main task once a packet from the send queue went out
+    void MarkPacketSent(AudioStreamPacket& packet) {
+        latency_tracer_.Mark(kLatencyStageSend, packet.trace_origin_us, packet.trace_last_us);
+    }
+    AudioLatencyTracer& GetLatencyTracer() { return latency_tracer_; }
+    // Any task, the depths may be a moment old
+    AudioQueueDepths GetQueueDepths() const {
+        return {audio_decode_queue_.size(), audio_encode_queue_.size(), audio_playback_queue_.size(),
+                audio_send_queue_.size()};
+    }
+#if CONFIG_AUDIO_TASK_MONITOR
+    AudioTaskMonitor& GetTaskMonitor() { return task_monitor_; }
+#endif
+#if CONFIG_AUDIO_CAPTURE
+    AudioCapture* GetCapture() { return capture_.get(); }
+#endif
+#if CONFIG_WEB_AUDIO_MONITOR
+    // Sees every uplink packet queued (encoder task) and every downlink packet pushed (network
+    // task), it must not block. Set before Start()
+    using AudioMonitor = std::function<void(bool uplink, const AudioStreamPacket& packet)>;
+    void SetAudioMonitor(AudioMonitor monitor) { audio_monitor_ = std::move(monitor); }
+#endif
+    const char* GetAudioProcessorMode() { return audio_processor_ ? audio_processor_->GetModeName() : "none"; }
+#if CONFIG_WAKE_WORD_BENCHMARK
+    // Stops live detection, feeds the assets corpus into the engine and returns the result as JSON
+    std::string RunWakeWordBenchmark(int speed, int max_seconds);
+#endif
+#if CONFIG_AUDIO_LATENCY_BENCHMARK
+    // Plays a marker through the playback queue while idle and times its echo, `rounds` times. Returns JSON
+    std::string RunLatencyBenchmark(int rounds);
+#endif
+#if CONFIG_AEC_DELAY_CALIBRATION
+    // Plays a sweep while idle, measures the echo lag of the reference and stores the delay. Returns JSON
+    std::string CalibrateAecDelay();
+#endif
 
 private:
     AudioCodec* codec_ = nullptr;
@@ -141,44 +330,168 @@ private:
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
     void* opus_encoder_ = nullptr;
+    // Warm decoders keyed by (sample rate, frame duration), opus_decoder_ / output_resampler_ point into the active one
+    struct OpusDecoderSlot {
+        int sample_rate = 0;
+        int frame_duration = 0;
+        void* decoder = nullptr;
+        std::unique_ptr<Resampler> resampler;
+        uint32_t last_used = 0;
+    };
+    std::array<OpusDecoderSlot, CONFIG_AUDIO_WARM_OPUS_DECODERS> decoder_slots_;
+    uint32_t decoder_use_count_ = 0;
     void* opus_decoder_ = nullptr;
     std::mutex decoder_mutex_;
     std::mutex input_resampler_mutex_;
-    esp_ae_rate_cvt_handle_t input_resampler_ = nullptr;
-    esp_ae_rate_cvt_handle_t output_resampler_ = nullptr;
+    std::unique_ptr<Resampler> input_resampler_;
+    Resampler* output_resampler_ = nullptr;
     
     // Encoder/Decoder state
     int encoder_sample_rate_ = 16000;
     int encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
     int encoder_frame_size_ = 0;
     int encoder_outbuf_size_ = 0;
+    std::mutex encoder_settings_mutex_;
+    OpusEncoderSettings encoder_settings_;
+    std::atomic<bool> encoder_settings_changed_{false};
+    // Idle release, requested by the clock tick and done by the codec tasks
+    std::atomic<int64_t> last_uplink_us_{0};
+    std::atomic<int64_t> last_decode_us_{0};
+    int64_t uplink_released_us_ = 0;
+    int64_t decoder_released_us_ = 0;
+    std::atomic<bool> release_encoder_{false};
+    std::atomic<bool> release_decoder_{false};
+    // Owned by the encoder task, other tasks only switch it and request a reset
+    std::unique_ptr<UplinkSilenceGate> uplink_gate_;
+#if CONFIG_USE_AUDIO_PROCESSOR
+    AecReferenceDelay aec_reference_delay_;
+#endif
+#if CONFIG_AUDIO_LATENCY_BENCHMARK
+    // Requested by the benchmark, queued by the decoder task and timed by the output task
+    std::atomic<bool> latency_marker_requested_{false};
+    std::atomic<int64_t> latency_marker_queued_us_{0};
+    std::atomic<int64_t> latency_marker_output_us_{0};
+    std::atomic<int64_t> latency_marker_render_us_{0};
+#endif
+    std::atomic<bool> uplink_gate_enabled_{false};
+    std::atomic<bool> uplink_gate_reset_{false};
+    // Samples per uplink frame, followed by the producer of the encode queue
+    std::atomic<int> uplink_frame_samples_{16000 / 1000 * CONFIG_AUDIO_UPLINK_FRAME_DURATION_MS};
+    std::vector<int16_t> uplink_pending_pcm_;
+    AudioTaskType uplink_pending_type_ = kAudioTaskTypeEncodeToSendQueue;
     int decoder_sample_rate_ = 0;
     int decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
     int decoder_frame_size_ = 0;
     DebugStatistics debug_statistics_;
+    AudioLatencyTracer latency_tracer_;
+#if CONFIG_AUDIO_TASK_MONITOR
+    AudioTaskMonitor task_monitor_;
+#endif
+#if CONFIG_AUDIO_CAPTURE
+    std::unique_ptr<AudioCapture> capture_;
+#endif
+#if CONFIG_WEB_AUDIO_MONITOR
+    AudioMonitor audio_monitor_;
+#endif
+    std::atomic<int64_t> last_input_read_us_{0};
     srmodel_list_t* models_list_ = nullptr;
+    std::function<srmodel_list_t*()> models_loader_;
 
     EventGroupHandle_t event_group_;
 
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
-    // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    // In single codec task mode both handles refer to the same "opus_codec" task
+    TaskHandle_t opus_decoder_task_handle_ = nullptr;
+    TaskHandle_t opus_encoder_task_handle_ = nullptr;
+    // Producer -> consumer: network/main -> opus_codec (the decode queue
+    // has several producers, which are serialized by decode_producer_mutex_)
+    SpscRing<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_{AUDIO_TESTING_MAX_PACKETS};
+    // opus_codec -> main
+    SpscRing<std::unique_ptr<AudioStreamPacket>> audio_send_queue_{MAX_SEND_PACKETS_IN_QUEUE};
+    // opus_codec -> main (audio testing)
+    SpscRing<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_{AUDIO_TESTING_MAX_PACKETS};
+    // audio processor -> opus_codec
+    SpscRing<std::unique_ptr<AudioTask>> audio_encode_queue_{MAX_ENCODE_TASKS_IN_QUEUE};
+    // opus_codec -> audio_output
+    SpscRing<std::unique_ptr<AudioTask>> audio_playback_queue_{MAX_PLAYBACK_TASKS_IN_QUEUE};
+    // Used depth of the two queues above, from the latency profile
+    std::atomic<size_t> encode_queue_limit_{2};
+    std::atomic<size_t> playback_queue_limit_{2};
+    std::mutex decode_producer_mutex_;
+    // Owned by the decoder task, other tasks only request a reset
+    std::unique_ptr<JitterBuffer> jitter_buffer_;
+    std::atomic<bool> jitter_buffer_reset_{false};
+    // Jitter buffer delay range of a new latency profile, applied by the decoder task
+    std::atomic<bool> jitter_range_changed_{false};
+    std::atomic<int> jitter_min_ms_{0};
+    std::atomic<int> jitter_max_ms_{0};
+    std::atomic<size_t> jitter_buffer_size_{0};
+    // Sounds are demuxed by the decoder task as playback queue space frees up
+    SoundPlayer sound_player_;
+    AudioStreamPacket sound_packet_;
+#if CONFIG_AUDIO_STREAM_PLAYER
+    StreamPlayer stream_player_;
+    AudioStreamPacket stream_packet_;
+#endif
+    // Decoded short prompts, played by the output task without the Opus decoder
+    SoundCache sound_cache_{SOUND_CACHE_BUDGET_BYTES, SOUND_CACHE_MAX_OGG_BYTES};
+    // Owned by the output task
+    AudioMixer mixer_;
+    std::vector<int16_t> mix_buffer_;
+    // Last samples written to the codec, the tail of it is what the DMA buffers still hold
+    std::vector<int16_t> output_history_;
+    size_t output_history_pos_ = 0;
+    std::atomic<bool> output_flush_requested_{false};
+    std::atomic<bool> silence_watched_{false};
+    std::atomic<bool> first_stream_frame_pending_{false};
+#if CONFIG_AUDIO_DECODE_AHEAD
+    // Set by PrepareStream(), cleared by the output task once it plays the stream
+    std::atomic<bool> decode_ahead_held_{false};
+    std::atomic<int64_t> decode_ahead_prepared_us_{0};
+    // 0 until StartStream()
+    std::atomic<int64_t> decode_ahead_started_us_{0};
+    std::atomic<size_t> decode_ahead_samples_{0};
+#endif
+    // Written by the output task: stream samples output since the last reset, and when the DMA runs dry
+    std::atomic<int64_t> output_stream_samples_{0};
+    std::atomic<int64_t> output_drain_us_{0};
+    // For server AEC: when each timestamped downlink frame reached the speaker
+    struct RenderRecord {
+        uint32_t timestamp;
+        int64_t render_us;
+        int64_t duration_us;
+    };
+    std::mutex timestamp_mutex_;
+    std::deque<RenderRecord> render_log_;
+
+    // Pre-allocated frames, so the steady-state audio path does not touch the heap
+    AudioFramePool<AudioTask> audio_task_pool_;
+    AudioFramePool<AudioStreamPacket> audio_packet_pool_;
+    std::vector<int16_t> input_resample_buffer_;
+    std::vector<int16_t> output_resample_buffer_;
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
     bool voice_detected_ = false;
     bool service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
+    // The audio processor runs on the wake word's AFE (CONFIG_USE_SHARED_AFE)
+    bool shared_afe_ = false;
+    // Reused by every read of the audio input task
+    std::vector<int16_t> input_feed_buffer_;
+#if CONFIG_WAKE_WORD_ENERGY_GATE
+    WakeWordGate wake_word_gate_;
+    std::vector<int16_t> wake_word_lookback_;
+#endif
+#if CONFIG_LP_VOICE_WAKE
+    std::vector<int16_t> wake_word_preroll_;
+#endif
+#if CONFIG_PUSH_TO_TALK_PREROLL
+    std::unique_ptr<PcmRing> talk_preroll_;
+    std::vector<int16_t> talk_preroll_chunk_;
+#endif
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
@@ -187,9 +500,47 @@ private:
     void AudioInputTask();
     void AudioOutputTask();
     void OpusCodecTask();
+    void OpusDecoderTask();
+    void OpusEncoderTask();
+    bool PopCachedSoundFrame(std::unique_ptr<AudioTask>& task, size_t samples);
+    void MixPlaybackFrame(AudioTask& task, bool from_stream);
+    void RecordOutput(const std::vector<int16_t>& pcm, bool from_stream);
+    void FlushOutput();
+    int BufferedOutputSamples();
+    int64_t UpdatePlaybackClock(size_t samples);
+    uint32_t PlaybackTimestampAt(int64_t time_us);
+    bool DecodeNextPacket();
+    bool DecodeToPlaybackQueue(const AudioStreamPacket* packet, esp_audio_dec_recovery_t recover);
+    esp_audio_dec_recovery_t PacketRecovery(const AudioStreamPacket* packet);
+    void NotifyFirstStreamFrame();
+    // Output task. Pops the next decoded frame unless the stream is held, wait is how long to sleep without one
+    bool PopPlaybackFrame(std::unique_ptr<AudioTask>& task, TickType_t& wait);
+#if CONFIG_AUDIO_DECODE_AHEAD
+    bool DecodeAheadHolds(TickType_t& wait);
+#endif
+    TickType_t DecoderWaitTicks();
+    bool EncodeNextTask();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void PushFrameToEncodeQueue(AudioTaskType type, const int16_t* samples, size_t count, uint8_t flags = 0);
+    void FlushUplinkFrame();
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void QueueSendPacket(std::unique_ptr<AudioStreamPacket>&& packet);
+    void ApplyLatencyProfile(const AudioLatencyProfile& profile);
+    void OpenEncoder(const OpusEncoderSettings& settings);
+    void ReleaseDecoders();
     void CheckAndUpdateAudioPowerState();
+    // Enables the output, from standby in a register write, and logs how long it took
+    void WakeOutput();
+    void SetupAudioProcessor();
+    void SetupWakeWordCallbacks();
+    void LoadPendingModels();
+    bool InitializeWakeWord();
+    int GetInputFeedSamples(EventBits_t bits);
+    void FeedWakeWord(const std::vector<int16_t>& data, EventBits_t bits);
+#if CONFIG_PUSH_TO_TALK_PREROLL
+    void FeedTalkPreroll(const std::vector<int16_t>& data, EventBits_t bits);
+#endif
+    void NotifyTask(TaskHandle_t task);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "audio_task_monitor.h"
+#include "audio_codec.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "AudioTaskMonitor"
+
+// A task is short of stack below this many free bytes
+#define MONITOR_STACK_MARGIN 512
+// and short of CPU above this share of one core
+#define MONITOR_CPU_ALERT_PERCENT 80
+
+static const char* const kWatchedTasks[] = {
+    "audio_input",
+    "audio_output",
+    "opus_codec",
+    "opus_decoder",
+    "opus_encoder",
+    "audio_communication",
+    "audio_detection",
+    "encode_wake_word",
+    "preencode_wake",
+};
+
+void AudioTaskMonitor::Sample() {
+    if (entries_.empty()) {
+        for (auto name : kWatchedTasks) {
+            entries_.push_back({name});
+        }
+    }
+
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 4;
+    statuses_.resize(count);
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    count = uxTaskGetSystemState(statuses_.data(), count, &total);
+    // The total is wall clock run time, so the shares below are of one core
+    uint32_t elapsed = total - last_total_;
+    bool first = last_total_ == 0;
+    last_total_ = total;
+
+    for (auto& entry : entries_) {
+        auto status = std::find_if(statuses_.begin(), statuses_.begin() + count, [&entry](const TaskStatus_t& s) {
+            return strcmp(s.pcTaskName, entry.name) == 0;
+        });
+        if (status == statuses_.begin() + count) {
+            entry.found = false;
+            continue;
+        }
+        uint32_t counter = status->ulRunTimeCounter;
+        if (entry.found && !first && elapsed > 0) {
+            entry.cpu_percent = (int)((uint64_t)(counter - entry.last_counter) * 100 / elapsed);
+            entry.peak_cpu_percent = std::max(entry.peak_cpu_percent, entry.cpu_percent);
+        }
+        entry.found = true;
+        entry.last_counter = counter;
+        // The lowest free stack since the task started, in bytes on ESP-IDF
+        entry.stack_free = status->usStackHighWaterMark;
+
+        if (entry.stack_free < MONITOR_STACK_MARGIN) {
+            ESP_LOGW(TAG, "%s is short of stack: %lu bytes left", entry.name, (unsigned long)entry.stack_free);
+        }
+        if (entry.cpu_percent > MONITOR_CPU_ALERT_PERCENT) {
+            ESP_LOGW(TAG, "%s is short of CPU: %d%% of a core", entry.name, entry.cpu_percent);
+        }
+    }
+
+    if (codec_ != nullptr) {
+        uint32_t overruns = codec_->input_overruns();
+        uint32_t underruns = codec_->output_underruns();
+        if (overruns != last_input_overruns_) {
+            ESP_LOGW(TAG, "I2S input overran %lu times", (unsigned long)(overruns - last_input_overruns_));
+        }
+        if (underruns != last_output_underruns_) {
+            ESP_LOGW(TAG, "I2S output underran %lu times", (unsigned long)(underruns - last_output_underruns_));
+        }
+        last_input_overruns_ = overruns;
+        last_output_underruns_ = underruns;
+    }
+}
+
+std::string AudioTaskMonitor::GetJson() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* tasks = cJSON_AddArrayToObject(root, "tasks");
+    for (auto& entry : entries_) {
+        if (!entry.found) {
+            continue;
+        }
+        cJSON* task = cJSON_CreateObject();
+        cJSON_AddStringToObject(task, "name", entry.name);
+        cJSON_AddNumberToObject(task, "cpu_percent", entry.cpu_percent);
+        cJSON_AddNumberToObject(task, "peak_cpu_percent", entry.peak_cpu_percent);
+        cJSON_AddNumberToObject(task, "stack_free_min", entry.stack_free);
+        cJSON_AddItemToArray(tasks, task);
+    }
+    if (codec_ != nullptr) {
+        cJSON_AddNumberToObject(root, "i2s_input_overruns", codec_->input_overruns());
+        cJSON_AddNumberToObject(root, "i2s_output_underruns", codec_->output_underruns());
+    }
+    char* json = cJSON_PrintUnformatted(root);
+    std::string result(json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+    return result;
+}
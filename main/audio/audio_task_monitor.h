@@ -0,0 +1,48 @@
+#ifndef AUDIO_TASK_MONITOR_H
+#define AUDIO_TASK_MONITOR_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class AudioCodec;
+
+/*
+ * Watches the tasks of the audio pipeline by name: CPU share between two samples, from the
+ * same run time counters as SystemInfo::PrintTaskCpuUsage(), the lowest free stack seen, and
+ * the I2S queue overflows of the codec. Sample() warns when a task runs short of stack or CPU,
+ * so stack sizes can be trimmed to the measured need instead of found by crashing.
+ *
+ * Sample() and GetJson() run on the main task.
+ */
+class AudioTaskMonitor {
+public:
+    explicit AudioTaskMonitor(AudioCodec* codec = nullptr) : codec_(codec) {}
+
+    void SetCodec(AudioCodec* codec) { codec_ = codec; }
+    void Sample();
+    // The last sample of every watched task that exists
+    std::string GetJson();
+
+private:
+    struct Entry {
+        const char* name;
+        bool found = false;
+        uint32_t last_counter = 0;
+        int cpu_percent = 0;
+        int peak_cpu_percent = 0;
+        uint32_t stack_free = 0;
+    };
+
+    AudioCodec* codec_;
+    std::vector<Entry> entries_;
+    std::vector<TaskStatus_t> statuses_;
+    configRUN_TIME_COUNTER_TYPE last_total_ = 0;
+    uint32_t last_input_overruns_ = 0;
+    uint32_t last_output_underruns_ = 0;
+};
+
+#endif // AUDIO_TASK_MONITOR_H
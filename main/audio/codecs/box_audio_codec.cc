@@ -1,4 +1,5 @@
 #include "box_audio_codec.h"
+#include "audio_hot.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
@@ -182,7 +183,12 @@ void BoxAudioCodec::CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gpio_
 }
 
 void BoxAudioCodec::SetOutputVolume(int volume) {
-    ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, volume));
+    // A closed device gets the volume when it is opened again
+    if (output_dev_ != nullptr && (output_enabled_ || output_standby_)) {
+        RampOutputVolume(output_volume_, volume, [this](int v) {
+            ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, v));
+        });
+    }
     AudioCodec::SetOutputVolume(volume);
 }
 
@@ -212,10 +218,13 @@ void BoxAudioCodec::EnableInput(bool enable) {
 
 void BoxAudioCodec::EnableOutput(bool enable) {
     std::lock_guard<std::mutex> lock(data_if_mutex_);
-    if (enable == output_enabled_) {
+    if (enable == output_enabled_ && !output_standby_) {
         return;
     }
-    if (enable) {
+    if (enable && output_standby_) {
+        // Still open and clocked from StandbyOutput()
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(output_dev_, false));
+    } else if (enable) {
         // Play 16bit 1 channel
         esp_codec_dev_sample_info_t fs = {
             .bits_per_sample = 16,
@@ -227,19 +236,34 @@ void BoxAudioCodec::EnableOutput(bool enable) {
         ESP_ERROR_CHECK(esp_codec_dev_open(output_dev_, &fs));
         ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, output_volume_));
     } else {
+        if (output_standby_) {
+            // The mute would outlast the close
+            ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(output_dev_, false));
+        }
         ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
     }
+    output_standby_ = false;
     AudioCodec::EnableOutput(enable);
 }
 
-int BoxAudioCodec::Read(int16_t* dest, int samples) {
+void BoxAudioCodec::StandbyOutput() {
+    std::lock_guard<std::mutex> lock(data_if_mutex_);
+    if (!output_enabled_) {
+        return;
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(output_dev_, true));
+    output_standby_ = true;
+    AudioCodec::EnableOutput(false);
+}
+
+int AUDIO_HOT BoxAudioCodec::Read(int16_t* dest, int samples) {
     if (input_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)dest, samples * sizeof(int16_t)));
     }
     return samples;
 }
 
-int BoxAudioCodec::Write(const int16_t* data, int samples) {
+int AUDIO_HOT BoxAudioCodec::Write(const int16_t* data, int samples) {
     if (output_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_write(output_dev_, (void*)data, samples * sizeof(int16_t)));
     }
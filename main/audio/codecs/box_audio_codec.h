@@ -35,6 +35,7 @@ public:
     virtual void SetOutputVolume(int volume) override;
     virtual void EnableInput(bool enable) override;
     virtual void EnableOutput(bool enable) override;
+    virtual void StandbyOutput() override;
 };
 
 #endif // _BOX_AUDIO_CODEC_H
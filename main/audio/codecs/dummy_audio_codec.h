@@ -3,7 +3,7 @@
 
 #include "audio_codec.h"
 
-class DummyAudioCodec : public AudioCodec {
+class DummyAudioCodec final : public AudioCodec {
 private:
     virtual int Read(int16_t* dest, int samples) override;
     virtual int Write(const int16_t* data, int samples) override;
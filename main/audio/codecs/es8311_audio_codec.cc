@@ -1,4 +1,5 @@
 #include "es8311_audio_codec.h"
+#include "audio_hot.h"
 
 #include <esp_log.h>
 
@@ -87,7 +88,7 @@ void Es8311AudioCodec::UpdateDeviceState() {
         ESP_ERROR_CHECK(esp_codec_dev_open(dev_, &fs));
         ESP_ERROR_CHECK(esp_codec_dev_set_in_gain(dev_, input_gain_));
         ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(dev_, output_volume_));
-    } else if (!input_enabled_ && !output_enabled_ && dev_ != nullptr) {
+    } else if (!input_enabled_ && !output_enabled_ && !output_standby_ && dev_ != nullptr) {
         esp_codec_dev_close(dev_);
         dev_ = nullptr;
     }
@@ -156,7 +157,12 @@ void Es8311AudioCodec::CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gp
 }
 
 void Es8311AudioCodec::SetOutputVolume(int volume) {
-    ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(dev_, volume));
+    // A closed device gets the volume when it is opened again
+    if (dev_ != nullptr && (output_enabled_ || output_standby_)) {
+        RampOutputVolume(output_volume_, volume, [this](int v) {
+            ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(dev_, v));
+        });
+    }
     AudioCodec::SetOutputVolume(volume);
 }
 
@@ -177,21 +183,38 @@ void Es8311AudioCodec::EnableOutput(bool enable) {
     if (codec_if_ == nullptr) {
         return;
     }
-    if (enable == output_enabled_) {
+    if (enable == output_enabled_ && !output_standby_) {
         return;
     }
+    if (output_standby_) {
+        // Still open and clocked from StandbyOutput()
+        output_standby_ = false;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(dev_, false));
+    }
     AudioCodec::EnableOutput(enable);
     UpdateDeviceState();
 }
 
-int Es8311AudioCodec::Read(int16_t* dest, int samples) {
+void Es8311AudioCodec::StandbyOutput() {
+    std::lock_guard<std::mutex> lock(data_if_mutex_);
+    if (codec_if_ == nullptr || !output_enabled_) {
+        return;
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(dev_, true));
+    output_standby_ = true;
+    AudioCodec::EnableOutput(false);
+    // Keeps the device open, only the PA goes off
+    UpdateDeviceState();
+}
+
+int AUDIO_HOT Es8311AudioCodec::Read(int16_t* dest, int samples) {
     if (input_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(dev_, (void*)dest, samples * sizeof(int16_t)));
     }
     return samples;
 }
 
-int Es8311AudioCodec::Write(const int16_t* data, int samples) {
+int AUDIO_HOT Es8311AudioCodec::Write(const int16_t* data, int samples) {
     if (output_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_write(dev_, (void*)data, samples * sizeof(int16_t)));
     }
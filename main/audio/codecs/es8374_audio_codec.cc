@@ -1,4 +1,5 @@
 #include "es8374_audio_codec.h"
+#include "audio_hot.h"
 
 #include <esp_log.h>
 
@@ -132,7 +133,12 @@ void Es8374AudioCodec::CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gp
 }
 
 void Es8374AudioCodec::SetOutputVolume(int volume) {
-    ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, volume));
+    // A closed device gets the volume when it is opened again
+    if (output_dev_ != nullptr && (output_enabled_ || output_standby_)) {
+        RampOutputVolume(output_volume_, volume, [this](int v) {
+            ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, v));
+        });
+    }
     AudioCodec::SetOutputVolume(volume);
 }
 
@@ -159,10 +165,16 @@ void Es8374AudioCodec::EnableInput(bool enable) {
 
 void Es8374AudioCodec::EnableOutput(bool enable) {
     std::lock_guard<std::mutex> lock(data_if_mutex_);
-    if (enable == output_enabled_) {
+    if (enable == output_enabled_ && !output_standby_) {
         return;
     }
-    if (enable) {
+    if (enable && output_standby_) {
+        // Still open and clocked from StandbyOutput()
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(output_dev_, false));
+        if (pa_pin_ != GPIO_NUM_NC) {
+            gpio_set_level(pa_pin_, 1);
+        }
+    } else if (enable) {
         // Play 16bit 1 channel
         esp_codec_dev_sample_info_t fs = {
             .bits_per_sample = 16,
@@ -177,22 +189,40 @@ void Es8374AudioCodec::EnableOutput(bool enable) {
             gpio_set_level(pa_pin_, 1);
         }
     } else {
+        if (output_standby_) {
+            // The mute would outlast the close
+            ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(output_dev_, false));
+        }
         ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
         if (pa_pin_ != GPIO_NUM_NC) {
             gpio_set_level(pa_pin_, 0);
         }
     }
+    output_standby_ = false;
     AudioCodec::EnableOutput(enable);
 }
 
-int Es8374AudioCodec::Read(int16_t* dest, int samples) {
+void Es8374AudioCodec::StandbyOutput() {
+    std::lock_guard<std::mutex> lock(data_if_mutex_);
+    if (!output_enabled_) {
+        return;
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_set_out_mute(output_dev_, true));
+    if (pa_pin_ != GPIO_NUM_NC) {
+        gpio_set_level(pa_pin_, 0);
+    }
+    output_standby_ = true;
+    AudioCodec::EnableOutput(false);
+}
+
+int AUDIO_HOT Es8374AudioCodec::Read(int16_t* dest, int samples) {
     if (input_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)dest, samples * sizeof(int16_t)));
     }
     return samples;
 }
 
-int Es8374AudioCodec::Write(const int16_t* data, int samples) {
+int AUDIO_HOT Es8374AudioCodec::Write(const int16_t* data, int samples) {
     if (output_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_write(output_dev_, (void*)data, samples * sizeof(int16_t)));
     }
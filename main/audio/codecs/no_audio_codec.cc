@@ -1,11 +1,19 @@
 #include "no_audio_codec.h"
+#include "audio_dsp.h"
+#include "audio_hot.h"
 
 #include <esp_log.h>
 #include <cmath>
 #include <cstring>
+#include <algorithm>
 
 #define TAG "NoAudioCodec"
 
+NoAudioCodec::NoAudioCodec() {
+    // 16-bit samples are written as 32-bit I2S slots
+    output_headroom_ = 2;
+}
+
 NoAudioCodec::~NoAudioCodec() {
     if (rx_handle_ != nullptr) {
         ESP_ERROR_CHECK(i2s_channel_disable(rx_handle_));
@@ -214,30 +222,68 @@ NoAudioCodecSimplex::NoAudioCodecSimplex(int input_sample_rate, int output_sampl
     ESP_LOGI(TAG, "Simplex channels created");
 }
 
-int NoAudioCodec::Write(const int16_t* data, int samples) {
+int AUDIO_HOT NoAudioCodec::Write(const int16_t* data, int samples) {
+    // Only used outside OutputData(), which expands in place
+    output_buffer_.resize(samples * 2);
+    std::copy(data, data + samples, output_buffer_.begin());
+    return WriteInPlace(output_buffer_.data(), samples);
+}
+
+void NoAudioCodec::SetOutputVolume(int volume) {
+    // output_volume_: 0-100, volume_factor_: 0-65536
+    volume_factor_ = pow(double(volume) / 100.0, 2) * 65536;
+    AudioCodec::SetOutputVolume(volume);
+}
+
+int32_t NoAudioCodec::VolumeFactor() {
+    int32_t factor = volume_factor_;
+    if (factor == 0 && output_volume_ > 0) {
+        // Before the first SetOutputVolume(), the volume came from the settings
+        factor = pow(double(output_volume_) / 100.0, 2) * 65536;
+        volume_factor_ = factor;
+    }
+    return factor;
+}
+
+int AUDIO_HOT NoAudioCodec::WriteInPlace(int16_t* data, int samples) {
     std::lock_guard<std::mutex> lock(data_if_mutex_);
-    std::vector<int32_t> buffer(samples);
-
-    // output_volume_: 0-100
-    // volume_factor_: 0-65536
-    int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-    for (int i = 0; i < samples; i++) {
-        int64_t temp = int64_t(data[i]) * volume_factor; // 使用 int64_t 进行乘法运算
-        if (temp > INT32_MAX) {
-            buffer[i] = INT32_MAX;
-        } else if (temp < INT32_MIN) {
-            buffer[i] = INT32_MIN;
-        } else {
-            buffer[i] = static_cast<int32_t>(temp);
+
+    int32_t target = VolumeFactor();
+    int32_t from = applied_volume_factor_ < 0 ? target : applied_volume_factor_;
+    applied_volume_factor_ = target;
+    // Expand to 32-bit slots in place, from the end so no sample is overwritten before it is read
+    int32_t* buffer = (int32_t*)data;
+    if (from == target) {
+        audio_dsp::ScaleToS32(buffer, data, samples, target);
+    } else {
+        // A volume change glides over this write in short segments instead of stepping
+        const int segment = 32;
+        int segments = (samples + segment - 1) / segment;
+        for (int i = segments - 1; i >= 0; i--) {
+            int begin = i * segment;
+            int count = std::min(segment, samples - begin);
+            int32_t factor = from + (int64_t)(target - from) * (i + 1) / segments;
+            audio_dsp::ScaleToS32(buffer + begin, data + begin, count, factor);
         }
     }
 
     size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer, samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
     return bytes_written / sizeof(int32_t);
 }
 
-int NoAudioCodec::Read(int16_t* dest, int samples) {
+void NoAudioCodec::FlushOutput(std::vector<int16_t>& fade) {
+    std::lock_guard<std::mutex> lock(data_if_mutex_);
+    if (!output_enabled_) {
+        return;
+    }
+    int samples = fade.size();
+    fade.resize(samples * 2);
+    audio_dsp::ScaleToS32((int32_t*)fade.data(), fade.data(), samples, VolumeFactor());
+    RestartOutput(fade.data(), samples * sizeof(int32_t));
+}
+
+int AUDIO_HOT NoAudioCodec::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
     std::vector<int32_t> bit32_buffer(samples);
@@ -247,10 +293,7 @@ int NoAudioCodec::Read(int16_t* dest, int samples) {
     }
 
     samples = bytes_read / sizeof(int32_t);
-    for (int i = 0; i < samples; i++) {
-        int32_t value = bit32_buffer[i] >> 12;
-        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
-    }
+    audio_dsp::ShiftToS16(dest, bit32_buffer.data(), samples, 12);
     return samples;
 }
 
@@ -364,7 +407,7 @@ NoAudioCodecSimplexPdm::NoAudioCodecSimplexPdm(int input_sample_rate, int output
     ESP_LOGI(TAG, "Simplex channels created");
 }
 
-int NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
+int AUDIO_HOT NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
     // PDM 解调后的数据位宽为 16 位，直接读取到目标缓冲区
@@ -375,11 +418,7 @@ int NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
 
     samples = bytes_read / sizeof(int16_t);
     if (input_gain_ > 0) {
-        int gain_factor = (int)input_gain_;
-        for (int i = 0; i < samples; i++) {
-            int32_t amplified = dest[i] * gain_factor;
-            dest[i] = (amplified > INT16_MAX) ? INT16_MAX : (amplified < -INT16_MAX) ? -INT16_MAX : (int16_t)amplified;
-        }
+        audio_dsp::Gain(dest, dest, samples, audio_dsp::GainToQ15((int)input_gain_));
     }
     return samples;
 }
@@ -6,32 +6,44 @@
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
 #include <mutex>
+#include <atomic>
+#include <vector>
 
 class NoAudioCodec : public AudioCodec {
 protected:
     std::mutex data_if_mutex_;
 
+    std::vector<int16_t> output_buffer_;
+    // Software volume in Q16, output_volume_ squared. Writes glide from the applied to the target one
+    std::atomic<int32_t> volume_factor_{0};
+    int32_t applied_volume_factor_ = -1;
+
     virtual int Write(const int16_t* data, int samples) override;
+    virtual int WriteInPlace(int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
     virtual void EnableInput(bool enable) override;
     virtual void EnableOutput(bool enable) override;
+    virtual void FlushOutput(std::vector<int16_t>& fade) override;
+    int32_t VolumeFactor();
 
 public:
+    virtual void SetOutputVolume(int volume) override;
+    NoAudioCodec();
     virtual ~NoAudioCodec();
 };
 
-class NoAudioCodecDuplex : public NoAudioCodec {
+class NoAudioCodecDuplex final : public NoAudioCodec {
 public:
     NoAudioCodecDuplex(int input_sample_rate, int output_sample_rate, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din);
 };
 
-class NoAudioCodecSimplex : public NoAudioCodec {
+class NoAudioCodecSimplex final : public NoAudioCodec {
 public:
     NoAudioCodecSimplex(int input_sample_rate, int output_sample_rate, gpio_num_t spk_bclk, gpio_num_t spk_ws, gpio_num_t spk_dout, gpio_num_t mic_sck, gpio_num_t mic_ws, gpio_num_t mic_din);
     NoAudioCodecSimplex(int input_sample_rate, int output_sample_rate, gpio_num_t spk_bclk, gpio_num_t spk_ws, gpio_num_t spk_dout, i2s_std_slot_mask_t spk_slot_mask, gpio_num_t mic_sck, gpio_num_t mic_ws, gpio_num_t mic_din, i2s_std_slot_mask_t mic_slot_mask);
 };
 
-class NoAudioCodecSimplexPdm : public NoAudioCodec {
+class NoAudioCodecSimplexPdm final : public NoAudioCodec {
 public:
     NoAudioCodecSimplexPdm(int input_sample_rate, int output_sample_rate, gpio_num_t spk_bclk, gpio_num_t spk_ws, gpio_num_t spk_dout, gpio_num_t mic_sck,  gpio_num_t mic_din);
     NoAudioCodecSimplexPdm(int input_sample_rate, int output_sample_rate, gpio_num_t spk_bclk, gpio_num_t spk_ws, gpio_num_t spk_dout, i2s_std_slot_mask_t spk_slot_mask, gpio_num_t mic_sck,  gpio_num_t mic_din);
@@ -3,6 +3,67 @@
 
 #define TAG "OggDemuxer"
 
+// 包索引的结尾：u32采样率，u32包数量，u16版本，u16每包时长(ms)，"OPIX"
+#define PACKET_INDEX_MAGIC "OPIX"
+#define PACKET_INDEX_VERSION 1
+#define PACKET_INDEX_FOOTER_SIZE 16
+#define PACKET_INDEX_ENTRY_SIZE 6
+
+static uint32_t ReadLe32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ReadLe16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/// @brief 在data末尾查找包索引
+/// @return 没有索引或索引无效时返回false，调用方改用Process()解析页
+bool OggDemuxer::FindPacketIndex(const uint8_t* data, size_t size, PacketIndex& index)
+{
+    index = {};
+    if (size < PACKET_INDEX_FOOTER_SIZE + 4 || memcmp(data, "OggS", 4) != 0) {
+        return false;
+    }
+    const uint8_t* footer = data + size - PACKET_INDEX_FOOTER_SIZE;
+    if (memcmp(footer + 12, PACKET_INDEX_MAGIC, 4) != 0 || ReadLe16(footer + 8) != PACKET_INDEX_VERSION) {
+        return false;
+    }
+    size_t count = ReadLe32(footer + 4);
+    size_t trailer_size = PACKET_INDEX_FOOTER_SIZE + count * PACKET_INDEX_ENTRY_SIZE;
+    if (count == 0 || count > size / PACKET_INDEX_ENTRY_SIZE || trailer_size >= size) {
+        ESP_LOGW(TAG, "无效的包索引: %zu个包", count);
+        return false;
+    }
+    index.data = data;
+    index.entries = footer - count * PACKET_INDEX_ENTRY_SIZE;
+    index.count = count;
+    index.audio_size = size - trailer_size;
+    index.sample_rate = ReadLe32(footer);
+    index.frame_duration = ReadLe16(footer + 10);
+    return true;
+}
+
+/// @brief 取第i个包，包数据直接引用文件数据
+bool OggDemuxer::PacketIndex::Get(size_t i, const uint8_t** packet, size_t* len) const
+{
+    if (i >= count) {
+        return false;
+    }
+    const uint8_t* entry = entries + i * PACKET_INDEX_ENTRY_SIZE;
+    size_t offset = ReadLe32(entry);
+    size_t length = ReadLe16(entry + 4);
+    if (length == 0 || offset > audio_size || length > audio_size - offset) {
+        ESP_LOGE(TAG, "包索引越界: %zu + %zu > %zu", offset, length, audio_size);
+        return false;
+    }
+    *packet = data + offset;
+    *len = length;
+    return true;
+}
+
 /// @brief 重置解封器
 void OggDemuxer::Reset()
 {
@@ -14,6 +75,7 @@ void OggDemuxer::Reset()
 
     state_ = ParseState::FIND_PAGE;
     ctx_.packet_len = 0;
+    ctx_.packet_direct = nullptr;
     ctx_.seg_count = 0;
     ctx_.seg_index = 0;
     ctx_.data_offset = 0;
@@ -29,13 +91,34 @@ void OggDemuxer::Reset()
     memset(ctx_.packet_buf, 0, sizeof(ctx_.packet_buf));
 }
 
+/// @brief 把直接引用的包数据复制到包缓冲区，输入数据在返回后不再有效
+/// @return 包缓冲区放不下时返回false，当前包被丢弃
+bool OggDemuxer::BufferDirectPacket()
+{
+    if (ctx_.packet_direct == nullptr) {
+        return true;
+    }
+    const uint8_t* direct = ctx_.packet_direct;
+    ctx_.packet_direct = nullptr;
+    if (ctx_.packet_len > sizeof(ctx_.packet_buf)) {
+        ESP_LOGE(TAG, "包缓冲区溢出: %zu > %zu", ctx_.packet_len, sizeof(ctx_.packet_buf));
+        ctx_.packet_len = 0;
+        ctx_.packet_continued = false;
+        return false;
+    }
+    memcpy(ctx_.packet_buf, direct, ctx_.packet_len);
+    return true;
+}
+
 /// @brief 处理数据块
 /// @param data 输入数据
 /// @param size 输入数据大小
+/// @param max_packets 最多输出的包数量
 /// @return 已处理的字节数
-size_t OggDemuxer::Process(const uint8_t* data, size_t size)
+size_t OggDemuxer::Process(const uint8_t* data, size_t size, size_t max_packets)
 {
     size_t processed = 0;  // 已处理的字节数
+    size_t packets = 0;    // 已输出的包数量
     
     while (processed < size) {
         switch (state_) {
@@ -206,8 +289,13 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                     ctx_.seg_remaining = seg_len;
                 }
                 
+                // 新包从当前数据块开始时直接引用输入数据
+                if (ctx_.packet_len == 0 && ctx_.seg_remaining == ctx_.seg_table[ctx_.seg_index]) {
+                    ctx_.packet_direct = data + processed;
+                }
+
                 // 检查缓冲区是否足够
-                if (ctx_.packet_len + seg_len > sizeof(ctx_.packet_buf)) {
+                if (ctx_.packet_direct == nullptr && ctx_.packet_len + seg_len > sizeof(ctx_.packet_buf)) {
                     ESP_LOGE(TAG, "包缓冲区溢出: %zu + %u > %zu", ctx_.packet_len, seg_len, sizeof(ctx_.packet_buf));
                     state_ = ParseState::FIND_PAGE;
                     ctx_.packet_len = 0;
@@ -219,7 +307,9 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                 
                 // 复制数据
                 size_t to_copy = std::min(size - processed, (size_t)seg_len);
-                memcpy(ctx_.packet_buf + ctx_.packet_len, data + processed, to_copy);
+                if (ctx_.packet_direct == nullptr) {
+                    memcpy(ctx_.packet_buf + ctx_.packet_len, data + processed, to_copy);
+                }
                 
                 processed += to_copy;
                 ctx_.packet_len += to_copy;
@@ -229,6 +319,7 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                 // 检查段是否完整
                 if (ctx_.seg_remaining > 0) {
                     // 段不完整，等待更多数据
+                    BufferDirectPacket();
                     return processed;
                 }
                 
@@ -237,15 +328,17 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                 
                 if (!seg_continued) {
                     // 包结束
+                    const uint8_t* packet = ctx_.packet_direct != nullptr ? ctx_.packet_direct : ctx_.packet_buf;
+                    ctx_.packet_direct = nullptr;
                     if (ctx_.packet_len) {
                         if (!opus_info_.head_seen) {
-                            if (ctx_.packet_len >=8 && memcmp(ctx_.packet_buf, "OpusHead", 8) == 0) {
+                            if (ctx_.packet_len >=8 && memcmp(packet, "OpusHead", 8) == 0) {
                                 opus_info_.head_seen = true;
                                 if (ctx_.packet_len >= 19) {
-                                    opus_info_.sample_rate = ctx_.packet_buf[12] | 
-                                                            (ctx_.packet_buf[13] << 8) | 
-                                                            (ctx_.packet_buf[14] << 16) | 
-                                                            (ctx_.packet_buf[15] << 24);
+                                    opus_info_.sample_rate = packet[12] | 
+                                                            (packet[13] << 8) | 
+                                                            (packet[14] << 16) | 
+                                                            (packet[15] << 24);
                                     ESP_LOGI(TAG, "OpusHead found, sample_rate=%d", opus_info_.sample_rate);
                                 }
                                 ctx_.packet_len = 0;
@@ -256,7 +349,7 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                             }
                         }
                         if (!opus_info_.tags_seen) {
-                            if (ctx_.packet_len >= 8 && memcmp(ctx_.packet_buf, "OpusTags", 8) == 0) {
+                            if (ctx_.packet_len >= 8 && memcmp(packet, "OpusTags", 8) == 0) {
                                 opus_info_.tags_seen = true;
                                 ESP_LOGI(TAG, "OpusTags found.");
                                 ctx_.packet_len = 0;
@@ -268,8 +361,9 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                         }
                         if (opus_info_.head_seen && opus_info_.tags_seen) {
                             if (on_demuxer_finished_) {
-                                on_demuxer_finished_(ctx_.packet_buf, opus_info_.sample_rate, ctx_.packet_len);
+                                on_demuxer_finished_(packet, opus_info_.sample_rate, ctx_.packet_len);
                             }
+                            packets++;
                         } else {
                             ESP_LOGW(TAG, "当前Ogg容器未解析到OpusHead/OpusTags，丢弃");
                         }
@@ -282,6 +376,10 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                 
                 ctx_.seg_index++;
                 ctx_.seg_remaining = 0;
+                if (packets >= max_packets) {
+                    // 已输出足够的包，停在包边界上，下次调用从这里继续
+                    return processed;
+                }
             }
             
             if (ctx_.seg_index == ctx_.seg_count) {
@@ -294,6 +392,8 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                 // 如果包跨页，保持packet_len和packet_continued
                 if (!ctx_.packet_continued) {
                     ctx_.packet_len = 0;
+                } else {
+                    BufferDirectPacket();
                 }
                 
                 // 进入下一页面
@@ -306,6 +406,8 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
         }
     }
     
+    // 数据块在包中间结束
+    BufferDirectPacket();
     return processed;
 }
 
@@ -7,6 +7,37 @@
 #include <vector>
 
 class OggDemuxer {
+public:
+    /// @brief 转换工具附加在Ogg文件末尾的Opus包索引，有索引的文件可不解析页，直接按偏移取包
+    struct PacketIndex {
+        const uint8_t* data = nullptr;      // 文件开头
+        const uint8_t* entries = nullptr;   // 每个包6字节：u32偏移，u16长度，小端
+        size_t count = 0;                   // 音频包数量，不含OpusHead/OpusTags
+        size_t audio_size = 0;              // 索引之前的Ogg数据大小
+        int sample_rate = 0;                // OpusHead中的采样率
+        int frame_duration = 0;             // 每包时长(ms)
+
+        /// @brief 取第i个包，索引损坏时返回false
+        bool Get(size_t i, const uint8_t** packet, size_t* len) const;
+    };
+
+    /// @brief 在data末尾查找包索引
+    static bool FindPacketIndex(const uint8_t* data, size_t size, PacketIndex& index);
+
+    /// @brief Opus可以按自身支持的任一采样率解码，输出采样率是其中之一时直接按它解码，省去重采样
+    static int DecodeSampleRate(int output_sample_rate, int stream_sample_rate) {
+        switch (output_sample_rate) {
+            case 8000:
+            case 12000:
+            case 16000:
+            case 24000:
+            case 48000:
+                return output_sample_rate;
+            default:
+                return stream_sample_rate;
+        }
+    }
+
 private:
     enum ParseState : int8_t {
         FIND_PAGE,
@@ -27,8 +58,9 @@ private:
         bool packet_continued{false};   // 当前包是否跨多个段
         uint8_t header[27];             // Ogg页头
         uint8_t seg_table[255];         // 当前存储的段表
-        uint8_t packet_buf[8192];       // 8KB包缓冲区
-        size_t packet_len = 0;          // 缓冲区中累计的数据长度
+        uint8_t packet_buf[8192];       // 8KB包缓冲区，仅用于跨页或跨数据块的包
+        const uint8_t* packet_direct = nullptr; // 包完整位于输入数据中时直接引用，不复制
+        size_t packet_len = 0;          // 当前包累计的数据长度
         size_t seg_count = 0;           // 当前页段数
         size_t seg_index = 0;           // 当前处理的段索引
         size_t data_offset = 0;         // 解析当前阶段已读取的字节数
@@ -45,7 +77,10 @@ public:
     
     void Reset();
     
-    size_t Process(const uint8_t* data, size_t size);
+    /// @brief 处理数据块
+    /// @param max_packets 输出该数量的包后立即返回，便于调用方按需拉取
+    /// @return 已处理的字节数
+    size_t Process(const uint8_t* data, size_t size, size_t max_packets = SIZE_MAX);
 
     /// @brief 设置解封装完毕后回调处理函数
     /// @param on_demuxer_finished 
@@ -58,6 +93,8 @@ private:
     context_t   ctx_;
     Opus_t      opus_info_;
     std::function<void(const uint8_t*, int, size_t)> on_demuxer_finished_;
+
+    bool BufferDirectPacket();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "jitter_buffer.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <iterator>
+#include <cstdlib>
+
+#define TAG "JitterBuffer"
+
+// Good frames needed before one frame of underrun protection is given back
+#define JITTER_BUFFER_STABLE_FRAMES 50
+
+JitterBuffer::JitterBuffer(int min_delay_ms, int max_delay_ms, size_t max_packets)
+    : min_delay_ms_(min_delay_ms), max_delay_ms_(std::max(min_delay_ms, max_delay_ms)), max_packets_(max_packets) {
+}
+
+void JitterBuffer::SetDelayRange(int min_delay_ms, int max_delay_ms) {
+    min_delay_ms_ = min_delay_ms;
+    max_delay_ms_ = std::max(min_delay_ms, max_delay_ms);
+}
+
+void JitterBuffer::Reset(const Release& release) {
+    for (auto& entry : packets_) {
+        if (release) {
+            release(std::move(entry.packet));
+        }
+    }
+    packets_.clear();
+    playing_ = false;
+    has_expected_timestamp_ = false;
+    has_transit_ = false;
+    underrun_pending_ = false;
+    stable_frames_ = 0;
+}
+
+bool JitterBuffer::Push(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_us) {
+    if (full()) {
+        return false;
+    }
+    if (packet->frame_duration > 0) {
+        frame_duration_ms_ = packet->frame_duration;
+    }
+
+    /* A packet right after the buffer ran dry means the playout delay was too short */
+    if (underrun_pending_) {
+        underrun_pending_ = false;
+        if (now_us - underrun_start_us_ < max_delay_ms_ * 1000LL) {
+            underrun_count_++;
+            underrun_bonus_ms_ = std::min(underrun_bonus_ms_ + frame_duration_ms_, max_delay_ms_);
+            stable_frames_ = 0;
+            ESP_LOGI(TAG, "Underrun, playout delay %d ms", target_delay_ms());
+        }
+    }
+
+    uint32_t timestamp = packet->timestamp;
+    if (timestamp == 0) {
+        packets_.push_back({std::move(packet), now_us});
+        return true;
+    }
+
+    if (has_expected_timestamp_ && (int32_t)(timestamp - expected_timestamp_) < 0) {
+        late_count_++;
+        return false;
+    }
+
+    /* Interarrival jitter, RFC 3550 section 6.4.1 */
+    int64_t transit_us = now_us - (int64_t)timestamp * 1000;
+    if (has_transit_) {
+        int64_t d = std::min<int64_t>(std::abs(transit_us - last_transit_us_), max_delay_ms_ * 1000LL);
+        jitter_us_ += (d - jitter_us_) / 16;
+    }
+    last_transit_us_ = transit_us;
+    has_transit_ = true;
+
+    /* Insert ordered by timestamp, packets mostly arrive in order so search from the back */
+    auto it = packets_.end();
+    while (it != packets_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->packet->timestamp == 0 || (int32_t)(timestamp - prev->packet->timestamp) > 0) {
+            break;
+        }
+        if (prev->packet->timestamp == timestamp) {
+            late_count_++;  // duplicate
+            return false;
+        }
+        it = prev;
+    }
+    packets_.insert(it, {std::move(packet), now_us});
+    return true;
+}
+
+JitterBuffer::Action JitterBuffer::Next(int64_t now_us, std::unique_ptr<AudioStreamPacket>& packet,
+    const AudioStreamPacket*& next) {
+    next = nullptr;
+    if (packets_.empty()) {
+        if (playing_) {
+            playing_ = false;
+            underrun_pending_ = true;
+            underrun_start_us_ = now_us;
+        }
+        return kWait;
+    }
+
+    if (!playing_) {
+        int target_ms = target_delay_ms();
+        if (BufferedMs() < target_ms && now_us - packets_.front().arrival_us < target_ms * 1000LL) {
+            return kWait;
+        }
+        playing_ = true;
+    }
+
+    auto& front = packets_.front();
+    uint32_t timestamp = front.packet->timestamp;
+    if (timestamp != 0 && has_expected_timestamp_ && timestamp != expected_timestamp_) {
+        int32_t gap_ms = timestamp - expected_timestamp_;
+        if (gap_ms >= max_delay_ms_) {
+            /* Too much is missing (or the stream restarted), resync on this packet */
+            has_expected_timestamp_ = false;
+        } else {
+            expected_timestamp_ += frame_duration_ms_;
+            stable_frames_ = 0;
+            /* Opus in-band FEC of a frame is carried by the packet right after it */
+            if (gap_ms <= frame_duration_ms_) {
+                next = front.packet.get();
+            }
+            return kConceal;
+        }
+    }
+
+    packet = std::move(front.packet);
+    packets_.pop_front();
+    if (timestamp != 0) {
+        expected_timestamp_ = timestamp + (packet->frame_duration > 0 ? packet->frame_duration : frame_duration_ms_);
+        has_expected_timestamp_ = true;
+    }
+    if (underrun_bonus_ms_ > 0 && ++stable_frames_ >= JITTER_BUFFER_STABLE_FRAMES) {
+        underrun_bonus_ms_ = std::max(underrun_bonus_ms_ - frame_duration_ms_, 0);
+        stable_frames_ = 0;
+    }
+    return kDecode;
+}
+
+int JitterBuffer::WaitTimeMs(int64_t now_us) const {
+    if (packets_.empty() || playing_) {
+        return -1;
+    }
+    int64_t waited_ms = (now_us - packets_.front().arrival_us) / 1000;
+    return std::max<int64_t>(target_delay_ms() - waited_ms, 1);
+}
+
+int JitterBuffer::target_delay_ms() const {
+    int delay_ms = frame_duration_ms_ + 3 * jitter_ms() + underrun_bonus_ms_;
+    return std::clamp(delay_ms, min_delay_ms_, max_delay_ms_);
+}
+
+int JitterBuffer::BufferedMs() const {
+    int duration_ms = 0;
+    for (auto& entry : packets_) {
+        duration_ms += entry.packet->frame_duration > 0 ? entry.packet->frame_duration : frame_duration_ms_;
+    }
+    return duration_ms;
+}
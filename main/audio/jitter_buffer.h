@@ -0,0 +1,91 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <deque>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "protocol.h"
+
+/*
+ * Adaptive jitter buffer in front of the Opus decoder.
+ *
+ * - Packets with a timestamp are kept ordered by AudioStreamPacket::timestamp and late
+ *   packets are dropped. Packets without a timestamp (protocol v1/v3, local prompts) are
+ *   played in arrival order.
+ * - The playout delay follows the RFC 3550 interarrival jitter estimate, plus an extra
+ *   frame every time a real underrun is seen (decaying again after a stable period).
+ * - A gap in the timestamps is reported as kConceal, so the decoder can recover the
+ *   missing frame with Opus FEC (using the next packet) or PLC instead of stalling.
+ *
+ * Not thread-safe: only the decoder task touches it.
+ */
+class JitterBuffer {
+public:
+    enum Action {
+        kWait,      // nothing to play yet
+        kDecode,    // decode the returned packet
+        kConceal,   // one frame is missing, conceal it (FEC data is available if `next` is set)
+    };
+
+    using Release = std::function<void(std::unique_ptr<AudioStreamPacket>&&)>;
+
+    JitterBuffer(int min_delay_ms, int max_delay_ms, size_t max_packets);
+
+    // Takes effect with the next target delay, the buffered packets are kept
+    void SetDelayRange(int min_delay_ms, int max_delay_ms);
+
+    // Hand all packets to `release` and restart buffering, the learned delay is kept
+    void Reset(const Release& release);
+
+    // Takes ownership of the packet on success; returns false (packet untouched) if full, late or duplicated
+    bool Push(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_us);
+
+    // `packet` is set for kDecode; for kConceal `next` points at the packet following the gap (or nullptr)
+    Action Next(int64_t now_us, std::unique_ptr<AudioStreamPacket>& packet, const AudioStreamPacket*& next);
+
+    // How long the decoder may sleep before calling Next() again, -1 means until it is notified
+    int WaitTimeMs(int64_t now_us) const;
+
+    inline bool full() const { return packets_.size() >= max_packets_; }
+    inline size_t size() const { return packets_.size(); }
+    inline int jitter_ms() const { return jitter_us_ / 1000; }
+    int target_delay_ms() const;
+    inline uint32_t late_count() const { return late_count_; }
+    inline uint32_t underrun_count() const { return underrun_count_; }
+
+private:
+    struct Entry {
+        std::unique_ptr<AudioStreamPacket> packet;
+        int64_t arrival_us;
+    };
+
+    int min_delay_ms_;
+    int max_delay_ms_;
+    const size_t max_packets_;
+    std::deque<Entry> packets_;
+
+    bool playing_ = false;
+    bool has_expected_timestamp_ = false;
+    uint32_t expected_timestamp_ = 0;
+    int frame_duration_ms_ = 60;
+
+    // Jitter estimate (microseconds)
+    bool has_transit_ = false;
+    int64_t last_transit_us_ = 0;
+    int64_t jitter_us_ = 0;
+
+    // Underrun tracking
+    bool underrun_pending_ = false;
+    int64_t underrun_start_us_ = 0;
+    int underrun_bonus_ms_ = 0;
+    int stable_frames_ = 0;
+
+    uint32_t late_count_ = 0;
+    uint32_t underrun_count_ = 0;
+
+    int BufferedMs() const;
+};
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,129 @@
+#include "latency_benchmark.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cJSON.h>
+
+#define MARKER_MS 20
+#define MARKER_F0 1000.0
+#define MARKER_F1 4000.0
+#define MARKER_MIN_SCORE 0.3f
+
+void LatencyBenchmark::MakeMarker(std::vector<int16_t>& pcm, int sample_rate) {
+    size_t samples = sample_rate / 1000 * MARKER_MS;
+    double duration = (double)samples / sample_rate;
+    for (size_t i = 0; i < samples; i++) {
+        // Linear sweep, with a Hann window against clicks
+        double t = (double)i / sample_rate;
+        double phase = 2 * M_PI * (MARKER_F0 * t + (MARKER_F1 - MARKER_F0) / (2 * duration) * t * t);
+        double window = 0.5 - 0.5 * std::cos(2 * M_PI * i / (samples - 1));
+        pcm.push_back((int16_t)(8192 * window * std::sin(phase)));
+    }
+}
+
+bool LatencyBenchmark::FindMarker(const std::vector<int16_t>& mic, int sample_rate, size_t& offset, float& score) {
+    std::vector<int16_t> marker;
+    MakeMarker(marker, sample_rate);
+    size_t length = marker.size();
+    if (mic.size() < length) {
+        return false;
+    }
+    double marker_energy = 0;
+    for (auto sample : marker) {
+        marker_energy += (double)sample * sample;
+    }
+
+    // Normalized by the energy of the window under the marker, kept as a running sum
+    double window_energy = 0;
+    for (size_t i = 0; i < length; i++) {
+        window_energy += (double)mic[i] * mic[i];
+    }
+    float best = 0;
+    size_t best_offset = 0;
+    for (size_t lag = 0; lag + length <= mic.size(); lag++) {
+        if (lag > 0) {
+            window_energy += (double)mic[lag + length - 1] * mic[lag + length - 1] - (double)mic[lag - 1] * mic[lag - 1];
+        }
+        if (window_energy <= 0) {
+            continue;
+        }
+        float sum = 0;
+        for (size_t i = 0; i < length; i++) {
+            sum += (float)marker[i] * mic[lag + i];
+        }
+        float normalized = std::fabs(sum) / std::sqrt(marker_energy * window_energy);
+        if (normalized > best) {
+            best = normalized;
+            best_offset = lag;
+        }
+    }
+    offset = best_offset;
+    score = best;
+    return best >= MARKER_MIN_SCORE;
+}
+
+static cJSON* StageJson(const std::vector<int64_t>& values) {
+    cJSON* stage = cJSON_CreateObject();
+    int64_t min = INT64_MAX, max = INT64_MIN, sum = 0;
+    for (auto value : values) {
+        min = std::min(min, value);
+        max = std::max(max, value);
+        sum += value;
+    }
+    cJSON_AddNumberToObject(stage, "mean_us", sum / (int64_t)values.size());
+    cJSON_AddNumberToObject(stage, "min_us", min);
+    cJSON_AddNumberToObject(stage, "max_us", max);
+    return stage;
+}
+
+std::string LatencyBenchmark::GetJson(const std::vector<Round>& rounds, int input_sample_rate, int output_sample_rate) {
+    std::vector<int64_t> queue, output_dma, acoustic, input_dma, round_trip;
+    for (const auto& round : rounds) {
+        if (!round.found) {
+            continue;
+        }
+        queue.push_back(round.output_us - round.queued_us);
+        output_dma.push_back(round.render_us - round.output_us);
+        acoustic.push_back(round.heard_us - round.render_us);
+        input_dma.push_back(round.seen_us - round.heard_us);
+        round_trip.push_back(round.seen_us - round.queued_us);
+    }
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "rounds", rounds.size());
+    cJSON_AddNumberToObject(root, "found", round_trip.size());
+    cJSON_AddNumberToObject(root, "input_sample_rate", input_sample_rate);
+    cJSON_AddNumberToObject(root, "output_sample_rate", output_sample_rate);
+    if (!round_trip.empty()) {
+        cJSON* total = StageJson(round_trip);
+        double mean = 0, variance = 0;
+        for (auto value : round_trip) {
+            mean += value;
+        }
+        mean /= round_trip.size();
+        for (auto value : round_trip) {
+            variance += (value - mean) * (value - mean);
+        }
+        cJSON_AddNumberToObject(total, "jitter_us", (int64_t)std::sqrt(variance / round_trip.size()));
+        cJSON_AddItemToObject(root, "round_trip", total);
+
+        cJSON* stages = cJSON_CreateObject();
+        cJSON_AddItemToObject(stages, "queue", StageJson(queue));
+        cJSON_AddItemToObject(stages, "output_dma", StageJson(output_dma));
+        cJSON_AddItemToObject(stages, "acoustic", StageJson(acoustic));
+        cJSON_AddItemToObject(stages, "input_dma", StageJson(input_dma));
+        cJSON_AddItemToObject(root, "stages", stages);
+    }
+    cJSON* scores = cJSON_CreateArray();
+    for (const auto& round : rounds) {
+        cJSON_AddItemToArray(scores, cJSON_CreateNumber(std::round(round.score * 100) / 100));
+    }
+    cJSON_AddItemToObject(root, "scores", scores);
+
+    char* str = cJSON_PrintUnformatted(root);
+    std::string json(str);
+    cJSON_free(str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,42 @@
+#ifndef LATENCY_BENCHMARK_H
+#define LATENCY_BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Speaker to microphone round trip of the audio pipeline.
+ *
+ * AudioService has the decoder task queue a short marker sweep for playback and records the
+ * microphone meanwhile, reading one I2S DMA descriptor at a time so every read returns as
+ * the descriptor completes. The marker is found in the recording with a matched filter. Each
+ * round is split at the points the pipeline knows:
+ *
+ *   queued    the decoder task pushed the marker to the playback queue
+ *   output    the output task hands it to AudioCodec::OutputData  (queue: playback queue, mixing)
+ *   render    its first sample leaves the DAC, from the playback clock  (output_dma: I2S TX DMA)
+ *   heard     the ADC sampled its echo  (acoustic: DAC, speaker, air, microphone, ADC)
+ *   seen      the read holding that sample returned  (input_dma: I2S RX DMA)
+ */
+class LatencyBenchmark {
+public:
+    struct Round {
+        int64_t queued_us = 0;
+        int64_t output_us = 0;
+        int64_t render_us = 0;
+        int64_t heard_us = 0;
+        int64_t seen_us = 0;
+        float score = 0;
+        bool found = false;
+    };
+
+    // Appends the marker, a 20 ms sweep from 1 to 4 kHz at -12 dBFS
+    static void MakeMarker(std::vector<int16_t>& pcm, int sample_rate);
+    // Sample offset of the marker in the mono recording, false if the peak score is too low
+    static bool FindMarker(const std::vector<int16_t>& mic, int sample_rate, size_t& offset, float& score);
+    // Mean, min and max of every stage and the round trip with its jitter, over the found rounds
+    static std::string GetJson(const std::vector<Round>& rounds, int input_sample_rate, int output_sample_rate);
+};
+
+#endif // LATENCY_BENCHMARK_H
@@ -0,0 +1,88 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+
+/*
+ * Keeps the most recent capacity samples of PCM in one buffer, allocated on the first Write()
+ * (PSRAM when available). Older samples are overwritten, so writing never allocates.
+ *
+ * Write() and Read() may run on different tasks.
+ */
+class PcmRing {
+public:
+    explicit PcmRing(size_t capacity) : capacity_(capacity) {}
+    PcmRing(const PcmRing&) = delete;
+    PcmRing& operator=(const PcmRing&) = delete;
+    ~PcmRing() { heap_caps_free(buffer_); }
+
+    void Write(const int16_t* data, size_t samples) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffer_ == nullptr && !Allocate()) {
+            return;
+        }
+        // Only the newest capacity samples survive
+        if (samples > capacity_) {
+            data += samples - capacity_;
+            samples = capacity_;
+        }
+        size_t tail = (head_ + size_) % capacity_;
+        size_t first = std::min(samples, capacity_ - tail);
+        memcpy(buffer_ + tail, data, first * sizeof(int16_t));
+        memcpy(buffer_, data + first, (samples - first) * sizeof(int16_t));
+        size_ += samples;
+        if (size_ > capacity_) {
+            head_ = (head_ + size_ - capacity_) % capacity_;
+            size_ = capacity_;
+        }
+    }
+
+    // Moves up to samples of the oldest PCM out, returns how many
+    size_t Read(int16_t* out, size_t samples) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples = std::min(samples, size_);
+        if (samples == 0) {
+            return 0;
+        }
+        size_t first = std::min(samples, capacity_ - head_);
+        memcpy(out, buffer_ + head_, first * sizeof(int16_t));
+        memcpy(out + first, buffer_, (samples - first) * sizeof(int16_t));
+        head_ = (head_ + samples) % capacity_;
+        size_ -= samples;
+        return samples;
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        head_ = 0;
+        size_ = 0;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return size_;
+    }
+
+private:
+    const size_t capacity_;
+    int16_t* buffer_ = nullptr;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    std::mutex mutex_;
+
+    bool Allocate() {
+        buffer_ = (int16_t*)heap_caps_malloc(capacity_ * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buffer_ == nullptr) {
+            buffer_ = (int16_t*)heap_caps_malloc(capacity_ * sizeof(int16_t), MALLOC_CAP_8BIT);
+        }
+        return buffer_ != nullptr;
+    }
+};
+
+#endif // PCM_RING_H
@@ -1,7 +1,25 @@
 #include "afe_audio_processor.h"
+#include "memory_budget.h"
+#include "task_manifest.h"
+#include "audio_hot.h"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <algorithm>
 
 #define PROCESSOR_RUNNING 0x01
+#define PROCESSOR_RELEASE 0x02
+
+// Lets the task come back from a fetch that no feed will complete, e.g. to rebuild the AFE
+#define AFE_FETCH_TIMEOUT_MS 100
+// A session whose feed ring ran fuller than this fell behind, the next one runs low cost
+#define AFE_OVERRUN_FREE_PCT 0.25f
+// Low cost sessions that kept the ring this free before high performance is tried again
+#define AFE_HEADROOM_FREE_PCT 0.75f
+#define AFE_RECOVER_SESSIONS 5
+// Sessions shorter than this many fetches say nothing about the load
+#define AFE_MIN_SESSION_FETCHES 50
 
 #define TAG "AfeAudioProcessor"
 
@@ -34,20 +52,37 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
         models = models_list;
     }
 
-    char* ns_model_name = esp_srmodel_filter(models, ESP_NSNET_PREFIX, NULL);
-    char* vad_model_name = esp_srmodel_filter(models, ESP_VADN_PREFIX, NULL);
-    
-    afe_config_t* afe_config = afe_config_init(input_format.c_str(), NULL, AFE_TYPE_VC, AFE_MODE_HIGH_PERF);
-    afe_config->aec_mode = AEC_MODE_VOIP_HIGH_PERF;
+    ns_model_name_ = esp_srmodel_filter(models, ESP_NSNET_PREFIX, NULL);
+    vad_model_name_ = esp_srmodel_filter(models, ESP_VADN_PREFIX, NULL);
+    input_format_ = input_format;
+    CreateAfe();
+
+    TaskManifest::Create("audio_communication", [](void* arg) {
+        auto this_ = (AfeAudioProcessor*)arg;
+        this_->AudioProcessorTask();
+        TaskManifest::Exit();
+    }, this);
+}
+
+// The AFE mode is fixed at creation, so a profile change builds a new instance
+void AfeAudioProcessor::CreateAfe() {
+    bool low_cost = profile_ == kProfileLowCost;
+    afe_config_t* afe_config = afe_config_init(input_format_.c_str(), NULL, AFE_TYPE_VC,
+        low_cost ? AFE_MODE_LOW_COST : AFE_MODE_HIGH_PERF);
+    afe_config->aec_mode = low_cost ? AEC_MODE_VOIP_LOW_COST : AEC_MODE_VOIP_HIGH_PERF;
     afe_config->vad_mode = VAD_MODE_0;
     afe_config->vad_min_noise_ms = 100;
-    if (vad_model_name != nullptr) {
-        afe_config->vad_model_name = vad_model_name;
+    if (vad_model_name_ != nullptr) {
+        afe_config->vad_model_name = vad_model_name_;
     }
 
-    if (ns_model_name != nullptr) {
+    if (low_cost) {
+        // WebRTC NS costs a fraction of the neural one
         afe_config->ns_init = true;
-        afe_config->ns_model_name = ns_model_name;
+        afe_config->afe_ns_mode = AFE_NS_MODE_WEBRTC;
+    } else if (ns_model_name_ != nullptr) {
+        afe_config->ns_init = true;
+        afe_config->ns_model_name = ns_model_name_;
         afe_config->afe_ns_mode = AFE_NS_MODE_NET;
     } else {
         afe_config->ns_init = false;
@@ -66,12 +101,7 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
 
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
-    
-    xTaskCreate([](void* arg) {
-        auto this_ = (AfeAudioProcessor*)arg;
-        this_->AudioProcessorTask();
-        vTaskDelete(NULL);
-    }, "audio_communication", 4096, this, 3, NULL);
+    afe_config_free(afe_config);
 }
 
 AfeAudioProcessor::~AfeAudioProcessor() {
@@ -88,28 +118,141 @@ size_t AfeAudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_);
 }
 
-void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
-    if (afe_data_ == nullptr) {
-        return;
-    }
-
+void AUDIO_HOT AfeAudioProcessor::Feed(const std::vector<int16_t>& data) {
     std::lock_guard<std::mutex> lock(input_buffer_mutex_);
-    // Check running state inside lock to avoid TOCTOU race with Stop()
-    if (!IsRunning()) {
+    // Check running state inside lock to avoid TOCTOU race with Stop() and Release()
+    if (!IsRunning() || afe_data_ == nullptr) {
         return;
     }
-    input_buffer_.insert(input_buffer_.end(), data.begin(), data.end());
     size_t chunk_size = afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
-    while (input_buffer_.size() >= chunk_size) {
+    const int16_t* src = data.data();
+    size_t left = data.size();
+    // Complete a partial chunk from the last feed first
+    if (!input_buffer_.empty()) {
+        size_t n = std::min(left, chunk_size - input_buffer_.size());
+        input_buffer_.insert(input_buffer_.end(), src, src + n);
+        src += n;
+        left -= n;
+        if (input_buffer_.size() < chunk_size) {
+            return;
+        }
         afe_iface_->feed(afe_data_, input_buffer_.data());
-        input_buffer_.erase(input_buffer_.begin(), input_buffer_.begin() + chunk_size);
+        input_buffer_.clear();
+    }
+    // Whole chunks go to the AFE straight from the caller's buffer
+    while (left >= chunk_size) {
+        afe_iface_->feed(afe_data_, src);
+        src += chunk_size;
+        left -= chunk_size;
     }
+    input_buffer_.insert(input_buffer_.end(), src, src + left);
 }
 
 void AfeAudioProcessor::Start() {
+#if CONFIG_AFE_ADAPTIVE_MODE
+    ChooseProfile();
+#endif
+    session_fetches_ = 0;
+    session_min_free_ = 1.0f;
+    session_free_sum_ = 0;
+
+    // Set under the lock, so a release still pending on the task sees the processor running
+    std::lock_guard<std::mutex> lock(input_buffer_mutex_);
+    if (afe_data_ == nullptr) {
+        int64_t start_us = esp_timer_get_time();
+        size_t free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+        if (free < released_bytes_) {
+            MemoryBudget::GetInstance().Evict(MALLOC_CAP_SPIRAM, released_bytes_ - free);
+        }
+        profile_ = pending_profile_;
+        CreateAfe();
+        RestoreDeviceAec();
+        ESP_LOGI(TAG, "AFE rebuilt in %ld ms", (long)((esp_timer_get_time() - start_us) / 1000));
+    }
+    xEventGroupClearBits(event_group_, PROCESSOR_RELEASE);
     xEventGroupSetBits(event_group_, PROCESSOR_RUNNING);
 }
 
+bool AfeAudioProcessor::Release() {
+    std::lock_guard<std::mutex> lock(input_buffer_mutex_);
+    if (afe_data_ == nullptr || IsRunning()) {
+        return false;
+    }
+    // The task may still be in a fetch, it destroys the instance itself
+    xEventGroupSetBits(event_group_, PROCESSOR_RELEASE);
+    return true;
+}
+
+// Runs on the processor task
+void AfeAudioProcessor::DestroyAfe() {
+    std::lock_guard<std::mutex> lock(input_buffer_mutex_);
+    if (afe_data_ == nullptr || IsRunning()) {
+        return;
+    }
+    size_t free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    afe_iface_->destroy(afe_data_);
+    afe_data_ = nullptr;
+    input_buffer_.clear();
+    output_buffer_.clear();
+    is_speaking_ = false;
+    // Other tasks allocate meanwhile, the difference is an estimate
+    size_t after = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    released_bytes_ = after > free ? after - free : 0;
+    ESP_LOGI(TAG, "AFE released, %u bytes of PSRAM", (unsigned)released_bytes_);
+}
+
+/*
+ * Picks the profile of the next session from the last one. The AFE runs in the fetching task,
+ * so when it cannot keep up the feed ring fills, ringbuff_free_pct is the slack of the fetch loop.
+ */
+void AfeAudioProcessor::ChooseProfile() {
+    if (session_fetches_ < AFE_MIN_SESSION_FETCHES) {
+        return;
+    }
+    Profile wanted = profile_;
+    if (profile_ == kProfileHighPerf) {
+        if (session_min_free_ < AFE_OVERRUN_FREE_PCT) {
+            wanted = kProfileLowCost;
+        }
+    } else if (session_min_free_ > AFE_HEADROOM_FREE_PCT) {
+        if (++healthy_sessions_ >= AFE_RECOVER_SESSIONS) {
+            wanted = kProfileHighPerf;
+        }
+    } else {
+        healthy_sessions_ = 0;
+    }
+    if (wanted != profile_) {
+        ESP_LOGW(TAG, "Feed ring min free %.0f%% (avg %.0f%%), switching to %s", session_min_free_ * 100,
+            session_free_sum_ / session_fetches_ * 100, wanted == kProfileLowCost ? "low cost" : "high performance");
+        healthy_sessions_ = 0;
+        pending_profile_ = wanted;
+    }
+}
+
+// Runs on the processor task, so no fetch is in flight
+void AfeAudioProcessor::ApplyPendingProfile() {
+    std::lock_guard<std::mutex> lock(input_buffer_mutex_);
+    profile_ = pending_profile_;
+    afe_iface_->destroy(afe_data_);
+    CreateAfe();
+    input_buffer_.clear();
+    RestoreDeviceAec();
+}
+
+void AfeAudioProcessor::RestoreDeviceAec() {
+#if CONFIG_USE_DEVICE_AEC
+    // A new instance starts with the AEC on
+    if (!device_aec_enabled_) {
+        afe_iface_->disable_aec(afe_data_);
+        afe_iface_->enable_vad(afe_data_);
+    }
+#endif
+}
+
+const char* AfeAudioProcessor::GetModeName() {
+    return profile_ == kProfileLowCost ? "low_cost" : "high_perf";
+}
+
 void AfeAudioProcessor::Stop() {
     xEventGroupClearBits(event_group_, PROCESSOR_RUNNING);
 
@@ -132,6 +275,10 @@ void AfeAudioProcessor::OnVadStateChange(std::function<void(bool speaking)> call
     vad_state_change_callback_ = callback;
 }
 
+void AfeAudioProcessor::OnEndOfUtterance(std::function<void()> callback) {
+    end_of_utterance_callback_ = callback;
+}
+
 void AfeAudioProcessor::AudioProcessorTask() {
     auto fetch_size = afe_iface_->get_fetch_chunksize(afe_data_);
     auto feed_size = afe_iface_->get_feed_chunksize(afe_data_);
@@ -139,9 +286,18 @@ void AfeAudioProcessor::AudioProcessorTask() {
         feed_size, fetch_size);
 
     while (true) {
-        xEventGroupWaitBits(event_group_, PROCESSOR_RUNNING, pdFALSE, pdTRUE, portMAX_DELAY);
+        auto bits = xEventGroupWaitBits(event_group_, PROCESSOR_RUNNING | PROCESSOR_RELEASE, pdFALSE, pdFALSE,
+            portMAX_DELAY);
+        if (bits & PROCESSOR_RELEASE) {
+            xEventGroupClearBits(event_group_, PROCESSOR_RELEASE);
+            DestroyAfe();
+            continue;
+        }
+        if (pending_profile_ != profile_) {
+            ApplyPendingProfile();
+        }
 
-        auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
+        auto res = afe_iface_->fetch_with_delay(afe_data_, pdMS_TO_TICKS(AFE_FETCH_TIMEOUT_MS));
         if ((xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING) == 0) {
             continue;
         }
@@ -151,14 +307,19 @@ void AfeAudioProcessor::AudioProcessorTask() {
             }
             continue;
         }
+        session_fetches_++;
+        session_free_sum_ += res->ringbuff_free_pct;
+        session_min_free_ = std::min(session_min_free_, res->ringbuff_free_pct);
 
         // VAD state change
+        bool speech_ended = false;
         if (vad_state_change_callback_) {
             if (res->vad_state == VAD_SPEECH && !is_speaking_) {
                 is_speaking_ = true;
                 vad_state_change_callback_(true);
             } else if (res->vad_state == VAD_SILENCE && is_speaking_) {
                 is_speaking_ = false;
+                speech_ended = true;
                 vad_state_change_callback_(false);
             }
         }
@@ -182,11 +343,29 @@ void AfeAudioProcessor::AudioProcessorTask() {
                     output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
                 }
             }
+
+            // Don't hold the tail of the utterance back until a full frame collects
+            if (speech_ended) {
+                if (!output_buffer_.empty()) {
+                    output_callback_(std::move(output_buffer_));
+                    output_buffer_.clear();
+                    output_buffer_.reserve(frame_samples_);
+                }
+                if (end_of_utterance_callback_) {
+                    end_of_utterance_callback_();
+                }
+            }
         }
     }
 }
 
 void AfeAudioProcessor::EnableDeviceAec(bool enable) {
+    // Kept for the AFE rebuilt on a profile change
+    std::lock_guard<std::mutex> lock(input_buffer_mutex_);
+    device_aec_enabled_ = enable;
+    if (afe_data_ == nullptr) {
+        return;
+    }
     if (enable) {
 #if CONFIG_USE_DEVICE_AEC
         afe_iface_->disable_vad(afe_data_);
@@ -10,6 +10,7 @@
 #include <vector>
 #include <functional>
 #include <mutex>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
@@ -20,29 +21,61 @@ public:
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
-    void Feed(std::vector<int16_t>&& data) override;
+    void Feed(const std::vector<int16_t>& data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
     void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
+    void OnEndOfUtterance(std::function<void()> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
+    const char* GetModeName() override;
+    bool Release() override;
 
 private:
+    enum Profile {
+        kProfileHighPerf,
+        kProfileLowCost,
+    };
+
     EventGroupHandle_t event_group_ = nullptr;
     const esp_afe_sr_iface_t* afe_iface_ = nullptr;
     esp_afe_sr_data_t* afe_data_ = nullptr;
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
+    std::function<void()> end_of_utterance_callback_;
     AudioCodec* codec_ = nullptr;
     int frame_samples_ = 0;
     bool is_speaking_ = false;
     std::vector<int16_t> input_buffer_;
     std::mutex input_buffer_mutex_;
     std::vector<int16_t> output_buffer_;
+    std::string input_format_;
+    char* ns_model_name_ = nullptr;
+    char* vad_model_name_ = nullptr;
+#if CONFIG_USE_DEVICE_AEC
+    bool device_aec_enabled_ = true;
+#else
+    bool device_aec_enabled_ = false;
+#endif
+
+    // Chosen at the start of a session from the feed ring slack of the last one
+    Profile profile_ = kProfileHighPerf;
+    std::atomic<Profile> pending_profile_ = kProfileHighPerf;
+    int healthy_sessions_ = 0;
+    int session_fetches_ = 0;
+    float session_min_free_ = 1.0f;
+    float session_free_sum_ = 0;
+    // PSRAM the released instance gave back, made available again before it is rebuilt
+    size_t released_bytes_ = 0;
 
     void AudioProcessorTask();
+    void CreateAfe();
+    void DestroyAfe();
+    void RestoreDeviceAec();
+    void ChooseProfile();
+    void ApplyPendingProfile();
 };
 
 #endif 
\ No newline at end of file
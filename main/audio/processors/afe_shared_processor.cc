@@ -0,0 +1,107 @@
+#include "afe_shared_processor.h"
+#include "audio_hot.h"
+#include <esp_log.h>
+
+#define TAG "AfeSharedProcessor"
+
+AfeSharedProcessor::AfeSharedProcessor(AfeWakeWord* wake_word) : wake_word_(wake_word) {
+    wake_word_->OnProcessedAudio([this](afe_fetch_result_t* res) {
+        OnProcessedAudio(res);
+    });
+}
+
+void AfeSharedProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+    output_buffer_.reserve(frame_samples_);
+    if (!wake_word_->Initialize(codec, models_list)) {
+        ESP_LOGE(TAG, "Failed to initialize the shared AFE");
+    }
+}
+
+// AudioService feeds the shared AFE once per chunk through the wake word, this is only for other callers
+void AUDIO_HOT AfeSharedProcessor::Feed(const std::vector<int16_t>& data) {
+    wake_word_->Feed(data);
+}
+
+void AfeSharedProcessor::Start() {
+    is_speaking_ = false;
+    output_buffer_.clear();
+    wake_word_->StartProcessing();
+}
+
+void AfeSharedProcessor::Stop() {
+    wake_word_->StopProcessing();
+}
+
+bool AfeSharedProcessor::IsRunning() {
+    return wake_word_->IsProcessing();
+}
+
+void AfeSharedProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+    output_callback_ = callback;
+}
+
+void AfeSharedProcessor::OnVadStateChange(std::function<void(bool speaking)> callback) {
+    vad_state_change_callback_ = callback;
+}
+
+void AfeSharedProcessor::OnEndOfUtterance(std::function<void()> callback) {
+    end_of_utterance_callback_ = callback;
+}
+
+size_t AfeSharedProcessor::GetFeedSize() {
+    return wake_word_->GetFeedSize();
+}
+
+void AfeSharedProcessor::EnableDeviceAec(bool enable) {
+#if CONFIG_USE_DEVICE_AEC
+    wake_word_->EnableAec(enable);
+#else
+    if (enable) {
+        ESP_LOGE(TAG, "Device AEC is not supported");
+    }
+#endif
+}
+
+// Runs on the wake word's detection task
+void AfeSharedProcessor::OnProcessedAudio(afe_fetch_result_t* res) {
+    bool speech_ended = false;
+    if (vad_state_change_callback_) {
+        if (res->vad_state == VAD_SPEECH && !is_speaking_) {
+            is_speaking_ = true;
+            vad_state_change_callback_(true);
+        } else if (res->vad_state == VAD_SILENCE && is_speaking_) {
+            is_speaking_ = false;
+            speech_ended = true;
+            vad_state_change_callback_(false);
+        }
+    }
+
+    if (!output_callback_) {
+        return;
+    }
+    size_t samples = res->data_size / sizeof(int16_t);
+    output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
+    while (output_buffer_.size() >= frame_samples_) {
+        if (output_buffer_.size() == frame_samples_) {
+            output_callback_(std::move(output_buffer_));
+            output_buffer_.clear();
+            output_buffer_.reserve(frame_samples_);
+        } else {
+            output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
+            output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
+        }
+    }
+
+    // Don't hold the tail of the utterance back until a full frame collects
+    if (speech_ended) {
+        if (!output_buffer_.empty()) {
+            output_callback_(std::move(output_buffer_));
+            output_buffer_.clear();
+            output_buffer_.reserve(frame_samples_);
+        }
+        if (end_of_utterance_callback_) {
+            end_of_utterance_callback_();
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef AFE_SHARED_PROCESSOR_H
+#define AFE_SHARED_PROCESSOR_H
+
+#include <esp_afe_sr_models.h>
+
+#include <functional>
+#include <vector>
+
+#include "audio_processor.h"
+#include "audio_codec.h"
+#include "wake_words/afe_wake_word.h"
+
+/*
+ * The audio processor of CONFIG_USE_SHARED_AFE: the uplink audio comes out of the wake word's
+ * AFE instead of a second one, so the models are loaded once and the AEC keeps adapting while
+ * the device switches between waiting, listening and speaking.
+ */
+class AfeSharedProcessor : public AudioProcessor {
+public:
+    explicit AfeSharedProcessor(AfeWakeWord* wake_word);
+
+    void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
+    void Feed(const std::vector<int16_t>& data) override;
+    void Start() override;
+    void Stop() override;
+    bool IsRunning() override;
+    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    void OnVadStateChange(std::function<void(bool speaking)> callback) override;
+    void OnEndOfUtterance(std::function<void()> callback) override;
+    size_t GetFeedSize() override;
+    void EnableDeviceAec(bool enable) override;
+
+private:
+    AfeWakeWord* wake_word_;
+    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::function<void(bool speaking)> vad_state_change_callback_;
+    std::function<void()> end_of_utterance_callback_;
+    int frame_samples_ = 0;
+    bool is_speaking_ = false;
+    std::vector<int16_t> output_buffer_;
+
+    void OnProcessedAudio(afe_fetch_result_t* res);
+};
+
+#endif
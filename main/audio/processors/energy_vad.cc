@@ -0,0 +1,77 @@
+#include "energy_vad.h"
+
+#include <algorithm>
+
+// Below about -60 dBFS nothing is speech, however quiet the room
+#define ENERGY_VAD_MIN_LEVEL (32 << 4)
+// Level over the floor, in eighths: strong speech at about +10 dB, weak at +4 dB
+#define ENERGY_VAD_STRONG_RATIO 26
+#define ENERGY_VAD_WEAK_RATIO 13
+// Fraction of samples crossing zero in 256ths, about 3 kHz and up at 16 kHz
+#define ENERGY_VAD_FRICATIVE_ZCR 96
+
+EnergyVad::EnergyVad(int hangover_ms) : hangover_ms_(hangover_ms) {
+}
+
+void EnergyVad::Reset() {
+    noise_floor_ = 0;
+    speech_ms_ = 0;
+    silence_ms_ = 0;
+    speaking_ = false;
+}
+
+bool EnergyVad::Process(const int16_t* samples, size_t count, int sample_rate) {
+    if (count == 0) {
+        return speaking_;
+    }
+    int32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    int32_t mean = sum / (int32_t)count;
+
+    int32_t abs_sum = 0;
+    int crossings = 0;
+    bool negative = samples[0] < mean;
+    for (size_t i = 0; i < count; i++) {
+        int32_t x = samples[i] - mean;
+        abs_sum += x < 0 ? -x : x;
+        if ((x < 0) != negative) {
+            negative = x < 0;
+            crossings++;
+        }
+    }
+    int32_t level = (abs_sum << 4) / (int32_t)count;
+    int zcr = crossings * 256 / (int)count;
+    int frame_ms = count * 1000 / sample_rate;
+
+    if (noise_floor_ == 0) {
+        noise_floor_ = std::max(level, 1);
+    }
+    int32_t floor = std::max(noise_floor_, (int32_t)ENERGY_VAD_MIN_LEVEL);
+    bool speech = level * 8 > floor * ENERGY_VAD_STRONG_RATIO ||
+        (level * 8 > floor * ENERGY_VAD_WEAK_RATIO && zcr >= ENERGY_VAD_FRICATIVE_ZCR);
+
+    // Down within a few frames, up over seconds, and hardly at all while someone speaks
+    if (level < noise_floor_) {
+        noise_floor_ -= (noise_floor_ - level) >> 2;
+    } else {
+        noise_floor_ += (level - noise_floor_) >> (speech ? 10 : 6);
+    }
+    noise_floor_ = std::max(noise_floor_, (int32_t)1);
+
+    if (speech) {
+        silence_ms_ = 0;
+        speech_ms_ += frame_ms;
+        if (!speaking_ && speech_ms_ >= kOnsetMs) {
+            speaking_ = true;
+        }
+    } else {
+        speech_ms_ = 0;
+        silence_ms_ += frame_ms;
+        if (speaking_ && silence_ms_ >= hangover_ms_) {
+            speaking_ = false;
+        }
+    }
+    return speaking_;
+}
@@ -0,0 +1,41 @@
+#ifndef ENERGY_VAD_H
+#define ENERGY_VAD_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Voice activity from the frame level and zero-crossing rate, for boards without the AFE.
+ *
+ * - The level is the mean absolute amplitude around the frame's own mean (the DC offset of
+ *   the microphone is removed), integer only.
+ * - A noise floor follows the level, quickly downwards and slowly upwards, so steady noise
+ *   like a fan is learned within a few seconds and speech is not.
+ * - A frame is speech when it is well above the floor, or a little above it with a high
+ *   zero-crossing rate (unvoiced consonants such as "s" and "f" have little energy).
+ * - Speech starts after kOnsetMs of speech frames and ends after hangover_ms without any.
+ *
+ * Not thread-safe: only the feeding task calls Process().
+ */
+class EnergyVad {
+public:
+    explicit EnergyVad(int hangover_ms);
+
+    // Returns the speaking state after this mono frame
+    bool Process(const int16_t* samples, size_t count, int sample_rate);
+    void Reset();
+
+    bool speaking() const { return speaking_; }
+
+private:
+    static constexpr int kOnsetMs = 40;
+
+    int hangover_ms_;
+    // Mean absolute amplitude in Q4, 0 until the first frame
+    int32_t noise_floor_ = 0;
+    int speech_ms_ = 0;
+    int silence_ms_ = 0;
+    bool speaking_ = false;
+};
+
+#endif // ENERGY_VAD_H
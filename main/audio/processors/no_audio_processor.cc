@@ -1,4 +1,6 @@
 #include "no_audio_processor.h"
+#include "audio_dsp.h"
+#include "audio_hot.h"
 #include <esp_log.h>
 
 #define TAG "NoAudioProcessor"
@@ -8,29 +10,51 @@ void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmo
     frame_samples_ = frame_duration_ms * 16000 / 1000;
 }
 
-void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
+void AUDIO_HOT NoAudioProcessor::Feed(const std::vector<int16_t>& data) {
     if (!is_running_ || !output_callback_) {
         return;
     }
 
+    // The output goes to the encode queue, so it needs its own buffer
     if (codec_->input_channels() == 2) {
         // If input channels is 2, we need to fetch the left channel data
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
-        }
-        output_callback_(std::move(mono_data));
+        std::vector<int16_t> mono(data.size() / 2);
+        audio_dsp::ExtractChannel(mono.data(), data.data(), mono.size(), 2, 0);
+        UpdateVad(mono.data(), mono.size());
+        output_callback_(std::move(mono));
     } else {
-        output_callback_(std::move(data));
+        UpdateVad(data.data(), data.size());
+        output_callback_(std::vector<int16_t>(data));
     }
 }
 
+// Reports the change before the frame is output, an ended utterance after its last frame
+void NoAudioProcessor::UpdateVad(const int16_t* samples, size_t count) {
+#if CONFIG_USE_ENERGY_VAD
+    bool was_speaking = vad_.speaking();
+    bool speaking = vad_.Process(samples, count, 16000);
+    if (speaking == was_speaking) {
+        return;
+    }
+    if (vad_state_change_callback_) {
+        vad_state_change_callback_(speaking);
+    }
+    if (!speaking && end_of_utterance_callback_) {
+        end_of_utterance_callback_();
+    }
+#endif
+}
+
 void NoAudioProcessor::Start() {
     is_running_ = true;
 }
 
 void NoAudioProcessor::Stop() {
     is_running_ = false;
+#if CONFIG_USE_ENERGY_VAD
+    // The noise floor is learned again, the room may have changed until the next session
+    vad_.Reset();
+#endif
 }
 
 bool NoAudioProcessor::IsRunning() {
@@ -45,6 +69,10 @@ void NoAudioProcessor::OnVadStateChange(std::function<void(bool speaking)> callb
     vad_state_change_callback_ = callback;
 }
 
+void NoAudioProcessor::OnEndOfUtterance(std::function<void()> callback) {
+    end_of_utterance_callback_ = callback;
+}
+
 size_t NoAudioProcessor::GetFeedSize() {
     if (!codec_) {
         return 0;
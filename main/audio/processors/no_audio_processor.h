@@ -7,6 +7,9 @@
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#if CONFIG_USE_ENERGY_VAD
+#include "energy_vad.h"
+#endif
 
 class NoAudioProcessor : public AudioProcessor {
 public:
@@ -14,12 +17,13 @@ public:
     ~NoAudioProcessor() = default;
 
     void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
-    void Feed(std::vector<int16_t>&& data) override;
+    void Feed(const std::vector<int16_t>& data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
     void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
+    void OnEndOfUtterance(std::function<void()> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
 
@@ -28,7 +32,13 @@ private:
     int frame_samples_ = 0;
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
+    std::function<void()> end_of_utterance_callback_;
     std::atomic<bool> is_running_ = false;
+#if CONFIG_USE_ENERGY_VAD
+    EnergyVad vad_{CONFIG_ENERGY_VAD_HANGOVER_MS};
+#endif
+
+    void UpdateVad(const int16_t* samples, size_t count);
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "resampler.h"
+
+#include <esp_log.h>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "Resampler"
+
+// Windowed-sinc taps per polyphase branch, 48 taps for 2:1 and 72 for 3:1
+#define DECIMATOR_TAPS_PER_PHASE 24
+// Passband edge relative to the output Nyquist frequency
+#define DECIMATOR_CUTOFF 0.9
+
+#define RATE_CVT_CFG(_src_rate, _dest_rate, _channel)        \
+    (esp_ae_rate_cvt_cfg_t)                                  \
+    {                                                        \
+        .src_rate        = (uint32_t)(_src_rate),            \
+        .dest_rate       = (uint32_t)(_dest_rate),           \
+        .channel         = (uint8_t)(_channel),              \
+        .bits_per_sample = ESP_AUDIO_BIT16,                  \
+        .complexity      = 2,                                \
+        .perf_type       = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,  \
+    }
+
+Resampler::Resampler(int input_rate, int output_rate, int channels)
+    : input_rate_(input_rate), output_rate_(output_rate), channels_(channels) {
+    if (input_rate == output_rate) {
+        decimation_ = 1;
+    } else if (input_rate > output_rate && input_rate % output_rate == 0) {
+        InitDecimator(input_rate / output_rate);
+    } else {
+        esp_ae_rate_cvt_cfg_t cfg = RATE_CVT_CFG(input_rate, output_rate, channels);
+        auto ret = esp_ae_rate_cvt_open(&cfg, &rate_cvt_);
+        if (rate_cvt_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to create rate converter %d -> %d, error code: %d", input_rate, output_rate, ret);
+            return;
+        }
+    }
+    ESP_LOGI(TAG, "%d -> %d Hz, %d channel(s), %s", input_rate, output_rate, channels,
+        decimation_ == 1 ? "bypass" : decimation_ > 1 ? "integer decimator" : "esp_ae_rate_cvt");
+}
+
+Resampler::~Resampler() {
+    if (rate_cvt_ != nullptr) {
+        esp_ae_rate_cvt_close(rate_cvt_);
+    }
+}
+
+void Resampler::InitDecimator(int decimation) {
+    decimation_ = decimation;
+    taps_ = DECIMATOR_TAPS_PER_PHASE * decimation;
+
+    /* Blackman windowed sinc low pass, normalized to unity DC gain */
+    double cutoff = DECIMATOR_CUTOFF * 0.5 / decimation;
+    double center = (taps_ - 1) / 2.0;
+    std::vector<double> h(taps_);
+    double sum = 0;
+    for (int i = 0; i < taps_; i++) {
+        double x = i - center;
+        double sinc = x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        double window = 0.42 - 0.5 * cos(2 * M_PI * i / (taps_ - 1)) + 0.08 * cos(4 * M_PI * i / (taps_ - 1));
+        h[i] = sinc * window;
+        sum += h[i];
+    }
+    coefficients_.resize(taps_);
+    for (int i = 0; i < taps_; i++) {
+        coefficients_[i] = (int16_t)lround(h[i] / sum * 32768.0);
+    }
+    work_.assign((taps_ - 1) * channels_, 0);
+    phase_ = 0;
+}
+
+size_t Resampler::GetMaxOutputFrames(size_t in_frames) const {
+    if (decimation_ > 0) {
+        return in_frames / decimation_ + 1;
+    }
+    uint32_t out_frames = 0;
+    if (rate_cvt_ != nullptr) {
+        esp_ae_rate_cvt_get_max_out_sample_num(rate_cvt_, in_frames, &out_frames);
+    }
+    return out_frames;
+}
+
+size_t Resampler::Process(const int16_t* input, size_t in_frames, int16_t* output) {
+    if (decimation_ == 1) {
+        memcpy(output, input, in_frames * channels_ * sizeof(int16_t));
+        return in_frames;
+    } else if (decimation_ > 1) {
+        return Decimate(input, in_frames, output);
+    } else if (rate_cvt_ == nullptr) {
+        return 0;
+    }
+    uint32_t out_frames = GetMaxOutputFrames(in_frames);
+    esp_ae_rate_cvt_process(rate_cvt_, (esp_ae_sample_t)input, in_frames, (esp_ae_sample_t)output, &out_frames);
+    return out_frames;
+}
+
+void Resampler::Process(const std::vector<int16_t>& input, std::vector<int16_t>& output) {
+    size_t in_frames = input.size() / channels_;
+    output.resize(GetMaxOutputFrames(in_frames) * channels_);
+    output.resize(Process(input.data(), in_frames, output.data()) * channels_);
+}
+
+size_t Resampler::Decimate(const int16_t* input, size_t in_frames, int16_t* output) {
+    /* Append the input after the history, the vector only grows on the first frames */
+    size_t history = taps_ - 1;
+    work_.resize((history + in_frames) * channels_);
+    std::copy(input, input + in_frames * channels_, work_.begin() + history * channels_);
+
+    size_t total = history + in_frames;
+    size_t pos = phase_;
+    size_t out_frames = 0;
+    const int16_t* coefficients = coefficients_.data();
+    for (; pos + taps_ <= total; pos += decimation_) {
+        const int16_t* frame = &work_[pos * channels_];
+        for (int c = 0; c < channels_; c++) {
+            int32_t acc = 1 << 14;
+            for (int k = 0; k < taps_; k++) {
+                acc += coefficients[k] * frame[k * channels_ + c];
+            }
+            acc >>= 15;
+            output[out_frames * channels_ + c] = (int16_t)std::clamp<int32_t>(acc, INT16_MIN, INT16_MAX);
+        }
+        out_frames++;
+    }
+
+    /* Keep the last taps - 1 frames as history for the next call */
+    phase_ = pos - in_frames;
+    std::copy(work_.end() - history * channels_, work_.end(), work_.begin());
+    return out_frames;
+}
+
+void Resampler::Reset() {
+    if (decimation_ > 1) {
+        std::fill(work_.begin(), work_.end(), 0);
+        work_.resize((taps_ - 1) * channels_);
+        phase_ = 0;
+    } else if (rate_cvt_ != nullptr) {
+        esp_ae_rate_cvt_reset(rate_cvt_);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "esp_ae_rate_cvt.h"
+
+/*
+ * 16-bit interleaved sample rate converter with preallocated work buffers.
+ *
+ * Equal rates are a plain copy. Integer down ratios (32k -> 16k, 48k -> 16k) use a polyphase
+ * FIR decimator that only computes the kept output samples. Everything else, such as
+ * 24k -> 44.1k on the output side, goes through esp_ae_rate_cvt.
+ */
+class Resampler {
+public:
+    Resampler(int input_rate, int output_rate, int channels);
+    ~Resampler();
+
+    Resampler(const Resampler&) = delete;
+    Resampler& operator=(const Resampler&) = delete;
+
+    int input_rate() const { return input_rate_; }
+    int output_rate() const { return output_rate_; }
+    bool ok() const { return decimation_ > 0 || rate_cvt_ != nullptr; }
+
+    // Upper bound of output frames for in_frames input frames
+    size_t GetMaxOutputFrames(size_t in_frames) const;
+
+    // Convert interleaved frames, output must hold GetMaxOutputFrames(in_frames) frames. Returns output frames.
+    size_t Process(const int16_t* input, size_t in_frames, int16_t* output);
+
+    // Convert into a vector that keeps its capacity between calls
+    void Process(const std::vector<int16_t>& input, std::vector<int16_t>& output);
+
+    // Drop filter history, e.g. when the input stream restarts
+    void Reset();
+
+private:
+    int input_rate_;
+    int output_rate_;
+    int channels_;
+
+    // Integer decimator
+    int decimation_ = 0;
+    int taps_ = 0;
+    std::vector<int16_t> coefficients_;  // Q15
+    std::vector<int16_t> work_;          // taps - 1 frames of history followed by the new input
+    size_t phase_ = 0;                   // Offset of the next output frame in work_
+
+    esp_ae_rate_cvt_handle_t rate_cvt_ = nullptr;
+
+    void InitDecimator(int decimation);
+    size_t Decimate(const int16_t* input, size_t in_frames, int16_t* output);
+};
+
+#endif // RESAMPLER_H
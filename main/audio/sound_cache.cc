@@ -0,0 +1,254 @@
+#include "sound_cache.h"
+#include "ogg_demuxer.h"
+#include "resampler.h"
+#include "memory_budget.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+#include "esp_opus_dec.h"
+
+#define TAG "SoundCache"
+
+// Ogg Opus assets are encoded with 60 ms frames
+#define SOUND_FRAME_DURATION_MS 60
+
+SoundCache::Pcm::~Pcm() {
+    heap_caps_free(data);
+}
+
+SoundCache::SoundCache(size_t budget_bytes, size_t max_ogg_bytes)
+    : budget_bytes_(budget_bytes), max_ogg_bytes_(max_ogg_bytes) {
+    if (budget_bytes_ > 0) {
+        budget_id_ = MemoryBudget::GetInstance().Register("sound_cache", MALLOC_CAP_SPIRAM, budget_bytes_,
+            kMemoryPriorityNormal, [this]() {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return used_bytes_;
+            }, [this](size_t bytes) { return Trim(bytes); });
+    }
+}
+
+SoundCache::~SoundCache() {
+    if (budget_id_ != 0) {
+        MemoryBudget::GetInstance().Unregister(budget_id_);
+    }
+}
+
+size_t SoundCache::Trim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t freed = 0;
+    auto it = entries_.end();
+    while (freed < bytes && it != entries_.begin()) {
+        --it;
+        // Freeing a sound that is queued or playing would not give back its memory yet
+        if (it->pcm.use_count() > 1) {
+            continue;
+        }
+        size_t size = it->pcm->samples * sizeof(int16_t);
+        used_bytes_ -= size;
+        freed += size;
+        it = entries_.erase(it);
+    }
+    return freed;
+}
+
+std::shared_ptr<const SoundCache::Pcm> SoundCache::Find(std::string_view ogg) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == ogg.data() && it->size == ogg.size()) {
+            entries_.splice(entries_.begin(), entries_, it);
+            return it->pcm;
+        }
+    }
+    return nullptr;
+}
+
+bool SoundCache::Play(std::string_view ogg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto pcm = Find(ogg);
+    if (pcm == nullptr) {
+        return false;
+    }
+    play_queue_.push_back(pcm);
+    busy_ = true;
+    return true;
+}
+
+void SoundCache::RequestLoad(std::string_view ogg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::find(load_queue_.begin(), load_queue_.end(), ogg) != load_queue_.end()) {
+        return;
+    }
+    load_queue_.push_back(ogg);
+    load_pending_ = true;
+}
+
+void SoundCache::Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    play_queue_.clear();
+    generation_++;
+    busy_ = false;
+}
+
+void SoundCache::LoadPending(int output_sample_rate) {
+    while (true) {
+        std::string_view ogg;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (load_queue_.empty()) {
+                load_pending_ = false;
+                return;
+            }
+            ogg = load_queue_.front();
+            load_queue_.pop_front();
+            if (Find(ogg) != nullptr) {
+                continue;
+            }
+        }
+
+        auto pcm = Decode(ogg, output_sample_rate);
+        if (pcm == nullptr) {
+            continue;
+        }
+        size_t bytes = pcm->samples * sizeof(int16_t);
+        if (bytes > budget_bytes_) {
+            ESP_LOGW(TAG, "Sound of %u bytes does not fit in the cache", (unsigned)bytes);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        /* Evict the least recently used sounds, a sound still playing is freed when it ends */
+        while (used_bytes_ + bytes > budget_bytes_ && !entries_.empty()) {
+            used_bytes_ -= entries_.back().pcm->samples * sizeof(int16_t);
+            entries_.pop_back();
+        }
+        entries_.push_front({ogg.data(), ogg.size(), pcm});
+        used_bytes_ += bytes;
+        ESP_LOGI(TAG, "Cached sound, %u samples, %u/%u bytes used", (unsigned)pcm->samples,
+            (unsigned)used_bytes_, (unsigned)budget_bytes_);
+    }
+}
+
+std::shared_ptr<const SoundCache::Pcm> SoundCache::Decode(std::string_view ogg, int output_sample_rate) {
+    void* decoder = nullptr;
+    std::unique_ptr<Resampler> resampler;
+    std::vector<int16_t> frame;
+    std::vector<int16_t> resampled;
+    std::vector<int16_t> pcm;
+    bool failed = false;
+
+    auto decode_packet = [&](const uint8_t* data, int stream_sample_rate, size_t size) {
+        if (failed) {
+            return;
+        }
+        if (decoder == nullptr) {
+            // Opus decodes straight to the output rate if it is one of its own
+            int sample_rate = OggDemuxer::DecodeSampleRate(output_sample_rate, stream_sample_rate);
+            esp_opus_dec_cfg_t cfg = {
+                .sample_rate = (uint32_t)sample_rate,
+                .channel = ESP_AUDIO_MONO,
+                .frame_duration = ESP_OPUS_DEC_FRAME_DURATION_60_MS,
+                .self_delimited = false,
+            };
+            auto ret = esp_opus_dec_open(&cfg, sizeof(cfg), &decoder);
+            if (decoder == nullptr) {
+                ESP_LOGE(TAG, "Failed to create sound decoder, error code: %d", ret);
+                failed = true;
+                return;
+            }
+            if (sample_rate != output_sample_rate) {
+                resampler = std::make_unique<Resampler>(sample_rate, output_sample_rate, 1);
+                if (!resampler->ok()) {
+                    failed = true;
+                    return;
+                }
+            }
+            frame.resize(sample_rate / 1000 * SOUND_FRAME_DURATION_MS);
+        }
+
+        esp_audio_dec_in_raw_t raw = {
+            .buffer = (uint8_t*)data,
+            .len = (uint32_t)size,
+            .consumed = 0,
+            .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
+        };
+        esp_audio_dec_out_frame_t out_frame = {
+            .buffer = (uint8_t*)frame.data(),
+            .len = (uint32_t)(frame.size() * sizeof(int16_t)),
+            .decoded_size = 0,
+        };
+        esp_audio_dec_info_t dec_info = {};
+        if (esp_opus_dec_decode(decoder, &raw, &out_frame, &dec_info) != ESP_AUDIO_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to decode sound");
+            failed = true;
+            return;
+        }
+        size_t samples = out_frame.decoded_size / sizeof(int16_t);
+        if (resampler != nullptr) {
+            resampled.resize(resampler->GetMaxOutputFrames(samples));
+            resampled.resize(resampler->Process(frame.data(), samples, resampled.data()));
+            pcm.insert(pcm.end(), resampled.begin(), resampled.end());
+        } else {
+            pcm.insert(pcm.end(), frame.begin(), frame.begin() + samples);
+        }
+    };
+
+    /* Packets of an indexed sound are taken by offset, the others go through the demuxer */
+    auto data = reinterpret_cast<const uint8_t*>(ogg.data());
+    OggDemuxer::PacketIndex index;
+    if (OggDemuxer::FindPacketIndex(data, ogg.size(), index) && index.frame_duration == SOUND_FRAME_DURATION_MS) {
+        const uint8_t* packet;
+        size_t size;
+        for (size_t i = 0; !failed && i < index.count; i++) {
+            if (!index.Get(i, &packet, &size)) {
+                failed = true;
+                break;
+            }
+            decode_packet(packet, index.sample_rate, size);
+        }
+    } else {
+        auto demuxer = std::make_unique<OggDemuxer>();
+        demuxer->OnDemuxerFinished(decode_packet);
+        demuxer->Process(data, ogg.size());
+    }
+    if (decoder != nullptr) {
+        esp_opus_dec_close(decoder);
+    }
+    if (failed || pcm.empty()) {
+        return nullptr;
+    }
+
+    auto result = std::make_shared<Pcm>();
+    result->data = (int16_t*)heap_caps_malloc(pcm.size() * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (result->data == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for a sound", (unsigned)(pcm.size() * sizeof(int16_t)));
+        return nullptr;
+    }
+    memcpy(result->data, pcm.data(), pcm.size() * sizeof(int16_t));
+    result->samples = pcm.size();
+    return result;
+}
+
+bool SoundCache::NextFrame(std::vector<int16_t>& pcm, size_t max_samples) {
+    if (current_generation_ != generation_) {
+        current_.reset();
+    }
+    if (current_ == nullptr || offset_ >= current_->samples) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_.reset();
+        if (play_queue_.empty()) {
+            busy_ = false;
+            return false;
+        }
+        current_ = play_queue_.front();
+        current_generation_ = generation_;
+        play_queue_.pop_front();
+        offset_ = 0;
+    }
+
+    size_t samples = std::min(max_samples, current_->samples - offset_);
+    pcm.assign(current_->data + offset_, current_->data + offset_ + samples);
+    offset_ += samples;
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <string_view>
+#include <memory>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+/*
+ * LRU cache of short Ogg Opus prompts, decoded and resampled to the codec output rate in PSRAM.
+ *
+ * A hit is queued with Play() and the output task copies it to the speaker frame by frame
+ * with NextFrame(), without going through the Opus decoder. A miss is queued with RequestLoad()
+ * and the decoder task decodes it with a temporary decoder in LoadPending(), so the decoder
+ * state of the server stream is never touched.
+ */
+class SoundCache {
+public:
+    struct Pcm {
+        int16_t* data = nullptr;
+        size_t samples = 0;
+        ~Pcm();
+    };
+
+    SoundCache(size_t budget_bytes, size_t max_ogg_bytes);
+    ~SoundCache();
+
+    bool Cacheable(std::string_view ogg) const { return budget_bytes_ > 0 && ogg.size() <= max_ogg_bytes_; }
+
+    // Thread safe. Queues the cached PCM of ogg for playback, returns false on a miss
+    bool Play(std::string_view ogg);
+    // Thread safe. Remembers ogg to be decoded by the next LoadPending()
+    void RequestLoad(std::string_view ogg);
+    bool load_pending() const { return load_pending_; }
+    // Drops the sound that is playing and the queued ones
+    void Cancel();
+    bool busy() const { return busy_; }
+
+    // Decoder task only
+    void LoadPending(int output_sample_rate);
+    // Output task only. Copies up to max_samples of the current sound into pcm
+    bool NextFrame(std::vector<int16_t>& pcm, size_t max_samples);
+
+    // Thread safe. Drops least recently used sounds that are not playing, returns the bytes freed
+    size_t Trim(size_t bytes);
+
+private:
+    struct Entry {
+        const char* key;
+        size_t size;
+        std::shared_ptr<const Pcm> pcm;
+    };
+
+    size_t budget_bytes_;
+    size_t max_ogg_bytes_;
+    size_t used_bytes_ = 0;
+    int budget_id_ = 0;
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;  // Most recently used first
+    std::deque<std::string_view> load_queue_;
+    std::deque<std::shared_ptr<const Pcm>> play_queue_;
+    std::atomic<bool> load_pending_ = false;
+    std::atomic<bool> busy_ = false;
+    std::atomic<uint32_t> generation_ = 0;  // Bumped by Cancel()
+
+    // Owned by the output task
+    std::shared_ptr<const Pcm> current_;
+    uint32_t current_generation_ = 0;
+    size_t offset_ = 0;
+
+    std::shared_ptr<const Pcm> Find(std::string_view ogg);
+    std::shared_ptr<const Pcm> Decode(std::string_view ogg, int output_sample_rate);
+};
+
+#endif // SOUND_CACHE_H
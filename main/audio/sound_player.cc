@@ -0,0 +1,95 @@
+#include "sound_player.h"
+
+#include <esp_log.h>
+
+#define TAG "SoundPlayer"
+
+// Ogg Opus assets are encoded with 60 ms frames
+#define SOUND_FRAME_DURATION_MS 60
+
+SoundPlayer::SoundPlayer() {
+    demuxer_.OnDemuxerFinished([this](const uint8_t* data, int sample_rate, size_t size) {
+        Output(*output_, data, sample_rate, size);
+        output_ = nullptr;
+    });
+}
+
+void SoundPlayer::Output(AudioStreamPacket& packet, const uint8_t* data, int sample_rate, size_t size) {
+    packet.sample_rate = OggDemuxer::DecodeSampleRate(decode_sample_rate_, sample_rate);
+    packet.frame_duration = SOUND_FRAME_DURATION_MS;
+    packet.timestamp = 0;
+    packet.flags = 0;
+    packet.trace_origin_us = packet.trace_last_us = 0;
+    packet.payload.assign(data, data + size);
+}
+
+void SoundPlayer::Play(std::string_view ogg, bool priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back({ogg, priority});
+    busy_ = true;
+}
+
+void SoundPlayer::Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.clear();
+    generation_++;
+    busy_ = false;
+}
+
+bool SoundPlayer::NextPacket(AudioStreamPacket& packet, bool stream_idle, int output_sample_rate) {
+    decode_sample_rate_ = output_sample_rate;
+    if (current_generation_ != generation_) {
+        current_ = {};
+    }
+    while (true) {
+        if (current_.ogg.empty()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.empty()) {
+                busy_ = false;
+                return false;
+            }
+            if (!queue_.front().priority && !stream_idle) {
+                return false;
+            }
+            current_ = queue_.front();
+            current_generation_ = generation_;
+            queue_.pop_front();
+            offset_ = 0;
+            index_position_ = 0;
+            demuxer_.Reset();
+            auto data = reinterpret_cast<const uint8_t*>(current_.ogg.data());
+            if (OggDemuxer::FindPacketIndex(data, current_.ogg.size(), index_) &&
+                index_.frame_duration != SOUND_FRAME_DURATION_MS) {
+                index_ = {};
+            }
+        }
+
+        if (index_.count > 0) {
+            const uint8_t* data;
+            size_t size;
+            if (index_.Get(index_position_++, &data, &size)) {
+                Output(packet, data, index_.sample_rate, size);
+                return true;
+            }
+            current_ = {};
+            continue;
+        }
+
+        /* Demux up to the end of the next packet, it is copied straight from the asset data */
+        auto data = reinterpret_cast<const uint8_t*>(current_.ogg.data());
+        output_ = &packet;
+        while (output_ != nullptr && offset_ < current_.ogg.size()) {
+            size_t processed = demuxer_.Process(data + offset_, current_.ogg.size() - offset_, 1);
+            if (processed == 0) {
+                ESP_LOGW(TAG, "Sound demuxer stalled at %u/%u", (unsigned)offset_, (unsigned)current_.ogg.size());
+                break;
+            }
+            offset_ += processed;
+        }
+        if (output_ == nullptr) {
+            return true;
+        }
+        output_ = nullptr;
+        current_ = {};
+    }
+}
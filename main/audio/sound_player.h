@@ -0,0 +1,63 @@
+#ifndef SOUND_PLAYER_H
+#define SOUND_PLAYER_H
+
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+#include "ogg_demuxer.h"
+#include "protocol.h"
+
+/*
+ * Queue of Ogg Opus sounds that are demuxed lazily by the decoder task.
+ *
+ * Play() only queues the sound and returns. The decoder pulls one Opus packet at a time with
+ * NextPacket() whenever the playback queue has room, straight out of the (mmapped) asset data.
+ * Normal sounds start once the network stream is idle, priority sounds start right away and
+ * hold the stream back until they finish. A started sound always plays to the end unless
+ * Cancel() is called.
+ *
+ * Sounds written by the converters in scripts/ carry a packet index after the last Ogg page,
+ * their packets are taken by offset and the pages are never parsed. The packets are decoded
+ * at the codec output rate whenever Opus supports it, so a prompt needs neither a resampler
+ * nor a decoder reconfiguration next to the server stream.
+ */
+class SoundPlayer {
+public:
+    SoundPlayer();
+
+    // Thread safe, ogg must stay valid until the sound has played or was cancelled
+    void Play(std::string_view ogg, bool priority);
+    // Thread safe, drops the current and all queued sounds
+    void Cancel();
+    bool busy() const { return busy_; }
+
+    // Decoder task only. Fills packet with the next Opus packet, returns false if there is none to play now.
+    bool NextPacket(AudioStreamPacket& packet, bool stream_idle, int output_sample_rate);
+
+private:
+    struct Sound {
+        std::string_view ogg;
+        bool priority = false;
+    };
+
+    std::mutex mutex_;
+    std::deque<Sound> queue_;
+    std::atomic<bool> busy_ = false;
+    std::atomic<uint32_t> generation_ = 0;  // Bumped by Cancel()
+
+    // Owned by the decoder task
+    OggDemuxer demuxer_;
+    Sound current_;
+    uint32_t current_generation_ = 0;
+    size_t offset_ = 0;
+    OggDemuxer::PacketIndex index_;
+    size_t index_position_ = 0;
+    int decode_sample_rate_ = 0;
+    AudioStreamPacket* output_ = nullptr;
+
+    void Output(AudioStreamPacket& packet, const uint8_t* data, int sample_rate, size_t size);
+};
+
+#endif // SOUND_PLAYER_H
@@ -0,0 +1,101 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Bounded lock-free single-producer / single-consumer ring.
+ *
+ * Push() may only be called from the producer task and Pop() / Reclaim() / Clear()
+ * only from the consumer task. Any task may call Flush(): it logically drops every item
+ * pushed so far, and the consumer destroys them lazily on its next Pop() or Reclaim().
+ * Items pushed after Flush() are kept, so a flush never races with a fresh producer.
+ *
+ * Positions are free-running 32-bit counters; slots are indexed modulo capacity.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : capacity_(capacity), slots_(capacity) {}
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. The item is left untouched if the ring is full.
+    bool Push(T&& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= capacity_) {
+            return false;
+        }
+        slots_[tail % capacity_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool Pop(T& item) {
+        uint32_t head = Reclaim();
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots_[head % capacity_]);
+        slots_[head % capacity_] = T();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: destroy the items dropped by Flush(), returns the new head position
+    uint32_t Reclaim() {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t flush = flush_until_.load(std::memory_order_acquire);
+        if ((int32_t)(flush - head) <= 0) {
+            return head;
+        }
+        while (head != flush) {
+            slots_[head % capacity_] = T();
+            head++;
+        }
+        head_.store(head, std::memory_order_release);
+        return head;
+    }
+
+    // Consumer side: drop everything immediately
+    void Clear() {
+        Flush();
+        Reclaim();
+    }
+
+    // Any task
+    void Flush() {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t current = flush_until_.load(std::memory_order_relaxed);
+        while ((int32_t)(tail - current) > 0 &&
+            !flush_until_.compare_exchange_weak(current, tail, std::memory_order_acq_rel)) {
+        }
+    }
+
+    // Number of live (not flushed) items, safe to call from any task
+    size_t size() const {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t flush = flush_until_.load(std::memory_order_acquire);
+        if ((int32_t)(flush - head) > 0) {
+            head = flush;
+        }
+        return (int32_t)(tail - head) > 0 ? tail - head : 0;
+    }
+
+    inline bool empty() const { return size() == 0; }
+    inline size_t capacity() const { return capacity_; }
+
+private:
+    const size_t capacity_;
+    std::vector<T> slots_;
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> flush_until_{0};
+};
+
+#endif // SPSC_RING_H
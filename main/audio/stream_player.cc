@@ -0,0 +1,327 @@
+#include "stream_player.h"
+#include "http_pool.h"
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cJSON.h>
+
+#include <algorithm>
+#include <memory>
+
+#define TAG "StreamPlayer"
+
+#define STREAM_BUFFER_BYTES (CONFIG_AUDIO_STREAM_BUFFER_KB * 1024)
+#define STREAM_RESUME_BYTES (STREAM_BUFFER_BYTES / 100 * CONFIG_AUDIO_STREAM_RESUME_PERCENT)
+// Buffered before playback starts, about 4 s of 32 kbit/s Opus
+#define STREAM_PREBUFFER_BYTES (16 * 1024)
+#define STREAM_CHUNK_BYTES 4096
+#define STREAM_MAX_FAILURES 5
+
+// Duration of an Opus packet from its TOC byte (RFC 6716 3.1), 0 if it has none
+static int PacketDurationMs(const uint8_t* data, size_t size) {
+    static const int kSilkSamples[] = {480, 960, 1920, 2880};
+    static const int kHybridSamples[] = {480, 960};
+    static const int kCeltSamples[] = {120, 240, 480, 960};
+    if (size == 0) {
+        return 0;
+    }
+    int config = data[0] >> 3;
+    int samples = config < 12 ? kSilkSamples[config & 3] :
+        config < 16 ? kHybridSamples[config & 1] : kCeltSamples[config & 3];
+    int frames = 1;
+    switch (data[0] & 3) {
+        case 1:
+        case 2:
+            frames = 2;
+            break;
+        case 3:
+            frames = size > 1 ? (data[1] & 0x3F) : 0;
+            break;
+    }
+    return samples * frames / 48;
+}
+
+StreamPlayer::StreamPlayer() {
+    demuxer_.OnDemuxerFinished([this](const uint8_t* data, int sample_rate, size_t size) {
+        int duration = PacketDurationMs(data, size);
+        // The decoder takes whole frame durations only, 2.5 ms CELT frames are dropped
+        if (duration != 5 && duration != 10 && duration != 20 && duration != 40 && duration != 60 &&
+            duration != 80 && duration != 100 && duration != 120) {
+            return;
+        }
+        output_->sample_rate = decode_sample_rate_;
+        output_->frame_duration = duration;
+        output_->timestamp = 0;
+        output_->flags = 0;
+        output_->trace_origin_us = output_->trace_last_us = 0;
+        output_->headroom = 0;
+        output_->payload.assign(data, data + size);
+        output_ = nullptr;
+    });
+}
+
+StreamPlayer::~StreamPlayer() {
+    Stop();
+}
+
+bool StreamPlayer::Play(const std::string& url) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (buffer_ == nullptr) {
+        buffer_ = (uint8_t*)heap_caps_malloc(STREAM_BUFFER_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buffer_ == nullptr) {
+            ESP_LOGE(TAG, "No memory for the %d KB stream buffer", CONFIG_AUDIO_STREAM_BUFFER_KB);
+            return false;
+        }
+        capacity_ = STREAM_BUFFER_BYTES;
+    }
+    url_ = url;
+    generation_++;
+    active_ = true;
+    ESP_LOGI(TAG, "Play %s", url.c_str());
+    if (fetch_task_ == nullptr) {
+        TaskManifest::Create("stream_fetch", [](void* arg) {
+            static_cast<StreamPlayer*>(arg)->FetchTask();
+        }, this, &fetch_task_);
+    } else {
+        xTaskNotifyGive(fetch_task_);
+    }
+    return true;
+}
+
+void StreamPlayer::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (url_.empty()) {
+        return;
+    }
+    url_.clear();
+    generation_++;
+    active_ = false;
+    if (fetch_task_ != nullptr) {
+        xTaskNotifyGive(fetch_task_);
+    }
+}
+
+std::string StreamPlayer::GetStatusJson() {
+    cJSON* root = cJSON_CreateObject();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const char* state = !active_ ? "stopped" : paused_ ? "paused" : buffering_ ? "buffering" : "playing";
+        cJSON_AddStringToObject(root, "state", state);
+        if (active_) {
+            cJSON_AddStringToObject(root, "url", url_.c_str());
+        }
+    }
+    cJSON_AddNumberToObject(root, "buffered_kb", (write_pos_ - read_pos_) / 1024);
+    cJSON_AddNumberToObject(root, "buffer_kb", CONFIG_AUDIO_STREAM_BUFFER_KB);
+    cJSON_AddBoolToObject(root, "ranges", range_supported_);
+    cJSON_AddNumberToObject(root, "connections", connections_);
+    cJSON_AddNumberToObject(root, "underruns", underruns_);
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+bool StreamPlayer::NextPacket(AudioStreamPacket& packet, int output_sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    /* Nothing to read until the fetch task has taken up the current stream */
+    if (buffer_ == nullptr || !active_ || paused_ || fetch_generation_ != generation_) {
+        return false;
+    }
+    if (read_generation_ != generation_) {
+        read_generation_ = generation_;
+        demuxer_.Reset();
+        buffering_ = true;
+    }
+    uint32_t read = read_pos_;
+    uint32_t write = write_pos_;
+    if (buffering_) {
+        if (write - read < STREAM_PREBUFFER_BYTES && !eof_) {
+            return false;
+        }
+        buffering_ = false;
+        ESP_LOGI(TAG, "Playing, %lu bytes buffered", write - read);
+    }
+
+    // Opus decodes straight to the output rate if it is one of its own
+    decode_sample_rate_ = OggDemuxer::DecodeSampleRate(output_sample_rate, 48000);
+
+    output_ = &packet;
+    while (output_ != nullptr && read != write) {
+        if (has_discontinuity_ && read == discontinuity_pos_) {
+            has_discontinuity_ = false;
+            demuxer_.Reset();
+        }
+        size_t length = std::min<size_t>(write - read, capacity_ - read % capacity_);
+        if (has_discontinuity_ && discontinuity_pos_ - read < length) {
+            length = discontinuity_pos_ - read;
+        }
+        size_t processed = demuxer_.Process(buffer_ + read % capacity_, length, 1);
+        // A stalled demuxer skips the bytes, it looks for the next page
+        read += processed > 0 ? processed : length;
+        read_pos_ = read;
+    }
+    if (output_ == nullptr) {
+        return true;
+    }
+    output_ = nullptr;
+    if (eof_) {
+        ESP_LOGI(TAG, "Stream finished");
+        url_.clear();
+        generation_++;
+        active_ = false;
+        if (fetch_task_ != nullptr) {
+            xTaskNotifyGive(fetch_task_);
+        }
+    } else {
+        underruns_++;
+        buffering_ = true;
+        ESP_LOGW(TAG, "Stream buffer ran empty, buffering");
+    }
+    return false;
+}
+
+void StreamPlayer::FetchTask() {
+    uint32_t generation = 0;
+    bool adopted = false;
+    std::string url;
+    std::unique_ptr<Http> http;
+    uint32_t stream_offset = 0;
+    uint32_t total_length = 0;
+    bool fetch_paused = false;
+    int failures = 0;
+
+    while (true) {
+        bool stop = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!adopted || generation != generation_) {
+                if (url_.empty()) {
+                    heap_caps_free(buffer_);
+                    buffer_ = nullptr;
+                    fetch_task_ = nullptr;
+                    stop = true;
+                } else {
+                    adopted = true;
+                    generation = fetch_generation_ = generation_;
+                    url = url_;
+                    write_pos_ = 0;
+                    read_pos_ = 0;
+                    has_discontinuity_ = false;
+                    eof_ = false;
+                    underruns_ = 0;
+                    connections_ = 0;
+                    range_supported_ = false;
+                    stream_offset = 0;
+                    total_length = 0;
+                    fetch_paused = false;
+                    failures = 0;
+                }
+                http.reset();
+            }
+        }
+        if (stop) {
+            break;
+        }
+        if (eof_) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        uint32_t fill = write_pos_ - read_pos_;
+        if (http == nullptr) {
+            /* The connection was closed on a full buffer, let it drain before the next burst */
+            if (fetch_paused && fill > STREAM_RESUME_BYTES) {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+                continue;
+            }
+            fetch_paused = false;
+            http = HttpPool::GetInstance().CreateStreamingHttp(0);
+            if (stream_offset > 0 && range_supported_) {
+                http->SetHeader("Range", "bytes=" + std::to_string(stream_offset) + "-");
+            }
+            connections_++;
+            int status = 0;
+            if (http->Open("GET", url)) {
+                status = http->GetStatusCode();
+            }
+            if (status != 200 && status != 206) {
+                ESP_LOGW(TAG, "Failed to open the stream at %lu, status code: %d", stream_offset, status);
+                http.reset();
+                if (++failures >= STREAM_MAX_FAILURES) {
+                    /* Play out what is buffered and stop */
+                    ESP_LOGE(TAG, "Giving up on %s", url.c_str());
+                    eof_ = true;
+                } else {
+                    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000 << failures));
+                }
+                continue;
+            }
+            if (stream_offset > 0 && status != 206) {
+                /* The server starts over, from the beginning of the file or the live edge */
+                std::lock_guard<std::mutex> lock(mutex_);
+                has_discontinuity_ = true;
+                discontinuity_pos_ = write_pos_;
+                stream_offset = 0;
+            }
+            if (stream_offset == 0) {
+                range_supported_ = status == 206 || http->GetResponseHeader("Accept-Ranges") == "bytes";
+            }
+            size_t body_length = http->GetBodyLength();
+            total_length = body_length > 0 ? stream_offset + body_length : 0;
+            ESP_LOGI(TAG, "Fetching from %lu of %lu bytes, ranges %s", stream_offset, total_length,
+                range_supported_ ? "supported" : "not supported");
+        }
+
+        if (fill + STREAM_CHUNK_BYTES > capacity_) {
+            if (range_supported_) {
+                ESP_LOGI(TAG, "Buffer full, fetch paused at %lu", stream_offset);
+                http.reset();
+                fetch_paused = true;
+            } else {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            }
+            continue;
+        }
+
+        /* Only this task frees the buffer, it can be written without the lock */
+        size_t position = write_pos_ % capacity_;
+        size_t length = std::min<size_t>(STREAM_CHUNK_BYTES, capacity_ - position);
+        int ret = http->Read(reinterpret_cast<char*>(buffer_) + position, length);
+        if (ret > 0) {
+            write_pos_ += ret;
+            stream_offset += ret;
+            failures = 0;
+            if (on_data_available_) {
+                on_data_available_();
+            }
+            continue;
+        }
+        http.reset();
+        if (ret == 0 && (total_length == 0 || stream_offset >= total_length)) {
+            ESP_LOGI(TAG, "Stream fetched, %lu bytes", stream_offset);
+            eof_ = true;
+            if (on_data_available_) {
+                on_data_available_();
+            }
+            continue;
+        }
+        ESP_LOGW(TAG, "Stream read failed at %lu, reconnecting", stream_offset);
+        if (!range_supported_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            has_discontinuity_ = true;
+            discontinuity_pos_ = write_pos_;
+            stream_offset = 0;
+        }
+        if (++failures >= STREAM_MAX_FAILURES) {
+            ESP_LOGE(TAG, "Giving up on %s", url.c_str());
+            eof_ = true;
+        } else {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000 << failures));
+        }
+    }
+    ESP_LOGI(TAG, "Fetch task stopped");
+    TaskManifest::Exit();
+}
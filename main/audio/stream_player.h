@@ -0,0 +1,81 @@
+#ifndef STREAM_PLAYER_H
+#define STREAM_PLAYER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "ogg_demuxer.h"
+#include "protocol.h"
+
+/*
+ * Long-form Ogg Opus playback (music, radio) from an HTTP URL, through a PSRAM buffer of
+ * CONFIG_AUDIO_STREAM_BUFFER_KB that rides out network stalls of tens of seconds.
+ *
+ * The "stream_fetch" task fills the buffer. Once it is full the connection is closed, so the
+ * radio can sleep, and reopened with a Range request from the same offset when the buffer has
+ * drained to CONFIG_AUDIO_STREAM_RESUME_PERCENT. A server that ignores ranges (a live stream)
+ * keeps its connection, TCP holds it back; after a dropped connection the stream restarts there.
+ *
+ * The decoder task pulls one Opus packet at a time with NextPacket() while no sound and no
+ * server audio is playing. Playback starts, and restarts after an underrun, once a few seconds
+ * are buffered.
+ */
+class StreamPlayer {
+public:
+    StreamPlayer();
+    ~StreamPlayer();
+
+    // Thread safe. Plays url, replacing the stream that is playing, false if the buffer cannot be allocated
+    bool Play(const std::string& url);
+    // Thread safe. Stops the stream and frees the buffer
+    void Stop();
+    // Thread safe. A paused stream keeps buffering but is not played, e.g. while the assistant talks
+    void Pause(bool paused) { paused_ = paused; }
+    bool active() const { return active_; }
+    // Called from the fetch task when new data can be played
+    void OnDataAvailable(std::function<void()> callback) { on_data_available_ = callback; }
+    std::string GetStatusJson();
+
+    // Decoder task only. Fills packet with the next Opus packet decoded at a rate close to output_sample_rate
+    bool NextPacket(AudioStreamPacket& packet, int output_sample_rate);
+
+private:
+    // Guards the buffer pointer, the URL and the read side
+    std::mutex mutex_;
+    std::string url_;
+    uint32_t generation_ = 0;           // Bumped by Play() and Stop()
+    uint32_t fetch_generation_ = 0;     // The stream the buffer holds, set by the fetch task
+    uint8_t* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    std::atomic<uint32_t> write_pos_{0};    // Free-running byte positions, the fetch task writes
+    std::atomic<uint32_t> read_pos_{0};
+    bool has_discontinuity_ = false;    // The demuxer restarts at this position, a live stream reconnected
+    uint32_t discontinuity_pos_ = 0;
+    std::atomic<bool> eof_{false};
+    std::atomic<bool> active_{false};
+    std::atomic<bool> paused_{false};
+    TaskHandle_t fetch_task_ = nullptr;
+    std::function<void()> on_data_available_;
+
+    // Statistics of the current stream
+    std::atomic<uint32_t> underruns_{0};
+    std::atomic<uint32_t> connections_{0};
+    std::atomic<bool> range_supported_{false};
+
+    // Owned by the decoder task
+    OggDemuxer demuxer_;
+    uint32_t read_generation_ = 0;
+    bool buffering_ = true;
+    int decode_sample_rate_ = 0;
+    AudioStreamPacket* output_ = nullptr;
+
+    void FetchTask();
+};
+
+#endif // STREAM_PLAYER_H
@@ -0,0 +1,295 @@
+#include "tts_cache.h"
+#include "audio_service.h"
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+
+#include <cctype>
+#include <cstring>
+
+#define TAG "TtsCache"
+
+#define TTS_CACHE_MAGIC 0x43535454  // "TTSC"
+#define TTS_CACHE_MAX_PENDING_STORES 2
+
+static uint8_t* AllocateBuffer(size_t size) {
+    auto data = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (data == nullptr) {
+        data = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return data;
+}
+
+TtsCache::TtsCache() {
+    partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "tts_cache");
+    if (partition_ == nullptr) {
+        ESP_LOGI(TAG, "No tts_cache partition, phrases are not cached");
+        return;
+    }
+    slot_size_ = CONFIG_TTS_CACHE_SLOT_KB * 1024;
+    size_t count = partition_->size / slot_size_;
+    if (count == 0) {
+        ESP_LOGW(TAG, "The tts_cache partition is smaller than one slot");
+        partition_ = nullptr;
+        return;
+    }
+    slots_.resize(count);
+    TaskManifest::Create("tts_cache", [](void* arg) {
+        static_cast<TtsCache*>(arg)->WorkerTask();
+    }, this, &task_handle_);
+}
+
+bool TtsCache::ValidHash(const std::string& hash) {
+    if (hash.empty() || hash.size() >= sizeof(SlotHeader::hash)) {
+        return false;
+    }
+    for (char c : hash) {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TtsCache::BeginStore(const std::string& hash, int sample_rate, int frame_duration) {
+    if (!available()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    DropRecording();
+    if (!ValidHash(hash)) {
+        ESP_LOGW(TAG, "Invalid phrase hash: %s", hash.c_str());
+        return;
+    }
+    record_data_ = AllocateBuffer(slot_size_ - sizeof(SlotHeader));
+    if (record_data_ == nullptr) {
+        ESP_LOGW(TAG, "No memory to record phrase %s", hash.c_str());
+        return;
+    }
+    record_hash_ = hash;
+    record_sample_rate_ = sample_rate;
+    record_frame_duration_ = frame_duration;
+    record_bytes_ = 0;
+    record_packets_ = 0;
+}
+
+void TtsCache::Record(const AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (record_data_ == nullptr) {
+        return;
+    }
+    size_t size = packet.payload_size();
+    if (record_bytes_ + 2 + size > slot_size_ - sizeof(SlotHeader)) {
+        ESP_LOGW(TAG, "Phrase %s does not fit in a slot", record_hash_.c_str());
+        DropRecording();
+        return;
+    }
+    record_data_[record_bytes_] = size & 0xFF;
+    record_data_[record_bytes_ + 1] = size >> 8;
+    memcpy(record_data_ + record_bytes_ + 2, packet.payload_data(), size);
+    record_bytes_ += 2 + size;
+    record_packets_++;
+}
+
+void TtsCache::EndStore() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (record_data_ == nullptr) {
+        return;
+    }
+    if (record_packets_ == 0 || stores_.size() >= TTS_CACHE_MAX_PENDING_STORES) {
+        DropRecording();
+        return;
+    }
+    PendingStore store = {};
+    store.header.magic = TTS_CACHE_MAGIC;
+    strncpy(store.header.hash, record_hash_.c_str(), sizeof(store.header.hash) - 1);
+    store.header.sample_rate = record_sample_rate_;
+    store.header.frame_duration = record_frame_duration_;
+    store.header.packets = record_packets_;
+    store.header.bytes = record_bytes_;
+    store.header.crc = esp_rom_crc32_le(0, record_data_, record_bytes_);
+    store.data = record_data_;
+    record_data_ = nullptr;
+    stores_.push_back(store);
+    xTaskNotifyGive(task_handle_);
+}
+
+void TtsCache::Play(const std::string& hash, AudioService* audio_service, std::function<void(bool played)> done) {
+    if (!available()) {
+        done(false);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    plays_.push_back({hash, audio_service, std::move(done), generation_});
+    xTaskNotifyGive(task_handle_);
+}
+
+void TtsCache::Cancel() {
+    if (!available()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    plays_.clear();
+    DropRecording();
+}
+
+void TtsCache::DropRecording() {
+    if (record_data_ != nullptr) {
+        heap_caps_free(record_data_);
+        record_data_ = nullptr;
+    }
+}
+
+void TtsCache::LoadIndex() {
+    int count = 0;
+    for (size_t i = 0; i < slots_.size(); i++) {
+        SlotHeader header;
+        if (esp_partition_read(partition_, i * slot_size_, &header, sizeof(header)) != ESP_OK ||
+            header.magic != TTS_CACHE_MAGIC || header.bytes > slot_size_ - sizeof(SlotHeader)) {
+            continue;
+        }
+        header.hash[sizeof(header.hash) - 1] = '\0';
+        slots_[i].hash = header.hash;
+        slots_[i].sequence = header.sequence;
+        slots_[i].last_used = header.sequence;
+        slots_[i].valid = true;
+        if (header.sequence > sequence_) {
+            sequence_ = header.sequence;
+        }
+        count++;
+    }
+    use_clock_ = sequence_;
+    ESP_LOGI(TAG, "%d of %u slots hold a phrase", count, (unsigned)slots_.size());
+}
+
+int TtsCache::FindSlot(const std::string& hash) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (slots_[i].valid && slots_[i].hash == hash) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TtsCache::WorkerTask() {
+    LoadIndex();
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (true) {
+            PendingPlay play;
+            PendingStore store = {};
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                // A play is waited for by the server, a store is not
+                if (!plays_.empty()) {
+                    play = std::move(plays_.front());
+                    plays_.erase(plays_.begin());
+                } else if (!stores_.empty()) {
+                    store = stores_.front();
+                    stores_.erase(stores_.begin());
+                } else {
+                    break;
+                }
+            }
+            if (play.done) {
+                bool played = PlaySlot(play);
+                if (play.generation == generation_) {
+                    play.done(played);
+                }
+            } else {
+                WriteSlot(store);
+                heap_caps_free(store.data);
+            }
+        }
+    }
+}
+
+void TtsCache::WriteSlot(PendingStore& store) {
+    std::string hash = store.header.hash;
+    // The same phrase stored again replaces its slot, otherwise an empty or the least recently used one
+    int index = FindSlot(hash);
+    if (index < 0) {
+        index = 0;
+        for (size_t i = 0; i < slots_.size(); i++) {
+            if (!slots_[i].valid) {
+                index = i;
+                break;
+            }
+            if (slots_[i].last_used < slots_[index].last_used) {
+                index = i;
+            }
+        }
+    }
+    auto& slot = slots_[index];
+    slot.valid = false;
+    size_t offset = index * slot_size_;
+    store.header.sequence = ++sequence_;
+    // The header goes last, a write cut short leaves an empty slot
+    esp_err_t err = esp_partition_erase_range(partition_, offset, slot_size_);
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition_, offset + sizeof(SlotHeader), store.data, store.header.bytes);
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition_, offset, &store.header, sizeof(SlotHeader));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write slot %d: %s", index, esp_err_to_name(err));
+        return;
+    }
+    slot.hash = hash;
+    slot.sequence = store.header.sequence;
+    slot.last_used = ++use_clock_;
+    slot.valid = true;
+    ESP_LOGI(TAG, "Stored phrase %s in slot %d, %lu packets, %lu bytes", hash.c_str(), index,
+        store.header.packets, store.header.bytes);
+}
+
+bool TtsCache::PlaySlot(PendingPlay& play) {
+    int index = FindSlot(play.hash);
+    if (index < 0) {
+        ESP_LOGI(TAG, "Phrase %s is not cached", play.hash.c_str());
+        return false;
+    }
+    size_t offset = index * slot_size_;
+    SlotHeader header;
+    if (esp_partition_read(partition_, offset, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    auto data = AllocateBuffer(header.bytes);
+    if (data == nullptr) {
+        return false;
+    }
+    if (esp_partition_read(partition_, offset + sizeof(SlotHeader), data, header.bytes) != ESP_OK ||
+        esp_rom_crc32_le(0, data, header.bytes) != header.crc) {
+        ESP_LOGW(TAG, "Slot %d of phrase %s is damaged", index, play.hash.c_str());
+        slots_[index].valid = false;
+        heap_caps_free(data);
+        return false;
+    }
+    slots_[index].last_used = ++use_clock_;
+
+    size_t position = 0;
+    while (position + 2 <= header.bytes && play.generation == generation_) {
+        size_t size = data[position] | (data[position + 1] << 8);
+        position += 2;
+        if (position + size > header.bytes) {
+            break;
+        }
+        auto packet = play.audio_service->AcquirePacket();
+        packet->sample_rate = header.sample_rate;
+        packet->frame_duration = header.frame_duration;
+        packet->timestamp = 0;
+        packet->flags = 0;
+        packet->headroom = 0;
+        packet->payload.assign(data + position, data + position + size);
+        position += size;
+        if (!play.audio_service->PushPacketToDecodeQueue(std::move(packet), true)) {
+            break;
+        }
+    }
+    heap_caps_free(data);
+    return true;
+}
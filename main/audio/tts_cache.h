@@ -0,0 +1,115 @@
+#ifndef TTS_CACHE_H
+#define TTS_CACHE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_partition.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct AudioStreamPacket;
+class AudioService;
+
+/*
+ * Opus of repeated TTS phrases (greetings, "I didn't catch that", timer confirmations) kept on
+ * the "tts_cache" partition, so the server can replay a phrase by its hash instead of streaming it.
+ *
+ * The partition is split in slots of CONFIG_TTS_CACHE_SLOT_KB, one phrase per slot: a header
+ * followed by the packets as [u16 length][opus]. The least recently used slot is replaced by the
+ * next store. Plays do not write the flash, so after a reboot the store order stands in for it.
+ *
+ * The network task records with BeginStore() / Record() / EndStore(), the "tts_cache" task erases,
+ * writes and reads the slots, so the audio path never waits for the flash.
+ */
+class TtsCache {
+public:
+    static TtsCache& GetInstance() {
+        static TtsCache instance;
+        return instance;
+    }
+
+    // The partition was found, the feature is only advertised then
+    bool available() const { return partition_ != nullptr; }
+
+    // Hashes go back to the server in JSON, only [0-9A-Za-z_-] shorter than a slot header holds
+    static bool ValidHash(const std::string& hash);
+
+    // Network task. Packets of the segment tagged hash follow until EndStore()
+    void BeginStore(const std::string& hash, int sample_rate, int frame_duration);
+    void Record(const AudioStreamPacket& packet);
+    void EndStore();
+
+    // Feeds the packets of hash to the decoder, done(false) on a miss or a damaged slot
+    void Play(const std::string& hash, AudioService* audio_service, std::function<void(bool played)> done);
+    // Stops a play and drops a store in progress
+    void Cancel();
+
+private:
+    struct SlotHeader {
+        uint32_t magic;
+        uint32_t sequence;      // Store order, the oldest is replaced first after a reboot
+        char hash[64];
+        uint16_t sample_rate;
+        uint16_t frame_duration;
+        uint32_t packets;
+        uint32_t bytes;         // Packet records after the header
+        uint32_t crc;           // Of the packet records
+    };
+
+    struct Slot {
+        std::string hash;
+        uint32_t sequence = 0;
+        uint32_t last_used = 0;
+        bool valid = false;
+    };
+
+    struct PendingPlay {
+        std::string hash;
+        AudioService* audio_service = nullptr;
+        std::function<void(bool played)> done;
+        uint32_t generation = 0;
+    };
+
+    struct PendingStore {
+        SlotHeader header;
+        uint8_t* data = nullptr;
+    };
+
+    const esp_partition_t* partition_ = nullptr;
+    size_t slot_size_ = 0;
+    std::mutex mutex_;
+    std::vector<Slot> slots_;
+    uint32_t sequence_ = 0;
+    uint32_t use_clock_ = 0;
+    TaskHandle_t task_handle_ = nullptr;
+    // Bumped by Cancel(), a play of an older generation stops and reports nothing
+    std::atomic<uint32_t> generation_{0};
+
+    // Recording of the network task, guarded by mutex_ since Cancel() comes from the main task
+    std::string record_hash_;
+    int record_sample_rate_ = 0;
+    int record_frame_duration_ = 0;
+    uint8_t* record_data_ = nullptr;
+    size_t record_bytes_ = 0;
+    uint32_t record_packets_ = 0;
+
+    std::vector<PendingPlay> plays_;
+    std::vector<PendingStore> stores_;
+
+    TtsCache();
+
+    void StartTask();
+    void LoadIndex();
+    void WorkerTask();
+    void WriteSlot(PendingStore& store);
+    bool PlaySlot(PendingPlay& play);
+    int FindSlot(const std::string& hash);
+    void DropRecording();
+};
+
+#endif // TTS_CACHE_H
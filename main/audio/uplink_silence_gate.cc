@@ -0,0 +1,65 @@
+#include "uplink_silence_gate.h"
+
+UplinkSilenceGate::UplinkSilenceGate(int hangover_ms, int preroll_ms, int keepalive_ms, Sink send, Sink release)
+    : hangover_ms_(hangover_ms), preroll_ms_(preroll_ms), keepalive_ms_(keepalive_ms),
+      send_(std::move(send)), release_(std::move(release)) {
+}
+
+void UplinkSilenceGate::Push(std::unique_ptr<AudioStreamPacket>&& packet, bool silent) {
+    int duration_ms = packet->frame_duration;
+    if (!silent || (packet->flags & AUDIO_PACKET_FLAG_END_OF_UTTERANCE)) {
+        FlushPreroll();
+        silent_ms_ = 0;
+        since_keepalive_ms_ = 0;
+        send_(std::move(packet));
+        return;
+    }
+
+    silent_ms_ += duration_ms;
+    if (silent_ms_ <= hangover_ms_) {
+        send_(std::move(packet));
+        return;
+    }
+
+    since_keepalive_ms_ += duration_ms;
+    if (since_keepalive_ms_ >= keepalive_ms_) {
+        since_keepalive_ms_ = 0;
+        DropPreroll();
+        packet->flags |= AUDIO_PACKET_FLAG_SILENCE;
+        send_(std::move(packet));
+        return;
+    }
+
+    preroll_held_ms_ += duration_ms;
+    preroll_.push_back(std::move(packet));
+    while (preroll_held_ms_ > preroll_ms_ && !preroll_.empty()) {
+        preroll_held_ms_ -= preroll_.front()->frame_duration;
+        release_(std::move(preroll_.front()));
+        preroll_.pop_front();
+        suppressed_++;
+    }
+}
+
+void UplinkSilenceGate::Reset() {
+    DropPreroll();
+    silent_ms_ = 0;
+    since_keepalive_ms_ = 0;
+    suppressed_ = 0;
+}
+
+void UplinkSilenceGate::FlushPreroll() {
+    while (!preroll_.empty()) {
+        send_(std::move(preroll_.front()));
+        preroll_.pop_front();
+    }
+    preroll_held_ms_ = 0;
+}
+
+void UplinkSilenceGate::DropPreroll() {
+    suppressed_ += preroll_.size();
+    while (!preroll_.empty()) {
+        release_(std::move(preroll_.front()));
+        preroll_.pop_front();
+    }
+    preroll_held_ms_ = 0;
+}
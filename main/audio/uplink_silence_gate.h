@@ -0,0 +1,56 @@
+#ifndef UPLINK_SILENCE_GATE_H
+#define UPLINK_SILENCE_GATE_H
+
+#include <deque>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "protocol.h"
+
+// Opus DTX frames are 1 to 3 bytes, anything larger carries signal
+#define OPUS_DTX_FRAME_MAX_BYTES 3
+
+/*
+ * Thins the uplink during long silences in realtime listening.
+ *
+ * - Speech, and silence for up to hangover_ms after it, goes out as encoded.
+ * - Past the hangover the packets are held back: the newest preroll_ms of them stay queued
+ *   so the onset of the next utterance is sent with its lead-in, older ones are dropped.
+ * - Every keepalive_ms one held packet is sent with AUDIO_PACKET_FLAG_SILENCE, telling the
+ *   server the silence since the previous packet was suppressed on purpose (comfort noise,
+ *   not loss). The packets held before it are dropped, they would arrive out of order.
+ * - Packets flagged AUDIO_PACKET_FLAG_END_OF_UTTERANCE are never held.
+ *
+ * Not thread-safe: only the encoder task touches it.
+ */
+class UplinkSilenceGate {
+public:
+    using Sink = std::function<void(std::unique_ptr<AudioStreamPacket>&&)>;
+
+    // send queues a packet for the protocol, release returns a dropped packet to its pool
+    UplinkSilenceGate(int hangover_ms, int preroll_ms, int keepalive_ms, Sink send, Sink release);
+
+    void Push(std::unique_ptr<AudioStreamPacket>&& packet, bool silent);
+    // Drops the held packets and starts over as after speech
+    void Reset();
+
+    uint32_t suppressed() const { return suppressed_; }
+
+private:
+    int hangover_ms_;
+    int preroll_ms_;
+    int keepalive_ms_;
+    Sink send_;
+    Sink release_;
+    std::deque<std::unique_ptr<AudioStreamPacket>> preroll_;
+    int preroll_held_ms_ = 0;
+    int silent_ms_ = 0;
+    int since_keepalive_ms_ = 0;
+    uint32_t suppressed_ = 0;
+
+    void FlushPreroll();
+    void DropPreroll();
+};
+
+#endif // UPLINK_SILENCE_GATE_H
@@ -7,6 +7,19 @@
 
 #include <model_path.h>
 #include "audio_codec.h"
+#include "pcm_ring.h"
+
+// Pre-roll kept for EncodeWakeWordData(), about 2 seconds at 16 kHz
+#define WAKE_WORD_PCM_SAMPLES (16000 * 2)
+
+// A local command recognized by the wake word engine
+struct WakeWordCommand {
+    std::string command;    // The phrase as given to the model
+    std::string text;
+    std::string action;
+    float confidence;
+    int latency_ms;         // From the speech onset to the result
+};
 
 class WakeWord {
 public:
@@ -15,6 +28,10 @@ public:
     virtual bool Initialize(AudioCodec* codec, srmodel_list_t* models_list) = 0;
     virtual void Feed(const std::vector<int16_t>& data) = 0;
     virtual void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) = 0;
+    // Speech that may be a wake word started, OnWakeWordDetected() follows if it is confirmed
+    virtual void OnWakeWordCandidate(std::function<void()> callback) {}
+    // A command other than the wake word was recognized, detection keeps running
+    virtual void OnCommandDetected(std::function<void(const WakeWordCommand& command)> callback) {}
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
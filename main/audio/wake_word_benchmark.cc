@@ -0,0 +1,211 @@
+#include "wake_word_benchmark.h"
+#include "assets.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cJSON.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#define TAG "WakeWordBenchmark"
+
+// Silence fed after every clip, so a detection at its very end still arrives
+#define BENCHMARK_TAIL_MS 1000
+
+namespace {
+
+struct RunTime {
+    uint64_t total = 0;
+    uint64_t tasks = 0;
+};
+
+// The feeding task and the AFE detection task, where the engines spend their time
+RunTime SampleRunTime() {
+    RunTime sample;
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 4;
+    std::vector<TaskStatus_t> statuses(count);
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    count = uxTaskGetSystemState(statuses.data(), count, &total);
+    const char* self = pcTaskGetName(nullptr);
+    for (UBaseType_t i = 0; i < count; i++) {
+        if (strcmp(statuses[i].pcTaskName, self) == 0 || strcmp(statuses[i].pcTaskName, "audio_detection") == 0) {
+            sample.tasks += statuses[i].ulRunTimeCounter;
+        }
+    }
+    sample.total = total;
+    return sample;
+}
+
+} // namespace
+
+bool WakeWordBenchmark::LoadCorpus(std::vector<Clip>& clips) {
+    void* ptr = nullptr;
+    size_t size = 0;
+    if (!Assets::GetInstance().GetAssetData(WAKE_WORD_BENCHMARK_INDEX, ptr, size)) {
+        return false;
+    }
+    cJSON* root = cJSON_ParseWithLength(static_cast<char*>(ptr), size);
+    if (root == nullptr) {
+        return false;
+    }
+    cJSON* list = cJSON_GetObjectItem(root, "clips");
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, list) {
+        cJSON* file = cJSON_GetObjectItem(item, "file");
+        cJSON* wake_end_ms = cJSON_GetObjectItem(item, "wake_end_ms");
+        if (cJSON_IsString(file)) {
+            clips.push_back({file->valuestring, cJSON_IsNumber(wake_end_ms) ? wake_end_ms->valueint : -1});
+        }
+    }
+    cJSON_Delete(root);
+    return !clips.empty();
+}
+
+bool WakeWordBenchmark::FeedClip(const int16_t* pcm, size_t samples, int speed, int64_t deadline_us) {
+    size_t chunk = wake_word_->GetFeedSize();
+    if (chunk == 0) {
+        chunk = 512;
+    }
+    size_t tail = BENCHMARK_TAIL_MS * 16;
+    std::vector<int16_t> frame(chunk * input_channels_);
+    int64_t chunk_us = (int64_t)chunk * 1000000 / 16000;
+    int64_t next_us = esp_timer_get_time();
+    int restarts = 0;
+
+    for (size_t pos = 0; pos < samples + tail; pos += chunk) {
+        // Every mic channel gets the clip, the reference stays silent
+        for (size_t i = 0; i < chunk; i++) {
+            int16_t sample = pos + i < samples ? pcm[pos + i] : 0;
+            for (int c = 0; c < input_channels_; c++) {
+                frame[i * input_channels_ + c] = (has_reference_ && c == input_channels_ - 1) ? 0 : sample;
+            }
+        }
+        wake_word_->Feed(frame);
+        fed_samples_ += chunk;
+
+        // A detection stops the engine, keep it listening to count every false accept
+        if (detections_ > restarts) {
+            restarts = detections_;
+            wake_word_->Start();
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (now > deadline_us) {
+            return false;
+        }
+        if (speed > 0) {
+            next_us += chunk_us / speed;
+            if (next_us - now >= 1000 * portTICK_PERIOD_MS) {
+                vTaskDelay(pdMS_TO_TICKS((next_us - now) / 1000));
+            }
+        } else {
+            taskYIELD();
+        }
+    }
+    return true;
+}
+
+std::string WakeWordBenchmark::Run(const std::string& engine, const std::string& model, int speed, int max_seconds) {
+    std::vector<Clip> clips;
+    if (!LoadCorpus(clips)) {
+        throw std::runtime_error("No corpus, add " WAKE_WORD_BENCHMARK_INDEX " and its clips to the assets");
+    }
+    ESP_LOGI(TAG, "Running %u clips on %s (%s) at %dx", (unsigned)clips.size(), engine.c_str(), model.c_str(), speed);
+
+    wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+        detections_++;
+        if (detected_at_ms_ < 0) {
+            detected_at_ms_ = (int)(fed_samples_ * 1000 / 16000);
+        }
+    });
+
+    int positives = 0;
+    int detected = 0;
+    int false_accepts = 0;
+    int64_t negative_ms = 0;
+    std::vector<int> latencies;
+    size_t internal_min = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    size_t psram_min = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    bool truncated = false;
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = start_us + (int64_t)max_seconds * 1000000;
+    RunTime start = SampleRunTime();
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "engine", engine.c_str());
+    cJSON_AddStringToObject(root, "model", model.c_str());
+    cJSON* results = cJSON_AddArrayToObject(root, "clips");
+
+    for (auto& clip : clips) {
+        void* ptr = nullptr;
+        size_t size = 0;
+        if (!Assets::GetInstance().GetAssetData(clip.file, ptr, size)) {
+            ESP_LOGW(TAG, "Missing clip %s", clip.file.c_str());
+            continue;
+        }
+        size_t samples = size / sizeof(int16_t);
+        fed_samples_ = 0;
+        detected_at_ms_ = -1;
+        detections_ = 0;
+
+        wake_word_->Start();
+        bool finished = FeedClip(static_cast<const int16_t*>(ptr), samples, speed, deadline_us);
+        wake_word_->Stop();
+        internal_min = std::min(internal_min, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+        psram_min = std::min(psram_min, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+        if (!finished) {
+            truncated = true;
+            break;
+        }
+
+        cJSON* result = cJSON_CreateObject();
+        cJSON_AddStringToObject(result, "file", clip.file.c_str());
+        cJSON_AddNumberToObject(result, "detections", detections_);
+        if (clip.wake_end_ms >= 0) {
+            positives++;
+            if (detected_at_ms_ >= 0) {
+                detected++;
+                latencies.push_back(detected_at_ms_ - clip.wake_end_ms);
+                cJSON_AddNumberToObject(result, "latency_ms", latencies.back());
+            }
+        } else {
+            false_accepts += detections_;
+            negative_ms += samples * 1000 / 16000;
+        }
+        cJSON_AddItemToArray(results, result);
+    }
+
+    RunTime end = SampleRunTime();
+    int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+    uint64_t total = std::max<uint64_t>(end.total - start.total, 1);
+
+    cJSON_AddBoolToObject(root, "truncated", truncated);
+    cJSON_AddNumberToObject(root, "elapsed_ms", elapsed_ms);
+    cJSON_AddNumberToObject(root, "positives", positives);
+    cJSON_AddNumberToObject(root, "detected", detected);
+    cJSON_AddNumberToObject(root, "detection_rate", positives > 0 ? (double)detected / positives : 0);
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        cJSON_AddNumberToObject(root, "latency_p50_ms", latencies[latencies.size() / 2]);
+        cJSON_AddNumberToObject(root, "latency_max_ms", latencies.back());
+    }
+    cJSON_AddNumberToObject(root, "negative_ms", negative_ms);
+    cJSON_AddNumberToObject(root, "false_accepts", false_accepts);
+    cJSON_AddNumberToObject(root, "false_accepts_per_hour", negative_ms > 0 ? false_accepts * 3600000.0 / negative_ms : 0);
+    // Share of one core
+    cJSON_AddNumberToObject(root, "cpu_percent", (double)(end.tasks - start.tasks) * 100 / total);
+    cJSON_AddNumberToObject(root, "heap_internal_min_free", internal_min);
+    cJSON_AddNumberToObject(root, "heap_psram_min_free", psram_min);
+
+    char* json = cJSON_PrintUnformatted(root);
+    std::string result(json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+    ESP_LOGI(TAG, "Result: %s", result.c_str());
+    return result;
+}
@@ -0,0 +1,54 @@
+#ifndef WAKE_WORD_BENCHMARK_H
+#define WAKE_WORD_BENCHMARK_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "wake_word.h"
+
+// Index of the labelled corpus in the assets partition
+#define WAKE_WORD_BENCHMARK_INDEX "wake_bench.json"
+
+/*
+ * Feeds a labelled corpus from the assets partition into a wake word engine and reports the
+ * detection rate and latency of the positive clips, the false accepts per hour of the negative
+ * ones, the CPU share of the feeding and detection tasks and the lowest free heap.
+ *
+ * wake_bench.json lists the clips, raw 16 kHz mono PCM assets:
+ *   {"clips": [{"file": "wb_hi_1.pcm", "wake_end_ms": 1250}, {"file": "wb_tv_1.pcm"}]}
+ * A clip with wake_end_ms (where the wake word ends) is positive, one without is negative.
+ *
+ * The caller stops the live feed and owns the engine callbacks for the duration of Run().
+ */
+class WakeWordBenchmark {
+public:
+    WakeWordBenchmark(WakeWord* wake_word, int input_channels, bool has_reference)
+        : wake_word_(wake_word), input_channels_(input_channels), has_reference_(has_reference) {}
+
+    /*
+     * speed is the multiple of real time to feed at, 0 for as fast as Feed() returns (only for
+     * engines detecting inside Feed()). Stops after max_seconds, reported as truncated.
+     */
+    std::string Run(const std::string& engine, const std::string& model, int speed, int max_seconds);
+
+private:
+    struct Clip {
+        std::string file;
+        int wake_end_ms;  // -1 for a negative clip
+    };
+
+    WakeWord* wake_word_;
+    int input_channels_;
+    bool has_reference_;
+    std::atomic<size_t> fed_samples_{0};
+    std::atomic<int> detected_at_ms_{-1};
+    std::atomic<int> detections_{0};
+
+    bool LoadCorpus(std::vector<Clip>& clips);
+    // Feeds the clip and a tail of silence, false when the time ran out
+    bool FeedClip(const int16_t* pcm, size_t samples, int speed, int64_t deadline_us);
+};
+
+#endif // WAKE_WORD_BENCHMARK_H
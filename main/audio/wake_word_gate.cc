@@ -0,0 +1,106 @@
+#include "wake_word_gate.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cmath>
+
+#define TAG "WakeWordGate"
+
+// A chunk is active this far above the noise floor (6 dB)
+#define GATE_ENERGY_RATIO 4.0f
+// or when the log energies of both bands rose this much in total since the previous chunk
+#define GATE_FLUX_THRESHOLD 1.5f
+// Below this mean square (RMS 60) nothing counts as sound
+#define GATE_MIN_ENERGY 3600.0f
+
+// The ring holds up to two interleaved input channels
+WakeWordGate::WakeWordGate() : lookback_(16 * WAKE_WORD_GATE_LOOKBACK_MS * 2) {
+}
+
+void WakeWordGate::Initialize(int channels) {
+    channels_ = channels > 0 ? channels : 1;
+    Reset();
+}
+
+void WakeWordGate::Reset() {
+    lookback_.Clear();
+    open_ = false;
+    last_active_us_ = 0;
+    noise_floor_ = 0;
+    last_low_ = 0;
+    last_high_ = 0;
+}
+
+bool WakeWordGate::IsActive(const std::vector<int16_t>& data) {
+    size_t frames = data.size() / channels_;
+    if (frames < 2) {
+        return false;
+    }
+    // The first channel is the microphone
+    float low = 0;
+    float high = 0;
+    int32_t prev = data[0];
+    for (size_t i = 0; i < frames; i++) {
+        int32_t x = data[i * channels_];
+        float d = (float)(x - prev);
+        low += (float)x * x;
+        high += d * d;
+        prev = x;
+    }
+    low /= frames;
+    high /= frames;
+
+    float flux = 0;
+    if (last_low_ > 0) {
+        flux = std::max(0.0f, logf((low + 1) / (last_low_ + 1))) + std::max(0.0f, logf((high + 1) / (last_high_ + 1)));
+    }
+    last_low_ = low;
+    last_high_ = high;
+
+    // The floor follows quiet quickly and loud slowly, a few seconds to adapt to steady noise
+    if (noise_floor_ == 0) {
+        noise_floor_ = low;
+    } else if (low < noise_floor_) {
+        noise_floor_ = noise_floor_ * 0.9f + low * 0.1f;
+    } else {
+        noise_floor_ = noise_floor_ * 0.995f + low * 0.005f;
+    }
+
+    if (low < GATE_MIN_ENERGY) {
+        return false;
+    }
+    return low > noise_floor_ * GATE_ENERGY_RATIO || flux > GATE_FLUX_THRESHOLD;
+}
+
+bool WakeWordGate::Process(const std::vector<int16_t>& data) {
+    int64_t now = esp_timer_get_time();
+    if (IsActive(data)) {
+        last_active_us_ = now;
+        if (!open_) {
+            open_ = true;
+            opened_us_ = now;
+            ESP_LOGD(TAG, "Open");
+        }
+    } else if (open_ && now - last_active_us_ > WAKE_WORD_GATE_HANGOVER_MS * 1000) {
+        open_ = false;
+        ESP_LOGD(TAG, "Closed after %d ms", (int)((now - opened_us_) / 1000));
+    }
+
+    if (!open_) {
+        lookback_.Write(data.data(), data.size());
+    }
+    return open_;
+}
+
+bool WakeWordGate::TakeLookback(std::vector<int16_t>& out) {
+    // Whole frames only, so the channels stay interleaved
+    size_t samples = lookback_.size() / channels_ * channels_;
+    if (samples == 0) {
+        return false;
+    }
+    out.resize(samples);
+    out.resize(lookback_.Read(out.data(), samples));
+    return !out.empty();
+}
@@ -0,0 +1,54 @@
+#ifndef WAKE_WORD_GATE_H
+#define WAKE_WORD_GATE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "pcm_ring.h"
+
+// Audio kept while the gate is closed, enough for the onset of a wake word
+#define WAKE_WORD_GATE_LOOKBACK_MS 300
+// How long the gate stays open after the last active chunk
+#define WAKE_WORD_GATE_HANGOVER_MS 1500
+
+/*
+ * A cheap first stage in front of the wake word engine. Each input chunk is scored by its
+ * energy against a tracked noise floor and by a two-band spectral flux (full band and the
+ * first difference as a crude high band), so onsets in a quiet room pass while steady noise
+ * does not. While closed the audio only goes into a short lookback ring, which is handed to
+ * the engine first when the gate opens, so the start of the wake word is never lost. The gate
+ * stays open for a hangover after the last active chunk.
+ *
+ * Only the audio input task calls it.
+ */
+class WakeWordGate {
+public:
+    WakeWordGate();
+
+    void Initialize(int channels);
+    // Closes the gate and forgets the lookback and noise floor
+    void Reset();
+
+    // True when the chunk should reach the engine, otherwise it was kept in the lookback
+    bool Process(const std::vector<int16_t>& data);
+    // Moves the audio kept before the gate opened into out, false when there is none
+    bool TakeLookback(std::vector<int16_t>& out);
+
+    bool is_open() const { return open_; }
+
+private:
+    int channels_ = 1;
+    PcmRing lookback_;
+    bool open_ = false;
+    int64_t last_active_us_ = 0;
+    float noise_floor_ = 0;
+    float last_low_ = 0;
+    float last_high_ = 0;
+    // Time spent open, logged on every close
+    int64_t opened_us_ = 0;
+
+    bool IsActive(const std::vector<int16_t>& data);
+};
+
+#endif // WAKE_WORD_GATE_H
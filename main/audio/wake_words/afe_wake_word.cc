@@ -1,16 +1,17 @@
 #include "afe_wake_word.h"
 #include "audio_service.h"
+#include "task_manifest.h"
 #include <esp_log.h>
+#include <algorithm>
 #include <sstream>
 
 #define DETECTION_RUNNING_EVENT 1
+#define PROCESSING_RUNNING_EVENT 2
 
 #define TAG "AfeWakeWord"
 
 AfeWakeWord::AfeWakeWord()
-    : afe_data_(nullptr),
-      wake_word_pcm_(),
-      wake_word_opus_() {
+    : afe_data_(nullptr) {
 
     event_group_ = xEventGroupCreate();
 }
@@ -20,14 +21,6 @@ AfeWakeWord::~AfeWakeWord() {
         afe_iface_->destroy(afe_data_);
     }
 
-    if (wake_word_encode_task_stack_ != nullptr) {
-        heap_caps_free(wake_word_encode_task_stack_);
-    }
-
-    if (wake_word_encode_task_buffer_ != nullptr) {
-        heap_caps_free(wake_word_encode_task_buffer_);
-    }
-
     if (models_ != nullptr) {
         esp_srmodel_deinit(models_);
     }
@@ -36,6 +29,10 @@ AfeWakeWord::~AfeWakeWord() {
 }
 
 bool AfeWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list) {
+    // With a shared AFE the audio processor may have initialized it already
+    if (afe_data_ != nullptr) {
+        return true;
+    }
     codec_ = codec;
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -76,15 +73,36 @@ bool AfeWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list) {
     afe_config->afe_perferred_core = 1;
     afe_config->afe_perferred_priority = 1;
     afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+#if CONFIG_WAKE_WORD_PRECONNECT
+    // VAD onsets are reported as wake word candidates
+    afe_config->vad_init = true;
+#endif
+#if CONFIG_USE_SHARED_AFE
+    // The uplink audio comes from here too, so noise suppression and VAD as in AfeAudioProcessor
+    char* ns_model_name = esp_srmodel_filter(models_, ESP_NSNET_PREFIX, NULL);
+    char* vad_model_name = esp_srmodel_filter(models_, ESP_VADN_PREFIX, NULL);
+    afe_config->vad_init = true;
+    afe_config->vad_mode = VAD_MODE_0;
+    afe_config->vad_min_noise_ms = 100;
+    if (vad_model_name != nullptr) {
+        afe_config->vad_model_name = vad_model_name;
+    }
+    if (ns_model_name != nullptr) {
+        afe_config->ns_init = true;
+        afe_config->ns_model_name = ns_model_name;
+        afe_config->afe_ns_mode = AFE_NS_MODE_NET;
+    }
+    afe_config->agc_init = false;
+#endif
     
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
 
-    xTaskCreate([](void* arg) {
+    TaskManifest::Create("audio_detection", [](void* arg) {
         auto this_ = (AfeWakeWord*)arg;
         this_->AudioDetectionTask();
-        vTaskDelete(NULL);
-    }, "audio_detection", 4096, this, 3, nullptr);
+        TaskManifest::Exit();
+    }, this);
 
     return true;
 }
@@ -93,20 +111,76 @@ void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_
     wake_word_detected_callback_ = callback;
 }
 
+void AfeWakeWord::OnWakeWordCandidate(std::function<void()> callback) {
+    wake_word_candidate_callback_ = callback;
+}
+
 void AfeWakeWord::Start() {
+    if (afe_data_ != nullptr && IsProcessing()) {
+        afe_iface_->enable_wakenet(afe_data_);
+    }
     xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
 }
 
 void AfeWakeWord::Stop() {
     xEventGroupClearBits(event_group_, DETECTION_RUNNING_EVENT);
+    if (afe_data_ != nullptr && IsProcessing()) {
+        // Keeps cleaning the uplink audio, only the wake word is no longer looked for
+        afe_iface_->disable_wakenet(afe_data_);
+    }
+    ResetIfIdle();
+}
 
+// The buffered audio is only dropped once nobody fetches it, so AEC state survives a mode switch
+void AfeWakeWord::ResetIfIdle() {
     std::lock_guard<std::mutex> lock(input_buffer_mutex_);
+    if (xEventGroupGetBits(event_group_) & (DETECTION_RUNNING_EVENT | PROCESSING_RUNNING_EVENT)) {
+        return;
+    }
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
     }
     input_buffer_.clear();
 }
 
+void AfeWakeWord::OnProcessedAudio(std::function<void(afe_fetch_result_t* result)> callback) {
+    processed_audio_callback_ = callback;
+}
+
+void AfeWakeWord::StartProcessing() {
+    if (afe_data_ != nullptr && !IsDetecting()) {
+        afe_iface_->disable_wakenet(afe_data_);
+    }
+    xEventGroupSetBits(event_group_, PROCESSING_RUNNING_EVENT);
+}
+
+void AfeWakeWord::StopProcessing() {
+    xEventGroupClearBits(event_group_, PROCESSING_RUNNING_EVENT);
+    if (afe_data_ != nullptr) {
+        afe_iface_->enable_wakenet(afe_data_);
+    }
+    ResetIfIdle();
+}
+
+bool AfeWakeWord::IsDetecting() {
+    return xEventGroupGetBits(event_group_) & DETECTION_RUNNING_EVENT;
+}
+
+bool AfeWakeWord::IsProcessing() {
+    return xEventGroupGetBits(event_group_) & PROCESSING_RUNNING_EVENT;
+}
+
+void AfeWakeWord::EnableAec(bool enable) {
+    if (afe_data_ == nullptr) {
+        return;
+    }
+    if (enable) {
+        afe_iface_->enable_aec(afe_data_);
+    } else {
+        afe_iface_->disable_aec(afe_data_);
+    }
+}
+
 void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
     if (afe_data_ == nullptr) {
         return;
@@ -114,15 +188,31 @@ void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
 
     std::lock_guard<std::mutex> lock(input_buffer_mutex_);
     // Check running state inside lock to avoid TOCTOU race with Stop()
-    if (!(xEventGroupGetBits(event_group_) & DETECTION_RUNNING_EVENT)) {
+    if (!(xEventGroupGetBits(event_group_) & (DETECTION_RUNNING_EVENT | PROCESSING_RUNNING_EVENT))) {
         return;
     }
-    input_buffer_.insert(input_buffer_.end(), data.begin(), data.end());
     size_t chunk_size = afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
-    while (input_buffer_.size() >= chunk_size) {
+    const int16_t* src = data.data();
+    size_t left = data.size();
+    // Complete a partial chunk from the last feed first
+    if (!input_buffer_.empty()) {
+        size_t n = std::min(left, chunk_size - input_buffer_.size());
+        input_buffer_.insert(input_buffer_.end(), src, src + n);
+        src += n;
+        left -= n;
+        if (input_buffer_.size() < chunk_size) {
+            return;
+        }
         afe_iface_->feed(afe_data_, input_buffer_.data());
-        input_buffer_.erase(input_buffer_.begin(), input_buffer_.begin() + chunk_size);
+        input_buffer_.clear();
+    }
+    // Whole chunks go to the AFE straight from the caller's buffer
+    while (left >= chunk_size) {
+        afe_iface_->feed(afe_data_, src);
+        src += chunk_size;
+        left -= chunk_size;
     }
+    input_buffer_.insert(input_buffer_.end(), src, src + left);
 }
 
 size_t AfeWakeWord::GetFeedSize() {
@@ -139,16 +229,30 @@ void AfeWakeWord::AudioDetectionTask() {
         feed_size, fetch_size);
 
     while (true) {
-        xEventGroupWaitBits(event_group_, DETECTION_RUNNING_EVENT, pdFALSE, pdTRUE, portMAX_DELAY);
+        xEventGroupWaitBits(event_group_, DETECTION_RUNNING_EVENT | PROCESSING_RUNNING_EVENT, pdFALSE, pdFALSE, portMAX_DELAY);
 
         auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
         if (res == nullptr || res->ret_value == ESP_FAIL) {
             continue;;
         }
 
+        auto bits = xEventGroupGetBits(event_group_);
+        if ((bits & PROCESSING_RUNNING_EVENT) && processed_audio_callback_) {
+            processed_audio_callback_(res);
+        }
+        if (!(bits & DETECTION_RUNNING_EVENT)) {
+            continue;
+        }
+
         // Store the wake word data for voice recognition, like who is speaking
         StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
 
+        bool speech = res->vad_state == VAD_SPEECH;
+        if (speech && !candidate_speech_ && wake_word_candidate_callback_) {
+            wake_word_candidate_callback_();
+        }
+        candidate_speech_ = speech;
+
         if (res->wakeup_state == WAKENET_DETECTED) {
             Stop();
             last_detected_wake_word_ = wake_words_[res->wakenet_model_index - 1];
@@ -161,103 +265,13 @@ void AfeWakeWord::AudioDetectionTask() {
 }
 
 void AfeWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
-    // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
-        wake_word_pcm_.pop_front();
-    }
+    preroll_.Store(data, samples);
 }
 
 void AfeWakeWord::EncodeWakeWordData() {
-    const size_t stack_size = 4096 * 6;
-    wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
-        assert(wake_word_encode_task_stack_ != nullptr);
-    }
-    if (wake_word_encode_task_buffer_ == nullptr) {
-        wake_word_encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
-        assert(wake_word_encode_task_buffer_ != nullptr);
-    }
-
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
-        auto this_ = (AfeWakeWord*)arg;
-        {
-            auto start_time = esp_timer_get_time();
-            // Create encoder
-            esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG();
-            void* encoder_handle = nullptr;
-            auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &encoder_handle);
-            if (encoder_handle == nullptr) {
-                ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
-                std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-                this_->wake_word_cv_.notify_all();
-                return;
-            }
-            
-            // Get frame size
-            int frame_size = 0;
-            int outbuf_size = 0;
-            esp_opus_enc_get_frame_size(encoder_handle, &frame_size, &outbuf_size);
-            frame_size = frame_size / sizeof(int16_t);
-            
-            // Encode all PCM data
-            int packets = 0;
-            std::vector<int16_t> in_buffer;
-            esp_audio_enc_in_frame_t in = {};
-            esp_audio_enc_out_frame_t out = {};
-            
-            for (auto& pcm: this_->wake_word_pcm_) {
-                if (in_buffer.empty()) {
-                    in_buffer = std::move(pcm);
-                } else {
-                    in_buffer.reserve(in_buffer.size() + pcm.size());
-                    in_buffer.insert(in_buffer.end(), pcm.begin(), pcm.end());
-                }
-                
-                while (in_buffer.size() >= frame_size) {
-                    std::vector<uint8_t> opus_buf(outbuf_size);
-                    in.buffer = (uint8_t *)(in_buffer.data());
-                    in.len = (uint32_t)(frame_size * sizeof(int16_t));
-                    out.buffer = opus_buf.data();
-                    out.len = outbuf_size;
-                    out.encoded_bytes = 0;
-                    
-                    ret = esp_opus_enc_process(encoder_handle, &in, &out);
-                    if (ret == ESP_AUDIO_ERR_OK) {
-                        std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                        this_->wake_word_opus_.emplace_back(opus_buf.data(), opus_buf.data() + out.encoded_bytes);
-                        this_->wake_word_cv_.notify_all();
-                        packets++;
-                    } else {
-                        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
-                    }
-                    
-                    in_buffer.erase(in_buffer.begin(), in_buffer.begin() + frame_size);
-                }
-            }
-            this_->wake_word_pcm_.clear();
-            // Close encoder
-            esp_opus_enc_close(encoder_handle);
-            auto end_time = esp_timer_get_time();
-            ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
-
-            std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-            this_->wake_word_cv_.notify_all();
-        }
-        vTaskDelete(NULL);
-    }, "encode_wake_word", stack_size, this, 2, wake_word_encode_task_stack_, wake_word_encode_task_buffer_);
+    preroll_.Encode();
 }
 
 bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
-    std::unique_lock<std::mutex> lock(wake_word_mutex_);
-    wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
-    });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    return preroll_.GetOpus(opus);
 }
@@ -9,15 +9,14 @@
 #include <esp_nsn_models.h>
 #include <model_path.h>
 
-#include <deque>
 #include <string>
 #include <vector>
 #include <functional>
 #include <mutex>
-#include <condition_variable>
 
 #include "audio_codec.h"
 #include "wake_word.h"
+#include "wake_word_preroll.h"
 
 class AfeWakeWord : public WakeWord {
 public:
@@ -27,6 +26,7 @@ public:
     bool Initialize(AudioCodec* codec, srmodel_list_t* models_list);
     void Feed(const std::vector<int16_t>& data);
     void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback);
+    void OnWakeWordCandidate(std::function<void()> callback) override;
     void Start();
     void Stop();
     size_t GetFeedSize();
@@ -34,6 +34,15 @@ public:
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
+    // The same AFE also cleans the uplink audio with CONFIG_USE_SHARED_AFE, every fetch result
+    // is handed to the callback while processing runs, with or without detection
+    void OnProcessedAudio(std::function<void(afe_fetch_result_t* result)> callback);
+    void StartProcessing();
+    void StopProcessing();
+    bool IsDetecting();
+    bool IsProcessing();
+    void EnableAec(bool enable);
+
 private:
     srmodel_list_t *models_ = nullptr;
     const esp_afe_sr_iface_t* afe_iface_ = nullptr;
@@ -42,20 +51,18 @@ private:
     std::vector<std::string> wake_words_;
     EventGroupHandle_t event_group_;
     std::function<void(const std::string& wake_word)> wake_word_detected_callback_;
+    std::function<void()> wake_word_candidate_callback_;
+    std::function<void(afe_fetch_result_t* result)> processed_audio_callback_;
+    bool candidate_speech_ = false;
     AudioCodec* codec_ = nullptr;
     std::string last_detected_wake_word_;
     std::vector<int16_t> input_buffer_;
     std::mutex input_buffer_mutex_;
 
-    TaskHandle_t wake_word_encode_task_ = nullptr;
-    StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
-    StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
-    std::deque<std::vector<uint8_t>> wake_word_opus_;
-    std::mutex wake_word_mutex_;
-    std::condition_variable wake_word_cv_;
+    WakeWordPreroll preroll_;
 
     void StoreWakeWordData(const int16_t* data, size_t size);
+    void ResetIfIdle();
     void AudioDetectionTask();
 };
 
@@ -4,15 +4,22 @@
 #include "assets.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <esp_mn_iface.h>
 #include <esp_mn_models.h>
 #include <esp_mn_speech_commands.h>
 #include <cJSON.h>
+#include <algorithm>
+#include <cstdlib>
 
 #define TAG "CustomWakeWord"
 
-CustomWakeWord::CustomWakeWord()
-    : wake_word_pcm_(), wake_word_opus_() {
+// About -36 dBFS mean level held for ~90 ms starts a candidate, ~600 ms of quiet ends it (30 ms chunks)
+#define CANDIDATE_MEAN_ABS_THRESHOLD 500
+#define CANDIDATE_LOUD_CHUNKS 3
+#define CANDIDATE_QUIET_CHUNKS 20
+
+CustomWakeWord::CustomWakeWord() {
 }
 
 CustomWakeWord::~CustomWakeWord() {
@@ -21,14 +28,6 @@ CustomWakeWord::~CustomWakeWord() {
         multinet_model_data_ = nullptr;
     }
 
-    if (wake_word_encode_task_stack_ != nullptr) {
-        heap_caps_free(wake_word_encode_task_stack_);
-    }
-
-    if (wake_word_encode_task_buffer_ != nullptr) {
-        heap_caps_free(wake_word_encode_task_buffer_);
-    }
-
     if (models_ != nullptr) {
         esp_srmodel_deinit(models_);
     }
@@ -70,9 +69,13 @@ void CustomWakeWord::ParseWakenetModelConfig() {
                     cJSON* command_name = cJSON_GetObjectItem(command, "command");
                     cJSON* text = cJSON_GetObjectItem(command, "text");
                     cJSON* action = cJSON_GetObjectItem(command, "action");
+                    // Optional, the model threshold by default
+                    cJSON* command_threshold = cJSON_GetObjectItem(command, "threshold");
                     if (cJSON_IsString(command_name) && cJSON_IsString(text) && cJSON_IsString(action)) {
-                        commands_.push_back({command_name->valuestring, text->valuestring, action->valuestring});
-                        ESP_LOGI(TAG, "Command: %s, Text: %s, Action: %s", command_name->valuestring, text->valuestring, action->valuestring);
+                        float value = cJSON_IsNumber(command_threshold) ? command_threshold->valuedouble : threshold_;
+                        commands_.push_back({command_name->valuestring, text->valuestring, action->valuestring, value});
+                        ESP_LOGI(TAG, "Command: %s, Text: %s, Action: %s, Threshold: %.2f", command_name->valuestring,
+                            text->valuestring, action->valuestring, value);
                     }
                 }
             }
@@ -91,7 +94,7 @@ bool CustomWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list)
         models_ = esp_srmodel_init("model");
 #ifdef CONFIG_CUSTOM_WAKE_WORD
         threshold_ = CONFIG_CUSTOM_WAKE_WORD_THRESHOLD / 100.0f;
-        commands_.push_back({CONFIG_CUSTOM_WAKE_WORD, CONFIG_CUSTOM_WAKE_WORD_DISPLAY, "wake"});
+        commands_.push_back({CONFIG_CUSTOM_WAKE_WORD, CONFIG_CUSTOM_WAKE_WORD_DISPLAY, "wake", threshold_});
 #endif
     } else {
         models_ = models_list;
@@ -117,7 +120,12 @@ bool CustomWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list)
 
     multinet_ = esp_mn_handle_from_name(mn_name_);
     multinet_model_data_ = multinet_->create(mn_name_, duration_);
-    multinet_->set_det_threshold(multinet_model_data_, threshold_);
+    // The model reports everything above the lowest threshold, each command checks its own
+    float det_threshold = threshold_;
+    for (auto& command : commands_) {
+        det_threshold = std::min(det_threshold, command.threshold);
+    }
+    multinet_->set_det_threshold(multinet_model_data_, det_threshold);
     esp_mn_commands_clear();
     for (int i = 0; i < commands_.size(); i++) {
         esp_mn_commands_add(i + 1, commands_[i].command.c_str());
@@ -132,6 +140,35 @@ void CustomWakeWord::OnWakeWordDetected(std::function<void(const std::string& wa
     wake_word_detected_callback_ = callback;
 }
 
+void CustomWakeWord::OnWakeWordCandidate(std::function<void()> callback) {
+    wake_word_candidate_callback_ = callback;
+}
+
+void CustomWakeWord::OnCommandDetected(std::function<void(const WakeWordCommand& command)> callback) {
+    command_detected_callback_ = callback;
+}
+
+// Multinet has no partial score, speech onset is found with a plain energy gate instead
+void CustomWakeWord::CheckCandidate(const int16_t* chunk, size_t samples) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += std::abs(chunk[i]);
+    }
+    bool loud = sum / (int64_t)samples > CANDIDATE_MEAN_ABS_THRESHOLD;
+    loud_chunks_ = loud ? loud_chunks_ + 1 : 0;
+    quiet_chunks_ = loud ? 0 : quiet_chunks_ + 1;
+    if (!candidate_speech_ && loud_chunks_ >= CANDIDATE_LOUD_CHUNKS) {
+        candidate_speech_ = true;
+        // The loud chunks that started it count as speech
+        speech_onset_us_ = esp_timer_get_time() - (int64_t)CANDIDATE_LOUD_CHUNKS * samples * 1000000 / 16000;
+        if (wake_word_candidate_callback_) {
+            wake_word_candidate_callback_();
+        }
+    } else if (candidate_speech_ && quiet_chunks_ >= CANDIDATE_QUIET_CHUNKS) {
+        candidate_speech_ = false;
+    }
+}
+
 void CustomWakeWord::Start() {
     running_ = true;
 }
@@ -165,27 +202,16 @@ void CustomWakeWord::Feed(const std::vector<int16_t>& data) {
     
     int chunksize = multinet_->get_samp_chunksize(multinet_model_data_);
     while (input_buffer_.size() >= chunksize) {
-        std::vector<int16_t> chunk(input_buffer_.begin(), input_buffer_.begin() + chunksize);
-        StoreWakeWordData(chunk);
+        // Read in place, input_buffer_ keeps its capacity between feeds
+        int16_t* chunk = input_buffer_.data();
+        StoreWakeWordData(chunk, chunksize);
+        // Also timestamps the speech onset for the command latency
+        CheckCandidate(chunk, chunksize);
         
-        esp_mn_state_t mn_state = multinet_->detect(multinet_model_data_, chunk.data());
+        esp_mn_state_t mn_state = multinet_->detect(multinet_model_data_, chunk);
         
         if (mn_state == ESP_MN_STATE_DETECTED) {
-            esp_mn_results_t *mn_result = multinet_->get_results(multinet_model_data_);
-            for (int i = 0; i < mn_result->num && running_; i++) {
-                ESP_LOGI(TAG, "Custom wake word detected: command_id=%d, string=%s, prob=%f", 
-                        mn_result->command_id[i], mn_result->string, mn_result->prob[i]);
-                auto& command = commands_[mn_result->command_id[i] - 1];
-                if (command.action == "wake") {
-                    last_detected_wake_word_ = command.text;
-                    running_ = false;
-                    input_buffer_.clear();
-                    
-                    if (wake_word_detected_callback_) {
-                        wake_word_detected_callback_(last_detected_wake_word_);
-                    }
-                }
-            }
+            HandleResults(multinet_->get_results(multinet_model_data_));
             multinet_->clean(multinet_model_data_);
         } else if (mn_state == ESP_MN_STATE_TIMEOUT) {
             ESP_LOGD(TAG, "Command word detection timeout, cleaning state");
@@ -199,6 +225,37 @@ void CustomWakeWord::Feed(const std::vector<int16_t>& data) {
     }
 }
 
+// Results come best first, the first one above its command's threshold wins
+void CustomWakeWord::HandleResults(esp_mn_results_t* results) {
+    int latency_ms = speech_onset_us_ > 0 ? (int)((esp_timer_get_time() - speech_onset_us_) / 1000) : 0;
+    for (int i = 0; i < results->num; i++) {
+        int id = results->command_id[i];
+        if (id < 1 || id > (int)commands_.size()) {
+            continue;
+        }
+        auto& command = commands_[id - 1];
+        float prob = results->prob[i];
+        ESP_LOGI(TAG, "Result %d: %s (%s), prob=%.2f, threshold=%.2f, %d ms after onset", i, command.command.c_str(),
+            command.action.c_str(), prob, command.threshold, latency_ms);
+        if (prob < command.threshold) {
+            continue;
+        }
+
+        if (command.action == "wake") {
+            last_detected_wake_word_ = command.text;
+            running_ = false;
+            input_buffer_.clear();
+
+            if (wake_word_detected_callback_) {
+                wake_word_detected_callback_(last_detected_wake_word_);
+            }
+        } else if (command_detected_callback_) {
+            command_detected_callback_({command.command, command.text, command.action, prob, latency_ms});
+        }
+        return;
+    }
+}
+
 size_t CustomWakeWord::GetFeedSize() {
     if (multinet_model_data_ == nullptr) {
         return 0;
@@ -206,98 +263,14 @@ size_t CustomWakeWord::GetFeedSize() {
     return multinet_->get_samp_chunksize(multinet_model_data_);
 }
 
-void CustomWakeWord::StoreWakeWordData(const std::vector<int16_t>& data) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.push_back(data);
-    // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
-        wake_word_pcm_.pop_front();
-    }
+void CustomWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
+    preroll_.Store(data, samples);
 }
 
 void CustomWakeWord::EncodeWakeWordData() {
-    const size_t stack_size = 4096 * 7;
-    wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
-        assert(wake_word_encode_task_stack_ != nullptr);
-    }
-    if (wake_word_encode_task_buffer_ == nullptr) {
-        wake_word_encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
-        assert(wake_word_encode_task_buffer_ != nullptr);
-    }
-
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
-        auto this_ = (CustomWakeWord*)arg;
-        {
-            auto start_time = esp_timer_get_time();
-            // Create encoder
-            esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG();
-            void* encoder_handle = nullptr;
-            auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &encoder_handle);
-            if (encoder_handle == nullptr) {
-                ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
-                std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-                this_->wake_word_cv_.notify_all();
-                return;
-            }
-            // Get frame size
-            int frame_size = 0;
-            int outbuf_size = 0;
-            esp_opus_enc_get_frame_size(encoder_handle, &frame_size, &outbuf_size);
-            frame_size = frame_size / sizeof(int16_t);
-            // Encode all PCM data
-            int packets = 0;
-            std::vector<int16_t> in_buffer;
-            esp_audio_enc_in_frame_t in = {};
-            esp_audio_enc_out_frame_t out = {};
-            for (auto& pcm: this_->wake_word_pcm_) {
-                if (in_buffer.empty()) {
-                    in_buffer = std::move(pcm);
-                } else {
-                    in_buffer.reserve(in_buffer.size() + pcm.size());
-                    in_buffer.insert(in_buffer.end(), pcm.begin(), pcm.end());
-                }
-                while (in_buffer.size() >= frame_size) {
-                    std::vector<uint8_t> opus_buf(outbuf_size);
-                    in.buffer = (uint8_t *)(in_buffer.data());
-                    in.len = (uint32_t)(frame_size * sizeof(int16_t));
-                    out.buffer = opus_buf.data();
-                    out.len = outbuf_size;
-                    out.encoded_bytes = 0;
-                    ret = esp_opus_enc_process(encoder_handle, &in, &out);
-                    if (ret == ESP_AUDIO_ERR_OK) {
-                        std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                        this_->wake_word_opus_.emplace_back(opus_buf.data(), opus_buf.data() + out.encoded_bytes);
-                        this_->wake_word_cv_.notify_all();
-                        packets++;
-                    } else {
-                        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
-                    }
-                    in_buffer.erase(in_buffer.begin(), in_buffer.begin() + frame_size);
-                }
-            }
-            this_->wake_word_pcm_.clear();
-            // Close encoder
-            esp_opus_enc_close(encoder_handle);
-            auto end_time = esp_timer_get_time();
-            ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
-
-            std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-            this_->wake_word_cv_.notify_all();
-        }
-        vTaskDelete(NULL);
-    }, "encode_wake_word", stack_size, this, 2, wake_word_encode_task_stack_, wake_word_encode_task_buffer_);
+    preroll_.Encode();
 }
 
 bool CustomWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
-    std::unique_lock<std::mutex> lock(wake_word_mutex_);
-    wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
-    });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    return preroll_.GetOpus(opus);
 }
@@ -11,11 +11,11 @@
 #include <vector>
 #include <functional>
 #include <mutex>
-#include <condition_variable>
 #include <atomic>
 
 #include "audio_codec.h"
 #include "wake_word.h"
+#include "wake_word_preroll.h"
 
 class CustomWakeWord : public WakeWord {
 public:
@@ -25,6 +25,8 @@ public:
     bool Initialize(AudioCodec* codec, srmodel_list_t* models_list);
     void Feed(const std::vector<int16_t>& data);
     void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback);
+    void OnWakeWordCandidate(std::function<void()> callback) override;
+    void OnCommandDetected(std::function<void(const WakeWordCommand& command)> callback) override;
     void Start();
     void Stop();
     size_t GetFeedSize();
@@ -37,6 +39,8 @@ private:
         std::string command;
         std::string text;
         std::string action;
+        // Results below this confidence are ignored
+        float threshold;
     };
 
     // multinet 相关成员变量
@@ -50,22 +54,25 @@ private:
     std::deque<Command> commands_;
  
     std::function<void(const std::string& wake_word)> wake_word_detected_callback_;
+    std::function<void()> wake_word_candidate_callback_;
+    std::function<void(const WakeWordCommand& command)> command_detected_callback_;
+    // Energy gate for candidates: consecutive loud / quiet chunks
+    int loud_chunks_ = 0;
+    int quiet_chunks_ = 0;
+    bool candidate_speech_ = false;
+    int64_t speech_onset_us_ = 0;
     AudioCodec* codec_ = nullptr;
     std::string last_detected_wake_word_;
     std::atomic<bool> running_ = false;
     std::vector<int16_t> input_buffer_;
     std::mutex input_buffer_mutex_;
 
-    TaskHandle_t wake_word_encode_task_ = nullptr;
-    StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
-    StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
-    std::deque<std::vector<uint8_t>> wake_word_opus_;
-    std::mutex wake_word_mutex_;
-    std::condition_variable wake_word_cv_;
+    WakeWordPreroll preroll_;
 
-    void StoreWakeWordData(const std::vector<int16_t>& data);
+    void CheckCandidate(const int16_t* chunk, size_t samples);
+    void StoreWakeWordData(const int16_t* data, size_t samples);
     void ParseWakenetModelConfig();
+    void HandleResults(esp_mn_results_t* results);
 };
 
 #endif
@@ -0,0 +1,186 @@
+#include "wake_word_preroll.h"
+#include "audio_service.h"
+#include "wake_word.h"
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "WakeWordPreroll"
+
+#if CONFIG_WAKE_WORD_PREENCODE
+// The PCM only waits here until the encoder task gets to it
+#define PREROLL_PCM_SAMPLES (16 * CONFIG_AUDIO_UPLINK_FRAME_DURATION_MS * 8)
+#define PREROLL_PACKETS (2000 / CONFIG_AUDIO_UPLINK_FRAME_DURATION_MS)
+#else
+#define PREROLL_PCM_SAMPLES WAKE_WORD_PCM_SAMPLES
+#endif
+
+WakeWordPreroll::WakeWordPreroll() : pcm_(PREROLL_PCM_SAMPLES) {
+#if CONFIG_WAKE_WORD_PREENCODE
+    TaskManifest::Create("preencode_wake", [](void* arg) {
+        static_cast<WakeWordPreroll*>(arg)->PreencodeTask();
+    }, this, &encode_task_);
+#endif
+}
+
+WakeWordPreroll::~WakeWordPreroll() {
+    // The wake word lives as long as the audio service, the task is never stopped
+}
+
+void WakeWordPreroll::Store(const int16_t* data, size_t samples) {
+    pcm_.Write(data, samples);
+#if CONFIG_WAKE_WORD_PREENCODE
+    xTaskNotifyGive(encode_task_);
+#endif
+}
+
+void WakeWordPreroll::EndOpus() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    opus_.push_back(std::vector<uint8_t>());
+    cv_.notify_all();
+}
+
+#if CONFIG_WAKE_WORD_PREENCODE
+void WakeWordPreroll::PreencodeTask() {
+    // Wake word audio uses the uplink settings at the lowest complexity, it runs all the time
+    OpusEncoderSettings settings;
+    settings.complexity = 0;
+    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG(settings);
+    void* encoder_handle = nullptr;
+    auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &encoder_handle);
+    if (encoder_handle == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
+        TaskManifest::Exit();
+        return;
+    }
+
+    int frame_size = 0;
+    int outbuf_size = 0;
+    esp_opus_enc_get_frame_size(encoder_handle, &frame_size, &outbuf_size);
+    frame_size = frame_size / sizeof(int16_t);
+    {
+        std::lock_guard<std::mutex> lock(packet_mutex_);
+        packet_slot_size_ = outbuf_size;
+        packet_data_.resize(PREROLL_PACKETS * packet_slot_size_);
+        packet_lengths_.resize(PREROLL_PACKETS);
+    }
+
+    std::vector<int16_t> in_buffer(frame_size);
+    esp_audio_enc_in_frame_t in = {};
+    esp_audio_enc_out_frame_t out = {};
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Only whole frames are taken, the rest waits for the next chunk
+        while (pcm_.size() >= (size_t)frame_size) {
+            pcm_.Read(in_buffer.data(), frame_size);
+            std::lock_guard<std::mutex> lock(packet_mutex_);
+            size_t slot = (packet_head_ + packet_count_) % PREROLL_PACKETS;
+            if (packet_count_ == PREROLL_PACKETS) {
+                packet_head_ = (packet_head_ + 1) % PREROLL_PACKETS;
+            } else {
+                packet_count_++;
+            }
+            in.buffer = (uint8_t*)in_buffer.data();
+            in.len = (uint32_t)(frame_size * sizeof(int16_t));
+            out.buffer = packet_data_.data() + slot * packet_slot_size_;
+            out.len = packet_slot_size_;
+            out.encoded_bytes = 0;
+            ret = esp_opus_enc_process(encoder_handle, &in, &out);
+            if (ret != ESP_AUDIO_ERR_OK) {
+                ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+                out.encoded_bytes = 0;
+            }
+            packet_lengths_[slot] = out.encoded_bytes;
+        }
+    }
+}
+
+void WakeWordPreroll::Encode() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        opus_.clear();
+        std::lock_guard<std::mutex> packet_lock(packet_mutex_);
+        for (size_t i = 0; i < packet_count_; i++) {
+            size_t slot = (packet_head_ + i) % PREROLL_PACKETS;
+            // DTX may leave empty packets, an empty packet ends the stream
+            if (packet_lengths_[slot] > 0) {
+                auto data = packet_data_.data() + slot * packet_slot_size_;
+                opus_.emplace_back(data, data + packet_lengths_[slot]);
+            }
+        }
+        ESP_LOGI(TAG, "Handing over %u pre-encoded wake word packets", opus_.size());
+        packet_head_ = 0;
+        packet_count_ = 0;
+    }
+    EndOpus();
+}
+#else
+void WakeWordPreroll::Encode() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        opus_.clear();
+    }
+    TaskManifest::Create("encode_wake_word", [](void* arg) {
+        static_cast<WakeWordPreroll*>(arg)->EncodeTask();
+        TaskManifest::Exit();
+    }, this, &encode_task_);
+}
+#endif
+
+void WakeWordPreroll::EncodeTask() {
+    auto start_time = esp_timer_get_time();
+    // Wake word audio always uses the configured default uplink settings
+    OpusEncoderSettings settings;
+    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG(settings);
+    void* encoder_handle = nullptr;
+    auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &encoder_handle);
+    if (encoder_handle == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
+        EndOpus();
+        return;
+    }
+
+    int frame_size = 0;
+    int outbuf_size = 0;
+    esp_opus_enc_get_frame_size(encoder_handle, &frame_size, &outbuf_size);
+    frame_size = frame_size / sizeof(int16_t);
+
+    // Encode all PCM data, a partial last frame is dropped
+    int packets = 0;
+    std::vector<int16_t> in_buffer(frame_size);
+    std::vector<uint8_t> opus_buf(outbuf_size);
+    esp_audio_enc_in_frame_t in = {};
+    esp_audio_enc_out_frame_t out = {};
+    while (pcm_.Read(in_buffer.data(), frame_size) == (size_t)frame_size) {
+        in.buffer = (uint8_t*)in_buffer.data();
+        in.len = (uint32_t)(frame_size * sizeof(int16_t));
+        out.buffer = opus_buf.data();
+        out.len = outbuf_size;
+        out.encoded_bytes = 0;
+        ret = esp_opus_enc_process(encoder_handle, &in, &out);
+        if (ret == ESP_AUDIO_ERR_OK) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            opus_.emplace_back(opus_buf.data(), opus_buf.data() + out.encoded_bytes);
+            cv_.notify_all();
+            packets++;
+        } else {
+            ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+        }
+    }
+    pcm_.Clear();
+    esp_opus_enc_close(encoder_handle);
+    auto end_time = esp_timer_get_time();
+    ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
+    EndOpus();
+}
+
+bool WakeWordPreroll::GetOpus(std::vector<uint8_t>& opus) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() {
+        return !opus_.empty();
+    });
+    opus.swap(opus_.front());
+    opus_.pop_front();
+    return !opus.empty();
+}
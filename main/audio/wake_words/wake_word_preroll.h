@@ -0,0 +1,57 @@
+#ifndef WAKE_WORD_PREROLL_H
+#define WAKE_WORD_PREROLL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "pcm_ring.h"
+
+/*
+ * The audio before a wake word, handed to the server as Opus packets.
+ *
+ * By default the last WAKE_WORD_PCM_SAMPLES of PCM are kept and encoded on a short lived task
+ * once the wake word fires. With CONFIG_WAKE_WORD_PREENCODE a long lived low priority task
+ * encodes the PCM as it arrives at complexity 0 and keeps the last two seconds of packets,
+ * so Encode() only has to hand them over.
+ */
+class WakeWordPreroll {
+public:
+    WakeWordPreroll();
+    ~WakeWordPreroll();
+
+    // Detection task: the PCM checked for the wake word
+    void Store(const int16_t* data, size_t samples);
+    // Starts handing out the pre-roll, ends with an empty packet
+    void Encode();
+    // Waits for the next packet, false at the end
+    bool GetOpus(std::vector<uint8_t>& opus);
+
+private:
+    PcmRing pcm_;
+    TaskHandle_t encode_task_ = nullptr;
+    std::deque<std::vector<uint8_t>> opus_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+#if CONFIG_WAKE_WORD_PREENCODE
+    // Encoded packets in fixed slots, packet_count_ of them from packet_head_ on
+    std::vector<uint8_t> packet_data_;
+    std::vector<uint16_t> packet_lengths_;
+    size_t packet_slot_size_ = 0;
+    size_t packet_head_ = 0;
+    size_t packet_count_ = 0;
+    std::mutex packet_mutex_;
+
+    void PreencodeTask();
+#endif
+    void EncodeTask();
+    void EndOpus();
+};
+
+#endif // WAKE_WORD_PREROLL_H
@@ -1,4 +1,17 @@
 #include "adc_battery_monitor.h"
+#include "application.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
+
+#include <algorithm>
+
+#define ADC_BATTERY_SAMPLE_INTERVAL_MS 10000
+#define ADC_BATTERY_STANDBY_SAMPLE_INTERVAL_MS 60000
+// Weight of a new reading in the level EMA
+#define ADC_BATTERY_EMA_ALPHA 0.25f
+// The battery icon changes every 20%
+#define ADC_BATTERY_DISPLAY_STEP 20
 
 AdcBatteryMonitor::AdcBatteryMonitor(adc_unit_t adc_unit, adc_channel_t adc_channel, float upper_resistor, float lower_resistor, gpio_num_t charging_pin)
     : charging_pin_(charging_pin) {
@@ -10,9 +23,15 @@ AdcBatteryMonitor::AdcBatteryMonitor(adc_unit_t adc_unit, adc_channel_t adc_chan
             .mode = GPIO_MODE_INPUT,
             .pull_up_en = GPIO_PULLUP_DISABLE,
             .pull_down_en = GPIO_PULLDOWN_DISABLE,
-            .intr_type = GPIO_INTR_DISABLE,
+            .intr_type = GPIO_INTR_ANYEDGE,
         };
         ESP_ERROR_CHECK(gpio_config(&gpio_cfg));
+        // Another driver may have installed the service already
+        esp_err_t err = gpio_install_isr_service(0);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            ESP_ERROR_CHECK(err);
+        }
+        ESP_ERROR_CHECK(gpio_isr_handler_add(charging_pin_, ChargingPinIsr, this));
     }
 
     // Initialize ADC battery estimation
@@ -41,20 +60,29 @@ AdcBatteryMonitor::AdcBatteryMonitor(adc_unit_t adc_unit, adc_channel_t adc_chan
     }
     adc_battery_estimation_handle_ = adc_battery_estimation_create(&adc_cfg);
 
-    // Initialize timer
+    // One shot, rearmed after every sample with the interval for the current power state
     esp_timer_create_args_t timer_cfg = {
         .callback = [](void *arg) {
             AdcBatteryMonitor *self = (AdcBatteryMonitor *)arg;
+            self->SampleLevel();
             self->CheckBatteryStatus();
+            bool standby = Application::GetInstance().IsStandby();
+            int interval_ms = standby ? ADC_BATTERY_STANDBY_SAMPLE_INTERVAL_MS : ADC_BATTERY_SAMPLE_INTERVAL_MS;
+            esp_timer_start_once(self->timer_handle_, (uint64_t)interval_ms * 1000);
         },
         .arg = this,
         .name = "adc_battery_monitor",
     };
     ESP_ERROR_CHECK(esp_timer_create(&timer_cfg, &timer_handle_));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(timer_handle_, 1000000));
+    SampleLevel();
+    is_charging_ = IsCharging();
+    ESP_ERROR_CHECK(esp_timer_start_once(timer_handle_, ADC_BATTERY_SAMPLE_INTERVAL_MS * 1000));
 }
 
 AdcBatteryMonitor::~AdcBatteryMonitor() {
+    if (charging_pin_ != GPIO_NUM_NC) {
+        gpio_isr_handler_remove(charging_pin_);
+    }
     if (adc_battery_estimation_handle_) {
         ESP_ERROR_CHECK(adc_battery_estimation_destroy(adc_battery_estimation_handle_));
     }
@@ -88,17 +116,36 @@ bool AdcBatteryMonitor::IsDischarging() {
 }
 
 uint8_t AdcBatteryMonitor::GetBatteryLevel() {
-    // 如果句柄无效，返回默认值
+    return level_;
+}
+
+void AdcBatteryMonitor::SampleLevel() {
+    // 如果句柄无效，保持默认值
     if (adc_battery_estimation_handle_ == nullptr) {
-        return 100;
+        return;
     }
     
     float capacity = 0;
     esp_err_t err = adc_battery_estimation_get_capacity(adc_battery_estimation_handle_, &capacity);
     if (err != ESP_OK) {
-        return 100; // 出错时返回默认值
+        return; // 出错时保持上次的值
+    }
+    level_ema_ = level_ema_ < 0 ? capacity : level_ema_ + ADC_BATTERY_EMA_ALPHA * (capacity - level_ema_);
+
+    uint8_t level = (uint8_t)std::clamp(level_ema_ + 0.5f, 0.0f, 100.0f);
+    uint8_t last = level_.exchange(level);
+    if (level / ADC_BATTERY_DISPLAY_STEP != last / ADC_BATTERY_DISPLAY_STEP) {
+        Application::GetInstance().RefreshStatusBar();
     }
-    return (uint8_t)capacity;
+}
+
+void IRAM_ATTR AdcBatteryMonitor::ChargingPinIsr(void* arg) {
+    // Checked on the timer service task, the ISR only hands it over
+    BaseType_t woken = pdFALSE;
+    xTimerPendFunctionCallFromISR([](void* arg, uint32_t) {
+        static_cast<AdcBatteryMonitor*>(arg)->CheckBatteryStatus();
+    }, arg, 0, &woken);
+    portYIELD_FROM_ISR(woken);
 }
 
 void AdcBatteryMonitor::OnChargingStatusChanged(std::function<void(bool)> callback) {
@@ -107,10 +154,10 @@ void AdcBatteryMonitor::OnChargingStatusChanged(std::function<void(bool)> callba
 
 void AdcBatteryMonitor::CheckBatteryStatus() {
     bool new_charging_status = IsCharging();
-    if (new_charging_status != is_charging_) {
-        is_charging_ = new_charging_status;
+    if (is_charging_.exchange(new_charging_status) != new_charging_status) {
+        Application::GetInstance().RefreshStatusBar();
         if (on_charging_status_changed_) {
-            on_charging_status_changed_(is_charging_);
+            on_charging_status_changed_(new_charging_status);
         }
     }
 }
\ No newline at end of file
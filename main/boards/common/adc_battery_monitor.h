@@ -1,11 +1,18 @@
 #ifndef ADC_BATTERY_MONITOR_H
 #define ADC_BATTERY_MONITOR_H
 
+#include <atomic>
 #include <functional>
 #include <driver/gpio.h>
 #include <adc_battery_estimation.h>
 #include <esp_timer.h>
 
+/*
+ * Samples the battery every 10 seconds, once a minute while the application is in standby,
+ * and keeps the level as an EMA, so GetBatteryLevel() never touches the ADC. The status bar
+ * is only refreshed when the level crosses one of the 20% icon steps. A charging pin raises
+ * an interrupt instead of being polled.
+ */
 class AdcBatteryMonitor {
 public:
     AdcBatteryMonitor(adc_unit_t adc_unit, adc_channel_t adc_channel, float upper_resistor, float lower_resistor, gpio_num_t charging_pin = GPIO_NUM_NC);
@@ -21,10 +28,14 @@ private:
     gpio_num_t charging_pin_;
     adc_battery_estimation_handle_t adc_battery_estimation_handle_ = nullptr;
     esp_timer_handle_t timer_handle_ = nullptr;
-    bool is_charging_ = false;
+    std::atomic<bool> is_charging_{false};
     std::function<void(bool)> on_charging_status_changed_;
+    float level_ema_ = -1;
+    std::atomic<uint8_t> level_{100};
 
     void CheckBatteryStatus();
+    void SampleLevel();
+    static void IRAM_ATTR ChargingPinIsr(void* arg);
 };
 
 #endif // ADC_BATTERY_MONITOR_H
@@ -1,9 +1,8 @@
 #include "afsk_demod.h"
 #include <cstring>
 #include <algorithm>
+#include <limits>
 #include "esp_log.h"
-#include "display.h"
-#include "ssid_manager.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -13,100 +12,6 @@ namespace audio_wifi_config
 {
     static const char *kLogTag = "AUDIO_WIFI_CONFIG";
 
-    void ReceiveWifiCredentialsFromAudio(Application *app,
-                                        WifiManager *wifi_manager,
-                                        Display *display,
-                                        size_t input_channels
-                                    )
-    {
-        const int kInputSampleRate = 16000;                                    // Input sampling rate
-        const float kDownsampleStep = static_cast<float>(kInputSampleRate) / static_cast<float>(kAudioSampleRate); // Downsampling step
-        std::vector<int16_t> audio_data;
-        AudioSignalProcessor signal_processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate, kWindowSize);
-        AudioDataBuffer data_buffer;
-
-        while (true)
-        {
-            // 检查Application状态，只有在WiFi配置模式下才处理音频
-            if (app->GetDeviceState() != kDeviceStateWifiConfiguring) {
-                // 不在WiFi配置状态，休眠100ms后再检查
-                vTaskDelay(pdMS_TO_TICKS(100));
-                continue;
-            }
-            
-            if (!app->GetAudioService().ReadAudioData(audio_data, 16000, 480)) { // 16kHz, 480 samples corresponds to 30ms data
-                // 读取音频失败，短暂延迟后重试
-                ESP_LOGI(kLogTag, "Failed to read audio data, retrying.");
-                vTaskDelay(pdMS_TO_TICKS(10));
-                continue;
-            }
-
-            if (input_channels == 2) { // 如果是双声道输入，转换为单声道
-                auto mono_data = std::vector<int16_t>(audio_data.size() / 2);
-                for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                    mono_data[i] = audio_data[j];
-                }
-                audio_data = std::move(mono_data);
-            }
-            
-            // Downsample the audio data
-            std::vector<float> downsampled_data;
-            size_t last_index = 0;
-
-            if (kDownsampleStep > 1.0f) {
-                downsampled_data.reserve(audio_data.size() / static_cast<size_t>(kDownsampleStep));
-                for (size_t i = 0; i < audio_data.size(); ++i) {
-                    size_t sample_index = static_cast<size_t>(i / kDownsampleStep);
-                    if ((sample_index + 1) > last_index) {
-                        downsampled_data.push_back(static_cast<float>(audio_data[i]));
-                        last_index = sample_index + 1;
-                    }
-                }
-            } else {
-                downsampled_data.reserve(audio_data.size());
-                for (int16_t sample : audio_data) {
-                    downsampled_data.push_back(static_cast<float>(sample));
-                }
-            }
-            
-            // Process audio samples to get probability data
-            auto probabilities = signal_processor.ProcessAudioSamples(downsampled_data);
-            
-            // Feed probability data to the data buffer
-            if (data_buffer.ProcessProbabilityData(probabilities, 0.5f)) {
-                // If complete data was received, extract WiFi credentials
-                if (data_buffer.decoded_text.has_value()) {
-                    ESP_LOGI(kLogTag, "Received text data: %s", data_buffer.decoded_text->c_str());
-                    display->SetChatMessage("system", data_buffer.decoded_text->c_str());
-                    
-                    // Split SSID and password by newline character
-                    std::string wifi_ssid, wifi_password;
-                    size_t newline_position = data_buffer.decoded_text->find('\n');
-                    if (newline_position != std::string::npos) {
-                        wifi_ssid = data_buffer.decoded_text->substr(0, newline_position);
-                        wifi_password = data_buffer.decoded_text->substr(newline_position + 1);
-                        ESP_LOGI(kLogTag, "WiFi SSID: %s, Password: %s", wifi_ssid.c_str(), wifi_password.c_str());
-                    } else {
-                        ESP_LOGE(kLogTag, "Invalid data format, no newline character found");
-                        continue;
-                    }
-                    
-                    // Save WiFi credentials using SsidManager
-                    auto& ssid_manager = SsidManager::GetInstance();
-                    ssid_manager.AddSsid(wifi_ssid, wifi_password);
-                    ESP_LOGI(kLogTag, "WiFi credentials saved successfully");
-                    
-                    // Exit config mode (triggers ConfigModeExit event)
-                    wifi_manager->StopConfigAp();
-                    
-                    data_buffer.decoded_text.reset();  // Clear processed data
-                    return;  // Exit the function
-                }
-            }
-            vTaskDelay(pdMS_TO_TICKS(1));  // 1ms delay
-        }
-    }
-
     // Default start and end transmission identifiers
     // \x01\x02 = 00000001 00000010
     const std::vector<uint8_t> kDefaultStartTransmissionPattern = {
@@ -116,110 +21,77 @@ namespace audio_wifi_config
     const std::vector<uint8_t> kDefaultEndTransmissionPattern = {
         0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0};
 
-    // FrequencyDetector implementation
-    FrequencyDetector::FrequencyDetector(float frequency, size_t window_size)
-        : frequency_(frequency), window_size_(window_size) {
-        frequency_bin_ = std::floor(frequency_ * static_cast<float>(window_size_));
-        angular_frequency_ = 2.0f * M_PI * frequency_;
-        cos_coefficient_ = std::cos(angular_frequency_);
-        sin_coefficient_ = std::sin(angular_frequency_);
-        filter_coefficient_ = 2.0f * cos_coefficient_;
-
-        // Initialize state buffer
-        state_buffer_.push_back(0.0f);
-        state_buffer_.push_back(0.0f);
+    // ToneDetector implementation
+    int32_t ToneDetector::Coefficient(float frequency) {
+        return static_cast<int32_t>(std::lround(2.0 * std::cos(2.0 * M_PI * frequency) * (1 << 14)));
     }
 
-    void FrequencyDetector::Reset() {
-        state_buffer_.clear();
-        state_buffer_.push_back(0.0f);
-        state_buffer_.push_back(0.0f);
+    float ToneDetector::Amplitude(int32_t coefficient, int32_t s1, int32_t s2) {
+        // |X|^2 = S1^2 + S2^2 - 2cos(w) * S1 * S2
+        float f1 = static_cast<float>(s1);
+        float f2 = static_cast<float>(s2);
+        float power = f1 * f1 + f2 * f2 - (static_cast<float>(coefficient) / (1 << 14)) * f1 * f2;
+        return std::sqrt(std::max(power, 0.0f));
     }
 
-    void FrequencyDetector::ProcessSample(float sample) {
-        if (state_buffer_.size() < 2) {
-            return;
-        }
-
-        float s_minus_2 = state_buffer_.front();  // S[-2]
-        state_buffer_.pop_front();
-        float s_minus_1 = state_buffer_.front();  // S[-1]
-        state_buffer_.pop_front();
-
-        float s_current = sample + filter_coefficient_ * s_minus_1 - s_minus_2;
-
-        state_buffer_.push_back(s_minus_1);  // Put S[-1] back
-        state_buffer_.push_back(s_current);  // Add new S[0]
-    }
-
-    float FrequencyDetector::GetAmplitude() const {
-        if (state_buffer_.size() < 2) {
-            return 0.0f;
-        }
-
-        float s_minus_1 = state_buffer_[1];                      // S[-1]
-        float s_minus_2 = state_buffer_[0];                      // S[-2]
-        float real_part = cos_coefficient_ * s_minus_1 - s_minus_2;  // Real part
-        float imaginary_part = sin_coefficient_ * s_minus_1;         // Imaginary part
-
-        return std::sqrt(real_part * real_part + imaginary_part * imaginary_part) / 
-               (static_cast<float>(window_size_) / 2.0f);
+    float ToneDetector::GetMarkProbability() const {
+        float mark_amplitude = Amplitude(mark_coefficient_, mark_s1_, mark_s2_);
+        float space_amplitude = Amplitude(space_coefficient_, space_s1_, space_s2_);
+        // Avoid division by zero
+        return mark_amplitude / (space_amplitude + mark_amplitude + std::numeric_limits<float>::epsilon());
     }
 
     // AudioSignalProcessor implementation
     AudioSignalProcessor::AudioSignalProcessor(size_t sample_rate, size_t mark_frequency, size_t space_frequency,
-                                             size_t bit_rate, size_t window_size)
-        : input_buffer_size_(window_size), output_sample_count_(0) {
+                                             size_t bit_rate) {
         if (sample_rate % bit_rate != 0) {
             // On ESP32 we can continue execution, but log the error
             ESP_LOGW(kLogTag, "Sample rate %zu is not divisible by bit rate %zu", sample_rate, bit_rate);
         }
 
-        float normalized_mark_freq = static_cast<float>(mark_frequency) / static_cast<float>(sample_rate);
-        float normalized_space_freq = static_cast<float>(space_frequency) / static_cast<float>(sample_rate);
-
-        mark_detector_ = std::make_unique<FrequencyDetector>(normalized_mark_freq, window_size);
-        space_detector_ = std::make_unique<FrequencyDetector>(normalized_space_freq, window_size);
-
         samples_per_bit_ = sample_rate / bit_rate;  // Number of samples per bit
+        int32_t mark_coefficient = ToneDetector::Coefficient(static_cast<float>(mark_frequency) / static_cast<float>(sample_rate));
+        int32_t space_coefficient = ToneDetector::Coefficient(static_cast<float>(space_frequency) / static_cast<float>(sample_rate));
+        for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+            detectors_[phase] = ToneDetector(mark_coefficient, space_coefficient);
+            // Stagger the windows, the first one of each phase is shorter
+            window_fill_[phase] = phase * samples_per_bit_ / kPhaseCount;
+            contrast_[phase] = 0.0f;
+        }
     }
 
-    std::vector<float> AudioSignalProcessor::ProcessAudioSamples(const std::vector<float> &samples) {
-        std::vector<float> result;
-
-        for (float sample : samples) {
-            if (input_buffer_.size() < input_buffer_size_) {
-                input_buffer_.push_back(sample);  // Just add, don't process yet
-            } else {
-                // Input buffer is full, process the data
-                input_buffer_.pop_front();   // Remove oldest sample
-                input_buffer_.push_back(sample);  // Add new sample
-                output_sample_count_++;
-
-                if (output_sample_count_ >= samples_per_bit_) {
-                    // Process all samples in the window using Goertzel algorithm
-                    for (float window_sample : input_buffer_) {
-                        mark_detector_->ProcessSample(window_sample);
-                        space_detector_->ProcessSample(window_sample);
-                    }
+    void AudioSignalProcessor::ProcessAudioSamples(const int16_t *samples, size_t frames, size_t stride,
+                                                   std::vector<float> &probabilities) {
+        probabilities.clear();
 
-                    float mark_amplitude = mark_detector_->GetAmplitude();   // Mark amplitude
-                    float space_amplitude = space_detector_->GetAmplitude(); // Space amplitude
+        for (size_t i = 0; i < frames; ++i) {
+            int32_t sample = samples[i * stride];
+            samples_since_output_++;
+
+            for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+                auto &detector = detectors_[phase];
+                detector.ProcessSample(sample);
+                if (++window_fill_[phase] < samples_per_bit_) {
+                    continue;
+                }
 
-                    // Avoid division by zero
-                    float mark_probability = mark_amplitude / 
-                                           (space_amplitude + mark_amplitude + std::numeric_limits<float>::epsilon());
-                    result.push_back(mark_probability);
+                float mark_probability = detector.GetMarkProbability();
+                detector.Reset();
+                window_fill_[phase] = 0;
 
-                    // Reset detector windows
-                    mark_detector_->Reset();
-                    space_detector_->Reset();
-                    output_sample_count_ = 0;  // Reset output counter
+                // A window aligned with the bits sees one tone, a straddling one sees both
+                contrast_[phase] = 0.9f * contrast_[phase] + 0.1f * std::fabs(2.0f * mark_probability - 1.0f);
+                if (phase != selected_phase_ && contrast_[phase] > contrast_[selected_phase_] + 0.05f) {
+                    selected_phase_ = phase;
+                }
+
+                // After switching phase, skip a window overlapping the bit just taken
+                if (phase == selected_phase_ && samples_since_output_ >= samples_per_bit_ / 2) {
+                    probabilities.push_back(mark_probability);
+                    samples_since_output_ = 0;
                 }
             }
         }
-
-        return result;
     }
 
     // AudioDataBuffer implementation
@@ -229,6 +101,8 @@ namespace audio_wifi_config
           end_of_transmission_(kDefaultEndTransmissionPattern),
           enable_checksum_validation_(true) {
         identifier_buffer_size_ = std::max(start_of_transmission_.size(), end_of_transmission_.size());
+        start_bits_ = PackIdentifier(start_of_transmission_);
+        end_bits_ = PackIdentifier(end_of_transmission_);
         max_bit_buffer_size_ = 776;  // Preset bit buffer size, 776 bits = (32 + 1 + 63 + 1) * 8 = 776
 
         bit_buffer_.reserve(max_bit_buffer_size_);
@@ -241,6 +115,8 @@ namespace audio_wifi_config
           end_of_transmission_(end_identifier),
           enable_checksum_validation_(enable_checksum) {
         identifier_buffer_size_ = std::max(start_of_transmission_.size(), end_of_transmission_.size());
+        start_bits_ = PackIdentifier(start_of_transmission_);
+        end_bits_ = PackIdentifier(end_of_transmission_);
         max_bit_buffer_size_ = max_byte_size * 8;  // Bit buffer size in bytes
 
         bit_buffer_.reserve(max_bit_buffer_size_);
@@ -255,23 +131,40 @@ namespace audio_wifi_config
     }
 
     void AudioDataBuffer::ClearBuffers() {
-        identifier_buffer_.clear();
+        identifier_bits_ = 0;
+        identifier_count_ = 0;
         bit_buffer_.clear();
     }
 
+    uint32_t AudioDataBuffer::PackIdentifier(const std::vector<uint8_t> &identifier) {
+        uint32_t bits = 0;
+        for (uint8_t bit : identifier) {
+            bits = (bits << 1) | (bit & 1);
+        }
+        return bits;
+    }
+
+    bool AudioDataBuffer::MatchesIdentifier(uint32_t bits, size_t length) const {
+        if (identifier_count_ < length) {
+            return false;
+        }
+        uint32_t mask = length >= 32 ? 0xFFFFFFFFu : ((1u << length) - 1);
+        return (identifier_bits_ & mask) == bits;
+    }
+
     bool AudioDataBuffer::ProcessProbabilityData(const std::vector<float> &probabilities, float threshold) {
         for (float probability : probabilities) {
             uint8_t bit = (probability > threshold) ? 1 : 0;
 
-            if (identifier_buffer_.size() >= identifier_buffer_size_) {
-                identifier_buffer_.pop_front();  // Maintain buffer size
+            identifier_bits_ = (identifier_bits_ << 1) | bit;  // Maintain buffer size
+            if (identifier_count_ < identifier_buffer_size_) {
+                identifier_count_++;
             }
-            identifier_buffer_.push_back(bit);
 
             // Process received bit based on state machine
             switch (current_state_) {
             case DataReceptionState::kInactive:
-                if (identifier_buffer_.size() >= start_of_transmission_.size()) {
+                if (identifier_count_ >= start_of_transmission_.size()) {
                     current_state_ = DataReceptionState::kWaiting;  // Enter waiting state
                     ESP_LOGI(kLogTag, "Entering Waiting state");
                 }
@@ -279,9 +172,8 @@ namespace audio_wifi_config
 
             case DataReceptionState::kWaiting:
                 // Waiting state, possibly waiting for transmission end
-                if (identifier_buffer_.size() >= start_of_transmission_.size()) {
-                    std::vector<uint8_t> identifier_snapshot(identifier_buffer_.begin(), identifier_buffer_.end());
-                    if (identifier_snapshot == start_of_transmission_)
+                if (identifier_count_ >= start_of_transmission_.size()) {
+                    if (MatchesIdentifier(start_bits_, start_of_transmission_.size()))
                     {
                         ClearBuffers();                                // Clear buffers
                         current_state_ = DataReceptionState::kReceiving;  // Enter receiving state
@@ -292,9 +184,8 @@ namespace audio_wifi_config
 
             case DataReceptionState::kReceiving:
                 bit_buffer_.push_back(bit);
-                if (identifier_buffer_.size() >= end_of_transmission_.size()) {
-                    std::vector<uint8_t> identifier_snapshot(identifier_buffer_.begin(), identifier_buffer_.end());
-                    if (identifier_snapshot == end_of_transmission_) {
+                if (identifier_count_ >= end_of_transmission_.size()) {
+                    if (MatchesIdentifier(end_bits_, end_of_transmission_.size())) {
                         current_state_ = DataReceptionState::kInactive;  // Enter inactive state
 
                         // Convert bits to bytes
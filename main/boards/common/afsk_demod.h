@@ -1,20 +1,24 @@
 #pragma once
 
 #include <vector>
-#include <deque>
+#include <array>
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <optional>
 #include <cmath>
-#include "wifi_manager.h"
-#include "application.h"
+
+// The demodulator builds without ESP-IDF too, see scripts/acoustic_check/afsk_bench.cc
+class Application;
+class WifiManager;
+class Display;
 
 // Audio signal processing constants for WiFi configuration via audio
-const size_t kAudioSampleRate = 6400;
+// The demodulator runs on the 16 kHz input directly, one Goertzel window per bit
+const size_t kAudioSampleRate = 16000;
 const size_t kMarkFrequency = 1800;
 const size_t kSpaceFrequency = 1500;
 const size_t kBitRate = 100;
-const size_t kWindowSize = 64;
 
 namespace audio_wifi_config
 {
@@ -23,60 +27,76 @@ namespace audio_wifi_config
                                          size_t input_channels = 1);
 
     /**
-     * Goertzel algorithm implementation for single frequency detection
-     * Used to detect specific audio frequencies in the AFSK demodulation process
+     * Fixed-point Goertzel filters for the mark and space tones, run together over one window
+     * Integer only, so it costs the same on targets without an FPU
      */
-    class FrequencyDetector
+    class ToneDetector
     {
     private:
-        float frequency_;              // Target frequency (normalized, i.e., f / fs)
-        size_t window_size_;           // Window size for analysis
-        float frequency_bin_;          // Frequency bin
-        float angular_frequency_;      // Angular frequency
-        float cos_coefficient_;        // cos(w)
-        float sin_coefficient_;        // sin(w)
-        float filter_coefficient_;     // 2 * cos(w)
-        std::deque<float> state_buffer_;  // Circular buffer for storing S[-1] and S[-2]
+        int32_t mark_coefficient_ = 0;   // 2 * cos(w) of the mark tone, Q14
+        int32_t space_coefficient_ = 0;  // 2 * cos(w) of the space tone, Q14
+        int32_t mark_s1_ = 0, mark_s2_ = 0;    // Mark S[-1] and S[-2]
+        int32_t space_s1_ = 0, space_s2_ = 0;  // Space S[-1] and S[-2]
+
+        static float Amplitude(int32_t coefficient, int32_t s1, int32_t s2);
 
     public:
+        ToneDetector() = default;
+        ToneDetector(int32_t mark_coefficient, int32_t space_coefficient)
+            : mark_coefficient_(mark_coefficient), space_coefficient_(space_coefficient) {}
+
         /**
-         * Constructor
+         * Q14 Goertzel coefficient of a tone
          * @param frequency Normalized frequency (f / fs)
-         * @param window_size Window size for analysis
          */
-        FrequencyDetector(float frequency, size_t window_size);
+        static int32_t Coefficient(float frequency);
 
         /**
          * Reset the detector state
          */
-        void Reset();
+        void Reset() {
+            mark_s1_ = mark_s2_ = space_s1_ = space_s2_ = 0;
+        }
 
         /**
          * Process one audio sample
          * @param sample Input audio sample
          */
-        void ProcessSample(float sample);
+        inline void ProcessSample(int32_t sample) {
+            int32_t mark = sample + (int32_t)(((int64_t)mark_coefficient_ * mark_s1_) >> 14) - mark_s2_;
+            mark_s2_ = mark_s1_;
+            mark_s1_ = mark;
+            int32_t space = sample + (int32_t)(((int64_t)space_coefficient_ * space_s1_) >> 14) - space_s2_;
+            space_s2_ = space_s1_;
+            space_s1_ = space;
+        }
 
         /**
-         * Calculate current amplitude
-         * @return Amplitude value
+         * Mark share of the two tone amplitudes over the window
+         * @return Mark probability (0.0 to 1.0)
          */
-        float GetAmplitude() const;
+        float GetMarkProbability() const;
     };
 
     /**
      * Audio signal processor for Mark/Space frequency pair detection
      * Processes audio signals to extract digital data using AFSK demodulation
+     *
+     * Four bit-long windows run staggered by a quarter bit, and bits are taken from the window
+     * phase with the clearest mark/space contrast, so the decision no longer depends on where the
+     * first window happened to start relative to the bit boundaries
      */
     class AudioSignalProcessor
     {
     private:
-        std::deque<float> input_buffer_;             // Input sample buffer
-        size_t input_buffer_size_;                   // Input buffer size = window size
-        size_t output_sample_count_;                 // Output sample counter
-        size_t samples_per_bit_;                     // Samples per bit threshold
-        std::unique_ptr<FrequencyDetector> mark_detector_;   // Mark frequency detector
-        std::unique_ptr<FrequencyDetector> space_detector_;  // Space frequency detector
+        static const size_t kPhaseCount = 4;
+
+        size_t samples_per_bit_;                               // Samples per bit (window size)
+        std::array<ToneDetector, kPhaseCount> detectors_;      // One detector per window phase
+        std::array<size_t, kPhaseCount> window_fill_;          // Samples in each window
+        std::array<float, kPhaseCount> contrast_;              // Smoothed |mark - space| per phase
+        size_t selected_phase_ = 0;                            // Phase the bits come from
+        size_t samples_since_output_ = 0;                      // Samples since the last bit
 
     public:
         /**
@@ -85,17 +105,19 @@ namespace audio_wifi_config
          * @param mark_frequency Mark frequency for digital '1'
          * @param space_frequency Space frequency for digital '0'
          * @param bit_rate Data transmission bit rate
-         * @param window_size Analysis window size
          */
         AudioSignalProcessor(size_t sample_rate, size_t mark_frequency, size_t space_frequency,
-                           size_t bit_rate, size_t window_size);
+                           size_t bit_rate);
 
         /**
          * Process input audio samples
-         * @param samples Input audio sample vector
-         * @return Vector of Mark probability values (0.0 to 1.0)
+         * @param samples Interleaved input audio, only the first channel is used
+         * @param frames Number of frames
+         * @param stride Channels per frame
+         * @param probabilities Cleared and filled with the Mark probability (0.0 to 1.0) of each bit
          */
-        std::vector<float> ProcessAudioSamples(const std::vector<float> &samples);
+        void ProcessAudioSamples(const int16_t *samples, size_t frames, size_t stride,
+                                 std::vector<float> &probabilities);
     };
 
     /**
@@ -116,8 +138,11 @@ namespace audio_wifi_config
     {
     private:
         DataReceptionState current_state_;       // Current reception state
-        std::deque<uint8_t> identifier_buffer_;  // Buffer for start/end identifier detection
+        uint32_t identifier_bits_ = 0;           // Shift register of the last bits, for start/end identifier detection
+        size_t identifier_count_ = 0;            // Bits in the shift register, up to identifier_buffer_size_
         size_t identifier_buffer_size_;          // Identifier buffer size
+        uint32_t start_bits_ = 0;                // Start identifier packed like identifier_bits_
+        uint32_t end_bits_ = 0;                  // End identifier packed like identifier_bits_
         std::vector<uint8_t> bit_buffer_;        // Buffer for storing bit stream
         size_t max_bit_buffer_size_;             // Maximum bit buffer size
         const std::vector<uint8_t> start_of_transmission_;  // Start-of-transmission identifier
@@ -169,6 +194,17 @@ namespace audio_wifi_config
          * Clear all buffers and reset state
          */
         void ClearBuffers();
+
+        /**
+         * Whether the last bits received match an identifier
+         */
+        bool MatchesIdentifier(uint32_t bits, size_t length) const;
+
+        /**
+         * Pack an identifier of up to 32 bits, last bit lowest
+         * @param identifier Identifier bits, first bit sent first
+         */
+        static uint32_t PackIdentifier(const std::vector<uint8_t> &identifier);
     };
 
     // Default start and end transmission identifiers
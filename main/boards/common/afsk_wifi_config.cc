@@ -0,0 +1,78 @@
+#include "afsk_demod.h"
+#include <algorithm>
+#include "esp_log.h"
+#include "application.h"
+#include "display.h"
+#include "wifi_manager.h"
+#include "ssid_manager.h"
+
+namespace audio_wifi_config
+{
+    static const char *kLogTag = "AUDIO_WIFI_CONFIG";
+
+    void ReceiveWifiCredentialsFromAudio(Application *app,
+                                        WifiManager *wifi_manager,
+                                        Display *display,
+                                        size_t input_channels
+                                    )
+    {
+        std::vector<int16_t> audio_data;
+        std::vector<float> probabilities;
+        AudioSignalProcessor signal_processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate);
+        AudioDataBuffer data_buffer;
+
+        while (true)
+        {
+            // 检查Application状态，只有在WiFi配置模式下才处理音频
+            if (app->GetDeviceState() != kDeviceStateWifiConfiguring) {
+                // 不在WiFi配置状态，休眠100ms后再检查
+                vTaskDelay(pdMS_TO_TICKS(100));
+                continue;
+            }
+            
+            if (!app->GetAudioService().ReadAudioData(audio_data, kAudioSampleRate, 480)) { // 16kHz, 480 samples corresponds to 30ms data
+                // 读取音频失败，短暂延迟后重试
+                ESP_LOGI(kLogTag, "Failed to read audio data, retrying.");
+                vTaskDelay(pdMS_TO_TICKS(10));
+                continue;
+            }
+
+            // Process audio samples to get probability data, the first channel of interleaved input
+            size_t stride = std::max<size_t>(input_channels, 1);
+            signal_processor.ProcessAudioSamples(audio_data.data(), audio_data.size() / stride, stride, probabilities);
+            
+            // Feed probability data to the data buffer
+            if (data_buffer.ProcessProbabilityData(probabilities, 0.5f)) {
+                // If complete data was received, extract WiFi credentials
+                if (data_buffer.decoded_text.has_value()) {
+                    ESP_LOGI(kLogTag, "Received text data: %s", data_buffer.decoded_text->c_str());
+                    display->SetChatMessage("system", data_buffer.decoded_text->c_str());
+                    
+                    // Split SSID and password by newline character
+                    std::string wifi_ssid, wifi_password;
+                    size_t newline_position = data_buffer.decoded_text->find('\n');
+                    if (newline_position != std::string::npos) {
+                        wifi_ssid = data_buffer.decoded_text->substr(0, newline_position);
+                        wifi_password = data_buffer.decoded_text->substr(newline_position + 1);
+                        ESP_LOGI(kLogTag, "WiFi SSID: %s, Password: %s", wifi_ssid.c_str(), wifi_password.c_str());
+                    } else {
+                        ESP_LOGE(kLogTag, "Invalid data format, no newline character found");
+                        continue;
+                    }
+                    
+                    // Save WiFi credentials using SsidManager
+                    auto& ssid_manager = SsidManager::GetInstance();
+                    ssid_manager.AddSsid(wifi_ssid, wifi_password);
+                    ESP_LOGI(kLogTag, "WiFi credentials saved successfully");
+                    
+                    // Exit config mode (triggers ConfigModeExit event)
+                    wifi_manager->StopConfigAp();
+                    
+                    data_buffer.decoded_text.reset();  // Clear processed data
+                    return;  // Exit the function
+                }
+            }
+            vTaskDelay(pdMS_TO_TICKS(1));  // 1ms delay
+        }
+    }
+}
@@ -6,11 +6,18 @@
 
 #define TAG "Axp2101"
 
+// Status is polled every second, the gauge every five, reads older than twice that go to the bus
+#define AXP2101_STATUS_POLL_MS 1000
+#define AXP2101_GAUGE_POLL_MS 5000
+
 Axp2101::Axp2101(i2c_master_bus_handle_t i2c_bus, uint8_t addr) : I2cDevice(i2c_bus, addr) {
+    PollRegs(0x01, 1, AXP2101_STATUS_POLL_MS);
+    // Battery level and temperature in one transaction
+    PollRegs(0xA4, 2, AXP2101_GAUGE_POLL_MS);
 }
 
 int Axp2101::GetBatteryCurrentDirection() {
-    return (ReadReg(0x01) & 0b01100000) >> 5;
+    return (ReadRegCached(0x01, AXP2101_STATUS_POLL_MS * 2) & 0b01100000) >> 5;
 }
 
 bool Axp2101::IsCharging() {
@@ -22,16 +29,16 @@ bool Axp2101::IsDischarging() {
 }
 
 bool Axp2101::IsChargingDone() {
-    uint8_t value = ReadReg(0x01);
+    uint8_t value = ReadRegCached(0x01, AXP2101_STATUS_POLL_MS * 2);
     return (value & 0b00000111) == 0b00000100;
 }
 
 int Axp2101::GetBatteryLevel() {
-    return ReadReg(0xA4);
+    return ReadRegCached(0xA4, AXP2101_GAUGE_POLL_MS * 2);
 }
 
 float Axp2101::GetTemperature() {
-    return ReadReg(0xA5);
+    return ReadRegCached(0xA5, AXP2101_GAUGE_POLL_MS * 2);
 }
 
 void Axp2101::PowerOff() {
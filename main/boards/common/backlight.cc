@@ -4,8 +4,14 @@
 #include <esp_log.h>
 #include <driver/ledc.h>
 
+#include <algorithm>
+#include <cstdlib>
+
 #define TAG "Backlight"
 
+// One percent of brightness per step of a transition
+#define BACKLIGHT_STEP_MS 5
+
 
 Backlight::Backlight() {
     // 创建背光渐变定时器
@@ -48,7 +54,7 @@ void Backlight::SetBrightness(uint8_t brightness, bool permanent) {
         brightness = 100;
     }
 
-    if (brightness_ == brightness) {
+    if (target_brightness_ == brightness && brightness_ == brightness) {
         return;
     }
 
@@ -58,11 +64,20 @@ void Backlight::SetBrightness(uint8_t brightness, bool permanent) {
     }
 
     target_brightness_ = brightness;
-    step_ = (target_brightness_ > brightness_) ? 1 : -1;
+    if (transition_timer_ != nullptr) {
+        esp_timer_stop(transition_timer_);
+    }
 
+    int duration_ms = std::max(abs(target_brightness_ - brightness_), 1) * BACKLIGHT_STEP_MS;
+    if (StartFade(target_brightness_, duration_ms)) {
+        ESP_LOGI(TAG, "Fade brightness to %d", brightness);
+        return;
+    }
+
+    step_ = (target_brightness_ > brightness_) ? 1 : -1;
     if (transition_timer_ != nullptr) {
         // 启动定时器，每 5ms 更新一次
-        esp_timer_start_periodic(transition_timer_, 5 * 1000);
+        esp_timer_start_periodic(transition_timer_, BACKLIGHT_STEP_MS * 1000);
     }
     ESP_LOGI(TAG, "Set brightness to %d", brightness);
 }
@@ -106,9 +121,27 @@ PwmBacklight::PwmBacklight(gpio_num_t pin, bool output_invert, uint32_t freq_hz)
         }
     };
     ESP_ERROR_CHECK(ledc_channel_config(&backlight_channel));
+
+    // The fades run in the LEDC hardware, only their end raises an interrupt
+    esp_err_t err = ledc_fade_func_install(0);
+    if (err == ESP_OK) {
+        ledc_cbs_t callbacks = {
+            .fade_cb = &PwmBacklight::OnFadeEnd,
+        };
+        err = ledc_cb_register(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, &callbacks, this);
+    }
+    if (err == ESP_OK) {
+        fade_installed_ = true;
+    } else {
+        ESP_LOGW(TAG, "LEDC fade not available, stepping transitions in software: %s", esp_err_to_name(err));
+    }
 }
 
 PwmBacklight::~PwmBacklight() {
+    if (fade_installed_) {
+        ledc_fade_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+        ledc_fade_func_uninstall();
+    }
     ledc_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0);
 }
 
@@ -119,3 +152,28 @@ void PwmBacklight::SetBrightnessImpl(uint8_t brightness) {
     ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
 }
 
+bool PwmBacklight::StartFade(uint8_t brightness, int duration_ms) {
+    if (!fade_installed_) {
+        return false;
+    }
+    // A fade still running is taken over from the duty it reached
+    ledc_fade_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    uint32_t duty_cycle = (1023 * brightness) / 100;
+    esp_err_t err = ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty_cycle, duration_ms);
+    if (err == ESP_OK) {
+        err = ledc_fade_start(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, LEDC_FADE_NO_WAIT);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to start fade: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool IRAM_ATTR PwmBacklight::OnFadeEnd(const ledc_cb_param_t* param, void* user_arg) {
+    if (param->event == LEDC_FADE_END_EVT) {
+        auto self = static_cast<PwmBacklight*>(user_arg);
+        self->brightness_ = self->target_brightness_;
+    }
+    return false;
+}
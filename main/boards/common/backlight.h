@@ -4,6 +4,7 @@
 #include <functional>
 
 #include <driver/gpio.h>
+#include <driver/ledc.h>
 #include <esp_timer.h>
 
 
@@ -19,6 +20,9 @@ public:
 protected:
     void OnTransitionTimer();
     virtual void SetBrightnessImpl(uint8_t brightness) = 0;
+    // Backlights that fade in hardware run the whole transition there and set brightness_ when
+    // it ends, the others return false and are stepped by the transition timer
+    virtual bool StartFade(uint8_t brightness, int duration_ms) { return false; }
 
     esp_timer_handle_t transition_timer_ = nullptr;
     uint8_t brightness_ = 0;
@@ -33,4 +37,12 @@ public:
     ~PwmBacklight();
 
     void SetBrightnessImpl(uint8_t brightness) override;
+
+protected:
+    bool StartFade(uint8_t brightness, int duration_ms) override;
+
+private:
+    bool fade_installed_ = false;
+
+    static bool OnFadeEnd(const ledc_cb_param_t* param, void* user_arg);
 };
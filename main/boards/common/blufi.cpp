@@ -7,12 +7,17 @@
 #include "esp_bt.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_system.h"
 #include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/task.h"
 #include "wifi_manager.h"
 
 #define BLUFI_DEVICE_NAME "Xiaozhi-Blufi"
+// Scan results younger than this are served without scanning again
+#define BLUFI_SCAN_CACHE_MS 10000
+// Strongest networks sent to the app, one entry per SSID
+#define BLUFI_MAX_AP_COUNT 20
 
 #ifdef CONFIG_BT_BLUEDROID_ENABLED
 #include "esp_bt_device.h"
@@ -104,6 +109,10 @@ Blufi::~Blufi() {
 
 esp_err_t Blufi::init() {
     esp_err_t ret = ESP_FAIL;
+    if (m_bt_mem_released) {
+        ESP_LOGE(BLUFI_TAG, "Bluetooth memory was released after provisioning, reboot to use BluFi again");
+        return ESP_ERR_INVALID_STATE;
+    }
     inited_ = true;
     m_provisioned = false;
     m_deinited = false;
@@ -145,7 +154,17 @@ esp_err_t Blufi::deinit() {
         if (m_deinited) {
             return ESP_OK;
         }
+        if (m_ble_is_connected && m_sta_is_connecting) {
+            // The connection report is on its way, the disconnect after it deinitializes
+            ESP_LOGI(BLUFI_TAG, "Deinit deferred until the BLE client disconnects");
+            return ESP_OK;
+        }
         m_deinited = true;
+        if (m_scan_event_instance != nullptr) {
+            esp_event_handler_instance_unregister(WIFI_EVENT, WIFI_EVENT_SCAN_DONE,
+                                                  m_scan_event_instance);
+            m_scan_event_instance = nullptr;
+        }
         ret = _host_deinit();
         if (ret) {
             ESP_LOGE(BLUFI_TAG, "Host deinit failed: %s", esp_err_to_name(ret));
@@ -155,6 +174,14 @@ esp_err_t Blufi::deinit() {
         if (ret) {
             ESP_LOGE(BLUFI_TAG, "Controller deinit failed: %s", esp_err_to_name(ret));
         }
+#if CONFIG_BLUFI_RELEASE_BT_MEMORY
+        // Hands the controller's memory back to the heap for good
+        if (ret == ESP_OK && esp_bt_controller_mem_release(ESP_BT_MODE_BTDM) == ESP_OK) {
+            m_bt_mem_released = true;
+            ESP_LOGI(BLUFI_TAG, "Bluetooth memory released, free heap %u",
+                     (unsigned)esp_get_free_heap_size());
+        }
+#endif
 #endif
     }
     return ret;
@@ -537,16 +564,27 @@ void Blufi::start_wifi_scan() {
     ESP_LOGI(BLUFI_TAG, "Starting dedicated WiFi scan");
 
     // Check if a scan is already in progress
-    if (m_scan_in_progress) {
-        ESP_LOGW(BLUFI_TAG, "Scan already in progress, skipping");
-        return;
+    {
+        std::lock_guard<std::mutex> lock(m_scan_mutex);
+        if (m_scan_in_progress) {
+            ESP_LOGW(BLUFI_TAG, "Scan already in progress, skipping");
+            return;
+        }
+        m_scan_in_progress = true;
     }
-
-    m_scan_in_progress = true;
+    auto scan_failed = [this]() {
+        std::lock_guard<std::mutex> lock(m_scan_mutex);
+        m_scan_in_progress = false;
+    };
 
     // Get current WiFi mode
     wifi_mode_t current_mode;
     esp_err_t err = esp_wifi_get_mode(&current_mode);
+    if (err != ESP_OK) {
+        ESP_LOGE(BLUFI_TAG, "WiFi is not initialized, cannot scan: %s", esp_err_to_name(err));
+        scan_failed();
+        return;
+    }
 
     if (current_mode == WIFI_MODE_AP) {
         // If in AP mode, temporarily switch to APSTA to allow scanning
@@ -554,67 +592,74 @@ void Blufi::start_wifi_scan() {
         err = esp_wifi_set_mode(WIFI_MODE_STA);
         if (err != ESP_OK) {
             ESP_LOGE(BLUFI_TAG, "Failed to set WiFi mode to STA: %s", esp_err_to_name(err));
-            m_scan_in_progress = false;
+            scan_failed();
             return;
         }
         // Need to restart WiFi for mode change to take effect
         err = esp_wifi_start();
         if (err != ESP_OK) {
             ESP_LOGE(BLUFI_TAG, "Failed to start WiFi after mode switch: %s", esp_err_to_name(err));
-            m_scan_in_progress = false;
+            scan_failed();
             return;
         }
-        // Register scan event handler
-        esp_event_handler_instance_t scan_event_instance;
-        esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+    } else if (current_mode != WIFI_MODE_STA) {
+        ESP_LOGE(BLUFI_TAG, "Unexpected WiFi mode: %d", current_mode);
+        scan_failed();
+        return;
+    }
+
+    // Registered once, the results of every scan are cached
+    if (m_scan_event_instance == nullptr) {
+        esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE,
                                             &Blufi::_wifi_scan_event_handler, this,
-                                            &scan_event_instance);
+                                            &m_scan_event_instance);
+    }
 
-        // Start scan
-        err = esp_wifi_scan_start(NULL, false);
-        if (err != ESP_OK) {
-            ESP_LOGE(BLUFI_TAG, "Failed to start WiFi scan: %s", esp_err_to_name(err));
-            m_scan_in_progress = false;
-            return;
-        }
-    } else if (current_mode == WIFI_MODE_STA) {
-        // Start scan
-        err = esp_wifi_scan_start(NULL, false);
-        if (err != ESP_OK) {
-            ESP_LOGE(BLUFI_TAG, "Failed to start WiFi scan: %s", esp_err_to_name(err));
-            m_scan_in_progress = false;
-            return;
-        }
-    } else {
-        ESP_LOGE(BLUFI_TAG, "Unexpected WiFi mode: %d", current_mode);
-        m_scan_in_progress = false;
+    // Start scan
+    err = esp_wifi_scan_start(NULL, false);
+    if (err != ESP_OK) {
+        ESP_LOGE(BLUFI_TAG, "Failed to start WiFi scan: %s", esp_err_to_name(err));
+        scan_failed();
         return;
     }
 
     ESP_LOGI(BLUFI_TAG, "WiFi scan started");
 }
 
+bool Blufi::_scan_cache_stale() {
+    std::lock_guard<std::mutex> lock(m_scan_mutex);
+    return m_ap_list.empty() ||
+           esp_timer_get_time() - m_scan_time_us > BLUFI_SCAN_CACHE_MS * 1000LL;
+}
+
 void Blufi::_send_wifi_list() {
-    if (m_ap_records.empty()) {
-        ESP_LOGW(BLUFI_TAG, "No AP records available to send");
-        return;
+    std::vector<esp_blufi_ap_record_t> ap_list;
+    bool scanning;
+    {
+        std::lock_guard<std::mutex> lock(m_scan_mutex);
+        ap_list = m_ap_list;
+        scanning = m_scan_in_progress;
+        if (ap_list.empty()) {
+            // Answered from the scan done handler instead of blocking the BLE task
+            m_wifi_list_pending = true;
+        }
     }
 
-    ESP_LOGI(BLUFI_TAG, "Sending WiFi list with %d APs", m_ap_records.size());
-
-    std::vector<esp_blufi_ap_record_t> blufi_ap_list;
-    for (const auto& ap : m_ap_records) {
-        esp_blufi_ap_record_t blufi_ap;
-        memset(&blufi_ap, 0, sizeof(blufi_ap));
-        memcpy(blufi_ap.ssid, ap.ssid, std::min((size_t)32, sizeof(ap.ssid)));
-        blufi_ap.rssi = ap.rssi;
-        blufi_ap_list.push_back(blufi_ap);
+    if (ap_list.empty()) {
+        ESP_LOGI(BLUFI_TAG, "No AP records yet, the list is sent when the scan finishes");
+        if (!scanning) {
+            start_wifi_scan();
+        }
+        return;
     }
 
-    esp_blufi_send_wifi_list(blufi_ap_list.size(), blufi_ap_list.data());
+    ESP_LOGI(BLUFI_TAG, "Sending WiFi list with %d APs", ap_list.size());
+    esp_blufi_send_wifi_list(ap_list.size(), ap_list.data());
 
-    m_ap_records.clear();
-    start_wifi_scan();
+    // Refreshed in the background for the next request
+    if (!scanning && _scan_cache_stale()) {
+        start_wifi_scan();
+    }
 }
 
 void Blufi::_wifi_scan_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id,
@@ -627,22 +672,140 @@ void Blufi::_wifi_scan_event_handler(void* arg, esp_event_base_t event_base, int
         uint16_t ap_num = 0;
         esp_wifi_scan_get_ap_num(&ap_num);
 
-        if (ap_num == 0) {
-            ESP_LOGW(BLUFI_TAG, "No APs found");
-            self->m_ap_records.clear();
+        std::vector<wifi_ap_record_t> records(ap_num);
+        if (ap_num > 0) {
+            esp_wifi_scan_get_ap_records(&ap_num, records.data());
+            records.resize(ap_num);
         } else {
-            if (static_cast<Blufi*>(arg)->m_scan_should_save_ssid == true) {
-                self->m_ap_records.resize(ap_num);
-                esp_wifi_scan_get_ap_records(&ap_num, self->m_ap_records.data());
-
-                ESP_LOGI(BLUFI_TAG, "Found %d APs", ap_num);
-                for (const auto& ap : self->m_ap_records) {
-                    ESP_LOGI(BLUFI_TAG, "  SSID: %s, RSSI: %d, Authmode: %d", (char*)ap.ssid,
-                             ap.rssi, ap.authmode);
-                }
+            ESP_LOGW(BLUFI_TAG, "No APs found");
+        }
+
+        // Strongest first, so the cap keeps the networks worth joining
+        std::sort(records.begin(), records.end(),
+                  [](const wifi_ap_record_t& a, const wifi_ap_record_t& b) { return a.rssi > b.rssi; });
+        std::vector<esp_blufi_ap_record_t> ap_list;
+        for (const auto& ap : records) {
+            if (ap.ssid[0] == '\0' || ap_list.size() >= BLUFI_MAX_AP_COUNT) {
+                continue;
             }
+            bool duplicate = std::any_of(ap_list.begin(), ap_list.end(), [&ap](const esp_blufi_ap_record_t& r) {
+                return memcmp(r.ssid, ap.ssid, sizeof(r.ssid)) == 0;
+            });
+            if (duplicate) {
+                continue;
+            }
+            esp_blufi_ap_record_t blufi_ap;
+            memset(&blufi_ap, 0, sizeof(blufi_ap));
+            memcpy(blufi_ap.ssid, ap.ssid, std::min(sizeof(blufi_ap.ssid), sizeof(ap.ssid)));
+            blufi_ap.rssi = ap.rssi;
+            ap_list.push_back(blufi_ap);
+            ESP_LOGD(BLUFI_TAG, "  SSID: %s, RSSI: %d, Authmode: %d", (char*)ap.ssid, ap.rssi,
+                     ap.authmode);
+        }
+        ESP_LOGI(BLUFI_TAG, "Found %d APs, %d networks", ap_num, ap_list.size());
+
+        bool send_list;
+        {
+            std::lock_guard<std::mutex> lock(self->m_scan_mutex);
+            self->m_scan_in_progress = false;
+            // Scans after a connect request are for the station, not for the app
+            if (!self->m_scan_should_save_ssid) {
+                return;
+            }
+            self->m_ap_list = std::move(ap_list);
+            self->m_scan_time_us = esp_timer_get_time();
+            send_list = self->m_wifi_list_pending && self->m_ble_is_connected;
+            self->m_wifi_list_pending = false;
+        }
+        if (send_list) {
+            self->_send_wifi_list();
         }
-        self->m_scan_in_progress = false;
+    }
+}
+
+void Blufi::_connect_to_ap(const std::string& ssid, const std::string& password) {
+    SsidManager::GetInstance().AddSsid(ssid, password);
+
+    auto& wifi_manager = WifiManager::GetInstance();
+
+    // A running scan of ours would hold off the connection
+    esp_wifi_scan_stop();
+
+    if (wifi_manager.IsInitialized()) {
+        if (wifi_manager.IsConfigMode()) {
+            wifi_manager.StopConfigAp();
+        }
+        wifi_manager.StopStation();
+    }
+
+    if (!wifi_manager.IsInitialized() && !wifi_manager.Initialize()) {
+        ESP_LOGE(BLUFI_TAG, "Failed to initialize WifiManager");
+        m_sta_is_connecting = false;
+        return;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(500));
+
+    wifi_manager.StartStation();
+
+    constexpr int kConnectTimeoutMs = 10000;
+    constexpr int kPollMs = 100;
+    int waited_ms = 0;
+
+    while (waited_ms < kConnectTimeoutMs && !wifi_manager.IsConnected()) {
+        vTaskDelay(pdMS_TO_TICKS(kPollMs));
+        waited_ms += kPollMs;
+    }
+
+    wifi_mode_t mode = GetWifiModeWithFallback(wifi_manager);
+    const int softap_conn_num = _get_softap_conn_num();
+
+    if (wifi_manager.IsConnected()) {
+        m_sta_connected = true;
+        m_sta_got_ip = true;
+        m_provisioned = true;
+
+        auto current_ssid = wifi_manager.GetSsid();
+        if (!current_ssid.empty()) {
+            m_sta_ssid_len = static_cast<int>(std::min(current_ssid.size(), sizeof(m_sta_ssid)));
+            memcpy(m_sta_ssid, current_ssid.c_str(), m_sta_ssid_len);
+        }
+
+        wifi_ap_record_t ap_info{};
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+            memcpy(m_sta_bssid, ap_info.bssid, sizeof(m_sta_bssid));
+        }
+
+        esp_blufi_extra_info_t info = {};
+        memcpy(info.sta_bssid, m_sta_bssid, sizeof(m_sta_bssid));
+        info.sta_bssid_set = true;
+        info.sta_ssid = m_sta_ssid;
+        info.sta_ssid_len = m_sta_ssid_len;
+        esp_blufi_send_wifi_conn_report(mode, ESP_BLUFI_STA_CONN_SUCCESS, softap_conn_num, &info);
+        ESP_LOGI(BLUFI_TAG, "connected to WiFi in %d ms", waited_ms);
+        m_sta_is_connecting = false;
+
+        // The disconnect deinitializes BluFi and frees the Bluetooth stack
+        if (m_ble_is_connected) {
+            esp_blufi_disconnect();
+        } else {
+            deinit();
+        }
+    } else {
+        m_sta_is_connecting = false;
+        m_sta_connected = false;
+        m_sta_got_ip = false;
+        {
+            // The app lists the networks again to pick another one
+            std::lock_guard<std::mutex> lock(m_scan_mutex);
+            m_scan_should_save_ssid = true;
+        }
+
+        esp_blufi_extra_info_t info = {};
+        info.sta_ssid = m_sta_ssid;
+        info.sta_ssid_len = m_sta_ssid_len;
+        esp_blufi_send_wifi_conn_report(mode, ESP_BLUFI_STA_CONN_FAIL, softap_conn_num, &info);
+        ESP_LOGE(BLUFI_TAG, "Failed to connect to WiFi via esp-wifi-connect");
     }
 }
 
@@ -661,6 +824,10 @@ void Blufi::_handle_event(esp_blufi_cb_event_t event, esp_blufi_cb_param_t* para
             m_ble_is_connected = true;
             esp_blufi_adv_stop();
             _security_init();
+            // Usually done by the time the app asks for the list
+            if (_scan_cache_stale()) {
+                start_wifi_scan();
+            }
             break;
         case ESP_BLUFI_EVENT_BLE_DISCONNECT:
             ESP_LOGI(BLUFI_TAG, "BLUFI ble disconnect");
@@ -710,8 +877,14 @@ void Blufi::_handle_event(esp_blufi_cb_event_t event, esp_blufi_cb_param_t* para
             std::string ssid(reinterpret_cast<const char*>(m_sta_config.sta.ssid));
             std::string password(reinterpret_cast<const char*>(m_sta_config.sta.password));
 
-            SsidManager::GetInstance().AddSsid(ssid, password);
-            m_scan_should_save_ssid = false;
+            if (m_sta_is_connecting) {
+                ESP_LOGW(BLUFI_TAG, "Already connecting, request ignored");
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_scan_mutex);
+                m_scan_should_save_ssid = false;
+            }
 
             m_sta_ssid_len = static_cast<int>(std::min(ssid.size(), sizeof(m_sta_ssid)));
             memcpy(m_sta_ssid, ssid.c_str(), m_sta_ssid_len);
@@ -723,85 +896,16 @@ void Blufi::_handle_event(esp_blufi_cb_event_t event, esp_blufi_cb_param_t* para
             m_sta_conn_info.sta_ssid = m_sta_ssid;
             m_sta_conn_info.sta_ssid_len = m_sta_ssid_len;
 
-            auto& wifi_manager = WifiManager::GetInstance();
-
-            if (wifi_manager.IsInitialized()) {
-                if (wifi_manager.IsConfigMode()) {
-                    wifi_manager.StopConfigAp();
-                }
-                wifi_manager.StopStation();
-            }
-
-            if (!wifi_manager.IsInitialized() && !wifi_manager.Initialize()) {
-                ESP_LOGE(BLUFI_TAG, "Failed to initialize WifiManager");
-                break;
-            }
-
-            vTaskDelay(pdMS_TO_TICKS(500));
-
-            wifi_manager.StartStation();
-
+            // Verified on its own task, the BLE task returns at once to acknowledge the request
+            auto* request = new std::pair<std::string, std::string>(ssid, password);
             xTaskCreate(
                 [](void* ctx) {
-                    auto* self = static_cast<Blufi*>(ctx);
-                    auto& wifi = WifiManager::GetInstance();
-                    constexpr int kConnectTimeoutMs = 10000;
-                    constexpr TickType_t kDelayTick = pdMS_TO_TICKS(200);
-                    int waited_ms = 0;
-
-                    while (waited_ms < kConnectTimeoutMs && !wifi.IsConnected()) {
-                        vTaskDelay(kDelayTick);
-                        waited_ms += 200;
-                    }
-
-                    wifi_mode_t mode = GetWifiModeWithFallback(wifi);
-                    const int softap_conn_num = _get_softap_conn_num();
-
-                    if (wifi.IsConnected()) {
-                        self->m_sta_is_connecting = false;
-                        self->m_sta_connected = true;
-                        self->m_sta_got_ip = true;
-                        self->m_provisioned = true;
-
-                        auto current_ssid = wifi.GetSsid();
-                        if (!current_ssid.empty()) {
-                            self->m_sta_ssid_len = static_cast<int>(
-                                std::min(current_ssid.size(), sizeof(self->m_sta_ssid)));
-                            memcpy(self->m_sta_ssid, current_ssid.c_str(), self->m_sta_ssid_len);
-                        }
-
-                        wifi_ap_record_t ap_info{};
-                        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
-                            memcpy(self->m_sta_bssid, ap_info.bssid, sizeof(self->m_sta_bssid));
-                        }
-
-                        esp_blufi_extra_info_t info = {};
-                        memcpy(info.sta_bssid, self->m_sta_bssid, sizeof(self->m_sta_bssid));
-                        info.sta_bssid_set = true;
-                        info.sta_ssid = self->m_sta_ssid;
-                        info.sta_ssid_len = self->m_sta_ssid_len;
-                        esp_blufi_send_wifi_conn_report(mode, ESP_BLUFI_STA_CONN_SUCCESS,
-                                                        softap_conn_num, &info);
-                        ESP_LOGI(BLUFI_TAG, "connected to WiFi");
-
-                        if (self->m_ble_is_connected) {
-                            esp_blufi_disconnect();
-                        }
-                    } else {
-                        self->m_sta_is_connecting = false;
-                        self->m_sta_connected = false;
-                        self->m_sta_got_ip = false;
-
-                        esp_blufi_extra_info_t info = {};
-                        info.sta_ssid = self->m_sta_ssid;
-                        info.sta_ssid_len = self->m_sta_ssid_len;
-                        esp_blufi_send_wifi_conn_report(mode, ESP_BLUFI_STA_CONN_FAIL,
-                                                        softap_conn_num, &info);
-                        ESP_LOGE(BLUFI_TAG, "Failed to connect to WiFi via esp-wifi-connect");
-                    }
+                    auto* request = static_cast<std::pair<std::string, std::string>*>(ctx);
+                    Blufi::GetInstance()._connect_to_ap(request->first, request->second);
+                    delete request;
                     vTaskDelete(nullptr);
                 },
-                "blufi_wifi_conn", 4096, this, 5, nullptr);
+                "blufi_wifi_conn", 4096, request, 5, nullptr);
             break;
         }
         case ESP_BLUFI_EVENT_REQ_DISCONNECT_FROM_AP:
@@ -865,9 +969,6 @@ void Blufi::_handle_event(esp_blufi_cb_event_t event, esp_blufi_cb_param_t* para
             break;
         case ESP_BLUFI_EVENT_GET_WIFI_LIST: {
             ESP_LOGI(BLUFI_TAG, "BLUFI get wifi list");
-            while (m_scan_in_progress) {
-                vTaskDelay(pdMS_TO_TICKS(500));
-            }
             _send_wifi_list();
             break;
         }
@@ -3,6 +3,8 @@
 #include <aes/esp_aes.h>
 #include <cassert>
 #include <cstring>
+#include <mutex>
+#include <string>
 #include <vector>
 #include "esp_blufi_api.h"
 #include "esp_err.h"
@@ -86,6 +88,9 @@ private:
     // WiFi scan methods
     void _send_wifi_list();
     void _start_dedicated_wifi_scan();
+    bool _scan_cache_stale();
+    // Runs on its own task, so the BLE stack acknowledges the request meanwhile
+    void _connect_to_ap(const std::string &ssid, const std::string &password);
     static void _wifi_scan_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id,
                                          void *event_data);
 
@@ -140,8 +145,14 @@ private:
     bool m_sta_is_connecting;
     esp_blufi_extra_info_t m_sta_conn_info{};
 
-    // WiFi scan related
-    std::vector<wifi_ap_record_t> m_ap_records;
+    // WiFi scan related, the list is kept in its BluFi form and sent as it is for every request
+    std::mutex m_scan_mutex;
+    std::vector<esp_blufi_ap_record_t> m_ap_list;
+    int64_t m_scan_time_us = 0;
     bool m_scan_in_progress = false;
     bool m_scan_should_save_ssid = true;
+    // A list request came in before the first scan finished, answered when it does
+    bool m_wifi_list_pending = false;
+    esp_event_handler_instance_t m_scan_event_instance = nullptr;
+    bool m_bt_mem_released = false;
 };
@@ -1,17 +1,22 @@
 #include "board.h"
 #include "system_info.h"
 #include "settings.h"
+#include "audio_codec.h"
 #include "display/display.h"
 #include "display/oled_display.h"
 #include "assets/lang_config.h"
+#include "application.h"
 
 #include <esp_log.h>
 #include <esp_ota_ops.h>
 #include <esp_chip_info.h>
 #include <esp_random.h>
+#include <esp_timer.h>
 
 #define TAG "Board"
 
+std::atomic<uint32_t> Board::device_status_version_{1};
+
 Board::Board() {
     Settings settings("board", true);
     uuid_ = settings.GetString("uuid");
@@ -45,6 +50,36 @@ std::string Board::GenerateUuid() {
     return std::string(uuid_str);
 }
 
+/*
+ * get_device_status and the status notifications ask for the status far more often than it
+ * changes, and building it reads the battery, often a PMIC over I2C, and the network. The
+ * volume, brightness and theme are plain members, so they are compared on every call. The
+ * rest is rebuilt after InvalidateDeviceStatus() or when the JSON is DEVICE_STATUS_MAX_AGE_MS old.
+ */
+std::string Board::GetDeviceStatusJson() {
+    auto codec = GetAudioCodec();
+    auto backlight = GetBacklight();
+    auto display = GetDisplay();
+    int volume = codec != nullptr ? codec->output_volume() : -1;
+    int brightness = backlight != nullptr ? backlight->brightness() : -1;
+    Theme* theme = display != nullptr ? display->GetTheme() : nullptr;
+    uint32_t version = device_status_version_.load();
+    int64_t now = esp_timer_get_time();
+
+    std::lock_guard<std::mutex> lock(device_status_mutex_);
+    auto& cache = device_status_;
+    if (cache.json.empty() || cache.version != version || now - cache.built_us > DEVICE_STATUS_MAX_AGE_MS * 1000LL ||
+            cache.volume != volume || cache.brightness != brightness || cache.theme != theme) {
+        cache.json = BuildDeviceStatusJson();
+        cache.version = version;
+        cache.built_us = now;
+        cache.volume = volume;
+        cache.brightness = brightness;
+        cache.theme = theme;
+    }
+    return cache.json;
+}
+
 bool Board::GetBatteryLevel(int &level, bool& charging, bool& discharging) {
     return false;
 }
@@ -150,6 +185,10 @@ std::string Board::GetSystemInfoJson() {
     json.pop_back(); // Remove the last comma
     json += R"(],)";
 
+    json += R"("audio_processor":{)";
+    json += R"("mode":")" + std::string(Application::GetInstance().GetAudioService().GetAudioProcessorMode()) + R"(")";
+    json += R"(},)";
+
     json += R"("ota":{)";
     auto ota_partition = esp_ota_get_running_partition();
     json += R"("label":")" + std::string(ota_partition->label) + R"(")";
@@ -7,12 +7,15 @@
 #include <udp.h>
 #include <string>
 #include <functional>
+#include <atomic>
+#include <mutex>
 #include <network_interface.h>
 
 #include "led/led.h"
 #include "backlight.h"
 #include "camera.h"
 #include "assets.h"
+#include "boot_profile.h"
 
 /**
  * Network events for unified callback
@@ -43,9 +46,13 @@ enum class PowerSaveLevel {
 // data contains additional info like SSID for Connecting/Connected events
 using NetworkEventCallback = std::function<void(NetworkEvent event, const std::string& data)>;
 
+// A status older than this is rebuilt, the battery and the signal change without an event
+#define DEVICE_STATUS_MAX_AGE_MS 5000
+
 void* create_board();
 class AudioCodec;
 class Display;
+class Theme;
 class Board {
 private:
     Board(const Board&) = delete; // 禁用拷贝构造函数
@@ -58,9 +65,28 @@ protected:
     // 软件生成的设备唯一标识
     std::string uuid_;
 
+private:
+    // The last BuildDeviceStatusJson() and what it was built from
+    struct DeviceStatusCache {
+        std::string json;
+        uint32_t version = 0;
+        int64_t built_us = 0;
+        int volume = -1;
+        int brightness = -1;
+        Theme* theme = nullptr;
+    };
+    std::mutex device_status_mutex_;
+    DeviceStatusCache device_status_;
+    static std::atomic<uint32_t> device_status_version_;
+
 public:
     static Board& GetInstance() {
-        static Board* instance = static_cast<Board*>(create_board());
+        static Board* instance = []() {
+            BootProfile::Mark("board_create");
+            auto board = static_cast<Board*>(create_board());
+            BootProfile::Mark("board");
+            return board;
+        }();
         return *instance;
     }
 
@@ -81,7 +107,12 @@ public:
     virtual std::string GetSystemInfoJson();
     virtual void SetPowerSaveLevel(PowerSaveLevel level) = 0;
     virtual std::string GetBoardJson() = 0;
-    virtual std::string GetDeviceStatusJson() = 0;
+    // The cached status JSON, rebuilt only when something in it may have changed
+    std::string GetDeviceStatusJson();
+    // Any task: a change the cache can not see by itself, e.g. the network connected
+    static void InvalidateDeviceStatus() { device_status_version_++; }
+    // Queries the hardware and builds the status from scratch
+    virtual std::string BuildDeviceStatusJson() = 0;
 };
 
 #define DECLARE_BOARD(BOARD_CLASS_NAME) \
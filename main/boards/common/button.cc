@@ -1,10 +1,24 @@
 #include "button.h"
 
 #include <button_gpio.h>
+#include <esp_attr.h>
 #include <esp_log.h>
 
 #define TAG "Button"
 
+#define BUTTON_DEBOUNCE_MS 20
+// The iot_button defaults, used when a time is 0
+#ifdef CONFIG_BUTTON_LONG_PRESS_TIME_MS
+#define BUTTON_DEFAULT_LONG_PRESS_MS CONFIG_BUTTON_LONG_PRESS_TIME_MS
+#else
+#define BUTTON_DEFAULT_LONG_PRESS_MS 1500
+#endif
+#ifdef CONFIG_BUTTON_SHORT_PRESS_TIME_MS
+#define BUTTON_DEFAULT_SHORT_PRESS_MS CONFIG_BUTTON_SHORT_PRESS_TIME_MS
+#else
+#define BUTTON_DEFAULT_SHORT_PRESS_MS 180
+#endif
+
 #if CONFIG_SOC_ADC_SUPPORTED
 AdcButton::AdcButton(const button_adc_config_t& adc_config) : Button(nullptr) {
     button_config_t btn_config = {
@@ -22,6 +36,30 @@ Button::Button(gpio_num_t gpio_num, bool active_high, uint16_t long_press_time,
     if (gpio_num == GPIO_NUM_NC) {
         return;
     }
+    if (!enable_power_save) {
+        active_level_ = active_high ? 1 : 0;
+        long_press_us_ = (long_press_time != 0 ? long_press_time : BUTTON_DEFAULT_LONG_PRESS_MS) * 1000LL;
+        short_press_us_ = (short_press_time != 0 ? short_press_time : BUTTON_DEFAULT_SHORT_PRESS_MS) * 1000LL;
+        gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << gpio_num,
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = active_high ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE,
+            .pull_down_en = active_high ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_ANYEDGE,
+        };
+        ESP_ERROR_CHECK(gpio_config(&io_conf));
+        esp_err_t err = gpio_install_isr_service(0);
+        if (err != ESP_ERR_INVALID_STATE) {
+            ESP_ERROR_CHECK(err);
+        }
+        // Held at boot: that press produces no events
+        pressed_ = gpio_get_level(gpio_num) == active_level_;
+        long_pressed_ = pressed_;
+        isr_backend_ = true;
+        InputQueue::GetInstance().Register(this);
+        ESP_ERROR_CHECK(gpio_isr_handler_add(gpio_num, IsrHandler, this));
+        return;
+    }
     button_config_t button_config = {
         .long_press_time = long_press_time,
         .short_press_time = short_press_time
@@ -39,13 +77,105 @@ Button::~Button() {
     if (button_handle_ != NULL) {
         iot_button_delete(button_handle_);
     }
+    if (isr_backend_) {
+        gpio_isr_handler_remove(gpio_num_);
+        InputQueue::GetInstance().Unregister(this);
+    }
+}
+
+void IRAM_ATTR Button::IsrHandler(void* arg) {
+    auto* button = static_cast<Button*>(arg);
+    // One event per burst of bounces, the level is read once it settled
+    if (button->edge_pending_) {
+        return;
+    }
+    button->edge_pending_ = true;
+    if (InputQueue::PostFromIsr(button, 0)) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void Button::OnInput(int32_t value, int64_t time_us) {
+    settle_us_ = time_us + BUTTON_DEBOUNCE_MS * 1000;
+    UpdateDeadline();
+}
+
+void Button::OnDeadline(int64_t now_us) {
+    if (settle_us_ != 0 && now_us >= settle_us_) {
+        settle_us_ = 0;
+        edge_pending_ = false;
+        bool pressed = gpio_get_level(gpio_num_) == active_level_;
+        if (pressed != pressed_) {
+            OnStableLevel(pressed, now_us);
+        }
+    }
+    if (pressed_ && !long_pressed_ && now_us >= pressed_us_ + long_press_us_) {
+        long_pressed_ = true;
+        if (on_long_press_) {
+            on_long_press_();
+        }
+    }
+    // The click sequence ends when no press follows within the short press time
+    if (!pressed_ && clicks_ > 0 && now_us >= released_us_ + short_press_us_) {
+        clicks_ = 0;
+    }
+    UpdateDeadline();
+}
+
+void Button::OnStableLevel(bool pressed, int64_t now_us) {
+    pressed_ = pressed;
+    if (pressed) {
+        pressed_us_ = now_us;
+        long_pressed_ = false;
+        if (clicks_ < UINT8_MAX) {
+            clicks_++;
+        }
+        if (on_press_down_) {
+            on_press_down_();
+        }
+        return;
+    }
+
+    released_us_ = now_us;
+    if (on_press_up_) {
+        on_press_up_();
+    }
+    if (long_pressed_) {
+        clicks_ = 0;
+        return;
+    }
+    // Like iot_button, every click of a sequence reports its count right away
+    if (clicks_ == 1 && on_click_) {
+        on_click_();
+    } else if (clicks_ == 2 && on_double_click_) {
+        on_double_click_();
+    }
+    if (multiple_clicks_ != 0 && clicks_ == multiple_clicks_ && on_multiple_click_) {
+        on_multiple_click_();
+    }
+}
+
+void Button::UpdateDeadline() {
+    int64_t next_us = settle_us_;
+    auto consider = [&next_us](int64_t time_us) {
+        if (next_us == 0 || time_us < next_us) {
+            next_us = time_us;
+        }
+    };
+    if (pressed_ && !long_pressed_) {
+        consider(pressed_us_ + long_press_us_);
+    }
+    if (!pressed_ && clicks_ > 0) {
+        consider(released_us_ + short_press_us_);
+    }
+    deadline_us = next_us;
 }
 
 void Button::OnPressDown(std::function<void()> callback) {
+    on_press_down_ = callback;
     if (button_handle_ == nullptr) {
         return;
     }
-    on_press_down_ = callback;
     iot_button_register_cb(button_handle_, BUTTON_PRESS_DOWN, nullptr, [](void* handle, void* usr_data) {
         Button* button = static_cast<Button*>(usr_data);
         if (button->on_press_down_) {
@@ -55,10 +185,10 @@ void Button::OnPressDown(std::function<void()> callback) {
 }
 
 void Button::OnPressUp(std::function<void()> callback) {
+    on_press_up_ = callback;
     if (button_handle_ == nullptr) {
         return;
     }
-    on_press_up_ = callback;
     iot_button_register_cb(button_handle_, BUTTON_PRESS_UP, nullptr, [](void* handle, void* usr_data) {
         Button* button = static_cast<Button*>(usr_data);
         if (button->on_press_up_) {
@@ -68,10 +198,10 @@ void Button::OnPressUp(std::function<void()> callback) {
 }
 
 void Button::OnLongPress(std::function<void()> callback) {
+    on_long_press_ = callback;
     if (button_handle_ == nullptr) {
         return;
     }
-    on_long_press_ = callback;
     iot_button_register_cb(button_handle_, BUTTON_LONG_PRESS_START, nullptr, [](void* handle, void* usr_data) {
         Button* button = static_cast<Button*>(usr_data);
         if (button->on_long_press_) {
@@ -81,10 +211,10 @@ void Button::OnLongPress(std::function<void()> callback) {
 }
 
 void Button::OnClick(std::function<void()> callback) {
+    on_click_ = callback;
     if (button_handle_ == nullptr) {
         return;
     }
-    on_click_ = callback;
     iot_button_register_cb(button_handle_, BUTTON_SINGLE_CLICK, nullptr, [](void* handle, void* usr_data) {
         Button* button = static_cast<Button*>(usr_data);
         if (button->on_click_) {
@@ -94,10 +224,10 @@ void Button::OnClick(std::function<void()> callback) {
 }
 
 void Button::OnDoubleClick(std::function<void()> callback) {
+    on_double_click_ = callback;
     if (button_handle_ == nullptr) {
         return;
     }
-    on_double_click_ = callback;
     iot_button_register_cb(button_handle_, BUTTON_DOUBLE_CLICK, nullptr, [](void* handle, void* usr_data) {
         Button* button = static_cast<Button*>(usr_data);
         if (button->on_double_click_) {
@@ -107,10 +237,11 @@ void Button::OnDoubleClick(std::function<void()> callback) {
 }
 
 void Button::OnMultipleClick(std::function<void()> callback, uint8_t click_count) {
+    on_multiple_click_ = callback;
+    multiple_clicks_ = click_count;
     if (button_handle_ == nullptr) {
         return;
     }
-    on_multiple_click_ = callback;
     button_event_args_t event_args = {
         .multiple_clicks = {
             .clicks = click_count
@@ -8,7 +8,15 @@
 #include <button_gpio.h>
 #include <functional>
 
-class Button {
+#include "input_queue.h"
+
+/*
+ * A GPIO button is read from its edge interrupt through the InputQueue, which debounces it and
+ * runs the click state machine of iot_button (the same events and default times), so nothing
+ * polls while the button is idle. ADC buttons, other iot_button handles and the power save
+ * button, whose light sleep wakeup needs the level interrupt of iot_button, keep iot_button.
+ */
+class Button : private InputHandler {
 public:
     Button(button_handle_t button_handle);
     Button(gpio_num_t gpio_num, bool active_high = false, uint16_t long_press_time = 0, uint16_t short_press_time = 0, bool enable_power_save = false);
@@ -22,7 +30,7 @@ public:
     void OnMultipleClick(std::function<void()> callback, uint8_t click_count = 3);
 
 protected:
-    gpio_num_t gpio_num_;
+    gpio_num_t gpio_num_ = GPIO_NUM_NC;
     button_handle_t button_handle_ = nullptr;
 
     std::function<void()> on_press_down_;
@@ -31,6 +39,28 @@ protected:
     std::function<void()> on_click_;
     std::function<void()> on_double_click_;
     std::function<void()> on_multiple_click_;
+
+private:
+    // Edge interrupt backend, used when button_handle_ is null
+    bool isr_backend_ = false;
+    // Set by the interrupt, cleared when the level is read
+    volatile bool edge_pending_ = false;
+    uint8_t active_level_ = 0;
+    int64_t long_press_us_ = 0;
+    int64_t short_press_us_ = 0;
+    uint8_t multiple_clicks_ = 0;
+    bool pressed_ = false;
+    bool long_pressed_ = false;
+    uint8_t clicks_ = 0;
+    int64_t settle_us_ = 0;
+    int64_t pressed_us_ = 0;
+    int64_t released_us_ = 0;
+
+    static void IsrHandler(void* arg);
+    void OnInput(int32_t value, int64_t time_us) override;
+    void OnDeadline(int64_t now_us) override;
+    void OnStableLevel(bool pressed, int64_t now_us);
+    void UpdateDeadline();
 };
 
 #if CONFIG_SOC_ADC_SUPPORTED
@@ -1,8 +1,36 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
 #include <string>
 
+// A streamed frame, only valid during the frame callback
+struct CameraFrame {
+    const uint8_t* data;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    uint32_t format;  // V4L2 pixel format
+    int64_t timestamp_us;
+    bool keyframe;  // Encoded frames: decodable on its own
+};
+
+enum VideoCodec {
+    kVideoCodecJpeg,
+    kVideoCodecH264,
+};
+
+struct VideoStreamConfig {
+    VideoCodec codec = kVideoCodecH264;
+    int fps = 10;
+    int bitrate_kbps = 1000;   // H.264
+    int jpeg_quality = 60;
+    int keyframe_interval = 30; // H.264, in frames
+};
+
 class Camera {
 public:
     virtual void SetExplainUrl(const std::string& url, const std::string& token) = 0;
@@ -11,6 +39,28 @@ public:
     virtual bool SetVFlip(bool enabled) = 0;
     virtual bool SetSwapBytes(bool enabled) { return false; }  // Optional, default no-op
     virtual std::string Explain(const std::string& question) = 0;
+    // Optional: told when an assistant session starts and ends, a camera may keep its sensor
+    // streaming through the session so Capture() needs no exposure wait, and power it down after
+    virtual void SetSessionActive(bool active) {}
+    // Optional: JPEG quality (1-100) and downscale (1, 2 or 4) of the next Explain() only, 0 keeps
+    // the one picked from the measured upload rate
+    virtual void SetExplainOverride(int quality, int scale) {}
+    // Optional: count frames interval_ms apart explained together, in one upload of one file part each
+    virtual bool SupportsBurst() const { return false; }
+    virtual std::string ExplainBurst(const std::string& question, int count, int interval_ms) {
+        throw std::runtime_error("Burst capture is not supported");
+    }
+
+    // Optional: calls callback with frames at about fps on a low priority task, a frame the callback
+    // was too slow for is replaced by a newer one. width and height pick the largest sensor mode that
+    // fits, 0 keeps the current one. Capture() is unavailable while streaming.
+    virtual bool StartStreaming(int fps, int width, int height, std::function<void(const CameraFrame&)> callback) { return false; }
+    virtual void StopStreaming() {}
+    // Optional: like StartStreaming() but the frames come compressed by a hardware encoder, at the
+    // sensor resolution. The codec actually used is in frame.format as a V4L2 pixel format, it may
+    // fall back from H.264 to JPEG when the sensor cannot deliver the encoder's input format.
+    // StopStreaming() ends it.
+    virtual bool StartVideoStream(const VideoStreamConfig& config, std::function<void(const CameraFrame&)> callback) { return false; }
 };
 
 #endif // CAMERA_H
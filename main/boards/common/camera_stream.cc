@@ -0,0 +1,122 @@
+#include "camera_stream.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#define TAG "CameraStream"
+
+// Both below the audio and UI tasks, a late frame is replaced by the next one anyway
+#define CAPTURE_TASK_PRIORITY 2
+#define CONSUMER_TASK_PRIORITY 1
+#define CAPTURE_TASK_STACK_SIZE 3072
+#define CONSUMER_TASK_STACK_SIZE 4096
+
+#define CAPTURE_TASK_EXITED_EVENT (1 << 0)
+#define CONSUMER_TASK_EXITED_EVENT (1 << 1)
+
+CameraStream::CameraStream(size_t slot_size, int fps, GrabFunction grab, FrameCallback callback)
+    : slot_size_(slot_size), period_ms_(1000 / (fps > 0 ? fps : 1)), grab_(std::move(grab)), callback_(std::move(callback)) {
+    for (int i = 0; i < kSlotCount; i++) {
+        slots_[i] = (uint8_t*)heap_caps_malloc(slot_size_, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (slots_[i] == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate %u bytes for a frame", (unsigned)slot_size_);
+            for (int j = 0; j < i; j++) {
+                heap_caps_free(slots_[j]);
+                slots_[j] = nullptr;
+            }
+            return;
+        }
+    }
+    ready_semaphore_ = xSemaphoreCreateBinary();
+    event_group_ = xEventGroupCreate();
+
+    running_ = true;
+    xTaskCreate([](void* arg) {
+        static_cast<CameraStream*>(arg)->CaptureTask();
+    }, "camera_stream", CAPTURE_TASK_STACK_SIZE, this, CAPTURE_TASK_PRIORITY, nullptr);
+    xTaskCreate([](void* arg) {
+        static_cast<CameraStream*>(arg)->ConsumerTask();
+    }, "camera_consumer", CONSUMER_TASK_STACK_SIZE, this, CONSUMER_TASK_PRIORITY, nullptr);
+    ESP_LOGI(TAG, "Streaming every %d ms, %u bytes per frame", period_ms_, (unsigned)slot_size_);
+}
+
+CameraStream::~CameraStream() {
+    if (running_) {
+        running_ = false;
+        xSemaphoreGive(ready_semaphore_);
+        xEventGroupWaitBits(event_group_, CAPTURE_TASK_EXITED_EVENT | CONSUMER_TASK_EXITED_EVENT,
+                            pdFALSE, pdTRUE, portMAX_DELAY);
+        ESP_LOGI(TAG, "Stopped, %lu frames delivered, %lu dropped",
+                 (unsigned long)delivered_.load(), (unsigned long)dropped_.load());
+    }
+    if (ready_semaphore_ != nullptr) {
+        vSemaphoreDelete(ready_semaphore_);
+    }
+    if (event_group_ != nullptr) {
+        vEventGroupDelete(event_group_);
+    }
+    for (int i = 0; i < kSlotCount; i++) {
+        heap_caps_free(slots_[i]);
+    }
+}
+
+void CameraStream::CaptureTask() {
+    TickType_t last_wake = xTaskGetTickCount();
+    while (running_) {
+        // The slot that is neither waiting nor being read, only this task writes to it
+        int writing;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writing = 0;
+            while (writing == ready_ || writing == reading_) {
+                writing++;
+            }
+        }
+
+        CameraFrame frame = {};
+        if (grab_(slots_[writing], slot_size_, frame)) {
+            frame.data = slots_[writing];
+            if (frame.timestamp_us == 0) {
+                frame.timestamp_us = esp_timer_get_time();
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ready_ >= 0) {
+                dropped_++;
+            }
+            frames_[writing] = frame;
+            ready_ = writing;
+            xSemaphoreGive(ready_semaphore_);
+        }
+        // Skips ahead instead of catching up when a grab took longer than the period
+        if (xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(period_ms_)) == pdFALSE) {
+            last_wake = xTaskGetTickCount();
+        }
+    }
+    xEventGroupSetBits(event_group_, CAPTURE_TASK_EXITED_EVENT);
+    vTaskDelete(NULL);
+}
+
+void CameraStream::ConsumerTask() {
+    while (running_) {
+        xSemaphoreTake(ready_semaphore_, portMAX_DELAY);
+        CameraFrame frame;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_ || ready_ < 0) {
+                continue;
+            }
+            reading_ = ready_;
+            ready_ = -1;
+            frame = frames_[reading_];
+        }
+        callback_(frame);
+        delivered_++;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            reading_ = -1;
+        }
+    }
+    xEventGroupSetBits(event_group_, CONSUMER_TASK_EXITED_EVENT);
+    vTaskDelete(NULL);
+}
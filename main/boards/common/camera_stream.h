@@ -0,0 +1,58 @@
+#ifndef CAMERA_STREAM_H
+#define CAMERA_STREAM_H
+
+#include "camera.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/event_groups.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+/*
+ * Streams camera frames through three slots allocated once: the camera task fills one while the
+ * consumer task reads another, and the third holds the newest frame waiting to be read. A frame
+ * still waiting when the next one is ready is dropped, so a slow consumer always sees the latest
+ * frame and never holds up the camera.
+ */
+class CameraStream {
+public:
+    using FrameCallback = std::function<void(const CameraFrame&)>;
+    // Copies a frame of at most slot_size bytes into slot and fills in frame, false to skip this one
+    using GrabFunction = std::function<bool(uint8_t* slot, size_t slot_size, CameraFrame& frame)>;
+
+    CameraStream(size_t slot_size, int fps, GrabFunction grab, FrameCallback callback);
+    // Stops both tasks, the callback is not called after this returns
+    ~CameraStream();
+
+    bool valid() const { return slots_[0] != nullptr; }
+    uint32_t delivered() const { return delivered_; }
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    static constexpr int kSlotCount = 3;
+
+    size_t slot_size_;
+    int period_ms_;
+    GrabFunction grab_;
+    FrameCallback callback_;
+    uint8_t* slots_[kSlotCount] = {};
+    CameraFrame frames_[kSlotCount] = {};
+
+    std::mutex mutex_;
+    int ready_ = -1;
+    int reading_ = -1;
+    SemaphoreHandle_t ready_semaphore_ = nullptr;
+    EventGroupHandle_t event_group_ = nullptr;
+    std::atomic<bool> running_ = false;
+    std::atomic<uint32_t> delivered_ = 0;
+    std::atomic<uint32_t> dropped_ = 0;
+
+    void CaptureTask();
+    void ConsumerTask();
+};
+
+#endif // CAMERA_STREAM_H
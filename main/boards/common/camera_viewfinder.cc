@@ -0,0 +1,57 @@
+#include "camera_viewfinder.h"
+#include "lvgl_display.h"
+
+#include <esp_log.h>
+
+#include "linux/videodev2.h"
+
+#define TAG "CameraViewfinder"
+
+bool CameraViewfinder::Start(Camera* camera, LvglDisplay* display, int fps) {
+    Stop();
+    if (display == nullptr || !display->HasViewfinder()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    camera_ = camera;
+    display_ = display;
+    format_warned_ = false;
+    frames_ = 0;
+    // The sensor mode nearest the preview area leaves the least to downscale
+    int width, height;
+    display->GetPreviewImageSize(width, height);
+    if (!camera->StartStreaming(fps, width, height, [this](const CameraFrame& frame) { OnFrame(frame); })) {
+        camera_ = nullptr;
+        display_ = nullptr;
+        return false;
+    }
+    ESP_LOGI(TAG, "Viewfinder at %d fps in %dx%d", fps, width, height);
+    return true;
+}
+
+void CameraViewfinder::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (camera_ == nullptr) {
+        return;
+    }
+    // No frame is drawn once the stream stopped
+    camera_->StopStreaming();
+    display_->StopViewfinder();
+    camera_ = nullptr;
+    display_ = nullptr;
+    ESP_LOGI(TAG, "Viewfinder stopped, %lu frames", frames_);
+}
+
+void CameraViewfinder::OnFrame(const CameraFrame& frame) {
+    bool rgb565 = frame.format == V4L2_PIX_FMT_RGB565 || frame.format == V4L2_PIX_FMT_RGB565X;
+    if (!rgb565 || frame.len < (size_t)frame.width * frame.height * 2) {
+        if (!format_warned_) {
+            ESP_LOGW(TAG, "Cannot show %dx%d frames of format 0x%08lx", frame.width, frame.height, frame.format);
+            format_warned_ = true;
+        }
+        return;
+    }
+    if (display_->DrawViewfinderFrame(frame.data, frame.width, frame.height, frame.format == V4L2_PIX_FMT_RGB565X)) {
+        frames_++;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef CAMERA_VIEWFINDER_H
+#define CAMERA_VIEWFINDER_H
+
+#include <mutex>
+
+#include "camera.h"
+
+class LvglDisplay;
+
+/*
+ * Live camera view on the screen. A camera stream sized to the preview area feeds the display's
+ * direct panel path, so a frame costs a downscale and an SPI transfer instead of an LVGL image,
+ * an invalidate and a software blit. Photos, the watch and the video stream take the camera over
+ * and end it.
+ */
+class CameraViewfinder {
+public:
+    static CameraViewfinder& GetInstance() {
+        static CameraViewfinder instance;
+        return instance;
+    }
+
+    bool Start(Camera* camera, LvglDisplay* display, int fps);
+    void Stop();
+    bool active() const { return camera_ != nullptr; }
+
+private:
+    std::mutex mutex_;
+    Camera* camera_ = nullptr;
+    LvglDisplay* display_ = nullptr;
+    // Stream task only
+    bool format_warned_ = false;
+    uint32_t frames_ = 0;
+
+    CameraViewfinder() = default;
+
+    void OnFrame(const CameraFrame& frame);
+};
+
+#endif // CAMERA_VIEWFINDER_H
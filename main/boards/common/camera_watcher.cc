@@ -0,0 +1,216 @@
+#include "camera_watcher.h"
+#include "application.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "linux/videodev2.h"
+
+#define TAG "CameraWatcher"
+
+// Detection runs on frames of about this size
+#define WATCH_FRAME_WIDTH 160
+#define WATCH_FRAME_HEIGHT 120
+// Pixels sampled across each cell, in both directions
+#define WATCH_CELL_SAMPLES 4
+// Share of the cells that must change for an event
+#define WATCH_MIN_CHANGED_PERCENT 2
+
+bool CameraWatcher::Start(Camera* camera, int sensitivity, int cooldown_ms) {
+    Stop();
+    std::lock_guard<std::mutex> lock(mutex_);
+    camera_ = camera;
+    sensitivity_ = sensitivity;
+    cooldown_ms_ = cooldown_ms;
+    events_ = 0;
+    last_event_us_ = 0;
+    if (!StartStream()) {
+        camera_ = nullptr;
+        return false;
+    }
+    ESP_LOGI(TAG, "Watching at %d fps, sensitivity %d, cooldown %d ms", CONFIG_XIAOZHI_CAMERA_WATCH_FPS,
+             sensitivity, cooldown_ms);
+    return true;
+}
+
+void CameraWatcher::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (camera_ == nullptr) {
+        return;
+    }
+    camera_->StopStreaming();
+    camera_ = nullptr;
+    ESP_LOGI(TAG, "Watch stopped, %lu events", events_.load());
+}
+
+bool CameraWatcher::StartStream() {
+    has_background_ = false;
+    changed_frames_ = 0;
+    format_warned_ = false;
+    return camera_->StartStreaming(CONFIG_XIAOZHI_CAMERA_WATCH_FPS, WATCH_FRAME_WIDTH, WATCH_FRAME_HEIGHT,
+        [this](const CameraFrame& frame) { OnFrame(frame); });
+}
+
+CameraWatcher::Suspension::Suspension() {
+    auto& watcher = CameraWatcher::GetInstance();
+    std::lock_guard<std::mutex> lock(watcher.mutex_);
+    if (watcher.camera_ != nullptr) {
+        watcher.camera_->StopStreaming();
+        resume_ = true;
+    }
+}
+
+CameraWatcher::Suspension::~Suspension() {
+    if (!resume_) {
+        return;
+    }
+    auto& watcher = CameraWatcher::GetInstance();
+    std::lock_guard<std::mutex> lock(watcher.mutex_);
+    if (watcher.camera_ != nullptr && !watcher.StartStream()) {
+        ESP_LOGW(TAG, "Failed to resume the watch");
+        watcher.camera_ = nullptr;
+    }
+}
+
+bool CameraWatcher::SampleCells(const CameraFrame& frame, uint8_t* cells) {
+    int bytes_per_pixel;
+    switch (frame.format) {
+        case V4L2_PIX_FMT_GREY:
+            bytes_per_pixel = 1;
+            break;
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_RGB565X:
+            bytes_per_pixel = 2;
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            bytes_per_pixel = 3;
+            break;
+        default:
+            return false;
+    }
+    int cell_width = frame.width / kGridWidth;
+    int cell_height = frame.height / kGridHeight;
+    if (cell_width == 0 || cell_height == 0 ||
+        frame.len < (size_t)frame.width * frame.height * bytes_per_pixel) {
+        return false;
+    }
+    for (int cy = 0; cy < kGridHeight; cy++) {
+        for (int cx = 0; cx < kGridWidth; cx++) {
+            uint32_t sum = 0;
+            for (int sy = 0; sy < WATCH_CELL_SAMPLES; sy++) {
+                int y = cy * cell_height + sy * cell_height / WATCH_CELL_SAMPLES;
+                for (int sx = 0; sx < WATCH_CELL_SAMPLES; sx++) {
+                    int x = cx * cell_width + sx * cell_width / WATCH_CELL_SAMPLES;
+                    const uint8_t* p = frame.data + ((size_t)y * frame.width + x) * bytes_per_pixel;
+                    uint32_t luma;
+                    switch (frame.format) {
+                        case V4L2_PIX_FMT_RGB565:
+                        case V4L2_PIX_FMT_RGB565X: {
+                            uint16_t v = frame.format == V4L2_PIX_FMT_RGB565 ? (p[0] | (p[1] << 8)) : ((p[0] << 8) | p[1]);
+                            luma = (((v >> 11) & 0x1F) * 8 * 77 + ((v >> 5) & 0x3F) * 4 * 150 + (v & 0x1F) * 8 * 29) >> 8;
+                            break;
+                        }
+                        case V4L2_PIX_FMT_RGB24:
+                            luma = (p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8;
+                            break;
+                        default:
+                            // GREY, and the Y of each YUYV pixel
+                            luma = p[0];
+                            break;
+                    }
+                    sum += luma;
+                }
+            }
+            cells[cy * kGridWidth + cx] = sum / (WATCH_CELL_SAMPLES * WATCH_CELL_SAMPLES);
+        }
+    }
+    return true;
+}
+
+void CameraWatcher::OnFrame(const CameraFrame& frame) {
+    uint8_t cells[kCells];
+    if (!SampleCells(frame, cells)) {
+        if (!format_warned_) {
+            ESP_LOGW(TAG, "Cannot watch %dx%d frames of format 0x%08lx", frame.width, frame.height, frame.format);
+            format_warned_ = true;
+        }
+        return;
+    }
+    if (!has_background_) {
+        for (int i = 0; i < kCells; i++) {
+            background_[i] = cells[i] << 4;
+        }
+        has_background_ = true;
+        return;
+    }
+
+    // The mean difference is the exposure, what stands out from it is motion
+    int total = 0;
+    for (int i = 0; i < kCells; i++) {
+        total += (cells[i] << 4) - background_[i];
+    }
+    int mean = total / kCells;
+    int threshold = (64 - sensitivity_ * 58 / 100) << 4;
+    int changed = 0;
+    int x0 = kGridWidth, y0 = kGridHeight, x1 = -1, y1 = -1;
+    for (int i = 0; i < kCells; i++) {
+        int diff = (cells[i] << 4) - background_[i];
+        bool moved = abs(diff - mean) > threshold;
+        if (moved) {
+            int x = i % kGridWidth;
+            int y = i / kGridWidth;
+            changed++;
+            x0 = std::min(x0, x);
+            y0 = std::min(y0, y);
+            x1 = std::max(x1, x);
+            y1 = std::max(y1, y);
+        }
+        // Something that stays is learned into the background over tens of frames
+        background_[i] += diff / (moved ? 32 : 8);
+    }
+
+    int changed_percent = changed * 100 / kCells;
+    if (changed_percent < WATCH_MIN_CHANGED_PERCENT) {
+        changed_frames_ = 0;
+        return;
+    }
+    if (++changed_frames_ < 2) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (last_event_us_ != 0 && now - last_event_us_ < (int64_t)cooldown_ms_ * 1000) {
+        return;
+    }
+    last_event_us_ = now;
+    events_++;
+    Notify(changed_percent, x0, y0, x1, y1);
+}
+
+void CameraWatcher::Notify(int changed_percent, int x0, int y0, int x1, int y1) {
+    ESP_LOGI(TAG, "Motion in %d%% of the frame", changed_percent);
+    cJSON* params = cJSON_CreateObject();
+    cJSON_AddStringToObject(params, "event", "motion");
+    cJSON_AddNumberToObject(params, "changed_percent", changed_percent);
+    // The bounding box of the changed cells, in percent of the frame
+    cJSON* region = cJSON_CreateObject();
+    cJSON_AddNumberToObject(region, "x", x0 * 100 / kGridWidth);
+    cJSON_AddNumberToObject(region, "y", y0 * 100 / kGridHeight);
+    cJSON_AddNumberToObject(region, "width", (x1 - x0 + 1) * 100 / kGridWidth);
+    cJSON_AddNumberToObject(region, "height", (y1 - y0 + 1) * 100 / kGridHeight);
+    cJSON_AddItemToObject(params, "region", region);
+
+    cJSON* notification = cJSON_CreateObject();
+    cJSON_AddStringToObject(notification, "jsonrpc", "2.0");
+    cJSON_AddStringToObject(notification, "method", "notifications/camera_event");
+    cJSON_AddItemToObject(notification, "params", params);
+    auto json_str = cJSON_PrintUnformatted(notification);
+    std::string payload(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(notification);
+    Application::GetInstance().SendMcpMessage(std::move(payload));
+}
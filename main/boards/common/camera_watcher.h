@@ -0,0 +1,67 @@
+#ifndef CAMERA_WATCHER_H
+#define CAMERA_WATCHER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "camera.h"
+
+/*
+ * Watches a low-rate, downscaled camera stream on the device and pushes
+ * `notifications/camera_event` when something moves, so the server looks at the scene only
+ * when it changed instead of polling with take_photo.
+ *
+ * Each frame is reduced to a grid of mean luma cells and compared with a slowly adapting
+ * background. A uniform shift of all cells, the sensor adjusting its exposure, is not motion.
+ * An event needs the change in two frames in a row, and events are at least the cooldown apart.
+ */
+class CameraWatcher {
+public:
+    static CameraWatcher& GetInstance() {
+        static CameraWatcher instance;
+        return instance;
+    }
+
+    // sensitivity 1-100, a higher one reports smaller changes
+    bool Start(Camera* camera, int sensitivity, int cooldown_ms);
+    void Stop();
+    bool active() const { return camera_ != nullptr; }
+
+    // Frees the camera while a photo is taken, the watch goes on with a new background afterwards
+    class Suspension {
+    public:
+        Suspension();
+        ~Suspension();
+    private:
+        bool resume_ = false;
+    };
+
+private:
+    static constexpr int kGridWidth = 16;
+    static constexpr int kGridHeight = 12;
+    static constexpr int kCells = kGridWidth * kGridHeight;
+
+    std::mutex mutex_;
+    Camera* camera_ = nullptr;
+    int sensitivity_ = 50;
+    int cooldown_ms_ = 10000;
+
+    // Consumer task only, reset before the stream starts
+    uint16_t background_[kCells] = {};   // Luma x 16
+    bool has_background_ = false;
+    int changed_frames_ = 0;
+    int64_t last_event_us_ = 0;
+    bool format_warned_ = false;
+    std::atomic<uint32_t> events_{0};
+
+    CameraWatcher() = default;
+
+    bool StartStream();
+    void OnFrame(const CameraFrame& frame);
+    // Mean luma of each grid cell, false for a pixel format without plain luma
+    bool SampleCells(const CameraFrame& frame, uint8_t* cells);
+    void Notify(int changed_percent, int x0, int y0, int x1, int y1);
+};
+
+#endif // CAMERA_WATCHER_H
@@ -4,20 +4,60 @@
 #include "assets/lang_config.h"
 #include "settings.h"
 #include <esp_log.h>
+#include <wifi_manager.h>
+#include <ssid_manager.h>
 
 static const char *TAG = "DualNetworkBoard";
 
-DualNetworkBoard::DualNetworkBoard(gpio_num_t ml307_tx_pin, gpio_num_t ml307_rx_pin, gpio_num_t ml307_dtr_pin, int32_t default_net_type) 
-    : Board(), 
-      ml307_tx_pin_(ml307_tx_pin), 
-      ml307_rx_pin_(ml307_rx_pin), 
+// The link monitor samples both networks this often
+static constexpr int LINK_CHECK_INTERVAL_MS = 5000;
+// Consecutive poor samples of the current network before failing over
+static constexpr int FAILOVER_SAMPLES = 3;
+// Consecutive good samples of the preferred network before returning to it
+static constexpr int FAILBACK_SAMPLES = 6;
+
+#ifdef CONFIG_DUAL_NETWORK_FAILOVER_RSSI
+static constexpr int FAILOVER_MIN_RSSI = CONFIG_DUAL_NETWORK_FAILOVER_RSSI;
+#else
+static constexpr int FAILOVER_MIN_RSSI = -80;
+#endif
+
+static NetworkType OtherNetwork(NetworkType type) {
+    return type == NetworkType::WIFI ? NetworkType::ML307 : NetworkType::WIFI;
+}
+
+DualNetworkBoard::DualNetworkBoard(gpio_num_t ml307_tx_pin, gpio_num_t ml307_rx_pin, gpio_num_t ml307_dtr_pin, int32_t default_net_type)
+    : Board(),
+      ml307_tx_pin_(ml307_tx_pin),
+      ml307_rx_pin_(ml307_rx_pin),
       ml307_dtr_pin_(ml307_dtr_pin) {
-    
+
     // 从Settings加载网络类型
-    network_type_ = LoadNetworkTypeFromSettings(default_net_type);
-    
-    // 只初始化当前网络类型对应的板卡
-    InitializeCurrentBoard();
+    preferred_type_ = LoadNetworkTypeFromSettings(default_net_type);
+    network_type_ = preferred_type_;
+
+    // 只初始化当前网络类型对应的板卡, the other one is created when it is needed
+    current_board_ = &GetBoard(preferred_type_);
+
+#if CONFIG_DUAL_NETWORK_FAILOVER
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<DualNetworkBoard*>(arg)->CheckLinkQuality();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "link_monitor",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&timer_args, &link_monitor_timer_);
+#endif
+}
+
+DualNetworkBoard::~DualNetworkBoard() {
+    if (link_monitor_timer_ != nullptr) {
+        esp_timer_stop(link_monitor_timer_);
+        esp_timer_delete(link_monitor_timer_);
+    }
 }
 
 NetworkType DualNetworkBoard::LoadNetworkTypeFromSettings(int32_t default_net_type) {
@@ -32,67 +72,202 @@ void DualNetworkBoard::SaveNetworkTypeToSettings(NetworkType type) {
     settings.SetInt("type", network_type);
 }
 
-void DualNetworkBoard::InitializeCurrentBoard() {
-    if (network_type_ == NetworkType::ML307) {
-        ESP_LOGI(TAG, "Initialize ML307 board");
-        current_board_ = std::make_unique<Ml307Board>(ml307_tx_pin_, ml307_rx_pin_, ml307_dtr_pin_);
-    } else {
+Board& DualNetworkBoard::GetBoard(NetworkType type) {
+    if (type == NetworkType::ML307) {
+        if (ml307_board_ == nullptr) {
+            ESP_LOGI(TAG, "Initialize ML307 board");
+            ml307_board_ = std::make_unique<Ml307Board>(ml307_tx_pin_, ml307_rx_pin_, ml307_dtr_pin_);
+            ml307_board_->SetNetworkEventCallback([this](NetworkEvent event, const std::string& data) {
+                OnBoardNetworkEvent(NetworkType::ML307, event, data);
+            });
+        }
+        return *ml307_board_;
+    }
+    if (wifi_board_ == nullptr) {
         ESP_LOGI(TAG, "Initialize WiFi board");
-        current_board_ = std::make_unique<WifiBoard>();
+        wifi_board_ = std::make_unique<WifiBoard>();
+        wifi_board_->SetNetworkEventCallback([this](NetworkEvent event, const std::string& data) {
+            OnBoardNetworkEvent(NetworkType::WIFI, event, data);
+        });
     }
+    return *wifi_board_;
+}
+
+void DualNetworkBoard::StartStandbyNetwork(NetworkType type) {
+    bool& started = type == NetworkType::ML307 ? ml307_started_ : wifi_started_;
+    if (started) {
+        return;
+    }
+    started = true;
+    ESP_LOGI(TAG, "Starting standby %s network", type == NetworkType::ML307 ? "ML307" : "WiFi");
+    auto& board = GetBoard(type);
+    if (type == NetworkType::WIFI) {
+        // A standby Wi-Fi without credentials must not take over the screen
+        wifi_board_->SetConfigModeFallback(false);
+    }
+    board.StartNetwork();
 }
 
 void DualNetworkBoard::SwitchNetworkType() {
     auto display = GetDisplay();
-    if (network_type_ == NetworkType::WIFI) {    
-        SaveNetworkTypeToSettings(NetworkType::ML307);
+    NetworkType target = OtherNetwork(network_type_);
+    preferred_type_ = target;
+    SaveNetworkTypeToSettings(target);
+    if (target == NetworkType::ML307) {
         display->ShowNotification(Lang::Strings::SWITCH_TO_4G_NETWORK);
     } else {
-        SaveNetworkTypeToSettings(NetworkType::WIFI);
         display->ShowNotification(Lang::Strings::SWITCH_TO_WIFI_NETWORK);
     }
-    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    if (IsLinkGood(target)) {
+        ActivateNetwork(target);
+        return;
+    }
+    if (target == NetworkType::WIFI && SsidManager::GetInstance().GetSsidList().empty()) {
+        // Nothing to connect to, boot into Wi-Fi for its config mode
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        Application::GetInstance().Reboot();
+        return;
+    }
+    // Moves over on the Connected event of the other network
+    switch_pending_ = true;
+    StartStandbyNetwork(target);
+}
+
+void DualNetworkBoard::OnBoardNetworkEvent(NetworkType type, NetworkEvent event, const std::string& data) {
+    if (type != network_type_) {
+        if (event == NetworkEvent::Connected) {
+            ESP_LOGI(TAG, "Standby %s network connected", type == NetworkType::ML307 ? "ML307" : "WiFi");
+            if (switch_pending_) {
+                ActivateNetwork(type);
+            } else if (type == NetworkType::ML307) {
+                ml307_board_->SetStandby(true);
+            }
+        }
+        return;
+    }
+
+#if CONFIG_DUAL_NETWORK_FAILOVER
+    // Fail over at once instead of waiting for the link monitor
+    if (event == NetworkEvent::Disconnected && !switch_pending_ && IsLinkGood(OtherNetwork(type))) {
+        ESP_LOGW(TAG, "Current network lost, failing over");
+        ActivateNetwork(OtherNetwork(type));
+        return;
+    }
+#endif
+
+    if (network_event_callback_) {
+        network_event_callback_(event, data);
+    }
+}
+
+void DualNetworkBoard::ActivateNetwork(NetworkType type) {
+    switch_pending_ = false;
+    NetworkType previous = network_type_.exchange(type);
+    if (previous == type) {
+        return;
+    }
+    if (type == NetworkType::ML307) {
+        ml307_board_->SetStandby(false);
+    }
+    current_board_ = &GetBoard(type);
+    poor_link_samples_ = 0;
+    good_link_samples_ = 0;
+    ESP_LOGI(TAG, "Switched to %s network", type == NetworkType::ML307 ? "ML307" : "WiFi");
+    if (previous == NetworkType::ML307) {
+        ml307_board_->SetStandby(true);
+    }
+
     auto& app = Application::GetInstance();
-    app.Reboot();
+    app.ReconnectProtocol();
+    if (network_event_callback_) {
+        std::string data = type == NetworkType::WIFI ? WifiManager::GetInstance().GetSsid() : "";
+        network_event_callback_(NetworkEvent::Connected, data);
+    }
+}
+
+bool DualNetworkBoard::IsLinkGood(NetworkType type) {
+    if (type == NetworkType::ML307) {
+        return ml307_started_ && ml307_board_->IsNetworkReady();
+    }
+    if (!wifi_started_) {
+        return false;
+    }
+    auto& wifi = WifiManager::GetInstance();
+    return wifi.IsConnected() && wifi.GetRssi() >= FAILOVER_MIN_RSSI;
+}
+
+void DualNetworkBoard::CheckLinkQuality() {
+    if (switch_pending_) {
+        return;
+    }
+    NetworkType current = network_type_;
+    NetworkType other = OtherNetwork(current);
+    if (!IsLinkGood(current)) {
+        good_link_samples_ = 0;
+        if (++poor_link_samples_ >= FAILOVER_SAMPLES && IsLinkGood(other)) {
+            ESP_LOGW(TAG, "Current network is poor, failing over");
+            ActivateNetwork(other);
+        }
+        return;
+    }
+    poor_link_samples_ = 0;
+
+    // Return to the chosen network between conversations
+    if (current != preferred_type_ && IsLinkGood(preferred_type_)) {
+        if (++good_link_samples_ >= FAILBACK_SAMPLES &&
+            Application::GetInstance().GetDeviceState() == kDeviceStateIdle) {
+            ESP_LOGI(TAG, "Preferred network is good again, returning to it");
+            ActivateNetwork(preferred_type_);
+        }
+    } else {
+        good_link_samples_ = 0;
+    }
 }
 
- 
 std::string DualNetworkBoard::GetBoardType() {
-    return current_board_->GetBoardType();
+    return GetCurrentBoard().GetBoardType();
 }
 
 void DualNetworkBoard::StartNetwork() {
     auto display = Board::GetInstance().GetDisplay();
-    
+
     if (network_type_ == NetworkType::WIFI) {
         display->SetStatus(Lang::Strings::CONNECTING);
+        wifi_started_ = true;
     } else {
         display->SetStatus(Lang::Strings::DETECTING_MODULE);
+        ml307_started_ = true;
     }
-    current_board_->StartNetwork();
+    GetCurrentBoard().StartNetwork();
+
+#if CONFIG_DUAL_NETWORK_FAILOVER
+    StartStandbyNetwork(OtherNetwork(network_type_));
+    esp_timer_start_periodic(link_monitor_timer_, LINK_CHECK_INTERVAL_MS * 1000);
+#endif
 }
 
 void DualNetworkBoard::SetNetworkEventCallback(NetworkEventCallback callback) {
-    // Forward the callback to the current board
-    current_board_->SetNetworkEventCallback(std::move(callback));
+    // The boards report to OnBoardNetworkEvent(), which forwards the current one
+    network_event_callback_ = std::move(callback);
 }
 
 NetworkInterface* DualNetworkBoard::GetNetwork() {
-    return current_board_->GetNetwork();
+    return GetCurrentBoard().GetNetwork();
 }
 
 const char* DualNetworkBoard::GetNetworkStateIcon() {
-    return current_board_->GetNetworkStateIcon();
+    return GetCurrentBoard().GetNetworkStateIcon();
 }
 
 void DualNetworkBoard::SetPowerSaveLevel(PowerSaveLevel level) {
-    current_board_->SetPowerSaveLevel(level);
+    GetCurrentBoard().SetPowerSaveLevel(level);
 }
 
-std::string DualNetworkBoard::GetBoardJson() {   
-    return current_board_->GetBoardJson();
+std::string DualNetworkBoard::GetBoardJson() {
+    return GetCurrentBoard().GetBoardJson();
 }
 
-std::string DualNetworkBoard::GetDeviceStatusJson() {
-    return current_board_->GetDeviceStatusJson();
+std::string DualNetworkBoard::BuildDeviceStatusJson() {
+    return GetCurrentBoard().BuildDeviceStatusJson();
 }
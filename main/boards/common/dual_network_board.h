@@ -4,6 +4,8 @@
 #include "board.h"
 #include "wifi_board.h"
 #include "ml307_board.h"
+#include <esp_timer.h>
+#include <atomic>
 #include <memory>
 
 //enum NetworkType
@@ -12,40 +14,70 @@ enum class NetworkType {
     ML307
 };
 
-// 双网络板卡类，可以在WiFi和ML307之间切换
+/*
+ * 双网络板卡类，可以在WiFi和ML307之间切换
+ *
+ * Switching needs no reboot: the other network is brought up next to the current one and the
+ * application moves over once it is connected. With CONFIG_DUAL_NETWORK_FAILOVER both networks
+ * stay up all the time, and a link monitor fails over when the current one drops or weakens.
+ */
 class DualNetworkBoard : public Board {
 private:
-    // 使用基类指针存储当前活动的板卡
-    std::unique_ptr<Board> current_board_;
-    NetworkType network_type_ = NetworkType::ML307;  // Default to ML307
+    std::unique_ptr<WifiBoard> wifi_board_;
+    std::unique_ptr<Ml307Board> ml307_board_;
+    bool wifi_started_ = false;
+    bool ml307_started_ = false;
+    // 当前活动的板卡
+    std::atomic<Board*> current_board_{nullptr};
+    std::atomic<NetworkType> network_type_{NetworkType::ML307};  // Default to ML307
+    // The network saved in Settings, the failover returns to it
+    NetworkType preferred_type_ = NetworkType::ML307;
+    // The other network is coming up because of SwitchNetworkType()
+    std::atomic<bool> switch_pending_{false};
+    NetworkEventCallback network_event_callback_;
+    esp_timer_handle_t link_monitor_timer_ = nullptr;
+    int poor_link_samples_ = 0;
+    int good_link_samples_ = 0;
 
     // ML307的引脚配置
     gpio_num_t ml307_tx_pin_;
     gpio_num_t ml307_rx_pin_;
     gpio_num_t ml307_dtr_pin_;
-    
+
     // 从Settings加载网络类型
     NetworkType LoadNetworkTypeFromSettings(int32_t default_net_type);
-    
+
     // 保存网络类型到Settings
     void SaveNetworkTypeToSettings(NetworkType type);
 
-    // 初始化当前网络类型对应的板卡
-    void InitializeCurrentBoard();
- 
+    // 创建网络类型对应的板卡
+    Board& GetBoard(NetworkType type);
+
+    // Brings up the network of the type next to the current one, once
+    void StartStandbyNetwork(NetworkType type);
+
+    // Events of both boards, only those of the current one reach the application
+    void OnBoardNetworkEvent(NetworkType type, NetworkEvent event, const std::string& data);
+
+    // Moves the application to the network of the type
+    void ActivateNetwork(NetworkType type);
+
+    bool IsLinkGood(NetworkType type);
+    void CheckLinkQuality();
+
 public:
     DualNetworkBoard(gpio_num_t ml307_tx_pin, gpio_num_t ml307_rx_pin, gpio_num_t ml307_dtr_pin = GPIO_NUM_NC, int32_t default_net_type = 1);
-    virtual ~DualNetworkBoard() = default;
- 
+    virtual ~DualNetworkBoard();
+
     // 切换网络类型
     void SwitchNetworkType();
-    
+
     // 获取当前网络类型
     NetworkType GetNetworkType() const { return network_type_; }
-    
+
     // 获取当前活动的板卡引用
-    Board& GetCurrentBoard() const { return *current_board_; }
-    
+    Board& GetCurrentBoard() const { return *current_board_.load(); }
+
     // 重写Board接口
     virtual std::string GetBoardType() override;
     virtual void StartNetwork() override;
@@ -54,7 +86,7 @@ public:
     virtual const char* GetNetworkStateIcon() override;
     virtual void SetPowerSaveLevel(PowerSaveLevel level) override;
     virtual std::string GetBoardJson() override;
-    virtual std::string GetDeviceStatusJson() override;
+    virtual std::string BuildDeviceStatusJson() override;
 };
 
-#endif // DUAL_NETWORK_BOARD_H 
\ No newline at end of file
+#endif // DUAL_NETWORK_BOARD_H
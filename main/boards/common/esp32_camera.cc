@@ -3,7 +3,10 @@
 #include <esp_heap_caps.h>
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <stdexcept>
 #include <esp_log.h>
+#include <driver/gpio.h>
 #include <img_converters.h>
 
 #include "esp32_camera.h"
@@ -11,62 +14,216 @@
 #include "display.h"
 #include "lvgl_display.h"
 #include "mcp_server.h"
+#include "memory_budget.h"
+#include "dns_cache.h"
+#include "http_pool.h"
 #include "system_info.h"
 #include "jpg/image_to_jpeg.h"
 #include "esp_timer.h"
 
 #define TAG "Esp32Camera"
 
-Esp32Camera::Esp32Camera(const camera_config_t &config) {
-    esp_err_t err = esp_camera_init(&config);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_camera_init failed with error 0x%x", err);
-        return;
+#define EXPLAIN_BOUNDARY "----ESP32_CAMERA_BOUNDARY"
+// Frames of a burst in memory at once, the capture waits when the encoder is this far behind
+#define BURST_RING_SLOTS 3
+
+Esp32Camera::Esp32Camera(const camera_config_t &config) : config_(config) {
+#if CONFIG_XIAOZHI_CAMERA_HOT_MODE
+    // The driver keeps filling two buffers and drops the older frame, Capture() takes the newest at once
+    if (config_.fb_location == CAMERA_FB_IN_PSRAM) {
+        config_.fb_count = std::max<size_t>(config_.fb_count, 2);
+        config_.grab_mode = CAMERA_GRAB_LATEST;
+    } else {
+        ESP_LOGW(TAG, "Hot mode needs the frame buffers in PSRAM, capturing on demand");
     }
-
-    sensor_t *s = esp_camera_sensor_get();
-    if (s) {
-        if (s->id.PID == GC0308_PID) {
-            s->set_hmirror(s, 0); // Control camera mirror: 1 for mirror, 0 for normal
-        }
-        ESP_LOGI(TAG, "Camera initialized: format=%d", config.pixel_format);
+#endif
+    if (!PowerUp()) {
+        return;
     }
 
-    streaming_on_ = true;
+    max_frame_size_ = config_.frame_size;
+    ESP_LOGI(TAG, "Camera initialized: format=%d", config_.pixel_format);
+#if CONFIG_XIAOZHI_CAMERA_HOT_MODE
+    // The sensor was probed, it sleeps until the first session
+    PowerDown();
+#endif
 }
 
 Esp32Camera::~Esp32Camera() {
+    StopStreamingLocked();
     if (streaming_on_) {
         if (current_fb_) {
             esp_camera_fb_return(current_fb_);
             current_fb_ = nullptr;
         }
-        if (encode_buf_) {
-            heap_caps_free(encode_buf_);
-            encode_buf_ = nullptr;
-            encode_buf_size_ = 0;
-        }
         esp_camera_deinit();
         streaming_on_ = false;
     }
+    heap_caps_free(burst_ring_);
+}
+
+Esp32Camera::Hold::Hold(Esp32Camera *camera) : camera_(camera) {
+    camera_->mutex_.lock();
+}
+
+Esp32Camera::Hold::~Hold() {
+    camera_->mutex_.unlock();
+    if (camera_->power_down_pending_) {
+        camera_->TryPowerDown();
+    }
+}
+
+bool Esp32Camera::PowerUp() {
+    if (streaming_on_) {
+        return true;
+    }
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = esp_camera_init(&config_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_camera_init failed with error 0x%x", err);
+        return false;
+    }
+    sensor_t *s = esp_camera_sensor_get();
+    if (s) {
+        ApplySensorSettings(s);
+    }
+    streaming_on_ = true;
+    ESP_LOGI(TAG, "Camera powered up in %d ms", (int)((esp_timer_get_time() - start_us) / 1000));
+    return true;
+}
+
+void Esp32Camera::PowerDown() {
+    if (!streaming_on_) {
+        return;
+    }
+    if (encoder_thread_.joinable()) {
+        encoder_thread_.join();
+    }
+    if (current_fb_) {
+        esp_camera_fb_return(current_fb_);
+        current_fb_ = nullptr;
+    }
+    esp_camera_deinit();
+    streaming_on_ = false;
+    // The deinit only stops the clock, the power down pin puts the sensor in standby as well
+    if (config_.pin_pwdn >= 0) {
+        gpio_set_direction((gpio_num_t)config_.pin_pwdn, GPIO_MODE_OUTPUT);
+        gpio_set_level((gpio_num_t)config_.pin_pwdn, 1);
+    }
+    ESP_LOGI(TAG, "Camera powered down");
+}
+
+void Esp32Camera::TryPowerDown() {
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        // The holder tries again when it is done
+        return;
+    }
+    // A watch stream keeps the sensor on, StopStreaming() powers it down
+    if (power_down_pending_.exchange(false) && !hot_ && !stream_) {
+        PowerDown();
+    }
+}
+
+void Esp32Camera::ApplySensorSettings(sensor_t *s) {
+    if (s->id.PID == GC0308_PID) {
+        s->set_hmirror(s, 0); // Control camera mirror: 1 for mirror, 0 for normal
+    }
+    if (hmirror_ >= 0) {
+        s->set_hmirror(s, hmirror_);
+    }
+    if (vflip_ >= 0) {
+        s->set_vflip(s, vflip_);
+    }
+}
+
+void Esp32Camera::SetSessionActive(bool active) {
+#if CONFIG_XIAOZHI_CAMERA_HOT_MODE
+    if (hot_.exchange(active) == active) {
+        return;
+    }
+    if (active) {
+        power_down_pending_ = false;
+        Hold hold(this);
+        PowerUp();
+    } else {
+        // Not waiting for an upload still holding the driver, it powers down when done
+        power_down_pending_ = true;
+        TryPowerDown();
+    }
+#endif
 }
 
 void Esp32Camera::SetExplainUrl(const std::string &url, const std::string &token) {
     explain_url_ = url;
     explain_token_ = token;
+    DnsCache::GetInstance().AddHost(url);
+}
+
+void Esp32Camera::ShowPreview(const camera_fb_t *fb) {
+    auto display = dynamic_cast<LvglDisplay *>(Board::GetInstance().GetDisplay());
+    if (display != nullptr && fb->format == PIXFORMAT_RGB565) {
+        // Reduce and byte swap in one pass into a buffer of the preview size
+        int max_width, max_height;
+        display->GetPreviewImageSize(max_width, max_height);
+        int factor = 1;
+        while ((max_width > 0 && fb->width / factor > max_width) ||
+               (max_height > 0 && fb->height / factor > max_height)) {
+            factor++;
+        }
+        int width = fb->width / factor;
+        int height = fb->height / factor;
+        size_t data_size = width * height * 2;
+        MemoryBudget::GetInstance().Reserve(MALLOC_CAP_SPIRAM, data_size);
+        uint16_t *preview_data = (uint16_t *)heap_caps_malloc(data_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (preview_data != nullptr) {
+            const uint16_t *src = (const uint16_t *)fb->buf;
+            uint16_t *dst = preview_data;
+            for (int y = 0; y < height; y++) {
+                const uint16_t *row = src + (size_t)y * factor * fb->width;
+                if (factor == 1 && !swap_bytes_enabled_) {
+                    memcpy(dst, row, width * 2);
+                    dst += width;
+                    continue;
+                }
+                for (int x = 0; x < width; x++, row += factor) {
+                    *dst++ = swap_bytes_enabled_ ? __builtin_bswap16(*row) : *row;
+                }
+            }
+            auto image = std::make_unique<LvglAllocatedImage>(preview_data, data_size, width, height, width * 2, LV_COLOR_FORMAT_RGB565);
+            display->Post([display, image = std::move(image)]() mutable {
+                display->SetPreviewImage(std::move(image));
+            });
+        }
+    } else if (display != nullptr && fb->format == PIXFORMAT_JPEG) {
+        // Only the compressed frame is copied, it is decoded at the preview size off this task
+        uint8_t *jpeg_data = (uint8_t *)heap_caps_malloc(fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (jpeg_data != nullptr) {
+            memcpy(jpeg_data, fb->buf, fb->len);
+            display->LoadPreviewImage(jpeg_data, fb->len);
+        }
+    }
 }
 
 bool Esp32Camera::Capture() {
+    Hold hold(this);
     if (encoder_thread_.joinable()) {
         encoder_thread_.join();
     }
 
-    if (!streaming_on_) {
+    if (stream_) {
+        ESP_LOGW(TAG, "Capture is unavailable while streaming");
+        return false;
+    }
+    // Outside a session the sensor wakes for this photo and sleeps again when the next one ends
+    if (!PowerUp()) {
         return false;
     }
 
-    // Get the latest frame, discard old frames for real-time performance
-    for (int i = 0; i < 2; i++) {
+    // Get the latest frame, discard old frames for real-time performance. In grab latest mode the
+    // driver already dropped them, the frame it holds finished at most one frame time ago.
+    int grabs = config_.grab_mode == CAMERA_GRAB_LATEST ? 1 : 2;
+    for (int i = 0; i < grabs; i++) {
         if (current_fb_) {
             esp_camera_fb_return(current_fb_);
         }
@@ -77,51 +234,8 @@ bool Esp32Camera::Capture() {
         }
     }
 
-    // Prepare encode buffer for RGB565 format (with optional byte swapping)
-    if (current_fb_->format == PIXFORMAT_RGB565) {
-        size_t pixel_count = current_fb_->width * current_fb_->height;
-        size_t data_size = pixel_count * 2;
-
-        // Allocate or reallocate encode buffer if needed
-        if (encode_buf_size_ < data_size) {
-            if (encode_buf_) {
-                heap_caps_free(encode_buf_);
-            }
-            encode_buf_ = (uint8_t *)heap_caps_malloc(data_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-            if (encode_buf_ == nullptr) {
-                ESP_LOGE(TAG, "Failed to allocate memory for encode buffer");
-                encode_buf_size_ = 0;
-                return false;
-            }
-            encode_buf_size_ = data_size;
-        }
-
-        // Copy data to encode buffer with optional byte swapping
-        uint16_t *src = (uint16_t *)current_fb_->buf;
-        uint16_t *dst = (uint16_t *)encode_buf_;
-        if (swap_bytes_enabled_) {
-            for (size_t i = 0; i < pixel_count; i++) {
-                dst[i] = __builtin_bswap16(src[i]);
-            }
-        } else {
-            memcpy(encode_buf_, current_fb_->buf, data_size);
-        }
-
-        // Allocate separate buffer for preview display
-        uint8_t *preview_data = (uint8_t *)heap_caps_malloc(data_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (preview_data != nullptr) {
-            memcpy(preview_data, encode_buf_, data_size);
-            auto display = dynamic_cast<LvglDisplay *>(Board::GetInstance().GetDisplay());
-            if (display != nullptr) {
-                display->SetPreviewImage(std::make_unique<LvglAllocatedImage>(preview_data, data_size, current_fb_->width, current_fb_->height, current_fb_->width * 2, LV_COLOR_FORMAT_RGB565));
-            } else {
-                heap_caps_free(preview_data);
-            }
-        }
-    } else if (current_fb_->format == PIXFORMAT_JPEG) {
-        // JPEG format preview usually requires decoding, skip preview display for now, just log
-        ESP_LOGW(TAG, "JPEG capture success, len=%zu, but not supported for preview", current_fb_->len);
-    }
+    // The frame buffer stays borrowed until the next capture, the encoder reads it directly
+    ShowPreview(current_fb_);
 
     ESP_LOGI(TAG, "Captured frame: %dx%d, len=%zu, format=%d",
              current_fb_->width, current_fb_->height, current_fb_->len, current_fb_->format);
@@ -130,20 +244,25 @@ bool Esp32Camera::Capture() {
 }
 
 bool Esp32Camera::SetHMirror(bool enabled) {
+    Hold hold(this);
+    hmirror_ = enabled ? 1 : 0;
     sensor_t *s = esp_camera_sensor_get();
     if (!s) {
-        return false;
+        // Powered down, the next power up applies it
+        return max_frame_size_ != FRAMESIZE_INVALID;
     }
-    s->set_hmirror(s, enabled ? 1 : 0);
+    s->set_hmirror(s, hmirror_);
     return true;
 }
 
 bool Esp32Camera::SetVFlip(bool enabled) {
+    Hold hold(this);
+    vflip_ = enabled ? 1 : 0;
     sensor_t *s = esp_camera_sensor_get();
     if (!s) {
-        return false;
+        return max_frame_size_ != FRAMESIZE_INVALID;
     }
-    s->set_vflip(s, enabled ? 1 : 0);
+    s->set_vflip(s, vflip_);
     return true;
 }
 
@@ -152,157 +271,293 @@ bool Esp32Camera::SetSwapBytes(bool enabled) {
     return true;
 }
 
-std::string Esp32Camera::Explain(const std::string &question) {
-    if (explain_url_.empty()) {
-        throw std::runtime_error("Image explain URL or token is not set");
+bool Esp32Camera::StartStreaming(int fps, int width, int height, std::function<void(const CameraFrame &)> callback) {
+    Hold hold(this);
+    if (stream_ || !PowerUp()) {
+        return false;
+    }
+    if (encoder_thread_.joinable()) {
+        encoder_thread_.join();
+    }
+    sensor_t *s = esp_camera_sensor_get();
+    if (s == nullptr) {
+        return false;
     }
 
-    if (current_fb_ == nullptr) {
-        throw std::runtime_error("No camera frame captured");
+    // The largest mode within both the request and the frame buffers
+    framesize_t frame_size = s->status.framesize;
+    if (width > 0 && height > 0) {
+        framesize_t best = FRAMESIZE_INVALID;
+        for (int i = 0; i <= max_frame_size_; i++) {
+            if (resolution[i].width <= width && resolution[i].height <= height &&
+                (best == FRAMESIZE_INVALID || resolution[i].width * resolution[i].height >
+                                                  resolution[best].width * resolution[best].height)) {
+                best = (framesize_t)i;
+            }
+        }
+        if (best == FRAMESIZE_INVALID) {
+            ESP_LOGE(TAG, "No sensor mode fits %dx%d", width, height);
+            return false;
+        }
+        frame_size = best;
     }
 
-    // Create local JPEG queue
-    QueueHandle_t jpeg_queue = xQueueCreate(40, sizeof(JpegChunk));
-    if (jpeg_queue == nullptr) {
-        ESP_LOGE(TAG, "Failed to create JPEG queue");
-        throw std::runtime_error("Failed to create JPEG queue");
+    size_t pixels = resolution[frame_size].width * resolution[frame_size].height;
+    size_t slot_size;
+    switch (s->pixformat) {
+        case PIXFORMAT_GRAYSCALE:
+            slot_size = pixels;
+            break;
+        case PIXFORMAT_RGB888:
+            slot_size = pixels * 3;
+            break;
+        case PIXFORMAT_JPEG:
+            // Frames compressing worse than this are skipped
+            slot_size = pixels / 4;
+            break;
+        default:
+            slot_size = pixels * 2;
+            break;
     }
 
-    // Start encoding thread
-    encoder_thread_ = std::thread([this, jpeg_queue]() {
-        int64_t start_time = esp_timer_get_time();
-        uint16_t w = current_fb_->width;
-        uint16_t h = current_fb_->height;
-        v4l2_pix_fmt_t enc_fmt;
-        switch (current_fb_->format) {
-            case PIXFORMAT_RGB565:
-                enc_fmt = V4L2_PIX_FMT_RGB565;
-                break;
-            case PIXFORMAT_YUV422:
-                enc_fmt = V4L2_PIX_FMT_YUYV;  // YUV422 is actually YUYV format
-                break;
-            case PIXFORMAT_YUV420:
-                enc_fmt = V4L2_PIX_FMT_YUV420;
-                break;
-            case PIXFORMAT_GRAYSCALE:
-                enc_fmt = V4L2_PIX_FMT_GREY;
-                break;
-            case PIXFORMAT_JPEG:
-                enc_fmt = V4L2_PIX_FMT_JPEG;
-                break;
-            case PIXFORMAT_RGB888:
-                enc_fmt = V4L2_PIX_FMT_RGB24;
-                break;
-            default:
-                ESP_LOGE(TAG, "Unsupported pixel format: %d", current_fb_->format);
-                return;
+    // The driver needs its buffers back for the stream
+    if (current_fb_) {
+        esp_camera_fb_return(current_fb_);
+        current_fb_ = nullptr;
+    }
+    if (frame_size != s->status.framesize) {
+        stream_restore_frame_size_ = s->status.framesize;
+        s->set_framesize(s, frame_size);
+    }
+
+    stream_ = std::make_unique<CameraStream>(slot_size, fps,
+        [this](uint8_t *slot, size_t slot_size, CameraFrame &frame) -> bool {
+            camera_fb_t *fb = esp_camera_fb_get();
+            if (fb == nullptr) {
+                return false;
+            }
+            bool fits = fb->len <= slot_size;
+            if (fits) {
+                memcpy(slot, fb->buf, fb->len);
+                frame.len = fb->len;
+                frame.width = fb->width;
+                frame.height = fb->height;
+                frame.format = ToV4l2Format(fb->format);
+                frame.timestamp_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+            } else {
+                ESP_LOGW(TAG, "Skipping a %zu byte frame, the stream holds %zu", fb->len, slot_size);
+            }
+            esp_camera_fb_return(fb);
+            return fits;
+        }, std::move(callback));
+    if (!stream_->valid()) {
+        StopStreamingLocked();
+        return false;
+    }
+    ESP_LOGI(TAG, "Streaming %dx%d at %d fps", resolution[frame_size].width, resolution[frame_size].height, fps);
+    return true;
+}
+
+void Esp32Camera::StopStreaming() {
+    Hold hold(this);
+    StopStreamingLocked();
+#if CONFIG_XIAOZHI_CAMERA_HOT_MODE
+    // A watch kept the sensor on past its session
+    if (!hot_) {
+        PowerDown();
+    }
+#endif
+}
+
+void Esp32Camera::StopStreamingLocked() {
+    if (!stream_) {
+        return;
+    }
+    stream_.reset();
+    if (stream_restore_frame_size_ != FRAMESIZE_INVALID) {
+        sensor_t *s = esp_camera_sensor_get();
+        if (s != nullptr) {
+            s->set_framesize(s, stream_restore_frame_size_);
         }
+        stream_restore_frame_size_ = FRAMESIZE_INVALID;
+    }
+}
 
-        // Use encode buffer for RGB565, otherwise use original frame buffer
-        uint8_t *jpeg_src_buf = current_fb_->buf;
-        size_t jpeg_src_len = current_fb_->len;
-        if (current_fb_->format == PIXFORMAT_RGB565 && encode_buf_ != nullptr) {
-            jpeg_src_buf = encode_buf_;
-            jpeg_src_len = encode_buf_size_;
+// Source rows of a downscaled frame for the stripe encoder, every scale-th pixel of every scale-th row
+struct DownscaleSource {
+    const uint8_t *src;
+    size_t src_stride;
+    int scale;
+    int width;              // Of the output, even
+    int bytes_per_pixel;
+    bool yuyv;
+    uint8_t *rows;          // 16 output rows
+};
+
+static const uint8_t *DownscaleRows(void *arg, uint16_t y, uint16_t rows) {
+    auto source = static_cast<DownscaleSource *>(arg);
+    size_t stride = source->width * source->bytes_per_pixel;
+    for (int i = 0; i < rows; i++) {
+        const uint8_t *in = source->src + (size_t)(y + i) * source->scale * source->src_stride;
+        uint8_t *out = source->rows + i * stride;
+        if (source->yuyv) {
+            // Pairs of output pixels share the chroma of the first one's source pair
+            for (int x = 0; x < source->width; x += 2) {
+                size_t a = (size_t)x * source->scale;
+                size_t b = (size_t)(x + 1) * source->scale;
+                const uint8_t *pair = in + (a & ~(size_t)1) * 2;
+                out[0] = in[a * 2];
+                out[1] = pair[1];
+                out[2] = in[b * 2];
+                out[3] = pair[3];
+                out += 4;
+            }
+        } else {
+            for (int x = 0; x < source->width; x++) {
+                memcpy(out, in + (size_t)x * source->scale * source->bytes_per_pixel, source->bytes_per_pixel);
+                out += source->bytes_per_pixel;
+            }
         }
+    }
+    return source->rows;
+}
 
-        bool ok = image_to_jpeg_cb(jpeg_src_buf, jpeg_src_len, w, h, enc_fmt, 80,
-            [](void* arg, size_t index, const void* data, size_t len) -> size_t {
-                auto jpeg_queue = static_cast<QueueHandle_t>(arg);
-                JpegChunk chunk = {.data = nullptr, .len = len};
-                if (index == 0 && data != nullptr && len > 0) {
-                    chunk.data = (uint8_t*)heap_caps_aligned_alloc(16, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-                    if (chunk.data == nullptr) {
-                        ESP_LOGE(TAG, "Failed to allocate %zu bytes for JPEG chunk", len);
-                        chunk.len = 0;
-                    } else {
-                        memcpy(chunk.data, data, len);
-                    }
-                } else {
-                    chunk.len = 0;  // Sentinel or error
-                }
-                xQueueSend(jpeg_queue, &chunk, portMAX_DELAY);
-                return len;
-            }, jpeg_queue);
+void Esp32Camera::SetExplainOverride(int quality, int scale) {
+    explain_quality_override_ = quality;
+    explain_scale_override_ = scale;
+}
+
+v4l2_pix_fmt_t Esp32Camera::ToV4l2Format(pixformat_t format) const {
+    switch (format) {
+        case PIXFORMAT_RGB565:
+            // Swapped bytes are big endian RGB565, converted per stripe without a copy of the frame
+            return swap_bytes_enabled_ ? V4L2_PIX_FMT_RGB565X : V4L2_PIX_FMT_RGB565;
+        case PIXFORMAT_YUV422:
+            return V4L2_PIX_FMT_YUYV;  // YUV422 is actually YUYV format
+        case PIXFORMAT_YUV420:
+            return V4L2_PIX_FMT_YUV420;
+        case PIXFORMAT_GRAYSCALE:
+            return V4L2_PIX_FMT_GREY;
+        case PIXFORMAT_JPEG:
+            return V4L2_PIX_FMT_JPEG;
+        case PIXFORMAT_RGB888:
+            return V4L2_PIX_FMT_RGB24;
+        default:
+            return 0;
+    }
+}
 
-        if (!ok) {
-            JpegChunk chunk = {.data = nullptr, .len = 0};
-            xQueueSend(jpeg_queue, &chunk, portMAX_DELAY);
+ExplainTuner::Choice Esp32Camera::PickExplainChoice(int width, int height, pixformat_t format) {
+    // Smaller for a slow link, unless the caller asked for a quality or scale
+    auto choice = explain_tuner_.Pick(width, height);
+    if (explain_quality_override_ > 0) {
+        choice.quality = explain_quality_override_;
+    }
+    if (explain_scale_override_ > 0) {
+        choice.scale = explain_scale_override_;
+    }
+    explain_quality_override_ = 0;
+    explain_scale_override_ = 0;
+    // JPEG frames are sent as they are, YUV420 has no stripe encoder to downscale with
+    if (format == PIXFORMAT_JPEG || format == PIXFORMAT_YUV420) {
+        choice.scale = 1;
+    }
+    return choice;
+}
+
+bool Esp32Camera::EncodeFrame(const camera_fb_t *fb, const ExplainTuner::Choice &choice, int index, JpegChunkPool *pool) {
+    uint16_t w = fb->width;
+    uint16_t h = fb->height;
+    v4l2_pix_fmt_t enc_fmt = ToV4l2Format(fb->format);
+    if (enc_fmt == 0) {
+        ESP_LOGE(TAG, "Unsupported pixel format: %d", fb->format);
+        return false;
+    }
+
+    // Each frame is a file part of its own, the uploader only forwards the chunks
+    char filename[24];
+    if (index < 0) {
+        strcpy(filename, "camera.jpg");
+    } else {
+        snprintf(filename, sizeof(filename), "camera_%d.jpg", index);
+    }
+    char part_header[160];
+    int header_len = snprintf(part_header, sizeof(part_header),
+        "--" EXPLAIN_BOUNDARY "\r\n"
+        "Content-Disposition: form-data; name=\"file\"; filename=\"%s\"\r\n"
+        "Content-Type: image/jpeg\r\n"
+        "\r\n", filename);
+    pool->Write(part_header, header_len);
+
+    auto output = [](void* arg, size_t index, const void* data, size_t len) -> size_t {
+        if (data != nullptr && len > 0) {
+            static_cast<JpegChunkPool*>(arg)->Write(data, len);
         }
-        int64_t end_time = esp_timer_get_time();
-        ESP_LOGI(TAG, "JPEG encoding time: %ld ms", int((end_time - start_time) / 1000));
-    });
+        return len;
+    };
+    bool ok;
+    if (choice.scale > 1) {
+        int bytes_per_pixel = enc_fmt == V4L2_PIX_FMT_GREY ? 1 : enc_fmt == V4L2_PIX_FMT_RGB24 ? 3 : 2;
+        DownscaleSource source = {};
+        source.src = fb->buf;
+        source.src_stride = (size_t)w * bytes_per_pixel;
+        source.scale = choice.scale;
+        source.width = (w / choice.scale) & ~1;
+        source.bytes_per_pixel = bytes_per_pixel;
+        source.yuyv = enc_fmt == V4L2_PIX_FMT_YUYV;
+        source.rows = (uint8_t*)heap_caps_malloc(16 * source.width * bytes_per_pixel, MALLOC_CAP_8BIT);
+        ok = source.rows != nullptr &&
+             image_stripes_to_jpeg_cb(source.width, h / choice.scale, enc_fmt, choice.quality, DownscaleRows,
+                                      &source, output, pool);
+        heap_caps_free(source.rows);
+    } else {
+        ok = image_to_jpeg_cb(fb->buf, fb->len, w, h, enc_fmt, choice.quality, output, pool);
+    }
+    pool->Write("\r\n", 2);
+    return ok;
+}
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(3);
-    std::string boundary = "----ESP32_CAMERA_BOUNDARY";
+std::string Esp32Camera::UploadExplain(const std::string &fields, std::shared_ptr<JpegChunkPool> pool,
+                                       size_t &total_sent, int64_t &send_us) {
+    auto http = HttpPool::GetInstance().CreateHttp(3);
 
     http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
     http->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
     if (!explain_token_.empty()) {
         http->SetHeader("Authorization", "Bearer " + explain_token_);
     }
-    http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
+    http->SetHeader("Content-Type", "multipart/form-data; boundary=" EXPLAIN_BOUNDARY);
     http->SetHeader("Transfer-Encoding", "chunked");
     if (!http->Open("POST", explain_url_)) {
         ESP_LOGE(TAG, "Failed to connect to explain URL");
+        // The encoder only finishes once its chunks are handed back
+        pool->Drain();
         encoder_thread_.join();
-        JpegChunk chunk;
-        while (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) == pdPASS) {
-            if (chunk.data != nullptr) {
-                heap_caps_free(chunk.data);
-            } else {
-                break;
-            }
-        }
-        vQueueDelete(jpeg_queue);
         throw std::runtime_error("Failed to connect to explain URL");
     }
+    // Everything before the JPEG data, written in one go
+    http->Write(fields.c_str(), fields.size());
 
-    {
-        std::string question_field;
-        question_field += "--" + boundary + "\r\n";
-        question_field += "Content-Disposition: form-data; name=\"question\"\r\n";
-        question_field += "\r\n";
-        question_field += question + "\r\n";
-        http->Write(question_field.c_str(), question_field.size());
-    }
-    {
-        std::string file_header;
-        file_header += "--" + boundary + "\r\n";
-        file_header += "Content-Disposition: form-data; name=\"file\"; filename=\"camera.jpg\"\r\n";
-        file_header += "Content-Type: image/jpeg\r\n";
-        file_header += "\r\n";
-        http->Write(file_header.c_str(), file_header.size());
-    }
-
-    size_t total_sent = 0;
-    bool saw_terminator = false;
-    while (true) {
-        JpegChunk chunk;
-        if (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) != pdPASS) {
-            ESP_LOGE(TAG, "Failed to receive JPEG chunk");
-            break;
-        }
-        if (chunk.data == nullptr) {
-            saw_terminator = true;
-            break;
-        }
+    total_sent = 0;
+    int64_t send_start_us = esp_timer_get_time();
+    JpegChunk chunk;
+    while (pool->Receive(chunk)) {
         http->Write((const char *)chunk.data, chunk.len);
         total_sent += chunk.len;
-        heap_caps_free(chunk.data);
+        pool->Release(chunk);
     }
+    int64_t send_end_us = esp_timer_get_time();
+    send_us = send_end_us - send_start_us;
     encoder_thread_.join();
-    vQueueDelete(jpeg_queue);
+    pool->LogStats(total_sent, send_start_us, send_end_us);
 
-    if (!saw_terminator || total_sent == 0) {
+    if (!pool->encoded_ok() || total_sent == 0) {
         ESP_LOGE(TAG, "JPEG encoder failed or produced empty output");
         throw std::runtime_error("Failed to encode image to JPEG");
     }
 
     {
-        std::string multipart_footer;
-        multipart_footer += "\r\n--" + boundary + "--\r\n";
+        std::string multipart_footer = "--" EXPLAIN_BOUNDARY "--\r\n";
         http->Write(multipart_footer.c_str(), multipart_footer.size());
     }
     http->Write("", 0);
@@ -314,9 +569,181 @@ std::string Esp32Camera::Explain(const std::string &question) {
 
     std::string result = http->ReadAll();
     http->Close();
+    return result;
+}
+
+static std::string FormField(const char *name, const std::string &value) {
+    std::string field;
+    field += "--" EXPLAIN_BOUNDARY "\r\n";
+    field += "Content-Disposition: form-data; name=\"";
+    field += name;
+    field += "\"\r\n";
+    field += "\r\n";
+    field += value + "\r\n";
+    return field;
+}
+
+std::string Esp32Camera::Explain(const std::string &question) {
+    Hold hold(this);
+    if (explain_url_.empty()) {
+        throw std::runtime_error("Image explain URL or token is not set");
+    }
+
+    if (current_fb_ == nullptr) {
+        throw std::runtime_error("No camera frame captured");
+    }
+
+    // Reusable chunks between the encoder and the upload, the encoder waits when all are in flight
+    auto pool = std::make_shared<JpegChunkPool>();
+    if (!pool->valid()) {
+        throw std::runtime_error("Failed to allocate JPEG chunks");
+    }
+
+    auto choice = PickExplainChoice(current_fb_->width, current_fb_->height, current_fb_->format);
+
+    // Start encoding thread
+    encoder_thread_ = std::thread([this, pool, choice]() {
+        pool->Finish(EncodeFrame(current_fb_, choice, -1, pool.get()));
+    });
+
+    size_t total_sent = 0;
+    int64_t send_us = 0;
+    std::string result = UploadExplain(FormField("question", question), pool, total_sent, send_us);
+    explain_tuner_.Record(choice, current_fb_->width, current_fb_->height, total_sent, send_us,
+                          pool->backpressure_us());
 
     size_t remain_stack_size = uxTaskGetStackHighWaterMark(nullptr);
-    ESP_LOGI(TAG, "Explain image size=%dx%d, compressed size=%d, remain stack size=%d, question=%s\n%s",
-             current_fb_->width, current_fb_->height, (int)total_sent, (int)remain_stack_size, question.c_str(), result.c_str());
+    ESP_LOGI(TAG, "Explain image size=%dx%d, quality=%d, scale=1/%d, compressed size=%d, remain stack size=%d, question=%s\n%s",
+             current_fb_->width, current_fb_->height, choice.quality, choice.scale, (int)total_sent, (int)remain_stack_size,
+             question.c_str(), result.c_str());
+    return result;
+}
+
+/*
+ * Burst: a capture thread copies each frame into the next free slot of the ring, the encoder
+ * thread encodes the slots in order into one multipart body and this task uploads it, so the
+ * three overlap. The ring is kept for the next burst.
+ */
+std::string Esp32Camera::ExplainBurst(const std::string &question, int count, int interval_ms) {
+    if (explain_url_.empty()) {
+        throw std::runtime_error("Image explain URL or token is not set");
+    }
+    if (count < 1 || count > CONFIG_XIAOZHI_CAMERA_BURST_MAX_FRAMES) {
+        throw std::invalid_argument("count must be 1 to " + std::to_string(CONFIG_XIAOZHI_CAMERA_BURST_MAX_FRAMES));
+    }
+    Hold hold(this);
+    if (encoder_thread_.joinable()) {
+        encoder_thread_.join();
+    }
+    if (stream_ || !PowerUp()) {
+        throw std::runtime_error("The camera is busy");
+    }
+
+    // The driver needs its buffers back for the burst
+    if (current_fb_) {
+        esp_camera_fb_return(current_fb_);
+        current_fb_ = nullptr;
+    }
+    camera_fb_t *first = esp_camera_fb_get();
+    if (first == nullptr) {
+        throw std::runtime_error("Camera capture failed");
+    }
+    // Compressed frames vary in size, leave room for a busier scene
+    size_t slot_size = first->format == PIXFORMAT_JPEG ? first->len * 2 : first->len;
+    int width = first->width;
+    int height = first->height;
+    pixformat_t format = first->format;
+    esp_camera_fb_return(first);
+
+    int slots = std::min(count, BURST_RING_SLOTS);
+    if (burst_ring_ == nullptr || burst_slot_size_ < slot_size) {
+        heap_caps_free(burst_ring_);
+        MemoryBudget::GetInstance().Reserve(MALLOC_CAP_SPIRAM, slot_size * BURST_RING_SLOTS);
+        burst_ring_ = (uint8_t *)heap_caps_malloc(slot_size * BURST_RING_SLOTS, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        burst_slot_size_ = burst_ring_ != nullptr ? slot_size : 0;
+        if (burst_ring_ == nullptr) {
+            throw std::runtime_error("Failed to allocate the burst ring");
+        }
+    }
+
+    auto pool = std::make_shared<JpegChunkPool>();
+    if (!pool->valid()) {
+        throw std::runtime_error("Failed to allocate JPEG chunks");
+    }
+
+    // All frames are sized together, the upload carries count of them
+    auto choice = PickExplainChoice(width, height * count, format);
+    // Both threads are joined before this returns
+    std::vector<camera_fb_t> frames(count);
+    SemaphoreHandle_t filled = xSemaphoreCreateCounting(count, 0);
+    SemaphoreHandle_t free_slots = xSemaphoreCreateCounting(slots, slots);
+
+    std::thread capture_thread([this, count, interval_ms, slots, &frames, filled, free_slots]() {
+        int64_t next_us = esp_timer_get_time();
+        for (int i = 0; i < count; i++) {
+            int64_t wait_us = next_us - esp_timer_get_time();
+            if (wait_us > 0) {
+                vTaskDelay(pdMS_TO_TICKS(wait_us / 1000));
+            }
+            next_us += (int64_t)interval_ms * 1000;
+            // Waits here only when the encoder is a whole ring behind
+            xSemaphoreTake(free_slots, portMAX_DELAY);
+            auto &frame = frames[i];
+            frame = {};
+            camera_fb_t *fb = esp_camera_fb_get();
+            if (fb != nullptr && fb->len <= burst_slot_size_) {
+                frame = *fb;
+                frame.buf = burst_ring_ + (i % slots) * burst_slot_size_;
+                memcpy(frame.buf, fb->buf, fb->len);
+                if (i == count - 1) {
+                    ShowPreview(fb);
+                }
+            } else {
+                ESP_LOGW(TAG, "Burst frame %d skipped", i);
+            }
+            if (fb != nullptr) {
+                esp_camera_fb_return(fb);
+            }
+            xSemaphoreGive(filled);
+        }
+    });
+
+    encoder_thread_ = std::thread([this, count, choice, pool, &frames, filled, free_slots]() {
+        bool ok = true;
+        int encoded = 0;
+        for (int i = 0; i < count; i++) {
+            xSemaphoreTake(filled, portMAX_DELAY);
+            auto &frame = frames[i];
+            if (ok && frame.buf != nullptr) {
+                ok = EncodeFrame(&frame, choice, i, pool.get());
+                encoded++;
+            }
+            xSemaphoreGive(free_slots);
+        }
+        pool->Finish(ok && encoded > 0);
+    });
+
+    std::string fields = FormField("question", question) +
+                         FormField("frame_count", std::to_string(count)) +
+                         FormField("frame_interval_ms", std::to_string(interval_ms));
+    size_t total_sent = 0;
+    int64_t send_us = 0;
+    std::string result;
+    try {
+        result = UploadExplain(fields, pool, total_sent, send_us);
+    } catch (...) {
+        capture_thread.join();
+        vSemaphoreDelete(filled);
+        vSemaphoreDelete(free_slots);
+        throw;
+    }
+    capture_thread.join();
+    vSemaphoreDelete(filled);
+    vSemaphoreDelete(free_slots);
+    explain_tuner_.Record(choice, width, height * count, total_sent, send_us, pool->backpressure_us());
+
+    ESP_LOGI(TAG, "Explain burst of %d frames %dx%d every %d ms, quality=%d, scale=1/%d, compressed size=%d, question=%s\n%s",
+             count, width, height, interval_ms, choice.quality, choice.scale, (int)total_sent, question.c_str(),
+             result.c_str());
     return result;
 }
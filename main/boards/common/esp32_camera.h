@@ -2,8 +2,10 @@
 #include "sdkconfig.h"
 
 #include <lvgl.h>
+#include <atomic>
 #include <thread>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <freertos/FreeRTOS.h>
@@ -12,12 +14,9 @@
 #include "camera.h"
 #include "esp_camera.h"
 #include "jpg/image_to_jpeg.h"
-
-struct JpegChunk
-{
-    uint8_t *data;
-    size_t len;
-};
+#include "jpeg_chunk_pool.h"
+#include "camera_stream.h"
+#include "explain_tuner.h"
 
 class Esp32Camera : public Camera
 {
@@ -28,8 +27,49 @@ private:
     std::string explain_token_;
     std::thread encoder_thread_;
     camera_fb_t *current_fb_ = nullptr;
-    uint8_t *encode_buf_ = nullptr;  // Buffer for JPEG encoding (with optional byte swap)
-    size_t encode_buf_size_ = 0;
+    // The frame buffers are sized for this, streaming never asks the sensor for more
+    framesize_t max_frame_size_ = FRAMESIZE_INVALID;
+    framesize_t stream_restore_frame_size_ = FRAMESIZE_INVALID;
+    std::unique_ptr<CameraStream> stream_;
+    ExplainTuner explain_tuner_;
+    int explain_quality_override_ = 0;
+    int explain_scale_override_ = 0;
+    // Reused by every burst, grown when the frames get larger
+    uint8_t *burst_ring_ = nullptr;
+    size_t burst_slot_size_ = 0;
+    // Hot mode: the driver is initialized again from this after a power down
+    camera_config_t config_ = {};
+    std::mutex mutex_;
+    std::atomic<bool> hot_{false};
+    std::atomic<bool> power_down_pending_{false};
+    // Reapplied on every power up, -1 for the sensor default
+    int hmirror_ = -1;
+    int vflip_ = -1;
+
+    // Holds the driver for one call, the power down of an ended session waits for it
+    class Hold {
+    public:
+        explicit Hold(Esp32Camera *camera);
+        ~Hold();
+    private:
+        Esp32Camera *camera_;
+    };
+
+    bool PowerUp();
+    void PowerDown();
+    void TryPowerDown();
+    void ApplySensorSettings(sensor_t *s);
+    void StopStreamingLocked();
+
+    void ShowPreview(const camera_fb_t *fb);
+    // 0 for a format the JPEG encoder does not take
+    v4l2_pix_fmt_t ToV4l2Format(pixformat_t format) const;
+    ExplainTuner::Choice PickExplainChoice(int width, int height, pixformat_t format);
+    // Writes the multipart file part of fb, index -1 for a single photo
+    bool EncodeFrame(const camera_fb_t *fb, const ExplainTuner::Choice &choice, int index, JpegChunkPool *pool);
+    // Posts fields followed by the file parts coming out of pool, the encoder thread is joined
+    std::string UploadExplain(const std::string &fields, std::shared_ptr<JpegChunkPool> pool, size_t &total_sent,
+                              int64_t &send_us);
 
 public:
     Esp32Camera(const camera_config_t &config);
@@ -41,4 +81,10 @@ public:
     virtual bool SetVFlip(bool enabled) override;
     virtual bool SetSwapBytes(bool enabled) override;
     virtual std::string Explain(const std::string &question) override;
+    virtual void SetExplainOverride(int quality, int scale) override;
+    virtual void SetSessionActive(bool active) override;
+    virtual bool SupportsBurst() const override { return true; }
+    virtual std::string ExplainBurst(const std::string &question, int count, int interval_ms) override;
+    virtual bool StartStreaming(int fps, int width, int height, std::function<void(const CameraFrame &)> callback) override;
+    virtual void StopStreaming() override;
 };
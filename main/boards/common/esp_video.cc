@@ -7,8 +7,10 @@
 #include <unistd.h>
 #include <errno.h>
 #include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include <cstdio>
 #include <cstring>
+#include <utility>
 
 #include "esp_imgfx_color_convert.h"
 #include "esp_video_device.h"
@@ -20,9 +22,11 @@
 #include "esp_video.h"
 #include "esp_jpeg_common.h"
 #include "jpg/image_to_jpeg.h"
-#include "jpg/jpeg_to_image.h"
 #include "lvgl_display.h"
 #include "mcp_server.h"
+#include "memory_budget.h"
+#include "dns_cache.h"
+#include "http_pool.h"
 #include "system_info.h"
 
 #ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
@@ -363,6 +367,10 @@ EspVideo::EspVideo(const esp_video_init_config_t& config) {
 }
 
 EspVideo::~EspVideo() {
+    StopStreaming();
+    if (encoder_thread_.joinable()) {
+        encoder_thread_.join();
+    }
     if (streaming_on_ && video_fd_ >= 0) {
         int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         ioctl(video_fd_, VIDIOC_STREAMOFF, &type);
@@ -378,13 +386,220 @@ EspVideo::~EspVideo() {
     }
     sensor_format_ = 0;
     esp_video_deinit();
+#if defined(CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE) && defined(CONFIG_SOC_PPA_SUPPORTED)
+    if (ppa_client_ != nullptr) {
+        ppa_unregister_client(ppa_client_);
+    }
+#endif
+#ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+    heap_caps_free(rotate_buffer_);
+#endif
+    heap_caps_free(frame_.data);
 }
 
 void EspVideo::SetExplainUrl(const std::string& url, const std::string& token) {
     explain_url_ = url;
     explain_token_ = token;
+    DnsCache::GetInstance().AddHost(url);
 }
 
+// PPA 通过 cache 写入, 缓冲区地址和大小都按 cache line 对齐
+#define FRAME_BUFFER_ALIGN 128
+
+// 缓冲区不够大时才重新分配
+static bool ReserveFrameBuffer(uint8_t*& buffer, size_t& capacity, size_t size) {
+    if (buffer != nullptr && capacity >= size) {
+        return true;
+    }
+    heap_caps_free(buffer);
+    capacity = (size + FRAME_BUFFER_ALIGN - 1) & ~(size_t)(FRAME_BUFFER_ALIGN - 1);
+    MemoryBudget::GetInstance().Reserve(MALLOC_CAP_SPIRAM, capacity + FRAME_BUFFER_ALIGN);
+    buffer = (uint8_t*)heap_caps_aligned_alloc(FRAME_BUFFER_ALIGN, capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer == nullptr) {
+        capacity = 0;
+        return false;
+    }
+    return true;
+}
+
+#ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+#ifndef CONFIG_SOC_PPA_SUPPORTED
+bool EspVideo::RotateFrame() {
+    if (!ReserveFrameBuffer(rotate_buffer_, rotate_capacity_, frame_.len)) {
+        ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
+        return false;
+    }
+
+    esp_imgfx_rotate_cfg_t rotate_cfg = {
+        .in_res =
+            {
+                .width = static_cast<int16_t>(sensor_width_),
+                .height = static_cast<int16_t>(sensor_height_),
+            },
+        .degree = IMAGE_ROTATION_ANGLE,
+    };
+    switch (frame_.format) {
+        case V4L2_PIX_FMT_RGB565:
+            rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
+            break;
+        case V4L2_PIX_FMT_YUYV:
+            rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
+            break;
+        case V4L2_PIX_FMT_GREY:
+            rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_Y;
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888;
+            break;
+        default:
+            ESP_LOGE(TAG, "unsupported sensor format: 0x%08lx", sensor_format_);
+            return false;
+    }
+    esp_imgfx_rotate_handle_t rotate_handle = nullptr;
+    esp_imgfx_err_t imgfx_err = esp_imgfx_rotate_open(&rotate_cfg, &rotate_handle);
+    if (imgfx_err != ESP_IMGFX_ERR_OK || rotate_handle == nullptr) {
+        ESP_LOGE(TAG, "esp_imgfx_rotate_create failed");
+        return false;
+    }
+
+    esp_imgfx_data_t rotate_input_data = {
+        .data = frame_.data,
+        .data_len = frame_.len,
+    };
+    esp_imgfx_data_t rotate_output_data = {
+        .data = rotate_buffer_,
+        .data_len = frame_.len,
+    };
+    imgfx_err = esp_imgfx_rotate_process(rotate_handle, &rotate_input_data, &rotate_output_data);
+    esp_imgfx_rotate_close(rotate_handle);
+    if (imgfx_err != ESP_IMGFX_ERR_OK) {
+        ESP_LOGE(TAG, "esp_imgfx_rotate_process failed");
+        return false;
+    }
+
+    // 旋转结果成为新的帧, 旧的帧缓冲留给下一次旋转
+    std::swap(frame_.data, rotate_buffer_);
+    std::swap(frame_capacity_, rotate_capacity_);
+    return true;
+}
+#else   // CONFIG_SOC_PPA_SUPPORTED
+bool EspVideo::RotateFrame() {
+    if (ppa_client_ == nullptr) {
+        ppa_client_config_t client_cfg = {
+            .oper_type = PPA_OPERATION_SRM,
+            .max_pending_trans_num = 1,
+        };
+        esp_err_t err = ppa_register_client(&client_cfg, &ppa_client_);
+        if (err != ESP_OK || ppa_client_ == nullptr) {
+            ESP_LOGE(TAG, "ppa_register_client failed: %d", (int)err);
+            ppa_client_ = nullptr;
+            return false;
+        }
+    }
+
+    size_t out_len = (size_t)frame_.width * frame_.height * 2;
+    ppa_srm_color_mode_t ppa_color_mode;
+    uint8_t* rotate_src = frame_.data;
+    uint8_t* rotate_dst = nullptr;
+    size_t rotate_dst_capacity = 0;
+    switch (frame_.format) {
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_RGB24:
+            ppa_color_mode = frame_.format == V4L2_PIX_FMT_RGB565 ? PPA_SRM_COLOR_MODE_RGB565 : PPA_SRM_COLOR_MODE_RGB888;
+            if (!ReserveFrameBuffer(rotate_buffer_, rotate_capacity_, out_len)) {
+                ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
+                return false;
+            }
+            rotate_dst = rotate_buffer_;
+            rotate_dst_capacity = rotate_capacity_;
+            break;
+        case V4L2_PIX_FMT_YUYV: {
+            // PPA 不支持 YUYV 输入, 先用软件转换为 RGB565, 然后旋转回帧缓冲 (大小相同)
+            if (!ReserveFrameBuffer(rotate_buffer_, rotate_capacity_, out_len)) {
+                ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
+                return false;
+            }
+            esp_imgfx_color_convert_cfg_t convert_cfg = {
+                .in_res = {.width = static_cast<int16_t>(sensor_width_),
+                           .height = static_cast<int16_t>(sensor_height_)},
+                .in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_YUYV,
+                .out_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE,
+                .color_space_std = ESP_IMGFX_COLOR_SPACE_STD_BT601,
+            };
+            esp_imgfx_color_convert_handle_t convert_handle = nullptr;
+            esp_imgfx_err_t err = esp_imgfx_color_convert_open(&convert_cfg, &convert_handle);
+            if (err != ESP_IMGFX_ERR_OK || convert_handle == nullptr) {
+                ESP_LOGE(TAG, "esp_imgfx_color_convert_open failed");
+                return false;
+            }
+            esp_imgfx_data_t convert_input_data = {
+                .data = frame_.data,
+                .data_len = frame_.len,
+            };
+            esp_imgfx_data_t convert_output_data = {
+                .data = rotate_buffer_,
+                .data_len = static_cast<uint32_t>(out_len),
+            };
+            err = esp_imgfx_color_convert_process(convert_handle, &convert_input_data, &convert_output_data);
+            esp_imgfx_color_convert_close(convert_handle);
+            if (err != ESP_IMGFX_ERR_OK) {
+                ESP_LOGE(TAG, "esp_imgfx_color_convert_process failed");
+                return false;
+            }
+            ppa_color_mode = PPA_SRM_COLOR_MODE_RGB565;
+            rotate_src = rotate_buffer_;
+            rotate_dst = frame_.data;
+            rotate_dst_capacity = frame_capacity_;
+            break;
+        }
+        default:
+            ESP_LOGE(TAG, "unsupported sensor format for PPA rotation: 0x%08lx", sensor_format_);
+            return false;
+    }
+
+    ppa_srm_oper_config_t srm_cfg = {};
+    srm_cfg.in.buffer = (void*)rotate_src;
+    srm_cfg.in.pic_w = sensor_width_;
+    srm_cfg.in.pic_h = sensor_height_;
+    srm_cfg.in.block_w = sensor_width_;
+    srm_cfg.in.block_h = sensor_height_;
+    srm_cfg.in.block_offset_x = 0;
+    srm_cfg.in.block_offset_y = 0;
+    srm_cfg.in.srm_cm = ppa_color_mode;
+
+    srm_cfg.out.buffer = (void*)rotate_dst;
+    srm_cfg.out.buffer_size = rotate_dst_capacity;
+    srm_cfg.out.pic_w = frame_.width;
+    srm_cfg.out.pic_h = frame_.height;
+    srm_cfg.out.block_offset_x = 0;
+    srm_cfg.out.block_offset_y = 0;
+    srm_cfg.out.srm_cm = PPA_SRM_COLOR_MODE_RGB565;
+
+    // 等比例缩放 1.0
+    srm_cfg.scale_x = 1.0f;
+    srm_cfg.scale_y = 1.0f;
+    srm_cfg.rotation_angle = IMAGE_ROTATION_ANGLE;
+    srm_cfg.mode = PPA_TRANS_MODE_BLOCKING;
+    srm_cfg.user_data = nullptr;
+
+    esp_err_t err = ppa_do_scale_rotate_mirror(ppa_client_, &srm_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ppa_do_scale_rotate_mirror failed: %d", (int)err);
+        return false;
+    }
+
+    if (rotate_dst == rotate_buffer_) {
+        // 旋转结果成为新的帧, 旧的帧缓冲留给下一次旋转
+        std::swap(frame_.data, rotate_buffer_);
+        std::swap(frame_capacity_, rotate_capacity_);
+    }
+    frame_.len = out_len;
+    frame_.format = V4L2_PIX_FMT_RGB565;
+    return true;
+}
+#endif  // CONFIG_SOC_PPA_SUPPORTED
+#endif  // CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+
 bool EspVideo::Capture() {
     if (encoder_thread_.joinable()) {
         encoder_thread_.join();
@@ -393,6 +608,10 @@ bool EspVideo::Capture() {
     if (!streaming_on_ || video_fd_ < 0) {
         return false;
     }
+    if (stream_) {
+        ESP_LOGW(TAG, "Video stream is running, capture refused");
+        return false;
+    }
 
     for (int i = 0; i < 3; i++) {
         struct v4l2_buffer buf = {};
@@ -403,15 +622,10 @@ bool EspVideo::Capture() {
             return false;
         }
         if (i == 2) {
-            // 保存帧副本到PSRAM
-            if (frame_.data) {
-                heap_caps_free(frame_.data);
-                frame_.data = nullptr;
-                frame_.format = 0;
-            }
+            // 保存帧副本到PSRAM, 缓冲区在多次拍照间复用
+            frame_.format = 0;
             frame_.len = buf.bytesused;
-            frame_.data = (uint8_t*)heap_caps_malloc(frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-            if (!frame_.data) {
+            if (!ReserveFrameBuffer(frame_.data, frame_capacity_, frame_.len)) {
                 ESP_LOGE(TAG, "alloc frame copy failed: need allocate %lu bytes", buf.bytesused);
                 if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
                     ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
@@ -492,235 +706,12 @@ bool EspVideo::Capture() {
             }
 
 #ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
-#ifndef CONFIG_SOC_PPA_SUPPORTED
-            uint8_t* rotate_dst =
-                (uint8_t*)heap_caps_aligned_alloc(64, frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-            if (rotate_dst == nullptr) {
-                ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
-            uint8_t* rotate_src = (uint8_t*)frame_.data;
-
-            esp_imgfx_rotate_cfg_t rotate_cfg = {
-                .in_res =
-                    {
-                        .width = static_cast<int16_t>(sensor_width_),
-                        .height = static_cast<int16_t>(sensor_height_),
-                    },
-                .degree = IMAGE_ROTATION_ANGLE,
-            };
-            switch (frame_.format) {
-                case V4L2_PIX_FMT_RGB565:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
-                    break;
-                case V4L2_PIX_FMT_YUYV:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
-                    break;
-                case V4L2_PIX_FMT_GREY:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_Y;
-                    break;
-                case V4L2_PIX_FMT_RGB24:
-                    rotate_cfg.in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888;
-                    break;
-                default:
-                    ESP_LOGE(TAG, "unsupported sensor format: 0x%08lx", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
-                    return false;
-            }
-            esp_imgfx_rotate_handle_t rotate_handle = nullptr;
-            esp_imgfx_err_t imgfx_err = esp_imgfx_rotate_open(&rotate_cfg, &rotate_handle);
-            if (imgfx_err != ESP_IMGFX_ERR_OK || rotate_handle == nullptr) {
-                ESP_LOGE(TAG, "esp_imgfx_rotate_create failed");
+            if (!RotateFrame()) {
                 if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
                     ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
                 }
                 return false;
             }
-
-            esp_imgfx_data_t rotate_input_data = {
-                .data = rotate_src,
-                .data_len = frame_.len,
-            };
-            esp_imgfx_data_t rotate_output_data = {
-                .data = rotate_dst,
-                .data_len = frame_.len,
-            };
-
-            imgfx_err = esp_imgfx_rotate_process(rotate_handle, &rotate_input_data, &rotate_output_data);
-            if (imgfx_err != ESP_IMGFX_ERR_OK) {
-                ESP_LOGE(TAG, "esp_imgfx_rotate_process failed");
-                heap_caps_free(rotate_dst);
-                rotate_dst = nullptr;
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                esp_imgfx_rotate_close(rotate_handle);
-                rotate_handle = nullptr;
-                return false;
-            }
-
-            frame_.data = rotate_dst;
-
-            heap_caps_free(rotate_src);
-            rotate_src = nullptr;
-
-            esp_imgfx_rotate_close(rotate_handle);
-            rotate_handle = nullptr;
-#else   // CONFIG_SOC_PPA_SUPPORTED
-            uint8_t* rotate_src = nullptr;
-
-            ppa_srm_color_mode_t ppa_color_mode;
-            switch (frame_.format) {
-                case V4L2_PIX_FMT_RGB565:
-                    rotate_src = (uint8_t*)frame_.data;
-                    ppa_color_mode = PPA_SRM_COLOR_MODE_RGB565;
-                    break;
-                case V4L2_PIX_FMT_RGB24:
-                    rotate_src = (uint8_t*)frame_.data;
-                    ppa_color_mode = PPA_SRM_COLOR_MODE_RGB888;
-                    break;
-                case V4L2_PIX_FMT_YUYV: {
-                    ESP_LOGW(TAG, "YUYV format is not supported for PPA rotation, using software conversion to RGB888");
-                    rotate_src = (uint8_t*)heap_caps_malloc(frame_.width * frame_.height * 3,
-                                                            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-                    if (rotate_src == nullptr) {
-                        ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
-                        return false;
-                    }
-                    esp_imgfx_color_convert_cfg_t convert_cfg = {
-                        .in_res = {.width = static_cast<int16_t>(frame_.width),
-                                   .height = static_cast<int16_t>(frame_.height)},
-                        .in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_YUYV,
-                        .out_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888,
-                    };
-                    esp_imgfx_color_convert_handle_t convert_handle = nullptr;
-                    esp_imgfx_err_t err = esp_imgfx_color_convert_open(&convert_cfg, &convert_handle);
-                    if (err != ESP_IMGFX_ERR_OK || convert_handle == nullptr) {
-                        ESP_LOGE(TAG, "esp_imgfx_color_convert_open failed");
-                        heap_caps_free(rotate_src);
-                        rotate_src = nullptr;
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
-                        return false;
-                    }
-                    esp_imgfx_data_t convert_input_data = {
-                        .data = frame_.data,
-                        .data_len = frame_.len,
-                    };
-                    esp_imgfx_data_t convert_output_data = {
-                        .data = rotate_src,
-                        .data_len = static_cast<uint32_t>(frame_.width * frame_.height * 3),
-                    };
-                    err = esp_imgfx_color_convert_process(convert_handle, &convert_input_data, &convert_output_data);
-                    if (err != ESP_IMGFX_ERR_OK) {
-                        ESP_LOGE(TAG, "esp_imgfx_color_convert_process failed");
-                        heap_caps_free(rotate_src);
-                        rotate_src = nullptr;
-                        esp_imgfx_color_convert_close(convert_handle);
-                        convert_handle = nullptr;
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
-                        return false;
-                    }
-                    esp_imgfx_color_convert_close(convert_handle);
-                    convert_handle = nullptr;
-                    ppa_color_mode = PPA_SRM_COLOR_MODE_RGB888;
-                    heap_caps_free(frame_.data);
-                    frame_.data = rotate_src;
-                    frame_.len = frame_.width * frame_.height * 3;
-                    break;
-                }
-                default:
-                    ESP_LOGE(TAG, "unsupported sensor format for PPA rotation: 0x%08lx", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
-                    return false;
-            }
-
-            uint8_t* rotate_dst = (uint8_t*)heap_caps_malloc(
-                frame_.width * frame_.height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT | MALLOC_CAP_CACHE_ALIGNED);
-            if (rotate_dst == nullptr) {
-                ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
-
-            ppa_client_handle_t ppa_client = nullptr;
-            ppa_client_config_t client_cfg = {
-                .oper_type = PPA_OPERATION_SRM,
-                .max_pending_trans_num = 1,
-            };
-            esp_err_t err = ppa_register_client(&client_cfg, &ppa_client);
-            if (err != ESP_OK || ppa_client == nullptr) {
-                ESP_LOGE(TAG, "ppa_register_client failed: %d", (int)err);
-                heap_caps_free(rotate_dst);
-                rotate_dst = nullptr;
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
-
-            ppa_srm_rotation_angle_t ppa_angle = IMAGE_ROTATION_ANGLE;
-
-            ppa_srm_oper_config_t srm_cfg = {};
-            srm_cfg.in.buffer = (void*)rotate_src;
-            srm_cfg.in.pic_w = sensor_width_;
-            srm_cfg.in.pic_h = sensor_height_;
-            srm_cfg.in.block_w = sensor_width_;
-            srm_cfg.in.block_h = sensor_height_;
-            srm_cfg.in.block_offset_x = 0;
-            srm_cfg.in.block_offset_y = 0;
-            srm_cfg.in.srm_cm = ppa_color_mode;
-
-            srm_cfg.out.buffer = (void*)rotate_dst;
-            srm_cfg.out.buffer_size = frame_.len;
-            srm_cfg.out.pic_w = frame_.width;
-            srm_cfg.out.pic_h = frame_.height;
-            srm_cfg.out.block_offset_x = 0;
-            srm_cfg.out.block_offset_y = 0;
-            srm_cfg.out.srm_cm = PPA_SRM_COLOR_MODE_RGB565;
-
-            // 等比例缩放 1.0
-            srm_cfg.scale_x = 1.0f;
-            srm_cfg.scale_y = 1.0f;
-            srm_cfg.rotation_angle = ppa_angle;
-            srm_cfg.mode = PPA_TRANS_MODE_BLOCKING;
-            srm_cfg.user_data = nullptr;
-
-            err = ppa_do_scale_rotate_mirror(ppa_client, &srm_cfg);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "ppa_do_scale_rotate_mirror failed: %d", (int)err);
-                heap_caps_free(rotate_dst);
-                rotate_dst = nullptr;
-                (void)ppa_unregister_client(ppa_client);
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
-                return false;
-            }
-
-            (void)ppa_unregister_client(ppa_client);
-
-            frame_.data = rotate_dst;
-            frame_.len = frame_.width * frame_.height * 2;
-            frame_.format = V4L2_PIX_FMT_RGB565;
-            heap_caps_free(rotate_src);
-            rotate_src = nullptr;
-#endif  // CONFIG_SOC_PPA_SUPPORTED
 #endif  // CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
         }
 
@@ -804,29 +795,15 @@ bool EspVideo::Capture() {
 
 #ifdef CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
             case V4L2_PIX_FMT_JPEG: {
-                uint8_t* out_data = nullptr;  // out data is allocated by jpeg_to_image
-                size_t out_len = 0;
-                size_t out_width = 0;
-                size_t out_height = 0;
-                size_t out_stride = 0;
-
-                esp_err_t ret =
-                    jpeg_to_image(frame_.data, frame_.len, &out_data, &out_len, &out_width, &out_height, &out_stride);
-                if (ret != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to decode JPEG image: %d (%s)", (int)ret, esp_err_to_name(ret));
-                    if (out_data) {
-                        heap_caps_free(out_data);
-                        out_data = nullptr;
-                    }
+                // Decoded at the preview size on the display's loader task, Capture() does not wait for it
+                data = (uint8_t*)heap_caps_malloc(frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                if (data == nullptr) {
+                    ESP_LOGE(TAG, "Failed to allocate memory for preview image");
                     return false;
                 }
-
-                data = out_data;
-                w = out_width;
-                h = out_height;
-                lvgl_image_size = out_len;
-                stride = out_stride;
-                break;
+                memcpy(data, frame_.data, frame_.len);
+                display->LoadPreviewImage(data, frame_.len);
+                return true;
             }
 #endif
             default:
@@ -835,7 +812,9 @@ bool EspVideo::Capture() {
         }
 
         auto image = std::make_unique<LvglAllocatedImage>(data, lvgl_image_size, w, h, stride, color_format);
-        display->SetPreviewImage(std::move(image));
+        display->Post([display, image = std::move(image)]() mutable {
+            display->SetPreviewImage(std::move(image));
+        });
     }
     return true;
 }
@@ -874,6 +853,196 @@ bool EspVideo::SetVFlip(bool enabled) {
     return true;
 }
 
+/**
+ * @brief 推送原始帧流, 按整数倍抽样缩小到不超过 width x height
+ *
+ * 抽样直接从摄像头缓冲区拷到 CameraStream 的槽, 不经过整帧的中间缓冲。YUYV 每两个字节的第一个
+ * 字节都是 Y, 按两字节抽样后亮度仍然正确, 色度只是近似。不支持 YUV420 和 JPEG。
+ */
+bool EspVideo::StartStreaming(int fps, int width, int height, std::function<void(const CameraFrame&)> callback) {
+    if (!streaming_on_ || video_fd_ < 0 || stream_) {
+        return false;
+    }
+    if (encoder_thread_.joinable()) {
+        encoder_thread_.join();
+    }
+
+    int bytes_per_pixel;
+    uint32_t stream_format = sensor_format_;
+    switch (sensor_format_) {
+        case V4L2_PIX_FMT_GREY:
+            bytes_per_pixel = 1;
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            bytes_per_pixel = 3;
+            break;
+        case V4L2_PIX_FMT_YUV422P:
+            // 注: 当前版本 esp_video 中 YUV422P 实际输出为 YUYV。
+            stream_format = V4L2_PIX_FMT_YUYV;
+            bytes_per_pixel = 2;
+            break;
+        case V4L2_PIX_FMT_RGB565:
+            bytes_per_pixel = 2;
+            break;
+        default:
+            ESP_LOGE(TAG, "Streaming is not supported for pixel format 0x%08lx", sensor_format_);
+            return false;
+    }
+
+    struct v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(video_fd_, VIDIOC_G_FMT, &format) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_G_FMT failed, errno=%d(%s)", errno, strerror(errno));
+        return false;
+    }
+    int sensor_width = format.fmt.pix.width;
+    int sensor_height = format.fmt.pix.height;
+    int factor = 1;
+    while ((width > 0 && sensor_width / factor > width) || (height > 0 && sensor_height / factor > height)) {
+        factor++;
+    }
+    int out_width = sensor_width / factor;
+    int out_height = sensor_height / factor;
+
+    size_t slot_size = (size_t)out_width * out_height * bytes_per_pixel;
+    stream_ = std::make_unique<CameraStream>(slot_size, fps,
+        [this, factor, out_width, out_height, sensor_width, bytes_per_pixel, stream_format](
+            uint8_t* slot, size_t slot_size, CameraFrame& frame) -> bool {
+            struct v4l2_buffer buf = {};
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            if (ioctl(video_fd_, VIDIOC_DQBUF, &buf) != 0) {
+                ESP_LOGE(TAG, "VIDIOC_DQBUF failed");
+                return false;
+            }
+            auto src = (const uint8_t*)mmap_buffers_[buf.index].start;
+            size_t src_stride = (size_t)sensor_width * bytes_per_pixel;
+            uint8_t* dst = slot;
+            for (int y = 0; y < out_height; y++) {
+                const uint8_t* row = src + (size_t)y * factor * src_stride;
+                if (factor == 1) {
+                    memcpy(dst, row, src_stride);
+                    dst += src_stride;
+                    continue;
+                }
+                for (int x = 0; x < out_width; x++) {
+                    memcpy(dst, row + (size_t)x * factor * bytes_per_pixel, bytes_per_pixel);
+                    dst += bytes_per_pixel;
+                }
+            }
+            if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
+                ESP_LOGE(TAG, "VIDIOC_QBUF failed");
+            }
+            frame.len = dst - slot;
+            frame.width = out_width;
+            frame.height = out_height;
+            frame.format = stream_format;
+            frame.timestamp_us = esp_timer_get_time();
+            frame.keyframe = false;
+            return true;
+        }, std::move(callback));
+    if (!stream_->valid()) {
+        StopStreaming();
+        return false;
+    }
+    ESP_LOGI(TAG, "Streaming %dx%d (1/%d) at %d fps", out_width, out_height, factor, fps);
+    return true;
+}
+
+#ifdef CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+/**
+ * @brief 以硬件编码器 (H.264 或 JPEG) 推送传感器分辨率的视频流
+ *
+ * 摄像头缓冲区直接交给编码器 (USERPTR), 原始帧不拷贝; 编码后的帧拷贝进 CameraStream 的槽,
+ * 由消费者任务回调。消费者跟不上时 CameraStream 丢弃旧帧。视频流不做旋转。
+ * 传感器输出不是 YUV420 时 H.264 无法使用, 回退到 JPEG。
+ */
+bool EspVideo::StartVideoStream(const VideoStreamConfig& config, std::function<void(const CameraFrame&)> callback) {
+    if (!streaming_on_ || video_fd_ < 0 || stream_) {
+        return false;
+    }
+    if (encoder_thread_.joinable()) {
+        encoder_thread_.join();
+    }
+
+    struct v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(video_fd_, VIDIOC_G_FMT, &format) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_G_FMT failed, errno=%d(%s)", errno, strerror(errno));
+        return false;
+    }
+    int width = format.fmt.pix.width;
+    int height = format.fmt.pix.height;
+
+    VideoCodec codec = config.codec;
+    if (!HwVideoEncoder::Supports(codec, sensor_format_)) {
+        codec = kVideoCodecJpeg;
+        if (!HwVideoEncoder::Supports(codec, sensor_format_)) {
+            ESP_LOGE(TAG, "No hardware encoder takes the sensor format 0x%08lx", sensor_format_);
+            return false;
+        }
+        ESP_LOGW(TAG, "H.264 needs YUV420 input, streaming JPEG");
+    }
+    video_encoder_ = std::make_unique<HwVideoEncoder>();
+    if (!video_encoder_->Open(codec, sensor_format_, width, height, config)) {
+        video_encoder_.reset();
+        return false;
+    }
+
+    // 压缩后超过这个大小的帧被跳过
+    size_t slot_size = width * height / 4;
+    uint32_t stream_format = codec == kVideoCodecH264 ? V4L2_PIX_FMT_H264 : V4L2_PIX_FMT_JPEG;
+    stream_ = std::make_unique<CameraStream>(slot_size, config.fps,
+        [this, width, height, stream_format](uint8_t* slot, size_t slot_size, CameraFrame& frame) -> bool {
+            struct v4l2_buffer buf = {};
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            if (ioctl(video_fd_, VIDIOC_DQBUF, &buf) != 0) {
+                ESP_LOGE(TAG, "VIDIOC_DQBUF failed");
+                return false;
+            }
+            bool fits = false;
+            video_encoder_->Encode((const uint8_t*)mmap_buffers_[buf.index].start, buf.bytesused,
+                [&](const uint8_t* data, size_t len, bool keyframe) {
+                    if (len > slot_size) {
+                        ESP_LOGW(TAG, "Skipping a %zu byte frame, the stream holds %zu", len, slot_size);
+                        return;
+                    }
+                    memcpy(slot, data, len);
+                    frame.len = len;
+                    frame.keyframe = keyframe;
+                    fits = true;
+                });
+            if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
+                ESP_LOGE(TAG, "VIDIOC_QBUF failed");
+            }
+            frame.width = width;
+            frame.height = height;
+            frame.format = stream_format;
+            frame.timestamp_us = esp_timer_get_time();
+            return fits;
+        }, std::move(callback));
+    if (!stream_->valid()) {
+        StopStreaming();
+        return false;
+    }
+    ESP_LOGI(TAG, "Streaming %s %dx%d at %d fps", codec == kVideoCodecH264 ? "H.264" : "JPEG", width, height,
+             config.fps);
+    return true;
+}
+#endif  // CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+
+void EspVideo::StopStreaming() {
+    if (!stream_) {
+        return;
+    }
+    stream_.reset();
+#ifdef CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+    video_encoder_.reset();
+#endif
+    ESP_LOGI(TAG, "Streaming stopped");
+}
+
 /**
  * @brief 将摄像头捕获的图像发送到远程服务器进行AI分析和解释
  *
@@ -902,49 +1071,44 @@ std::string EspVideo::Explain(const std::string& question) {
         throw std::runtime_error("Image explain URL or token is not set");
     }
 
-    // 创建局部的 JPEG 队列, 40 entries is about to store 512 * 40 = 20480 bytes of JPEG data
-    QueueHandle_t jpeg_queue = xQueueCreate(40, sizeof(JpegChunk));
-    if (jpeg_queue == nullptr) {
-        ESP_LOGE(TAG, "Failed to create JPEG queue");
-        throw std::runtime_error("Failed to create JPEG queue");
+    // 编码线程与上传之间复用的固定 JPEG 块, 全部在途时编码线程等待
+    auto pool = std::make_shared<JpegChunkPool>();
+    if (!pool->valid()) {
+        throw std::runtime_error("Failed to allocate JPEG chunks");
     }
 
     // We spawn a thread to encode the image to JPEG using optimized encoder (cost about 500ms and 8KB SRAM)
-    encoder_thread_ = std::thread([this, jpeg_queue]() {
+    encoder_thread_ = std::thread([this, pool]() {
         uint16_t w = frame_.width ? frame_.width : 320;
         uint16_t h = frame_.height ? frame_.height : 240;
         v4l2_pix_fmt_t enc_fmt = frame_.format;
         bool ok = image_to_jpeg_cb(
             frame_.data, frame_.len, w, h, enc_fmt, 80,
             [](void* arg, size_t index, const void* data, size_t len) -> size_t {
-                auto jpeg_queue = static_cast<QueueHandle_t>(arg);
-                JpegChunk chunk = {.data = nullptr, .len = len};
-                if (index == 0 && data != nullptr && len > 0) {
-                    chunk.data = (uint8_t*)heap_caps_aligned_alloc(16, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-                    if (chunk.data == nullptr) {
-                        ESP_LOGE(TAG, "Failed to allocate %zu bytes for JPEG chunk", len);
-                        chunk.len = 0;
-                    } else {
-                        memcpy(chunk.data, data, len);
-                    }
-                } else {
-                    chunk.len = 0;  // Sentinel or error
+                if (data != nullptr && len > 0) {
+                    static_cast<JpegChunkPool*>(arg)->Write(data, len);
                 }
-                xQueueSend(jpeg_queue, &chunk, portMAX_DELAY);
                 return len;
             },
-            jpeg_queue);
-
-        if (!ok) {
-            JpegChunk chunk = {.data = nullptr, .len = 0};
-            xQueueSend(jpeg_queue, &chunk, portMAX_DELAY);
-        }
+            pool.get());
+        pool->Finish(ok);
     });
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(3);
-    // 构造multipart/form-data请求体
+    // 构造multipart/form-data请求体, JPEG 数据之前的部分一次写出
     std::string boundary = "----ESP32_CAMERA_BOUNDARY";
+    std::string preamble;
+    // 第一块：question字段
+    preamble += "--" + boundary + "\r\n";
+    preamble += "Content-Disposition: form-data; name=\"question\"\r\n";
+    preamble += "\r\n";
+    preamble += question + "\r\n";
+    // 第二块：文件字段头部
+    preamble += "--" + boundary + "\r\n";
+    preamble += "Content-Disposition: form-data; name=\"file\"; filename=\"camera.jpg\"\r\n";
+    preamble += "Content-Type: image/jpeg\r\n";
+    preamble += "\r\n";
+
+    auto http = HttpPool::GetInstance().CreateHttp(3);
 
     // 配置HTTP客户端，使用分块传输编码
     http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
@@ -956,62 +1120,28 @@ std::string EspVideo::Explain(const std::string& question) {
     http->SetHeader("Transfer-Encoding", "chunked");
     if (!http->Open("POST", explain_url_)) {
         ESP_LOGE(TAG, "Failed to connect to explain URL");
-        // Clear the queue
+        // 归还所有块, 编码线程才能结束
+        pool->Drain();
         encoder_thread_.join();
-        JpegChunk chunk;
-        while (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) == pdPASS) {
-            if (chunk.data != nullptr) {
-                heap_caps_free(chunk.data);
-            } else {
-                break;
-            }
-        }
-        vQueueDelete(jpeg_queue);
         throw std::runtime_error("Failed to connect to explain URL");
     }
-
-    {
-        // 第一块：question字段
-        std::string question_field;
-        question_field += "--" + boundary + "\r\n";
-        question_field += "Content-Disposition: form-data; name=\"question\"\r\n";
-        question_field += "\r\n";
-        question_field += question + "\r\n";
-        http->Write(question_field.c_str(), question_field.size());
-    }
-    {
-        // 第二块：文件字段头部
-        std::string file_header;
-        file_header += "--" + boundary + "\r\n";
-        file_header += "Content-Disposition: form-data; name=\"file\"; filename=\"camera.jpg\"\r\n";
-        file_header += "Content-Type: image/jpeg\r\n";
-        file_header += "\r\n";
-        http->Write(file_header.c_str(), file_header.size());
-    }
+    http->Write(preamble.c_str(), preamble.size());
 
     // 第三块：JPEG数据
     size_t total_sent = 0;
-    bool saw_terminator = false;
-    while (true) {
-        JpegChunk chunk;
-        if (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) != pdPASS) {
-            ESP_LOGE(TAG, "Failed to receive JPEG chunk");
-            break;
-        }
-        if (chunk.data == nullptr) {
-            saw_terminator = true;
-            break;  // The last chunk
-        }
+    int64_t send_start_us = esp_timer_get_time();
+    JpegChunk chunk;
+    while (pool->Receive(chunk)) {
         http->Write((const char*)chunk.data, chunk.len);
         total_sent += chunk.len;
-        heap_caps_free(chunk.data);
+        pool->Release(chunk);
     }
+    int64_t send_end_us = esp_timer_get_time();
     // Wait for the encoder thread to finish
     encoder_thread_.join();
-    // 清理队列
-    vQueueDelete(jpeg_queue);
+    pool->LogStats(total_sent, send_start_us, send_end_us);
 
-    if (!saw_terminator || total_sent == 0) {
+    if (!pool->encoded_ok() || total_sent == 0) {
         ESP_LOGE(TAG, "JPEG encoder failed or produced empty output");
         throw std::runtime_error("Failed to encode image to JPEG");
     }
@@ -12,11 +12,16 @@
 #include "camera.h"
 #include "jpg/image_to_jpeg.h"
 #include "esp_video_init.h"
+#include "jpeg_chunk_pool.h"
+#include "camera_stream.h"
 
-struct JpegChunk {
-    uint8_t* data;
-    size_t len;
-};
+#ifdef CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+#include "hw_video_encoder.h"
+#endif
+
+#if defined(CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE) && defined(CONFIG_SOC_PPA_SUPPORTED)
+#include "driver/ppa.h"
+#endif
 
 class EspVideo : public Camera {
 private:
@@ -27,6 +32,17 @@ private:
         uint16_t height = 0;
         v4l2_pix_fmt_t format = 0;
     } frame_;
+    // frame_.data 的实际容量, 拍照间复用, 只在需要更大时重新分配
+    size_t frame_capacity_ = 0;
+#ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+    // 旋转的另一块缓冲区, 旋转后与 frame_.data 交换
+    uint8_t* rotate_buffer_ = nullptr;
+    size_t rotate_capacity_ = 0;
+#ifdef CONFIG_SOC_PPA_SUPPORTED
+    ppa_client_handle_t ppa_client_ = nullptr;
+#endif
+    bool RotateFrame();
+#endif
     v4l2_pix_fmt_t sensor_format_ = 0;
 #ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
     uint16_t sensor_width_ = 0;
@@ -39,6 +55,11 @@ private:
     std::string explain_url_;
     std::string explain_token_;
     std::thread encoder_thread_;
+    // 视频流期间由采集任务独占 video_fd_, Capture() 会被拒绝
+    std::unique_ptr<CameraStream> stream_;
+#ifdef CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+    std::unique_ptr<HwVideoEncoder> video_encoder_;
+#endif
 
 public:
     EspVideo(const esp_video_init_config_t& config);
@@ -50,4 +71,9 @@ public:
     virtual bool SetHMirror(bool enabled) override;
     virtual bool SetVFlip(bool enabled) override;
     virtual std::string Explain(const std::string& question);
+    virtual bool StartStreaming(int fps, int width, int height, std::function<void(const CameraFrame&)> callback) override;
+#ifdef CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+    virtual bool StartVideoStream(const VideoStreamConfig& config, std::function<void(const CameraFrame&)> callback) override;
+#endif
+    virtual void StopStreaming() override;
 };
@@ -0,0 +1,62 @@
+#include "explain_tuner.h"
+#include "sdkconfig.h"
+
+#include <esp_log.h>
+
+#include <algorithm>
+
+#define TAG "ExplainTuner"
+
+// Best first, larger steps in quality before the resolution goes down
+static const ExplainTuner::Choice kChoices[] = {
+    {80, 1}, {60, 1}, {45, 1}, {60, 2}, {45, 2}, {30, 2}, {45, 4}, {30, 4},
+};
+
+// Size relative to quality 80, rough figures of the baseline encoder on camera images
+static int SizePercent(int quality) {
+    if (quality >= 80) {
+        return 100 + (quality - 80) * 5;
+    }
+    if (quality >= 60) {
+        return 65 + (quality - 60) * 35 / 20;
+    }
+    if (quality >= 30) {
+        return 40 + (quality - 30) * 25 / 30;
+    }
+    return 25 + quality / 2;
+}
+
+ExplainTuner::Choice ExplainTuner::Pick(int width, int height) const {
+    if (bytes_per_second_ == 0 || bytes_per_kilopixel_ == 0) {
+        return kChoices[0];
+    }
+    uint64_t budget = (uint64_t)bytes_per_second_ * CONFIG_XIAOZHI_CAMERA_EXPLAIN_TARGET_MS / 1000;
+    for (const auto& choice : kChoices) {
+        uint64_t pixels = (uint64_t)(width / choice.scale) * (height / choice.scale);
+        uint64_t predicted = pixels * bytes_per_kilopixel_ / 1000 * SizePercent(choice.quality) / 100;
+        if (predicted <= budget) {
+            return choice;
+        }
+    }
+    return kChoices[sizeof(kChoices) / sizeof(kChoices[0]) - 1];
+}
+
+void ExplainTuner::Record(const Choice& choice, int width, int height, size_t bytes, int64_t send_us,
+                          int64_t backpressure_us) {
+    uint64_t pixels = (uint64_t)(width / choice.scale) * (height / choice.scale);
+    if (bytes == 0 || pixels == 0 || send_us <= 0) {
+        return;
+    }
+    uint32_t size = (uint64_t)bytes * 1000 * 100 / pixels / SizePercent(choice.quality);
+    bytes_per_kilopixel_ = bytes_per_kilopixel_ == 0 ? size : (bytes_per_kilopixel_ + size) / 2;
+
+    uint32_t rate = (uint64_t)bytes * 1000000 / send_us;
+    if (backpressure_us * 4 >= send_us) {
+        // The network held back the encoder, this is the link rate
+        bytes_per_second_ = bytes_per_second_ == 0 ? rate : (bytes_per_second_ + rate) / 2;
+    } else {
+        bytes_per_second_ = std::max(bytes_per_second_, rate);
+    }
+    ESP_LOGI(TAG, "Upload at %lu KB/s, %lu bytes per kilopixel at quality 80", bytes_per_second_ / 1024,
+             bytes_per_kilopixel_);
+}
@@ -0,0 +1,35 @@
+#ifndef EXPLAIN_TUNER_H
+#define EXPLAIN_TUNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Picks the JPEG quality and downscale of the next Explain() upload from the throughput of the
+ * previous ones, so the photo reaches the server in about CONFIG_XIAOZHI_CAMERA_EXPLAIN_TARGET_MS
+ * on a slow link and at full quality on a fast one.
+ *
+ * The encoder runs alongside the upload, so a send that never waited for the network only tells
+ * that the link is at least that fast. The estimate is lowered only by uploads that held back the
+ * encoder.
+ */
+class ExplainTuner {
+public:
+    struct Choice {
+        int quality;
+        int scale;      // 1, 2 or 4
+    };
+
+    // The best choice expected to upload width x height pixels within the target time
+    Choice Pick(int width, int height) const;
+
+    // After an upload of bytes in send_us, backpressure_us of which the encoder waited for the network
+    void Record(const Choice& choice, int width, int height, size_t bytes, int64_t send_us, int64_t backpressure_us);
+
+private:
+    uint32_t bytes_per_second_ = 0;     // 0 until the first upload
+    // Compressed size per 1000 pixels at quality 80, learned from the uploads
+    uint32_t bytes_per_kilopixel_ = 0;
+};
+
+#endif // EXPLAIN_TUNER_H
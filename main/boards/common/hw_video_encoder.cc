@@ -0,0 +1,248 @@
+#include "hw_video_encoder.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <esp_log.h>
+#include <cstring>
+
+#include "esp_video_device.h"
+#include "linux/videodev2.h"
+
+#define TAG "HwVideoEncoder"
+
+// for compatibility with old esp_video version
+#ifndef MAP_FAILED
+#define MAP_FAILED nullptr
+#endif
+
+// An IDR slice or a sequence parameter set starts a decodable access unit
+static bool IsH264Keyframe(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i + 3 < len; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            uint8_t type = data[i + 3] & 0x1F;
+            if (type == 5 || type == 7) {
+                return true;
+            }
+            if (type == 1) {
+                return false;
+            }
+            i += 2;
+        }
+    }
+    return false;
+}
+
+HwVideoEncoder::~HwVideoEncoder() {
+    Close();
+}
+
+bool HwVideoEncoder::Supports(VideoCodec codec, uint32_t pixel_format) {
+    switch (codec) {
+#if CONFIG_ESP_VIDEO_ENABLE_HW_H264_VIDEO_DEVICE
+        case kVideoCodecH264:
+            return pixel_format == V4L2_PIX_FMT_YUV420;
+#endif
+#if CONFIG_ESP_VIDEO_ENABLE_HW_JPEG_VIDEO_DEVICE
+        case kVideoCodecJpeg:
+            return pixel_format == V4L2_PIX_FMT_RGB565 || pixel_format == V4L2_PIX_FMT_RGB24 ||
+                   pixel_format == V4L2_PIX_FMT_YUV422P || pixel_format == V4L2_PIX_FMT_GREY;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool HwVideoEncoder::SetControl(uint32_t control_class, uint32_t id, int32_t value) {
+    struct v4l2_ext_control control = {};
+    control.id = id;
+    control.value = value;
+    struct v4l2_ext_controls controls = {};
+    controls.ctrl_class = control_class;
+    controls.count = 1;
+    controls.controls = &control;
+    if (ioctl(fd_, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
+        ESP_LOGW(TAG, "Failed to set control 0x%08lx to %ld, errno=%d(%s)", id, value, errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool HwVideoEncoder::Open(VideoCodec codec, uint32_t pixel_format, int width, int height, const VideoStreamConfig& config) {
+    Close();
+    if (!Supports(codec, pixel_format)) {
+        ESP_LOGE(TAG, "No %s encoder for pixel format 0x%08lx", codec == kVideoCodecH264 ? "H.264" : "JPEG", pixel_format);
+        return false;
+    }
+    const char* device_name = nullptr;
+    uint32_t output_format = 0;
+#if CONFIG_ESP_VIDEO_ENABLE_HW_H264_VIDEO_DEVICE
+    if (codec == kVideoCodecH264) {
+        device_name = ESP_VIDEO_H264_DEVICE_NAME;
+        output_format = V4L2_PIX_FMT_H264;
+    }
+#endif
+#if CONFIG_ESP_VIDEO_ENABLE_HW_JPEG_VIDEO_DEVICE
+    if (codec == kVideoCodecJpeg) {
+        device_name = ESP_VIDEO_JPEG_DEVICE_NAME;
+        output_format = V4L2_PIX_FMT_JPEG;
+    }
+#endif
+    fd_ = open(device_name, O_RDWR);
+    if (fd_ < 0) {
+        ESP_LOGE(TAG, "open %s failed, errno=%d(%s)", device_name, errno, strerror(errno));
+        return false;
+    }
+    codec_ = codec;
+
+    // The raw frames go in on the OUTPUT queue, the encoded ones come out of the CAPTURE queue
+    struct v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    format.fmt.pix.width = width;
+    format.fmt.pix.height = height;
+    format.fmt.pix.pixelformat = pixel_format;
+    if (ioctl(fd_, VIDIOC_S_FMT, &format) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_S_FMT of the input failed, errno=%d(%s)", errno, strerror(errno));
+        Close();
+        return false;
+    }
+    format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = width;
+    format.fmt.pix.height = height;
+    format.fmt.pix.pixelformat = output_format;
+    if (ioctl(fd_, VIDIOC_S_FMT, &format) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_S_FMT of the output failed, errno=%d(%s)", errno, strerror(errno));
+        Close();
+        return false;
+    }
+
+    if (codec == kVideoCodecH264) {
+        SetControl(V4L2_CTRL_CLASS_CODEC, V4L2_CID_MPEG_VIDEO_BITRATE, config.bitrate_kbps * 1000);
+        SetControl(V4L2_CTRL_CLASS_CODEC, V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, config.keyframe_interval);
+    } else {
+        SetControl(V4L2_CTRL_CLASS_JPEG, V4L2_CID_JPEG_COMPRESSION_QUALITY, config.jpeg_quality);
+    }
+
+    struct v4l2_requestbuffers req = {};
+    req.count = 1;
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_USERPTR;
+    if (ioctl(fd_, VIDIOC_REQBUFS, &req) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_REQBUFS of the input failed");
+        Close();
+        return false;
+    }
+    req = {};
+    req.count = 1;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(fd_, VIDIOC_REQBUFS, &req) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_REQBUFS of the output failed");
+        Close();
+        return false;
+    }
+    struct v4l2_buffer buf = {};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = 0;
+    if (ioctl(fd_, VIDIOC_QUERYBUF, &buf) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_QUERYBUF failed");
+        Close();
+        return false;
+    }
+    void* start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+    if (start == MAP_FAILED) {
+        ESP_LOGE(TAG, "mmap failed");
+        Close();
+        return false;
+    }
+    capture_start_ = start;
+    capture_length_ = buf.length;
+    if (ioctl(fd_, VIDIOC_QBUF, &buf) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_QBUF of the output failed");
+        Close();
+        return false;
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    if (ioctl(fd_, VIDIOC_STREAMON, &type) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_STREAMON of the input failed");
+        Close();
+        return false;
+    }
+    streaming_ = true;
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd_, VIDIOC_STREAMON, &type) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_STREAMON of the output failed");
+        Close();
+        return false;
+    }
+    ESP_LOGI(TAG, "%s encoder open, %dx%d", codec == kVideoCodecH264 ? "H.264" : "JPEG", width, height);
+    return true;
+}
+
+void HwVideoEncoder::Close() {
+    if (fd_ < 0) {
+        return;
+    }
+    if (streaming_) {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        ioctl(fd_, VIDIOC_STREAMOFF, &type);
+        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        ioctl(fd_, VIDIOC_STREAMOFF, &type);
+        streaming_ = false;
+    }
+    if (capture_start_ != nullptr) {
+        munmap(capture_start_, capture_length_);
+        capture_start_ = nullptr;
+        capture_length_ = 0;
+    }
+    close(fd_);
+    fd_ = -1;
+}
+
+bool HwVideoEncoder::Encode(const uint8_t* frame, size_t len, const OutputFunction& output) {
+    if (fd_ < 0) {
+        return false;
+    }
+    // The encoder reads the frame in place, it stays queued until the output buffer is back
+    struct v4l2_buffer input = {};
+    input.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    input.memory = V4L2_MEMORY_USERPTR;
+    input.index = 0;
+    input.m.userptr = (unsigned long)frame;
+    input.length = len;
+    input.bytesused = len;
+    if (ioctl(fd_, VIDIOC_QBUF, &input) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_QBUF of the frame failed, errno=%d(%s)", errno, strerror(errno));
+        return false;
+    }
+    struct v4l2_buffer encoded = {};
+    encoded.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    encoded.memory = V4L2_MEMORY_MMAP;
+    bool encoded_ok = ioctl(fd_, VIDIOC_DQBUF, &encoded) == 0;
+    if (!encoded_ok) {
+        ESP_LOGE(TAG, "VIDIOC_DQBUF of the encoded frame failed, errno=%d(%s)", errno, strerror(errno));
+    }
+    bool input_ok = ioctl(fd_, VIDIOC_DQBUF, &input) == 0;
+    if (!input_ok) {
+        ESP_LOGE(TAG, "VIDIOC_DQBUF of the frame failed, errno=%d(%s)", errno, strerror(errno));
+    }
+    if (!encoded_ok) {
+        return false;
+    }
+    if (input_ok) {
+        auto data = static_cast<const uint8_t*>(capture_start_);
+        size_t size = encoded.bytesused;
+        bool keyframe = codec_ == kVideoCodecJpeg || IsH264Keyframe(data, size);
+        output(data, size, keyframe);
+    }
+    if (ioctl(fd_, VIDIOC_QBUF, &encoded) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_QBUF of the output failed");
+        return false;
+    }
+    return input_ok;
+}
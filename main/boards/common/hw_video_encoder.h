@@ -0,0 +1,40 @@
+#ifndef HW_VIDEO_ENCODER_H
+#define HW_VIDEO_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "camera.h"
+
+/*
+ * One of the esp_video memory-to-memory encoders of the ESP32-P4 (H.264 or JPEG). The raw
+ * frame is queued by address (V4L2_MEMORY_USERPTR), so a camera capture buffer goes to the
+ * encoder without a copy; the encoded frame is read from the encoder's own mmapped buffer.
+ */
+class HwVideoEncoder {
+public:
+    // Called with the encoded frame, only valid during the call
+    using OutputFunction = std::function<void(const uint8_t* data, size_t len, bool keyframe)>;
+
+    HwVideoEncoder() = default;
+    ~HwVideoEncoder();
+
+    // Whether the encoder device for codec is built in and takes frames of pixel_format
+    static bool Supports(VideoCodec codec, uint32_t pixel_format);
+
+    bool Open(VideoCodec codec, uint32_t pixel_format, int width, int height, const VideoStreamConfig& config);
+    void Close();
+    bool Encode(const uint8_t* frame, size_t len, const OutputFunction& output);
+
+private:
+    int fd_ = -1;
+    VideoCodec codec_ = kVideoCodecJpeg;
+    void* capture_start_ = nullptr;
+    size_t capture_length_ = 0;
+    bool streaming_ = false;
+
+    bool SetControl(uint32_t control_class, uint32_t id, int32_t value);
+};
+
+#endif // HW_VIDEO_ENCODER_H
@@ -1,9 +1,16 @@
 #include "i2c_device.h"
+#include "i2c_scheduler.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
 
 #define TAG "I2cDevice"
 
+// Register runs longer than this are read or written through a heap buffer
+#define I2C_DEVICE_MAX_RUN 32
+
 
 I2cDevice::I2cDevice(i2c_master_bus_handle_t i2c_bus, uint8_t addr) {
     i2c_device_config_t i2c_device_cfg = {
@@ -19,9 +26,30 @@ I2cDevice::I2cDevice(i2c_master_bus_handle_t i2c_bus, uint8_t addr) {
     assert(i2c_device_ != NULL);
 }
 
+I2cDevice::~I2cDevice() {
+    if (polling_) {
+        I2cScheduler::GetInstance().RemovePolls(this);
+    }
+}
+
 void I2cDevice::WriteReg(uint8_t reg, uint8_t value) {
     uint8_t buffer[2] = {reg, value};
     ESP_ERROR_CHECK(i2c_master_transmit(i2c_device_, buffer, 2, 100));
+    UpdateCache(reg, &value, 1, false);
+}
+
+void I2cDevice::WriteRegs(uint8_t reg, const uint8_t* data, size_t length) {
+    uint8_t stack_buffer[I2C_DEVICE_MAX_RUN + 1];
+    std::vector<uint8_t> heap_buffer;
+    uint8_t* buffer = stack_buffer;
+    if (length > I2C_DEVICE_MAX_RUN) {
+        heap_buffer.resize(length + 1);
+        buffer = heap_buffer.data();
+    }
+    buffer[0] = reg;
+    std::copy(data, data + length, buffer + 1);
+    ESP_ERROR_CHECK(i2c_master_transmit(i2c_device_, buffer, length + 1, 100));
+    UpdateCache(reg, data, length, false);
 }
 
 uint8_t I2cDevice::ReadReg(uint8_t reg) {
@@ -32,4 +60,64 @@ uint8_t I2cDevice::ReadReg(uint8_t reg) {
 
 void I2cDevice::ReadRegs(uint8_t reg, uint8_t* buffer, size_t length) {
     ESP_ERROR_CHECK(i2c_master_transmit_receive(i2c_device_, &reg, 1, buffer, length, 100));
-}
\ No newline at end of file
+}
+
+void I2cDevice::PollRegs(uint8_t reg, size_t length, int interval_ms) {
+    polling_ = true;
+    I2cScheduler::GetInstance().AddPoll(this, reg, length, interval_ms);
+}
+
+uint8_t I2cDevice::ReadRegCached(uint8_t reg, int max_age_ms) {
+    if (polling_ && I2cScheduler::GetInstance().slow_polling()) {
+        max_age_ms = std::max(max_age_ms, I2C_SLOW_POLL_MS * 2);
+    }
+    int64_t now = esp_timer_get_time();
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        for (auto& entry : cache_) {
+            if (entry.reg == reg && now - entry.updated_us <= (int64_t)max_age_ms * 1000) {
+                return entry.value;
+            }
+        }
+    }
+    uint8_t value = ReadReg(reg);
+    UpdateCache(reg, &value, 1, true);
+    return value;
+}
+
+void I2cDevice::UpdateCache(uint8_t reg, const uint8_t* values, size_t length, bool insert) {
+    int64_t now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    for (size_t i = 0; i < length; i++) {
+        uint8_t r = reg + i;
+        bool found = false;
+        for (auto& entry : cache_) {
+            if (entry.reg == r) {
+                entry.value = values[i];
+                entry.updated_us = now;
+                found = true;
+                break;
+            }
+        }
+        // Writes only refresh registers that are already cached
+        if (!found && insert) {
+            cache_.push_back({r, values[i], now});
+        }
+    }
+}
+
+void I2cDevice::Poll(uint8_t reg, size_t length) {
+    uint8_t stack_buffer[I2C_DEVICE_MAX_RUN];
+    std::vector<uint8_t> heap_buffer;
+    uint8_t* buffer = stack_buffer;
+    if (length > I2C_DEVICE_MAX_RUN) {
+        heap_buffer.resize(length);
+        buffer = heap_buffer.data();
+    }
+    esp_err_t err = i2c_master_transmit_receive(i2c_device_, &reg, 1, buffer, length, 100);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Poll of 0x%02x failed: %s", reg, esp_err_to_name(err));
+        return;
+    }
+    UpdateCache(reg, buffer, length, true);
+}
@@ -3,16 +3,44 @@
 
 #include <driver/i2c_master.h>
 
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
 class I2cDevice {
 public:
     I2cDevice(i2c_master_bus_handle_t i2c_bus, uint8_t addr);
+    ~I2cDevice();
 
 protected:
     i2c_master_dev_handle_t i2c_device_;
 
     void WriteReg(uint8_t reg, uint8_t value);
+    // Writes a run of registers in one transaction, the device auto increments the address
+    void WriteRegs(uint8_t reg, const uint8_t* data, size_t length);
     uint8_t ReadReg(uint8_t reg);
     void ReadRegs(uint8_t reg, uint8_t* buffer, size_t length);
+
+    // Reads length registers from reg on the low priority I2C poll task every interval_ms
+    void PollRegs(uint8_t reg, size_t length, int interval_ms);
+    // The last value polled or read, the bus is only read when it is older than max_age_ms
+    uint8_t ReadRegCached(uint8_t reg, int max_age_ms);
+
+private:
+    friend class I2cScheduler;
+
+    struct CachedReg {
+        uint8_t reg;
+        uint8_t value;
+        int64_t updated_us;
+    };
+    std::mutex cache_mutex_;
+    std::vector<CachedReg> cache_;
+    bool polling_ = false;
+
+    void UpdateCache(uint8_t reg, const uint8_t* values, size_t length, bool insert);
+    // Called by the poll task, a failed read only logs
+    void Poll(uint8_t reg, size_t length);
 };
 
 #endif // I2C_DEVICE_H
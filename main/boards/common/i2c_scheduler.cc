@@ -0,0 +1,83 @@
+#include "i2c_scheduler.h"
+#include "i2c_device.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+
+#define TAG "I2cScheduler"
+
+// Below every audio, display and network task
+#define I2C_POLL_TASK_PRIORITY 1
+
+void I2cScheduler::AddPoll(I2cDevice* device, uint8_t reg, size_t length, int interval_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool merged = false;
+    for (auto& poll : polls_) {
+        if (poll.device == device && poll.reg == reg && poll.length == length) {
+            poll.interval_ms = std::min(poll.interval_ms, interval_ms);
+            merged = true;
+            break;
+        }
+    }
+    if (!merged) {
+        // Due right away, so the cache is filled before the first read
+        polls_.push_back({device, reg, length, interval_ms, 0});
+    }
+
+    if (task_ == nullptr) {
+        xTaskCreate([](void* arg) {
+            static_cast<I2cScheduler*>(arg)->PollTask();
+        }, "i2c_poll", 3072, this, I2C_POLL_TASK_PRIORITY, &task_);
+    } else {
+        xTaskNotifyGive(task_);
+    }
+}
+
+void I2cScheduler::RemovePolls(I2cDevice* device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    polls_.erase(std::remove_if(polls_.begin(), polls_.end(), [device](const PollEntry& poll) {
+        return poll.device == device;
+    }), polls_.end());
+}
+
+void I2cScheduler::SetSlowPolling(bool slow) {
+    if (slow_polling_ == slow) {
+        return;
+    }
+    slow_polling_ = slow;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!slow) {
+        // Whatever was read during standby is stale now
+        for (auto& poll : polls_) {
+            poll.next_us = 0;
+        }
+    }
+    if (task_ != nullptr) {
+        xTaskNotifyGive(task_);
+    }
+}
+
+void I2cScheduler::PollTask() {
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        int64_t next_us = now + 60 * 1000000LL;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto& poll : polls_) {
+            if (poll.next_us <= now) {
+                // The bus is the shared resource, the device cache has its own lock
+                poll.device->Poll(poll.reg, poll.length);
+                int interval_ms = slow_polling_ ? std::max(poll.interval_ms, I2C_SLOW_POLL_MS) : poll.interval_ms;
+                poll.next_us = now + (int64_t)interval_ms * 1000;
+            }
+            next_us = std::min(next_us, poll.next_us);
+        }
+        lock.unlock();
+
+        int64_t wait_us = next_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(std::max<int64_t>(wait_us / 1000, 1)));
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef I2C_SCHEDULER_H
+#define I2C_SCHEDULER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Poll interval while slow polling
+#define I2C_SLOW_POLL_MS 60000
+
+class I2cDevice;
+
+/*
+ * Runs the background register polls of every I2cDevice on one low priority task, so battery
+ * and charger status reads no longer happen on the main or LVGL task while touch and codec
+ * transactions wait on the same bus. A poll reads a run of registers in one transaction into
+ * the device cache, and a second poll of the same device and registers is merged into the
+ * first at the shorter interval. In slow polling every poll stretches to a minute.
+ */
+class I2cScheduler {
+public:
+    static I2cScheduler& GetInstance() {
+        static I2cScheduler instance;
+        return instance;
+    }
+    I2cScheduler(const I2cScheduler&) = delete;
+    I2cScheduler& operator=(const I2cScheduler&) = delete;
+
+    void AddPoll(I2cDevice* device, uint8_t reg, size_t length, int interval_ms);
+    void RemovePolls(I2cDevice* device);
+    // Every poll runs at most once a minute, e.g. while the device is in standby
+    void SetSlowPolling(bool slow);
+    bool slow_polling() const { return slow_polling_; }
+
+private:
+    I2cScheduler() = default;
+
+    struct PollEntry {
+        I2cDevice* device;
+        uint8_t reg;
+        size_t length;
+        int interval_ms;
+        int64_t next_us;
+    };
+    std::mutex mutex_;
+    std::vector<PollEntry> polls_;
+    TaskHandle_t task_ = nullptr;
+    std::atomic<bool> slow_polling_{false};
+
+    void PollTask();
+};
+
+#endif // I2C_SCHEDULER_H
@@ -0,0 +1,74 @@
+#include "input_queue.h"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+
+#define TAG "InputQueue"
+#define INPUT_QUEUE_LENGTH 32
+
+QueueHandle_t InputQueue::queue_ = nullptr;
+
+InputQueue::InputQueue() {
+    queue_ = xQueueCreate(INPUT_QUEUE_LENGTH, sizeof(Event));
+    // Above the application tasks, the callbacks only schedule work
+    xTaskCreate([](void* arg) {
+        static_cast<InputQueue*>(arg)->Run();
+    }, "input", 4096, this, 10, nullptr);
+}
+
+void InputQueue::Register(InputHandler* handler) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    handlers_.push_back(handler);
+}
+
+void InputQueue::Unregister(InputHandler* handler) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    handlers_.erase(std::remove(handlers_.begin(), handlers_.end(), handler), handlers_.end());
+}
+
+bool IRAM_ATTR InputQueue::PostFromIsr(InputHandler* handler, int32_t value) {
+    Event event = {handler, value, esp_timer_get_time()};
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(queue_, &event, &woken);
+    return woken == pdTRUE;
+}
+
+void InputQueue::Run() {
+    while (true) {
+        TickType_t timeout = portMAX_DELAY;
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            int64_t next_us = 0;
+            for (auto handler : handlers_) {
+                if (handler->deadline_us != 0 && (next_us == 0 || handler->deadline_us < next_us)) {
+                    next_us = handler->deadline_us;
+                }
+            }
+            if (next_us != 0) {
+                int64_t wait_us = std::max<int64_t>(next_us - esp_timer_get_time(), 0);
+                // Round up, so the deadline has passed when the wait ends
+                timeout = (TickType_t)((wait_us / 1000 + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+            }
+        }
+
+        Event event;
+        bool received = xQueueReceive(queue_, &event, timeout) == pdTRUE;
+
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (received && std::find(handlers_.begin(), handlers_.end(), event.handler) != handlers_.end()) {
+            event.handler->OnInput(event.value, event.time_us);
+        }
+        int64_t now_us = esp_timer_get_time();
+        // By index, a callback may add or remove handlers
+        for (size_t i = 0; i < handlers_.size(); i++) {
+            auto handler = handlers_[i];
+            if (handler->deadline_us != 0 && handler->deadline_us <= now_us) {
+                handler->deadline_us = 0;
+                handler->OnDeadline(now_us);
+            }
+        }
+    }
+}
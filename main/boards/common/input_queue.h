@@ -0,0 +1,59 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * Something fed by an interrupt, handled on the input task. deadline_us asks for an
+ * OnDeadline() call at that esp_timer_get_time(), 0 for none.
+ */
+class InputHandler {
+public:
+    virtual ~InputHandler() = default;
+    virtual void OnInput(int32_t value, int64_t time_us) = 0;
+    virtual void OnDeadline(int64_t now_us) {}
+
+    int64_t deadline_us = 0;
+};
+
+/*
+ * One task for the buttons and knobs of the board, woken by their interrupts through a queue.
+ * It sleeps on the queue until the nearest deadline of a handler (a debounce, a long press or
+ * the end of a click sequence) or forever, so idle inputs cost no wakeups.
+ */
+class InputQueue {
+public:
+    static InputQueue& GetInstance() {
+        static InputQueue instance;
+        return instance;
+    }
+
+    void Register(InputHandler* handler);
+    void Unregister(InputHandler* handler);
+
+    // From the interrupt of a registered handler, true if a higher priority task was woken
+    static bool PostFromIsr(InputHandler* handler, int32_t value);
+
+private:
+    struct Event {
+        InputHandler* handler;
+        int32_t value;
+        int64_t time_us;
+    };
+
+    static QueueHandle_t queue_;
+    // Recursive, a callback may create or delete a button
+    std::recursive_mutex mutex_;
+    std::vector<InputHandler*> handlers_;
+
+    InputQueue();
+    void Run();
+};
+
+#endif // INPUT_QUEUE_H
@@ -0,0 +1,95 @@
+#include "jpeg_chunk_pool.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "JpegChunkPool"
+
+JpegChunkPool::JpegChunkPool(size_t chunk_count, size_t chunk_size) : chunk_size_(chunk_size) {
+    encode_start_us_ = esp_timer_get_time();
+    buffer_ = (uint8_t*)heap_caps_aligned_alloc(16, chunk_count * chunk_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u chunks of %u bytes", (unsigned)chunk_count, (unsigned)chunk_size);
+        return;
+    }
+    free_queue_ = xQueueCreate(chunk_count, sizeof(uint8_t*));
+    // One more entry for the end of the stream
+    filled_queue_ = xQueueCreate(chunk_count + 1, sizeof(JpegChunk));
+    for (size_t i = 0; i < chunk_count; i++) {
+        uint8_t* data = buffer_ + i * chunk_size;
+        xQueueSend(free_queue_, &data, 0);
+    }
+}
+
+JpegChunkPool::~JpegChunkPool() {
+    if (free_queue_ != nullptr) {
+        vQueueDelete(free_queue_);
+    }
+    if (filled_queue_ != nullptr) {
+        vQueueDelete(filled_queue_);
+    }
+    heap_caps_free(buffer_);
+}
+
+void JpegChunkPool::Write(const void* data, size_t len) {
+    auto src = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        if (current_.data == nullptr) {
+            int64_t wait_start = esp_timer_get_time();
+            xQueueReceive(free_queue_, &current_.data, portMAX_DELAY);
+            backpressure_us_ += esp_timer_get_time() - wait_start;
+            current_.len = 0;
+        }
+        size_t n = std::min(len, chunk_size_ - current_.len);
+        memcpy(current_.data + current_.len, src, n);
+        current_.len += n;
+        src += n;
+        len -= n;
+        if (current_.len == chunk_size_) {
+            xQueueSend(filled_queue_, &current_, portMAX_DELAY);
+            current_ = {nullptr, 0};
+        }
+    }
+}
+
+void JpegChunkPool::Finish(bool ok) {
+    if (current_.data != nullptr) {
+        xQueueSend(filled_queue_, &current_, portMAX_DELAY);
+        current_ = {nullptr, 0};
+    }
+    encoded_ok_ = ok;
+    encode_end_us_ = esp_timer_get_time();
+    JpegChunk end = {nullptr, 0};
+    xQueueSend(filled_queue_, &end, portMAX_DELAY);
+}
+
+bool JpegChunkPool::Receive(JpegChunk& chunk) {
+    if (xQueueReceive(filled_queue_, &chunk, portMAX_DELAY) != pdPASS) {
+        return false;
+    }
+    return chunk.data != nullptr;
+}
+
+void JpegChunkPool::Release(const JpegChunk& chunk) {
+    xQueueSend(free_queue_, &chunk.data, portMAX_DELAY);
+}
+
+void JpegChunkPool::Drain() {
+    JpegChunk chunk;
+    while (Receive(chunk)) {
+        Release(chunk);
+    }
+}
+
+void JpegChunkPool::LogStats(size_t bytes_sent, int64_t send_start_us, int64_t send_end_us) const {
+    int64_t send_us = std::max<int64_t>(send_end_us - send_start_us, 1);
+    int64_t overlap_us = std::min(encode_end_us_, send_end_us) - std::max(encode_start_us_, send_start_us);
+    ESP_LOGI(TAG, "Encoded in %d ms, sent %u bytes in %d ms (%d KB/s), %d%% of the upload overlapped the encode, "
+             "encoder waited %d ms for chunks", (int)((encode_end_us_ - encode_start_us_) / 1000), (unsigned)bytes_sent,
+             (int)(send_us / 1000), (int)(bytes_sent * 1000000 / send_us / 1024),
+             (int)(std::max<int64_t>(overlap_us, 0) * 100 / send_us), (int)(backpressure_us_ / 1000));
+}
@@ -0,0 +1,61 @@
+#ifndef JPEG_CHUNK_POOL_H
+#define JPEG_CHUNK_POOL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include <cstddef>
+#include <cstdint>
+
+struct JpegChunk {
+    uint8_t* data;
+    size_t len;
+};
+
+/*
+ * Carries the JPEG output of an encoder thread to the uploader in a fixed set of reusable
+ * buffers allocated once. The encoder output is packed into full chunks, and the encoder
+ * blocks while every chunk is still waiting to be sent, so memory use is bounded by the
+ * pool whatever the network speed.
+ */
+class JpegChunkPool {
+public:
+    JpegChunkPool(size_t chunk_count = 8, size_t chunk_size = 4096);
+    ~JpegChunkPool();
+
+    bool valid() const { return buffer_ != nullptr; }
+
+    // Encoder side: copies the data into free chunks, sent as they fill up
+    void Write(const void* data, size_t len);
+    // Encoder side: sends the last partial chunk and ends the stream, false for a failed encode
+    void Finish(bool ok);
+
+    // Sender side: the next filled chunk, false once the stream ended
+    bool Receive(JpegChunk& chunk);
+    // Sender side: hands a received chunk back to the encoder
+    void Release(const JpegChunk& chunk);
+    // Sender side: releases everything up to the end, so the encoder can finish
+    void Drain();
+
+    // Valid once Receive() returned false
+    bool encoded_ok() const { return encoded_ok_; }
+    // Encode and upload time, upload throughput and how much of the upload overlapped the encode
+    void LogStats(size_t bytes_sent, int64_t send_start_us, int64_t send_end_us) const;
+    // Time the encoder waited for the uploader, above zero the network was the bottleneck
+    int64_t backpressure_us() const { return backpressure_us_; }
+
+private:
+    uint8_t* buffer_ = nullptr;
+    size_t chunk_size_;
+    QueueHandle_t free_queue_ = nullptr;
+    QueueHandle_t filled_queue_ = nullptr;
+    JpegChunk current_ = {nullptr, 0};
+    bool encoded_ok_ = false;
+    // The encoder starts right after the pool is created
+    int64_t encode_start_us_ = 0;
+    int64_t encode_end_us_ = 0;
+    // Time the encoder waited for a free chunk
+    int64_t backpressure_us_ = 0;
+};
+
+#endif // JPEG_CHUNK_POOL_H
@@ -1,52 +1,129 @@
 #include "knob.h"
 
+#include <esp_attr.h>
+
 static const char* TAG = "Knob";
 
-Knob::Knob(gpio_num_t pin_a, gpio_num_t pin_b) {
-    knob_config_t config = {
-        .default_direction = 0,
-        .gpio_encoder_a = static_cast<uint8_t>(pin_a),
-        .gpio_encoder_b = static_cast<uint8_t>(pin_b),
-    };
+// Quadrature edges per detent of the usual EC11 style encoders
+#define KNOB_STEPS_PER_DETENT 4
 
-    esp_err_t err = ESP_OK;
-    knob_handle_ = iot_knob_create(&config);
-    if (knob_handle_ == NULL) {
-        ESP_LOGE(TAG, "Failed to create knob instance");
-        return;
-    }
+Knob::Knob(gpio_num_t pin_a, gpio_num_t pin_b) : pin_a_(pin_a), pin_b_(pin_b) {
+    // The encoder contacts switch to ground
+    gpio_config_t io_conf = {
+        .pin_bit_mask = (1ULL << pin_a) | (1ULL << pin_b),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+    InputQueue::GetInstance().Register(this);
 
-    err = iot_knob_register_cb(knob_handle_, KNOB_LEFT, knob_callback, this);
+#if SOC_PCNT_SUPPORTED
+    // The count wraps to 0 at either limit, each limit is one detent
+    pcnt_unit_config_t unit_config = {
+        .low_limit = -KNOB_STEPS_PER_DETENT,
+        .high_limit = KNOB_STEPS_PER_DETENT,
+    };
+    esp_err_t err = pcnt_new_unit(&unit_config, &pcnt_unit_);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register left callback: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to create PCNT unit: %s", esp_err_to_name(err));
         return;
     }
+    pcnt_glitch_filter_config_t filter_config = {
+        .max_glitch_ns = 1000,
+    };
+    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(pcnt_unit_, &filter_config));
 
-    err = iot_knob_register_cb(knob_handle_, KNOB_RIGHT, knob_callback, this);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register right callback: %s", esp_err_to_name(err));
-        return;
-    }
+    pcnt_chan_config_t chan_a_config = {
+        .edge_gpio_num = pin_a,
+        .level_gpio_num = pin_b,
+    };
+    ESP_ERROR_CHECK(pcnt_new_channel(pcnt_unit_, &chan_a_config, &pcnt_chan_a_));
+    pcnt_chan_config_t chan_b_config = {
+        .edge_gpio_num = pin_b,
+        .level_gpio_num = pin_a,
+    };
+    ESP_ERROR_CHECK(pcnt_new_channel(pcnt_unit_, &chan_b_config, &pcnt_chan_b_));
+    // Full quadrature: both edges of both pins count, the other pin gives the direction
+    ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_a_, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE));
+    ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_a_, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
+    ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_b_, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE));
+    ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_b_, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
 
-    ESP_LOGI(TAG, "Knob initialized with pins A:%d B:%d", pin_a, pin_b);
+    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_unit_, KNOB_STEPS_PER_DETENT));
+    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_unit_, -KNOB_STEPS_PER_DETENT));
+    pcnt_event_callbacks_t callbacks = {
+        .on_reach = PcntReachCallback,
+    };
+    ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(pcnt_unit_, &callbacks, this));
+    ESP_ERROR_CHECK(pcnt_unit_enable(pcnt_unit_));
+    ESP_ERROR_CHECK(pcnt_unit_clear_count(pcnt_unit_));
+    ESP_ERROR_CHECK(pcnt_unit_start(pcnt_unit_));
+    ESP_LOGI(TAG, "Knob initialized on PCNT with pins A:%d B:%d", pin_a, pin_b);
+#else
+    state_ = (gpio_get_level(pin_a) << 1) | gpio_get_level(pin_b);
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_ERR_INVALID_STATE) {
+        ESP_ERROR_CHECK(err);
+    }
+    gpio_set_intr_type(pin_a, GPIO_INTR_ANYEDGE);
+    gpio_set_intr_type(pin_b, GPIO_INTR_ANYEDGE);
+    ESP_ERROR_CHECK(gpio_isr_handler_add(pin_a, GpioIsrHandler, this));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(pin_b, GpioIsrHandler, this));
+    ESP_LOGI(TAG, "Knob initialized on GPIO interrupts with pins A:%d B:%d", pin_a, pin_b);
+#endif
 }
 
 Knob::~Knob() {
-    if (knob_handle_ != NULL) {
-        iot_knob_delete(knob_handle_);
-        knob_handle_ = NULL;
+#if SOC_PCNT_SUPPORTED
+    if (pcnt_unit_ != nullptr) {
+        pcnt_unit_stop(pcnt_unit_);
+        pcnt_unit_disable(pcnt_unit_);
+        if (pcnt_chan_a_ != nullptr) {
+            pcnt_del_channel(pcnt_chan_a_);
+        }
+        if (pcnt_chan_b_ != nullptr) {
+            pcnt_del_channel(pcnt_chan_b_);
+        }
+        pcnt_del_unit(pcnt_unit_);
     }
+#else
+    gpio_isr_handler_remove(pin_a_);
+    gpio_isr_handler_remove(pin_b_);
+#endif
+    InputQueue::GetInstance().Unregister(this);
 }
 
 void Knob::OnRotate(std::function<void(bool)> callback) {
     on_rotate_ = callback;
 }
 
-void Knob::knob_callback(void* arg, void* data) {
-    Knob* knob = static_cast<Knob*>(data);
-    knob_event_t event = iot_knob_get_event(arg);
-    
-    if (knob->on_rotate_) {
-        knob->on_rotate_(event == KNOB_RIGHT);
+void Knob::OnInput(int32_t value, int64_t time_us) {
+    if (on_rotate_) {
+        on_rotate_(value > 0);
     }
-}
\ No newline at end of file
+}
+
+#if SOC_PCNT_SUPPORTED
+bool IRAM_ATTR Knob::PcntReachCallback(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t* edata, void* user_ctx) {
+    auto* knob = static_cast<Knob*>(user_ctx);
+    return InputQueue::PostFromIsr(knob, edata->watch_point_value > 0 ? 1 : -1);
+}
+#else
+void IRAM_ATTR Knob::GpioIsrHandler(void* arg) {
+    // Indexed by the previous and the new state of the pins, invalid transitions count 0
+    static const int8_t kTransitions[16] = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
+    auto* knob = static_cast<Knob*>(arg);
+    uint8_t state = (gpio_get_level(knob->pin_a_) << 1) | gpio_get_level(knob->pin_b_);
+    knob->quarter_steps_ += kTransitions[(knob->state_ << 2) | state];
+    knob->state_ = state;
+    if (knob->quarter_steps_ >= KNOB_STEPS_PER_DETENT || knob->quarter_steps_ <= -KNOB_STEPS_PER_DETENT) {
+        int32_t direction = knob->quarter_steps_ > 0 ? 1 : -1;
+        knob->quarter_steps_ = 0;
+        if (InputQueue::PostFromIsr(knob, direction)) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+#endif
@@ -4,9 +4,19 @@
 #include <driver/gpio.h>
 #include <functional>
 #include <esp_log.h>
-#include <iot_knob.h>
+#include <soc/soc_caps.h>
+#if SOC_PCNT_SUPPORTED
+#include <driver/pulse_cnt.h>
+#endif
 
-class Knob {
+#include "input_queue.h"
+
+/*
+ * A quadrature encoder decoded in hardware by a PCNT unit where the chip has one, otherwise
+ * from the edge interrupts of both pins. Every detent posts one step to the InputQueue, where
+ * OnRotate() runs, so a fast spin only costs an interrupt per detent and idle costs nothing.
+ */
+class Knob : private InputHandler {
 public:
     Knob(gpio_num_t pin_a, gpio_num_t pin_b);
     ~Knob();
@@ -14,12 +24,24 @@ public:
     void OnRotate(std::function<void(bool)> callback);
 
 private:
-    static void knob_callback(void* arg, void* data);
-
-    knob_handle_t knob_handle_;
     gpio_num_t pin_a_;
     gpio_num_t pin_b_;
     std::function<void(bool)> on_rotate_;
+#if SOC_PCNT_SUPPORTED
+    pcnt_unit_handle_t pcnt_unit_ = nullptr;
+    pcnt_channel_handle_t pcnt_chan_a_ = nullptr;
+    pcnt_channel_handle_t pcnt_chan_b_ = nullptr;
+
+    static bool PcntReachCallback(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t* edata, void* user_ctx);
+#else
+    // Last two-bit state of the pins and the quarter steps since the last detent
+    uint8_t state_ = 0;
+    int8_t quarter_steps_ = 0;
+
+    static void GpioIsrHandler(void* arg);
+#endif
+
+    void OnInput(int32_t value, int64_t time_us) override;
 };
 
-#endif // KNOB_H_
\ No newline at end of file
+#endif // KNOB_H_
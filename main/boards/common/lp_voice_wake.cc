@@ -0,0 +1,91 @@
+#include "lp_voice_wake.h"
+#include "resampler.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_sleep.h>
+#include <ulp_lp_core.h>
+#include <ulp_lp_core_lp_adc_shared.h>
+#include <algorithm>
+
+#include "ulp_voice_wake.h"
+
+#define TAG "LpVoiceWake"
+
+extern const uint8_t lp_voice_wake_bin_start[] asm("_binary_ulp_voice_wake_bin_start");
+extern const uint8_t lp_voice_wake_bin_end[] asm("_binary_ulp_voice_wake_bin_end");
+
+// Must match lp_voice_wake_main.c
+static const int kSampleRate = 8000;
+static const size_t kPrerollSamples = CONFIG_LP_VOICE_WAKE_PREROLL_MS * kSampleRate / 1000;
+static const uint32_t kStateDone = 2;
+
+bool LpVoiceWake::Arm() {
+    // Fails when the HP ADC driver still holds the unit, e.g. for the battery
+    esp_err_t err = lp_core_lp_adc_init(ADC_UNIT_1);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to take the LP ADC: %s", esp_err_to_name(err));
+        return false;
+    }
+    lp_core_lp_adc_chan_cfg_t channel_config = {
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    err = lp_core_lp_adc_config_channel(ADC_UNIT_1, (adc_channel_t)CONFIG_LP_VOICE_WAKE_ADC_CHANNEL, &channel_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure ADC channel %d: %s", CONFIG_LP_VOICE_WAKE_ADC_CHANNEL, esp_err_to_name(err));
+        lp_core_lp_adc_deinit(ADC_UNIT_1);
+        return false;
+    }
+
+    // Loading clears the ring and the state of a previous run
+    err = ulp_lp_core_load_binary(lp_voice_wake_bin_start, lp_voice_wake_bin_end - lp_voice_wake_bin_start);
+    if (err == ESP_OK) {
+        ulp_lp_core_cfg_t config = {
+            .wakeup_source = ULP_LP_CORE_WAKEUP_SOURCE_HP_CPU,
+        };
+        err = ulp_lp_core_run(&config);
+    }
+    if (err == ESP_OK) {
+        err = esp_sleep_enable_ulp_wakeup();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the LP core: %s", esp_err_to_name(err));
+        lp_core_lp_adc_deinit(ADC_UNIT_1);
+        return false;
+    }
+    ESP_LOGI(TAG, "Listening on ADC channel %d in deep sleep", CONFIG_LP_VOICE_WAKE_ADC_CHANNEL);
+    return true;
+}
+
+std::vector<int16_t> LpVoiceWake::TakePreroll() {
+    std::vector<int16_t> pcm;
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_ULP) {
+        return pcm;
+    }
+
+    // Usually done by now, the boot takes longer than the rest of the word
+    for (int ms = 0; ulp_state != kStateDone && ms < CONFIG_LP_VOICE_WAKE_PREROLL_MS; ms += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    ulp_lp_core_stop();
+    lp_core_lp_adc_deinit(ADC_UNIT_1);
+
+    auto ring = reinterpret_cast<volatile int16_t*>(&ulp_preroll);
+    size_t count = std::min<size_t>(ulp_preroll_count, kPrerollSamples);
+    size_t head = ulp_preroll_head % kPrerollSamples;
+    std::vector<int16_t> recorded(count);
+    for (size_t i = 0; i < count; i++) {
+        recorded[i] = ring[(head + kPrerollSamples - count + i) % kPrerollSamples];
+    }
+
+    Resampler resampler(kSampleRate, 16000, 1);
+    if (!resampler.ok()) {
+        return pcm;
+    }
+    resampler.Process(recorded, pcm);
+    ESP_LOGI(TAG, "Woken by a voice, level %lu over floor %lu, %u ms handed over",
+        ulp_onset_level, ulp_noise_floor, (unsigned)(count * 1000 / kSampleRate));
+    return pcm;
+}
@@ -0,0 +1,25 @@
+#ifndef LP_VOICE_WAKE_H
+#define LP_VOICE_WAKE_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Voice activity wakeup from deep sleep by the LP core (CONFIG_LP_VOICE_WAKE).
+ *
+ * The LP core samples an analog microphone on an LP ADC channel at 8 kHz and wakes the HP
+ * cores when the level rises well over the noise floor. It keeps recording into a ring in LP
+ * memory until the HP side takes it, so the wake word engine starts on the words that woke
+ * the device instead of missing them while it booted.
+ */
+class LpVoiceWake {
+public:
+    // Starts the detector and makes it a wakeup source, right before esp_deep_sleep_start()
+    static bool Arm();
+
+    // After a wakeup by the detector: stops it and returns the recording as 16 kHz mono,
+    // empty after any other reset
+    static std::vector<int16_t> TakePreroll();
+};
+
+#endif // LP_VOICE_WAKE_H
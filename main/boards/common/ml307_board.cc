@@ -9,6 +9,12 @@
 #include <freertos/task.h>
 #include <font_awesome.h>
 #include <utility>
+#include <cstring>
+#if CONFIG_ML307_PPP_MODE
+#include <esp_network.h>
+#include <esp_netif_ppp.h>
+#include <driver/uart.h>
+#endif
 
 static const char *TAG = "Ml307Board";
 
@@ -16,8 +22,11 @@ static const char *TAG = "Ml307Board";
 static constexpr int MODEM_DETECT_MAX_RETRIES = 30;
 // Maximum retry count for network registration
 static constexpr int NETWORK_REG_MAX_RETRIES = 6;
+// The baud rate the modem starts with, the AT mode keeps it
+static constexpr int MODEM_DEFAULT_BAUD_RATE = 921600;
 
-Ml307Board::Ml307Board(gpio_num_t tx_pin, gpio_num_t rx_pin, gpio_num_t dtr_pin) : tx_pin_(tx_pin), rx_pin_(rx_pin), dtr_pin_(dtr_pin) {
+Ml307Board::Ml307Board(gpio_num_t tx_pin, gpio_num_t rx_pin, gpio_num_t dtr_pin, gpio_num_t rts_pin, gpio_num_t cts_pin)
+    : tx_pin_(tx_pin), rx_pin_(rx_pin), dtr_pin_(dtr_pin), rts_pin_(rts_pin), cts_pin_(cts_pin) {
 }
 
 std::string Ml307Board::GetBoardType() {
@@ -68,6 +77,13 @@ void Ml307Board::NetworkTask() {
     // Notify modem detection started
     OnNetworkEvent(NetworkEvent::ModemDetecting);
 
+#if CONFIG_ML307_PPP_MODE
+    if (StartPppNetwork()) {
+        return;
+    }
+    ESP_LOGW(TAG, "PPP data mode unavailable, using AT sockets");
+#endif
+
     // Try to detect modem with retry limit
     int detect_retries = 0;
     while (detect_retries < MODEM_DETECT_MAX_RETRIES) {
@@ -131,6 +147,161 @@ void Ml307Board::NetworkTask() {
     ESP_LOGI(TAG, "ML307 ICCID: %s", iccid.c_str());
 }
 
+#if CONFIG_ML307_PPP_MODE
+bool Ml307Board::SyncPppModem() {
+    for (int i = 0; i < 5; i++) {
+        if (esp_modem_sync(dce_) == ESP_OK) {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(200));
+    }
+    return false;
+}
+
+/*
+ * Brings the modem into PPP, multiplexed with a command channel over CMUX when enabled, so lwIP
+ * carries every socket natively and they can run at the same time. The modem may still be at the
+ * higher rate from before a soft reboot, so that rate is tried first.
+ */
+bool Ml307Board::StartPppNetwork() {
+    esp_netif_init();
+    esp_event_loop_create_default();
+
+    esp_modem_dte_config_t dte_config = ESP_MODEM_DTE_DEFAULT_CONFIG();
+    dte_config.uart_config.port_num = UART_NUM_1;
+    dte_config.uart_config.tx_io_num = tx_pin_;
+    dte_config.uart_config.rx_io_num = rx_pin_;
+    dte_config.uart_config.rts_io_num = rts_pin_;
+    dte_config.uart_config.cts_io_num = cts_pin_;
+    dte_config.uart_config.flow_control = (rts_pin_ != GPIO_NUM_NC && cts_pin_ != GPIO_NUM_NC) ?
+        ESP_MODEM_FLOW_CONTROL_HW : ESP_MODEM_FLOW_CONTROL_NONE;
+    dte_config.uart_config.baud_rate = CONFIG_ML307_PPP_BAUD_RATE;
+    dte_config.uart_config.rx_buffer_size = 8192;
+    dte_config.uart_config.tx_buffer_size = 2048;
+    dte_config.dte_buffer_size = 2048;
+    esp_modem_dce_config_t dce_config = ESP_MODEM_DCE_DEFAULT_CONFIG(CONFIG_ML307_PPP_APN);
+    esp_netif_config_t netif_config = ESP_NETIF_DEFAULT_PPP();
+    ppp_netif_ = esp_netif_new(&netif_config);
+    dce_ = esp_modem_new_dev(ESP_MODEM_DCE_GENERIC, &dte_config, &dce_config, ppp_netif_);
+    if (dce_ == nullptr) {
+        esp_netif_destroy(ppp_netif_);
+        ppp_netif_ = nullptr;
+        return false;
+    }
+
+    bool synced = SyncPppModem();
+    if (!synced && CONFIG_ML307_PPP_BAUD_RATE != MODEM_DEFAULT_BAUD_RATE) {
+        uart_set_baudrate(UART_NUM_1, MODEM_DEFAULT_BAUD_RATE);
+        if (SyncPppModem()) {
+            // AT+IPR, then follow on our side
+            synced = esp_modem_set_baud(dce_, CONFIG_ML307_PPP_BAUD_RATE) == ESP_OK;
+            vTaskDelay(pdMS_TO_TICKS(100));
+            uart_set_baudrate(UART_NUM_1, CONFIG_ML307_PPP_BAUD_RATE);
+            synced = synced && SyncPppModem();
+        }
+    }
+
+    // Registration first, the data mode only makes sense once there is a network
+    bool registered = false;
+    for (int i = 0; synced && i < NETWORK_REG_MAX_RETRIES * 10 && !registered; i++) {
+        char reply[64] = {};
+        if (esp_modem_at(dce_, "AT+CEREG?", reply, 1000) == ESP_OK) {
+            registered = strstr(reply, ",1") != nullptr || strstr(reply, ",5") != nullptr;
+        }
+        if (!registered) {
+            if (i == 0) {
+                OnNetworkEvent(NetworkEvent::Connecting);
+            }
+            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+    }
+    if (!registered) {
+        esp_modem_destroy(dce_);
+        dce_ = nullptr;
+        esp_netif_destroy(ppp_netif_);
+        ppp_netif_ = nullptr;
+        return false;
+    }
+
+    char text[64] = {};
+    if (esp_modem_get_module_name(dce_, text) == ESP_OK) {
+        revision_ = text;
+    }
+    if (esp_modem_get_imei(dce_, text) == ESP_OK) {
+        imei_ = text;
+    }
+    int act = 0;
+    if (esp_modem_get_operator_name(dce_, text, &act) == ESP_OK) {
+        carrier_ = text;
+    }
+    int ber = 0;
+    esp_modem_get_signal_quality(dce_, &csq_, &ber);
+    ESP_LOGI(TAG, "ML307 Revision: %s", revision_.c_str());
+    ESP_LOGI(TAG, "ML307 IMEI: %s", imei_.c_str());
+
+    esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID, OnPppIpEvent, this);
+#if CONFIG_ML307_PPP_CMUX
+    esp_modem_dce_mode_t mode = ESP_MODEM_MODE_CMUX;
+#else
+    esp_modem_dce_mode_t mode = ESP_MODEM_MODE_DATA;
+#endif
+    if (esp_modem_set_mode(dce_, mode) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enter the data mode");
+        esp_event_handler_unregister(IP_EVENT, ESP_EVENT_ANY_ID, OnPppIpEvent);
+        esp_modem_destroy(dce_);
+        dce_ = nullptr;
+        esp_netif_destroy(ppp_netif_);
+        ppp_netif_ = nullptr;
+        return false;
+    }
+    ESP_LOGI(TAG, "PPP data mode at %d baud%s", CONFIG_ML307_PPP_BAUD_RATE,
+        dte_config.uart_config.flow_control == ESP_MODEM_FLOW_CONTROL_HW ? " with flow control" : "");
+    return true;
+}
+
+void Ml307Board::OnPppIpEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+    auto* self = static_cast<Ml307Board*>(arg);
+    if (id == IP_EVENT_PPP_GOT_IP) {
+        self->ppp_ready_ = true;
+        self->OnNetworkEvent(NetworkEvent::Connected);
+    } else if (id == IP_EVENT_PPP_LOST_IP) {
+        self->ppp_ready_ = false;
+        self->OnNetworkEvent(NetworkEvent::Disconnected);
+    }
+}
+#endif
+
+bool Ml307Board::IsNetworkReady() const {
+#if CONFIG_ML307_PPP_MODE
+    if (dce_ != nullptr) {
+        return ppp_ready_;
+    }
+#endif
+    return modem_ != nullptr && modem_->network_ready();
+}
+
+int Ml307Board::GetCsq() {
+#if CONFIG_ML307_PPP_MODE
+    if (dce_ != nullptr) {
+#if CONFIG_ML307_PPP_CMUX
+        int ber = 0;
+        esp_modem_get_signal_quality(dce_, &csq_, &ber);
+#endif
+        return csq_ == 99 ? -1 : csq_;
+    }
+#endif
+    return modem_ != nullptr ? modem_->GetCsq() : -1;
+}
+
+std::string Ml307Board::GetCarrierName() {
+#if CONFIG_ML307_PPP_MODE
+    if (dce_ != nullptr) {
+        return carrier_;
+    }
+#endif
+    return modem_ != nullptr ? modem_->GetCarrierName() : "";
+}
+
 void Ml307Board::StartNetwork() {
     // Create network initialization task and return immediately
     xTaskCreate([](void* arg) {
@@ -141,14 +312,20 @@ void Ml307Board::StartNetwork() {
 }
 
 NetworkInterface* Ml307Board::GetNetwork() {
+#if CONFIG_ML307_PPP_MODE
+    if (dce_ != nullptr) {
+        static EspNetwork network;
+        return &network;
+    }
+#endif
     return modem_.get();
 }
 
 const char* Ml307Board::GetNetworkStateIcon() {
-    if (modem_ == nullptr || !modem_->network_ready()) {
+    if (!IsNetworkReady()) {
         return FONT_AWESOME_SIGNAL_OFF;
     }
-    int csq = modem_->GetCsq();
+    int csq = GetCsq();
     if (csq == -1) {
         return FONT_AWESOME_SIGNAL_OFF;
     } else if (csq >= 0 && csq <= 9) {
@@ -169,6 +346,16 @@ std::string Ml307Board::GetBoardJson() {
     // Set the board type for OTA
     std::string board_json = std::string("{\"type\":\"" BOARD_TYPE "\",");
     board_json += "\"name\":\"" BOARD_NAME "\",";
+#if CONFIG_ML307_PPP_MODE
+    if (dce_ != nullptr) {
+        board_json += "\"revision\":\"" + revision_ + "\",";
+        board_json += "\"carrier\":\"" + carrier_ + "\",";
+        board_json += "\"csq\":\"" + std::to_string(GetCsq()) + "\",";
+        board_json += "\"imei\":\"" + imei_ + "\",";
+        board_json += "\"ppp\":true}";
+        return board_json;
+    }
+#endif
     board_json += "\"revision\":\"" + modem_->GetModuleRevision() + "\",";
     board_json += "\"carrier\":\"" + modem_->GetCarrierName() + "\",";
     board_json += "\"csq\":\"" + std::to_string(modem_->GetCsq()) + "\",";
@@ -183,7 +370,21 @@ void Ml307Board::SetPowerSaveLevel(PowerSaveLevel level) {
     (void)level;
 }
 
-std::string Ml307Board::GetDeviceStatusJson() {
+void Ml307Board::SetStandby(bool standby) {
+    // The PPP link keeps the UART busy, it is not put to sleep
+    if (modem_ == nullptr || dtr_pin_ == GPIO_NUM_NC) {
+        return;
+    }
+    if (standby) {
+        // Sleep 1 second after DTR goes high, waking up only takes DTR low again
+        modem_->SetSleepMode(true, 1);
+        modem_->GetAtUart()->SetDtrPin(true);
+    } else {
+        modem_->GetAtUart()->SetDtrPin(false);
+    }
+}
+
+std::string Ml307Board::BuildDeviceStatusJson() {
     /*
      * 返回设备状态JSON
      * 
@@ -247,8 +448,8 @@ std::string Ml307Board::GetDeviceStatusJson() {
     // Network
     auto network = cJSON_CreateObject();
     cJSON_AddStringToObject(network, "type", "cellular");
-    cJSON_AddStringToObject(network, "carrier", modem_->GetCarrierName().c_str());
-    int csq = modem_->GetCsq();
+    cJSON_AddStringToObject(network, "carrier", GetCarrierName().c_str());
+    int csq = GetCsq();
     if (csq == -1) {
         cJSON_AddStringToObject(network, "signal", "unknown");
     } else if (csq >= 0 && csq <= 14) {
@@ -2,9 +2,14 @@
 #define ML307_BOARD_H
 
 #include <memory>
+#include <atomic>
 #include <at_modem.h>
 #include "board.h"
 
+#if CONFIG_ML307_PPP_MODE
+#include <esp_modem_api.h>
+#include <esp_event.h>
+#endif
 
 class Ml307Board : public Board {
 protected:
@@ -12,10 +17,31 @@ protected:
     gpio_num_t tx_pin_;
     gpio_num_t rx_pin_;
     gpio_num_t dtr_pin_;
+    gpio_num_t rts_pin_;
+    gpio_num_t cts_pin_;
     NetworkEventCallback network_event_callback_;
 
+#if CONFIG_ML307_PPP_MODE
+    // Data mode: lwIP runs TCP/UDP over PPP, modem_ stays null
+    esp_modem_dce_t* dce_ = nullptr;
+    esp_netif_t* ppp_netif_ = nullptr;
+    std::atomic<bool> ppp_ready_{false};
+    // Read before the data mode, without CMUX there is no command channel afterwards
+    std::string revision_;
+    std::string imei_;
+    std::string carrier_;
+    int csq_ = -1;
+
+    bool StartPppNetwork();
+    bool SyncPppModem();
+    static void OnPppIpEvent(void* arg, esp_event_base_t base, int32_t id, void* data);
+#endif
+
     virtual std::string GetBoardJson() override;
 
+    int GetCsq();
+    std::string GetCarrierName();
+
     // Internal helper to trigger network event callback
     void OnNetworkEvent(NetworkEvent event, const std::string& data = "");
     
@@ -24,7 +50,9 @@ protected:
     void NetworkTask();
 
 public:
-    Ml307Board(gpio_num_t tx_pin, gpio_num_t rx_pin, gpio_num_t dtr_pin = GPIO_NUM_NC);
+    // rts_pin and cts_pin enable hardware flow control in the PPP data mode
+    Ml307Board(gpio_num_t tx_pin, gpio_num_t rx_pin, gpio_num_t dtr_pin = GPIO_NUM_NC,
+               gpio_num_t rts_pin = GPIO_NUM_NC, gpio_num_t cts_pin = GPIO_NUM_NC);
     virtual std::string GetBoardType() override;
     virtual void StartNetwork() override;
     virtual void SetNetworkEventCallback(NetworkEventCallback callback) override;
@@ -32,7 +60,15 @@ public:
     virtual const char* GetNetworkStateIcon() override;
     virtual void SetPowerSaveLevel(PowerSaveLevel level) override;
     virtual AudioCodec* GetAudioCodec() override { return nullptr; }
-    virtual std::string GetDeviceStatusJson() override;
+    virtual std::string BuildDeviceStatusJson() override;
+
+    bool IsNetworkReady() const;
+
+    /**
+     * Keep the registration but let the modem sleep on DTR while another network is in use
+     * Without a DTR pin the modem stays awake
+     */
+    void SetStandby(bool standby);
 };
 
 #endif // ML307_BOARD_H
@@ -206,7 +206,7 @@ Nt26CeregState Nt26Board::GetRegistrationState() {
     return state;
 }
 
-std::string Nt26Board::GetDeviceStatusJson() {
+std::string Nt26Board::BuildDeviceStatusJson() {
     auto& board = Board::GetInstance();
     auto root = cJSON_CreateObject();
 
@@ -0,0 +1,238 @@
+#include "power_governor.h"
+#include "application.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+
+#include <algorithm>
+
+#define TAG "PowerGovernor"
+
+// While the device is busy the idle stages are checked again this often
+#define POWER_GOVERNOR_BUSY_RECHECK_US (5 * 1000000LL)
+
+static const char* const kPowerStateNames[kPowerStateCount] = {"active", "save", "light_sleep"};
+
+PmLock::PmLock(esp_pm_lock_type_t type, const char* name) : name_(name), type_(type) {
+    auto ret = esp_pm_lock_create(type, 0, name, &handle_);
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGI(TAG, "Power management not supported, %s only counts", name);
+    } else {
+        ESP_ERROR_CHECK(ret);
+    }
+    PowerGovernor::GetInstance().RegisterLock(this);
+}
+
+PmLock::~PmLock() {
+    PowerGovernor::GetInstance().UnregisterLock(this);
+    if (handle_ != nullptr) {
+        while (count_-- > 0) {
+            esp_pm_lock_release(handle_);
+        }
+        esp_pm_lock_delete(handle_);
+    }
+}
+
+void PmLock::Acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (handle_ != nullptr) {
+        esp_pm_lock_acquire(handle_);
+    }
+    if (count_++ == 0) {
+        held_since_us_ = esp_timer_get_time();
+        acquisitions_++;
+    }
+}
+
+void PmLock::Release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ == 0) {
+        return;
+    }
+    if (handle_ != nullptr) {
+        esp_pm_lock_release(handle_);
+    }
+    if (--count_ == 0) {
+        held_us_ += esp_timer_get_time() - held_since_us_;
+    }
+}
+
+bool PmLock::held() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_ > 0;
+}
+
+int PmLock::acquisitions() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return acquisitions_;
+}
+
+int64_t PmLock::held_us() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return held_us_ + (count_ > 0 ? esp_timer_get_time() - held_since_us_ : 0);
+}
+
+PowerGovernor::PowerGovernor() {
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<PowerGovernor*>(arg)->OnTimer();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "power_governor",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_));
+    last_activity_us_ = esp_timer_get_time();
+    state_since_us_ = last_activity_us_;
+}
+
+PowerGovernor::StageId PowerGovernor::AddIdleStage(int seconds, std::function<void()> on_enter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StageId id = next_stage_id_++;
+    stages_.push_back({id, seconds, std::move(on_enter)});
+    return id;
+}
+
+void PowerGovernor::EnableIdleStage(StageId id, bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = esp_timer_get_time();
+    for (auto& stage : stages_) {
+        if (stage.id == id && stage.enabled != enabled) {
+            stage.enabled = enabled;
+            stage.entered = false;
+            // An enabled stage counts from now, like activity, the other stages keep their time
+            stage.enabled_us = now;
+        }
+    }
+    ArmTimer(now, false);
+}
+
+void PowerGovernor::RemoveIdleStage(StageId id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stages_.remove_if([id](const IdleStage& stage) {
+        return stage.id == id;
+    });
+    ArmTimer(esp_timer_get_time(), false);
+}
+
+void PowerGovernor::NotifyActivity() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = esp_timer_get_time();
+    last_activity_us_ = now;
+    for (auto& stage : stages_) {
+        stage.entered = false;
+    }
+    ArmTimer(now, false);
+}
+
+void PowerGovernor::ArmTimer(int64_t now, bool busy) {
+    int64_t next_us = INT64_MAX;
+    for (auto& stage : stages_) {
+        if (stage.enabled && !stage.entered) {
+            next_us = std::min(next_us, std::max(last_activity_us_, stage.enabled_us) + (int64_t)stage.seconds * 1000000);
+        }
+    }
+    esp_timer_stop(timer_);
+    if (next_us == INT64_MAX) {
+        return;
+    }
+    if (busy) {
+        next_us = std::min(next_us, now + POWER_GOVERNOR_BUSY_RECHECK_US);
+    }
+    esp_timer_start_once(timer_, std::max<int64_t>(next_us - now, 1000));
+}
+
+void PowerGovernor::OnTimer() {
+    std::vector<std::function<void()>> due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = esp_timer_get_time();
+        bool asleep = std::any_of(stages_.begin(), stages_.end(), [](const IdleStage& stage) {
+            return stage.enabled && stage.entered;
+        });
+        // Once asleep the later stages count on, before that the idle time starts when the device gets idle
+        if (!asleep && !Application::GetInstance().CanEnterSleepMode()) {
+            last_activity_us_ = now;
+            ArmTimer(now, true);
+            return;
+        }
+        for (auto& stage : stages_) {
+            int64_t deadline = std::max(last_activity_us_, stage.enabled_us) + (int64_t)stage.seconds * 1000000;
+            if (stage.enabled && !stage.entered && now >= deadline) {
+                stage.entered = true;
+                due.push_back(stage.on_enter);
+            }
+        }
+        ArmTimer(now, false);
+    }
+    for (auto& on_enter : due) {
+        on_enter();
+    }
+}
+
+void PowerGovernor::SetPowerState(PowerState state, int max_freq_mhz) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = esp_timer_get_time();
+        residency_us_[state_] += now - state_since_us_;
+        state_since_us_ = now;
+        state_ = state;
+    }
+
+    if (max_freq_mhz == -1 || state == kPowerStateLightSleep) {
+        return;
+    }
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = max_freq_mhz,
+        .min_freq_mhz = state == kPowerStateSave ? 40 : max_freq_mhz,
+        .light_sleep_enable = state == kPowerStateSave,
+    };
+    esp_pm_configure(&pm_config);
+}
+
+void PowerGovernor::RegisterLock(PmLock* lock) {
+    std::lock_guard<std::mutex> guard(locks_mutex_);
+    locks_.push_back(lock);
+}
+
+void PowerGovernor::UnregisterLock(PmLock* lock) {
+    std::lock_guard<std::mutex> guard(locks_mutex_);
+    locks_.erase(std::remove(locks_.begin(), locks_.end(), lock), locks_.end());
+}
+
+std::string PowerGovernor::GetStatsJson() {
+    cJSON* root = cJSON_CreateObject();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = esp_timer_get_time();
+        cJSON_AddStringToObject(root, "state", kPowerStateNames[state_]);
+        cJSON* residency = cJSON_AddObjectToObject(root, "residency_ms");
+        for (int i = 0; i < kPowerStateCount; i++) {
+            int64_t us = residency_us_[i] + (i == state_ ? now - state_since_us_ : 0);
+            cJSON_AddNumberToObject(residency, kPowerStateNames[i], us / 1000);
+        }
+        cJSON_AddNumberToObject(root, "idle_ms", (now - last_activity_us_) / 1000);
+    }
+
+    cJSON* locks = cJSON_AddArrayToObject(root, "pm_locks");
+    {
+        std::lock_guard<std::mutex> guard(locks_mutex_);
+        for (auto lock : locks_) {
+            cJSON* item = cJSON_CreateObject();
+            cJSON_AddStringToObject(item, "name", lock->name());
+            cJSON_AddStringToObject(item, "type", lock->type() == ESP_PM_CPU_FREQ_MAX ? "cpu_freq_max" :
+                                    lock->type() == ESP_PM_APB_FREQ_MAX ? "apb_freq_max" : "no_light_sleep");
+            cJSON_AddBoolToObject(item, "held", lock->held());
+            cJSON_AddNumberToObject(item, "acquisitions", lock->acquisitions());
+            cJSON_AddNumberToObject(item, "held_ms", lock->held_us() / 1000);
+            cJSON_AddItemToArray(locks, item);
+        }
+    }
+
+    char* json = cJSON_PrintUnformatted(root);
+    std::string result(json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+    return result;
+}
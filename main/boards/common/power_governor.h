@@ -0,0 +1,120 @@
+#ifndef POWER_GOVERNOR_H
+#define POWER_GOVERNOR_H
+
+#include <esp_timer.h>
+#include <esp_pm.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum PowerState {
+    kPowerStateActive,      // Full CPU frequency
+    kPowerStateSave,        // DFS down to 40 MHz with automatic light sleep
+    kPowerStateLightSleep,  // Explicit light sleep, woken by a timer or GPIO
+    kPowerStateCount,
+};
+
+/*
+ * An esp_pm lock listed in the PowerGovernor manifest, with how often and how long it was held.
+ * Without CONFIG_PM_ENABLE it only counts.
+ */
+class PmLock {
+public:
+    PmLock(esp_pm_lock_type_t type, const char* name);
+    ~PmLock();
+    PmLock(const PmLock&) = delete;
+    PmLock& operator=(const PmLock&) = delete;
+
+    void Acquire();
+    void Release();
+
+    const char* name() const { return name_; }
+    esp_pm_lock_type_t type() const { return type_; }
+    bool held();
+    int acquisitions();
+    int64_t held_us();
+
+private:
+    const char* name_;
+    esp_pm_lock_type_t type_;
+    esp_pm_lock_handle_t handle_ = nullptr;
+    std::mutex mutex_;
+    int count_ = 0;
+    int acquisitions_ = 0;
+    int64_t held_since_us_ = 0;
+    int64_t held_us_ = 0;
+};
+
+/*
+ * The one idle clock of the device. PowerSaveTimer and SleepTimer register their idle stages
+ * here instead of counting seconds on their own periodic timers: a single one shot timer is
+ * armed for the earliest stage deadline, activity only moves the deadline, so an idle device
+ * wakes up once per stage instead of every second. The stages run once Application says the
+ * device may sleep, which covers the device state, an open audio channel and audio activity.
+ *
+ * It also owns the DFS configuration of each power state, the PM lock manifest and the time
+ * spent in each state.
+ */
+class PowerGovernor {
+public:
+    static PowerGovernor& GetInstance() {
+        static PowerGovernor instance;
+        return instance;
+    }
+    PowerGovernor(const PowerGovernor&) = delete;
+    PowerGovernor& operator=(const PowerGovernor&) = delete;
+
+    using StageId = int;
+    // on_enter runs on the esp_timer task once the device was idle for seconds, again only after activity
+    StageId AddIdleStage(int seconds, std::function<void()> on_enter);
+    void EnableIdleStage(StageId id, bool enabled);
+    void RemoveIdleStage(StageId id);
+    // Starts the idle time over, e.g. on a button press or a device state change
+    void NotifyActivity();
+
+    // max_freq_mhz is the ceiling for the save state, the active state runs at it fixed
+    void SetPowerState(PowerState state, int max_freq_mhz = -1);
+    PowerState power_state() const { return state_; }
+
+    void RegisterLock(PmLock* lock);
+    void UnregisterLock(PmLock* lock);
+
+    // Milliseconds in each power state and the PM lock manifest
+    std::string GetStatsJson();
+
+private:
+    PowerGovernor();
+
+    struct IdleStage {
+        StageId id;
+        int seconds;
+        std::function<void()> on_enter;
+        bool enabled = false;
+        bool entered = false;
+        int64_t enabled_us = 0;
+    };
+
+    std::mutex mutex_;
+    std::list<IdleStage> stages_;
+    StageId next_stage_id_ = 0;
+    esp_timer_handle_t timer_ = nullptr;
+    int64_t last_activity_us_ = 0;
+
+    std::atomic<PowerState> state_{kPowerStateActive};
+    int64_t state_since_us_ = 0;
+    int64_t residency_us_[kPowerStateCount] = {};
+
+    std::mutex locks_mutex_;
+    std::vector<PmLock*> locks_;
+
+    void OnTimer();
+    // Called with mutex_ held, busy rechecks soon whether the device got idle
+    void ArmTimer(int64_t now, bool busy);
+};
+
+#endif // POWER_GOVERNOR_H
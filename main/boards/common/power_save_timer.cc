@@ -9,25 +9,29 @@
 
 PowerSaveTimer::PowerSaveTimer(int cpu_max_freq, int seconds_to_sleep, int seconds_to_shutdown)
     : cpu_max_freq_(cpu_max_freq), seconds_to_sleep_(seconds_to_sleep), seconds_to_shutdown_(seconds_to_shutdown) {
-    esp_timer_create_args_t timer_args = {
-        .callback = [](void* arg) {
-            auto self = static_cast<PowerSaveTimer*>(arg);
-            self->PowerSaveCheck();
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "power_save_timer",
-        .skip_unhandled_events = true,
-    };
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &power_save_timer_));
+    auto& governor = PowerGovernor::GetInstance();
+    if (seconds_to_sleep_ != -1) {
+        sleep_stage_ = governor.AddIdleStage(seconds_to_sleep_, [this]() {
+            EnterSleepMode();
+        });
+    }
+    if (seconds_to_shutdown_ != -1) {
+        shutdown_stage_ = governor.AddIdleStage(seconds_to_shutdown_, [this]() {
+            if (on_shutdown_request_) {
+                on_shutdown_request_();
+            }
+        });
+    }
 }
 
 PowerSaveTimer::~PowerSaveTimer() {
-    esp_timer_stop(power_save_timer_);
-    esp_timer_delete(power_save_timer_);
+    SetEnabled(false);
+    PowerGovernor::GetInstance().RemoveIdleStage(sleep_stage_);
+    PowerGovernor::GetInstance().RemoveIdleStage(shutdown_stage_);
 }
 
 void PowerSaveTimer::SetEnabled(bool enabled) {
+    auto& governor = PowerGovernor::GetInstance();
     if (enabled && !enabled_) {
         Settings settings("wifi", false);
         if (!settings.GetBool("sleep_mode", true)) {
@@ -35,12 +39,13 @@ void PowerSaveTimer::SetEnabled(bool enabled) {
             return;
         }
 
-        ticks_ = 0;
         enabled_ = enabled;
-        ESP_ERROR_CHECK(esp_timer_start_periodic(power_save_timer_, 1000000));
+        governor.EnableIdleStage(sleep_stage_, true);
+        governor.EnableIdleStage(shutdown_stage_, true);
         ESP_LOGI(TAG, "Power save timer enabled");
     } else if (!enabled && enabled_) {
-        ESP_ERROR_CHECK(esp_timer_stop(power_save_timer_));
+        governor.EnableIdleStage(sleep_stage_, false);
+        governor.EnableIdleStage(shutdown_stage_, false);
         enabled_ = enabled;
         WakeUp();
         ESP_LOGI(TAG, "Power save timer disabled");
@@ -59,64 +64,43 @@ void PowerSaveTimer::OnShutdownRequest(std::function<void()> callback) {
     on_shutdown_request_ = callback;
 }
 
-void PowerSaveTimer::PowerSaveCheck() {
-    auto& app = Application::GetInstance();
-    if (!in_sleep_mode_ && !app.CanEnterSleepMode()) {
-        ticks_ = 0;
+void PowerSaveTimer::EnterSleepMode() {
+    if (in_sleep_mode_) {
         return;
     }
+    ESP_LOGI(TAG, "Enabling power save mode");
+    in_sleep_mode_ = true;
+    if (on_enter_sleep_mode_) {
+        on_enter_sleep_mode_();
+    }
 
-    ticks_++;
-    if (seconds_to_sleep_ != -1 && ticks_ >= seconds_to_sleep_) {
-        if (!in_sleep_mode_) {
-            ESP_LOGI(TAG, "Enabling power save mode");
-            in_sleep_mode_ = true;
-            if (on_enter_sleep_mode_) {
-                on_enter_sleep_mode_();
-            }
-
-            if (cpu_max_freq_ != -1) {
-                // Disable wake word detection
-                auto& audio_service = app.GetAudioService();
-                is_wake_word_running_ = audio_service.IsWakeWordRunning();
-                if (is_wake_word_running_) {
-                    audio_service.EnableWakeWordDetection(false);
-                    vTaskDelay(pdMS_TO_TICKS(100));
-                }
-                // Disable audio input
-                auto codec = Board::GetInstance().GetAudioCodec();
-                if (codec) {
-                    codec->EnableInput(false);
-                }
-
-                esp_pm_config_t pm_config = {
-                    .max_freq_mhz = cpu_max_freq_,
-                    .min_freq_mhz = 40,
-                    .light_sleep_enable = true,
-                };
-                esp_pm_configure(&pm_config);
-            }
+    auto& app = Application::GetInstance();
+    if (cpu_max_freq_ != -1) {
+        // Disable wake word detection
+        auto& audio_service = app.GetAudioService();
+        is_wake_word_running_ = audio_service.IsWakeWordRunning();
+        if (is_wake_word_running_) {
+            audio_service.EnableWakeWordDetection(false);
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+        // Disable audio input
+        auto codec = Board::GetInstance().GetAudioCodec();
+        if (codec) {
+            codec->EnableInput(false);
         }
     }
-    if (seconds_to_shutdown_ != -1 && ticks_ >= seconds_to_shutdown_ && on_shutdown_request_) {
-        on_shutdown_request_();
-    }
+    PowerGovernor::GetInstance().SetPowerState(kPowerStateSave, cpu_max_freq_);
+    app.SetStandby(true);
 }
 
 void PowerSaveTimer::WakeUp() {
-    ticks_ = 0;
+    PowerGovernor::GetInstance().NotifyActivity();
     if (in_sleep_mode_) {
         ESP_LOGI(TAG, "Exiting power save mode");
         in_sleep_mode_ = false;
 
+        PowerGovernor::GetInstance().SetPowerState(kPowerStateActive, cpu_max_freq_);
         if (cpu_max_freq_ != -1) {
-            esp_pm_config_t pm_config = {
-                .max_freq_mhz = cpu_max_freq_,
-                .min_freq_mhz = cpu_max_freq_,
-                .light_sleep_enable = false,
-            };
-            esp_pm_configure(&pm_config);
-
             // Enable wake word detection
             auto& app = Application::GetInstance();
             auto& audio_service = app.GetAudioService();
@@ -128,5 +112,6 @@ void PowerSaveTimer::WakeUp() {
         if (on_exit_sleep_mode_) {
             on_exit_sleep_mode_();
         }
+        Application::GetInstance().SetStandby(false);
     }
 }
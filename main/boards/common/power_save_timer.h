@@ -2,9 +2,12 @@
 
 #include <functional>
 
-#include <esp_timer.h>
-#include <esp_pm.h>
+#include "power_governor.h"
 
+/*
+ * Lowers the CPU frequency with automatic light sleep after seconds_to_sleep idle and asks
+ * for a shutdown after seconds_to_shutdown, as two stages of the PowerGovernor idle clock.
+ */
 class PowerSaveTimer {
 public:
     PowerSaveTimer(int cpu_max_freq, int seconds_to_sleep = 20, int seconds_to_shutdown = -1);
@@ -17,13 +20,13 @@ public:
     void WakeUp();
 
 private:
-    void PowerSaveCheck();
+    void EnterSleepMode();
 
-    esp_timer_handle_t power_save_timer_ = nullptr;
+    PowerGovernor::StageId sleep_stage_ = -1;
+    PowerGovernor::StageId shutdown_stage_ = -1;
     bool enabled_ = false;
     bool in_sleep_mode_ = false;
     bool is_wake_word_running_ = false;
-    int ticks_ = 0;
     int cpu_max_freq_;
     int seconds_to_sleep_;
     int seconds_to_shutdown_;
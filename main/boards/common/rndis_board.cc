@@ -52,7 +52,14 @@ void RndisBoard::StartNetwork() {
      };
      ESP_ERROR_CHECK(usbh_cdc_driver_install(&config));
  
+     /* Each driver only claims a device whose descriptor has its interface class, with both
+      * installed a phone tethering over RNDIS and a modem or host offering CDC-ECM both work */
+#if CONFIG_USB_TETHERING_AUTO || CONFIG_USB_TETHERING_ECM
+     install_ecm(USB_DEVICE_VENDOR_ANY, USB_DEVICE_PRODUCT_ANY, "USB ECM0");
+#endif
+#if CONFIG_USB_TETHERING_AUTO || CONFIG_USB_TETHERING_RNDIS
      install_rndis(USB_DEVICE_VENDOR_ANY, USB_DEVICE_PRODUCT_ANY, "USB RNDIS0");
+#endif
      xEventGroupWaitBits(s_event_group, EVENT_GOT_IP_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
 }
  
@@ -67,10 +74,18 @@ void RndisBoard::iot_event_handle(void *arg, esp_event_base_t event_base, int32_
         case IOT_ETH_EVENT_STOP:
             ESP_LOGI(TAG, "IOT_ETH_EVENT_STOP");
             break;
-        case IOT_ETH_EVENT_CONNECTED:
-            ESP_LOGI(TAG, "IOT_ETH_EVENT_CONNECTED");
-            static_cast<RndisBoard*>(arg)->OnNetworkEvent(NetworkEvent::Connected);
+        case IOT_ETH_EVENT_CONNECTED: {
+            auto board = static_cast<RndisBoard*>(arg);
+            if (event_data != nullptr && board->ecm_eth_handle != nullptr &&
+                *static_cast<iot_eth_handle_t*>(event_data) == board->ecm_eth_handle) {
+                board->link_class_ = "ecm";
+            } else {
+                board->link_class_ = "rndis";
+            }
+            ESP_LOGI(TAG, "IOT_ETH_EVENT_CONNECTED, %s", board->link_class_);
+            board->OnNetworkEvent(NetworkEvent::Connected);
             break;
+        }
         case IOT_ETH_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "IOT_ETH_EVENT_DISCONNECTED");
             xEventGroupClearBits(static_cast<RndisBoard*>(arg)->s_event_group, EVENT_GOT_IP_BIT);
@@ -115,35 +130,59 @@ void RndisBoard::SetNetworkEventCallback(NetworkEventCallback callback) {
     network_event_callback_ = std::move(callback);
 }
 
-void RndisBoard::install_rndis(uint16_t idVendor, uint16_t idProduct, const char *netif_name)
+static usb_device_match_id_t *new_match_id_list(uint16_t idVendor, uint16_t idProduct)
 {
-    esp_err_t ret = ESP_OK;
-    iot_eth_handle_t eth_handle = nullptr;
-    iot_eth_netif_glue_handle_t glue = nullptr;
-
+    // Kept by the driver for as long as it is installed
     usb_device_match_id_t *dev_match_id = (usb_device_match_id_t*)calloc(2, sizeof(usb_device_match_id_t));
     dev_match_id[0].match_flags = USB_DEVICE_ID_MATCH_VID_PID;
     dev_match_id[0].idVendor = idVendor;
     dev_match_id[0].idProduct = idProduct;
     memset(&dev_match_id[1], 0, sizeof(usb_device_match_id_t)); // end of list
+    return dev_match_id;
+}
+
+void RndisBoard::install_rndis(uint16_t idVendor, uint16_t idProduct, const char *netif_name)
+{
     iot_usbh_rndis_config_t rndis_cfg = {
-        .match_id_list = dev_match_id,
+        .match_id_list = new_match_id_list(idVendor, idProduct),
     };
 
-    ret = iot_eth_new_usb_rndis(&rndis_cfg, &rndis_eth_driver);
+    esp_err_t ret = iot_eth_new_usb_rndis(&rndis_cfg, &rndis_eth_driver);
     if (ret != ESP_OK || rndis_eth_driver == NULL) {
         ESP_LOGE(TAG, "Failed to create USB RNDIS driver");
         return;
     }
+    rndis_eth_handle = install_eth(rndis_eth_driver, netif_name, &s_rndis_netif);
+}
+
+void RndisBoard::install_ecm(uint16_t idVendor, uint16_t idProduct, const char *netif_name)
+{
+    iot_usbh_ecm_config_t ecm_cfg = {
+        .match_id_list = new_match_id_list(idVendor, idProduct),
+    };
+
+    esp_err_t ret = iot_eth_new_usb_ecm(&ecm_cfg, &ecm_eth_driver);
+    if (ret != ESP_OK || ecm_eth_driver == NULL) {
+        ESP_LOGE(TAG, "Failed to create USB ECM driver");
+        return;
+    }
+    ecm_eth_handle = install_eth(ecm_eth_driver, netif_name, &s_ecm_netif);
+}
+
+iot_eth_handle_t RndisBoard::install_eth(iot_eth_driver_t *driver, const char *netif_name, esp_netif_t **netif)
+{
+    esp_err_t ret = ESP_OK;
+    iot_eth_handle_t eth_handle = nullptr;
+    iot_eth_netif_glue_handle_t glue = nullptr;
 
     iot_eth_config_t eth_cfg = {
-        .driver = rndis_eth_driver,
+        .driver = driver,
         .stack_input = NULL,
     };
     ret = iot_eth_install(&eth_cfg, &eth_handle);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to install USB RNDIS driver");
-        return;
+        ESP_LOGE(TAG, "Failed to install %s driver", netif_name);
+        return nullptr;
     }
 
     esp_netif_inherent_config_t _inherent_eth_config = ESP_NETIF_INHERENT_DEFAULT_ETH();
@@ -154,19 +193,20 @@ void RndisBoard::install_rndis(uint16_t idVendor, uint16_t idProduct, const char
         .driver = NULL,
         .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH,
     };
-    s_rndis_netif = esp_netif_new(&netif_cfg);
-    if (s_rndis_netif == NULL) {
+    *netif = esp_netif_new(&netif_cfg);
+    if (*netif == NULL) {
         ESP_LOGE(TAG, "Failed to create network interface");
-        return;
+        return nullptr;
     }
 
     glue = iot_eth_new_netif_glue(eth_handle);
     if (glue == NULL) {
         ESP_LOGE(TAG, "Failed to create netif glue");
-        return;
+        return nullptr;
     }
-    esp_netif_attach(s_rndis_netif, glue);
+    esp_netif_attach(*netif, glue);
     iot_eth_start(eth_handle);
+    return eth_handle;
 }
  
 
@@ -192,7 +232,7 @@ void RndisBoard::SetPowerSaveLevel(PowerSaveLevel level) {
  
 }
 
-std::string RndisBoard::GetDeviceStatusJson() {
+std::string RndisBoard::BuildDeviceStatusJson() {
     auto& board = Board::GetInstance();
     auto root = cJSON_CreateObject();
 
@@ -228,6 +268,7 @@ std::string RndisBoard::GetDeviceStatusJson() {
     // Network
     auto network = cJSON_CreateObject();
     cJSON_AddStringToObject(network, "type", "rndis");
+    cJSON_AddStringToObject(network, "usb_class", link_class_);
     cJSON_AddItemToObject(root, "network", network);
 
     // Chip temperature
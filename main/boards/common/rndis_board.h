@@ -7,6 +7,7 @@
 #include "board.h"
 #include "iot_eth.h"
 #include "iot_usbh_rndis.h"
+#include "iot_usbh_ecm.h"
 #include "iot_eth_netif_glue.h"
 #include <esp_netif.h>
 #include <esp_event.h>
@@ -18,9 +19,16 @@ class RndisBoard : public Board {
 private:
     EventGroupHandle_t s_event_group = nullptr;
     iot_eth_driver_t *rndis_eth_driver = nullptr;
+    iot_eth_driver_t *ecm_eth_driver = nullptr;
+    iot_eth_handle_t rndis_eth_handle = nullptr;
+    iot_eth_handle_t ecm_eth_handle = nullptr;
     esp_netif_t *s_rndis_netif = nullptr;
+    esp_netif_t *s_ecm_netif = nullptr;
+    const char *link_class_ = "rndis";   // Class of the device that is connected
 
     void install_rndis(uint16_t idVendor, uint16_t idProduct, const char *netif_name);
+    void install_ecm(uint16_t idVendor, uint16_t idProduct, const char *netif_name);
+    iot_eth_handle_t install_eth(iot_eth_driver_t *driver, const char *netif_name, esp_netif_t **netif);
     static void iot_event_handle(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 protected:
     NetworkEventCallback network_event_callback_ = nullptr;
@@ -66,7 +74,7 @@ public:
     virtual const char* GetNetworkStateIcon() override;
     virtual void SetPowerSaveLevel(PowerSaveLevel level) override;
     virtual AudioCodec* GetAudioCodec() override { return nullptr; }
-    virtual std::string GetDeviceStatusJson() override;
+    virtual std::string BuildDeviceStatusJson() override;
     
 };
 #endif // CONFIG_IDF_TARGET_ESP32P4 || CONFIG_IDF_TARGET_ESP32S3
@@ -0,0 +1,119 @@
+#include "servo_scheduler.h"
+
+#include <esp_log.h>
+
+#define TAG "ServoScheduler"
+
+ServoScheduler::ServoScheduler(Writer writer, size_t capacity)
+    : writer_(std::move(writer)), frames_(capacity) {
+    for (auto& position : live_) {
+        position = kHold;
+    }
+    progress_ = xSemaphoreCreateBinary();
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<ServoScheduler*>(arg)->OnTick();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "servo_scheduler",
+        .skip_unhandled_events = false
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_));
+}
+
+ServoScheduler::~ServoScheduler() {
+    esp_timer_stop(timer_);
+    esp_timer_delete(timer_);
+    vSemaphoreDelete(progress_);
+}
+
+void ServoScheduler::Push(const Frame& frame) {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (size_ < frames_.size()) {
+                frames_[(head_ + size_) % frames_.size()] = frame;
+                size_++;
+                StartTimer();
+                return;
+            }
+        }
+        xSemaphoreTake(progress_, pdMS_TO_TICKS(kTickMs * 2));
+    }
+}
+
+void ServoScheduler::WaitIdle() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (size_ == 0 && !applying_) {
+                return;
+            }
+        }
+        xSemaphoreTake(progress_, pdMS_TO_TICKS(kTickMs * 2));
+    }
+}
+
+void ServoScheduler::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ = 0;
+    xSemaphoreGive(progress_);
+}
+
+void ServoScheduler::SetLive(const Frame& frame) {
+    for (int i = 0; i < kMaxServos; i++) {
+        if (frame[i] != kHold) {
+            live_[i] = frame[i];
+        }
+    }
+    live_pending_ = true;
+    StartTimer();
+}
+
+void ServoScheduler::StartTimer() {
+    if (!running_.exchange(true)) {
+        esp_timer_start_periodic(timer_, kTickMs * 1000);
+    }
+}
+
+void ServoScheduler::OnTick() {
+    Frame frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (size_ > 0) {
+            frame = frames_[head_];
+            head_ = (head_ + 1) % frames_.size();
+            size_--;
+            if (live_pending_.exchange(false)) {
+                for (auto& position : live_) {
+                    position = kHold;
+                }
+            }
+        } else if (live_pending_.exchange(false)) {
+            for (int i = 0; i < kMaxServos; i++) {
+                frame[i] = live_[i].exchange(kHold);
+            }
+        } else {
+            // Stopped from its own callback, the next Push() or SetLive() starts it again
+            esp_timer_stop(timer_);
+            running_ = false;
+            // A live frame set meanwhile found the timer still running
+            if (live_pending_) {
+                StartTimer();
+            }
+            return;
+        }
+        applying_ = true;
+    }
+    for (int i = 0; i < kMaxServos; i++) {
+        if (frame[i] != kHold) {
+            writer_(i, frame[i]);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        applying_ = false;
+    }
+    xSemaphoreGive(progress_);
+}
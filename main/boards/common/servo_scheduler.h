@@ -0,0 +1,73 @@
+#ifndef SERVO_SCHEDULER_H
+#define SERVO_SCHEDULER_H
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*
+ * Plays servo trajectories at a fixed rate. Movement code computes the whole trajectory up
+ * front, one frame of angles per tick, and pushes it; a periodic esp_timer applies a frame
+ * every tick, so the timing no longer depends on how busy the task that planned the movement
+ * is. The timer only runs while frames are waiting.
+ */
+class ServoScheduler {
+public:
+    static constexpr int kMaxServos = 8;
+    // One PWM period of the servos, a faster update would not reach them
+    static constexpr int kTickMs = 20;
+    // A servo the frame leaves where it is
+    static constexpr int16_t kHold = INT16_MIN;
+
+    using Frame = std::array<int16_t, kMaxServos>;
+    // Called on the esp_timer task for every servo a frame moves
+    using Writer = std::function<void(int servo, int position)>;
+
+    explicit ServoScheduler(Writer writer, size_t capacity = 64);
+    ~ServoScheduler();
+
+    static Frame HoldFrame() {
+        Frame frame;
+        frame.fill(kHold);
+        return frame;
+    }
+
+    // Waits while all capacity frames are queued
+    void Push(const Frame& frame);
+    // Waits until every pushed frame was applied
+    void WaitIdle();
+    // Drops the frames not applied yet
+    void Clear();
+
+    // Lock free, for remote control at a high rate: the latest live frame is applied on the next
+    // tick without a trajectory, live frames arriving while one plays are dropped
+    void SetLive(const Frame& frame);
+
+private:
+    Writer writer_;
+    std::vector<Frame> frames_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    std::atomic<bool> running_ = false;
+    // A frame was taken and is being written
+    bool applying_ = false;
+    std::mutex mutex_;
+    // Given by the timer after every applied frame
+    SemaphoreHandle_t progress_ = nullptr;
+    esp_timer_handle_t timer_ = nullptr;
+    // Per servo, kHold once taken by a tick
+    std::array<std::atomic<int16_t>, kMaxServos> live_;
+    std::atomic<bool> live_pending_ = false;
+
+    void StartTimer();
+    void OnTick();
+};
+
+#endif // SERVO_SCHEDULER_H
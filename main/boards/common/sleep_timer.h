@@ -2,9 +2,12 @@
 
 #include <functional>
 
-#include <esp_timer.h>
-#include <esp_pm.h>
+#include "power_governor.h"
 
+/*
+ * Light sleeps with a 30 s timer wakeup after seconds_to_light_sleep idle and deep sleeps
+ * after seconds_to_deep_sleep, as two stages of the PowerGovernor idle clock.
+ */
 class SleepTimer {
 public:
     SleepTimer(int seconds_to_light_sleep = 20, int seconds_to_deep_sleep = -1);
@@ -17,11 +20,12 @@ public:
     void WakeUp();
 
 private:
-    void CheckTimer();
+    void EnterLightSleepMode();
+    void EnterDeepSleepMode();
 
-    esp_timer_handle_t sleep_timer_ = nullptr;
+    PowerGovernor::StageId light_sleep_stage_ = -1;
+    PowerGovernor::StageId deep_sleep_stage_ = -1;
     bool enabled_ = false;
-    int ticks_ = 0;
     int seconds_to_light_sleep_;
     int seconds_to_deep_sleep_;
     bool in_light_sleep_mode_ = false;
@@ -6,11 +6,17 @@
 
 #define TAG "Sy6970"
 
+#define SY6970_POLL_MS 1000
+// The charge target only changes when written
+#define SY6970_CONFIG_MAX_AGE_MS 60000
+
 Sy6970::Sy6970(i2c_master_bus_handle_t i2c_bus, uint8_t addr) : I2cDevice(i2c_bus, addr) {
+    // Status (0x0B) to battery voltage (0x0E) in one transaction
+    PollRegs(0x0B, 4, SY6970_POLL_MS);
 }
 
 int Sy6970::GetChangingStatus() {
-    return (ReadReg(0x0B) >> 3) & 0x03;
+    return (ReadRegCached(0x0B, SY6970_POLL_MS * 2) >> 3) & 0x03;
 }
 
 bool Sy6970::IsCharging() {
@@ -18,7 +24,7 @@ bool Sy6970::IsCharging() {
 }
 
 bool Sy6970::IsPowerGood() {
-    return (ReadReg(0x0B) & 0x04) != 0;
+    return (ReadRegCached(0x0B, SY6970_POLL_MS * 2) & 0x04) != 0;
 }
 
 bool Sy6970::IsChargingDone() {
@@ -26,7 +32,7 @@ bool Sy6970::IsChargingDone() {
 }
 
 int Sy6970::GetBatteryVoltage() {
-    uint8_t value = ReadReg(0x0E);
+    uint8_t value = ReadRegCached(0x0E, SY6970_POLL_MS * 2);
     value &= 0x7F;
     if (value == 0) {
         return 0;
@@ -35,7 +41,7 @@ int Sy6970::GetBatteryVoltage() {
 }
 
 int Sy6970::GetChargeTargetVoltage() {
-    uint8_t value = ReadReg(0x06);
+    uint8_t value = ReadRegCached(0x06, SY6970_CONFIG_MAX_AGE_MS);
     value = (value & 0xFC) >> 2;
     if (value > 0x30) {
         return 4608;
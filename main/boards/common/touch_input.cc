@@ -0,0 +1,86 @@
+#include "touch_input.h"
+
+#include <esp_lvgl_port.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+
+#define TAG "TouchInput"
+
+#ifndef CONFIG_TOUCH_IDLE_READ_PERIOD_MS
+#define CONFIG_TOUCH_IDLE_READ_PERIOD_MS 100
+#endif
+
+lv_indev_t* TouchInput::Add(esp_lcd_touch_handle_t touch, lv_display_t* display) {
+    if (display == nullptr) {
+        display = lv_display_get_default();
+    }
+    if (touch->config.int_gpio_num == GPIO_NUM_NC) {
+        const lvgl_port_touch_cfg_t touch_cfg = {
+            .disp = display,
+            .handle = touch,
+        };
+        return lvgl_port_add_touch(&touch_cfg);
+    }
+
+    // Never freed, like the indev it drives
+    auto self = new TouchInput(touch);
+    touch->config.user_data = self;
+    if (esp_lcd_touch_register_interrupt_callback(touch, OnInterrupt) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to hook the INT pin %d, polling the touch controller", touch->config.int_gpio_num);
+        touch->config.user_data = nullptr;
+        delete self;
+        const lvgl_port_touch_cfg_t touch_cfg = {
+            .disp = display,
+            .handle = touch,
+        };
+        return lvgl_port_add_touch(&touch_cfg);
+    }
+
+    lvgl_port_lock(0);
+    lv_indev_t* indev = lv_indev_create();
+    lv_indev_set_type(indev, LV_INDEV_TYPE_POINTER);
+    lv_indev_set_read_cb(indev, Read);
+    lv_indev_set_display(indev, display);
+    lv_indev_set_driver_data(indev, self);
+    lvgl_port_unlock();
+    ESP_LOGI(TAG, "Touch read on INT pin %d", touch->config.int_gpio_num);
+    return indev;
+}
+
+void IRAM_ATTR TouchInput::OnInterrupt(esp_lcd_touch_handle_t touch) {
+    auto self = static_cast<TouchInput*>(touch->config.user_data);
+    if (self != nullptr) {
+        self->interrupted_.store(true, std::memory_order_relaxed);
+    }
+}
+
+void TouchInput::SetIdle(lv_indev_t* indev, bool idle) {
+    if (idle_ != idle) {
+        idle_ = idle;
+        lv_timer_set_period(lv_indev_get_read_timer(indev), idle ? CONFIG_TOUCH_IDLE_READ_PERIOD_MS : LV_DEF_REFR_PERIOD);
+    }
+}
+
+void TouchInput::Read(lv_indev_t* indev, lv_indev_data_t* data) {
+    auto self = static_cast<TouchInput*>(lv_indev_get_driver_data(indev));
+    bool interrupted = self->interrupted_.exchange(false, std::memory_order_relaxed);
+    if (!self->pressed_ && !interrupted) {
+        data->point = self->last_point_;
+        data->state = LV_INDEV_STATE_RELEASED;
+        self->SetIdle(indev, true);
+        return;
+    }
+    self->SetIdle(indev, false);
+
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint8_t count = 0;
+    esp_lcd_touch_read_data(self->touch_);
+    bool touched = esp_lcd_touch_get_coordinates(self->touch_, &x, &y, nullptr, &count, 1) && count > 0;
+    if (touched) {
+        self->last_point_ = {(int32_t)x, (int32_t)y};
+    }
+    self->pressed_ = touched;
+    data->point = self->last_point_;
+    data->state = touched ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+}
@@ -0,0 +1,36 @@
+#ifndef TOUCH_INPUT_H
+#define TOUCH_INPUT_H
+
+#include <esp_lcd_touch.h>
+#include <lvgl.h>
+
+#include <atomic>
+
+/*
+ * The LVGL pointer device of an esp_lcd_touch controller, read over I2C only when its INT pin
+ * fired or while the screen is touched. Untouched, the read callback returns at once and the
+ * read timer slows to CONFIG_TOUCH_IDLE_READ_PERIOD_MS, so the LVGL task sleeps and the codec
+ * and PMIC have the shared bus to themselves. While touched it reads every period until a read
+ * finds no point, which also catches controllers that send no interrupt on release.
+ * A controller without an INT pin is polled by lvgl_port_add_touch() as before.
+ */
+class TouchInput {
+public:
+    // Registers the pointer device of touch on display, the default display if nullptr
+    static lv_indev_t* Add(esp_lcd_touch_handle_t touch, lv_display_t* display = nullptr);
+
+private:
+    explicit TouchInput(esp_lcd_touch_handle_t touch) : touch_(touch) {}
+
+    esp_lcd_touch_handle_t touch_;
+    std::atomic<bool> interrupted_{false};
+    bool pressed_ = false;
+    bool idle_ = false;
+    lv_point_t last_point_ = {0, 0};
+
+    static void OnInterrupt(esp_lcd_touch_handle_t touch);
+    static void Read(lv_indev_t* indev, lv_indev_data_t* data);
+    void SetIdle(lv_indev_t* indev, bool idle);
+};
+
+#endif // TOUCH_INPUT_H
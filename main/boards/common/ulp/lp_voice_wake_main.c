@@ -0,0 +1,114 @@
+/*
+ * LP core program of LpVoiceWake (boards/common/lp_voice_wake.cc).
+ *
+ * Samples an analog microphone on an LP ADC channel at about 8 kHz while the HP cores deep
+ * sleep. The DC is removed and the mean absolute level of every 8 ms block is compared with a
+ * slowly tracked noise floor, three loud blocks in a row wake the HP cores. Recording goes on
+ * after the wakeup until the ring holds PREROLL_LEAD_SAMPLES before the onset and the rest of
+ * the word, then the program halts and the HP side takes the ring.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+#include "riscv/csr.h"
+#include "ulp_lp_core_utils.h"
+#include "ulp_lp_core_lp_adc_shared.h"
+
+#define SAMPLE_RATE 8000
+#define PREROLL_SAMPLES (CONFIG_LP_VOICE_WAKE_PREROLL_MS * SAMPLE_RATE / 1000)
+#define PREROLL_LEAD_SAMPLES (PREROLL_SAMPLES / 4)
+#define BLOCK_SAMPLES 64
+#define ACTIVE_BLOCKS 3
+// Keeps a dead quiet room from triggering on a single LSB of noise
+#define MIN_LEVEL 8
+
+// The rough LP clock the lp_core utils delay with
+#if CONFIG_IDF_TARGET_ESP32C5
+#define LP_CORE_CPU_HZ 48000000
+#else
+#define LP_CORE_CPU_HZ 16000000
+#endif
+
+enum {
+    kStateListening = 0,
+    kStateRecording = 1,
+    kStateDone = 2,
+};
+
+// Shared with the HP cores as ulp_*
+int16_t preroll[PREROLL_SAMPLES];
+uint32_t preroll_head;
+uint32_t preroll_count;
+uint32_t state;
+uint32_t noise_floor;
+uint32_t onset_level;
+
+int main(void)
+{
+    const uint32_t period = LP_CORE_CPU_HZ / SAMPLE_RATE;
+    int32_t dc = -1;
+    uint32_t sum = 0;
+    uint32_t block = 0;
+    uint32_t active = 0;
+    uint32_t recorded = 0;
+    uint32_t deadline = RV_READ_CSR(mcycle);
+
+    while (true) {
+        deadline += period;
+        while ((int32_t)(RV_READ_CSR(mcycle) - deadline) < 0) {
+        }
+
+        int raw;
+        if (lp_core_lp_adc_read_channel_raw(ADC_UNIT_1, CONFIG_LP_VOICE_WAKE_ADC_CHANNEL, &raw) != ESP_OK) {
+            continue;
+        }
+        // 12 bit samples in Q4, the DC is a running mean of about 4 ms
+        int32_t x = raw << 4;
+        if (dc < 0) {
+            dc = x << 5;
+        }
+        dc += x - (dc >> 5);
+        x -= dc >> 5;
+        x = x > 32767 ? 32767 : x < -32768 ? -32768 : x;
+
+        preroll[preroll_head] = (int16_t)x;
+        preroll_head = preroll_head + 1 == PREROLL_SAMPLES ? 0 : preroll_head + 1;
+        if (preroll_count < PREROLL_SAMPLES) {
+            preroll_count++;
+        }
+
+        if (state == kStateRecording) {
+            if (++recorded >= PREROLL_SAMPLES - PREROLL_LEAD_SAMPLES) {
+                state = kStateDone;
+                ulp_lp_core_halt();
+            }
+            continue;
+        }
+
+        sum += x < 0 ? -x : x;
+        if (++block < BLOCK_SAMPLES) {
+            continue;
+        }
+        uint32_t level = sum / BLOCK_SAMPLES;
+        sum = 0;
+        block = 0;
+
+        if (level * 100 > (noise_floor + MIN_LEVEL) * CONFIG_LP_VOICE_WAKE_THRESHOLD) {
+            if (++active >= ACTIVE_BLOCKS && preroll_count >= PREROLL_LEAD_SAMPLES) {
+                onset_level = level;
+                state = kStateRecording;
+                ulp_lp_core_wakeup_main_processor();
+            }
+            continue;
+        }
+        active = 0;
+        // Down in about 64 ms, up in about 2 s, so speech does not raise the floor
+        if (level < noise_floor) {
+            noise_floor -= (noise_floor - level + 7) >> 3;
+        } else {
+            noise_floor += (level - noise_floor + 255) >> 8;
+        }
+    }
+    return 0;
+}
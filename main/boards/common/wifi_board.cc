@@ -9,8 +9,13 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <esp_network.h>
+#include <esp_wifi.h>
 #include <esp_log.h>
+#include <cstring>
 #include <utility>
+#if CONFIG_WIFI_TARGET_WAKE_TIME
+#include <esp_wifi_he.h>
+#endif
 
 #include <font_awesome.h>
 #include <wifi_manager.h>
@@ -25,6 +30,8 @@ static const char *TAG = "WifiBoard";
 
 // Connection timeout in seconds
 static constexpr int CONNECT_TIMEOUT_SEC = 60;
+// How long the cached access point gets before falling back to a scan
+static constexpr int FAST_CONNECT_TIMEOUT_MS = 3000;
 
 WifiBoard::WifiBoard() {
     // Create connection timeout timer
@@ -36,6 +43,19 @@ WifiBoard::WifiBoard() {
         .skip_unhandled_events = true
     };
     esp_timer_create(&timer_args, &connect_timer_);
+
+    esp_timer_create_args_t fast_timer_args = {
+        .callback = [](void* arg) {
+            auto* board = static_cast<WifiBoard*>(arg);
+            ESP_LOGW(TAG, "Fast connect timed out, scanning");
+            board->FinishFastConnect(false);
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_fast_connect",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&fast_timer_args, &fast_connect_timer_);
 }
 
 WifiBoard::~WifiBoard() {
@@ -43,6 +63,10 @@ WifiBoard::~WifiBoard() {
         esp_timer_stop(connect_timer_);
         esp_timer_delete(connect_timer_);
     }
+    if (fast_connect_timer_) {
+        esp_timer_stop(fast_connect_timer_);
+        esp_timer_delete(fast_connect_timer_);
+    }
 }
 
 std::string WifiBoard::GetBoardType() {
@@ -95,7 +119,11 @@ void WifiBoard::TryWifiConnect() {
         // Start connection attempt with timeout
         ESP_LOGI(TAG, "Starting WiFi connection attempt");
         esp_timer_start_once(connect_timer_, CONNECT_TIMEOUT_SEC * 1000000ULL);
+        connect_start_us_ = esp_timer_get_time();
         WifiManager::GetInstance().StartStation();
+        StartFastConnect();
+    } else if (!config_mode_fallback_) {
+        ESP_LOGI(TAG, "No SSID configured, WiFi stays off");
     } else {
         // No SSID configured, enter config mode
         // Wait for the board version to be shown
@@ -115,6 +143,21 @@ void WifiBoard::OnNetworkEvent(NetworkEvent event, const std::string& data) {
 #endif
             in_config_mode_ = false;
             ESP_LOGI(TAG, "Connected to WiFi: %s", data.c_str());
+            if (connect_start_us_ != 0) {
+                int elapsed_ms = (int)((esp_timer_get_time() - connect_start_us_) / 1000);
+                bool fast = fast_connecting_.load();
+                ESP_LOGI(TAG, "Associated in %d ms%s", elapsed_ms, fast ? " (fast connect)" : "");
+                if (!connected_once_) {
+                    BootProfile::Mark("wifi_connected");
+                    BootProfile::Record(fast ? "wifi_fast_connect" : "wifi_scan_connect", elapsed_ms);
+                } else {
+                    BootProfile::Record("wifi_reconnect", elapsed_ms);
+                }
+                connect_start_us_ = 0;
+            }
+            connected_once_ = true;
+            FinishFastConnect(true);
+            SaveFastConnect();
             break;
         case NetworkEvent::Scanning:
             ESP_LOGI(TAG, "WiFi scanning");
@@ -124,6 +167,13 @@ void WifiBoard::OnNetworkEvent(NetworkEvent event, const std::string& data) {
             break;
         case NetworkEvent::Disconnected:
             ESP_LOGW(TAG, "WiFi disconnected");
+            if (fast_connecting_) {
+                ESP_LOGW(TAG, "Cached access point refused, scanning");
+                FinishFastConnect(false);
+            } else if (connect_start_us_ == 0) {
+                // Time the recovery, whether a roam or a reconnect to the same access point
+                connect_start_us_ = esp_timer_get_time();
+            }
             break;
         case NetworkEvent::WifiConfigModeEnter:
             ESP_LOGI(TAG, "WiFi config mode entered");
@@ -145,12 +195,101 @@ void WifiBoard::OnNetworkEvent(NetworkEvent event, const std::string& data) {
     }
 }
 
+bool WifiBoard::StartFastConnect() {
+    Settings settings("wifi_fast");
+    std::string ssid = settings.GetString("ssid");
+    std::string bssid = settings.GetString("bssid");
+    int channel = settings.GetInt("channel");
+    if (ssid.empty() || bssid.size() != 12 || channel <= 0) {
+        return false;
+    }
+
+    // The cache is only trusted for a network that is still configured
+    const std::string* password = nullptr;
+    const auto& ssid_list = SsidManager::GetInstance().GetSsidList();
+    for (auto& item : ssid_list) {
+        if (item.ssid == ssid) {
+            password = &item.password;
+            break;
+        }
+    }
+    if (password == nullptr) {
+        return false;
+    }
+
+    wifi_config_t wifi_config = {};
+    strncpy((char*)wifi_config.sta.ssid, ssid.c_str(), sizeof(wifi_config.sta.ssid));
+    strncpy((char*)wifi_config.sta.password, password->c_str(), sizeof(wifi_config.sta.password));
+    for (int i = 0; i < 6; i++) {
+        wifi_config.sta.bssid[i] = (uint8_t)strtol(bssid.substr(i * 2, 2).c_str(), nullptr, 16);
+    }
+    wifi_config.sta.bssid_set = true;
+    wifi_config.sta.channel = channel;
+    wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    wifi_config.sta.pmf_cfg.capable = true;
+
+    auto& wifi_manager = WifiManager::GetInstance();
+    wifi_manager.PauseScan();
+    esp_wifi_scan_stop();
+    fast_connecting_ = true;
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (err == ESP_OK) {
+        err = esp_wifi_connect();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Fast connect failed to start: %s", esp_err_to_name(err));
+        FinishFastConnect(false);
+        return false;
+    }
+    ESP_LOGI(TAG, "Fast connect to %s on channel %d", ssid.c_str(), channel);
+    esp_timer_start_once(fast_connect_timer_, FAST_CONNECT_TIMEOUT_MS * 1000);
+    return true;
+}
+
+void WifiBoard::FinishFastConnect(bool connected) {
+    if (!fast_connecting_.exchange(false)) {
+        return;
+    }
+    esp_timer_stop(fast_connect_timer_);
+    if (!connected) {
+        esp_wifi_disconnect();
+    }
+    // Reconnects after a later drop go through the normal scan
+    WifiManager::GetInstance().ResumeScan();
+}
+
+void WifiBoard::SaveFastConnect() {
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+    char bssid[13];
+    snprintf(bssid, sizeof(bssid), "%02x%02x%02x%02x%02x%02x", ap_info.bssid[0], ap_info.bssid[1],
+        ap_info.bssid[2], ap_info.bssid[3], ap_info.bssid[4], ap_info.bssid[5]);
+
+    // Only written when the access point changed, to spare the flash
+    Settings settings("wifi_fast", true);
+    std::string ssid(reinterpret_cast<const char*>(ap_info.ssid));
+    if (settings.GetString("ssid") == ssid && settings.GetString("bssid") == bssid &&
+        settings.GetInt("channel") == ap_info.primary) {
+        return;
+    }
+    settings.SetString("ssid", ssid);
+    settings.SetString("bssid", bssid);
+    settings.SetInt("channel", ap_info.primary);
+    ESP_LOGI(TAG, "Cached access point %s on channel %d", bssid, ap_info.primary);
+}
+
 void WifiBoard::SetNetworkEventCallback(NetworkEventCallback callback) {
     network_event_callback_ = std::move(callback);
 }
 
 void WifiBoard::OnWifiConnectTimeout(void* arg) {
     auto* board = static_cast<WifiBoard*>(arg);
+    if (!board->config_mode_fallback_) {
+        ESP_LOGW(TAG, "WiFi connection timeout, still trying");
+        return;
+    }
     ESP_LOGW(TAG, "WiFi connection timeout, entering config mode");
 
     WifiManager::GetInstance().StopStation();
@@ -297,9 +436,48 @@ void WifiBoard::SetPowerSaveLevel(PowerSaveLevel level) {
             break;
     }
     WifiManager::GetInstance().SetPowerSaveLevel(wifi_level);
+    SetTargetWakeTime(level == PowerSaveLevel::LOW_POWER);
+}
+
+void WifiBoard::SetTargetWakeTime(bool enable) {
+#if CONFIG_WIFI_TARGET_WAKE_TIME
+    // The agreement does not survive a reconnect
+    if (!WifiManager::GetInstance().IsConnected()) {
+        twt_active_ = false;
+        return;
+    }
+    if (enable == twt_active_) {
+        return;
+    }
+    if (!enable) {
+        esp_wifi_sta_itwt_teardown(0);
+        twt_active_ = false;
+        return;
+    }
+    // The wake interval is mantissa * 2^exponent microseconds
+    int exponent = 10;
+    wifi_itwt_setup_config_t setup_config = {};
+    setup_config.setup_cmd = TWT_REQUEST;
+    setup_config.trigger = 1;
+    setup_config.flow_type = 0;
+    setup_config.flow_id = 0;
+    setup_config.wake_invl_expn = exponent;
+    setup_config.wake_invl_mant = (uint16_t)(CONFIG_WIFI_TARGET_WAKE_INTERVAL_MS * 1000 >> exponent);
+    setup_config.min_wake_dura = 255;
+    setup_config.timeout_time_ms = 5000;
+    esp_err_t err = esp_wifi_sta_itwt_setup(&setup_config);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Target wake time refused: %s", esp_err_to_name(err));
+        return;
+    }
+    twt_active_ = true;
+    ESP_LOGI(TAG, "Target wake time every %d ms", CONFIG_WIFI_TARGET_WAKE_INTERVAL_MS);
+#else
+    (void)enable;
+#endif
 }
 
-std::string WifiBoard::GetDeviceStatusJson() {
+std::string WifiBoard::BuildDeviceStatusJson() {
     auto& board = Board::GetInstance();
     auto root = cJSON_CreateObject();
 
@@ -6,10 +6,22 @@
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
 
+#include <atomic>
+
 class WifiBoard : public Board {
 protected:
     esp_timer_handle_t connect_timer_ = nullptr;
+    esp_timer_handle_t fast_connect_timer_ = nullptr;
+    // Connecting straight to the cached access point, the scan is paused meanwhile
+    std::atomic<bool> fast_connecting_{false};
+    // When the current association attempt started, for the boot profile
+    int64_t connect_start_us_ = 0;
+    bool connected_once_ = false;
+    // Without it a missing SSID or a connect timeout only logs, used for a standby network
+    bool config_mode_fallback_ = true;
     bool in_config_mode_ = false;
+    // An individual TWT agreement is set up while in the low power level
+    bool twt_active_ = false;
     NetworkEventCallback network_event_callback_ = nullptr;
 
     virtual std::string GetBoardJson() override;
@@ -36,6 +48,27 @@ protected:
      */
     static void OnWifiConnectTimeout(void* arg);
 
+    /**
+     * Connect to the access point of the last session by BSSID and channel, skipping the scan
+     * @return false when nothing usable is cached and the normal scan goes on
+     */
+    bool StartFastConnect();
+
+    /**
+     * End the fast connect attempt, resuming the scan when it failed
+     */
+    void FinishFastConnect(bool connected);
+
+    /**
+     * Remember the access point of this connection for the next fast connect
+     */
+    void SaveFastConnect();
+
+    /**
+     * Set up or tear down the Wi-Fi 6 target wake time agreement
+     */
+    void SetTargetWakeTime(bool enable);
+
 public:
     WifiBoard();
     virtual ~WifiBoard();
@@ -53,7 +86,7 @@ public:
     virtual const char* GetNetworkStateIcon() override;
     virtual void SetPowerSaveLevel(PowerSaveLevel level) override;
     virtual AudioCodec* GetAudioCodec() override { return nullptr; }
-    virtual std::string GetDeviceStatusJson() override;
+    virtual std::string BuildDeviceStatusJson() override;
     
     /**
      * Enter WiFi configuration mode (thread-safe, can be called from any task)
@@ -64,6 +97,11 @@ public:
      * Check if in WiFi config mode
      */
     bool IsInWifiConfigMode() const;
+
+    /**
+     * Whether a missing SSID or a connect timeout enters the config mode, call before StartNetwork()
+     */
+    void SetConfigModeFallback(bool enable) { config_mode_fallback_ = enable; }
 };
 
 #endif // WIFI_BOARD_H
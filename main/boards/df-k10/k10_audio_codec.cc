@@ -1,9 +1,11 @@
 #include "k10_audio_codec.h"
+#include "audio_dsp.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
 #include <driver/i2s_tdm.h>
 #include <cmath>
+#include <algorithm>
 
 static const char TAG[] = "K10AudioCodec";
 
@@ -15,6 +17,7 @@ K10AudioCodec::K10AudioCodec(void* i2c_master_handle, int input_sample_rate, int
     input_channels_ = input_reference_ ? 2 : 1; // 输入通道数
     input_sample_rate_ = input_sample_rate;
     output_sample_rate_ = output_sample_rate;
+    output_headroom_ = 4; // 单声道 16 位 -> 双声道 32 位
 
     CreateDuplexChannels(mclk, bclk, ws, dout, din);
 
@@ -200,27 +203,23 @@ int K10AudioCodec::Read(int16_t* dest, int samples) {
 }
 
 int K10AudioCodec::Write(const int16_t* data, int samples) {
+    output_buffer_.resize(samples * output_headroom_);
+    std::copy(data, data + samples, output_buffer_.begin());
+    return WriteInPlace(output_buffer_.data(), samples);
+}
+
+int K10AudioCodec::WriteInPlace(int16_t* data, int samples) {
     if (output_enabled_) {
-        std::vector<int32_t> buffer(samples * 2);  // Allocate buffer for 2x samples
+        // Expand to 2x 32-bit slots in place, from the end so no sample is overwritten before it is read
+        int32_t* buffer = (int32_t*)data;
 
         // Apply volume adjustment (same as before)
         int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-        for (int i = 0; i < samples; i++) {
-            int64_t temp = int64_t(data[i]) * volume_factor;
-            if (temp > INT32_MAX) {
-            buffer[i * 2] = INT32_MAX;
-            } else if (temp < INT32_MIN) {
-            buffer[i * 2] = INT32_MIN;
-            } else {
-            buffer[i * 2] = static_cast<int32_t>(temp);
-            }
-
-            // Repeat each sample for slow playback (assuming mono audio)
-            buffer[i * 2 + 1] = buffer[i * 2];
-        }
+        // Repeat each sample for slow playback (assuming mono audio)
+        audio_dsp::ScaleToS32(buffer, data, samples, volume_factor, 2);
 
         size_t bytes_written;
-        ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * 2 * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+        ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer, samples * 2 * sizeof(int32_t), &bytes_written, portMAX_DELAY));
         return bytes_written / sizeof(int32_t);
     }
     return samples;
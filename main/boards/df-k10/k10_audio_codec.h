@@ -17,11 +17,13 @@ private:
 
     esp_codec_dev_handle_t output_dev_ = nullptr;
     esp_codec_dev_handle_t input_dev_ = nullptr;
+    std::vector<int16_t> output_buffer_;
 
     void CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din);
 
     virtual int Read(int16_t* dest, int samples) override;
     virtual int Write(const int16_t* data, int samples) override;
+    virtual int WriteInPlace(int16_t* data, int samples) override;
 
 public:
     K10AudioCodec(void* i2c_master_handle, int input_sample_rate, int output_sample_rate,
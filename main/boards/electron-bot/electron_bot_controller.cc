@@ -6,6 +6,7 @@
 #include <esp_log.h>
 
 #include <cstring>
+#include <stdexcept>
 
 #include "application.h"
 #include "board.h"
@@ -106,7 +107,11 @@ private:
                  speed, direction, amount);
 
         ElectronBotActionParams params = {action_type, steps, speed, direction, amount};
-        xQueueSend(action_queue_, &params, portMAX_DELAY);
+        // Never blocks the MCP caller, a full queue is reported to it instead
+        if (xQueueSend(action_queue_, &params, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Action queue is full");
+            throw std::runtime_error("Too many actions queued, try again later");
+        }
         StartActionTaskIfNeeded();
     }
 
@@ -7,6 +7,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "oscillator.h"
+#include "servo_scheduler.h"
 
 //-- Constants
 #define FORWARD 1
@@ -76,9 +77,8 @@ private:
     int servo_trim_[SERVO_COUNT];
     int servo_initial_[SERVO_COUNT] = {180, 180, 0, 0, 90, 90};
 
-    unsigned long final_time_;
-    unsigned long partial_time_;
-    float increment_[SERVO_COUNT];
+    // Plays the trajectories MoveServos() and OscillateServos() plan
+    ServoScheduler scheduler_;
 
     bool is_otto_resting_;
 
@@ -1,274 +1,279 @@
-#include "box_audio_codec_lite.h"
-
-#include <esp_log.h>
-#include <driver/i2c_master.h>
-#include <driver/i2s_tdm.h>
-#include <cstring>
-
-static const char TAG[] = "BoxAudioCodecLite";
-
-BoxAudioCodecLite::BoxAudioCodecLite(void* i2c_master_handle, int input_sample_rate, int output_sample_rate,
-    gpio_num_t mclk, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din,
-    gpio_num_t pa_pin, bool input_reference) {
-    duplex_ = true; // 是否双工
-    input_reference_ = input_reference; // 是否使用参考输入，实现回声消除
-    if (input_reference) {
-        ref_buffer_.resize(960 * 2);
-    }
-    input_channels_ = 2 + input_reference_; // 输入通道数
-    input_sample_rate_ = input_sample_rate;
-    output_sample_rate_ = output_sample_rate;
-
-    CreateDuplexChannels(mclk, bclk, ws, dout, din);
-
-    // Do initialize of related interface: data_if, ctrl_if and gpio_if
-    audio_codec_i2s_cfg_t i2s_cfg = {
-        .port = I2S_NUM_0,
-        .rx_handle = rx_handle_,
-        .tx_handle = tx_handle_,
-    };
-    data_if_ = audio_codec_new_i2s_data(&i2s_cfg);
-    assert(data_if_ != NULL);
-
-    // Output
-    audio_codec_i2c_cfg_t i2c_cfg = {
-        .port = (i2c_port_t)1,
-        .addr = ES8156_CODEC_DEFAULT_ADDR,
-        .bus_handle = i2c_master_handle,
-    };
-    out_ctrl_if_ = audio_codec_new_i2c_ctrl(&i2c_cfg);
-    assert(out_ctrl_if_ != NULL);
-
-    gpio_if_ = audio_codec_new_gpio();
-    assert(gpio_if_ != NULL);
-
-    es8156_codec_cfg_t cfg = {};
-    cfg.ctrl_if = out_ctrl_if_;
-    cfg.gpio_if = gpio_if_;
-    cfg.pa_pin = pa_pin;
-    cfg.hw_gain.pa_voltage = 5.0;
-    cfg.hw_gain.codec_dac_voltage = 3.3;
-    out_codec_if_ = es8156_codec_new(&cfg);
-    assert(out_codec_if_ != NULL);
-
-    esp_codec_dev_cfg_t dev_cfg = {
-        .dev_type = ESP_CODEC_DEV_TYPE_OUT,
-        .codec_if = out_codec_if_,
-        .data_if = data_if_,
-    };
-    output_dev_ = esp_codec_dev_new(&dev_cfg);
-    assert(output_dev_ != NULL);
-
-    // Input
-    i2c_cfg.addr = ES7243E_CODEC_DEFAULT_ADDR;
-    in_ctrl_if_ = audio_codec_new_i2c_ctrl(&i2c_cfg);
-    assert(in_ctrl_if_ != NULL);
-
-    es7243e_codec_cfg_t es7243_cfg = {};
-    es7243_cfg.ctrl_if = in_ctrl_if_;
-    in_codec_if_ = es7243e_codec_new(&es7243_cfg);
-    assert(in_codec_if_ != NULL);
-
-    dev_cfg.dev_type = ESP_CODEC_DEV_TYPE_IN;
-    dev_cfg.codec_if = in_codec_if_;
-    input_dev_ = esp_codec_dev_new(&dev_cfg);
-    assert(input_dev_ != NULL);
-
-    ESP_LOGI(TAG, "BoxAudioDevice initialized");
-}
-
-BoxAudioCodecLite::~BoxAudioCodecLite() {
-    ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
-    esp_codec_dev_delete(output_dev_);
-    ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
-    esp_codec_dev_delete(input_dev_);
-
-    audio_codec_delete_codec_if(in_codec_if_);
-    audio_codec_delete_ctrl_if(in_ctrl_if_);
-    audio_codec_delete_codec_if(out_codec_if_);
-    audio_codec_delete_ctrl_if(out_ctrl_if_);
-    audio_codec_delete_gpio_if(gpio_if_);
-    audio_codec_delete_data_if(data_if_);
-}
-
-void BoxAudioCodecLite::CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din) {
-    assert(input_sample_rate_ == output_sample_rate_);
-
-    i2s_chan_config_t chan_cfg = {
-        .id = I2S_NUM_0,
-        .role = I2S_ROLE_MASTER,
-        .dma_desc_num = AUDIO_CODEC_DMA_DESC_NUM,
-        .dma_frame_num = AUDIO_CODEC_DMA_FRAME_NUM,
-        .auto_clear_after_cb = true,
-        .auto_clear_before_cb = false,
-        .intr_priority = 0,
-    };
-    ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_handle_, &rx_handle_));
-
-    i2s_std_config_t std_cfg = {
-        .clk_cfg = {
-            .sample_rate_hz = (uint32_t)output_sample_rate_,
-            .clk_src = I2S_CLK_SRC_DEFAULT,
-            .ext_clk_freq_hz = 0,
-            .mclk_multiple = I2S_MCLK_MULTIPLE_256
-        },
-        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
-        .gpio_cfg = {
-            .mclk = mclk,
-            .bclk = bclk,
-            .ws = ws,
-            .dout = dout,
-            .din = I2S_GPIO_UNUSED,
-            .invert_flags = {
-                .mclk_inv = false,
-                .bclk_inv = false,
-                .ws_inv = false
-            }
-        }
-    };
-
-    i2s_tdm_config_t tdm_cfg = {
-        .clk_cfg = {
-            .sample_rate_hz = (uint32_t)input_sample_rate_,
-            .clk_src = I2S_CLK_SRC_DEFAULT,
-            .ext_clk_freq_hz = 0,
-            .mclk_multiple = I2S_MCLK_MULTIPLE_256,
-            .bclk_div = 8,
-        },
-        .slot_cfg = {
-            .data_bit_width = I2S_DATA_BIT_WIDTH_16BIT,
-            .slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO,
-            .slot_mode = I2S_SLOT_MODE_STEREO,
-            .slot_mask = i2s_tdm_slot_mask_t(I2S_TDM_SLOT0 | I2S_TDM_SLOT1 | I2S_TDM_SLOT2 | I2S_TDM_SLOT3),
-            .ws_width = I2S_TDM_AUTO_WS_WIDTH,
-            .ws_pol = false,
-            .bit_shift = true,
-            .left_align = false,
-            .big_endian = false,
-            .bit_order_lsb = false,
-            .skip_mask = false,
-            .total_slot = I2S_TDM_AUTO_SLOT_NUM
-        },
-        .gpio_cfg = {
-            .mclk = mclk,
-            .bclk = bclk,
-            .ws = ws,
-            .dout = I2S_GPIO_UNUSED,
-            .din = din,
-            .invert_flags = {
-                .mclk_inv = false,
-                .bclk_inv = false,
-                .ws_inv = false
-            }
-        }
-    };
-
-    ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle_, &std_cfg));
-    ESP_ERROR_CHECK(i2s_channel_init_tdm_mode(rx_handle_, &tdm_cfg));
-    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
-    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
-    ESP_LOGI(TAG, "Duplex channels created");
-}
-
-void BoxAudioCodecLite::SetOutputVolume(int volume) {
-    ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, volume));
-    AudioCodec::SetOutputVolume(volume);
-}
-
-void BoxAudioCodecLite::EnableInput(bool enable) {
-    if (enable == input_enabled_) {
-        return;
-    }
-    if (enable) {
-        esp_codec_dev_sample_info_t fs = {
-            .bits_per_sample = 16,
-            .channel = (uint8_t)(input_channels_ - input_reference_),
-            .channel_mask = 0,
-            .sample_rate = (uint32_t)input_sample_rate_,
-            .mclk_multiple = 0,
-        };
-        for (int i = 0;i < fs.channel; i++) {
-            fs.channel_mask |= ESP_CODEC_DEV_MAKE_CHANNEL_MASK(i);
-        }
-        ESP_ERROR_CHECK(esp_codec_dev_open(input_dev_, &fs));
-        // 麦克风增益解决收音太小的问题
-        ESP_ERROR_CHECK(esp_codec_dev_set_in_gain(input_dev_, 37.5)); 
-    } else {
-        ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
-    }
-    AudioCodec::EnableInput(enable);
-}
-
-void BoxAudioCodecLite::EnableOutput(bool enable) {
-    if (enable == output_enabled_) {
-        return;
-    }
-    if (enable) {
-        // Play 16bit 1 channel
-        esp_codec_dev_sample_info_t fs = {
-            .bits_per_sample = 16,
-            .channel = 1,
-            .channel_mask = 0,
-            .sample_rate = (uint32_t)output_sample_rate_,
-            .mclk_multiple = 0,
-        };
-        ESP_ERROR_CHECK(esp_codec_dev_open(output_dev_, &fs));
-        ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, output_volume_));
-    } else {
-        ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
-    }
-    AudioCodec::EnableOutput(enable);
-}
-
-int BoxAudioCodecLite::Read(int16_t* dest, int samples) {
-    if (input_enabled_) {
-        if (!input_reference_) {
-            ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)dest, samples * sizeof(int16_t)));
-        }
-        else {
-            int size = samples / input_channels_;
-            int channels = input_channels_ - input_reference_;
-            std::vector<int16_t> data(size * channels);
-            // read mic data
-            ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)data.data(), data.size() * sizeof(int16_t)));
-            int j = 0;
-            int i = 0;
-            while (i< samples) {
-                // mic data
-                for (int p = 0; p < channels; p++) {
-                    dest[i++] = data[j++];
-                }
-                // ref data
-                dest[i++] = read_pos_ < write_pos_? ref_buffer_[read_pos_++] : 0;
-            }
-    
-            if (read_pos_ == write_pos_) {
-                read_pos_ = write_pos_ = 0;
-            }    
-        }
-    }
-    return samples;
-}
-
-int BoxAudioCodecLite::Write(const int16_t* data, int samples) {
-    if (output_enabled_) {
-        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_write(output_dev_, (void*)data, samples * sizeof(int16_t)));
-        if (input_reference_) { // 板子不支持硬件回采，采用缓存播放缓冲来实现回声消除
-            if (write_pos_ - read_pos_ + samples > ref_buffer_.size()) { 
-                assert(ref_buffer_.size() >= samples);
-                // 写溢出，只保留最近的数据
-                read_pos_ = write_pos_ + samples - ref_buffer_.size();
-            }
-            if (read_pos_) {
-                if (write_pos_ != read_pos_) {
-                    memmove(ref_buffer_.data(), ref_buffer_.data() + read_pos_, (write_pos_ - read_pos_) * sizeof(int16_t));
-                }
-                write_pos_ -= read_pos_;
-                read_pos_ = 0;
-            }
-            memcpy(&ref_buffer_[write_pos_], data, samples * sizeof(int16_t));
-            write_pos_ += samples;
-        }
-    }
-    return samples;
+#include "box_audio_codec_lite.h"
+
+#include <esp_log.h>
+#include <driver/i2c_master.h>
+#include <driver/i2s_tdm.h>
+#include <cstring>
+
+static const char TAG[] = "BoxAudioCodecLite";
+
+BoxAudioCodecLite::BoxAudioCodecLite(void* i2c_master_handle, int input_sample_rate, int output_sample_rate,
+    gpio_num_t mclk, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din,
+    gpio_num_t pa_pin, bool input_reference) {
+    duplex_ = true; // 是否双工
+    input_reference_ = input_reference; // 是否使用参考输入，实现回声消除
+    if (input_reference) {
+        ref_buffer_.resize(960 * 2);
+    }
+    input_channels_ = 2 + input_reference_; // 输入通道数
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+
+    CreateDuplexChannels(mclk, bclk, ws, dout, din);
+
+    // Do initialize of related interface: data_if, ctrl_if and gpio_if
+    audio_codec_i2s_cfg_t i2s_cfg = {
+        .port = I2S_NUM_0,
+        .rx_handle = rx_handle_,
+        .tx_handle = tx_handle_,
+    };
+    data_if_ = audio_codec_new_i2s_data(&i2s_cfg);
+    assert(data_if_ != NULL);
+
+    // Output
+    audio_codec_i2c_cfg_t i2c_cfg = {
+        .port = (i2c_port_t)1,
+        .addr = ES8156_CODEC_DEFAULT_ADDR,
+        .bus_handle = i2c_master_handle,
+    };
+    out_ctrl_if_ = audio_codec_new_i2c_ctrl(&i2c_cfg);
+    assert(out_ctrl_if_ != NULL);
+
+    gpio_if_ = audio_codec_new_gpio();
+    assert(gpio_if_ != NULL);
+
+    es8156_codec_cfg_t cfg = {};
+    cfg.ctrl_if = out_ctrl_if_;
+    cfg.gpio_if = gpio_if_;
+    cfg.pa_pin = pa_pin;
+    cfg.hw_gain.pa_voltage = 5.0;
+    cfg.hw_gain.codec_dac_voltage = 3.3;
+    out_codec_if_ = es8156_codec_new(&cfg);
+    assert(out_codec_if_ != NULL);
+
+    esp_codec_dev_cfg_t dev_cfg = {
+        .dev_type = ESP_CODEC_DEV_TYPE_OUT,
+        .codec_if = out_codec_if_,
+        .data_if = data_if_,
+    };
+    output_dev_ = esp_codec_dev_new(&dev_cfg);
+    assert(output_dev_ != NULL);
+
+    // Input
+    i2c_cfg.addr = ES7243E_CODEC_DEFAULT_ADDR;
+    in_ctrl_if_ = audio_codec_new_i2c_ctrl(&i2c_cfg);
+    assert(in_ctrl_if_ != NULL);
+
+    es7243e_codec_cfg_t es7243_cfg = {};
+    es7243_cfg.ctrl_if = in_ctrl_if_;
+    in_codec_if_ = es7243e_codec_new(&es7243_cfg);
+    assert(in_codec_if_ != NULL);
+
+    dev_cfg.dev_type = ESP_CODEC_DEV_TYPE_IN;
+    dev_cfg.codec_if = in_codec_if_;
+    input_dev_ = esp_codec_dev_new(&dev_cfg);
+    assert(input_dev_ != NULL);
+
+    ESP_LOGI(TAG, "BoxAudioDevice initialized");
+}
+
+BoxAudioCodecLite::~BoxAudioCodecLite() {
+    ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
+    esp_codec_dev_delete(output_dev_);
+    ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
+    esp_codec_dev_delete(input_dev_);
+
+    audio_codec_delete_codec_if(in_codec_if_);
+    audio_codec_delete_ctrl_if(in_ctrl_if_);
+    audio_codec_delete_codec_if(out_codec_if_);
+    audio_codec_delete_ctrl_if(out_ctrl_if_);
+    audio_codec_delete_gpio_if(gpio_if_);
+    audio_codec_delete_data_if(data_if_);
+}
+
+void BoxAudioCodecLite::CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din) {
+    assert(input_sample_rate_ == output_sample_rate_);
+
+    i2s_chan_config_t chan_cfg = {
+        .id = I2S_NUM_0,
+        .role = I2S_ROLE_MASTER,
+        .dma_desc_num = AUDIO_CODEC_DMA_DESC_NUM,
+        .dma_frame_num = AUDIO_CODEC_DMA_FRAME_NUM,
+        .auto_clear_after_cb = true,
+        .auto_clear_before_cb = false,
+        .intr_priority = 0,
+    };
+    ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_handle_, &rx_handle_));
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = {
+            .sample_rate_hz = (uint32_t)output_sample_rate_,
+            .clk_src = I2S_CLK_SRC_DEFAULT,
+            .ext_clk_freq_hz = 0,
+            .mclk_multiple = I2S_MCLK_MULTIPLE_256
+        },
+        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = mclk,
+            .bclk = bclk,
+            .ws = ws,
+            .dout = dout,
+            .din = I2S_GPIO_UNUSED,
+            .invert_flags = {
+                .mclk_inv = false,
+                .bclk_inv = false,
+                .ws_inv = false
+            }
+        }
+    };
+
+    i2s_tdm_config_t tdm_cfg = {
+        .clk_cfg = {
+            .sample_rate_hz = (uint32_t)input_sample_rate_,
+            .clk_src = I2S_CLK_SRC_DEFAULT,
+            .ext_clk_freq_hz = 0,
+            .mclk_multiple = I2S_MCLK_MULTIPLE_256,
+            .bclk_div = 8,
+        },
+        .slot_cfg = {
+            .data_bit_width = I2S_DATA_BIT_WIDTH_16BIT,
+            .slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO,
+            .slot_mode = I2S_SLOT_MODE_STEREO,
+            .slot_mask = i2s_tdm_slot_mask_t(I2S_TDM_SLOT0 | I2S_TDM_SLOT1 | I2S_TDM_SLOT2 | I2S_TDM_SLOT3),
+            .ws_width = I2S_TDM_AUTO_WS_WIDTH,
+            .ws_pol = false,
+            .bit_shift = true,
+            .left_align = false,
+            .big_endian = false,
+            .bit_order_lsb = false,
+            .skip_mask = false,
+            .total_slot = I2S_TDM_AUTO_SLOT_NUM
+        },
+        .gpio_cfg = {
+            .mclk = mclk,
+            .bclk = bclk,
+            .ws = ws,
+            .dout = I2S_GPIO_UNUSED,
+            .din = din,
+            .invert_flags = {
+                .mclk_inv = false,
+                .bclk_inv = false,
+                .ws_inv = false
+            }
+        }
+    };
+
+    ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle_, &std_cfg));
+    ESP_ERROR_CHECK(i2s_channel_init_tdm_mode(rx_handle_, &tdm_cfg));
+    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
+    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
+    ESP_LOGI(TAG, "Duplex channels created");
+}
+
+void BoxAudioCodecLite::SetOutputVolume(int volume) {
+    // A closed device gets the volume when it is opened again
+    if (output_enabled_ || output_standby_) {
+        RampOutputVolume(output_volume_, volume, [this](int v) {
+            ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, v));
+        });
+    }
+    AudioCodec::SetOutputVolume(volume);
+}
+
+void BoxAudioCodecLite::EnableInput(bool enable) {
+    if (enable == input_enabled_) {
+        return;
+    }
+    if (enable) {
+        esp_codec_dev_sample_info_t fs = {
+            .bits_per_sample = 16,
+            .channel = (uint8_t)(input_channels_ - input_reference_),
+            .channel_mask = 0,
+            .sample_rate = (uint32_t)input_sample_rate_,
+            .mclk_multiple = 0,
+        };
+        for (int i = 0;i < fs.channel; i++) {
+            fs.channel_mask |= ESP_CODEC_DEV_MAKE_CHANNEL_MASK(i);
+        }
+        ESP_ERROR_CHECK(esp_codec_dev_open(input_dev_, &fs));
+        // 麦克风增益解决收音太小的问题
+        ESP_ERROR_CHECK(esp_codec_dev_set_in_gain(input_dev_, 37.5)); 
+    } else {
+        ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
+    }
+    AudioCodec::EnableInput(enable);
+}
+
+void BoxAudioCodecLite::EnableOutput(bool enable) {
+    if (enable == output_enabled_) {
+        return;
+    }
+    if (enable) {
+        // Play 16bit 1 channel
+        esp_codec_dev_sample_info_t fs = {
+            .bits_per_sample = 16,
+            .channel = 1,
+            .channel_mask = 0,
+            .sample_rate = (uint32_t)output_sample_rate_,
+            .mclk_multiple = 0,
+        };
+        ESP_ERROR_CHECK(esp_codec_dev_open(output_dev_, &fs));
+        ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, output_volume_));
+    } else {
+        ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
+    }
+    AudioCodec::EnableOutput(enable);
+}
+
+int BoxAudioCodecLite::Read(int16_t* dest, int samples) {
+    if (input_enabled_) {
+        if (!input_reference_) {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)dest, samples * sizeof(int16_t)));
+        }
+        else {
+            int size = samples / input_channels_;
+            int channels = input_channels_ - input_reference_;
+            std::vector<int16_t> data(size * channels);
+            // read mic data
+            ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)data.data(), data.size() * sizeof(int16_t)));
+            int j = 0;
+            int i = 0;
+            while (i< samples) {
+                // mic data
+                for (int p = 0; p < channels; p++) {
+                    dest[i++] = data[j++];
+                }
+                // ref data
+                dest[i++] = read_pos_ < write_pos_? ref_buffer_[read_pos_++] : 0;
+            }
+    
+            if (read_pos_ == write_pos_) {
+                read_pos_ = write_pos_ = 0;
+            }    
+        }
+    }
+    return samples;
+}
+
+int BoxAudioCodecLite::Write(const int16_t* data, int samples) {
+    if (output_enabled_) {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_write(output_dev_, (void*)data, samples * sizeof(int16_t)));
+        if (input_reference_) { // 板子不支持硬件回采，采用缓存播放缓冲来实现回声消除
+            if (write_pos_ - read_pos_ + samples > ref_buffer_.size()) { 
+                assert(ref_buffer_.size() >= samples);
+                // 写溢出，只保留最近的数据
+                read_pos_ = write_pos_ + samples - ref_buffer_.size();
+            }
+            if (read_pos_) {
+                if (write_pos_ != read_pos_) {
+                    memmove(ref_buffer_.data(), ref_buffer_.data() + read_pos_, (write_pos_ - read_pos_) * sizeof(int16_t));
+                }
+                write_pos_ -= read_pos_;
+                read_pos_ = 0;
+            }
+            memcpy(&ref_buffer_[write_pos_], data, samples * sizeof(int16_t));
+            write_pos_ += samples;
+        }
+    }
+    return samples;
 }
\ No newline at end of file
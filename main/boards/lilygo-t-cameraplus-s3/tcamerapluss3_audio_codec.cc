@@ -1,4 +1,5 @@
 #include "tcamerapluss3_audio_codec.h"
+#include "audio_dsp.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
@@ -146,24 +147,21 @@ int Tcamerapluss3AudioCodec::Read(int16_t *dest, int samples) {
         i2s_channel_read(rx_handle_, dest, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
         
         // 麦克风接收音量放大20倍（限制在 int16_t 范围内防止溢出）
-        int16_t *ptr = dest;
-        for (int i = 0; i < samples; i++) {
-            int32_t amplified = *ptr * 20;
-            *ptr++ = (amplified > 32767) ? 32767 : (amplified < -32768) ? -32768 : amplified;
-        }
+        audio_dsp::Gain(dest, dest, samples, audio_dsp::GainToQ15(20));
     }
     return samples;
 }
 
 int Tcamerapluss3AudioCodec::Write(const int16_t *data, int samples){
+    output_buffer_.assign(data, data + samples);
+    return WriteInPlace(output_buffer_.data(), samples);
+}
+
+int Tcamerapluss3AudioCodec::WriteInPlace(int16_t *data, int samples){
     if (output_enabled_){
         size_t bytes_read;
-        auto output_data = (int16_t *)malloc(samples * sizeof(int16_t));
-        for (size_t i = 0; i < samples; i++){
-            output_data[i] = (float)data[i] * (float)(volume_ / 100.0);
-        }
-        i2s_channel_write(tx_handle_, output_data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-        free(output_data);
+        audio_dsp::Gain(data, data, samples, audio_dsp::GainToQ15(volume_ / 100.0f));
+        i2s_channel_write(tx_handle_, data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
     }
     return samples;
 }
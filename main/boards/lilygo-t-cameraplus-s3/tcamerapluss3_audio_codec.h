@@ -16,11 +16,13 @@ private:
     const audio_codec_gpio_if_t *gpio_if_ = nullptr;
 
     uint32_t volume_ = 70;
+    std::vector<int16_t> output_buffer_;
 
     void CreateVoiceHardware(gpio_num_t mic_bclk, gpio_num_t mic_ws, gpio_num_t mic_data,gpio_num_t spkr_bclk, gpio_num_t spkr_lrclk, gpio_num_t spkr_data);
 
     virtual int Read(int16_t *dest, int samples) override;
     virtual int Write(const int16_t *data, int samples) override;
+    virtual int WriteInPlace(int16_t *data, int samples) override;
 
 public:
     Tcamerapluss3AudioCodec(int input_sample_rate, int output_sample_rate,
@@ -1,4 +1,5 @@
 #include "tcircles3_audio_codec.h"
+#include "audio_dsp.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
@@ -134,14 +135,15 @@ int Tcircles3AudioCodec::Read(int16_t *dest, int samples){
 }
 
 int Tcircles3AudioCodec::Write(const int16_t *data, int samples){
+    output_buffer_.assign(data, data + samples);
+    return WriteInPlace(output_buffer_.data(), samples);
+}
+
+int Tcircles3AudioCodec::WriteInPlace(int16_t *data, int samples){
     if (output_enabled_){
         size_t bytes_read;
-        auto output_data = (int16_t *)malloc(samples * sizeof(int16_t));
-        for (size_t i = 0; i < samples; i++){
-            output_data[i] = (float)data[i] * (float)(volume_ / 100.0);
-        }
-        i2s_channel_write(tx_handle_, output_data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-        free(output_data);
+        audio_dsp::Gain(data, data, samples, audio_dsp::GainToQ15(volume_ / 100.0f));
+        i2s_channel_write(tx_handle_, data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
     }
     return samples;
 }
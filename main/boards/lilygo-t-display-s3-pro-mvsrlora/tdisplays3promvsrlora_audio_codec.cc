@@ -1,4 +1,5 @@
 #include "tdisplays3promvsrlora_audio_codec.h"
+#include "audio_dsp.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
@@ -137,14 +138,15 @@ int Tdisplays3promvsrloraAudioCodec::Read(int16_t *dest, int samples){
 }
 
 int Tdisplays3promvsrloraAudioCodec::Write(const int16_t *data, int samples){
+    output_buffer_.assign(data, data + samples);
+    return WriteInPlace(output_buffer_.data(), samples);
+}
+
+int Tdisplays3promvsrloraAudioCodec::WriteInPlace(int16_t *data, int samples){
     if (output_enabled_){
         size_t bytes_read;
-        auto output_data = (int16_t *)malloc(samples * sizeof(int16_t));
-        for (size_t i = 0; i < samples; i++){
-            output_data[i] = (float)data[i] * (float)(volume_ / 100.0);
-        }
-        i2s_channel_write(tx_handle_, output_data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-        free(output_data);
+        audio_dsp::Gain(data, data, samples, audio_dsp::GainToQ15(volume_ / 100.0f));
+        i2s_channel_write(tx_handle_, data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
     }
     return samples;
 }
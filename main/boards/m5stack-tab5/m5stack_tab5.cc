@@ -20,6 +20,7 @@
 #include <driver/i2c_master.h>
 #include <driver/spi_common.h>
 #include "i2c_device.h"
+#include "touch_input.h"
 #include "esp_lcd_touch_gt911.h"
 #include "esp_lcd_touch_st7123.h"
 #include <cstring>
@@ -257,8 +258,9 @@ private:
         ESP_ERROR_CHECK(esp_lcd_panel_init(panel));
         ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(panel, true));
 
+        // The ili9881c panel has two framebuffers, LVGL renders into them directly
         display_ = new MipiLcdDisplay(panel_io, panel, DISPLAY_WIDTH, DISPLAY_HEIGHT, DISPLAY_OFFSET_X,
-                                      DISPLAY_OFFSET_Y, DISPLAY_MIRROR_X, DISPLAY_MIRROR_Y, DISPLAY_SWAP_XY);
+                                      DISPLAY_OFFSET_Y, DISPLAY_MIRROR_X, DISPLAY_MIRROR_Y, DISPLAY_SWAP_XY, true);
     }
 
     void InitializeSt7123Display() {
@@ -424,6 +426,9 @@ private:
             InitializeIli9881cDisplay();
             InitializeGt911TouchPad();
         }
+        if (touch_ != nullptr) {
+            TouchInput::Add(touch_);
+        }
     }
 
     void InitializeCamera() {
@@ -12,6 +12,7 @@
 #include <esp_timer.h>
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 
 static const char* TAG = "Oscillator";
@@ -20,25 +21,48 @@ extern unsigned long IRAM_ATTR millis();
 
 static ledc_channel_t next_free_channel = LEDC_CHANNEL_0;
 
+// Sine of one cycle in Q15, one guard entry for the interpolation
+#define SINE_TABLE_BITS 8
+#define SINE_TABLE_SIZE (1 << SINE_TABLE_BITS)
+
+static const int16_t* SineTable() {
+    static const auto table = [] {
+        std::array<int16_t, SINE_TABLE_SIZE + 1> t;
+        for (int i = 0; i <= SINE_TABLE_SIZE; i++) {
+            t[i] = std::lround(std::sin(2 * M_PI * i / SINE_TABLE_SIZE) * 32767);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+// Q15 sine of a phase in 1/2^32 of a cycle, the table interpolated linearly
+static int32_t SineQ15(uint32_t phase) {
+    const int16_t* table = SineTable();
+    uint32_t index = phase >> (32 - SINE_TABLE_BITS);
+    int32_t frac = (phase >> (16 - SINE_TABLE_BITS)) & 0xffff;
+    int32_t a = table[index];
+    int32_t b = table[index + 1];
+    return a + (((b - a) * frac) >> 16);
+}
+
 Oscillator::Oscillator(int trim) {
     trim_ = trim;
     diff_limit_ = 0;
     is_attached_ = false;
 
-    sampling_period_ = 30;
     period_ = 2000;
-    number_samples_ = period_ / sampling_period_;
-    inc_ = 2 * M_PI / number_samples_;
 
     amplitude_ = 45;
     phase_ = 0;
     phase0_ = 0;
+    inc_ = 0;
+    inc_interval_ms_ = 0;
     offset_ = 0;
     stop_ = false;
     rev_ = false;
 
     pos_ = 90;
-    previous_millis_ = 0;
 }
 
 Oscillator::~Oscillator() {
@@ -51,17 +75,6 @@ uint32_t Oscillator::AngleToCompare(int angle) {
            SERVO_MIN_PULSEWIDTH_US;
 }
 
-bool Oscillator::NextSample() {
-    current_millis_ = millis();
-
-    if (current_millis_ - previous_millis_ > sampling_period_) {
-        previous_millis_ = current_millis_;
-        return true;
-    }
-
-    return false;
-}
-
 void Oscillator::Attach(int pin, bool rev) {
     if (is_attached_) {
         Detach();
@@ -110,26 +123,35 @@ void Oscillator::Detach() {
 
 void Oscillator::SetT(unsigned int T) {
     period_ = T;
+    inc_interval_ms_ = 0;
+}
 
-    number_samples_ = period_ / sampling_period_;
-    inc_ = 2 * M_PI / number_samples_;
+void Oscillator::SetPh(double Ph) {
+    // Negative phases wrap around to the same point of the cycle
+    phase0_ = (uint32_t)std::llround(Ph / (2 * M_PI) * 4294967296.0);
 }
 
 void Oscillator::SetPosition(int position) {
     Write(position);
 }
 
-void Oscillator::Refresh() {
-    if (NextSample()) {
-        if (!stop_) {
-            int pos = std::round(amplitude_ * std::sin(phase_ + phase0_) + offset_);
-            if (rev_)
-                pos = -pos;
-            Write(pos + 90);
-        }
+int Oscillator::Sample(int interval_ms) {
+    int position = -1;
+    if (!stop_) {
+        int32_t sine = SineQ15(phase_ + phase0_);
+        int pos = (((int32_t)amplitude_ * sine + (1 << 14)) >> 15) + offset_;
+        if (rev_)
+            pos = -pos;
+        position = pos + 90;
+    }
 
-        phase_ = phase_ + inc_;
+    // Movements sample at one rate, the increment is only divided out when it changes
+    if (interval_ms != inc_interval_ms_) {
+        inc_interval_ms_ = interval_ms;
+        inc_ = period_ > 0 ? (uint32_t)(((uint64_t)interval_ms << 32) / period_) : 0;
     }
+    phase_ += inc_;
+    return position;
 }
 
 void Oscillator::Write(int position) {
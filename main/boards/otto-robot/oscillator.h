@@ -36,7 +36,7 @@ public:
 
     void SetA(unsigned int amplitude) { amplitude_ = amplitude; };
     void SetO(int offset) { offset_ = offset; };
-    void SetPh(double Ph) { phase0_ = Ph; };
+    void SetPh(double Ph);
     void SetT(unsigned int period);
     void SetTrim(int trim) { trim_ = trim; };
     void SetLimiter(int diff_limit) { diff_limit_ = diff_limit; };
@@ -46,11 +46,11 @@ public:
     void Stop() { stop_ = true; };
     void Play() { stop_ = false; };
     void Reset() { phase_ = 0; };
-    void Refresh();
+    // Position of the next sample interval_ms later (0-180, before the trim), -1 while stopped
+    int Sample(int interval_ms);
     int GetPosition() { return pos_; }
 
 private:
-    bool NextSample();
     void Write(int position);
     uint32_t AngleToCompare(int angle);
 
@@ -61,20 +61,17 @@ private:
     unsigned int amplitude_;  //-- Amplitude (degrees)
     int offset_;              //-- Offset (degrees)
     unsigned int period_;     //-- Period (miliseconds)
-    double phase0_;           //-- Phase (radians)
+    uint32_t phase0_;         //-- Phase (1/2^32 of a cycle)
 
     //-- Internal variables
     int pos_;                       //-- Current servo pos
     int pin_;                       //-- Pin where the servo is connected
     int trim_;                      //-- Calibration offset
-    double phase_;                  //-- Current phase
-    double inc_;                    //-- Increment of phase
-    double number_samples_;         //-- Number of samples
-    unsigned int sampling_period_;  //-- sampling period (ms)
-
-    long previous_millis_;
-    long current_millis_;
-
+    //-- Current phase, wraps around once per cycle
+    uint32_t phase_;
+    //-- Phase increment per interval of inc_interval_ms_
+    uint32_t inc_;
+    int inc_interval_ms_;
     //-- Oscillation mode. If true, the servo is stopped
     bool stop_;
 
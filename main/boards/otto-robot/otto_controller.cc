@@ -7,6 +7,7 @@
 
 #include <cstdlib> 
 #include <cstring>
+#include <stdexcept>
 
 #include "application.h"
 #include "board.h"
@@ -441,7 +442,11 @@ private:
                  speed, direction, amount);
 
         OttoActionParams params = {action_type, steps, speed, direction, amount, ""};
-        xQueueSend(action_queue_, &params, portMAX_DELAY);
+        // Never blocks the MCP caller, a full queue is reported to it instead
+        if (xQueueSend(action_queue_, &params, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Action queue is full");
+            throw std::runtime_error("Too many actions queued, try again later");
+        }
         StartActionTaskIfNeeded();
     }
 
@@ -472,7 +477,11 @@ private:
         
         ESP_LOGD(TAG, "序列已加入队列: %s", params.servo_sequence_json);
         
-        xQueueSend(action_queue_, &params, portMAX_DELAY);
+        // Never blocks the MCP caller, a full queue is reported to it instead
+        if (xQueueSend(action_queue_, &params, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Action queue is full");
+            throw std::runtime_error("Too many actions queued, try again later");
+        }
         StartActionTaskIfNeeded();
     }
 
@@ -830,6 +839,30 @@ public:
         ESP_LOGI(TAG, "MCP工具注册完成");
     }
 
+    // Remote control from the WebSocket server, called on its httpd task
+    bool SetLivePositions(const int positions[SERVO_COUNT]) {
+        // A running action owns the servos
+        if (is_action_in_progress_ || uxQueueMessagesWaiting(action_queue_) > 0) {
+            return false;
+        }
+        otto_.SetLivePositions(positions);
+        return true;
+    }
+
+    bool QueueRemoteAction(int action_type, int steps, int speed, int direction, int amount) {
+        if (action_type < ACTION_WALK || action_type > ACTION_SHOWCASE ||
+            action_type == ACTION_SERVO_SEQUENCE) {
+            ESP_LOGW(TAG, "Unknown remote action: %d", action_type);
+            return false;
+        }
+        try {
+            QueueAction(action_type, steps, speed, direction, amount);
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        return true;
+    }
+
     ~OttoController() {
         if (action_task_handle_ != nullptr) {
             vTaskDelete(action_task_handle_);
@@ -847,3 +880,12 @@ void InitializeOttoController(const HardwareConfig& hw_config) {
         ESP_LOGI(TAG, "Otto控制器已初始化并注册MCP工具");
     }
 }
+
+bool OttoControllerSetLivePositions(const int positions[SERVO_COUNT]) {
+    return g_otto_controller != nullptr && g_otto_controller->SetLivePositions(positions);
+}
+
+bool OttoControllerQueueAction(int action_type, int steps, int speed, int direction, int amount) {
+    return g_otto_controller != nullptr &&
+           g_otto_controller->QueueRemoteAction(action_type, steps, speed, direction, amount);
+}
@@ -1,6 +1,7 @@
 #include "otto_movements.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "freertos/idf_additions.h"
 #include "oscillator.h"
@@ -9,7 +10,8 @@ static const char* TAG = "OttoMovements";
 
 #define HAND_HOME_POSITION 45
 
-Otto::Otto() {
+Otto::Otto()
+    : scheduler_([this](int servo, int position) { servo_[servo].SetPosition(position); }) {
     is_otto_resting_ = false;
     has_hands_ = false;
     // 初始化所有舵机管脚为-1（未连接）
@@ -92,33 +94,24 @@ void Otto::MoveServos(int time, int servo_target[]) {
         SetRestState(false);
     }
 
-    final_time_ = millis() + time;
-    if (time > 10) {
-        for (int i = 0; i < SERVO_COUNT; i++) {
-            if (servo_pins_[i] != -1) {
-                increment_[i] = (servo_target[i] - servo_[i].GetPosition()) / (time / 10.0);
-            }
-        }
-
-        for (int iteration = 1; millis() < final_time_; iteration++) {
-            partial_time_ = millis() + 10;
-            for (int i = 0; i < SERVO_COUNT; i++) {
-                if (servo_pins_[i] != -1) {
-                    servo_[i].SetPosition(servo_[i].GetPosition() + increment_[i]);
-                }
-            }
-            vTaskDelay(pdMS_TO_TICKS(10));
-        }
-    } else {
+    // The whole trajectory is planned here, the scheduler plays it at a fixed tick
+    int start[SERVO_COUNT];
+    for (int i = 0; i < SERVO_COUNT; i++) {
+        start[i] = servo_[i].GetPosition();
+    }
+    int ticks = std::max(1, time / ServoScheduler::kTickMs);
+    for (int tick = 1; tick <= ticks; tick++) {
+        ServoScheduler::Frame frame = ServoScheduler::HoldFrame();
         for (int i = 0; i < SERVO_COUNT; i++) {
             if (servo_pins_[i] != -1) {
-                servo_[i].SetPosition(servo_target[i]);
+                frame[i] = start[i] + (servo_target[i] - start[i]) * tick / ticks;
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(time));
+        scheduler_.Push(frame);
     }
+    scheduler_.WaitIdle();
 
-    // final adjustment to the target.
+    // final adjustment to the target, the limiter may have held a servo back.
     bool f = true;
     int adjustment_count = 0;
     while (f && adjustment_count < 10) {
@@ -130,12 +123,14 @@ void Otto::MoveServos(int time, int servo_target[]) {
             }
         }
         if (f) {
+            ServoScheduler::Frame frame = ServoScheduler::HoldFrame();
             for (int i = 0; i < SERVO_COUNT; i++) {
                 if (servo_pins_[i] != -1) {
-                    servo_[i].SetPosition(servo_target[i]);
+                    frame[i] = servo_target[i];
                 }
             }
-            vTaskDelay(pdMS_TO_TICKS(10));
+            scheduler_.Push(frame);
+            scheduler_.WaitIdle();
             adjustment_count++;
         }
     };
@@ -156,6 +151,20 @@ void Otto::MoveSingle(int position, int servo_number) {
     }
 }
 
+void Otto::SetLivePositions(const int positions[SERVO_COUNT]) {
+    if (GetRestState() == true) {
+        SetRestState(false);
+    }
+
+    ServoScheduler::Frame frame = ServoScheduler::HoldFrame();
+    for (int i = 0; i < SERVO_COUNT; i++) {
+        if (servo_pins_[i] != -1 && positions[i] >= 0 && positions[i] <= 180) {
+            frame[i] = positions[i];
+        }
+    }
+    scheduler_.SetLive(frame);
+}
+
 void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                            double phase_diff[SERVO_COUNT], float cycle = 1) {
     for (int i = 0; i < SERVO_COUNT; i++) {
@@ -167,18 +176,20 @@ void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT],
         }
     }
 
-    double ref = millis();
-    double end_time = period * cycle + ref;
-
-    while (millis() < end_time) {
+    int ticks = std::round(period * cycle / ServoScheduler::kTickMs);
+    for (int tick = 0; tick < ticks; tick++) {
+        ServoScheduler::Frame frame = ServoScheduler::HoldFrame();
         for (int i = 0; i < SERVO_COUNT; i++) {
             if (servo_pins_[i] != -1) {
-                servo_[i].Refresh();
+                int position = servo_[i].Sample(ServoScheduler::kTickMs);
+                if (position >= 0) {
+                    frame[i] = position;
+                }
             }
         }
-        vTaskDelay(5);
+        scheduler_.Push(frame);
     }
-    vTaskDelay(pdMS_TO_TICKS(10));
+    scheduler_.WaitIdle();
 }
 
 void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
@@ -7,6 +7,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "oscillator.h"
+#include "servo_scheduler.h"
 
 //-- Constants
 #define FORWARD 1
@@ -49,6 +50,8 @@ public:
     //-- Predetermined Motion Functions
     void MoveServos(int time, int servo_target[]);
     void MoveSingle(int position, int servo_number);
+    // Applied on the next scheduler tick without blocking, -1 leaves a servo where it is
+    void SetLivePositions(const int positions[SERVO_COUNT]);
     void OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                          double phase_diff[SERVO_COUNT], float cycle);
     void Execute2(int amplitude[SERVO_COUNT], int center_angle[SERVO_COUNT], int period,
@@ -102,9 +105,8 @@ private:
     int servo_pins_[SERVO_COUNT];
     int servo_trim_[SERVO_COUNT];
 
-    unsigned long final_time_;
-    unsigned long partial_time_;
-    float increment_[SERVO_COUNT];
+    // Plays the trajectories MoveServos() and OscillateServos() plan
+    ServoScheduler scheduler_;
 
     bool is_otto_resting_;
     bool has_hands_;  // 是否有手部舵机
@@ -1,5 +1,6 @@
 #include "websocket_control_server.h"
 #include "mcp_server.h"
+#include "otto_movements.h"
 #include <esp_log.h>
 #include <esp_http_server.h>
 #include <sys/param.h>
@@ -9,6 +10,18 @@
 
 static const char* TAG = "WSControl";
 
+// Binary frames for continuous remote control, handled on the httpd task without JSON or MCP:
+//   0x01 servos: u8 mask, then one u8 angle (0-180) per set bit, lowest servo first
+//   0x02 action: u8 action id, u8 steps, u16 speed (little endian), i8 direction, u8 amount
+#define WS_FRAME_SERVOS 0x01
+#define WS_FRAME_ACTION 0x02
+#define WS_ACTION_FRAME_LEN 7
+// Binary frames and most commands fit, larger ones are allocated
+#define WS_SMALL_FRAME_LEN 64
+
+extern bool OttoControllerSetLivePositions(const int positions[SERVO_COUNT]);
+extern bool OttoControllerQueueAction(int action_type, int steps, int speed, int direction, int amount);
+
 WebSocketControlServer* WebSocketControlServer::instance_ = nullptr;
 
 WebSocketControlServer::WebSocketControlServer() : server_handle_(nullptr) {
@@ -32,6 +45,7 @@ esp_err_t WebSocketControlServer::ws_handler(httpd_req_t *req) {
     }
     
     httpd_ws_frame_t ws_pkt;
+    uint8_t small_buf[WS_SMALL_FRAME_LEN + 1];
     uint8_t *buf = NULL;
     memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
     ws_pkt.type = HTTPD_WS_TYPE_TEXT;
@@ -42,45 +56,53 @@ esp_err_t WebSocketControlServer::ws_handler(httpd_req_t *req) {
         ESP_LOGE(TAG, "httpd_ws_recv_frame failed to get frame len with %d", ret);
         return ret;
     }
-    ESP_LOGI(TAG, "frame len is %d", ws_pkt.len);
+    ESP_LOGD(TAG, "frame len is %d", ws_pkt.len);
     
     if (ws_pkt.len) {
         /* ws_pkt.len + 1 is for NULL termination as we are expecting a string */
-        buf = (uint8_t*)calloc(1, ws_pkt.len + 1);
-        if (buf == NULL) {
-            ESP_LOGE(TAG, "Failed to calloc memory for buf");
-            return ESP_ERR_NO_MEM;
+        if (ws_pkt.len <= WS_SMALL_FRAME_LEN) {
+            buf = small_buf;
+        } else {
+            buf = (uint8_t*)calloc(1, ws_pkt.len + 1);
+            if (buf == NULL) {
+                ESP_LOGE(TAG, "Failed to calloc memory for buf");
+                return ESP_ERR_NO_MEM;
+            }
         }
         ws_pkt.payload = buf;
         /* Set max_len = ws_pkt.len to get the frame payload */
         ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "httpd_ws_recv_frame failed with %d", ret);
-            free(buf);
+            if (buf != small_buf) {
+                free(buf);
+            }
             return ret;
         }
-        ESP_LOGI(TAG, "Got packet with message: %s", ws_pkt.payload);
     }
     
-    ESP_LOGI(TAG, "Packet type: %d", ws_pkt.type);
+    ESP_LOGD(TAG, "Packet type: %d", ws_pkt.type);
     
     if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE) {
         ESP_LOGI(TAG, "WebSocket close frame received");
         instance_->RemoveClient(req);
-        free(buf);
-        return ESP_OK;
-    }
-    
-    if (ws_pkt.type == HTTPD_WS_TYPE_TEXT) {
+    } else if (ws_pkt.type == HTTPD_WS_TYPE_TEXT) {
         if (ws_pkt.len > 0 && buf != nullptr) {
             buf[ws_pkt.len] = '\0';
+            ESP_LOGI(TAG, "Got packet with message: %s", buf);
             instance_->HandleMessage(req, (const char*)buf, ws_pkt.len);
         }
+    } else if (ws_pkt.type == HTTPD_WS_TYPE_BINARY) {
+        if (ws_pkt.len > 0 && buf != nullptr) {
+            instance_->HandleBinaryMessage(buf, ws_pkt.len);
+        }
     } else {
         ESP_LOGW(TAG, "Unsupported frame type: %d", ws_pkt.type);
     }
     
-    free(buf);
+    if (buf != small_buf) {
+        free(buf);
+    }
     return ESP_OK;
 }
 
@@ -172,6 +194,41 @@ void WebSocketControlServer::HandleMessage(httpd_req_t *req, const char* data, s
     cJSON_Delete(root);
 }
 
+void WebSocketControlServer::HandleBinaryMessage(const uint8_t* data, size_t len) {
+    switch (data[0]) {
+    case WS_FRAME_SERVOS: {
+        if (len < 2) {
+            break;
+        }
+        int positions[SERVO_COUNT];
+        size_t offset = 2;
+        for (int i = 0; i < SERVO_COUNT; i++) {
+            positions[i] = -1;
+            if (data[1] & (1 << i)) {
+                if (offset >= len) {
+                    ESP_LOGW(TAG, "Servo frame too short for mask 0x%02x", data[1]);
+                    return;
+                }
+                positions[i] = data[offset++];
+            }
+        }
+        // Dropped while an action runs, the next frame follows anyway
+        OttoControllerSetLivePositions(positions);
+        return;
+    }
+    case WS_FRAME_ACTION:
+        if (len < WS_ACTION_FRAME_LEN) {
+            break;
+        }
+        OttoControllerQueueAction(data[1], data[2], data[3] | (data[4] << 8), (int8_t)data[5], data[6]);
+        return;
+    default:
+        ESP_LOGW(TAG, "Unknown binary frame: 0x%02x", data[0]);
+        return;
+    }
+    ESP_LOGW(TAG, "Binary frame 0x%02x too short: %zu bytes", data[0], len);
+}
+
 void WebSocketControlServer::AddClient(httpd_req_t *req) {
     int sock_fd = httpd_req_to_sockfd(req);
     if (clients_.find(sock_fd) == clients_.end()) {
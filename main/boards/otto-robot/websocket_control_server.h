@@ -24,6 +24,7 @@ private:
     static esp_err_t ws_handler(httpd_req_t *req);
     
     void HandleMessage(httpd_req_t *req, const char* data, size_t len);
+    void HandleBinaryMessage(const uint8_t* data, size_t len);
     void AddClient(httpd_req_t *req);
     void RemoveClient(httpd_req_t *req);
     static WebSocketControlServer* instance_;
@@ -10,6 +10,7 @@
 #include "power_save_timer.h"
 #include "sscma_camera.h"
 #include "lvgl_theme.h"
+#include "settings.h"
 
 #include <esp_log.h>
 #include <esp_check.h>
@@ -297,6 +298,7 @@ private:
             // 长按10s 恢复出厂设置: 2+0.02*400 = 10
             if (self->long_press_cnt_ > 400) {
                 ESP_LOGI(TAG, "Factory reset");
+                Settings::Invalidate();
                 nvs_flash_erase();
                 esp_restart();
             }
@@ -489,6 +491,7 @@ private:
             .func = NULL,
             .argtable = NULL,
             .func_w_context = [](void *context,int argc, char** argv) -> int {
+                Settings::Invalidate();
                 nvs_flash_erase();
                 esp_restart();
                 return 0;
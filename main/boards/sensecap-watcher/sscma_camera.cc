@@ -6,10 +6,13 @@
 #include "system_info.h"
 #include "config.h"
 #include "settings.h"
+#include "dns_cache.h"
+#include "http_pool.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
 #include <cstring>
+#include <algorithm>
 #include "application.h"
 #include "sscma_client_commands.h"
 
@@ -87,6 +90,7 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
         sscma_client_point_t  *points = NULL;
         int model_type = 0;
         int obj_cnt = 0;
+        SscmaDetection detection = {};
 
         int width = 0, height = 0;
         cJSON *data = cJSON_GetObjectItem(reply->payload, "data");
@@ -116,6 +120,11 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
                            is_object_detected = true;
                            model_type = 0;
                            obj_cnt++;
+                           detection.score = boxes[i].score;
+                           detection.x = boxes[i].x;
+                           detection.y = boxes[i].y;
+                           detection.w = boxes[i].w;
+                           detection.h = boxes[i].h;
                            break;
                         }
                     }
@@ -129,6 +138,7 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
                            is_object_detected = true;
                            model_type = 1;
                            obj_cnt++;
+                           detection.score = std::max(detection.score, (int)classes[i].score);
                         }
                     }
                     free(classes);
@@ -141,11 +151,18 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
                            is_object_detected = true;
                            model_type = 2;
                            obj_cnt++;
+                           detection.score = std::max(detection.score, (int)points[i].score);
                         }
                     }
                     free(points);
                 }
 
+                detection.timestamp_us = cur_tm;
+                detection.model_type = model_type;
+                detection.target = self->detect_target;
+                detection.count = obj_cnt;
+                self->PublishDetection(detection);
+
                 // 如果需要开始冷却期，现在开始计时
                 if (self->need_start_cooldown) { // 回调暂停，标志保持，等待回调恢复后开始计时
                     self->state_start_time = cur_tm;
@@ -299,47 +316,6 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
         return;
     }
 
-    //初始化JPEG解码
-    jpeg_error_t err;
-    jpeg_dec_config_t config = { .output_type = JPEG_PIXEL_FORMAT_RGB565_LE, .rotate = JPEG_ROTATE_0D };
-    err = jpeg_dec_open(&config, &jpeg_dec_);
-    if ( err != JPEG_ERR_OK ) {
-        ESP_LOGE(TAG, "Failed to open JPEG decoder");
-        return;
-    }
-    jpeg_io_ = (jpeg_dec_io_t*)heap_caps_malloc(sizeof(jpeg_dec_io_t), MALLOC_CAP_SPIRAM);
-    if (!jpeg_io_) {
-        ESP_LOGE(TAG, "Failed to allocate memory for JPEG IO");
-        jpeg_dec_close(jpeg_dec_);
-        return;
-    }
-    memset(jpeg_io_, 0, sizeof(jpeg_dec_io_t));
-
-    jpeg_out_ = (jpeg_dec_header_info_t*)heap_caps_aligned_alloc(16, sizeof(jpeg_dec_header_info_t), MALLOC_CAP_SPIRAM);
-    if (!jpeg_out_) {
-        ESP_LOGE(TAG, "Failed to allocate memory for JPEG output header");
-        heap_caps_free(jpeg_io_);
-        jpeg_dec_close(jpeg_dec_);
-        return;
-    }
-    memset(jpeg_out_, 0, sizeof(jpeg_dec_header_info_t));
-
-    // 初始化预览图片的内存
-    memset(&preview_image_, 0, sizeof(preview_image_));
-    preview_image_.header.magic = LV_IMAGE_HEADER_MAGIC;
-    preview_image_.header.cf = LV_COLOR_FORMAT_RGB565;
-    preview_image_.header.flags = LV_IMAGE_FLAGS_ALLOCATED | LV_IMAGE_FLAGS_MODIFIABLE;
-    preview_image_.header.w = 640;
-    preview_image_.header.h = 480;
-
-    preview_image_.header.stride = preview_image_.header.w * 2;
-    preview_image_.data_size = preview_image_.header.w * preview_image_.header.h * 2;
-    preview_image_.data =(uint8_t*)jpeg_calloc_align(preview_image_.data_size, 16);
-    if (preview_image_.data == nullptr) {
-        ESP_LOGE(TAG, "Failed to allocate memory for preview image");
-        return;
-    }
-
     sscma_client_set_model(sscma_client_handle_, 4);
     model_class_cnt = 0;
     if (sscma_client_get_model(sscma_client_handle_, &model, true) == ESP_OK) {
@@ -371,6 +347,7 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
         auto this_ = (SscmaCamera*)arg;
         bool is_inference = false;
         int64_t last_keepalive_time = esp_timer_get_time();
+        int64_t next_invoke_time = 0;
         while (true)
         {
             if (this_->sscma_restarted_) {
@@ -394,9 +371,17 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
                     sscma_client_break(this_->sscma_client_handle_);
                     sscma_client_set_model(this_->sscma_client_handle_, 4);
                     sscma_client_set_sensor(this_->sscma_client_handle_, 1, 1, true); // 设置分辨率 416X416
-                    sscma_client_invoke(this_->sscma_client_handle_, -1, false, true);
+                    if (this_->inference_period_ms <= 0) {
+                        sscma_client_invoke(this_->sscma_client_handle_, -1, false, true);
+                    }
+                    next_invoke_time = 0;
                     is_inference = true;
                 }
+                // 按间隔单次推理, 两次之间 himax 空闲
+                if (this_->inference_period_ms > 0 && esp_timer_get_time() >= next_invoke_time) {
+                    sscma_client_invoke(this_->sscma_client_handle_, 1, false, true);
+                    next_invoke_time = esp_timer_get_time() + this_->InferencePeriodMs() * 1000LL;
+                }
             } else if (is_inference && (!this_->inference_en || Application::GetInstance().GetDeviceState() != kDeviceStateIdle))  {
                 ESP_LOGI(TAG, "Stop inference (enable=%d state=%d)", this_->inference_en, Application::GetInstance().GetDeviceState());
                 is_inference = false;
@@ -409,10 +394,6 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
 }
 
 SscmaCamera::~SscmaCamera() {
-    if (preview_image_.data) {
-        heap_caps_free((void*)preview_image_.data);
-        preview_image_.data = nullptr;
-    }
     if (sscma_client_handle_) {
         sscma_client_del(sscma_client_handle_);
     }
@@ -423,18 +404,38 @@ SscmaCamera::~SscmaCamera() {
         heap_caps_free(jpeg_data_.buf);
         jpeg_data_.buf = nullptr;
     }
-    if (jpeg_dec_) {
-        jpeg_dec_close(jpeg_dec_);
-        jpeg_dec_ = nullptr;
-    }
-    if (jpeg_io_) {
-        heap_caps_free(jpeg_io_);
-        jpeg_io_ = nullptr;
-    }
-    if (jpeg_out_) {
-        heap_caps_free(jpeg_out_);
-        jpeg_out_ = nullptr;
+}
+
+void SscmaCamera::PublishDetection(const SscmaDetection& detection) {
+    detection_seq_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    detection_ = detection;
+    detection_seq_.fetch_add(1, std::memory_order_release);
+}
+
+SscmaDetection SscmaCamera::GetLatestDetection() const {
+    SscmaDetection detection;
+    uint32_t seq;
+    do {
+        // 写入中途读到的结果作废重读, 写入方可能优先级更低, 等待时让出 CPU
+        while ((seq = detection_seq_.load(std::memory_order_acquire)) & 1) {
+            vTaskDelay(1);
+        }
+        detection = detection_;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while (detection_seq_.load(std::memory_order_relaxed) != seq);
+    return detection;
+}
+
+int SscmaCamera::InferencePeriodMs() const {
+    // 一段时间没有看到目标就放慢, 看到目标后恢复
+    auto detection = GetLatestDetection();
+    bool recently_seen = detection.count > 0 || detection_state != IDLE ||
+        esp_timer_get_time() - last_detected_time < 30 * 1000000LL;
+    if (recently_seen) {
+        return inference_period_ms;
     }
+    return std::max(inference_period_ms, inference_idle_period_ms);
 }
 
 void SscmaCamera::InitializeMcpTools() {
@@ -445,6 +446,7 @@ void SscmaCamera::InitializeMcpTools() {
     detect_duration_sec = settings.GetInt("duration", 2);
     detect_target = settings.GetInt("target", 0);
     inference_en = settings.GetInt("enable", 0);
+    inference_period_ms = settings.GetInt("period", 0);
 
     auto& mcp_server = McpServer::GetInstance();
         // 获取模型参数配置
@@ -454,7 +456,8 @@ void SscmaCamera::InitializeMcpTools() {
         "  `threshold`: 检测置信度阈值 (0-100)，低于此值的检测结果将被忽略；\n"
         "  `interval`: 触发对话后的冷却时间(秒)，防止频繁打断；\n"
         "  `duration`: 持续检测确认时间(秒)；\n"
-        "  `target`: 当前关注的检测目标索引。",
+        "  `target`: 当前关注的检测目标索引；\n"
+        "  `period`: 推理间隔(毫秒)，0 为连续推理。",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
             Settings settings("model", false);
@@ -462,13 +465,15 @@ void SscmaCamera::InitializeMcpTools() {
             int interval = settings.GetInt("interval", 8);
             int duration = settings.GetInt("duration", 2);
             int target_type = settings.GetInt("target", 0);
+            int period = settings.GetInt("period", 0);
             
             std::string result = "{\"threshold\":" + std::to_string(threshold) + 
                             ",\"interval\":" + std::to_string(interval) + 
                             ",\"duration\":" + std::to_string(duration) + 
-                            ",\"target_type\":" + std::to_string(target_type) + "}";
+                            ",\"target_type\":" + std::to_string(target_type) +
+                            ",\"period\":" + std::to_string(period) + "}";
             return result;
-    });
+    }, MCP_GETTER_CACHE_TTL_MS);
 
     
     // 设置模型参数配置
@@ -478,12 +483,14 @@ void SscmaCamera::InitializeMcpTools() {
         "  `threshold`: 置信度阈值 (0-100)。提高此值可减少误报，但可能漏检；\n"
         "  `interval`: 冷却时间(秒)。设置对话结束后多久内不再触发检测；\n"
         "  `duration`: 持续检测时间(秒)。\n"
-        "  `target`: 设置检测目标的索引 ID。",
+        "  `target`: 设置检测目标的索引 ID；\n"
+        "  `period`: 推理间隔(毫秒)，0 为连续推理。间隔越长越省电，但发现目标越慢。",
         PropertyList({
             Property("threshold", kPropertyTypeInteger, -1, -1, 100),
             Property("interval", kPropertyTypeInteger, -1, -1, 60),
             Property("duration", kPropertyTypeInteger, -1, -1, 60),
-            Property("target", kPropertyTypeInteger, -1, -1, this->model_class_cnt > 0 ? this->model_class_cnt - 1 : 255)
+            Property("target", kPropertyTypeInteger, -1, -1, this->model_class_cnt > 0 ? this->model_class_cnt - 1 : 255),
+            Property("period", kPropertyTypeInteger, -1, -1, 60000)
         }),
         [this](const PropertyList& properties) -> ReturnValue {
             Settings settings("model", true);
@@ -534,6 +541,22 @@ void SscmaCamera::InitializeMcpTools() {
                 // target_type parameter not provided, skip
             }
 
+            try {
+                const Property& period_prop = properties["period"];
+                int period = period_prop.value<int>();
+                if (period != -1) {
+                    settings.SetInt("period", period);
+                    // 连续和单次推理之间切换时需要重新开始
+                    if ((period > 0) != (this->inference_period_ms > 0)) {
+                        this->sscma_restarted_ = true;
+                    }
+                    this->inference_period_ms = period;
+                    ESP_LOGI(TAG, "Set inference period to %d ms", period);
+                }
+            } catch (const std::runtime_error&) {
+                // period parameter not provided, skip
+            }
+
             return "{\"status\": \"success\", \"message\": \"Detection configuration updated\"}";
         });
 
@@ -561,11 +584,42 @@ void SscmaCamera::InitializeMcpTools() {
             int cur_en = settings.GetInt("enable", this->inference_en);
             return std::string("{\"enable\":") + std::to_string(cur_en) + "}";
         });
+
+    // 读取最近的推理结果, 不会触发拍照
+    mcp_server.AddTool("self.model.detection_get",
+        "获取视觉推理最近一次的检测结果，不会重新拍照，需要先开启推理。\n"
+        "返回结果包含：\n"
+        "  `age_ms`: 结果距今的毫秒数，-1 表示还没有结果；\n"
+        "  `target`: 检测目标索引，`name`: 目标名称；\n"
+        "  `count`: 超过阈值的目标数量，`score`: 最高置信度；\n"
+        "  `box`: 检测框模型的目标位置 [x, y, w, h]。",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto detection = GetLatestDetection();
+            if (detection.timestamp_us == 0) {
+                return std::string("{\"age_ms\":-1}");
+            }
+            std::string name = "object";
+            if (model != NULL && detection.target < model_class_cnt && model->classes[detection.target] != NULL) {
+                name = model->classes[detection.target];
+            }
+            std::string result = "{\"age_ms\":" + std::to_string((esp_timer_get_time() - detection.timestamp_us) / 1000) +
+                ",\"target\":" + std::to_string(detection.target) +
+                ",\"name\":\"" + name + "\"" +
+                ",\"count\":" + std::to_string(detection.count) +
+                ",\"score\":" + std::to_string(detection.score);
+            if (detection.model_type == 0 && detection.count > 0) {
+                result += ",\"box\":[" + std::to_string(detection.x) + "," + std::to_string(detection.y) + "," +
+                    std::to_string(detection.w) + "," + std::to_string(detection.h) + "]";
+            }
+            return result + "}";
+        });
 }
 
 void SscmaCamera::SetExplainUrl(const std::string& url, const std::string& token) {
     explain_url_ = url;
     explain_token_ = token;
+    DnsCache::GetInstance().AddHost(url);
 }
 
 bool SscmaCamera::Capture() {
@@ -583,13 +637,17 @@ bool SscmaCamera::Capture() {
         return false;
     }
     ESP_LOGI(TAG, "Capturing image...");
+    // 丢弃之前缓存的照片, 之后收到的就是这次拍的
+    while (xQueueReceive(sscma_data_queue_, &data, 0) == pdPASS) {
+        heap_caps_free(data.img);
+    }
     // himax 可能有缓存数据, 只获取最新的照片即可.
     if (sscma_client_sample(sscma_client_handle_, 1) ) {
         ESP_LOGE(TAG, "Failed to capture image from SSCMA client");
         return false;
     }
-    vTaskDelay(pdMS_TO_TICKS(500)); // 等待SSCMA客户端处理数据
-    if (xQueueReceive(sscma_data_queue_, &data, pdMS_TO_TICKS(1000)) != pdPASS) {
+    // 照片一到就返回, 不再固定等待
+    if (xQueueReceive(sscma_data_queue_, &data, pdMS_TO_TICKS(1500)) != pdPASS) {
         ESP_LOGE(TAG, "Failed to receive JPEG data from SSCMA client");
         return false;
     }
@@ -607,45 +665,16 @@ bool SscmaCamera::Capture() {
     }
     heap_caps_free(data.img);
 
-    //DECODE JPEG
-    if (!jpeg_dec_ || !jpeg_io_ || !jpeg_out_ || !preview_image_.data) {
-        return true;
-    }
-    jpeg_io_->inbuf = jpeg_data_.buf;
-    jpeg_io_->inbuf_len = jpeg_data_.len;
-    ret = jpeg_dec_parse_header(jpeg_dec_, jpeg_io_, jpeg_out_);
-    if (ret < 0) {
-        ESP_LOGE(TAG, "Failed to parse JPEG header, ret: %d", ret);
-        return true;
-    }
-    jpeg_io_->outbuf = (unsigned char*)preview_image_.data;
-    int inbuf_consumed = jpeg_io_->inbuf_len - jpeg_io_->inbuf_remain;
-    jpeg_io_->inbuf =  jpeg_data_.buf + inbuf_consumed;
-    jpeg_io_->inbuf_len = jpeg_io_->inbuf_remain;
-
-    ret = jpeg_dec_process(jpeg_dec_, jpeg_io_);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to decode JPEG image, ret: %d", ret);
-        return true;
-    }
-
-    // 显示预览图片
+    // 原始 JPEG 保留给 Explain 上传, 预览由显示的加载任务按预览尺寸解码, 拍照不等待解码
     auto display = dynamic_cast<LvglDisplay*>(Board::GetInstance().GetDisplay());
     if (display != nullptr) {
-        uint16_t w = preview_image_.header.w;
-        uint16_t h = preview_image_.header.h;
-        size_t image_size = w * h * 2;
-        size_t stride = preview_image_.header.w * 2;
-
-        uint8_t* data = (uint8_t*)heap_caps_malloc(image_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (data == nullptr) {
+        uint8_t* preview_data = (uint8_t*)heap_caps_malloc(jpeg_data_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (preview_data == nullptr) {
             ESP_LOGE(TAG, "Failed to allocate memory for display image");
             return true;
         }
-        memcpy(data, preview_image_.data, image_size);
-        
-        auto image = std::make_unique<LvglAllocatedImage>(data, image_size, w, h, stride, LV_COLOR_FORMAT_RGB565);
-        display->SetPreviewImage(std::move(image));
+        memcpy(preview_data, jpeg_data_.buf, jpeg_data_.len);
+        display->LoadPreviewImage(preview_data, jpeg_data_.len);
     }
     return true;
 }
@@ -679,8 +708,7 @@ std::string SscmaCamera::Explain(const std::string& question) {
         return "{\"success\": false, \"message\": \"Image explain URL or token is not set\"}";
     }
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(3);
+    auto http = HttpPool::GetInstance().CreateHttp(3);
     // 构造multipart/form-data请求体
     std::string boundary = "----ESP32_CAMERA_BOUNDARY";
     
@@ -5,11 +5,11 @@
 #include <lvgl.h>
 #include <thread>
 #include <memory>
+#include <atomic>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <esp_io_expander_tca95xx_16bit.h>
-#include <esp_jpeg_dec.h>
 #include <mbedtls/base64.h>
 
 #include "sscma_client.h"
@@ -23,19 +23,24 @@ struct JpegData {
     uint8_t* buf;
     size_t len;
 };
+// 最近一次推理结果
+struct SscmaDetection {
+    int64_t timestamp_us;   // 0 表示还没有结果
+    int model_type;         // 0: 检测框, 1: 分类, 2: 关键点
+    int target;
+    int count;              // 超过阈值的目标数量
+    int score;              // 目标的最高分
+    int x, y, w, h;         // 检测框模型的目标位置
+};
 
 class SscmaCamera : public Camera {
 private:
-    lv_img_dsc_t preview_image_;
     std::string explain_url_;
     std::string explain_token_;
     sscma_client_io_handle_t sscma_client_io_handle_;
     sscma_client_handle_t sscma_client_handle_;
     QueueHandle_t sscma_data_queue_;
     JpegData jpeg_data_;
-    jpeg_dec_handle_t jpeg_dec_;
-    jpeg_dec_io_t *jpeg_io_;
-    jpeg_dec_header_info_t *jpeg_out_;
     // 检测状态机
     enum DetectionState {
         IDLE,           // 空闲状态
@@ -54,14 +59,24 @@ private:
     int detect_invoke_interval_sec = 8; // 默认15秒冷却期，避免频繁开始会话
     int detect_debounce_sec = 1; // 验证期间人员离开的去抖动时间1秒
     int inference_en = 0; // 推理使能开关（0: 关闭, 1: 开启）
+    int inference_period_ms = 0; // 推理间隔, 0 为连续推理
+    int inference_idle_period_ms = 2000; // 长时间没有目标时放慢推理, 让 himax 多休息
     bool sscma_restarted_ = false;
     
     sscma_client_model_t *model;
     int model_class_cnt = 0;
+
+    // 事件回调写, 其它任务无锁读取: 序号为奇数时表示正在写
+    std::atomic<uint32_t> detection_seq_ = 0;
+    SscmaDetection detection_ = {};
+    void PublishDetection(const SscmaDetection& detection);
+    int InferencePeriodMs() const;
 public:
     SscmaCamera(esp_io_expander_handle_t io_exp_handle);
     ~SscmaCamera();
     void InitializeMcpTools();
+    // 读取最近的推理结果, 不会阻塞也不会触发新的推理
+    SscmaDetection GetLatestDetection() const;
 
     virtual void SetExplainUrl(const std::string& url, const std::string& token);
     virtual bool Capture();
@@ -22,6 +22,7 @@
 #include <driver/sdmmc_host.h>
 #include <driver/sdspi_host.h>
 #include "sd_pwr_ctrl_by_on_chip_ldo.h"
+#include "touch_input.h"
 
 #define TAG "WirelessTagEsp32p47b"
 
@@ -157,11 +158,7 @@ private:
         ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c(i2c_bus_, &tp_io_config, &tp_io_handle));
         ESP_LOGI(TAG, "Initialize touch controller");
         ESP_ERROR_CHECK(esp_lcd_touch_new_i2c_gt911(tp_io_handle, &tp_cfg, &tp));
-        const lvgl_port_touch_cfg_t touch_cfg = {
-            .disp = lv_display_get_default(),
-            .handle = tp,
-        };
-        lvgl_port_add_touch(&touch_cfg);
+        TouchInput::Add(tp);
         ESP_LOGI(TAG, "Touch panel initialized successfully");
     }
 
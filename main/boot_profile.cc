@@ -0,0 +1,138 @@
+#include "boot_profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#define TAG "BootProfile"
+#define BOOT_PROFILE_MAX_MARKS 24
+#define BOOT_PROFILE_MAX_TIMINGS 8
+
+namespace {
+
+struct BootMark {
+    std::atomic<const char*> name{nullptr};
+    int64_t time_us;
+};
+
+BootMark marks[BOOT_PROFILE_MAX_MARKS];
+// Slots reserved by Mark(), a slot is readable once its name is set
+std::atomic<int> reserved{0};
+
+struct BootTiming {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int> last_ms{0};
+    std::atomic<int> count{0};
+};
+
+BootTiming timings[BOOT_PROFILE_MAX_TIMINGS];
+std::atomic<int> timings_reserved{0};
+
+} // namespace
+
+void BootProfile::Mark(const char* name) {
+    int64_t now = esp_timer_get_time();
+    int count = std::min(reserved.load(std::memory_order_acquire), BOOT_PROFILE_MAX_MARKS);
+    for (int i = 0; i < count; i++) {
+        const char* existing = marks[i].name.load(std::memory_order_acquire);
+        if (existing != nullptr && strcmp(existing, name) == 0) {
+            return;
+        }
+    }
+
+    int index = reserved.fetch_add(1, std::memory_order_acq_rel);
+    if (index >= BOOT_PROFILE_MAX_MARKS) {
+        return;
+    }
+    marks[index].time_us = now;
+    marks[index].name.store(name, std::memory_order_release);
+}
+
+void BootProfile::Record(const char* name, int duration_ms) {
+    BootTiming* timing = nullptr;
+    int count = std::min(timings_reserved.load(std::memory_order_acquire), BOOT_PROFILE_MAX_TIMINGS);
+    for (int i = 0; i < count; i++) {
+        const char* existing = timings[i].name.load(std::memory_order_acquire);
+        if (existing != nullptr && strcmp(existing, name) == 0) {
+            timing = &timings[i];
+            break;
+        }
+    }
+    if (timing == nullptr) {
+        int index = timings_reserved.fetch_add(1, std::memory_order_acq_rel);
+        if (index >= BOOT_PROFILE_MAX_TIMINGS) {
+            return;
+        }
+        timing = &timings[index];
+        timing->last_ms.store(duration_ms, std::memory_order_relaxed);
+        timing->count.store(1, std::memory_order_relaxed);
+        timing->name.store(name, std::memory_order_release);
+        return;
+    }
+    timing->last_ms.store(duration_ms, std::memory_order_relaxed);
+    timing->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BootProfile::PrintTable() {
+    int count = std::min(reserved.load(std::memory_order_acquire), BOOT_PROFILE_MAX_MARKS);
+    ESP_LOGI(TAG, "%-20s %8s %8s", "checkpoint", "at_ms", "delta_ms");
+    int64_t last_us = 0;
+    for (int i = 0; i < count; i++) {
+        const char* name = marks[i].name.load(std::memory_order_acquire);
+        if (name == nullptr) {
+            continue;
+        }
+        int64_t time_us = marks[i].time_us;
+        ESP_LOGI(TAG, "%-20s %8d %8d", name, (int)(time_us / 1000), (int)((time_us - last_us) / 1000));
+        last_us = time_us;
+    }
+    count = std::min(timings_reserved.load(std::memory_order_acquire), BOOT_PROFILE_MAX_TIMINGS);
+    for (int i = 0; i < count; i++) {
+        const char* name = timings[i].name.load(std::memory_order_acquire);
+        if (name == nullptr) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-20s %8d ms, %d times", name, timings[i].last_ms.load(), timings[i].count.load());
+    }
+}
+
+std::string BootProfile::GetJson() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* array = cJSON_CreateArray();
+    int count = std::min(reserved.load(std::memory_order_acquire), BOOT_PROFILE_MAX_MARKS);
+    for (int i = 0; i < count; i++) {
+        const char* name = marks[i].name.load(std::memory_order_acquire);
+        if (name == nullptr) {
+            continue;
+        }
+        cJSON* mark = cJSON_CreateObject();
+        cJSON_AddStringToObject(mark, "name", name);
+        cJSON_AddNumberToObject(mark, "at_ms", marks[i].time_us / 1000.0);
+        cJSON_AddItemToArray(array, mark);
+    }
+    cJSON_AddItemToObject(root, "checkpoints", array);
+
+    cJSON* timing_array = cJSON_CreateArray();
+    count = std::min(timings_reserved.load(std::memory_order_acquire), BOOT_PROFILE_MAX_TIMINGS);
+    for (int i = 0; i < count; i++) {
+        const char* name = timings[i].name.load(std::memory_order_acquire);
+        if (name == nullptr) {
+            continue;
+        }
+        cJSON* timing = cJSON_CreateObject();
+        cJSON_AddStringToObject(timing, "name", name);
+        cJSON_AddNumberToObject(timing, "last_ms", timings[i].last_ms.load());
+        cJSON_AddNumberToObject(timing, "count", timings[i].count.load());
+        cJSON_AddItemToArray(timing_array, timing);
+    }
+    cJSON_AddItemToObject(root, "timings", timing_array);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
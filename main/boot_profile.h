@@ -0,0 +1,22 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <string>
+
+/*
+ * Named checkpoints of the cold boot with their esp_timer_get_time(), so the slow phase of a
+ * board (e.g. an I2C probe in its constructor or the LCD init) shows up in the log.
+ *
+ * Mark() may be called from any task and before the scheduler objects exist, it only records
+ * the first time a name is reached and never allocates. Record() keeps the latest duration of
+ * something that repeats after boot, like a Wi-Fi reconnect, with how often it happened.
+ */
+class BootProfile {
+public:
+    static void Mark(const char* name);
+    static void Record(const char* name, int duration_ms);
+    static void PrintTable();
+    static std::string GetJson();
+};
+
+#endif // BOOT_PROFILE_H
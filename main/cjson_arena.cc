@@ -0,0 +1,104 @@
+#include "cjson_arena.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <cJSON.h>
+
+#include <cstdint>
+#include <cstdlib>
+
+#define TAG "CjsonArena"
+
+#define ARENA_ALIGN 8
+
+static thread_local CjsonArenaScope* current_scope = nullptr;
+
+static size_t AlignUp(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+CjsonArenaScope::CjsonArenaScope() : outer_(current_scope) {
+    current_scope = this;
+}
+
+CjsonArenaScope::~CjsonArenaScope() {
+    current_scope = outer_;
+    while (chunks_ != nullptr) {
+        Chunk* next = chunks_->next;
+        heap_caps_free(chunks_);
+        chunks_ = next;
+    }
+}
+
+void CjsonArenaScope::InstallHooks() {
+    cJSON_Hooks hooks = {
+        .malloc_fn = Malloc,
+        .free_fn = Free,
+    };
+    cJSON_InitHooks(&hooks);
+}
+
+void* CjsonArenaScope::Allocate(size_t size) {
+    size = AlignUp(size);
+    const size_t header = AlignUp(sizeof(Chunk));
+    if (chunks_ == nullptr || chunks_->used + size > chunks_->size) {
+        // Big strings get a chunk of their own behind the current one, which keeps its room
+        size_t chunk_size = header + size;
+        bool own = chunk_size > CONFIG_CJSON_ARENA_CHUNK_SIZE / 2;
+        if (!own) {
+            chunk_size = CONFIG_CJSON_ARENA_CHUNK_SIZE;
+        }
+        auto chunk = (Chunk*)heap_caps_malloc(chunk_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (chunk == nullptr) {
+            chunk = (Chunk*)heap_caps_malloc(chunk_size, MALLOC_CAP_8BIT);
+        }
+        if (chunk == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate a chunk of %u bytes", (unsigned)chunk_size);
+            return nullptr;
+        }
+        chunk->size = chunk_size;
+        chunk->used = header;
+        if (own && chunks_ != nullptr) {
+            chunk->next = chunks_->next;
+            chunks_->next = chunk;
+        } else {
+            chunk->next = chunks_;
+            chunks_ = chunk;
+        }
+        if (own) {
+            chunk->used = chunk_size;
+            return (uint8_t*)chunk + header;
+        }
+    }
+    void* ptr = (uint8_t*)chunks_ + chunks_->used;
+    chunks_->used += size;
+    return ptr;
+}
+
+bool CjsonArenaScope::Owns(const void* ptr) const {
+    for (const Chunk* chunk = chunks_; chunk != nullptr; chunk = chunk->next) {
+        if (ptr >= chunk && ptr < (const uint8_t*)chunk + chunk->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void* CjsonArenaScope::Malloc(size_t size) {
+    if (current_scope != nullptr) {
+        return current_scope->Allocate(size);
+    }
+    return malloc(size);
+}
+
+void CjsonArenaScope::Free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    for (auto scope = current_scope; scope != nullptr; scope = scope->outer_) {
+        if (scope->Owns(ptr)) {
+            return;
+        }
+    }
+    free(ptr);
+}
@@ -0,0 +1,52 @@
+#ifndef CJSON_ARENA_H
+#define CJSON_ARENA_H
+
+#include <cstddef>
+
+#include <sdkconfig.h>
+
+/*
+ * A bump arena for the cJSON trees of one message. While a scope is alive on a task, every
+ * cJSON allocation the task makes comes from chunks of CONFIG_CJSON_ARENA_CHUNK_SIZE (in PSRAM
+ * when there is some), cJSON_free() and cJSON_Delete() on them are no-ops, and the chunks are
+ * released together when the scope ends. Parsing a message and building its reply then costs
+ * a couple of heap calls instead of one per node, and leaves no fragments behind.
+ *
+ * Nothing allocated in a scope may outlive it or be freed by another task: only use it around
+ * code that parses, answers and deletes within the scope. Other tasks and code outside a scope
+ * keep using the heap. InstallHooks() is called once at boot.
+ */
+#if CONFIG_CJSON_ARENA
+class CjsonArenaScope {
+public:
+    CjsonArenaScope();
+    ~CjsonArenaScope();
+    CjsonArenaScope(const CjsonArenaScope&) = delete;
+    CjsonArenaScope& operator=(const CjsonArenaScope&) = delete;
+
+    static void InstallHooks();
+
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+        size_t used;
+    };
+
+    Chunk* chunks_ = nullptr;
+    // The scope this one is nested in, its allocations stay valid
+    CjsonArenaScope* outer_;
+
+    void* Allocate(size_t size);
+    bool Owns(const void* ptr) const;
+    static void* Malloc(size_t size);
+    static void Free(void* ptr);
+};
+#else
+class CjsonArenaScope {
+public:
+    static void InstallHooks() {}
+};
+#endif
+
+#endif // CJSON_ARENA_H
@@ -0,0 +1,316 @@
+#include "core_benchmark.h"
+#include "audio_service.h"
+#include "mcp_server.h"
+#include "afsk_demod.h"
+#include "assets/lang_config.h"
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#define TAG "CoreBenchmark"
+
+// Distinct inputs cycled through, so the encoder does not see the same frame over and over
+#define BENCHMARK_OPUS_FRAMES 16
+// Length of each AFSK step
+#define BENCHMARK_AFSK_STEP_MS 100
+// Give the idle task a tick after this much busy time
+#define BENCHMARK_YIELD_US 20000
+
+static const char kTtsMessage[] =
+    "{\"type\":\"tts\",\"state\":\"sentence_start\",\"session_id\":\"a3f1c6e2-9b7d-4c1e-8f21-5d0b7e3a9c44\","
+    "\"text\":\"Tomorrow will be sunny in the morning with some clouds in the afternoon, around 24 degrees.\"}";
+
+static const char kToolCallMessage[] =
+    "{\"type\":\"mcp\",\"session_id\":\"a3f1c6e2-9b7d-4c1e-8f21-5d0b7e3a9c44\",\"payload\":{\"jsonrpc\":\"2.0\","
+    "\"id\":42,\"method\":\"tools/call\",\"params\":{\"name\":\"self.audio_speaker.set_volume\","
+    "\"arguments\":{\"volume\":60}}}}";
+
+static const char kStatusResult[] =
+    "{\"audio_speaker\":{\"volume\":60},\"screen\":{\"brightness\":80,\"theme\":\"light\"},"
+    "\"battery\":{\"level\":76,\"charging\":false},\"network\":{\"type\":\"wifi\",\"ssid\":\"benchmark\","
+    "\"signal\":\"strong\"}}";
+
+template <typename Step>
+cJSON* CoreBenchmark::RunCase(cJSON* cases, const char* name, int case_ms, Step&& step) {
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)case_ms * 1000;
+    int64_t last_yield_us = start_us;
+    int64_t busy_us = 0;
+    int64_t max_us = 0;
+    int steps = 0;
+    int64_t now_us = start_us;
+    while (now_us < end_us) {
+        int64_t step_start_us = now_us;
+        step();
+        now_us = esp_timer_get_time();
+        busy_us += now_us - step_start_us;
+        max_us = std::max(max_us, now_us - step_start_us);
+        steps++;
+        // The yield is not counted in the step times
+        if (now_us - last_yield_us >= BENCHMARK_YIELD_US) {
+            vTaskDelay(1);
+            now_us = esp_timer_get_time();
+            last_yield_us = now_us;
+        }
+    }
+
+    double avg_us = steps > 0 ? (double)busy_us / steps : 0;
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "name", name);
+    cJSON_AddNumberToObject(result, "steps", steps);
+    cJSON_AddNumberToObject(result, "avg_us", avg_us);
+    cJSON_AddNumberToObject(result, "max_us", max_us);
+    cJSON_AddItemToArray(cases, result);
+    ESP_LOGI(TAG, "%s: %d steps, %.1f us avg, %lld us max", name, steps, avg_us, max_us);
+    return result;
+}
+
+static void AddRealtime(cJSON* result, int audio_ms) {
+    double avg_us = cJSON_GetObjectItem(result, "avg_us")->valuedouble;
+    // How many times faster than the audio plays
+    cJSON_AddNumberToObject(result, "realtime", avg_us > 0 ? audio_ms * 1000.0 / avg_us : 0);
+}
+
+void CoreBenchmark::RunOpus(cJSON* cases, int case_ms) {
+    OpusEncoderSettings settings;
+    esp_opus_enc_config_t enc_cfg = AS_OPUS_ENC_CONFIG(settings);
+    void* encoder = nullptr;
+    esp_opus_enc_open(&enc_cfg, sizeof(esp_opus_enc_config_t), &encoder);
+    if (encoder == nullptr) {
+        ESP_LOGE(TAG, "Failed to open the Opus encoder");
+        return;
+    }
+    int frame_bytes = 0, outbuf_size = 0;
+    esp_opus_enc_get_frame_size(encoder, &frame_bytes, &outbuf_size);
+    size_t frame_samples = frame_bytes / sizeof(int16_t);
+
+    // A voiced 150 Hz harmonic series with a syllable rate envelope and some noise
+    std::vector<int16_t> pcm(frame_samples * BENCHMARK_OPUS_FRAMES);
+    uint32_t noise = 12345;
+    for (size_t i = 0; i < pcm.size(); i++) {
+        float t = (float)i / 16000;
+        float envelope = 0.5f + 0.5f * sinf(2 * M_PI * 4 * t);
+        float voice = 0;
+        for (int harmonic = 1; harmonic <= 8; harmonic++) {
+            voice += sinf(2 * M_PI * 150 * harmonic * t) / harmonic;
+        }
+        noise = noise * 1664525 + 1013904223;
+        pcm[i] = (int16_t)(6000 * envelope * voice + (int16_t)(noise >> 16) / 32);
+    }
+
+    std::vector<std::vector<uint8_t>> packets(BENCHMARK_OPUS_FRAMES);
+    std::vector<uint8_t> outbuf(outbuf_size);
+    int frame = 0;
+    size_t encoded_bytes = 0;
+    auto encode = RunCase(cases, "opus_encode", case_ms, [&]() {
+        esp_audio_enc_in_frame_t in = {
+            .buffer = (uint8_t*)(pcm.data() + frame * frame_samples),
+            .len = (uint32_t)frame_bytes,
+        };
+        esp_audio_enc_out_frame_t out = {
+            .buffer = outbuf.data(),
+            .len = (uint32_t)outbuf.size(),
+            .encoded_bytes = 0,
+        };
+        if (esp_opus_enc_process(encoder, &in, &out) == ESP_AUDIO_ERR_OK) {
+            packets[frame].assign(outbuf.begin(), outbuf.begin() + out.encoded_bytes);
+            encoded_bytes += out.encoded_bytes;
+        }
+        frame = (frame + 1) % BENCHMARK_OPUS_FRAMES;
+    });
+    AddRealtime(encode, settings.frame_duration_ms);
+    int steps = cJSON_GetObjectItem(encode, "steps")->valueint;
+    cJSON_AddNumberToObject(encode, "avg_packet_bytes", steps > 0 ? encoded_bytes / steps : 0);
+    esp_opus_enc_close(encoder);
+
+    esp_opus_dec_cfg_t dec_cfg = {
+        .sample_rate = ESP_AUDIO_SAMPLE_RATE_16K,
+        .channel = ESP_AUDIO_MONO,
+        .frame_duration = (esp_opus_dec_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(settings.frame_duration_ms),
+        .self_delimited = false,
+    };
+    void* decoder = nullptr;
+    esp_opus_dec_open(&dec_cfg, sizeof(esp_opus_dec_cfg_t), &decoder);
+    if (decoder == nullptr) {
+        ESP_LOGE(TAG, "Failed to open the Opus decoder");
+        return;
+    }
+    std::vector<int16_t> decoded(frame_samples);
+    frame = 0;
+    auto decode = RunCase(cases, "opus_decode", case_ms, [&]() {
+        esp_audio_dec_in_raw_t raw = {
+            .buffer = packets[frame].data(),
+            .len = (uint32_t)packets[frame].size(),
+            .consumed = 0,
+            .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
+        };
+        esp_audio_dec_out_frame_t out = {
+            .buffer = (uint8_t*)decoded.data(),
+            .len = (uint32_t)(decoded.size() * sizeof(int16_t)),
+            .decoded_size = 0,
+        };
+        esp_audio_dec_info_t info = {};
+        esp_opus_dec_decode(decoder, &raw, &out, &info);
+        frame = (frame + 1) % BENCHMARK_OPUS_FRAMES;
+    });
+    AddRealtime(decode, settings.frame_duration_ms);
+    esp_opus_dec_close(decoder);
+}
+
+void CoreBenchmark::RunOggDemux(cJSON* cases, int case_ms) {
+    std::string_view ogg = Lang::Sounds::OGG_POPUP;
+    if (ogg.empty()) {
+        return;
+    }
+    // The demuxer holds an 8 KB packet buffer, keep it off the stack
+    auto demuxer = std::make_unique<OggDemuxer>();
+    size_t packets = 0;
+    demuxer->OnDemuxerFinished([&packets](const uint8_t* data, int sample_rate, size_t len) {
+        packets++;
+    });
+    auto result = RunCase(cases, "ogg_demux", case_ms, [&]() {
+        demuxer->Reset();
+        demuxer->Process(reinterpret_cast<const uint8_t*>(ogg.data()), ogg.size());
+    });
+    double avg_us = cJSON_GetObjectItem(result, "avg_us")->valuedouble;
+    int steps = cJSON_GetObjectItem(result, "steps")->valueint;
+    cJSON_AddNumberToObject(result, "bytes", ogg.size());
+    cJSON_AddNumberToObject(result, "packets", steps > 0 ? packets / steps : 0);
+    cJSON_AddNumberToObject(result, "mb_per_s", avg_us > 0 ? ogg.size() / avg_us : 0);
+}
+
+void CoreBenchmark::RunQueueHandoff(cJSON* cases, int case_ms) {
+    struct Handoff {
+        SpscRing<int64_t> ring{16};
+        TaskHandle_t consumer;
+        std::atomic<bool> stop{false};
+        SemaphoreHandle_t done;
+    } handoff;
+    handoff.consumer = xTaskGetCurrentTaskHandle();
+    handoff.done = xSemaphoreCreateBinary();
+
+    // The producer runs at the priority of the benchmark, like the audio tasks among each other
+    TaskManifest::Create("bench_producer", [](void* arg) {
+        auto handoff = static_cast<Handoff*>(arg);
+        while (!handoff->stop) {
+            handoff->ring.Push(esp_timer_get_time());
+            xTaskNotifyGive(handoff->consumer);
+            vTaskDelay(1);
+        }
+        xSemaphoreGive(handoff->done);
+        TaskManifest::Exit();
+    }, &handoff);
+
+    int count = 0;
+    int64_t total_us = 0, max_us = 0;
+    int64_t end_us = esp_timer_get_time() + (int64_t)case_ms * 1000;
+    while (esp_timer_get_time() < end_us) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+        int64_t pushed_us;
+        while (handoff.ring.Pop(pushed_us)) {
+            int64_t latency_us = esp_timer_get_time() - pushed_us;
+            total_us += latency_us;
+            max_us = std::max(max_us, latency_us);
+            count++;
+        }
+    }
+    handoff.stop = true;
+    xSemaphoreTake(handoff.done, portMAX_DELAY);
+    vSemaphoreDelete(handoff.done);
+
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "name", "queue_handoff");
+    cJSON_AddNumberToObject(result, "steps", count);
+    cJSON_AddNumberToObject(result, "avg_us", count > 0 ? (double)total_us / count : 0);
+    cJSON_AddNumberToObject(result, "max_us", max_us);
+    cJSON_AddItemToArray(cases, result);
+    ESP_LOGI(TAG, "queue_handoff: %d steps, %lld us max", count, max_us);
+}
+
+void CoreBenchmark::RunJson(cJSON* cases, int case_ms) {
+    auto parse = RunCase(cases, "json_parse", case_ms, []() {
+        cJSON_Delete(cJSON_Parse(kTtsMessage));
+        cJSON_Delete(cJSON_Parse(kToolCallMessage));
+    });
+    cJSON_AddNumberToObject(parse, "bytes", sizeof(kTtsMessage) + sizeof(kToolCallMessage) - 2);
+
+    // What a tools/call costs on the device besides the tool itself
+    size_t reply_bytes = 0;
+    auto dispatch = RunCase(cases, "mcp_dispatch", case_ms, [&reply_bytes]() {
+        cJSON* root = cJSON_Parse(kToolCallMessage);
+        auto payload = cJSON_GetObjectItem(root, "payload");
+        auto params = cJSON_GetObjectItem(payload, "params");
+        auto name = cJSON_GetObjectItem(params, "name");
+        auto arguments = cJSON_GetObjectItem(params, "arguments");
+        auto volume = cJSON_GetObjectItem(arguments, "volume");
+        if (cJSON_IsString(name) && cJSON_IsNumber(volume)) {
+            reply_bytes = McpTool::FormatResult(std::string(kStatusResult)).size();
+        }
+        cJSON_Delete(root);
+    });
+    cJSON_AddNumberToObject(dispatch, "reply_bytes", reply_bytes);
+}
+
+void CoreBenchmark::RunAfsk(cJSON* cases, int case_ms) {
+    using namespace audio_wifi_config;
+    // Alternating bytes at the bit rate, with a continuous phase like the sender
+    const size_t samples_per_bit = kAudioSampleRate / kBitRate;
+    std::vector<int16_t> pcm(kAudioSampleRate * BENCHMARK_AFSK_STEP_MS / 1000);
+    float phase = 0;
+    for (size_t i = 0; i < pcm.size(); i++) {
+        size_t bit = i / samples_per_bit;
+        bool mark = (0x5a >> (bit % 8)) & 1;
+        phase += 2 * M_PI * (mark ? kMarkFrequency : kSpaceFrequency) / kAudioSampleRate;
+        pcm[i] = (int16_t)(8000 * sinf(phase));
+    }
+
+    AudioSignalProcessor processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate);
+    std::vector<float> probabilities;
+    auto result = RunCase(cases, "afsk_demod", case_ms, [&]() {
+        processor.ProcessAudioSamples(pcm.data(), pcm.size(), 1, probabilities);
+    });
+    AddRealtime(result, BENCHMARK_AFSK_STEP_MS);
+}
+
+std::string CoreBenchmark::Run(int case_ms) {
+    struct Job {
+        int case_ms;
+        std::string result;
+        SemaphoreHandle_t done;
+    } job = {case_ms, "", xSemaphoreCreateBinary()};
+
+    TaskManifest::Create("core_bench", [](void* arg) {
+        auto job = static_cast<Job*>(arg);
+        cJSON* root = cJSON_CreateObject();
+        cJSON* cases = cJSON_CreateArray();
+        RunOpus(cases, job->case_ms);
+        RunOggDemux(cases, job->case_ms);
+        RunQueueHandoff(cases, job->case_ms);
+        RunJson(cases, job->case_ms);
+        RunAfsk(cases, job->case_ms);
+        cJSON_AddItemToObject(root, "cases", cases);
+        cJSON_AddNumberToObject(root, "case_ms", job->case_ms);
+
+        auto json_str = cJSON_PrintUnformatted(root);
+        job->result = json_str;
+        cJSON_free(json_str);
+        cJSON_Delete(root);
+        xSemaphoreGive(job->done);
+        TaskManifest::Exit();
+    }, &job);
+
+    xSemaphoreTake(job.done, portMAX_DELAY);
+    vSemaphoreDelete(job.done);
+    return job.result;
+}
@@ -0,0 +1,33 @@
+#ifndef CORE_BENCHMARK_H
+#define CORE_BENCHMARK_H
+
+#include <cJSON.h>
+
+#include <string>
+
+/*
+ * Micro-benchmarks of the hot paths that do not need a conversation: Opus encode and decode
+ * of the uplink format, Ogg demuxing of a prompt, the SPSC queue handoff between two tasks,
+ * cJSON parsing of protocol messages, MCP result formatting and the AFSK demodulator. Each
+ * case runs on synthetic input for about case_ms and reports the time per step, so firmware
+ * versions and boards can be compared for regressions. Run it while idle, the cases run on a
+ * task of their own with the stack of the Opus encoder task.
+ */
+class CoreBenchmark {
+public:
+    // The results as JSON
+    static std::string Run(int case_ms);
+
+private:
+    // Calls step until case_ms passed, the case with its step count and time per step
+    template <typename Step>
+    static cJSON* RunCase(cJSON* cases, const char* name, int case_ms, Step&& step);
+
+    static void RunOpus(cJSON* cases, int case_ms);
+    static void RunOggDemux(cJSON* cases, int case_ms);
+    static void RunQueueHandoff(cJSON* cases, int case_ms);
+    static void RunJson(cJSON* cases, int case_ms);
+    static void RunAfsk(cJSON* cases, int case_ms);
+};
+
+#endif // CORE_BENCHMARK_H
@@ -2,9 +2,13 @@
 
 #include <algorithm>
 #include <esp_log.h>
+#include <esp_timer.h>
 
 static const char* TAG = "StateMachine";
 
+// Listeners run on the transition path, anything slower than this is worth a warning
+#define SLOW_LISTENER_US 2000
+
 // State name strings for logging
 static const char* const STATE_STRINGS[] = {
     "unknown",
@@ -130,32 +134,63 @@ bool DeviceStateMachine::TransitionTo(DeviceState new_state) {
     return true;
 }
 
-int DeviceStateMachine::AddStateChangeListener(StateCallback callback) {
+int DeviceStateMachine::AddStateChangeListener(StateCallback callback, bool deferred) {
     std::lock_guard<std::mutex> lock(mutex_);
     int id = next_listener_id_++;
-    listeners_.emplace_back(id, std::move(callback));
+    auto listeners = std::make_shared<ListenerList>(*listeners_);
+    listeners->push_back({id, deferred, std::move(callback)});
+    listeners_ = std::move(listeners);
     return id;
 }
 
 void DeviceStateMachine::RemoveStateChangeListener(int listener_id) {
     std::lock_guard<std::mutex> lock(mutex_);
-    listeners_.erase(
-        std::remove_if(listeners_.begin(), listeners_.end(),
-            [listener_id](const auto& p) { return p.first == listener_id; }),
-        listeners_.end());
+    auto listeners = std::make_shared<ListenerList>(*listeners_);
+    listeners->erase(
+        std::remove_if(listeners->begin(), listeners->end(),
+            [listener_id](const auto& listener) { return listener.id == listener_id; }),
+        listeners->end());
+    listeners_ = std::move(listeners);
 }
 
-void DeviceStateMachine::NotifyStateChange(DeviceState old_state, DeviceState new_state) {
-    std::vector<StateCallback> callbacks_copy;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        callbacks_copy.reserve(listeners_.size());
-        for (const auto& [id, cb] : listeners_) {
-            callbacks_copy.push_back(cb);
+void DeviceStateMachine::SetDeferredDispatcher(DeferredDispatcher dispatcher) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    deferred_dispatcher_ = std::move(dispatcher);
+}
+
+std::shared_ptr<const DeviceStateMachine::ListenerList> DeviceStateMachine::GetListeners() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return listeners_;
+}
+
+void DeviceStateMachine::InvokeListener(const Listener& listener, DeviceState old_state, DeviceState new_state) {
+    int64_t start_us = esp_timer_get_time();
+    listener.callback(old_state, new_state);
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    if (elapsed_us > SLOW_LISTENER_US) {
+        ESP_LOGW(TAG, "Slow %s listener %d took %d us on %s -> %s", listener.deferred ? "deferred" : "state",
+                 listener.id, (int)elapsed_us, GetStateName(old_state), GetStateName(new_state));
+    }
+}
+
+void DeviceStateMachine::RunDeferredListener(int listener_id, DeviceState old_state, DeviceState new_state) {
+    auto listeners = GetListeners();
+    for (const auto& listener : *listeners) {
+        if (listener.id == listener_id) {
+            InvokeListener(listener, old_state, new_state);
+            return;
         }
     }
-    
-    for (const auto& cb : callbacks_copy) {
-        cb(old_state, new_state);
+}
+
+void DeviceStateMachine::NotifyStateChange(DeviceState old_state, DeviceState new_state) {
+    /* The snapshot is only a reference count, listeners are never copied on the transition path */
+    auto listeners = GetListeners();
+    for (const auto& listener : *listeners) {
+        if (listener.deferred && deferred_dispatcher_) {
+            deferred_dispatcher_(listener.id, old_state, new_state);
+        } else {
+            InvokeListener(listener, old_state, new_state);
+        }
     }
 }
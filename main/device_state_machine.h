@@ -3,6 +3,7 @@
 
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -48,16 +49,34 @@ public:
 
     /**
      * Add a state change listener (observer pattern)
-     * Callback is invoked in the context of the caller of TransitionTo()
+     * Callback is invoked in the context of the caller of TransitionTo(), unless deferred is set,
+     * then it is handed to the deferred dispatcher and RunDeferredListener() invokes it later
      * @return listener id for removal
      */
-    int AddStateChangeListener(StateCallback callback);
+    int AddStateChangeListener(StateCallback callback, bool deferred = false);
 
     /**
      * Remove a state change listener by id
      */
     void RemoveStateChangeListener(int listener_id);
 
+    /**
+     * Deferred dispatcher type
+     * Parameters: listener_id, old_state, new_state, to be passed to RunDeferredListener()
+     */
+    using DeferredDispatcher = std::function<void(int, DeviceState, DeviceState)>;
+
+    /**
+     * Set how deferred listeners are queued, e.g. to a task queue of lower priority
+     * Without a dispatcher deferred listeners run synchronously, set it before the first transition
+     */
+    void SetDeferredDispatcher(DeferredDispatcher dispatcher);
+
+    /**
+     * Invoke a deferred listener, does nothing if it has been removed meanwhile
+     */
+    void RunDeferredListener(int listener_id, DeviceState old_state, DeviceState new_state);
+
     /**
      * Get state name string for logging
      */
@@ -65,17 +84,29 @@ public:
 
 private:
     std::atomic<DeviceState> current_state_{kDeviceStateUnknown};
-    std::vector<std::pair<int, StateCallback>> listeners_;
+    struct Listener {
+        int id;
+        bool deferred;
+        StateCallback callback;
+    };
+    using ListenerList = std::vector<Listener>;
+
+    // Copy-on-write, a notification keeps the snapshot it started with alive
+    std::shared_ptr<const ListenerList> listeners_ = std::make_shared<const ListenerList>();
+    DeferredDispatcher deferred_dispatcher_;
     int next_listener_id_{0};
     std::mutex mutex_;
 
+    std::shared_ptr<const ListenerList> GetListeners();
+    void InvokeListener(const Listener& listener, DeviceState old_state, DeviceState new_state);
+
     /**
      * Check if transition from source to target is valid
      */
     bool IsValidTransition(DeviceState from, DeviceState to) const;
 
     /**
-     * Notify callback of state change
+     * Notify listeners of state change
      */
     void NotifyStateChange(DeviceState old_state, DeviceState new_state);
 };
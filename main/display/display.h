@@ -2,6 +2,7 @@
 #define DISPLAY_H
 
 #include "emoji_collection.h"
+#include "small_function.h"
 
 #ifndef CONFIG_USE_EMOTE_MESSAGE_STYLE
 #define HAVE_LVGL 1
@@ -28,6 +29,26 @@ private:
     std::string name_;
 };
 
+// A UI update to run on the render task
+using DisplayCommand = SmallFunction<void(), 48>;
+
+// A queued command with the same key is replaced, so only the latest update is drawn
+enum DisplayCommandKey {
+    kDisplayCommandKeyNone,
+    kDisplayCommandKeyAssistantMessage,
+    kDisplayCommandKeyUserMessage,
+    kDisplayCommandKeyEmotion,
+    kDisplayCommandKeyFrameRate,
+    kDisplayCommandKeyPreviewImage,
+};
+
+// How often the UI is redrawn, chosen by the device state
+enum DisplayFrameRate {
+    kDisplayFrameRateFull,
+    // Nothing but the status bar changes, animations still run at the full rate
+    kDisplayFrameRateIdle,
+};
+
 class Display {
 public:
     Display();
@@ -38,14 +59,20 @@ public:
     virtual void ShowNotification(const std::string &notification, int duration_ms = 3000);
     virtual void SetEmotion(const char* emotion);
     virtual void SetChatMessage(const char* role, const char* content);
+    // Continues the last message of the role, displays that show a single subtitle just replace it
+    virtual void AppendChatMessage(const char* role, const char* delta);
     virtual void ClearChatMessages();
     virtual void SetTheme(Theme* theme);
     virtual Theme* GetTheme() { return current_theme_; }
     virtual void UpdateStatusBar(bool update_all = false);
     virtual void SetPowerSaveMode(bool on);
+    // Displays without a render task draw on every update and ignore it
+    virtual void SetFrameRate(DisplayFrameRate rate) {}
     virtual void SetupUI() { 
         setup_ui_called_ = true;
     }
+    // Runs the command where the UI is drawn, displays without a render task run it right away
+    virtual void Post(DisplayCommand&& command, DisplayCommandKey key = kDisplayCommandKeyNone) { command(); }
 
     inline int width() const { return width_; }
     inline int height() const { return height_; }
@@ -0,0 +1,212 @@
+#include "display_benchmark.h"
+#include "lcd_display.h"
+#include "oled_display.h"
+#include "lvgl_theme.h"
+#include "board.h"
+#if CONFIG_DISPLAY_PPA_DRAW_UNIT
+#include "ppa_draw_unit.h"
+#endif
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define TAG "DisplayBenchmark"
+
+static const char* const kBenchmarkEmotions[] = {
+    "happy", "laughing", "thinking", "surprised", "sleepy", "winking", "crying", "neutral",
+};
+
+static const char* const kBenchmarkMessages[] = {
+    "Hello, what can you do?",
+    "I can chat with you, answer questions and control the devices around you.",
+    "What is the weather like tomorrow?",
+    "Tomorrow will be sunny in the morning with some clouds in the afternoon, around 24 degrees.",
+};
+
+const char* DisplayBenchmark::DriverName() const {
+    if (dynamic_cast<SpiLcdDisplay*>(display_) != nullptr) {
+        return "SpiLcdDisplay";
+    }
+    if (dynamic_cast<RgbLcdDisplay*>(display_) != nullptr) {
+        return "RgbLcdDisplay";
+    }
+    if (dynamic_cast<MipiLcdDisplay*>(display_) != nullptr) {
+        return "MipiLcdDisplay";
+    }
+    if (dynamic_cast<OledDisplay*>(display_) != nullptr) {
+        return "OledDisplay";
+    }
+    return "LvglDisplay";
+}
+
+template <typename Step>
+void DisplayBenchmark::RunPhase(cJSON* phases, const char* name, int phase_ms, int step_ms, Step&& step) {
+    // Let the previous phase flush, then count only this one
+    vTaskDelay(pdMS_TO_TICKS(100));
+    display_->GetFrameStats(true);
+
+    size_t free_start = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t free_min = free_start;
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)phase_ms * 1000;
+    int steps = 0;
+    while (esp_timer_get_time() < end_us) {
+        step(steps++);
+        free_min = std::min(free_min, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        vTaskDelay(pdMS_TO_TICKS(step_ms));
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    auto stats = display_->GetFrameStats(true);
+
+    uint32_t frames = std::max<uint32_t>(stats.frames, 1);
+    cJSON* phase = cJSON_CreateObject();
+    cJSON_AddStringToObject(phase, "name", name);
+    cJSON_AddNumberToObject(phase, "steps", steps);
+    cJSON_AddNumberToObject(phase, "frames", stats.frames);
+    cJSON_AddNumberToObject(phase, "fps", stats.frames * 1000000.0 / elapsed_us);
+    cJSON_AddNumberToObject(phase, "render_avg_us", stats.render_us / frames);
+    cJSON_AddNumberToObject(phase, "render_max_us", stats.render_max_us);
+    cJSON_AddNumberToObject(phase, "flush_wait_avg_us", stats.flush_wait_us / frames);
+    cJSON_AddNumberToObject(phase, "flush_wait_max_us", stats.flush_wait_max_us);
+    // LVGL allocates from the system heap, this is the most the phase had in use at once
+    cJSON_AddNumberToObject(phase, "heap_peak_bytes", free_start > free_min ? free_start - free_min : 0);
+    cJSON_AddItemToArray(phases, phase);
+    ESP_LOGI(TAG, "%s: %lu frames, %.1f fps", name, (unsigned long)stats.frames, stats.frames * 1000000.0 / elapsed_us);
+}
+
+std::string DisplayBenchmark::Run(int phase_ms) {
+    ESP_LOGI(TAG, "Running display benchmark, %d ms per phase", phase_ms);
+    auto original_theme = display_->GetTheme();
+    // Measured at the full rate, the benchmark only runs while idle
+    display_->SetFrameRate(kDisplayFrameRateFull);
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "board", Board::GetInstance().GetBoardType().c_str());
+    cJSON_AddStringToObject(root, "driver", DriverName());
+    cJSON_AddNumberToObject(root, "width", display_->width());
+    cJSON_AddNumberToObject(root, "height", display_->height());
+    cJSON_AddNumberToObject(root, "phase_ms", phase_ms);
+#if CONFIG_DISPLAY_PPA_DRAW_UNIT
+    cJSON_AddStringToObject(root, "draw_unit", "ppa");
+    uint32_t ppa_completed = PpaDrawUnit::completed();
+    uint32_t ppa_fallbacks = PpaDrawUnit::fallbacks();
+#elif CONFIG_LV_DRAW_SW_ASM_CUSTOM
+    cJSON_AddStringToObject(root, "draw_unit", "sw_simd");
+#else
+    cJSON_AddStringToObject(root, "draw_unit", "sw");
+#endif
+    cJSON* phases = cJSON_AddArrayToObject(root, "phases");
+
+    RunPhase(phases, "chat", phase_ms, 50, [this](int step) {
+        const char* role = step % 2 == 0 ? "user" : "assistant";
+        display_->SetChatMessage(role, kBenchmarkMessages[step % (sizeof(kBenchmarkMessages) / sizeof(kBenchmarkMessages[0]))]);
+    });
+
+    RunPhase(phases, "emotion", phase_ms, 500, [this](int step) {
+        display_->SetEmotion(kBenchmarkEmotions[step % (sizeof(kBenchmarkEmotions) / sizeof(kBenchmarkEmotions[0]))]);
+    });
+
+    auto light = LvglThemeManager::GetInstance().GetTheme("light");
+    auto dark = LvglThemeManager::GetInstance().GetTheme("dark");
+    if (light != nullptr && dark != nullptr) {
+        RunPhase(phases, "theme", phase_ms, 250, [this, light, dark](int step) {
+            display_->SetTheme(step % 2 == 0 ? dark : light);
+        });
+    }
+
+    int preview_width = std::max(display_->width() / 2, 1);
+    int preview_height = std::max(display_->height() / 2, 1);
+    RunPhase(phases, "preview", phase_ms, 100, [this, preview_width, preview_height](int step) {
+        size_t stride = preview_width * 2;
+        size_t size = stride * preview_height;
+        auto data = static_cast<uint16_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+        if (data == nullptr) {
+            data = static_cast<uint16_t*>(heap_caps_malloc(size, MALLOC_CAP_8BIT));
+        }
+        if (data == nullptr) {
+            return;
+        }
+        // A gradient moving with the step, so every frame differs
+        for (int y = 0; y < preview_height; y++) {
+            for (int x = 0; x < preview_width; x++) {
+                data[y * preview_width + x] = (uint16_t)(((x + step * 8) & 0x1F) << 11 | ((y + step * 4) & 0x3F) << 5 | (step & 0x1F));
+            }
+        }
+        display_->SetPreviewImage(std::make_unique<LvglAllocatedImage>(data, size, preview_width, preview_height,
+                                                                       stride, LV_COLOR_FORMAT_RGB565));
+    });
+
+    // An image turned and scaled in place, what a draw unit with a hardware blitter takes over
+    int transform_size = std::max(std::min(display_->width(), display_->height()) / 4, 16);
+    size_t transform_stride = transform_size * 2;
+    auto transform_data = static_cast<uint16_t*>(heap_caps_malloc(transform_stride * transform_size,
+                                                                  MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (transform_data == nullptr) {
+        transform_data = static_cast<uint16_t*>(heap_caps_malloc(transform_stride * transform_size, MALLOC_CAP_8BIT));
+    }
+    if (transform_data != nullptr) {
+        for (int y = 0; y < transform_size; y++) {
+            for (int x = 0; x < transform_size; x++) {
+                transform_data[y * transform_size + x] = (uint16_t)((x & 0x1F) << 11 | (y & 0x3F) << 5 | ((x + y) & 0x1F));
+            }
+        }
+        lv_image_dsc_t transform_dsc = {};
+        transform_dsc.header.magic = LV_IMAGE_HEADER_MAGIC;
+        transform_dsc.header.cf = LV_COLOR_FORMAT_RGB565;
+        transform_dsc.header.w = transform_size;
+        transform_dsc.header.h = transform_size;
+        transform_dsc.header.stride = transform_stride;
+        transform_dsc.data_size = transform_stride * transform_size;
+        transform_dsc.data = reinterpret_cast<const uint8_t*>(transform_data);
+        lv_obj_t* transform_image = nullptr;
+        {
+            DisplayLockGuard lock(display_);
+            transform_image = lv_image_create(lv_layer_top());
+            lv_image_set_src(transform_image, &transform_dsc);
+            lv_obj_center(transform_image);
+        }
+        RunPhase(phases, "transform", phase_ms, 50, [this, transform_image](int step) {
+            DisplayLockGuard lock(display_);
+            lv_image_set_rotation(transform_image, (step % 4) * 900);
+            lv_image_set_scale(transform_image, step % 8 < 4 ? LV_SCALE_NONE : LV_SCALE_NONE * 2);
+        });
+        {
+            DisplayLockGuard lock(display_);
+            lv_obj_delete(transform_image);
+        }
+        heap_caps_free(transform_data);
+    }
+
+    RunPhase(phases, "status", phase_ms, 100, [this](int step) {
+        if (step % 10 == 0) {
+            display_->ShowNotification("Benchmark", 500);
+        }
+        display_->UpdateStatusBar(true);
+    });
+
+    // Restore the UI
+    display_->SetPreviewImage(nullptr);
+    display_->ClearChatMessages();
+    display_->SetEmotion("neutral");
+    if (original_theme != nullptr && original_theme != display_->GetTheme()) {
+        display_->SetTheme(original_theme);
+    }
+    display_->SetFrameRate(kDisplayFrameRateIdle);
+#if CONFIG_DISPLAY_PPA_DRAW_UNIT
+    cJSON_AddNumberToObject(root, "ppa_tasks", PpaDrawUnit::completed() - ppa_completed);
+    cJSON_AddNumberToObject(root, "ppa_fallbacks", PpaDrawUnit::fallbacks() - ppa_fallbacks);
+#endif
+
+    char* json = cJSON_PrintUnformatted(root);
+    std::string result(json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+    ESP_LOGI(TAG, "Result: %s", result.c_str());
+    return result;
+}
@@ -0,0 +1,31 @@
+#ifndef DISPLAY_BENCHMARK_H
+#define DISPLAY_BENCHMARK_H
+
+#include "lvgl_display.h"
+
+#include <cJSON.h>
+
+#include <string>
+
+/*
+ * Drives the same UI updates on every LVGL display, so panel drivers can be compared across
+ * boards and releases. Each phase runs for phase_ms on the calling task and is reported with
+ * the frame rate, render and flush wait time from the frame trace and the heap low mark.
+ * The chat, emotion, theme and preview are restored afterwards. Run it while idle.
+ */
+class DisplayBenchmark {
+public:
+    explicit DisplayBenchmark(LvglDisplay* display) : display_(display) {}
+
+    // The results as JSON
+    std::string Run(int phase_ms);
+
+private:
+    LvglDisplay* display_;
+
+    template <typename Step>
+    void RunPhase(cJSON* phases, const char* name, int phase_ms, int step_ms, Step&& step);
+    const char* DriverName() const;
+};
+
+#endif // DISPLAY_BENCHMARK_H
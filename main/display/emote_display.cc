@@ -14,6 +14,7 @@
 
 // ESP-IDF headers
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <esp_lcd_panel_io.h>
 #include <esp_timer.h>
 #include <lvgl.h>
@@ -78,10 +79,16 @@ static emote_handle_t InitializeEmote(const esp_lcd_panel_handle_t panel, const
         return nullptr;
     }
 
+    // Frames are decoded from the mmapped assets partition into these strips. Without PSRAM a
+    // single, shorter strip leaves the internal RAM to long dialog animations.
+    const bool has_psram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+    const int strip_lines = has_psram ? 16 : 10;
+    ESP_LOGI(TAG, "Emote strips: %d lines, %s buffered", strip_lines, has_psram ? "double" : "single");
+
     emote_config_t emote_cfg = {
         .flags = {
             .swap = true,
-            .double_buffer = true,
+            .double_buffer = has_psram,
             .buff_dma = false,
         },
         .gfx_emote = {
@@ -90,7 +97,7 @@ static emote_handle_t InitializeEmote(const esp_lcd_panel_handle_t panel, const
             .fps = 30,
         },
         .buffers = {
-            .buf_pixels = static_cast<size_t>(width * 16),
+            .buf_pixels = static_cast<size_t>(width * strip_lines),
         },
         .task = {
             .task_priority = 5,
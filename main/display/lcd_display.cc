@@ -2,6 +2,7 @@
 #include "gif/lvgl_gif.h"
 #include "settings.h"
 #include "lvgl_theme.h"
+#include "marquee_label.h"
 #include "assets/lang_config.h"
 
 #include <vector>
@@ -10,14 +11,20 @@
 #include <esp_log.h>
 #include <esp_err.h>
 #include <esp_lvgl_port.h>
-#include <esp_psram.h>
+#include <esp_heap_caps.h>
 #include <cstring>
 #include <src/misc/cache/lv_cache.h>
 
 #include "board.h"
+#if CONFIG_DISPLAY_PPA_DRAW_UNIT
+#include "ppa_draw_unit.h"
+#endif
 
 #define TAG "LcdDisplay"
 
+// Rows of a viewfinder frame sent per panel draw
+#define VIEWFINDER_STRIPE_LINES 16
+
 LV_FONT_DECLARE(BUILTIN_TEXT_FONT);
 LV_FONT_DECLARE(BUILTIN_ICON_FONT);
 LV_FONT_DECLARE(font_awesome_30_4);
@@ -90,7 +97,8 @@ LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_
 }
 
 SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
-                           int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy)
+                           int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy,
+                           int draw_buffer_lines, bool double_buffer)
     : LcdDisplay(panel_io, panel, width, height) {
 
     // draw white
@@ -112,18 +120,10 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 
     ESP_LOGI(TAG, "Initialize LVGL library");
     lv_init();
-
-#if CONFIG_SPIRAM
-    // lv image cache, currently only PNG is supported
-    size_t psram_size_mb = esp_psram_get_size() / 1024 / 1024;
-    if (psram_size_mb >= 8) {
-        lv_image_cache_resize(2 * 1024 * 1024, true);
-        ESP_LOGI(TAG, "Use 2MB of PSRAM for image cache");
-    } else if (psram_size_mb >= 2) {
-        lv_image_cache_resize(512 * 1024, true);
-        ESP_LOGI(TAG, "Use 512KB of PSRAM for image cache");
-    }
+#if CONFIG_DISPLAY_PPA_DRAW_UNIT
+    PpaDrawUnit::Install();
 #endif
+    LvglImageCache::Setup();
 
     ESP_LOGI(TAG, "Initialize LVGL port");
     lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
@@ -133,13 +133,14 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 #endif
     lvgl_port_init(&port_cfg);
 
-    ESP_LOGI(TAG, "Adding LCD display");
-    const lvgl_port_display_cfg_t display_cfg = {
+    ESP_LOGI(TAG, "Adding LCD display, %d lines per draw buffer%s", draw_buffer_lines, double_buffer ? " x2" : "");
+    /* With two buffers LVGL renders the next stripe while the SPI DMA still sends the last one */
+    lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
         .control_handle = nullptr,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
-        .double_buffer = false,
+        .buffer_size = static_cast<uint32_t>(width_ * std::min(draw_buffer_lines, height_)),
+        .double_buffer = double_buffer,
         .trans_size = 0,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
@@ -161,6 +162,11 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     };
 
     display_ = lvgl_port_add_disp(&display_cfg);
+    if (display_ == nullptr && double_buffer) {
+        ESP_LOGW(TAG, "Not enough internal RAM for two draw buffers, using one");
+        display_cfg.double_buffer = false;
+        display_ = lvgl_port_add_disp(&display_cfg);
+    }
     if (display_ == nullptr) {
         ESP_LOGE(TAG, "Failed to add display");
         return;
@@ -169,6 +175,91 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
     }
+    offset_x_ = offset_x;
+    offset_y_ = offset_y;
+#if CONFIG_DISPLAY_FRAME_TRACE
+    StartFrameTrace();
+#endif
+}
+
+bool SpiLcdDisplay::DrawViewfinderFrame(const uint8_t* pixels, int width, int height, bool big_endian) {
+    int max_width, max_height;
+    GetPreviewImageSize(max_width, max_height);
+    int factor = 1;
+    while (width / factor > max_width || height / factor > max_height) {
+        factor++;
+    }
+    int out_width = width / factor;
+    int out_height = height / factor;
+    if (out_width == 0 || out_height == 0) {
+        return false;
+    }
+    int x0 = (width_ - out_width) / 2 + offset_x_;
+    int y0 = (height_ - out_height) / 2 + offset_y_;
+    const uint16_t* src = reinterpret_cast<const uint16_t*>(pixels);
+
+    DisplayLockGuard lock(this);
+    if (viewfinder_stripes_[0] == nullptr) {
+        size_t stripe_size = width_ * VIEWFINDER_STRIPE_LINES * sizeof(uint16_t);
+        for (auto& stripe : viewfinder_stripes_) {
+            stripe = (uint16_t*)heap_caps_malloc(stripe_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        }
+        if (viewfinder_stripes_[0] == nullptr || viewfinder_stripes_[1] == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate the viewfinder stripes");
+            for (auto& stripe : viewfinder_stripes_) {
+                heap_caps_free(stripe);
+                stripe = nullptr;
+            }
+            return false;
+        }
+    }
+    if (!viewfinder_active_) {
+        viewfinder_active_ = true;
+        // LVGL would paint an animation under the viewfinder over it between two frames
+        if (gif_controller_) {
+            gif_controller_->Stop();
+        }
+        if (emoji_box_ != nullptr) {
+            lv_obj_add_flag(emoji_box_, LV_OBJ_FLAG_HIDDEN);
+        }
+    }
+
+    // The panel takes big endian pixels, the draw of a stripe waits until the one before is sent
+    int index = 0;
+    for (int y = 0; y < out_height; y += VIEWFINDER_STRIPE_LINES, index ^= 1) {
+        int lines = std::min(VIEWFINDER_STRIPE_LINES, out_height - y);
+        uint16_t* dst = viewfinder_stripes_[index];
+        for (int i = 0; i < lines; i++) {
+            const uint16_t* row = src + (size_t)(y + i) * factor * width;
+            for (int x = 0; x < out_width; x++, row += factor) {
+                *dst++ = big_endian ? *row : __builtin_bswap16(*row);
+            }
+        }
+        esp_lcd_panel_draw_bitmap(panel_, x0, y0 + y, x0 + out_width, y0 + y + lines, viewfinder_stripes_[index]);
+    }
+    // Without a command this only waits for the last stripe, LVGL's next flush must not overtake it
+    esp_lcd_panel_io_tx_param(panel_io_, -1, nullptr, 0);
+    return true;
+}
+
+void SpiLcdDisplay::StopViewfinder() {
+    DisplayLockGuard lock(this);
+    for (auto& stripe : viewfinder_stripes_) {
+        heap_caps_free(stripe);
+        stripe = nullptr;
+    }
+    if (!viewfinder_active_) {
+        return;
+    }
+    viewfinder_active_ = false;
+    if (emoji_box_ != nullptr && (preview_image_ == nullptr || lv_obj_has_flag(preview_image_, LV_OBJ_FLAG_HIDDEN))) {
+        lv_obj_remove_flag(emoji_box_, LV_OBJ_FLAG_HIDDEN);
+        if (gif_controller_) {
+            gif_controller_->Start();
+        }
+    }
+    // LVGL paints the area the viewfinder covered again
+    lv_obj_invalidate(lv_screen_active());
 }
 
 
@@ -186,6 +277,10 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 
     ESP_LOGI(TAG, "Initialize LVGL library");
     lv_init();
+#if CONFIG_DISPLAY_PPA_DRAW_UNIT
+    PpaDrawUnit::Install();
+#endif
+    LvglImageCache::Setup();
 
     ESP_LOGI(TAG, "Initialize LVGL port");
     lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
@@ -209,7 +304,8 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         .flags = {
             .buff_dma = 1,
             .swap_bytes = 0,
-            .full_refresh = 1,
+            /* Only invalidated areas are rendered, LVGL copies them to the other framebuffer after the swap */
+            .full_refresh = 0,
             .direct_mode = 1,
         },
     };
@@ -230,22 +326,38 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
     }
+#if CONFIG_DISPLAY_FRAME_TRACE
+    StartFrameTrace();
+#endif
 }
 
 MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                             int width, int height,  int offset_x, int offset_y,
-                            bool mirror_x, bool mirror_y, bool swap_xy)
+                            bool mirror_x, bool mirror_y, bool swap_xy, bool direct_mode)
     : LcdDisplay(panel_io, panel, width, height) {
 
+    if (direct_mode && (mirror_x || mirror_y || swap_xy)) {
+        ESP_LOGW(TAG, "Direct mode cannot rotate in software, using partial mode");
+        direct_mode = false;
+    }
+
     ESP_LOGI(TAG, "Initialize LVGL library");
     lv_init();
+#if CONFIG_DISPLAY_PPA_DRAW_UNIT
+    PpaDrawUnit::Install();
+#endif
+    LvglImageCache::Setup();
 
     ESP_LOGI(TAG, "Initialize LVGL port");
     lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
     lvgl_port_init(&port_cfg);
 
-    ESP_LOGI(TAG, "Adding LCD display");
-    const lvgl_port_display_cfg_t disp_cfg = {
+    ESP_LOGI(TAG, "Adding LCD display, %s mode", direct_mode ? "direct" : "partial");
+    /*
+     * Direct mode renders into the DPI framebuffers themselves and swaps them on vsync, so only
+     * dirty areas are drawn and nothing is copied through an intermediate buffer.
+     */
+    lvgl_port_display_cfg_t disp_cfg = {
         .io_handle = panel_io,
         .panel_handle = panel,
         .control_handle = nullptr,
@@ -266,10 +378,17 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
             .sw_rotate = true,
         },
     };
+    if (direct_mode) {
+        disp_cfg.buffer_size = static_cast<uint32_t>(width_ * height_);
+        disp_cfg.double_buffer = true;
+        disp_cfg.flags.buff_dma = false;
+        disp_cfg.flags.sw_rotate = false;
+        disp_cfg.flags.direct_mode = true;
+    }
 
     const lvgl_port_display_dsi_cfg_t dpi_cfg = {
         .flags = {
-            .avoid_tearing = false,
+            .avoid_tearing = direct_mode,
         }
     };
     display_ = lvgl_port_add_disp_dsi(&disp_cfg, &dpi_cfg);
@@ -281,6 +400,9 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
     }
+#if CONFIG_DISPLAY_FRAME_TRACE
+    StartFrameTrace();
+#endif
 }
 
 LcdDisplay::~LcdDisplay() {
@@ -333,6 +455,14 @@ LcdDisplay::~LcdDisplay() {
     if (display_ != nullptr) {
         lv_display_delete(display_);
     }
+    if (setup_ui_called_) {
+        lv_style_reset(&screen_style_);
+        lv_style_reset(&background_style_);
+        lv_style_reset(&bar_style_);
+        lv_style_reset(&text_style_);
+        lv_style_reset(&icon_style_);
+        lv_style_reset(&popup_style_);
+    }
 
     if (panel_ != nullptr) {
         esp_lcd_panel_del(panel_);
@@ -351,6 +481,12 @@ void LcdDisplay::Unlock() {
 }
 
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
+#if CONFIG_IDF_TARGET_ESP32P4
+#define  MAX_MESSAGES 40
+#else
+#define  MAX_MESSAGES 20
+#endif
+
 void LcdDisplay::SetupUI() {
     // Prevent duplicate calls - if already called, return early
     if (setup_ui_called_) {
@@ -363,13 +499,12 @@ void LcdDisplay::SetupUI() {
 
     auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
     auto text_font = lvgl_theme->text_font()->font();
-    auto icon_font = lvgl_theme->icon_font()->font();
     auto large_icon_font = lvgl_theme->large_icon_font()->font();
 
+    InitializeThemeStyles(lvgl_theme);
+
     auto screen = lv_screen_active();
-    lv_obj_set_style_text_font(screen, text_font, 0);
-    lv_obj_set_style_text_color(screen, lvgl_theme->text_color(), 0);
-    lv_obj_set_style_bg_color(screen, lvgl_theme->background_color(), 0);
+    lv_obj_add_style(screen, &screen_style_, 0);
 
     /* Container */
     container_ = lv_obj_create(screen);
@@ -379,15 +514,14 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_style_pad_all(container_, 0, 0);
     lv_obj_set_style_border_width(container_, 0, 0);
     lv_obj_set_style_pad_row(container_, 0, 0);
-    lv_obj_set_style_bg_color(container_, lvgl_theme->background_color(), 0);
-    lv_obj_set_style_border_color(container_, lvgl_theme->border_color(), 0);
+    lv_obj_add_style(container_, &background_style_, 0);
 
     /* Layer 1: Top bar - for status icons */
     top_bar_ = lv_obj_create(container_);
     lv_obj_set_size(top_bar_, LV_HOR_RES, LV_SIZE_CONTENT);
     lv_obj_set_style_radius(top_bar_, 0, 0);
     lv_obj_set_style_bg_opa(top_bar_, LV_OPA_50, 0);  // 50% opacity background
-    lv_obj_set_style_bg_color(top_bar_, lvgl_theme->background_color(), 0);
+    lv_obj_add_style(top_bar_, &bar_style_, 0);
     lv_obj_set_style_border_width(top_bar_, 0, 0);
     lv_obj_set_style_pad_all(top_bar_, 0, 0);
     lv_obj_set_style_pad_top(top_bar_, lvgl_theme->spacing(2), 0);
@@ -401,8 +535,7 @@ void LcdDisplay::SetupUI() {
     // Left icon
     network_label_ = lv_label_create(top_bar_);
     lv_label_set_text(network_label_, "");
-    lv_obj_set_style_text_font(network_label_, icon_font, 0);
-    lv_obj_set_style_text_color(network_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(network_label_, &icon_style_, 0);
 
     // Right icons container
     lv_obj_t* right_icons = lv_obj_create(top_bar_);
@@ -415,13 +548,11 @@ void LcdDisplay::SetupUI() {
 
     mute_label_ = lv_label_create(right_icons);
     lv_label_set_text(mute_label_, "");
-    lv_obj_set_style_text_font(mute_label_, icon_font, 0);
-    lv_obj_set_style_text_color(mute_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(mute_label_, &icon_style_, 0);
 
     battery_label_ = lv_label_create(right_icons);
     lv_label_set_text(battery_label_, "");
-    lv_obj_set_style_text_font(battery_label_, icon_font, 0);
-    lv_obj_set_style_text_color(battery_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(battery_label_, &icon_style_, 0);
     lv_obj_set_style_margin_left(battery_label_, lvgl_theme->spacing(2), 0);
 
     /* Layer 2: Status bar - for center text labels */
@@ -440,17 +571,17 @@ void LcdDisplay::SetupUI() {
     notification_label_ = lv_label_create(status_bar_);
     lv_obj_set_width(notification_label_, LV_HOR_RES * 0.8);
     lv_obj_set_style_text_align(notification_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(notification_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(notification_label_, &text_style_, 0);
     lv_label_set_text(notification_label_, "");
     lv_obj_align(notification_label_, LV_ALIGN_CENTER, 0, 0);
     lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
 
     status_label_ = lv_label_create(status_bar_);
     lv_obj_set_width(status_label_, LV_HOR_RES * 0.8);
-    lv_label_set_long_mode(status_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_obj_set_style_text_align(status_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(status_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(status_label_, &text_style_, 0);
     lv_label_set_text(status_label_, Lang::Strings::INITIALIZING);
+    MarqueeLabel::Attach(status_label_);
     lv_obj_align(status_label_, LV_ALIGN_CENTER, 0, 0);
     
     /* Content - Chat area */
@@ -466,19 +597,15 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_scrollbar_mode(content_, LV_SCROLLBAR_MODE_OFF);
     lv_obj_set_scroll_dir(content_, LV_DIR_VER);
     
-    // Create a flex container for chat messages
-    lv_obj_set_flex_flow(content_, LV_FLEX_FLOW_COLUMN);
-    lv_obj_set_flex_align(content_, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START);
-    lv_obj_set_style_pad_row(content_, lvgl_theme->spacing(4), 0); // Space between messages
-
-    // We'll create chat messages dynamically in SetChatMessage
+    // Chat messages are shown by a fixed pool of bubbles recycled while scrolling
+    chat_list_ = std::make_unique<ChatMessageList>(content_, lvgl_theme, MAX_MESSAGES);
     chat_message_label_ = nullptr;
 
     low_battery_popup_ = lv_obj_create(screen);
     lv_obj_set_scrollbar_mode(low_battery_popup_, LV_SCROLLBAR_MODE_OFF);
     lv_obj_set_size(low_battery_popup_, LV_HOR_RES * 0.9, text_font->line_height * 2);
     lv_obj_align(low_battery_popup_, LV_ALIGN_BOTTOM_MID, 0, -lvgl_theme->spacing(4));
-    lv_obj_set_style_bg_color(low_battery_popup_, lvgl_theme->low_battery_color(), 0);
+    lv_obj_add_style(low_battery_popup_, &popup_style_, 0);
     lv_obj_set_style_radius(low_battery_popup_, lvgl_theme->spacing(4), 0);
     low_battery_label_ = lv_label_create(low_battery_popup_);
     lv_label_set_text(low_battery_label_, Lang::Strings::BATTERY_NEED_CHARGE);
@@ -493,305 +620,51 @@ void LcdDisplay::SetupUI() {
     emoji_label_ = lv_label_create(screen);
     lv_obj_center(emoji_label_);
     lv_obj_set_style_text_font(emoji_label_, large_icon_font, 0);
-    lv_obj_set_style_text_color(emoji_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(emoji_label_, &text_style_, 0);
     lv_label_set_text(emoji_label_, FONT_AWESOME_MICROCHIP_AI);
 }
-#if CONFIG_IDF_TARGET_ESP32P4
-#define  MAX_MESSAGES 40
-#else
-#define  MAX_MESSAGES 20
-#endif
 void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     if (!setup_ui_called_) {
         ESP_LOGW(TAG, "SetChatMessage('%s', '%s') called before SetupUI() - message will be lost!", role, content);
     }
     DisplayLockGuard lock(this);
-    if (content_ == nullptr) {
+    if (chat_list_ == nullptr) {
         if (setup_ui_called_) {
             ESP_LOGW(TAG, "SetChatMessage('%s', '%s') failed: content_ is nullptr (SetupUI() was called but container not created)", role, content);
         }
         return;
     }
-    
-    // Check if message count exceeds limit
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (child_count >= MAX_MESSAGES) {
-        // Delete the oldest message (first child object)
-        lv_obj_t* first_child = lv_obj_get_child(content_, 0);
-        if (first_child != nullptr) {
-            lv_obj_del(first_child);
-            // Refresh child count after deletion
-            child_count = lv_obj_get_child_cnt(content_);
-        }
-        // Scroll to the last message immediately (get last_child after deletion)
-        if (child_count > 0) {
-            lv_obj_t* last_child = lv_obj_get_child(content_, child_count - 1);
-            if (last_child != nullptr && lv_obj_is_valid(last_child)) {
-                lv_obj_scroll_to_view_recursive(last_child, LV_ANIM_OFF);
-            }
-        }
-    }
-    
-    // Collapse system messages (if it's a system message, check if the last message is also a system message)
-    if (strcmp(role, "system") == 0) {
-        // Refresh child count to get accurate count after potential deletion above
-        child_count = lv_obj_get_child_cnt(content_);
-        if (child_count > 0) {
-            // Get the last message container
-            lv_obj_t* last_container = lv_obj_get_child(content_, child_count - 1);
-            if (last_container != nullptr && lv_obj_is_valid(last_container) && lv_obj_get_child_cnt(last_container) > 0) {
-                // Get the bubble inside the container
-                lv_obj_t* last_bubble = lv_obj_get_child(last_container, 0);
-                if (last_bubble != nullptr && lv_obj_is_valid(last_bubble)) {
-                    // Check if bubble type is system message
-                    void* bubble_type_ptr = lv_obj_get_user_data(last_bubble);
-                    if (bubble_type_ptr != nullptr && strcmp((const char*)bubble_type_ptr, "system") == 0) {
-                        // If the last message is also a system message, delete it
-                        lv_obj_del(last_container);
-                    }
-                }
-            }
-        }
-    } else {
+
+    if (strcmp(role, "system") != 0) {
         // Hide the centered AI logo
         lv_obj_add_flag(emoji_label_, LV_OBJ_FLAG_HIDDEN);
     }
+    chat_list_->AddMessage(role, content);
+}
 
-    // Avoid empty message boxes
-    if(strlen(content) == 0) {
+void LcdDisplay::AppendChatMessage(const char* role, const char* delta) {
+    DisplayLockGuard lock(this);
+    if (chat_list_ == nullptr) {
         return;
     }
-
-    auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
-
-    // Create a message bubble
-    lv_obj_t* msg_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(msg_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(msg_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(msg_bubble, 0, 0);
-    lv_obj_set_style_pad_all(msg_bubble, lvgl_theme->spacing(4), 0);
-
-    // Create the message text
-    lv_obj_t* msg_text = lv_label_create(msg_bubble);
-    lv_label_set_text(msg_text, content);
-    
-    // Calculate bubble width constraints
-    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;  // 85% of screen width
-    lv_coord_t min_width = 20;  
-    
-    // Let LVGL calculate the natural text width first
-    lv_obj_set_width(msg_text, LV_SIZE_CONTENT);
-    lv_obj_update_layout(msg_text);
-    lv_coord_t text_width = lv_obj_get_width(msg_text);
-    
-    // Ensure text width is not less than minimum width
-    if (text_width < min_width) {
-        text_width = min_width;
-    }
-
-    // Constrain to max width
-    lv_coord_t bubble_width = (text_width < max_width) ? text_width : max_width;
-    
-    // Set message text width
-    lv_obj_set_width(msg_text, bubble_width);
-    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
-
-    // Set bubble width
-    lv_obj_set_width(msg_bubble, bubble_width);
-    lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-
-    // Set alignment and style based on message role
-    if (strcmp(role, "user") == 0) {
-        // User messages are right-aligned with green background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->user_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"user");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "assistant") == 0) {
-        // Assistant messages are left-aligned with white background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->assistant_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"assistant");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "system") == 0) {
-        // System messages are center-aligned with light gray background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->system_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->system_text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"system");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    }
-    
-    // Create a full-width container for user messages to ensure right alignment
-    if (strcmp(role, "user") == 0) {
-        // Create a full-width container
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // Make container transparent and borderless
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // Move the message bubble into this container
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // Right align the bubble in the container
-        lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
-        
-        // Auto-scroll to this container
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else if (strcmp(role, "system") == 0) {
-        // Create full-width container for system messages to ensure center alignment
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        lv_obj_set_parent(msg_bubble, container);
-        lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else {
-        // For assistant messages
-        // Left align assistant messages
-        lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
-
-        // Auto-scroll to the message bubble
-        lv_obj_scroll_to_view_recursive(msg_bubble, LV_ANIM_ON);
-    }
-    
-    // Store reference to the latest message label
-    chat_message_label_ = msg_text;
+    chat_list_->AppendMessage(role, delta);
 }
 
 void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
     DisplayLockGuard lock(this);
-    if (content_ == nullptr) {
-        return;
-    }
-
-    if (image == nullptr) {
+    if (chat_list_ == nullptr || image == nullptr) {
         return;
     }
-    
-    auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
-    // Create a message bubble for image preview
-    lv_obj_t* img_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(img_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(img_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(img_bubble, 0, 0);
-    lv_obj_set_style_pad_all(img_bubble, lvgl_theme->spacing(4), 0);
-    
-    // Set image bubble background color (similar to system message)
-    lv_obj_set_style_bg_color(img_bubble, lvgl_theme->assistant_bubble_color(), 0);
-    lv_obj_set_style_bg_opa(img_bubble, LV_OPA_70, 0);
-    
-    // Set custom attribute to mark bubble type
-    lv_obj_set_user_data(img_bubble, (void*)"image");
-
-    // Create the image object inside the bubble
-    lv_obj_t* preview_image = lv_image_create(img_bubble);
-    
-    // Calculate appropriate size for the image
-    lv_coord_t max_width = LV_HOR_RES * 70 / 100;  // 70% of screen width
-    lv_coord_t max_height = LV_VER_RES * 50 / 100; // 50% of screen height
-    
-    // Calculate zoom factor to fit within maximum dimensions
-    auto img_dsc = image->image_dsc();
-    lv_coord_t img_width = img_dsc->header.w;
-    lv_coord_t img_height = img_dsc->header.h;
-    if (img_width == 0 || img_height == 0) {
-        img_width = max_width;
-        img_height = max_height;
-        ESP_LOGW(TAG, "Invalid image dimensions: %ld x %ld, using default dimensions: %ld x %ld", img_width, img_height, max_width, max_height);
-    }
-    
-    lv_coord_t zoom_w = (max_width * 256) / img_width;
-    lv_coord_t zoom_h = (max_height * 256) / img_height;
-    lv_coord_t zoom = (zoom_w < zoom_h) ? zoom_w : zoom_h;
-    
-    // Ensure zoom doesn't exceed 256 (100%)
-    if (zoom > 256) zoom = 256;
-    
-    // Set image properties
-    lv_image_set_src(preview_image, img_dsc);
-    lv_image_set_scale(preview_image, zoom);
-    
-    // Add event handler to clean up LvglImage when image is deleted
-    // We need to transfer ownership of the unique_ptr to the event callback
-    LvglImage* raw_image = image.release(); // Release ownership of smart pointer
-    lv_obj_add_event_cb(preview_image, [](lv_event_t* e) {
-        LvglImage* img = (LvglImage*)lv_event_get_user_data(e);
-        if (img != nullptr) {
-            delete img; // Properly release memory by deleting LvglImage object
-        }
-    }, LV_EVENT_DELETE, (void*)raw_image);
-    
-    // Calculate actual scaled image dimensions
-    lv_coord_t scaled_width = (img_width * zoom) / 256;
-    lv_coord_t scaled_height = (img_height * zoom) / 256;
-    
-    // Set bubble size to be 16 pixels larger than the image (8 pixels on each side)
-    lv_obj_set_width(img_bubble, scaled_width + 16);
-    lv_obj_set_height(img_bubble, scaled_height + 16);
-    
-    // Don't grow in flex layout
-    lv_obj_set_style_flex_grow(img_bubble, 0, 0);
-    
-    // Center the image within the bubble
-    lv_obj_center(preview_image);
-    
-    // Left align the image bubble like assistant messages
-    lv_obj_align(img_bubble, LV_ALIGN_LEFT_MID, 0, 0);
-
-    // Auto-scroll to the image bubble
-    lv_obj_scroll_to_view_recursive(img_bubble, LV_ANIM_ON);
+    chat_list_->AddImage(std::move(image));
 }
 
 void LcdDisplay::ClearChatMessages() {
     DisplayLockGuard lock(this);
-    if (content_ == nullptr) {
+    if (chat_list_ == nullptr) {
         return;
     }
     
-    // Use lv_obj_clean to delete all children of content_ (chat message bubbles)
-    lv_obj_clean(content_);
-    
-    // Reset chat_message_label_ as it has been deleted
-    chat_message_label_ = nullptr;
+    chat_list_->Clear();
     
     // Show the centered AI logo (emoji_label_) again
     if (emoji_label_ != nullptr) {
@@ -812,13 +685,12 @@ void LcdDisplay::SetupUI() {
     DisplayLockGuard lock(this);
     LvglTheme* lvgl_theme = static_cast<LvglTheme*>(current_theme_);
     auto text_font = lvgl_theme->text_font()->font();
-    auto icon_font = lvgl_theme->icon_font()->font();
     auto large_icon_font = lvgl_theme->large_icon_font()->font();
 
+    InitializeThemeStyles(lvgl_theme);
+
     auto screen = lv_screen_active();
-    lv_obj_set_style_text_font(screen, text_font, 0);
-    lv_obj_set_style_text_color(screen, lvgl_theme->text_color(), 0);
-    lv_obj_set_style_bg_color(screen, lvgl_theme->background_color(), 0);
+    lv_obj_add_style(screen, &screen_style_, 0);
 
     /* Container - used as background */
     container_ = lv_obj_create(screen);
@@ -826,8 +698,7 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_style_radius(container_, 0, 0);
     lv_obj_set_style_pad_all(container_, 0, 0);
     lv_obj_set_style_border_width(container_, 0, 0);
-    lv_obj_set_style_bg_color(container_, lvgl_theme->background_color(), 0);
-    lv_obj_set_style_border_color(container_, lvgl_theme->border_color(), 0);
+    lv_obj_add_style(container_, &background_style_, 0);
 
     /* Bottom layer: emoji_box_ - centered display */
     emoji_box_ = lv_obj_create(screen);
@@ -839,7 +710,7 @@ void LcdDisplay::SetupUI() {
 
     emoji_label_ = lv_label_create(emoji_box_);
     lv_obj_set_style_text_font(emoji_label_, large_icon_font, 0);
-    lv_obj_set_style_text_color(emoji_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(emoji_label_, &text_style_, 0);
     lv_label_set_text(emoji_label_, FONT_AWESOME_MICROCHIP_AI);
 
     emoji_image_ = lv_img_create(emoji_box_);
@@ -857,7 +728,7 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_size(top_bar_, LV_HOR_RES, LV_SIZE_CONTENT);
     lv_obj_set_style_radius(top_bar_, 0, 0);
     lv_obj_set_style_bg_opa(top_bar_, LV_OPA_50, 0);  // 50% opacity background
-    lv_obj_set_style_bg_color(top_bar_, lvgl_theme->background_color(), 0);
+    lv_obj_add_style(top_bar_, &bar_style_, 0);
     lv_obj_set_style_border_width(top_bar_, 0, 0);
     lv_obj_set_style_pad_all(top_bar_, 0, 0);
     lv_obj_set_style_pad_top(top_bar_, lvgl_theme->spacing(2), 0);
@@ -872,8 +743,7 @@ void LcdDisplay::SetupUI() {
     // Left icon
     network_label_ = lv_label_create(top_bar_);
     lv_label_set_text(network_label_, "");
-    lv_obj_set_style_text_font(network_label_, icon_font, 0);
-    lv_obj_set_style_text_color(network_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(network_label_, &icon_style_, 0);
 
     // Right icons container
     lv_obj_t* right_icons = lv_obj_create(top_bar_);
@@ -886,13 +756,11 @@ void LcdDisplay::SetupUI() {
 
     mute_label_ = lv_label_create(right_icons);
     lv_label_set_text(mute_label_, "");
-    lv_obj_set_style_text_font(mute_label_, icon_font, 0);
-    lv_obj_set_style_text_color(mute_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(mute_label_, &icon_style_, 0);
 
     battery_label_ = lv_label_create(right_icons);
     lv_label_set_text(battery_label_, "");
-    lv_obj_set_style_text_font(battery_label_, icon_font, 0);
-    lv_obj_set_style_text_color(battery_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(battery_label_, &icon_style_, 0);
     lv_obj_set_style_margin_left(battery_label_, lvgl_theme->spacing(2), 0);
 
     /* Layer 2: Status bar - for center text labels */
@@ -911,25 +779,25 @@ void LcdDisplay::SetupUI() {
     notification_label_ = lv_label_create(status_bar_);
     lv_obj_set_width(notification_label_, LV_HOR_RES * 0.75);
     lv_obj_set_style_text_align(notification_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(notification_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(notification_label_, &text_style_, 0);
     lv_label_set_text(notification_label_, "");
     lv_obj_align(notification_label_, LV_ALIGN_CENTER, 0, 0);
     lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
 
     status_label_ = lv_label_create(status_bar_);
     lv_obj_set_width(status_label_, LV_HOR_RES * 0.75);
-    lv_label_set_long_mode(status_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_obj_set_style_text_align(status_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(status_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(status_label_, &text_style_, 0);
     lv_label_set_text(status_label_, Lang::Strings::INITIALIZING);
+    MarqueeLabel::Attach(status_label_);
     lv_obj_align(status_label_, LV_ALIGN_CENTER, 0, 0);
 
     /* Top layer: Bottom bar - fixed height at bottom */
     bottom_bar_ = lv_obj_create(screen);
     lv_obj_set_size(bottom_bar_, LV_HOR_RES, text_font->line_height + lvgl_theme->spacing(12));
     lv_obj_set_style_radius(bottom_bar_, 0, 0);
-    lv_obj_set_style_bg_color(bottom_bar_, lvgl_theme->background_color(), 0);
-    lv_obj_set_style_text_color(bottom_bar_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(bottom_bar_, &bar_style_, 0);
+    lv_obj_add_style(bottom_bar_, &text_style_, 0);
     lv_obj_set_style_pad_all(bottom_bar_, 0, 0);
     lv_obj_set_style_pad_left(bottom_bar_, lvgl_theme->spacing(4), 0);
     lv_obj_set_style_pad_right(bottom_bar_, lvgl_theme->spacing(4), 0);
@@ -941,24 +809,24 @@ void LcdDisplay::SetupUI() {
     chat_message_label_ = lv_label_create(bottom_bar_);
     lv_label_set_text(chat_message_label_, "");
     lv_obj_set_width(chat_message_label_, LV_HOR_RES - lvgl_theme->spacing(8));
-    lv_label_set_long_mode(chat_message_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_obj_set_style_text_align(chat_message_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(chat_message_label_, lvgl_theme->text_color(), 0);
+    lv_obj_add_style(chat_message_label_, &text_style_, 0);
     lv_obj_align(chat_message_label_, LV_ALIGN_CENTER, 0, 0);
 
-    // Start scrolling after a delay (short text won't scroll)
+    // Start scrolling after a delay (short text won't scroll), for text too long for a marquee strip
     static lv_anim_t a;
     lv_anim_init(&a);
     lv_anim_set_delay(&a, 1000);
     lv_anim_set_repeat_count(&a, LV_ANIM_REPEAT_INFINITE);
     lv_obj_set_style_anim(chat_message_label_, &a, LV_PART_MAIN);
     lv_obj_set_style_anim_duration(chat_message_label_, lv_anim_speed_clamped(60, 300, 60000), LV_PART_MAIN);
+    MarqueeLabel::Attach(chat_message_label_);
 
     low_battery_popup_ = lv_obj_create(screen);
     lv_obj_set_scrollbar_mode(low_battery_popup_, LV_SCROLLBAR_MODE_OFF);
     lv_obj_set_size(low_battery_popup_, LV_HOR_RES * 0.9, text_font->line_height * 2);
     lv_obj_align(low_battery_popup_, LV_ALIGN_BOTTOM_MID, 0, -lvgl_theme->spacing(4));
-    lv_obj_set_style_bg_color(low_battery_popup_, lvgl_theme->low_battery_color(), 0);
+    lv_obj_add_style(low_battery_popup_, &popup_style_, 0);
     lv_obj_set_style_radius(low_battery_popup_, lvgl_theme->spacing(4), 0);
     
     low_battery_label_ = lv_label_create(low_battery_popup_);
@@ -1015,18 +883,30 @@ void LcdDisplay::SetChatMessage(const char* role, const char* content) {
         }
         return;
     }
-    lv_label_set_text(chat_message_label_, content);
+    MarqueeLabel::SetText(chat_message_label_, content);
 }
 
 void LcdDisplay::ClearChatMessages() {
     DisplayLockGuard lock(this);
     // In non-wechat mode, just clear the chat message label
     if (chat_message_label_ != nullptr) {
-        lv_label_set_text(chat_message_label_, "");
+        MarqueeLabel::SetText(chat_message_label_, "");
     }
 }
 #endif
 
+void LcdDisplay::GetPreviewImageSize(int& width, int& height) {
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    // Image bubbles are limited by ChatMessageList::Measure()
+    width = width_ * 70 / 100;
+    height = height_ * 50 / 100;
+#else
+    // The preview is drawn at half the screen width
+    width = width_ / 2;
+    height = height_;
+#endif
+}
+
 void LcdDisplay::SetEmotion(const char* emotion) {
     if (!setup_ui_called_) {
         ESP_LOGW(TAG, "SetEmotion('%s') called before SetupUI() - emotion will not be displayed!", emotion);
@@ -1036,6 +916,7 @@ void LcdDisplay::SetEmotion(const char* emotion) {
         DisplayLockGuard lock(this);
         gif_controller_->Stop();
         gif_controller_.reset();
+        SetAnimating(false);
     }
     
     if (emoji_image_ == nullptr) {
@@ -1088,8 +969,7 @@ void LcdDisplay::SetEmotion(const char* emotion) {
 
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
     // In WeChat message style, if emotion is neutral, don't display it
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (strcmp(emotion, "neutral") == 0 && child_count > 0) {
+    if (strcmp(emotion, "neutral") == 0 && chat_list_ != nullptr && !chat_list_->empty()) {
         // Stop GIF animation if running
         if (gif_controller_) {
             gif_controller_->Stop();
@@ -1100,145 +980,87 @@ void LcdDisplay::SetEmotion(const char* emotion) {
         lv_obj_add_flag(emoji_label_, LV_OBJ_FLAG_HIDDEN);
     }
 #endif
+    SetAnimating(gif_controller_ != nullptr);
 }
 
-void LcdDisplay::SetTheme(Theme* theme) {
-    DisplayLockGuard lock(this);
-    
-    auto lvgl_theme = static_cast<LvglTheme*>(theme);
-    
-    // Get the active screen
-    lv_obj_t* screen = lv_screen_active();
-
-    // Set font
-    auto text_font = lvgl_theme->text_font()->font();
-    auto icon_font = lvgl_theme->icon_font()->font();
-    auto large_icon_font = lvgl_theme->large_icon_font()->font();
-
-    if (text_font->line_height >= 40) {
-        lv_obj_set_style_text_font(mute_label_, large_icon_font, 0);
-        lv_obj_set_style_text_font(battery_label_, large_icon_font, 0);
-        lv_obj_set_style_text_font(network_label_, large_icon_font, 0);
+void LcdDisplay::PauseAnimations(bool paused) {
+    if (gif_controller_ == nullptr) {
+        return;
+    }
+    if (paused) {
+        gif_controller_->Pause();
     } else {
-        lv_obj_set_style_text_font(mute_label_, icon_font, 0);
-        lv_obj_set_style_text_font(battery_label_, icon_font, 0);
-        lv_obj_set_style_text_font(network_label_, icon_font, 0);
+        gif_controller_->Resume();
     }
+}
 
-    // Set parent text color
-    lv_obj_set_style_text_font(screen, text_font, 0);
-    lv_obj_set_style_text_color(screen, lvgl_theme->text_color(), 0);
+void LcdDisplay::InitializeThemeStyles(LvglTheme* theme) {
+    lv_style_init(&screen_style_);
+    lv_style_init(&background_style_);
+    lv_style_init(&bar_style_);
+    lv_style_init(&text_style_);
+    lv_style_init(&icon_style_);
+    lv_style_init(&popup_style_);
+    UpdateThemeStyles(theme, theme->icon_font()->font());
+}
+
+void LcdDisplay::UpdateThemeStyles(LvglTheme* theme, const lv_font_t* icon_font) {
+    lv_style_set_text_font(&screen_style_, theme->text_font()->font());
+    lv_style_set_text_color(&screen_style_, theme->text_color());
+    lv_style_set_bg_color(&screen_style_, theme->background_color());
 
-    // Set background image
-    if (lvgl_theme->background_image() != nullptr) {
-        lv_obj_set_style_bg_image_src(container_, lvgl_theme->background_image()->image_dsc(), 0);
+    lv_style_set_bg_color(&background_style_, theme->background_color());
+    lv_style_set_border_color(&background_style_, theme->border_color());
+    if (theme->background_image() != nullptr) {
+        lv_style_set_bg_image_src(&background_style_, theme->background_image()->image_dsc());
     } else {
-        lv_obj_set_style_bg_image_src(container_, nullptr, 0);
-        lv_obj_set_style_bg_color(container_, lvgl_theme->background_color(), 0);
+        lv_style_remove_prop(&background_style_, LV_STYLE_BG_IMAGE_SRC);
     }
+
+    lv_style_set_bg_color(&bar_style_, theme->background_color());
+    lv_style_set_text_color(&text_style_, theme->text_color());
+    lv_style_set_text_font(&icon_style_, icon_font);
+    lv_style_set_text_color(&icon_style_, theme->text_color());
+    lv_style_set_bg_color(&popup_style_, theme->low_battery_color());
+}
+
+void LcdDisplay::SetTheme(Theme* theme) {
+    DisplayLockGuard lock(this);
+    int64_t start_time = esp_timer_get_time();
     
-    // Update top bar background color with 50% opacity
-    if (top_bar_ != nullptr) {
-        lv_obj_set_style_bg_opa(top_bar_, LV_OPA_50, 0);
-        lv_obj_set_style_bg_color(top_bar_, lvgl_theme->background_color(), 0);
+    auto lvgl_theme = static_cast<LvglTheme*>(theme);
+    auto text_font = lvgl_theme->text_font()->font();
+    auto icon_font = text_font->line_height >= 40 ? lvgl_theme->large_icon_font()->font() : lvgl_theme->icon_font()->font();
+
+    if (setup_ui_called_) {
+        // Widgets reference the styles, only the objects using them are refreshed and invalidated
+        UpdateThemeStyles(lvgl_theme, icon_font);
+        lv_obj_report_style_change(&screen_style_);
+        lv_obj_report_style_change(&background_style_);
+        lv_obj_report_style_change(&bar_style_);
+        lv_obj_report_style_change(&text_style_);
+        lv_obj_report_style_change(&icon_style_);
+        lv_obj_report_style_change(&popup_style_);
     }
-    
-    // Update status bar elements
-    lv_obj_set_style_text_color(network_label_, lvgl_theme->text_color(), 0);
-    lv_obj_set_style_text_color(status_label_, lvgl_theme->text_color(), 0);
-    lv_obj_set_style_text_color(notification_label_, lvgl_theme->text_color(), 0);
-    lv_obj_set_style_text_color(mute_label_, lvgl_theme->text_color(), 0);
-    lv_obj_set_style_text_color(battery_label_, lvgl_theme->text_color(), 0);
-    lv_obj_set_style_text_color(emoji_label_, lvgl_theme->text_color(), 0);
 
     // If we have the chat message style, update all message bubbles
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
     // Set content background opacity
-    lv_obj_set_style_bg_opa(content_, LV_OPA_TRANSP, 0);
+    if (content_ != nullptr) {
+        lv_obj_set_style_bg_opa(content_, LV_OPA_TRANSP, 0);
+    }
 
-    // Iterate through all children of content (message containers or bubbles)
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    for (uint32_t i = 0; i < child_count; i++) {
-        lv_obj_t* obj = lv_obj_get_child(content_, i);
-        if (obj == nullptr) continue;
-        
-        lv_obj_t* bubble = nullptr;
-        
-        // Check if this object is a container or bubble
-        // If it's a container (user or system message), get its child as bubble
-        // If it's a bubble (assistant message), use it directly
-        if (lv_obj_get_child_cnt(obj) > 0) {
-            // Might be a container, check if it's a user or system message container
-            // User and system message containers are transparent
-            lv_opa_t bg_opa = lv_obj_get_style_bg_opa(obj, LV_PART_MAIN);
-            if (bg_opa == LV_OPA_TRANSP) {
-                // This is a user or system message container
-                bubble = lv_obj_get_child(obj, 0);
-            } else {
-                // This might be an assistant message bubble itself
-                bubble = obj;
-            }
-        } else {
-            // No child elements, might be other UI elements, skip
-            continue;
-        }
-        
-        if (bubble == nullptr) continue;
-        
-        // Use saved user data to identify bubble type
-        void* bubble_type_ptr = lv_obj_get_user_data(bubble);
-        if (bubble_type_ptr != nullptr) {
-            const char* bubble_type = static_cast<const char*>(bubble_type_ptr);
-            
-            // Apply correct color based on bubble type
-            if (strcmp(bubble_type, "user") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->user_bubble_color(), 0);
-            } else if (strcmp(bubble_type, "assistant") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->assistant_bubble_color(), 0); 
-            } else if (strcmp(bubble_type, "system") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->system_bubble_color(), 0);
-            } else if (strcmp(bubble_type, "image") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->system_bubble_color(), 0);
-            }
-            
-            // Update border color
-            lv_obj_set_style_border_color(bubble, lvgl_theme->border_color(), 0);
-            
-            // Update text color for the message
-            if (lv_obj_get_child_cnt(bubble) > 0) {
-                lv_obj_t* text = lv_obj_get_child(bubble, 0);
-                if (text != nullptr) {
-                    // Set text color based on bubble type
-                    if (strcmp(bubble_type, "system") == 0) {
-                        lv_obj_set_style_text_color(text, lvgl_theme->system_text_color(), 0);
-                    } else {
-                        lv_obj_set_style_text_color(text, lvgl_theme->text_color(), 0);
-                    }
-                }
-            }
-        } else {
-            ESP_LOGW(TAG, "child[%lu] Bubble type is not found", i);
-        }
+    if (chat_list_ != nullptr) {
+        chat_list_->SetTheme(lvgl_theme);
     }
 #else
-    // Simple UI mode - just update the main chat message
-    if (chat_message_label_ != nullptr) {
-        lv_obj_set_style_text_color(chat_message_label_, lvgl_theme->text_color(), 0);
-    }
-    
-    if (emoji_label_ != nullptr) {
-        lv_obj_set_style_text_color(emoji_label_, lvgl_theme->text_color(), 0);
-    }
-    
-    // Update bottom bar background color with 50% opacity
+    // Update bottom bar background with 50% opacity
     if (bottom_bar_ != nullptr) {
         lv_obj_set_style_bg_opa(bottom_bar_, LV_OPA_50, 0);
-        lv_obj_set_style_bg_color(bottom_bar_, lvgl_theme->background_color(), 0);
     }
 #endif
-    
-    // Update low battery popup
-    lv_obj_set_style_bg_color(low_battery_popup_, lvgl_theme->low_battery_color(), 0);
+
+    ESP_LOGI(TAG, "Theme %s applied in %lld us", theme->name().c_str(), esp_timer_get_time() - start_time);
 
     // No errors occurred. Save theme to settings
     Display::SetTheme(lvgl_theme);
@@ -3,6 +3,7 @@
 
 #include "lvgl_display.h"
 #include "gif/lvgl_gif.h"
+#include "chat_message_list.h"
 
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
@@ -13,6 +14,12 @@
 
 #define PREVIEW_IMAGE_DURATION_MS 5000
 
+#ifdef CONFIG_LCD_SPI_DOUBLE_BUFFER
+#define LCD_SPI_DOUBLE_BUFFER true
+#else
+#define LCD_SPI_DOUBLE_BUFFER false
+#endif
+
 
 class LcdDisplay : public LvglDisplay {
 protected:
@@ -34,9 +41,20 @@ protected:
     lv_obj_t* chat_message_label_ = nullptr;
     esp_timer_handle_t preview_timer_ = nullptr;
     std::unique_ptr<LvglImage> preview_image_cached_ = nullptr;
+    std::unique_ptr<ChatMessageList> chat_list_;  // WeChat message style only
     bool hide_subtitle_ = false;  // Control whether to hide chat messages/subtitles
 
+    // Theme values referenced by the widgets, a theme switch updates these and reports the change once
+    lv_style_t screen_style_;
+    lv_style_t background_style_;
+    lv_style_t bar_style_;
+    lv_style_t text_style_;
+    lv_style_t icon_style_;
+    lv_style_t popup_style_;
+
     void InitializeLcdThemes();
+    void InitializeThemeStyles(LvglTheme* theme);
+    void UpdateThemeStyles(LvglTheme* theme, const lv_font_t* icon_font);
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
 
@@ -48,9 +66,14 @@ public:
     ~LcdDisplay();
     virtual void SetEmotion(const char* emotion) override;
     virtual void SetChatMessage(const char* role, const char* content) override;
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    virtual void AppendChatMessage(const char* role, const char* delta) override;
+#endif
     virtual void ClearChatMessages() override;
     virtual void SetPreviewImage(std::unique_ptr<LvglImage> image) override;
     virtual void SetupUI() override;
+    virtual void PauseAnimations(bool paused) override;
+    virtual void GetPreviewImageSize(int& width, int& height) override;
     // Add theme switching function
     virtual void SetTheme(Theme* theme) override;
     
@@ -58,15 +81,29 @@ public:
     void SetHideSubtitle(bool hide);
 };
 
-// SPI LCD display
+// SPI LCD display, LVGL renders stripes of draw_buffer_lines into DMA-capable internal RAM
 class SpiLcdDisplay : public LcdDisplay {
 public:
     SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                   int width, int height, int offset_x, int offset_y,
-                  bool mirror_x, bool mirror_y, bool swap_xy);
+                  bool mirror_x, bool mirror_y, bool swap_xy,
+                  int draw_buffer_lines = CONFIG_LCD_SPI_DRAW_BUFFER_LINES,
+                  bool double_buffer = LCD_SPI_DOUBLE_BUFFER);
+
+    // Sent in stripes under the display lock, so it never interleaves with an LVGL flush
+    virtual bool HasViewfinder() const override { return true; }
+    virtual bool DrawViewfinderFrame(const uint8_t* pixels, int width, int height, bool big_endian) override;
+    virtual void StopViewfinder() override;
+
+private:
+    int offset_x_ = 0;
+    int offset_y_ = 0;
+    // Two DMA stripes, one is filled while the other is sent. Allocated by the first frame.
+    uint16_t* viewfinder_stripes_[2] = {nullptr, nullptr};
+    bool viewfinder_active_ = false;
 };
 
-// RGB LCD display
+// RGB LCD display, LVGL draws straight into the two panel framebuffers and only re-renders dirty areas
 class RgbLcdDisplay : public LcdDisplay {
 public:
     RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
@@ -77,9 +114,10 @@ public:
 // MIPI LCD display
 class MipiLcdDisplay : public LcdDisplay {
 public:
+    // direct_mode needs a DPI panel created with num_fbs = 2 and no rotation
     MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                    int width, int height, int offset_x, int offset_y,
-                   bool mirror_x, bool mirror_y, bool swap_xy);
+                   bool mirror_x, bool mirror_y, bool swap_xy, bool direct_mode = false);
 };
 
 #endif // LCD_DISPLAY_H
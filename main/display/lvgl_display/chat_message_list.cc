@@ -0,0 +1,312 @@
+#include "chat_message_list.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "ChatMessageList"
+
+ChatMessageList::ChatMessageList(lv_obj_t* content, LvglTheme* theme, size_t max_messages)
+    : content_(content), theme_(theme), max_messages_(max_messages) {
+    /* Rows are positioned by hand, a flex column would lay out every message on each insert */
+    lv_obj_set_layout(content_, LV_LAYOUT_NONE);
+
+    spacer_ = lv_obj_create(content_);
+    lv_obj_remove_style_all(spacer_);
+    lv_obj_set_size(spacer_, 1, 1);
+    lv_obj_remove_flag(spacer_, LV_OBJ_FLAG_CLICKABLE);
+
+    EnsureRows();
+
+    auto callback = [](lv_event_t* e) {
+        static_cast<ChatMessageList*>(lv_event_get_user_data(e))->UpdateVisibleRows();
+    };
+    lv_obj_add_event_cb(content_, callback, LV_EVENT_SCROLL, this);
+    lv_obj_add_event_cb(content_, callback, LV_EVENT_SIZE_CHANGED, this);
+}
+
+int32_t ChatMessageList::max_bubble_width() const {
+    return LV_HOR_RES * 85 / 100 - 16;
+}
+
+void ChatMessageList::EnsureRows() {
+    // Enough rows for a viewport filled with single line messages, plus the two cut at the edges
+    auto font = theme_->text_font()->font();
+    int32_t min_height = font->line_height + theme_->spacing(8) + theme_->spacing(4);
+    size_t count = std::min<size_t>(LV_VER_RES / std::max<int32_t>(min_height, 1) + 2, max_messages_);
+    while (rows_.size() < count) {
+        Row row;
+        row.bubble = lv_obj_create(content_);
+        lv_obj_set_style_radius(row.bubble, 8, 0);
+        lv_obj_set_scrollbar_mode(row.bubble, LV_SCROLLBAR_MODE_OFF);
+        lv_obj_remove_flag(row.bubble, LV_OBJ_FLAG_SCROLLABLE);
+        lv_obj_set_style_border_width(row.bubble, 0, 0);
+        lv_obj_set_style_bg_opa(row.bubble, LV_OPA_70, 0);
+        lv_obj_add_flag(row.bubble, LV_OBJ_FLAG_HIDDEN);
+
+        row.label = lv_label_create(row.bubble);
+        lv_label_set_long_mode(row.label, LV_LABEL_LONG_WRAP);
+        lv_label_set_text_static(row.label, "");
+
+        row.image = lv_image_create(row.bubble);
+        lv_obj_center(row.image);
+        lv_obj_add_flag(row.image, LV_OBJ_FLAG_HIDDEN);
+        rows_.push_back(row);
+    }
+}
+
+void ChatMessageList::ResetRow(Row& row) {
+    // The label shows the message text in place and the image its descriptor
+    lv_obj_add_flag(row.bubble, LV_OBJ_FLAG_HIDDEN);
+    lv_label_set_text_static(row.label, "");
+    lv_image_set_src(row.image, nullptr);
+    row.message_id = -1;
+}
+
+void ChatMessageList::ResetRows() {
+    for (auto& row : rows_) {
+        ResetRow(row);
+    }
+}
+
+void ChatMessageList::Measure(Message& message) {
+    int32_t padding = theme_->spacing(4);
+    if (message.type == kMessageImage) {
+        int32_t max_width = LV_HOR_RES * 70 / 100;
+        int32_t max_height = LV_VER_RES * 50 / 100;
+        auto img_dsc = message.image->image_dsc();
+        int32_t img_width = img_dsc->header.w > 0 ? img_dsc->header.w : max_width;
+        int32_t img_height = img_dsc->header.h > 0 ? img_dsc->header.h : max_height;
+        message.image_scale = std::min<int32_t>({max_width * 256 / img_width, max_height * 256 / img_height, 256});
+        message.width = img_width * message.image_scale / 256 + 16;
+        message.height = img_height * message.image_scale / 256 + 16;
+        return;
+    }
+
+    /* Wrapped once here, binding a row later only lays out the label it is shown in */
+    lv_point_t size;
+    lv_text_get_size(&size, message.text.c_str(), theme_->text_font()->font(), 0, 0,
+        max_bubble_width() - 2 * padding, LV_TEXT_FLAG_NONE);
+    message.width = std::clamp<int32_t>(size.x, 20, max_bubble_width() - 2 * padding) + 2 * padding;
+    message.height = size.y + 2 * padding;
+}
+
+int32_t ChatMessageList::GapBefore(const Message& message) const {
+    return message.continuation ? theme_->spacing(1) : theme_->spacing(4);
+}
+
+void ChatMessageList::MeasureAll() {
+    int32_t y = 0;
+    for (auto& message : messages_) {
+        Measure(message);
+        if (&message != &messages_.front()) {
+            y += GapBefore(message);
+        }
+        message.y = y;
+        y += message.height;
+    }
+}
+
+void ChatMessageList::Push(Message&& message) {
+    if (messages_.size() >= max_messages_) {
+        PopFront();
+    }
+    message.id = next_id_++;
+    Measure(message);
+    if (messages_.empty()) {
+        message.y = 0;
+    } else {
+        auto& last = messages_.back();
+        message.y = last.y + last.height + GapBefore(message);
+    }
+    messages_.push_back(std::move(message));
+
+    UpdateVisibleRows();
+    lv_obj_update_layout(content_);
+    lv_obj_scroll_to_view(spacer_, LV_ANIM_ON);
+}
+
+void ChatMessageList::Unbind(const Message& message) {
+    auto& row = rows_[message.id % rows_.size()];
+    if (row.message_id == message.id) {
+        ResetRow(row);
+    }
+}
+
+void ChatMessageList::PopFront() {
+    Unbind(messages_.front());
+    messages_.pop_front();
+}
+
+void ChatMessageList::PopBack() {
+    Unbind(messages_.back());
+    messages_.pop_back();
+}
+
+ChatMessageList::MessageType ChatMessageList::TypeOfRole(const char* role) {
+    if (strcmp(role, "user") == 0) {
+        return kMessageUser;
+    } else if (strcmp(role, "system") == 0) {
+        return kMessageSystem;
+    }
+    return kMessageAssistant;
+}
+
+void ChatMessageList::AddMessage(const char* role, const char* content) {
+    MessageType type = TypeOfRole(role);
+
+    // Collapse consecutive system messages
+    if (type == kMessageSystem && !messages_.empty() && messages_.back().type == kMessageSystem) {
+        PopBack();
+        UpdateVisibleRows();
+    }
+    // Avoid empty message boxes
+    if (content[0] == '\0') {
+        return;
+    }
+
+    Message message = {};
+    message.type = type;
+    message.text = content;
+    Push(std::move(message));
+}
+
+void ChatMessageList::AppendMessage(const char* role, const char* delta) {
+    MessageType type = TypeOfRole(role);
+    if (messages_.empty() || messages_.back().type != type || type == kMessageSystem) {
+        AddMessage(role, delta);
+        return;
+    }
+    while (*delta == ' ') {
+        delta++;
+    }
+    if (*delta == '\0') {
+        return;
+    }
+
+    Message message = {};
+    message.type = type;
+    message.text = delta;
+    message.continuation = true;
+    Push(std::move(message));
+}
+
+void ChatMessageList::AddImage(std::unique_ptr<LvglImage> image) {
+    Message message = {};
+    message.type = kMessageImage;
+    message.image = std::move(image);
+    Push(std::move(message));
+}
+
+void ChatMessageList::Clear() {
+    ResetRows();
+    messages_.clear();
+    UpdateVisibleRows();
+}
+
+void ChatMessageList::SetTheme(LvglTheme* theme) {
+    theme_ = theme;
+    ResetRows();
+    // A smaller font fits more rows on the screen, ids map to rows by the pool size
+    EnsureRows();
+    MeasureAll();
+    UpdateVisibleRows();
+}
+
+void ChatMessageList::StyleRow(Row& row, MessageType type) {
+    lv_obj_set_style_pad_all(row.bubble, type == kMessageImage ? 8 : theme_->spacing(4), 0);
+    switch (type) {
+        case kMessageUser:
+            lv_obj_set_style_bg_color(row.bubble, theme_->user_bubble_color(), 0);
+            lv_obj_set_style_text_color(row.label, theme_->text_color(), 0);
+            break;
+        case kMessageAssistant:
+            lv_obj_set_style_bg_color(row.bubble, theme_->assistant_bubble_color(), 0);
+            lv_obj_set_style_text_color(row.label, theme_->text_color(), 0);
+            break;
+        case kMessageSystem:
+            lv_obj_set_style_bg_color(row.bubble, theme_->system_bubble_color(), 0);
+            lv_obj_set_style_text_color(row.label, theme_->system_text_color(), 0);
+            break;
+        case kMessageImage:
+            lv_obj_set_style_bg_color(row.bubble, theme_->assistant_bubble_color(), 0);
+            break;
+    }
+    if (type == kMessageImage) {
+        lv_obj_add_flag(row.label, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_remove_flag(row.image, LV_OBJ_FLAG_HIDDEN);
+    } else {
+        lv_obj_remove_flag(row.label, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(row.image, LV_OBJ_FLAG_HIDDEN);
+        lv_image_set_src(row.image, nullptr);
+    }
+}
+
+void ChatMessageList::Bind(Row& row, const Message& message) {
+    if (row.message_id != message.id) {
+        StyleRow(row, message.type);
+        if (message.type == kMessageImage) {
+            lv_image_set_src(row.image, message.image->image_dsc());
+            lv_image_set_scale(row.image, message.image_scale);
+        } else {
+            lv_obj_set_width(row.label, message.width - 2 * theme_->spacing(4));
+            lv_label_set_text_static(row.label, message.text.c_str());
+        }
+        lv_obj_set_size(row.bubble, message.width, message.height);
+        lv_obj_remove_flag(row.bubble, LV_OBJ_FLAG_HIDDEN);
+        row.message_id = message.id;
+    }
+
+    int32_t content_width = lv_obj_get_content_width(content_);
+    int32_t x = 0;
+    if (message.type == kMessageUser) {
+        x = content_width - message.width - 25;
+    } else if (message.type == kMessageSystem) {
+        x = (content_width - message.width) / 2;
+    }
+    lv_obj_set_pos(row.bubble, std::max<int32_t>(x, 0), message.y - messages_.front().y);
+}
+
+void ChatMessageList::UpdateVisibleRows() {
+    if (messages_.empty()) {
+        ResetRows();
+        lv_obj_set_pos(spacer_, 0, 0);
+        return;
+    }
+
+    int32_t base = messages_.front().y;
+    auto& last = messages_.back();
+    lv_obj_set_pos(spacer_, 0, last.y + last.height - base - 1);
+
+    int32_t top = lv_obj_get_scroll_y(content_) + base;
+    int32_t view_height = lv_obj_get_content_height(content_);
+    if (view_height <= 0) {
+        view_height = LV_VER_RES;
+    }
+    int32_t bottom = top + view_height;
+
+    // First message reaching into the viewport, the history is sorted by y
+    auto first = std::partition_point(messages_.begin(), messages_.end(), [top](const Message& message) {
+        return message.y + message.height <= top;
+    });
+    if (first == messages_.end()) {
+        first = messages_.end() - 1;
+    }
+
+    int64_t first_id = first->id;
+    int64_t last_id = first_id - 1;
+    for (auto it = first; it != messages_.end() && it->y < bottom; ++it) {
+        if (it->id - first_id >= static_cast<int64_t>(rows_.size())) {
+            ESP_LOGW(TAG, "More messages visible than rows");
+            break;
+        }
+        Bind(rows_[it->id % rows_.size()], *it);
+        last_id = it->id;
+    }
+
+    for (auto& row : rows_) {
+        if (row.message_id >= 0 && (row.message_id < first_id || row.message_id > last_id)) {
+            ResetRow(row);
+        }
+    }
+}
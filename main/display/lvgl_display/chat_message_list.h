@@ -0,0 +1,96 @@
+#ifndef CHAT_MESSAGE_LIST_H
+#define CHAT_MESSAGE_LIST_H
+
+#include "lvgl_theme.h"
+#include "lvgl_image.h"
+
+#include <lvgl.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Chat history shown in a scrollable container with a fixed pool of bubble objects.
+ *
+ * Messages are kept as text plus their measured bubble size, wrapped once when they are
+ * added. Only the messages inside the viewport are bound to a bubble, so the LVGL object
+ * count stays constant however long the conversation gets, and an insert never lays out
+ * the whole column. All methods must be called with the display lock held.
+ */
+class ChatMessageList {
+public:
+    // The bubbles are children of content and are deleted with it
+    ChatMessageList(lv_obj_t* content, LvglTheme* theme, size_t max_messages);
+
+    // Appends a message, a system message replaces a system message right before it
+    void AddMessage(const char* role, const char* content);
+    /*
+     * Continues the last message if it has the same role. The delta is wrapped and drawn as a
+     * segment under it, so the lines already shown are neither wrapped nor redrawn again.
+     */
+    void AppendMessage(const char* role, const char* delta);
+    void AddImage(std::unique_ptr<LvglImage> image);
+    void Clear();
+    // Restyles the bubbles and wraps the history again for the theme's font
+    void SetTheme(LvglTheme* theme);
+
+    bool empty() const { return messages_.empty(); }
+
+private:
+    enum MessageType {
+        kMessageUser,
+        kMessageAssistant,
+        kMessageSystem,
+        kMessageImage,
+    };
+
+    struct Message {
+        uint32_t id;
+        MessageType type;
+        std::string text;
+        std::unique_ptr<LvglImage> image;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+        int32_t image_scale;
+        // Segment appended to the message before it, drawn closer to it
+        bool continuation;
+    };
+
+    struct Row {
+        lv_obj_t* bubble;
+        lv_obj_t* label;
+        lv_obj_t* image;
+        // Id of the message shown, messages map to the row id % rows_.size()
+        int64_t message_id = -1;
+    };
+
+    lv_obj_t* content_;
+    LvglTheme* theme_;
+    size_t max_messages_;
+    std::deque<Message> messages_;
+    std::vector<Row> rows_;
+    // Defines the scroll range, placed at the bottom of the last message
+    lv_obj_t* spacer_;
+    uint32_t next_id_ = 0;
+
+    static MessageType TypeOfRole(const char* role);
+    int32_t GapBefore(const Message& message) const;
+    void Push(Message&& message);
+    void PopFront();
+    void PopBack();
+    void Unbind(const Message& message);
+    void Measure(Message& message);
+    void MeasureAll();
+    void EnsureRows();
+    void ResetRow(Row& row);
+    void ResetRows();
+    void Bind(Row& row, const Message& message);
+    void StyleRow(Row& row, MessageType type);
+    void UpdateVisibleRows();
+    int32_t max_bubble_width() const;
+};
+
+#endif // CHAT_MESSAGE_LIST_H
@@ -1,19 +1,63 @@
 #include "emoji_collection.h"
 
 #include <esp_log.h>
-#include <unordered_map>
+#include <algorithm>
 #include <string>
 
 #define TAG "EmojiCollection"
 
+uint32_t EmojiCollection::Hash(const char* name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    }
+    return hash;
+}
+
+EmojiCollection::Slot* EmojiCollection::Find(const char* name, uint32_t hash) {
+    // The table is never full, probing stops at the slot of the name or an empty one
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        auto& slot = slots_[i];
+        if (slot.image == nullptr || (slot.hash == hash && slot.name == name)) {
+            return &slot;
+        }
+    }
+}
+
+void EmojiCollection::Grow() {
+    std::vector<Slot> old_slots(std::max<size_t>(slots_.size() * 2, 32));
+    old_slots.swap(slots_);
+    for (auto& old_slot : old_slots) {
+        if (old_slot.image != nullptr) {
+            *Find(old_slot.name.c_str(), old_slot.hash) = std::move(old_slot);
+        }
+    }
+}
+
 void EmojiCollection::AddEmoji(const std::string& name, LvglImage* image) {
-    emoji_collection_[name] = image;
+    if ((count_ + 1) * 4 > slots_.size() * 3) {
+        Grow();
+    }
+    uint32_t hash = Hash(name.c_str());
+    auto slot = Find(name.c_str(), hash);
+    if (slot->image == nullptr) {
+        slot->name = name;
+        slot->hash = hash;
+        count_++;
+    } else if (slot->image != image) {
+        delete slot->image;
+    }
+    slot->image = image;
 }
 
 const LvglImage* EmojiCollection::GetEmojiImage(const char* name) {
-    auto it = emoji_collection_.find(name);
-    if (it != emoji_collection_.end()) {
-        return it->second;
+    if (count_ > 0) {
+        auto slot = Find(name, Hash(name));
+        if (slot->image != nullptr) {
+            return slot->image;
+        }
     }
 
     ESP_LOGW(TAG, "Emoji not found: %s", name);
@@ -21,10 +65,10 @@ const LvglImage* EmojiCollection::GetEmojiImage(const char* name) {
 }
 
 EmojiCollection::~EmojiCollection() {
-    for (auto it = emoji_collection_.begin(); it != emoji_collection_.end(); ++it) {
-        delete it->second;
+    for (auto& slot : slots_) {
+        delete slot.image;
     }
-    emoji_collection_.clear();
+    slots_.clear();
 }
 
 // These are declared in xiaozhi-fonts/src/font_emoji_32.c
@@ -5,9 +5,10 @@
 
 #include <lvgl.h>
 
-#include <map>
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 
 
 // Define interface for emoji collection
@@ -18,7 +19,19 @@ public:
     virtual ~EmojiCollection();
 
 private:
-    std::map<std::string, LvglImage*> emoji_collection_;
+    struct Slot {
+        std::string name;
+        LvglImage* image = nullptr;  // nullptr for an empty slot
+        uint32_t hash = 0;
+    };
+
+    // Open addressing on the name hash, looked up on every SetEmotion without building a string
+    std::vector<Slot> slots_;
+    size_t count_ = 0;
+
+    static uint32_t Hash(const char* name);
+    Slot* Find(const char* name, uint32_t hash);
+    void Grow();
 };
 
 class Twemoji32 : public EmojiCollection {
@@ -0,0 +1,270 @@
+#include "framebuffer_mirror.h"
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if !CONFIG_IDF_TARGET_ESP32
+#include "jpg/image_to_jpeg.h"
+#endif
+
+#define TAG "FramebufferMirror"
+
+#define MIRROR_TILE_SIZE 32
+// Frames are split at about this size, so one frame never fills a client's send queue
+#define MIRROR_FRAME_BYTES (16 * 1024)
+
+enum : uint8_t {
+    kTileEncodingRle = 1,
+    kTileEncodingJpeg = 2,
+};
+
+static void AppendU16(std::string& out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+static void AppendU32(std::string& out, uint32_t value) {
+    AppendU16(out, value & 0xffff);
+    AppendU16(out, value >> 16);
+}
+
+static void EncodeRle(std::string& out, const uint16_t* pixels, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && run < 129 && pixels[i + run] == pixels[i]) {
+            run++;
+        }
+        if (run >= 2) {
+            out.push_back(run + 126);
+            AppendU16(out, pixels[i]);
+            i += run;
+            continue;
+        }
+        // Literals up to the next run of two
+        size_t literals = 1;
+        while (i + literals < count && literals < 128 &&
+               !(i + literals + 1 < count && pixels[i + literals] == pixels[i + literals + 1])) {
+            literals++;
+        }
+        out.push_back(literals - 1);
+        for (size_t j = 0; j < literals; j++) {
+            AppendU16(out, pixels[i + j]);
+        }
+        i += literals;
+    }
+}
+
+FramebufferMirror::FramebufferMirror(lv_display_t* display, FrameSink sink, int max_fps, int jpeg_quality)
+    : display_(display), sink_(std::move(sink)), jpeg_quality_(jpeg_quality) {
+    width_ = lv_display_get_horizontal_resolution(display_);
+    height_ = lv_display_get_vertical_resolution(display_);
+    tiles_x_ = (width_ + MIRROR_TILE_SIZE - 1) / MIRROR_TILE_SIZE;
+    tiles_y_ = (height_ + MIRROR_TILE_SIZE - 1) / MIRROR_TILE_SIZE;
+    frame_period_us_ = 1000000 / std::max(max_fps, 1);
+
+    if (lv_display_get_color_format(display_) != LV_COLOR_FORMAT_RGB565) {
+        ESP_LOGW(TAG, "Only RGB565 displays can be mirrored");
+        return;
+    }
+    shadow_ = (uint16_t*)heap_caps_calloc(width_ * height_, sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (shadow_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the %dx%d shadow framebuffer", width_, height_);
+        return;
+    }
+    // The shadow starts out blank, the first frame sends everything
+    dirty_.assign(tiles_x_ * tiles_y_, 1);
+    tile_pixels_.resize(MIRROR_TILE_SIZE * MIRROR_TILE_SIZE);
+
+    TaskManifest::Create("fb_mirror", [](void* arg) {
+        static_cast<FramebufferMirror*>(arg)->MirrorTask();
+    }, this, &task_);
+}
+
+FramebufferMirror::~FramebufferMirror() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    if (task_ != nullptr) {
+        xTaskNotifyGive(task_);
+        // The task clears task_ when it leaves the loop
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (task_ == nullptr) {
+                    break;
+                }
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    heap_caps_free(shadow_);
+}
+
+void FramebufferMirror::OnFlush(const lv_area_t* area) {
+    lv_draw_buf_t* buf = lv_display_get_buf_active(display_);
+    if (shadow_ == nullptr || buf == nullptr) {
+        return;
+    }
+    lv_area_t clipped = {0, 0, width_ - 1, height_ - 1};
+    if (!lv_area_intersect(&clipped, &clipped, area)) {
+        return;
+    }
+
+    // Partial buffers hold just the area, full screen buffers (full and direct mode) the whole screen
+    const uint8_t* origin = buf->data;
+    size_t stride = buf->header.stride;
+    if (buf->header.w == width_ && buf->header.h == height_) {
+        origin += area->y1 * stride + area->x1 * 2;
+    }
+    origin += (clipped.y1 - area->y1) * stride + (clipped.x1 - area->x1) * 2;
+
+    bool changed = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int ty = clipped.y1 / MIRROR_TILE_SIZE; ty <= clipped.y2 / MIRROR_TILE_SIZE; ty++) {
+        int y1 = std::max<int>(clipped.y1, ty * MIRROR_TILE_SIZE);
+        int y2 = std::min<int>(clipped.y2, ty * MIRROR_TILE_SIZE + MIRROR_TILE_SIZE - 1);
+        for (int tx = clipped.x1 / MIRROR_TILE_SIZE; tx <= clipped.x2 / MIRROR_TILE_SIZE; tx++) {
+            int x1 = std::max<int>(clipped.x1, tx * MIRROR_TILE_SIZE);
+            int x2 = std::min<int>(clipped.x2, tx * MIRROR_TILE_SIZE + MIRROR_TILE_SIZE - 1);
+            size_t bytes = (x2 - x1 + 1) * 2;
+            uint8_t& dirty = dirty_[ty * tiles_x_ + tx];
+            for (int y = y1; y <= y2; y++) {
+                const uint8_t* src = origin + (y - clipped.y1) * stride + (x1 - clipped.x1) * 2;
+                uint16_t* dst = shadow_ + y * width_ + x1;
+                // Redrawn but unchanged pixels are not sent again
+                if (memcmp(dst, src, bytes) != 0) {
+                    memcpy(dst, src, bytes);
+                    dirty = 1;
+                    changed = true;
+                }
+            }
+        }
+    }
+    if (changed) {
+        xTaskNotifyGive(task_);
+    }
+}
+
+void FramebufferMirror::RequestKeyframe() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fill(dirty_.begin(), dirty_.end(), 1);
+    }
+    if (task_ != nullptr) {
+        xTaskNotifyGive(task_);
+    }
+}
+
+void FramebufferMirror::MirrorTask() {
+    int64_t last_frame_us = 0;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Cap the rate, the flushes meanwhile only add to the dirty tiles
+        int64_t wait_us = last_frame_us + frame_period_us_ - esp_timer_get_time();
+        if (wait_us > 0) {
+            vTaskDelay(pdMS_TO_TICKS(wait_us / 1000) + 1);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                break;
+            }
+        }
+        last_frame_us = esp_timer_get_time();
+        EncodeFrame();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = nullptr;
+    }
+    TaskManifest::Exit();
+}
+
+void FramebufferMirror::EncodeFrame() {
+    std::string frame;
+    int tiles = 0;
+    auto begin_frame = [&]() {
+        frame.clear();
+        frame.push_back('M');
+        AppendU16(frame, width_);
+        AppendU16(frame, height_);
+        // Tile count, written when the frame is sent
+        AppendU16(frame, 0);
+        tiles = 0;
+    };
+    auto send_frame = [&]() {
+        frame[5] = tiles & 0xff;
+        frame[6] = tiles >> 8;
+        sink_(std::move(frame));
+    };
+
+    begin_frame();
+    for (int i = 0; i < tiles_x_ * tiles_y_; i++) {
+        int x = (i % tiles_x_) * MIRROR_TILE_SIZE;
+        int y = (i / tiles_x_) * MIRROR_TILE_SIZE;
+        int w = std::min(MIRROR_TILE_SIZE, width_ - x);
+        int h = std::min(MIRROR_TILE_SIZE, height_ - y);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                return;
+            }
+            if (!dirty_[i]) {
+                continue;
+            }
+            dirty_[i] = 0;
+            for (int row = 0; row < h; row++) {
+                memcpy(&tile_pixels_[row * w], shadow_ + (y + row) * width_ + x, w * 2);
+            }
+        }
+        EncodeTile(frame, x, y, w, h);
+        tiles++;
+        if (frame.size() >= MIRROR_FRAME_BYTES) {
+            send_frame();
+            begin_frame();
+        }
+    }
+    if (tiles > 0) {
+        send_frame();
+    }
+}
+
+void FramebufferMirror::EncodeTile(std::string& frame, int x, int y, int w, int h) {
+    AppendU16(frame, x);
+    AppendU16(frame, y);
+    AppendU16(frame, w);
+    AppendU16(frame, h);
+
+    std::string data;
+    EncodeRle(data, tile_pixels_.data(), w * h);
+    uint8_t encoding = kTileEncodingRle;
+#if !CONFIG_IDF_TARGET_ESP32
+    // Photos and gradients hardly shrink with RLE, a lossy JPEG is far smaller
+    if (data.size() > (size_t)w * h) {
+        std::string jpeg;
+        bool ok = rgb565_region_to_jpeg_cb((uint8_t*)tile_pixels_.data(), w * 2, w, h, 1, true, jpeg_quality_,
+            [](void* arg, size_t index, const void* data, size_t len) -> size_t {
+            if (data && len > 0) {
+                static_cast<std::string*>(arg)->append(static_cast<const char*>(data), len);
+            }
+            return len;
+        }, &jpeg);
+        if (ok && jpeg.size() < data.size()) {
+            data = std::move(jpeg);
+            encoding = kTileEncodingJpeg;
+        }
+    }
+#endif
+    frame.push_back(encoding);
+    AppendU32(frame, data.size());
+    frame.append(data);
+}
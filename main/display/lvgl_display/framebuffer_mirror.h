@@ -0,0 +1,63 @@
+#pragma once
+
+#include <lvgl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Mirrors what the panel shows, tile by tile. Every flush of the display is copied into a shadow
+ * framebuffer on the LVGL task, and tiles whose pixels changed are marked dirty; that copy is
+ * all the LVGL task pays. A low priority task encodes the dirty tiles at most max_fps times a
+ * second, RLE for flat UI content and JPEG where RLE does not pay, and hands the frames to the
+ * sink. Only RGB565 displays are supported.
+ *
+ * A frame is little endian: 'M', u16 screen width, u16 height, u16 tile count, then per tile
+ * u16 x, y, width, height, u8 encoding (1 RLE, 2 JPEG), u32 length and the data. The RLE is
+ * PackBits over pixels: a header h < 128 is followed by h + 1 literal pixels, otherwise by one
+ * pixel repeated h - 126 times.
+ */
+class FramebufferMirror {
+public:
+    // Called on the mirror task, frames are at most MIRROR_FRAME_BYTES plus one tile
+    using FrameSink = std::function<void(std::string&& frame)>;
+
+    FramebufferMirror(lv_display_t* display, FrameSink sink, int max_fps, int jpeg_quality);
+    ~FramebufferMirror();
+
+    bool IsValid() const { return shadow_ != nullptr; }
+
+    // Called on the LVGL task from LV_EVENT_FLUSH_START
+    void OnFlush(const lv_area_t* area);
+
+    // Sends every tile with the next frame, e.g. for a new viewer
+    void RequestKeyframe();
+
+private:
+    lv_display_t* display_;
+    FrameSink sink_;
+    int width_;
+    int height_;
+    int tiles_x_;
+    int tiles_y_;
+    int frame_period_us_;
+    int jpeg_quality_;
+
+    std::mutex mutex_;
+    uint16_t* shadow_ = nullptr;
+    std::vector<uint8_t> dirty_;
+    // One tile copied out of the shadow, so the encoder never holds the mutex
+    std::vector<uint16_t> tile_pixels_;
+    TaskHandle_t task_ = nullptr;
+    bool stopping_ = false;
+
+    void MirrorTask();
+    void EncodeFrame();
+    void EncodeTile(std::string& frame, int x, int y, int w, int h);
+};
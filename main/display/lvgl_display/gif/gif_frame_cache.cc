@@ -0,0 +1,163 @@
+#include "gif_frame_cache.h"
+#include "memory_budget.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "GifFrameCache"
+
+#ifndef CONFIG_GIF_FRAME_CACHE_KB
+#define CONFIG_GIF_FRAME_CACHE_KB 0
+#endif
+
+#define PALETTE_BYTES (256 * 4)
+
+GifFrames::~GifFrames() {
+    for (auto& frame : frames_) {
+        heap_caps_free(frame.data);
+    }
+}
+
+bool GifFrames::Append(const uint8_t* canvas, uint32_t delay_ms) {
+    size_t pixels = (size_t)width_ * height_;
+    auto argb = reinterpret_cast<const uint32_t*>(canvas);
+
+    // Collect the palette, GIF frames rarely have more than 256 colors after compositing
+    uint32_t palette[256];
+    int colors = 0;
+    uint16_t table[512];
+    memset(table, 0xFF, sizeof(table));
+    bool indexed = true;
+    for (size_t i = 0; i < pixels && indexed; i++) {
+        uint32_t color = argb[i];
+        uint32_t slot = (color * 2654435761u) >> 23;
+        while (table[slot] != 0xFFFF && palette[table[slot]] != color) {
+            slot = (slot + 1) & 511;
+        }
+        if (table[slot] == 0xFFFF) {
+            if (colors == 256) {
+                indexed = false;
+                break;
+            }
+            palette[colors] = color;
+            table[slot] = colors++;
+        }
+    }
+
+    size_t size = indexed ? PALETTE_BYTES + pixels : pixels * 4;
+    auto budget = GifFrameCache::GetInstance().budget();
+    if (bytes_ + size > budget) {
+        return false;
+    }
+    auto data = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (data == nullptr) {
+        return false;
+    }
+
+    if (indexed) {
+        memcpy(data, palette, colors * 4);
+        uint8_t* indices = data + PALETTE_BYTES;
+        for (size_t i = 0; i < pixels; i++) {
+            uint32_t slot = (argb[i] * 2654435761u) >> 23;
+            while (palette[table[slot]] != argb[i]) {
+                slot = (slot + 1) & 511;
+            }
+            indices[i] = table[slot];
+        }
+    } else {
+        memcpy(data, canvas, size);
+    }
+    frames_.push_back({data, delay_ms, indexed});
+    bytes_ += size;
+    return true;
+}
+
+void GifFrames::Blit(size_t index, uint8_t* canvas) const {
+    auto& frame = frames_[index];
+    size_t pixels = (size_t)width_ * height_;
+    if (!frame.indexed) {
+        memcpy(canvas, frame.data, pixels * 4);
+        return;
+    }
+    auto palette = reinterpret_cast<const uint32_t*>(frame.data);
+    auto indices = frame.data + PALETTE_BYTES;
+    auto argb = reinterpret_cast<uint32_t*>(canvas);
+    for (size_t i = 0; i < pixels; i++) {
+        argb[i] = palette[indices[i]];
+    }
+}
+
+GifFrameCache::GifFrameCache() {
+    budget_ = (size_t)CONFIG_GIF_FRAME_CACHE_KB * 1024;
+    if (budget_ > 0 && heap_caps_get_total_size(MALLOC_CAP_SPIRAM) == 0) {
+        ESP_LOGW(TAG, "No PSRAM, GIF frame cache disabled");
+        budget_ = 0;
+    }
+    if (budget_ > 0) {
+        MemoryBudget::GetInstance().Register("gif_frame_cache", MALLOC_CAP_SPIRAM, budget_, kMemoryPriorityLow,
+            [this]() {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return bytes_;
+            }, [this](size_t bytes) { return Trim(bytes); });
+    }
+}
+
+size_t GifFrameCache::Trim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t freed = 0;
+    auto it = entries_.end();
+    while (freed < bytes && it != entries_.begin()) {
+        --it;
+        if (it->use_count() > 1) {
+            continue;
+        }
+        bytes_ -= (*it)->bytes();
+        freed += (*it)->bytes();
+        it = entries_.erase(it);
+    }
+    return freed;
+}
+
+std::shared_ptr<const GifFrames> GifFrameCache::Find(const void* key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if ((*it)->key() == key) {
+            entries_.splice(entries_.begin(), entries_, it);
+            return entries_.front();
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<GifFrames> GifFrameCache::Begin(const void* key, uint16_t width, uint16_t height) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (budget_ == 0 || too_large_.count(key) > 0 || building_.count(key) > 0) {
+        return nullptr;
+    }
+    building_.insert(key);
+    return std::make_shared<GifFrames>(key, width, height);
+}
+
+void GifFrameCache::Commit(std::shared_ptr<GifFrames> frames) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    building_.erase(frames->key());
+
+    /* Players still holding an evicted GIF keep it until they stop */
+    while (!entries_.empty() && bytes_ + frames->bytes() > budget_) {
+        bytes_ -= entries_.back()->bytes();
+        ESP_LOGD(TAG, "Evicted GIF %p, %u bytes", entries_.back()->key(), (unsigned)entries_.back()->bytes());
+        entries_.pop_back();
+    }
+    bytes_ += frames->bytes();
+    ESP_LOGI(TAG, "Cached %u frames of GIF %p, %u bytes, total %u/%u", (unsigned)frames->count(), frames->key(),
+        (unsigned)frames->bytes(), (unsigned)bytes_, (unsigned)budget_);
+    entries_.push_front(std::move(frames));
+}
+
+void GifFrameCache::Abandon(const void* key, bool too_large) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    building_.erase(key);
+    if (too_large) {
+        too_large_.insert(key);
+    }
+}
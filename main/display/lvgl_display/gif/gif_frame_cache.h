@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Composited frames of a GIF, decoded once while it plays the first time
+ * Frames with up to 256 colors are kept indexed with their own palette, others as ARGB8888
+ */
+class GifFrames {
+public:
+    GifFrames(const void* key, uint16_t width, uint16_t height) : key_(key), width_(width), height_(height) {}
+    ~GifFrames();
+
+    /**
+     * Store the canvas (ARGB8888) shown for delay_ms, false if the memory is not available
+     */
+    bool Append(const uint8_t* canvas, uint32_t delay_ms);
+
+    /**
+     * Expand a frame into an ARGB8888 canvas of the same size
+     */
+    void Blit(size_t index, uint8_t* canvas) const;
+
+    size_t count() const { return frames_.size(); }
+    uint32_t delay_ms(size_t index) const { return frames_[index].delay_ms; }
+    size_t bytes() const { return bytes_; }
+    const void* key() const { return key_; }
+
+private:
+    struct Frame {
+        uint8_t* data;  // palette (256 x ARGB8888) then indices, or the ARGB8888 pixels
+        uint32_t delay_ms;
+        bool indexed;
+    };
+
+    const void* key_;
+    uint16_t width_;
+    uint16_t height_;
+    std::vector<Frame> frames_;
+    size_t bytes_ = 0;
+};
+
+/**
+ * Decoded GIF frames shared by every player of the same GIF data, e.g. an emotion shown
+ * again or on another display. Kept within CONFIG_GIF_FRAME_CACHE_KB of PSRAM, the least
+ * recently played GIFs are dropped first.
+ */
+class GifFrameCache {
+public:
+    static GifFrameCache& GetInstance() {
+        static GifFrameCache instance;
+        return instance;
+    }
+
+    /**
+     * Frames of a GIF that was fully decoded before, or nullptr
+     */
+    std::shared_ptr<const GifFrames> Find(const void* key);
+
+    /**
+     * Frames to fill while the GIF is decoded, nullptr if the cache is disabled, the GIF is
+     * partly decoded elsewhere or known not to fit
+     */
+    std::shared_ptr<GifFrames> Begin(const void* key, uint16_t width, uint16_t height);
+
+    /**
+     * Makes the frames available to Find()
+     */
+    void Commit(std::shared_ptr<GifFrames> frames);
+
+    /**
+     * Drops frames that were not completed, too_large stops further attempts for the GIF
+     */
+    void Abandon(const void* key, bool too_large);
+
+    /**
+     * Drops least recently played GIFs that no player holds, returns the bytes freed
+     */
+    size_t Trim(size_t bytes);
+
+    size_t budget() const { return budget_; }
+
+private:
+    GifFrameCache();
+
+    std::mutex mutex_;
+    // Most recently played first
+    std::list<std::shared_ptr<GifFrames>> entries_;
+    std::unordered_set<const void*> building_;
+    std::unordered_set<const void*> too_large_;
+    size_t bytes_ = 0;
+    size_t budget_ = 0;
+};
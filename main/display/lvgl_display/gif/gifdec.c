@@ -29,6 +29,7 @@ typedef struct Table {
 #endif
 
 static gd_GIF  * gif_open(gd_GIF * gif);
+static void fill_rect(uint8_t * dst, uint16_t w, uint16_t h, uint16_t stride, const uint8_t * color, uint8_t opa);
 static bool f_gif_open(gd_GIF * gif, const void * path, bool is_file);
 static inline void f_gif_read(gd_GIF * gif, void * buf, size_t len);
 static inline int f_gif_seek(gd_GIF * gif, size_t pos, int k);
@@ -152,12 +153,8 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
 #ifdef GIFDEC_FILL_BG
     GIFDEC_FILL_BG(gif->canvas, gif->width * gif->height, 1, gif->width * gif->height, bgcolor, 0x00);
 #else
-    for(int i = 0; i < gif->width * gif->height; i++) {
-        gif->canvas[i * 4 + 0] = *(bgcolor + 2);
-        gif->canvas[i * 4 + 1] = *(bgcolor + 1);
-        gif->canvas[i * 4 + 2] = *(bgcolor + 0);
-        gif->canvas[i * 4 + 3] = 0x00;  // 初始化为透明，让第一帧根据自己的透明度设置来渲染
-    }
+    // 初始化为透明，让第一帧根据自己的透明度设置来渲染
+    fill_rect(gif->canvas, gif->width, gif->height, gif->width, bgcolor, 0x00);
 #endif
     gif->anim_start = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
     gif->loop_count = -1;
@@ -653,10 +650,39 @@ read_image(gd_GIF * gif)
     }
     else
         gif->palette = &gif->gct;
+    gif->palette_argb_valid = 0;
     /* Image Data. */
     return read_image_data(gif, interlace);
 }
 
+static const uint32_t *
+palette_argb(gd_GIF * gif)
+{
+    if(!gif->palette_argb_valid) {
+        const uint8_t * color = gif->palette->colors;
+        for(int i = 0; i < 0x100; i++, color += 3) {
+            gif->palette_argb[i] = 0xFF000000u | ((uint32_t) color[0] << 16) | ((uint32_t) color[1] << 8) | color[2];
+        }
+        gif->palette_argb_valid = 1;
+    }
+    return gif->palette_argb;
+}
+
+static void
+fill_rect(uint8_t * dst, uint16_t w, uint16_t h, uint16_t stride, const uint8_t * color, uint8_t opa)
+{
+    uint32_t pixel = ((uint32_t) opa << 24) | ((uint32_t) color[0] << 16) | ((uint32_t) color[1] << 8) | color[2];
+    uint32_t * row = (uint32_t *) dst;
+    int j, k;
+
+    for(j = 0; j < h; j++) {
+        for(k = 0; k < w; k++) {
+            row[k] = pixel;
+        }
+        row += stride;
+    }
+}
+
 static void
 render_frame_rect(gd_GIF * gif, uint8_t * buffer)
 {
@@ -666,21 +692,33 @@ render_frame_rect(gd_GIF * gif, uint8_t * buffer)
                         &gif->frame[i], gif->palette->colors,
                         gif->gce.transparency ? gif->gce.tindex : 0x100);
 #else
+    /* The canvas follows the gd_GIF header and is word aligned, write one pixel per store */
+    const uint32_t * lut = palette_argb(gif);
+    uint32_t * dst = (uint32_t *) buffer + i;
+    const uint8_t * src = &gif->frame[i];
     int j, k;
-    uint8_t index, * color;
-
-    for(j = 0; j < gif->fh; j++) {
-        for(k = 0; k < gif->fw; k++) {
-            index = gif->frame[(gif->fy + j) * gif->width + gif->fx + k];
-            color = &gif->palette->colors[index * 3];
-            if(!gif->gce.transparency || index != gif->gce.tindex) {
-                buffer[(i + k) * 4 + 0] = *(color + 2);
-                buffer[(i + k) * 4 + 1] = *(color + 1);
-                buffer[(i + k) * 4 + 2] = *(color + 0);
-                buffer[(i + k) * 4 + 3] = 0xFF;
+
+    if(!gif->gce.transparency) {
+        for(j = 0; j < gif->fh; j++) {
+            for(k = 0; k < gif->fw; k++) {
+                dst[k] = lut[src[k]];
             }
+            dst += gif->width;
+            src += gif->width;
+        }
+    }
+    else {
+        uint8_t tindex = gif->gce.tindex;
+        for(j = 0; j < gif->fh; j++) {
+            for(k = 0; k < gif->fw; k++) {
+                uint8_t index = src[k];
+                if(index != tindex) {
+                    dst[k] = lut[index];
+                }
+            }
+            dst += gif->width;
+            src += gif->width;
         }
-        i += gif->width;
     }
 #endif
 }
@@ -701,16 +739,7 @@ dispose(gd_GIF * gif)
 #ifdef GIFDEC_FILL_BG
             GIFDEC_FILL_BG(&(gif->canvas[i * 4]), gif->fw, gif->fh, gif->width, bgcolor, opa);
 #else
-            int j, k;
-            for(j = 0; j < gif->fh; j++) {
-                for(k = 0; k < gif->fw; k++) {
-                    gif->canvas[(i + k) * 4 + 0] = *(bgcolor + 2);
-                    gif->canvas[(i + k) * 4 + 1] = *(bgcolor + 1);
-                    gif->canvas[(i + k) * 4 + 2] = *(bgcolor + 0);
-                    gif->canvas[(i + k) * 4 + 3] = opa;
-                }
-                i += gif->width;
-            }
+            fill_rect(&(gif->canvas[i * 4]), gif->fw, gif->fh, gif->width, bgcolor, opa);
 #endif
             break;
         case 3: /* Restore to previous, i.e., don't update canvas.*/
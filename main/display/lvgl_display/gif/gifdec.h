@@ -36,6 +36,9 @@ typedef struct _gd_GIF {
     gd_GCE gce;
     gd_Palette * palette;
     gd_Palette lct, gct;
+    /* Palette expanded to canvas pixels, built on the first render of a frame */
+    uint32_t palette_argb[0x100];
+    uint8_t palette_argb_valid;
     void (*plain_text)(
         struct _gd_GIF * gif, uint16_t tx, uint16_t ty,
         uint16_t tw, uint16_t th, uint8_t cw, uint8_t ch,
@@ -6,7 +6,7 @@
 
 LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
     : gif_(nullptr), timer_(nullptr), last_call_(0), playing_(false), loaded_(false),
-      loop_delay_ms_(0), loop_waiting_(false), loop_wait_start_(0) {
+      loop_delay_ms_(0), loop_waiting_(false), loop_wait_start_(0), frame_index_(-1) {
     if (!img_dsc || !img_dsc->data) {
         ESP_LOGE(TAG, "Invalid image descriptor");
         return;
@@ -29,9 +29,18 @@ LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
     img_dsc_.data = gif_->canvas;
     img_dsc_.data_size = gif_->width * gif_->height * 4;
 
-    // Render first frame
-    if (gif_->canvas) {
-        gd_render_frame(gif_, gif_->canvas);
+    // The decoder still provides the canvas and the loop count when the frames are cached
+    auto& cache = GifFrameCache::GetInstance();
+    frames_ = cache.Find(img_dsc->data);
+    if (frames_ && frames_->count() > 0) {
+        frames_->Blit(0, gif_->canvas);
+    } else {
+        frames_.reset();
+        builder_ = cache.Begin(img_dsc->data, gif_->width, gif_->height);
+        // Render first frame
+        if (gif_->canvas) {
+            gd_render_frame(gif_, gif_->canvas);
+        }
     }
 
     loaded_ = true;
@@ -109,10 +118,19 @@ void LvglGif::Stop() {
     // Reset loop waiting state
     loop_waiting_ = false;
 
+    if (builder_) {
+        // Frames after the rewind would be drawn over the current canvas
+        GifFrameCache::GetInstance().Abandon(builder_->key(), false);
+        builder_.reset();
+    }
+
     if (gif_) {
         gd_rewind(gif_);
-        // Render first frame without advancing
-        if (gif_->canvas) {
+        if (frames_) {
+            frames_->Blit(0, gif_->canvas);
+            frame_index_ = 0;
+        } else if (gif_->canvas) {
+            // Render first frame without advancing
             gd_render_frame(gif_, gif_->canvas);
         }
         ESP_LOGD(TAG, "GIF animation stopped and rewound");
@@ -186,6 +204,11 @@ void LvglGif::NextFrame() {
         ESP_LOGD(TAG, "Loop delay completed, continuing GIF");
     }
 
+    if (frames_) {
+        NextCachedFrame();
+        return;
+    }
+
     // Check if enough time has passed for the next frame
     uint32_t elapsed = lv_tick_elaps(last_call_);
     if (elapsed < gif_->gce.delay * 10) {
@@ -201,11 +224,28 @@ void LvglGif::NextFrame() {
     int has_next = gd_get_frame(gif_);
     if (has_next == 0) {
         // Animation truly finished (non-infinite loop)
-        playing_ = false;
-        if (timer_) {
-            lv_timer_pause(timer_);
+        // The decoder is back at the first frame, so is the cached playback
+        if (builder_ && builder_->count() > 0) {
+            CommitFrames();
+        }
+        Finish();
+        return;
+    }
+    if (has_next < 0 && builder_) {
+        GifFrameCache::GetInstance().Abandon(builder_->key(), true);
+        builder_.reset();
+    }
+
+    // Every frame has been collected once the GIF starts over, replay them from the cache
+    if (builder_ && gif_->f_rw_p < pos_before) {
+        CommitFrames();
+        if (loop_delay_ms_ > 0) {
+            loop_waiting_ = true;
+            loop_wait_start_ = lv_tick_get();
+            ESP_LOGD(TAG, "GIF completed one cycle, waiting %lu ms before next loop", loop_delay_ms_);
+        } else {
+            NextCachedFrame();
         }
-        ESP_LOGD(TAG, "GIF animation completed");
         return;
     }
 
@@ -223,6 +263,12 @@ void LvglGif::NextFrame() {
     // Render current frame
     if (gif_->canvas) {
         gd_render_frame(gif_, gif_->canvas);
+
+        if (builder_ && !builder_->Append(gif_->canvas, gif_->gce.delay * 10)) {
+            ESP_LOGW(TAG, "GIF frames do not fit in the frame cache");
+            GifFrameCache::GetInstance().Abandon(builder_->key(), true);
+            builder_.reset();
+        }
         
         // Call frame callback if set
         if (frame_callback_) {
@@ -231,6 +277,55 @@ void LvglGif::NextFrame() {
     }
 }
 
+void LvglGif::NextCachedFrame() {
+    if (frame_index_ >= 0 && lv_tick_elaps(last_call_) < frames_->delay_ms(frame_index_)) {
+        return;
+    }
+    last_call_ = lv_tick_get();
+
+    int next = frame_index_ + 1;
+    if (next >= (int)frames_->count()) {
+        // Same loop count handling as gd_get_frame() at the GIF trailer
+        if (gif_->loop_count == 1 || gif_->loop_count < 0) {
+            frame_index_ = -1;
+            Finish();
+            return;
+        }
+        if (gif_->loop_count > 1) {
+            gif_->loop_count--;
+        }
+        frame_index_ = -1;
+        if (loop_delay_ms_ > 0) {
+            loop_waiting_ = true;
+            loop_wait_start_ = lv_tick_get();
+            ESP_LOGD(TAG, "GIF completed one cycle, waiting %lu ms before next loop", loop_delay_ms_);
+            return;
+        }
+        next = 0;
+    }
+
+    frame_index_ = next;
+    frames_->Blit(frame_index_, gif_->canvas);
+    if (frame_callback_) {
+        frame_callback_();
+    }
+}
+
+void LvglGif::CommitFrames() {
+    frames_ = builder_;
+    GifFrameCache::GetInstance().Commit(std::move(builder_));
+    builder_.reset();
+    frame_index_ = -1;
+}
+
+void LvglGif::Finish() {
+    playing_ = false;
+    if (timer_) {
+        lv_timer_pause(timer_);
+    }
+    ESP_LOGD(TAG, "GIF animation completed");
+}
+
 void LvglGif::Cleanup() {
     // Stop and delete timer
     if (timer_) {
@@ -238,6 +333,12 @@ void LvglGif::Cleanup() {
         timer_ = nullptr;
     }
 
+    if (builder_) {
+        GifFrameCache::GetInstance().Abandon(builder_->key(), false);
+        builder_.reset();
+    }
+    frames_.reset();
+
     // Close GIF decoder
     if (gif_) {
         gd_close_gif(gif_);
@@ -2,6 +2,7 @@
 
 #include "../lvgl_image.h"
 #include "gifdec.h"
+#include "gif_frame_cache.h"
 #include <lvgl.h>
 #include <memory>
 #include <functional>
@@ -104,11 +105,33 @@ private:
     
     // Frame update callback
     std::function<void()> frame_callback_;
+
+    // Decoded frames once the GIF has played through, replayed instead of decoding again
+    std::shared_ptr<const GifFrames> frames_;
+    // Frames collected during the first playback, handed to the cache when it completes
+    std::shared_ptr<GifFrames> builder_;
+    // Cached frame shown, -1 before the first one
+    int frame_index_;
     
     /**
      * Update to next frame
      */
     void NextFrame();
+
+    /**
+     * Update to next frame from the cached frames
+     */
+    void NextCachedFrame();
+
+    /**
+     * Hand the collected frames to the cache and continue playing from it
+     */
+    void CommitFrames();
+
+    /**
+     * Stop playing after the last frame
+     */
+    void Finish();
     
     /**
      * Cleanup resources
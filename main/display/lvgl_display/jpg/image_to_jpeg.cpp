@@ -35,6 +35,23 @@ static __always_inline uint8_t expand_6_to_8(uint8_t v) {
     return (uint8_t)((v << 2) | (v >> 4));
 }
 
+// 可按行连续读取的格式每个像素的字节数，平面格式返回 0
+static int bytes_per_pixel(v4l2_pix_fmt_t format) {
+    switch (format) {
+        case V4L2_PIX_FMT_GREY:
+            return 1;
+        case V4L2_PIX_FMT_RGB24:
+            return 3;
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_RGB565X:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
 static uint8_t* convert_input_to_encoder_buf(const uint8_t* src, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
                                              jpeg_pixel_format_t* out_fmt, int* out_size) {
     // GRAY 直接作为 JPEG_PIXEL_FORMAT_GRAY 输入
@@ -275,27 +292,10 @@ static uint8_t* convert_input_to_hw_encoder_buf(const uint8_t* src, uint16_t wid
     return NULL;
 }
 
-static bool encode_with_hw_jpeg(const uint8_t* src, size_t src_len, uint16_t width, uint16_t height,
-                                v4l2_pix_fmt_t format, uint8_t quality, uint8_t** jpg_out, size_t* jpg_out_len,
-                                jpg_out_cb cb, void* cb_arg) {
-    if (quality < 1)
-        quality = 1;
-    if (quality > 100)
-        quality = 100;
-
-    jpeg_enc_input_format_t enc_src_type = JPEG_ENCODE_IN_FORMAT_RGB888;
-    int enc_in_size = 0;
-    uint8_t* enc_in = convert_input_to_hw_encoder_buf(src, width, height, format, &enc_src_type, &enc_in_size);
-    if (!enc_in) {
-        ESP_LOGW(TAG, "hw jpeg: unsupported format, fallback to sw");
-        return false;
-    }
-
-    if (!hw_jpeg_ensure_inited()) {
-        free(enc_in);
-        return false;
-    }
-
+// 用硬件编码器编码已是编码器输入格式的缓冲区，不会释放 enc_in
+static bool hw_jpeg_process(const uint8_t* enc_in, int enc_in_size, uint16_t width, uint16_t height,
+                            jpeg_enc_input_format_t enc_src_type, uint8_t quality, uint8_t** jpg_out,
+                            size_t* jpg_out_len, jpg_out_cb cb, void* cb_arg) {
     jpeg_encode_cfg_t enc_cfg = {0};
     enc_cfg.width = width;
     enc_cfg.height = height;
@@ -310,14 +310,13 @@ static bool encode_with_hw_jpeg(const uint8_t* src, size_t src_len, uint16_t wid
     size_t out_cap_aligned = 0;
     uint8_t* outbuf = (uint8_t*)jpeg_alloc_encoder_mem(out_cap, &jpeg_enc_output_mem_cfg, &out_cap_aligned);
     if (!outbuf) {
-        free(enc_in);
         ESP_LOGE(TAG, "alloc out buffer failed");
         return false;
     }
 
     uint32_t out_len = 0;
-    esp_err_t er = jpeg_encoder_process(s_hw_jpeg_handle, &enc_cfg, enc_in, (uint32_t)enc_in_size, outbuf, (uint32_t)out_cap_aligned, &out_len);
-    free(enc_in);
+    esp_err_t er = jpeg_encoder_process(s_hw_jpeg_handle, &enc_cfg, const_cast<uint8_t*>(enc_in), (uint32_t)enc_in_size,
+                                        outbuf, (uint32_t)out_cap_aligned, &out_len);
 
     if (er != ESP_OK) {
         free(outbuf);
@@ -345,6 +344,32 @@ static bool encode_with_hw_jpeg(const uint8_t* src, size_t src_len, uint16_t wid
     free(outbuf);
     return true;
 }
+
+static bool encode_with_hw_jpeg(const uint8_t* src, size_t src_len, uint16_t width, uint16_t height,
+                                v4l2_pix_fmt_t format, uint8_t quality, uint8_t** jpg_out, size_t* jpg_out_len,
+                                jpg_out_cb cb, void* cb_arg) {
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    jpeg_enc_input_format_t enc_src_type = JPEG_ENCODE_IN_FORMAT_RGB888;
+    int enc_in_size = 0;
+    uint8_t* enc_in = convert_input_to_hw_encoder_buf(src, width, height, format, &enc_src_type, &enc_in_size);
+    if (!enc_in) {
+        ESP_LOGW(TAG, "hw jpeg: unsupported format, fallback to sw");
+        return false;
+    }
+
+    if (!hw_jpeg_ensure_inited()) {
+        free(enc_in);
+        return false;
+    }
+
+    bool ok = hw_jpeg_process(enc_in, enc_in_size, width, height, enc_src_type, quality, jpg_out, jpg_out_len, cb, cb_arg);
+    free(enc_in);
+    return ok;
+}
 #endif // CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
 
 static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_t width, uint16_t height,
@@ -463,5 +488,331 @@ bool image_to_jpeg_cb(uint8_t* src, size_t src_len, uint16_t width, uint16_t hei
     }
     // Fallback to esp_new_jpeg
 #endif
+    // 按条带读取源图像，不需要整帧的转换缓冲区和输出缓冲区
+    int bpp = bytes_per_pixel(format);
+    if (bpp > 0 && (format == V4L2_PIX_FMT_GREY || (width & 1) == 0) &&
+        src_len >= (size_t)width * height * bpp) {
+        struct frame_rows {
+            const uint8_t* data;
+            size_t row_bytes;
+        } rows = {src, (size_t)width * bpp};
+        return image_stripes_to_jpeg_cb(width, height, format, quality,
+            [](void* in_arg, uint16_t y, uint16_t /* rows */) -> const uint8_t* {
+                auto rows = static_cast<const frame_rows*>(in_arg);
+                return rows->data + y * rows->row_bytes;
+            }, &rows, cb, arg);
+    }
     return encode_with_esp_new_jpeg(src, src_len, width, height, format, quality, NULL, NULL, cb, arg);
 }
+
+// RGB565 帧缓冲中的区域，width/height 为缩小后的尺寸
+struct rgb565_region {
+    const uint8_t* data;
+    size_t stride;
+    uint16_t width;
+    uint16_t height;
+    uint8_t scale;
+    bool byte_swap;
+};
+
+static __always_inline uint16_t load_rgb565(const uint8_t* p, bool byte_swap) {
+    uint16_t v = *(const uint16_t*)p;
+    return byte_swap ? __builtin_bswap16(v) : v;
+}
+
+// 取 scale x scale 个像素的平均值，返回 5/6/5 位的分量
+static __always_inline void sample_rgb565(const rgb565_region& region, int x, int y, int* r, int* g, int* b) {
+    const uint8_t* p = region.data + (size_t)y * region.scale * region.stride + (size_t)x * region.scale * 2;
+    if (region.scale == 1) {
+        uint16_t v = load_rgb565(p, region.byte_swap);
+        *r = v >> 11;
+        *g = (v >> 5) & 0x3F;
+        *b = v & 0x1F;
+        return;
+    }
+    int sr = 0, sg = 0, sb = 0;
+    for (int dy = 0; dy < region.scale; dy++) {
+        const uint8_t* row = p + dy * region.stride;
+        for (int dx = 0; dx < region.scale; dx++) {
+            uint16_t v = load_rgb565(row + dx * 2, region.byte_swap);
+            sr += v >> 11;
+            sg += (v >> 5) & 0x3F;
+            sb += v & 0x1F;
+        }
+    }
+    // scale 为 2 或 4，像素数是 4 或 16
+    int shift = region.scale == 2 ? 2 : 4;
+    *r = sr >> shift;
+    *g = sg >> shift;
+    *b = sb >> shift;
+}
+
+static __always_inline uint8_t clamp_u8(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// 将输出的第 y 行转换为 YUYV (JFIF 全范围 BT.601)
+static void rgb565_row_to_yuyv(const rgb565_region& region, int y, uint8_t* dst) {
+    for (int x = 0; x < region.width; x += 2) {
+        int r5, g6, b5;
+        sample_rgb565(region, x, y, &r5, &g6, &b5);
+        int r0 = expand_5_to_8(r5), g0 = expand_6_to_8(g6), b0 = expand_5_to_8(b5);
+        sample_rgb565(region, x + 1, y, &r5, &g6, &b5);
+        int r1 = expand_5_to_8(r5), g1 = expand_6_to_8(g6), b1 = expand_5_to_8(b5);
+
+        int r = (r0 + r1) >> 1, g = (g0 + g1) >> 1, b = (b0 + b1) >> 1;
+        dst[0] = (uint8_t)((77 * r0 + 150 * g0 + 29 * b0) >> 8);
+        dst[1] = clamp_u8(((-43 * r - 85 * g + 128 * b) >> 8) + 128);
+        dst[2] = (uint8_t)((77 * r1 + 150 * g1 + 29 * b1) >> 8);
+        dst[3] = clamp_u8(((128 * r - 107 * g - 21 * b) >> 8) + 128);
+        dst += 4;
+    }
+}
+
+// 把输出的第 y 行起的 rows 行写入 dst，每行 width 个像素，格式为编码器输入格式
+typedef bool (*fill_rows_fn)(void* ctx, int y, int rows, uint8_t* dst);
+
+/*
+ * 按 MCU 行条带编码：每次只把一个条带转换为编码器输入格式，编码结果立即交给回调，
+ * 峰值内存只有一个条带加一个输出块，与图像大小基本无关。
+ */
+static bool encode_stripes(uint16_t width, uint16_t height, bool gray, fill_rows_fn fill, void* ctx,
+                           uint8_t quality, jpg_out_cb cb, void* cb_arg) {
+    jpeg_enc_config_t cfg = DEFAULT_JPEG_ENC_CONFIG();
+    cfg.width = width;
+    cfg.height = height;
+    cfg.src_type = gray ? JPEG_PIXEL_FORMAT_GRAY : JPEG_PIXEL_FORMAT_YCbYCr;
+    cfg.subsampling = gray ? JPEG_SUBSAMPLE_GRAY : JPEG_SUBSAMPLE_420;
+    cfg.quality = quality;
+    cfg.rotate = JPEG_ROTATE_0D;
+    cfg.task_enable = false;
+
+    jpeg_enc_handle_t h = NULL;
+    jpeg_error_t ret = jpeg_enc_open(&cfg, &h);
+    if (ret != JPEG_ERR_OK) {
+        ESP_LOGE(TAG, "jpeg_enc_open failed: %d", (int)ret);
+        return false;
+    }
+
+    // 每块是整数个输出行（一个 MCU 行）
+    int row_bytes = (int)width * (gray ? 1 : 2);
+    int block_size = jpeg_enc_get_block_size(h);
+    if (block_size <= 0 || block_size % row_bytes != 0) {
+        jpeg_enc_close(h);
+        ESP_LOGE(TAG, "unexpected block size: %d", block_size);
+        return false;
+    }
+    int block_rows = block_size / row_bytes;
+
+    // 第一块的输出还包含文件头和量化表
+    size_t out_cap = (size_t)block_size + 4096;
+    uint8_t* block = (uint8_t*)jpeg_calloc_align(block_size, 16);
+    uint8_t* outbuf = (uint8_t*)malloc_psram(out_cap);
+    if (!block || !outbuf) {
+        jpeg_free_align(block);
+        free(outbuf);
+        jpeg_enc_close(h);
+        ESP_LOGE(TAG, "alloc stripe buffers failed");
+        return false;
+    }
+
+    bool ok = true;
+    size_t index = 0;
+    for (int y = 0; y < height && ok; y += block_rows) {
+        int rows = height - y < block_rows ? height - y : block_rows;
+        if (!fill(ctx, y, rows, block)) {
+            ESP_LOGE(TAG, "failed to fill rows %d-%d", y, y + rows - 1);
+            ok = false;
+            break;
+        }
+        // 最后一块不足的行重复最后一行
+        for (int row = rows; row < block_rows; row++) {
+            memcpy(block + row * row_bytes, block + (rows - 1) * row_bytes, row_bytes);
+        }
+        int out_len = 0;
+        ret = jpeg_enc_process_with_block(h, block, block_size, outbuf, (int)out_cap, &out_len);
+        if (ret < JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "jpeg_enc_process_with_block failed: %d", (int)ret);
+            ok = false;
+        } else if (out_len > 0) {
+            cb(cb_arg, index++, outbuf, (size_t)out_len);
+        }
+    }
+    if (ok) {
+        cb(cb_arg, index, NULL, 0);  // 结束信号
+    }
+
+    jpeg_enc_close(h);
+    jpeg_free_align(block);
+    free(outbuf);
+    return ok;
+}
+
+static bool fill_rgb565_region_rows(void* ctx, int y, int rows, uint8_t* dst) {
+    const rgb565_region& region = *static_cast<const rgb565_region*>(ctx);
+    for (int row = 0; row < rows; row++) {
+        rgb565_row_to_yuyv(region, y + row, dst + row * (int)region.width * 2);
+    }
+    return true;
+}
+
+static bool encode_rgb565_region_stripes(const rgb565_region& region, uint8_t quality, jpg_out_cb cb, void* cb_arg) {
+    return encode_stripes(region.width, region.height, false, fill_rgb565_region_rows, (void*)&region, quality, cb,
+                          cb_arg);
+}
+
+// 按条带拉取的源图像
+struct pulled_image {
+    v4l2_pix_fmt_t format;
+    uint16_t width;
+    jpg_in_cb in;
+    void* in_arg;
+    // RGB 格式逐行转换为 YUYV
+    esp_imgfx_color_convert_handle_t convert;
+};
+
+static bool fill_pulled_rows(void* ctx, int y, int rows, uint8_t* dst) {
+    pulled_image& image = *static_cast<pulled_image*>(ctx);
+    const uint8_t* src = image.in(image.in_arg, (uint16_t)y, (uint16_t)rows);
+    if (src == NULL) {
+        return false;
+    }
+    int src_row_bytes = (int)image.width * bytes_per_pixel(image.format);
+    int dst_row_bytes = (int)image.width * (image.format == V4L2_PIX_FMT_GREY ? 1 : 2);
+
+    if (image.format == V4L2_PIX_FMT_GREY || image.format == V4L2_PIX_FMT_YUYV) {
+        memcpy(dst, src, (size_t)rows * src_row_bytes);
+        return true;
+    }
+    if (image.format == V4L2_PIX_FMT_UYVY) {
+        for (int i = 0; i < rows * src_row_bytes; i += 4) {
+            // src: Cb, Y0, Cr, Y1 -> dst: Y0, Cb, Y1, Cr
+            dst[i + 0] = src[i + 1];
+            dst[i + 1] = src[i + 0];
+            dst[i + 2] = src[i + 3];
+            dst[i + 3] = src[i + 2];
+        }
+        return true;
+    }
+    for (int row = 0; row < rows; row++) {
+        esp_imgfx_data_t in_data = {
+            .data = const_cast<uint8_t*>(src + row * src_row_bytes),
+            .data_len = static_cast<uint32_t>(src_row_bytes),
+        };
+        esp_imgfx_data_t out_data = {
+            .data = dst + row * dst_row_bytes,
+            .data_len = static_cast<uint32_t>(dst_row_bytes),
+        };
+        if (esp_imgfx_color_convert_process(image.convert, &in_data, &out_data) != ESP_IMGFX_ERR_OK) {
+            ESP_LOGE(TAG, "esp_imgfx_color_convert_process failed");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool image_stripes_to_jpeg_cb(uint16_t width, uint16_t height, v4l2_pix_fmt_t format, uint8_t quality, jpg_in_cb in,
+                              void* in_arg, jpg_out_cb cb, void* arg) {
+    if (bytes_per_pixel(format) == 0) {
+        ESP_LOGE(TAG, "unsupported stripe format: 0x%08lx", format);
+        return false;
+    }
+    if (width == 0 || height == 0 || (format != V4L2_PIX_FMT_GREY && (width & 1))) {
+        ESP_LOGE(TAG, "unsupported stripe size: %ux%u", width, height);
+        return false;
+    }
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    pulled_image image = {
+        .format = format,
+        .width = width,
+        .in = in,
+        .in_arg = in_arg,
+        .convert = nullptr,
+    };
+    if (format == V4L2_PIX_FMT_RGB24 || format == V4L2_PIX_FMT_RGB565 || format == V4L2_PIX_FMT_RGB565X) {
+        esp_imgfx_color_convert_cfg_t convert_cfg = {
+            .in_res = {.width = static_cast<int16_t>(width), .height = 1},
+            .in_pixel_fmt = format == V4L2_PIX_FMT_RGB24    ? ESP_IMGFX_PIXEL_FMT_RGB888
+                            : format == V4L2_PIX_FMT_RGB565 ? ESP_IMGFX_PIXEL_FMT_RGB565_LE
+                                                            : ESP_IMGFX_PIXEL_FMT_RGB565_BE,
+            .out_pixel_fmt = ESP_IMGFX_PIXEL_FMT_YUYV,
+            .color_space_std = ESP_IMGFX_COLOR_SPACE_STD_BT601,
+        };
+        esp_imgfx_err_t err = esp_imgfx_color_convert_open(&convert_cfg, &image.convert);
+        if (err != ESP_IMGFX_ERR_OK || image.convert == nullptr) {
+            ESP_LOGE(TAG, "esp_imgfx_color_convert_open failed");
+            return false;
+        }
+    }
+
+    bool ok = encode_stripes(width, height, format == V4L2_PIX_FMT_GREY, fill_pulled_rows, &image, quality, cb, arg);
+    if (image.convert) {
+        esp_imgfx_color_convert_close(image.convert);
+    }
+    return ok;
+}
+
+#if CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
+/*
+ * 在原缓冲区内把区域整理为连续的 RGB565 图像（已缩小、字节序已还原），写入位置总在
+ * 尚未读取的像素之前，因此不需要额外的缓冲区。
+ */
+static void compact_rgb565_region(uint8_t* base, const rgb565_region& region) {
+    uint16_t* dst = (uint16_t*)base;
+    for (int y = 0; y < region.height; y++) {
+        for (int x = 0; x < region.width; x++) {
+            int r, g, b;
+            sample_rgb565(region, x, y, &r, &g, &b);
+            *dst++ = (uint16_t)((r << 11) | (g << 5) | b);
+        }
+    }
+}
+#endif
+
+bool rgb565_region_to_jpeg_cb(uint8_t* src, size_t stride, uint16_t width, uint16_t height, uint8_t scale,
+                              bool byte_swap, uint8_t quality, jpg_out_cb cb, void* arg) {
+    if (scale != 1 && scale != 2 && scale != 4) {
+        ESP_LOGE(TAG, "unsupported scale: %u", scale);
+        return false;
+    }
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    rgb565_region region = {
+        .data = src,
+        .stride = stride,
+        .width = (uint16_t)(width / scale),
+        .height = (uint16_t)(height / scale),
+        .scale = scale,
+        .byte_swap = byte_swap,
+    };
+    // YUYV 以两个像素为一组
+    region.width &= ~1;
+    if (region.width == 0 || region.height == 0) {
+        ESP_LOGE(TAG, "region too small: %ux%u / %u", width, height, scale);
+        return false;
+    }
+
+#if CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
+    if (hw_jpeg_ensure_inited()) {
+        compact_rgb565_region(src, region);
+        int size = (int)region.width * (int)region.height * 2;
+        if (hw_jpeg_process(src, size, region.width, region.height, JPEG_ENCODE_IN_FORMAT_RGB565, quality,
+                            NULL, NULL, cb, arg)) {
+            return true;
+        }
+        // 缓冲区已整理为连续图像，软件编码从整理后的数据继续
+        region.data = src;
+        region.stride = (size_t)region.width * 2;
+        region.scale = 1;
+        region.byte_swap = false;
+    }
+#endif
+    return encode_rgb565_region_stripes(region, quality, cb, arg);
+}
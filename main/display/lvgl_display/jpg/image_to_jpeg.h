@@ -35,6 +35,11 @@ extern "C"
     // 返回: 实际处理的字节数
     typedef size_t (*jpg_out_cb)(void *arg, size_t index, const void *data, size_t len);
 
+    // 源图像输入回调函数类型
+    // arg: 用户自定义参数, y: 起始行, rows: 行数
+    // 返回: 这些行的像素数据（按 format 连续存放），NULL 表示失败并中止编码
+    typedef const uint8_t *(*jpg_in_cb)(void *arg, uint16_t y, uint16_t rows);
+
     /**
      * @brief 将图像格式高效转换为JPEG
      *
@@ -63,7 +68,8 @@ extern "C"
      * 使用回调函数处理JPEG输出数据，适合流式传输或分块处理：
      * - 节省约8KB的SRAM使用（静态变量改为堆分配）
      * - 支持流式输出，无需预分配大缓冲区
-     * - 通过回调函数逐块处理JPEG数据
+     * - 通过回调函数逐块处理JPEG数据，软件编码时每个条带输出一块
+     * - 软件编码按条带转换像素格式，不需要整帧的转换缓冲区
      *
      * @param src       源图像数据
      * @param src_len   源图像数据长度
@@ -79,6 +85,51 @@ extern "C"
     bool image_to_jpeg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height,
                           v4l2_pix_fmt_t format, uint8_t quality, jpg_out_cb cb, void *arg);
 
+    /**
+     * @brief 按条带拉取源图像并编码为JPEG（回调版本）
+     *
+     * 编码器每次通过 in 回调拉取一个 MCU 行条带（8 或 16 行）的源像素，转换为编码器输入格式后
+     * 立即编码，输出交给 cb：
+     * - 峰值内存只有一个条带的转换缓冲区和一个输出块，640x480 的图像约几十 KB
+     * - 源图像不必整帧存在于内存中，回调每次只需提供所请求的行
+     * - 只使用软件编码器
+     *
+     * @param width     图像宽度，GREY 以外的格式必须为偶数
+     * @param height    图像高度
+     * @param format    图像格式 (GREY, YUYV, UYVY, RGB24, RGB565, RGB565X)
+     * @param quality   JPEG质量 (1-100)
+     * @param in        源图像输入回调函数
+     * @param in_arg    传递给输入回调函数的用户参数
+     * @param cb        输出回调函数，每个条带的输出各调用一次，index 依次递增
+     * @param arg       传递给输出回调函数的用户参数
+     *
+     * @return true 成功, false 失败
+     */
+    bool image_stripes_to_jpeg_cb(uint16_t width, uint16_t height, v4l2_pix_fmt_t format, uint8_t quality,
+                                  jpg_in_cb in, void *in_arg, jpg_out_cb cb, void *arg);
+
+    /**
+     * @brief 将 RGB565 帧缓冲中的一个区域编码为JPEG（回调版本），可按 1/2/4 倍缩小
+     *
+     * 直接从帧缓冲读取像素，不复制整帧：
+     * - 软件编码按条带（一个 MCU 行）转换为 YUYV 后逐块编码，每块的输出立即交给回调
+     * - 启用硬件编码器时，像素在 src 缓冲区内原地整理后直接交给硬件，失败时回退到软件编码
+     *
+     * @param src       区域左上角像素的地址，使用硬件编码器时其内容会被改写
+     * @param stride    帧缓冲每行的字节数
+     * @param width     区域宽度（缩小前）
+     * @param height    区域高度（缩小前）
+     * @param scale     缩小倍数，1、2 或 4，每个输出像素取 scale x scale 个像素的平均值
+     * @param byte_swap 像素是否按字节交换存储
+     * @param quality   JPEG质量 (1-100)
+     * @param cb        输出回调函数
+     * @param arg       传递给回调函数的用户参数
+     *
+     * @return true 成功, false 失败
+     */
+    bool rgb565_region_to_jpeg_cb(uint8_t *src, size_t stride, uint16_t width, uint16_t height, uint8_t scale,
+                                  bool byte_swap, uint8_t quality, jpg_out_cb cb, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,8 +20,21 @@
 
 #define TAG "jpeg_to_image"
 
-static esp_err_t decode_with_new_jpeg(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len, size_t* width,
-                                      size_t* height, size_t* stride) {
+// Largest IDCT scale down (1, 2, 4 or 8) that keeps the image at least as large as it is shown when
+// fitted into max_width x max_height, only the side limiting the fit has to stay covered
+static int fit_scale(int width, int height, size_t max_width, size_t max_height) {
+    int scale = 1;
+    if (max_width == 0 || max_height == 0) {
+        return scale;
+    }
+    while (scale < 8 && ((size_t)width / (scale * 2) >= max_width || (size_t)height / (scale * 2) >= max_height)) {
+        scale *= 2;
+    }
+    return scale;
+}
+
+static esp_err_t decode_with_new_jpeg(const uint8_t* src, size_t src_len, size_t max_width, size_t max_height,
+                                      uint8_t** out, size_t* out_len, size_t* width, size_t* height, size_t* stride) {
     ESP_LOGD(TAG, "Decoding JPEG with software decoder");
     esp_err_t ret = ESP_OK;
     jpeg_error_t jpeg_ret = JPEG_ERR_OK;
@@ -53,7 +66,38 @@ static esp_err_t decode_with_new_jpeg(const uint8_t* src, size_t src_len, uint8_
 
     ESP_LOGD(TAG, "JPEG header info: width=%d, height=%d", out_info.width, out_info.height);
 
-    out_buf = jpeg_calloc_align(out_info.width * out_info.height * 2, 16);
+    int out_width = out_info.width;
+    int out_height = out_info.height;
+    int scale = fit_scale(out_info.width, out_info.height, max_width, max_height);
+    if (scale > 1) {
+        // The scale is applied in the IDCT, the full resolution image is never produced
+        config.scale.width = (out_info.width / scale) & ~7;
+        config.scale.height = (out_info.height / scale) & ~7;
+        jpeg_dec_close(jpeg_dec);
+        jpeg_dec = NULL;
+        if (jpeg_dec_open(&config, &jpeg_dec) == JPEG_ERR_OK &&
+            jpeg_dec_parse_header(jpeg_dec, &jpeg_io, &out_info) == JPEG_ERR_OK) {
+            out_width = config.scale.width;
+            out_height = config.scale.height;
+            ESP_LOGD(TAG, "Decoding at 1/%d scale: %dx%d", scale, out_width, out_height);
+        } else {
+            ESP_LOGW(TAG, "Scaled decode not supported, decoding at full size");
+            if (jpeg_dec) {
+                jpeg_dec_close(jpeg_dec);
+                jpeg_dec = NULL;
+            }
+            config.scale.width = 0;
+            config.scale.height = 0;
+            if (jpeg_dec_open(&config, &jpeg_dec) != JPEG_ERR_OK ||
+                jpeg_dec_parse_header(jpeg_dec, &jpeg_io, &out_info) != JPEG_ERR_OK) {
+                ESP_LOGE(TAG, "Failed to reopen JPEG decoder");
+                ret = ESP_FAIL;
+                goto jpeg_dec_failed;
+            }
+        }
+    }
+
+    out_buf = jpeg_calloc_align(out_width * out_height * 2, 16);
     if (out_buf == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for JPEG output buffer");
         ret = ESP_ERR_NO_MEM;
@@ -68,14 +112,14 @@ static esp_err_t decode_with_new_jpeg(const uint8_t* src, size_t src_len, uint8_
         goto jpeg_dec_failed;
     }
 
-    ESP_LOG_BUFFER_HEXDUMP(TAG, out_buf, MIN(out_info.width * out_info.height * 2, 256), ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(TAG, out_buf, MIN(out_width * out_height * 2, 256), ESP_LOG_DEBUG);
 
     *out = out_buf;
     out_buf = NULL;
-    *out_len = (size_t)(out_info.width * out_info.height * 2);
-    *width = (size_t)out_info.width;
-    *height = (size_t)out_info.height;
-    *stride = (size_t)out_info.width * 2;
+    *out_len = (size_t)(out_width * out_height * 2);
+    *width = (size_t)out_width;
+    *height = (size_t)out_height;
+    *stride = (size_t)out_width * 2;
     jpeg_dec_close(jpeg_dec);
     jpeg_dec = NULL;
 
@@ -242,14 +286,22 @@ jpeg_hw_dec_failed:
 }
 #endif  // CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_DECODER
 
+static bool is_valid_args(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len, size_t* width,
+                          size_t* height, size_t* stride) {
+    if (src == NULL || src_len == 0 || out == NULL || out_len == NULL || width == NULL || height == NULL ||
+        stride == NULL) {
+        ESP_LOGE(TAG, "Invalid parameters");
+        return false;
+    }
+    return true;
+}
+
 esp_err_t jpeg_to_image(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len, size_t* width,
                         size_t* height, size_t* stride) {
 #ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
 #endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
-    if (src == NULL || src_len == 0 || out == NULL || out_len == NULL || width == NULL || height == NULL ||
-        stride == NULL) {
-        ESP_LOGE(TAG, "Invalid parameters");
+    if (!is_valid_args(src, src_len, out, out_len, width, height, stride)) {
         return ESP_ERR_INVALID_ARG;
     }
 #ifdef CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_DECODER
@@ -260,5 +312,28 @@ esp_err_t jpeg_to_image(const uint8_t* src, size_t src_len, uint8_t** out, size_
     ESP_LOGW(TAG, "Failed to decode with hardware JPEG, fallback to software decoder");
     // Fallback to esp_new_jpeg
 #endif
-    return decode_with_new_jpeg(src, src_len, out, out_len, width, height, stride);
+    return decode_with_new_jpeg(src, src_len, 0, 0, out, out_len, width, height, stride);
+}
+
+esp_err_t jpeg_to_image_scaled(const uint8_t* src, size_t src_len, size_t max_width, size_t max_height, uint8_t** out,
+                               size_t* out_len, size_t* width, size_t* height, size_t* stride) {
+#ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
+    if (!is_valid_args(src, src_len, out, out_len, width, height, stride)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#ifdef CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_DECODER
+    // The hardware engine only decodes at full size, use it when there is nothing to scale away
+    jpeg_decode_picture_info_t header_info;
+    if (jpeg_decoder_get_info(src, src_len, &header_info) == ESP_OK &&
+        fit_scale(header_info.width, header_info.height, max_width, max_height) == 1) {
+        esp_err_t ret = decode_with_hardware_jpeg(src, src_len, out, out_len, width, height, stride);
+        if (ret == ESP_OK) {
+            return ret;
+        }
+        ESP_LOGW(TAG, "Failed to decode with hardware JPEG, fallback to software decoder");
+    }
+#endif
+    return decode_with_new_jpeg(src, src_len, max_width, max_height, out, out_len, width, height, stride);
 }
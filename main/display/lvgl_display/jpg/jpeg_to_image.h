@@ -55,6 +55,23 @@ extern "C" {
 esp_err_t jpeg_to_image(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len, size_t* width,
                         size_t* height, size_t* stride);
 
+/**
+ * @brief Decodes a JPEG image to RGB565 at a size suited for showing it within max_width x max_height
+ *
+ * The image is scaled down by 1/2, 1/4 or 1/8 during the IDCT, as far as it still covers the area it
+ * is shown in when fitted into max_width x max_height, e.g. a 1920x1080 camera frame shown on a
+ * 240x240 panel is decoded to 240x128 without a full resolution intermediate buffer. Images that
+ * need no scaling take the same path as jpeg_to_image(), including the hardware decoder.
+ *
+ * @param[in] max_width Width of the area the image is shown in, 0 to decode at full size
+ * @param[in] max_height Height of the area the image is shown in, 0 to decode at full size
+ *
+ * The other parameters, the return values and the ownership of `*out` are the same as for
+ * jpeg_to_image(). The width and height of a scaled image are multiples of 8.
+ */
+esp_err_t jpeg_to_image_scaled(const uint8_t* src, size_t src_len, size_t max_width, size_t max_height, uint8_t** out,
+                               size_t* out_len, size_t* width, size_t* height, size_t* stride);
+
 #ifdef __cplusplus
 }
 #endif
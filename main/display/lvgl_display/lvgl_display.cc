@@ -3,9 +3,11 @@
 #include <string>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include <font_awesome.h>
 
 #include "lvgl_display.h"
+#include "marquee_label.h"
 #include "board.h"
 #include "application.h"
 #include "audio_codec.h"
@@ -15,6 +17,15 @@
 
 #define TAG "Display"
 
+// Beyond this the LVGL task is not keeping up, commands run on the caller instead
+#define MAX_RENDER_COMMANDS 32
+
+#ifndef CONFIG_DISPLAY_IDLE_REFRESH_PERIOD_MS
+#define CONFIG_DISPLAY_IDLE_REFRESH_PERIOD_MS 100
+#endif
+// Posted commands are still drained while the refresh is paused
+#define PAUSED_COMMAND_PERIOD_MS 1000
+
 LvglDisplay::LvglDisplay() {
     // Notification timer
     esp_timer_create_args_t notification_timer_args = {
@@ -31,20 +42,18 @@ LvglDisplay::LvglDisplay() {
     };
     ESP_ERROR_CHECK(esp_timer_create(&notification_timer_args, &notification_timer_));
 
-    // Create a power management lock
-    auto ret = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "display_update", &pm_lock_);
-    if (ret == ESP_ERR_NOT_SUPPORTED) {
-        ESP_LOGI(TAG, "Power management not supported");
-    } else {
-        ESP_ERROR_CHECK(ret);
-    }
 }
 
 LvglDisplay::~LvglDisplay() {
+    // Waits for a running decode, its image is dropped
+    preview_loader_.reset();
     if (notification_timer_ != nullptr) {
         esp_timer_stop(notification_timer_);
         esp_timer_delete(notification_timer_);
     }
+    if (render_timer_ != nullptr) {
+        lv_timer_delete(render_timer_);
+    }
 
     if (network_label_ != nullptr) {
         lv_obj_del(network_label_);
@@ -64,9 +73,6 @@ LvglDisplay::~LvglDisplay() {
     if( low_battery_popup_ != nullptr ) {
         lv_obj_del(low_battery_popup_);
     }
-    if (pm_lock_ != nullptr) {
-        esp_pm_lock_delete(pm_lock_);
-    }
 }
 
 void LvglDisplay::SetStatus(const char* status) {
@@ -80,7 +86,7 @@ void LvglDisplay::SetStatus(const char* status) {
         }
         return;
     }
-    lv_label_set_text(status_label_, status);
+    MarqueeLabel::SetText(status_label_, status);
     lv_obj_remove_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
     lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
 
@@ -149,7 +155,7 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
         }
     }
 
-    esp_pm_lock_acquire(pm_lock_);
+    pm_lock_.Acquire();
     // Update battery icon
     int battery_level;
     bool charging, discharging;
@@ -178,7 +184,7 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
             if (strcmp(icon, FONT_AWESOME_BATTERY_EMPTY) == 0 && discharging) {
                 if (lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // Show if low battery popup is hidden
                     lv_obj_remove_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
-                    app.PlaySound(Lang::Sounds::OGG_LOW_BATTERY);
+                    app.PlaySound(Lang::Sounds::OGG_LOW_BATTERY, true);
                 }
             } else {
                 // Hide the low battery popup when the battery is not empty
@@ -211,12 +217,151 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
         }
     }
 
-    esp_pm_lock_release(pm_lock_);
+    pm_lock_.Release();
 }
 
 void LvglDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
 }
 
+void LvglDisplay::LoadPreviewImage(uint8_t* data, size_t size) {
+    std::call_once(preview_loader_once_, [this]() {
+        preview_loader_ = std::make_unique<PreviewImageLoader>([this](std::unique_ptr<LvglImage> image) {
+            // Keyed, so a preview still queued for the LVGL task is replaced rather than shown first
+            Post([this, image = std::move(image)]() mutable {
+                SetPreviewImage(std::move(image));
+            }, kDisplayCommandKeyPreviewImage);
+        });
+    });
+    int width, height;
+    GetPreviewImageSize(width, height);
+    preview_loader_->Load(data, size, width, height);
+}
+
+void LvglDisplay::Post(DisplayCommand&& command, DisplayCommandKey key) {
+    {
+        std::lock_guard<std::mutex> lock(render_mutex_);
+        if (render_timer_ != nullptr) {
+            if (key != kDisplayCommandKeyNone) {
+                for (auto& pending : render_queue_) {
+                    if (pending.key == key) {
+                        pending.command = std::move(command);
+                        return;
+                    }
+                }
+            }
+            if (render_queue_.size() < MAX_RENDER_COMMANDS) {
+                render_queue_.push_back({std::move(command), key});
+                return;
+            }
+        }
+    }
+
+    DisplayLockGuard lock(this);
+    {
+        std::lock_guard<std::mutex> queue_lock(render_mutex_);
+        if (render_timer_ == nullptr) {
+            /* Drain once per refresh period, the LVGL task wakes up for the refresh anyway */
+            render_timer_ = lv_timer_create([](lv_timer_t* timer) {
+                static_cast<LvglDisplay*>(lv_timer_get_user_data(timer))->RunRenderCommands();
+            }, LV_DEF_REFR_PERIOD, this);
+            ApplyFrameRate();
+        } else if (render_queue_.size() >= MAX_RENDER_COMMANDS) {
+            ESP_LOGW(TAG, "Render queue full, running command on the caller");
+        }
+    }
+    command();
+}
+
+void LvglDisplay::RunRenderCommands() {
+    std::vector<RenderCommand> commands;
+    {
+        std::lock_guard<std::mutex> lock(render_mutex_);
+        if (render_queue_.empty()) {
+            return;
+        }
+        commands.swap(render_queue_);
+    }
+    /* Timer callbacks run inside lv_timer_handler(), the display lock is already held */
+    for (auto& pending : commands) {
+        pending.command();
+    }
+
+    // Hand the buffer back so posting does not allocate again
+    commands.clear();
+    std::lock_guard<std::mutex> lock(render_mutex_);
+    if (render_queue_.empty()) {
+        render_queue_.swap(commands);
+    }
+}
+
+#if CONFIG_DISPLAY_FRAME_TRACE
+void LvglDisplay::StartFrameTrace() {
+    auto callback = [](lv_event_t* e) {
+        auto self = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+        self->OnFrameEvent(lv_event_get_code(e));
+    };
+    for (auto code : {LV_EVENT_REFR_START, LV_EVENT_RENDER_START, LV_EVENT_FLUSH_WAIT_START, LV_EVENT_FLUSH_WAIT_FINISH, LV_EVENT_REFR_READY}) {
+        lv_display_add_event_cb(display_, callback, code, this);
+    }
+}
+
+void LvglDisplay::OnFrameEvent(lv_event_code_t code) {
+    int64_t now = esp_timer_get_time();
+    switch (code) {
+        case LV_EVENT_REFR_START:
+            frame_start_us_ = now;
+            frame_flush_wait_us_ = 0;
+            frame_rendered_ = false;
+            break;
+        case LV_EVENT_RENDER_START:
+            frame_rendered_ = true;
+            break;
+        case LV_EVENT_FLUSH_WAIT_START:
+            flush_wait_start_us_ = now;
+            break;
+        case LV_EVENT_FLUSH_WAIT_FINISH:
+            /* One wait per stripe, LVGL blocks here until the panel took the previous buffer */
+            frame_flush_wait_us_ += now - flush_wait_start_us_;
+            break;
+        case LV_EVENT_REFR_READY: {
+            // Refreshes without invalidated areas render nothing and are not counted
+            if (!frame_rendered_) {
+                break;
+            }
+            frame_rendered_ = false;
+            int64_t render_us = now - frame_start_us_ - frame_flush_wait_us_;
+            frame_stats_.frames++;
+            frame_stats_.render_us += render_us;
+            frame_stats_.render_max_us = std::max(frame_stats_.render_max_us, render_us);
+            frame_stats_.flush_wait_us += frame_flush_wait_us_;
+            frame_stats_.flush_wait_max_us = std::max(frame_stats_.flush_wait_max_us, frame_flush_wait_us_);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+LvglDisplay::FrameStats LvglDisplay::GetFrameStats(bool clear) {
+    DisplayLockGuard lock(this);
+    FrameStats stats = frame_stats_;
+    if (clear) {
+        frame_stats_ = FrameStats();
+    }
+    return stats;
+}
+
+std::string LvglDisplay::GetFrameStatsJson(bool clear) {
+    FrameStats stats = GetFrameStats(clear);
+    uint32_t frames = std::max<uint32_t>(stats.frames, 1);
+    char json[192];
+    snprintf(json, sizeof(json), "{\"frames\":%lu,\"render_avg_us\":%lld,\"render_max_us\":%lld,"
+        "\"flush_wait_avg_us\":%lld,\"flush_wait_max_us\":%lld}", (unsigned long)stats.frames,
+        stats.render_us / frames, stats.render_max_us, stats.flush_wait_us / frames, stats.flush_wait_max_us);
+    return json;
+}
+#endif
+
 void LvglDisplay::SetPowerSaveMode(bool on) {
     if (on) {
         SetChatMessage("system", "");
@@ -225,31 +370,147 @@ void LvglDisplay::SetPowerSaveMode(bool on) {
         SetChatMessage("system", "");
         SetEmotion("neutral");
     }
+    Post([this, on]() {
+        power_save_ = on;
+        ApplyFrameRate();
+    }, kDisplayCommandKeyFrameRate);
 }
 
-bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality) {
-#if CONFIG_LV_USE_SNAPSHOT
+void LvglDisplay::SetFrameRate(DisplayFrameRate rate) {
+    Post([this, rate]() {
+        frame_rate_ = rate;
+        ApplyFrameRate();
+    }, kDisplayCommandKeyFrameRate);
+}
+
+void LvglDisplay::SetAnimating(bool animating) {
+    // Also applied when one animation replaces another, so a new GIF is paused in power save
+    animating_ = animating;
+    ApplyFrameRate();
+}
+
+void LvglDisplay::ApplyFrameRate() {
+    if (display_ == nullptr) {
+        return;
+    }
+    lv_timer_t* refr_timer = lv_display_get_refr_timer(display_);
+    if (refr_timer == nullptr) {
+        return;
+    }
+
+    bool full = !power_save_ && (frame_rate_ == kDisplayFrameRateFull || animating_);
+    if (full != pm_lock_held_) {
+        if (full) {
+            pm_lock_.Acquire();
+        } else {
+            pm_lock_.Release();
+        }
+        pm_lock_held_ = full;
+    }
+
+    if (power_save_) {
+        // Draw the sleep screen before the refresh stops
+        PauseAnimations(true);
+        lv_refr_now(display_);
+        if (!refresh_paused_) {
+            lv_timer_pause(refr_timer);
+            if (render_timer_ != nullptr) {
+                lv_timer_set_period(render_timer_, PAUSED_COMMAND_PERIOD_MS);
+            }
+            refresh_paused_ = true;
+            ESP_LOGI(TAG, "Display refresh paused");
+        }
+        return;
+    }
+
+    uint32_t period = full ? LV_DEF_REFR_PERIOD : CONFIG_DISPLAY_IDLE_REFRESH_PERIOD_MS;
+    lv_timer_set_period(refr_timer, period);
+    lv_timer_resume(refr_timer);
+    if (render_timer_ != nullptr) {
+        lv_timer_set_period(render_timer_, period);
+    }
+    if (refresh_paused_) {
+        refresh_paused_ = false;
+        PauseAnimations(false);
+    }
+    ESP_LOGD(TAG, "Display refresh period %lu ms", (unsigned long)period);
+}
+
+#if CONFIG_DISPLAY_MIRROR
+static void MirrorFlushCallback(lv_event_t* e) {
+    auto mirror = static_cast<FramebufferMirror*>(lv_event_get_user_data(e));
+    mirror->OnFlush(static_cast<const lv_area_t*>(lv_event_get_param(e)));
+}
+
+bool LvglDisplay::StartMirror(FramebufferMirror::FrameSink sink) {
     DisplayLockGuard lock(this);
+    if (display_ == nullptr) {
+        return false;
+    }
+    if (mirror_ != nullptr) {
+        mirror_->RequestKeyframe();
+        return true;
+    }
+    auto mirror = std::make_unique<FramebufferMirror>(display_, std::move(sink),
+        CONFIG_DISPLAY_MIRROR_MAX_FPS, CONFIG_DISPLAY_MIRROR_JPEG_QUALITY);
+    if (!mirror->IsValid()) {
+        return false;
+    }
+    mirror_ = std::move(mirror);
+    lv_display_add_event_cb(display_, MirrorFlushCallback, LV_EVENT_FLUSH_START, mirror_.get());
+    // Also redraws what a paused refresh would not
+    lv_obj_invalidate(lv_screen_active());
+    ESP_LOGI(TAG, "Display mirror started");
+    return true;
+}
 
-    lv_obj_t* screen = lv_screen_active();
-    lv_draw_buf_t* draw_buffer = lv_snapshot_take(screen, LV_COLOR_FORMAT_RGB565);
+void LvglDisplay::StopMirror() {
+    std::unique_ptr<FramebufferMirror> mirror;
+    {
+        DisplayLockGuard lock(this);
+        if (mirror_ == nullptr) {
+            return;
+        }
+        lv_display_remove_event_cb_with_user_data(display_, MirrorFlushCallback, mirror_.get());
+        mirror = std::move(mirror_);
+    }
+    // Waits for the mirror task, outside the lock so LVGL is not held up
+    mirror.reset();
+    ESP_LOGI(TAG, "Display mirror stopped");
+}
+#endif
+
+bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality, int scale, const lv_area_t* area) {
+#if CONFIG_LV_USE_SNAPSHOT
+    lv_draw_buf_t* draw_buffer;
+    {
+        DisplayLockGuard lock(this);
+        lv_obj_t* screen = lv_screen_active();
+        draw_buffer = lv_snapshot_take(screen, LV_COLOR_FORMAT_RGB565);
+    }
     if (draw_buffer == nullptr) {
         ESP_LOGE(TAG, "Failed to take snapshot, draw_buffer is nullptr");
         return false;
     }
 
-    // swap bytes
-    uint16_t* data = (uint16_t*)draw_buffer->data;
-    size_t pixel_count = draw_buffer->data_size / 2;
-    for (size_t i = 0; i < pixel_count; i++) {
-        data[i] = __builtin_bswap16(data[i]);
+    lv_area_t region = {0, 0, (int32_t)draw_buffer->header.w - 1, (int32_t)draw_buffer->header.h - 1};
+    if (area != nullptr && !lv_area_intersect(&region, &region, area)) {
+        ESP_LOGE(TAG, "Snapshot area is outside the screen");
+        DisplayLockGuard lock(this);
+        lv_draw_buf_destroy(draw_buffer);
+        return false;
     }
 
     // Clear output string and use callback version to avoid pre-allocating large memory blocks
     jpeg_data.clear();
 
-    // Use callback-based JPEG encoder to further save memory
-    bool ret = image_to_jpeg_cb((uint8_t*)draw_buffer->data, draw_buffer->data_size, draw_buffer->header.w, draw_buffer->header.h, V4L2_PIX_FMT_RGB565, quality,
+    /*
+     * Encoded stripe by stripe straight from the snapshot, without the display lock, so LVGL keeps
+     * rendering meanwhile. The bytes of each pixel are swapped on the fly.
+     */
+    size_t stride = draw_buffer->header.stride;
+    uint8_t* origin = (uint8_t*)draw_buffer->data + region.y1 * stride + region.x1 * 2;
+    bool ret = rgb565_region_to_jpeg_cb(origin, stride, lv_area_get_width(&region), lv_area_get_height(&region), scale, true, quality,
         [](void *arg, size_t index, const void *data, size_t len) -> size_t {
         std::string* output = static_cast<std::string*>(arg);
         if (data && len > 0) {
@@ -261,6 +522,7 @@ bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality) {
         ESP_LOGE(TAG, "Failed to convert image to JPEG");
     }
 
+    DisplayLockGuard lock(this);
     lv_draw_buf_destroy(draw_buffer);
     return ret;
 #else
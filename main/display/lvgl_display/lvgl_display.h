@@ -3,6 +3,11 @@
 
 #include "display.h"
 #include "lvgl_image.h"
+#include "preview_image_loader.h"
+#include "power_governor.h"
+#if CONFIG_DISPLAY_MIRROR
+#include "framebuffer_mirror.h"
+#endif
 
 #include <lvgl.h>
 #include <esp_timer.h>
@@ -11,6 +16,9 @@
 
 #include <string>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 class LvglDisplay : public Display {
 public:
@@ -21,12 +29,49 @@ public:
     virtual void ShowNotification(const char* notification, int duration_ms = 3000);
     virtual void ShowNotification(const std::string &notification, int duration_ms = 3000);
     virtual void SetPreviewImage(std::unique_ptr<LvglImage> image);
+    /*
+     * Shows compressed JPEG or PNG data (heap_caps_malloc, owned by the display) once it is decoded
+     * on a low priority task and reduced to the preview size. A newer image cancels a pending one.
+     */
+    void LoadPreviewImage(uint8_t* data, size_t size);
+    // Largest preview worth drawing, bigger images are reduced to it
+    virtual void GetPreviewImageSize(int& width, int& height) { width = width_; height = height_; }
+    /*
+     * Optional live viewfinder: draws an RGB565 frame straight to the panel, centered in the preview
+     * area and reduced to fit, without an LVGL image or blit. StopViewfinder() gives the area back.
+     */
+    virtual bool HasViewfinder() const { return false; }
+    virtual bool DrawViewfinderFrame(const uint8_t* pixels, int width, int height, bool big_endian) { return false; }
+    virtual void StopViewfinder() {}
     virtual void UpdateStatusBar(bool update_all = false);
+    // Power save pauses the refresh after drawing the sleep screen once
     virtual void SetPowerSaveMode(bool on);
-    virtual bool SnapshotToJpeg(std::string& jpeg_data, int quality = 80);
+    virtual void SetFrameRate(DisplayFrameRate rate) override;
+    // Optionally only the area (screen coordinates, inclusive) and reduced by scale 1, 2 or 4
+    virtual bool SnapshotToJpeg(std::string& jpeg_data, int quality = 80, int scale = 1, const lv_area_t* area = nullptr);
+#if CONFIG_DISPLAY_MIRROR
+    // Streams the changed tiles of the screen to sink, or sends them all again when already mirroring
+    bool StartMirror(FramebufferMirror::FrameSink sink);
+    void StopMirror();
+#endif
+    // Queues the command for the LVGL task, so the caller never waits for a frame to flush
+    virtual void Post(DisplayCommand&& command, DisplayCommandKey key = kDisplayCommandKeyNone) override;
+#if CONFIG_DISPLAY_FRAME_TRACE
+    // Updated by display events on the LVGL task, read under the display lock
+    struct FrameStats {
+        uint32_t frames = 0;
+        int64_t render_us = 0;
+        int64_t render_max_us = 0;
+        int64_t flush_wait_us = 0;
+        int64_t flush_wait_max_us = 0;
+    };
+    // Render and flush wait time of the frames since the last call, optionally resetting them
+    FrameStats GetFrameStats(bool clear = false);
+    std::string GetFrameStatsJson(bool clear = false);
+#endif
 
 protected:
-    esp_pm_lock_handle_t pm_lock_ = nullptr;
+    PmLock pm_lock_{ESP_PM_APB_FREQ_MAX, "display_update"};
     lv_display_t *display_ = nullptr;
 
     lv_obj_t *network_label_ = nullptr;
@@ -44,6 +89,52 @@ protected:
     std::chrono::system_clock::time_point last_status_update_time_;
     esp_timer_handle_t notification_timer_ = nullptr;
 
+    // Commands posted from other tasks, drained by render_timer_ on the LVGL task
+    std::mutex render_mutex_;
+    struct RenderCommand {
+        DisplayCommand command;
+        DisplayCommandKey key;
+    };
+    std::vector<RenderCommand> render_queue_;
+    lv_timer_t* render_timer_ = nullptr;
+
+    void RunRenderCommands();
+
+    // Created by the first LoadPreviewImage(), most displays never show a preview
+    std::once_flag preview_loader_once_;
+    std::unique_ptr<PreviewImageLoader> preview_loader_;
+
+    // Frame governor state, applied on the LVGL task by ApplyFrameRate()
+    DisplayFrameRate frame_rate_ = kDisplayFrameRateFull;
+    bool power_save_ = false;
+    bool animating_ = false;
+    bool refresh_paused_ = false;
+    // pm_lock_ is held while refreshing at the full rate, so esp_pm may only light sleep otherwise
+    bool pm_lock_held_ = false;
+
+    // Subclasses report running animations, e.g. a GIF emoji, which keep the full rate while idle
+    void SetAnimating(bool animating);
+    void ApplyFrameRate();
+    // Called on the LVGL task when the refresh is paused or resumed for power save
+    virtual void PauseAnimations(bool paused) {}
+
+#if CONFIG_DISPLAY_FRAME_TRACE
+    FrameStats frame_stats_;
+    int64_t frame_start_us_ = 0;
+    int64_t flush_wait_start_us_ = 0;
+    int64_t frame_flush_wait_us_ = 0;
+    bool frame_rendered_ = false;
+
+    // Call once display_ is created
+    void StartFrameTrace();
+    void OnFrameEvent(lv_event_code_t code);
+#endif
+
+#if CONFIG_DISPLAY_MIRROR
+    // Fed by LV_EVENT_FLUSH_START under the display lock
+    std::unique_ptr<FramebufferMirror> mirror_;
+#endif
+
     friend class DisplayLockGuard;
     virtual bool Lock(int timeout_ms = 0) = 0;
     virtual void Unlock() = 0;
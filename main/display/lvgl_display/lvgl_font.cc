@@ -1,13 +1,200 @@
 #include "lvgl_font.h"
+#include "memory_budget.h"
 #include <cbin_font.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "LvglFont"
+
+#ifndef CONFIG_LVGL_GLYPH_CACHE_KB
+#define CONFIG_LVGL_GLYPH_CACHE_KB 0
+#endif
 
 
 LvglCBinFont::LvglCBinFont(void* data) {
     font_ = cbin_font_create(static_cast<uint8_t*>(data));
+    if (font_ == nullptr || CONFIG_LVGL_GLYPH_CACHE_KB == 0) {
+        return;
+    }
+
+    /* A copy of the font with the bitmap callbacks going through the cache first */
+    cache_budget_ = CONFIG_LVGL_GLYPH_CACHE_KB * 1024;
+    cached_font_.font = *font_;
+    cached_font_.owner = this;
+    get_glyph_bitmap_ = font_->get_glyph_bitmap;
+    release_glyph_ = font_->release_glyph;
+    cached_font_.font.get_glyph_bitmap = GetGlyphBitmap;
+    cached_font_.font.release_glyph = ReleaseGlyph;
+
+    budget_id_ = MemoryBudget::GetInstance().Register("glyph_cache", MALLOC_CAP_SPIRAM, cache_budget_,
+        kMemoryPriorityHigh, [this]() {
+            std::lock_guard<std::mutex> lock(cache_mutex_);
+            return cache_size_;
+        }, [this](size_t bytes) { return Trim(bytes); });
 }
 
 LvglCBinFont::~LvglCBinFont() {
+    if (budget_id_ != 0) {
+        MemoryBudget::GetInstance().Unregister(budget_id_);
+    }
+    for (auto& glyph : glyphs_) {
+        heap_caps_free(glyph.draw_buf.data);
+    }
     if (font_ != nullptr) {
         cbin_font_delete(font_);
     }
-}
\ No newline at end of file
+}
+
+void LvglCBinFont::SetFallback(const lv_font_t* fallback) {
+    if (font_ == nullptr) {
+        return;
+    }
+    font_->fallback = fallback;
+    cached_font_.font.fallback = fallback;
+}
+
+const lv_font_t* LvglCBinFont::font() const {
+    if (font_ == nullptr || cache_budget_ == 0) {
+        return font_;
+    }
+    return &cached_font_.font;
+}
+
+const void* LvglCBinFont::GetGlyphBitmap(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf) {
+    auto self = reinterpret_cast<const CachedFont*>(g_dsc->resolved_font)->owner;
+    uint32_t index = g_dsc->gid.index;
+    auto cached = self->Lookup(index);
+    if (cached != nullptr) {
+        return cached;
+    }
+
+    auto bitmap = self->get_glyph_bitmap_(g_dsc, draw_buf);
+    // Only glyphs expanded into the draw buffer can be copied, other formats are drawn as they are
+    bool is_bitmap = g_dsc->format == LV_FONT_GLYPH_FORMAT_A1 || g_dsc->format == LV_FONT_GLYPH_FORMAT_A2 ||
+                     g_dsc->format == LV_FONT_GLYPH_FORMAT_A4 || g_dsc->format == LV_FONT_GLYPH_FORMAT_A8;
+    if (bitmap == nullptr || bitmap != draw_buf || !is_bitmap) {
+        return bitmap;
+    }
+    cached = self->Insert(index, draw_buf);
+    return cached != nullptr ? cached : bitmap;
+}
+
+void LvglCBinFont::ReleaseGlyph(const lv_font_t* font, lv_font_glyph_dsc_t* g_dsc) {
+    auto self = reinterpret_cast<const CachedFont*>(font)->owner;
+    self->Release(g_dsc->gid.index);
+    if (self->release_glyph_ != nullptr) {
+        self->release_glyph_(font, g_dsc);
+    }
+}
+
+const lv_draw_buf_t* LvglCBinFont::Lookup(uint32_t index) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = glyph_index_.find(index);
+    if (it == glyph_index_.end()) {
+        return nullptr;
+    }
+    glyphs_.splice(glyphs_.begin(), glyphs_, it->second);
+    it->second->refs++;
+    return &it->second->draw_buf;
+}
+
+const lv_draw_buf_t* LvglCBinFont::Insert(uint32_t index, const lv_draw_buf_t* bitmap) {
+    uint32_t size = bitmap->header.stride * bitmap->header.h;
+    if (size == 0 || size > cache_budget_ / 4) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (glyph_index_.count(index) > 0) {
+        return nullptr;
+    }
+    Evict(size, cache_budget_);
+    if (cache_size_ + size > cache_budget_) {
+        return nullptr;
+    }
+    void* data = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (data == nullptr) {
+        return nullptr;
+    }
+    memcpy(data, bitmap->data, size);
+
+    Glyph glyph = {};
+    glyph.index = index;
+    glyph.size = size;
+    // Held by the caller until LVGL releases the glyph
+    glyph.refs = 1;
+    lv_draw_buf_init(&glyph.draw_buf, bitmap->header.w, bitmap->header.h, (lv_color_format_t)bitmap->header.cf,
+        bitmap->header.stride, data, size);
+    glyphs_.push_front(glyph);
+    glyph_index_[index] = glyphs_.begin();
+    cache_size_ += size;
+    return &glyphs_.front().draw_buf;
+}
+
+void LvglCBinFont::Release(uint32_t index) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = glyph_index_.find(index);
+    if (it != glyph_index_.end() && it->second->refs > 0) {
+        it->second->refs--;
+    }
+}
+
+size_t LvglCBinFont::Evict(size_t needed, size_t budget) {
+    // Glyphs still being drawn are skipped
+    size_t freed = 0;
+    auto it = glyphs_.end();
+    while (cache_size_ + needed > budget && it != glyphs_.begin()) {
+        --it;
+        if (it->refs > 0) {
+            continue;
+        }
+        cache_size_ -= it->size;
+        freed += it->size;
+        heap_caps_free(it->draw_buf.data);
+        glyph_index_.erase(it->index);
+        it = glyphs_.erase(it);
+    }
+    return freed;
+}
+
+size_t LvglCBinFont::Trim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    return Evict(0, cache_size_ > bytes ? cache_size_ - bytes : 0);
+}
+
+void LvglCBinFont::Warmup(std::string_view characters) {
+    if (font_ == nullptr || cache_budget_ == 0) {
+        return;
+    }
+
+    const lv_font_t* font = &cached_font_.font;
+    int count = 0;
+    size_t pos = 0;
+    while (pos < characters.size()) {
+        // Decode one UTF-8 character
+        uint8_t c = characters[pos];
+        int length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+        uint32_t letter = length == 1 ? c : c & (0x3F >> (length - 1));
+        for (int i = 1; i < length && pos + i < characters.size(); i++) {
+            letter = (letter << 6) | (characters[pos + i] & 0x3F);
+        }
+        pos += length;
+
+        lv_font_glyph_dsc_t g_dsc = {};
+        if (letter <= ' ' || !lv_font_get_glyph_dsc(font, &g_dsc, letter, 0) || g_dsc.resolved_font != font ||
+                g_dsc.box_w == 0 || g_dsc.box_h == 0) {
+            continue;
+        }
+        lv_draw_buf_t* draw_buf = lv_draw_buf_create(g_dsc.box_w, g_dsc.box_h, LV_COLOR_FORMAT_A8, LV_STRIDE_AUTO);
+        if (draw_buf == nullptr) {
+            break;
+        }
+        if (GetGlyphBitmap(&g_dsc, draw_buf) != nullptr) {
+            Release(g_dsc.gid.index);
+            count++;
+        }
+        lv_draw_buf_destroy(draw_buf);
+    }
+    ESP_LOGI(TAG, "Pre-rasterized %d glyphs, cache %u/%u bytes", count, (unsigned)cache_size_, (unsigned)cache_budget_);
+}
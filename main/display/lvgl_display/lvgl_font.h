@@ -2,6 +2,11 @@
 
 #include <lvgl.h>
 
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
 
 class LvglFont {
 public:
@@ -20,12 +25,54 @@ private:
 };
 
 
+/*
+ * Font from the assets partition. Glyphs are expanded from the mmapped font on every draw,
+ * so the bitmaps are kept in an LRU cache in PSRAM of CONFIG_LVGL_GLYPH_CACHE_KB.
+ */
 class LvglCBinFont : public LvglFont {
 public:
     LvglCBinFont(void* data);
     virtual ~LvglCBinFont();
-    virtual const lv_font_t* font() const override { return font_; }
+    virtual const lv_font_t* font() const override;
+
+    // Glyphs missing from this font, e.g. one subset at build time, are drawn with fallback
+    void SetFallback(const lv_font_t* fallback);
+    // Rasterizes the UTF-8 characters into the cache ahead of time, call with the display lock held
+    void Warmup(std::string_view characters);
+    // Drops least recently drawn glyphs that are not being drawn, returns the bytes freed
+    size_t Trim(size_t bytes);
 
 private:
+    // LVGL passes this font to the callbacks, the owner is found right after it
+    struct CachedFont {
+        lv_font_t font;
+        LvglCBinFont* owner;
+    };
+
+    struct Glyph {
+        uint32_t index;
+        lv_draw_buf_t draw_buf;
+        uint32_t size;
+        int refs;
+    };
+
     lv_font_t* font_;
+    CachedFont cached_font_;
+    const void* (*get_glyph_bitmap_)(lv_font_glyph_dsc_t*, lv_draw_buf_t*) = nullptr;
+    void (*release_glyph_)(const lv_font_t*, lv_font_glyph_dsc_t*) = nullptr;
+
+    std::mutex cache_mutex_;
+    // Most recently used first
+    std::list<Glyph> glyphs_;
+    std::unordered_map<uint32_t, std::list<Glyph>::iterator> glyph_index_;
+    size_t cache_size_ = 0;
+    size_t cache_budget_ = 0;
+    int budget_id_ = 0;
+
+    static const void* GetGlyphBitmap(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf);
+    static void ReleaseGlyph(const lv_font_t* font, lv_font_glyph_dsc_t* g_dsc);
+    const lv_draw_buf_t* Lookup(uint32_t index);
+    const lv_draw_buf_t* Insert(uint32_t index, const lv_draw_buf_t* bitmap);
+    void Release(uint32_t index);
+    size_t Evict(size_t needed, size_t budget);
 };
@@ -1,16 +1,32 @@
 #include "lvgl_image.h"
+#include "memory_budget.h"
 #include <cbin_font.h>
 
 #include <esp_log.h>
 #include <stdexcept>
 #include <cstring>
 #include <esp_heap_caps.h>
+#include <esp_lvgl_port.h>
+#include <esp_psram.h>
+#include <src/core/lv_global.h>
+#include <src/misc/cache/lv_cache.h>
 
 #define TAG "LvglImage"
 
 
 LvglRawImage::LvglRawImage(void* data, size_t size) {
     bzero(&image_dsc_, sizeof(image_dsc_));
+    lv_image_header_t header;
+    if (size > sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
+        if (header.magic == LV_IMAGE_HEADER_MAGIC) {
+            // An LVGL binary, the bin decoder expands a compressed one into the image cache
+            image_dsc_.header = header;
+            image_dsc_.data = static_cast<uint8_t*>(data) + sizeof(header);
+            image_dsc_.data_size = size - sizeof(header);
+            return;
+        }
+    }
     image_dsc_.data_size = size;
     image_dsc_.data = static_cast<uint8_t*>(data);
     image_dsc_.header.magic = LV_IMAGE_HEADER_MAGIC;
@@ -20,6 +36,9 @@ LvglRawImage::LvglRawImage(void* data, size_t size) {
 }
 
 bool LvglRawImage::IsGif() const {
+    if (image_dsc_.header.cf != LV_COLOR_FORMAT_RAW_ALPHA) {
+        return false;
+    }
     auto ptr = (const uint8_t*)image_dsc_.data;
     return ptr[0] == 'G' && ptr[1] == 'I' && ptr[2] == 'F';
 }
@@ -61,4 +80,42 @@ LvglAllocatedImage::~LvglAllocatedImage() {
         heap_caps_free((void*)image_dsc_.data);
         image_dsc_.data = nullptr;
     }
-}
\ No newline at end of file
+}
+
+size_t LvglImageCache::budget_ = 0;
+
+void LvglImageCache::Setup() {
+#if CONFIG_SPIRAM
+    size_t psram_size_mb = esp_psram_get_size() / 1024 / 1024;
+    if (psram_size_mb >= 8) {
+        budget_ = 2 * 1024 * 1024;
+    } else if (psram_size_mb >= 2) {
+        budget_ = 512 * 1024;
+    }
+#endif
+    if (budget_ == 0) {
+        return;
+    }
+    lv_image_cache_resize(budget_, true);
+    ESP_LOGI(TAG, "Use %uKB of PSRAM for image cache", (unsigned)(budget_ / 1024));
+    MemoryBudget::GetInstance().Register("image_cache", MALLOC_CAP_SPIRAM, budget_, kMemoryPriorityNormal,
+        Usage, Trim);
+}
+
+size_t LvglImageCache::Usage() {
+    return lv_cache_get_size(LV_GLOBAL_DEFAULT()->img_cache, nullptr);
+}
+
+size_t LvglImageCache::Trim(size_t bytes) {
+    // The cache belongs to the LVGL task, give up rather than wait for a frame to finish
+    if (!lvgl_port_lock(10)) {
+        return 0;
+    }
+    size_t before = Usage();
+    // Shrinking it evicts the least recently used images that are not being drawn
+    lv_image_cache_resize(before > bytes ? before - bytes : 0, true);
+    lv_image_cache_resize(budget_, false);
+    size_t after = Usage();
+    lvgl_port_unlock();
+    return before > after ? before - after : 0;
+}
@@ -12,6 +12,7 @@ public:
 };
 
 
+// An image file from the assets: PNG, GIF or an LVGL binary, which may be RLE or LZ4 compressed
 class LvglRawImage : public LvglImage {
 public:
     LvglRawImage(void* data, size_t size);
@@ -50,4 +51,21 @@ public:
 
 private:
     lv_img_dsc_t image_dsc_;
-};
\ No newline at end of file
+};
+
+/*
+ * LVGL's cache of decoded images in PSRAM. PNG emojis and compressed LVGL binaries are decoded
+ * into it on their first draw and drawn from there afterwards, so redraws no longer read the
+ * mmapped assets. It is registered with the memory budget, which trims it when PSRAM runs low.
+ */
+class LvglImageCache {
+public:
+    // After lv_init(), sized by the PSRAM of the board
+    static void Setup();
+
+private:
+    static size_t budget_;
+
+    static size_t Usage();
+    static size_t Trim(size_t bytes);
+};
@@ -0,0 +1,182 @@
+#include "marquee_label.h"
+
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "MarqueeLabel"
+
+#ifndef CONFIG_DISPLAY_MARQUEE_STRIP_MAX_KB
+#define CONFIG_DISPLAY_MARQUEE_STRIP_MAX_KB 16
+#endif
+// The speed and start delay of the circular labels it replaces
+#define MARQUEE_SPEED_PX_PER_S 60
+#define MARQUEE_START_DELAY_MS 1000
+
+struct MarqueeLabel::State {
+    lv_draw_buf_t* strip = nullptr;
+    // The text and the gap after it, the strip repeats at this distance
+    int32_t period = 0;
+    int32_t offset = 0;
+    // Set while Refresh() changes styles of the label, whose change events come back to it
+    bool refreshing = false;
+};
+
+void MarqueeLabel::Attach(lv_obj_t* label) {
+    auto state = new State();
+    lv_obj_add_event_cb(label, OnDraw, LV_EVENT_DRAW_MAIN_END, state);
+    lv_obj_add_event_cb(label, OnChanged, LV_EVENT_SIZE_CHANGED, state);
+    lv_obj_add_event_cb(label, OnChanged, LV_EVENT_STYLE_CHANGED, state);
+    lv_obj_add_event_cb(label, OnDelete, LV_EVENT_DELETE, state);
+    Refresh(label, state);
+}
+
+MarqueeLabel::State* MarqueeLabel::GetState(lv_obj_t* label) {
+    // Only Attach() registers OnDelete, a user data of anyone else is not mistaken for a state
+    uint32_t count = lv_obj_get_event_count(label);
+    for (uint32_t i = 0; i < count; i++) {
+        auto dsc = lv_obj_get_event_dsc(label, i);
+        if (lv_event_dsc_get_cb(dsc) == OnDelete) {
+            return static_cast<State*>(lv_event_dsc_get_user_data(dsc));
+        }
+    }
+    return nullptr;
+}
+
+void MarqueeLabel::SetText(lv_obj_t* label, const char* text) {
+    auto state = GetState(label);
+    if (state == nullptr) {
+        lv_label_set_text(label, text);
+        return;
+    }
+    // The status is set again and again with the same text, the strip stays
+    if (strcmp(lv_label_get_text(label), text) == 0) {
+        return;
+    }
+    lv_label_set_text(label, text);
+    Refresh(label, state);
+}
+
+void MarqueeLabel::Refresh(lv_obj_t* label, State* state) {
+    state->refreshing = true;
+    lv_anim_delete(label, nullptr);
+    if (state->strip != nullptr) {
+        lv_draw_buf_destroy(state->strip);
+        state->strip = nullptr;
+    }
+    state->offset = 0;
+
+    const lv_font_t* font = lv_obj_get_style_text_font(label, LV_PART_MAIN);
+    int32_t letter_space = lv_obj_get_style_text_letter_space(label, LV_PART_MAIN);
+    lv_point_t size;
+    lv_text_get_size(&size, lv_label_get_text(label), font, letter_space, 0, LV_COORD_MAX, LV_TEXT_FLAG_NONE);
+    // 0 before the first layout, the size change comes back here
+    int32_t width = lv_obj_get_content_width(label);
+    bool overflows = width > 0 && size.x > width;
+
+    if (overflows && RenderStrip(label, state, size)) {
+        lv_label_set_long_mode(label, LV_LABEL_LONG_CLIP);
+        // The label draws nothing any more, OnDraw() blits the strip in its place
+        lv_obj_set_style_text_opa(label, LV_OPA_TRANSP, LV_PART_MAIN);
+        lv_anim_t a;
+        lv_anim_init(&a);
+        lv_anim_set_var(&a, label);
+        lv_anim_set_user_data(&a, state);
+        lv_anim_set_custom_exec_cb(&a, [](lv_anim_t* a, int32_t value) {
+            auto state = static_cast<State*>(lv_anim_get_user_data(a));
+            state->offset = value;
+            lv_obj_invalidate(static_cast<lv_obj_t*>(a->var));
+        });
+        lv_anim_set_values(&a, 0, state->period);
+        lv_anim_set_duration(&a, state->period * 1000 / MARQUEE_SPEED_PX_PER_S);
+        lv_anim_set_delay(&a, MARQUEE_START_DELAY_MS);
+        lv_anim_set_repeat_count(&a, LV_ANIM_REPEAT_INFINITE);
+        lv_anim_start(&a);
+    } else {
+        lv_obj_remove_local_style_prop(label, LV_STYLE_TEXT_OPA, LV_PART_MAIN);
+        lv_label_set_long_mode(label, overflows ? LV_LABEL_LONG_SCROLL_CIRCULAR : LV_LABEL_LONG_CLIP);
+    }
+    state->refreshing = false;
+}
+
+bool MarqueeLabel::RenderStrip(lv_obj_t* label, State* state, const lv_point_t& size) {
+    const lv_font_t* font = lv_obj_get_style_text_font(label, LV_PART_MAIN);
+    int32_t period = size.x + lv_font_get_glyph_width(font, ' ', ' ') * LV_LABEL_WAIT_CHAR_COUNT;
+    uint32_t stride = lv_draw_buf_width_to_stride(period, LV_COLOR_FORMAT_A8);
+    if ((size_t)stride * size.y > CONFIG_DISPLAY_MARQUEE_STRIP_MAX_KB * 1024) {
+        return false;
+    }
+    state->strip = lv_draw_buf_create(period, size.y, LV_COLOR_FORMAT_A8, LV_STRIDE_AUTO);
+    if (state->strip == nullptr) {
+        ESP_LOGW(TAG, "No memory for a %dx%d strip", (int)period, (int)size.y);
+        return false;
+    }
+    state->period = period;
+
+    // Coverage only, the color is applied when it is drawn
+    lv_obj_t* canvas = lv_canvas_create(lv_layer_top());
+    lv_obj_add_flag(canvas, LV_OBJ_FLAG_HIDDEN);
+    lv_draw_buf_clear(state->strip, nullptr);
+    lv_canvas_set_draw_buf(canvas, state->strip);
+    lv_layer_t layer;
+    lv_canvas_init_layer(canvas, &layer);
+    lv_draw_label_dsc_t dsc;
+    lv_draw_label_dsc_init(&dsc);
+    dsc.text = lv_label_get_text(label);
+    dsc.font = font;
+    dsc.letter_space = lv_obj_get_style_text_letter_space(label, LV_PART_MAIN);
+    dsc.color = lv_color_white();
+    lv_area_t area = {0, 0, size.x - 1, size.y - 1};
+    lv_draw_label(&layer, &dsc, &area);
+    lv_canvas_finish_layer(canvas, &layer);
+    lv_obj_delete(canvas);
+    return true;
+}
+
+void MarqueeLabel::OnDraw(lv_event_t* e) {
+    auto state = static_cast<State*>(lv_event_get_user_data(e));
+    if (state->strip == nullptr) {
+        return;
+    }
+    auto label = lv_event_get_target_obj(e);
+    lv_layer_t* layer = lv_event_get_layer(e);
+    lv_area_t content;
+    lv_obj_get_content_coords(label, &content);
+    lv_area_t clip;
+    if (!lv_area_intersect(&clip, &content, &layer->_clip_area)) {
+        return;
+    }
+
+    lv_draw_image_dsc_t dsc;
+    lv_draw_image_dsc_init(&dsc);
+    dsc.src = state->strip;
+    dsc.recolor = lv_obj_get_style_text_color_filtered(label, LV_PART_MAIN);
+    dsc.recolor_opa = LV_OPA_COVER;
+    // The two copies around the seam, the rest is clipped
+    lv_area_t saved_clip = layer->_clip_area;
+    layer->_clip_area = clip;
+    lv_area_t area;
+    area.y1 = content.y1;
+    area.y2 = content.y1 + state->strip->header.h - 1;
+    for (int32_t x = content.x1 - state->offset; x <= content.x2; x += state->period) {
+        area.x1 = x;
+        area.x2 = x + state->period - 1;
+        lv_draw_image(layer, &dsc, &area);
+    }
+    layer->_clip_area = saved_clip;
+}
+
+void MarqueeLabel::OnChanged(lv_event_t* e) {
+    auto state = static_cast<State*>(lv_event_get_user_data(e));
+    if (!state->refreshing) {
+        Refresh(lv_event_get_target_obj(e), state);
+    }
+}
+
+void MarqueeLabel::OnDelete(lv_event_t* e) {
+    auto state = static_cast<State*>(lv_event_get_user_data(e));
+    lv_anim_delete(lv_event_get_target_obj(e), nullptr);
+    if (state->strip != nullptr) {
+        lv_draw_buf_destroy(state->strip);
+    }
+    delete state;
+}
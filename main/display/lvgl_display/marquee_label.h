@@ -0,0 +1,32 @@
+#ifndef MARQUEE_LABEL_H
+#define MARQUEE_LABEL_H
+
+#include <lvgl.h>
+
+/*
+ * Single line labels that scroll text too wide for them, like LV_LABEL_LONG_SCROLL_CIRCULAR,
+ * from an A8 strip the text is rendered into once. A scroll step only blits the strip, where the
+ * circular label lays out and rasterizes every visible glyph again. The label keeps its text,
+ * size and styles, the strip takes its text color when drawn and is rendered again when the
+ * text, font or width changes. Text whose strip would exceed CONFIG_DISPLAY_MARQUEE_STRIP_MAX_KB
+ * falls back to the circular label. All methods must be called with the display lock held.
+ */
+class MarqueeLabel {
+public:
+    // The state is freed with the label
+    static void Attach(lv_obj_t* label);
+    // lv_label_set_text() of a marquee or any other label
+    static void SetText(lv_obj_t* label, const char* text);
+
+private:
+    struct State;
+
+    static State* GetState(lv_obj_t* label);
+    static void Refresh(lv_obj_t* label, State* state);
+    static bool RenderStrip(lv_obj_t* label, State* state, const lv_point_t& size);
+    static void OnDraw(lv_event_t* e);
+    static void OnChanged(lv_event_t* e);
+    static void OnDelete(lv_event_t* e);
+};
+
+#endif // MARQUEE_LABEL_H
@@ -0,0 +1,360 @@
+#include "ppa_draw_unit.h"
+
+#include <lvgl.h>
+#include <src/draw/lv_draw_private.h>
+#include <src/draw/lv_draw_image_private.h>
+#include <src/draw/sw/lv_draw_sw.h>
+
+#include <driver/ppa.h>
+#include <esp_cache.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_memory_utils.h>
+
+#include <atomic>
+
+#define TAG "PpaDrawUnit"
+
+#define DRAW_UNIT_ID_PPA 90
+// Beats the software renderer's 100, loses to anything else that claims the task
+#define PPA_PREFERENCE_SCORE 70
+// Below this many pixels the software renderer is done before the PPA is set up
+#define PPA_MIN_PIXELS (48 * 48)
+
+struct PpaUnit {
+    lv_draw_unit_t base_unit;
+    lv_draw_task_t* task_act;
+    ppa_client_handle_t fill_client;
+    ppa_client_handle_t srm_client;
+    ppa_client_handle_t blend_client;
+};
+
+static std::atomic<uint32_t> completed_{0};
+static std::atomic<uint32_t> fallbacks_{0};
+
+// Where an image task lands: the bounding box of the scaled and rotated image, on the screen
+static bool ImageDestination(const lv_draw_task_t* t, const lv_draw_image_dsc_t* dsc, lv_area_t& box) {
+    int32_t w = lv_area_get_width(&t->area);
+    int32_t h = lv_area_get_height(&t->area);
+    // LVGL scales about the pivot first, then rotates clockwise about it
+    int32_t left = -dsc->pivot.x * dsc->scale_x / LV_SCALE_NONE;
+    int32_t top = -dsc->pivot.y * dsc->scale_y / LV_SCALE_NONE;
+    int32_t right = left + w * dsc->scale_x / LV_SCALE_NONE;
+    int32_t bottom = top + h * dsc->scale_y / LV_SCALE_NONE;
+    int32_t x1, y1, x2, y2;
+    switch (dsc->rotation) {
+        case 0:
+            x1 = left; y1 = top; x2 = right; y2 = bottom;
+            break;
+        case 900:
+            x1 = -bottom; y1 = left; x2 = -top; y2 = right;
+            break;
+        case 1800:
+            x1 = -right; y1 = -bottom; x2 = -left; y2 = -top;
+            break;
+        case 2700:
+            x1 = top; y1 = -right; x2 = bottom; y2 = -left;
+            break;
+        default:
+            return false;
+    }
+    int32_t pivot_x = t->area.x1 + dsc->pivot.x;
+    int32_t pivot_y = t->area.y1 + dsc->pivot.y;
+    box.x1 = pivot_x + x1;
+    box.y1 = pivot_y + y1;
+    box.x2 = pivot_x + x2 - 1;
+    box.y2 = pivot_y + y2 - 1;
+    return true;
+}
+
+static bool IsTransformed(const lv_draw_image_dsc_t* dsc) {
+    return dsc->rotation != 0 || dsc->scale_x != LV_SCALE_NONE || dsc->scale_y != LV_SCALE_NONE;
+}
+
+static bool CanDrawImage(const lv_draw_task_t* t) {
+    auto dsc = static_cast<const lv_draw_image_dsc_t*>(t->draw_dsc);
+    if (lv_image_src_get_type(dsc->src) != LV_IMAGE_SRC_VARIABLE || dsc->tile || dsc->skew_x != 0 ||
+        dsc->skew_y != 0 || dsc->recolor_opa > LV_OPA_MIN || dsc->bitmap_mask_src != nullptr ||
+        dsc->blend_mode != LV_BLEND_MODE_NORMAL || dsc->clip_radius > 0) {
+        return false;
+    }
+    auto image = static_cast<const lv_image_dsc_t*>(dsc->src);
+    // The DMA reads RAM only, images mapped from flash stay with software
+    if (image->data == nullptr || !(esp_ptr_internal(image->data) || esp_ptr_external_ram(image->data)) ||
+        image->header.w != lv_area_get_width(&t->area) || image->header.h != lv_area_get_height(&t->area)) {
+        return false;
+    }
+    switch (image->header.cf) {
+        case LV_COLOR_FORMAT_RGB565:
+            // The scaler overwrites the destination, a translucent image is blended by software
+            if (dsc->opa < LV_OPA_MAX) {
+                return false;
+            }
+            break;
+        case LV_COLOR_FORMAT_ARGB8888:
+            if (IsTransformed(dsc)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    if (!IsTransformed(dsc)) {
+        return true;
+    }
+    // The scaler steps in 1/16, only scales it hits exactly match the software result
+    if (dsc->scale_x % 16 != 0 || dsc->scale_y % 16 != 0 || dsc->scale_x <= 0 || dsc->scale_y <= 0) {
+        return false;
+    }
+    // A transformed image is not cropped, it must land inside the clip area
+    lv_area_t box;
+    return ImageDestination(t, dsc, box) && lv_area_is_in(&box, &t->clip_area, 0);
+}
+
+static int32_t Evaluate(lv_draw_unit_t* draw_unit, lv_draw_task_t* t) {
+    if (t->target_layer == nullptr || t->target_layer->color_format != LV_COLOR_FORMAT_RGB565) {
+        return 0;
+    }
+    lv_area_t area;
+    if (!lv_area_intersect(&area, &t->area, &t->clip_area) || lv_area_get_size(&area) < PPA_MIN_PIXELS) {
+        return 0;
+    }
+    bool claim = false;
+    switch (t->type) {
+        case LV_DRAW_TASK_TYPE_FILL: {
+            auto dsc = static_cast<const lv_draw_fill_dsc_t*>(t->draw_dsc);
+            claim = dsc->radius == 0 && dsc->opa >= LV_OPA_MAX && dsc->grad.dir == LV_GRAD_DIR_NONE;
+            break;
+        }
+        case LV_DRAW_TASK_TYPE_IMAGE:
+            claim = CanDrawImage(t);
+            break;
+        default:
+            break;
+    }
+    if (claim && t->preference_score > PPA_PREFERENCE_SCORE) {
+        t->preference_score = PPA_PREFERENCE_SCORE;
+        t->preferred_draw_unit_id = DRAW_UNIT_ID_PPA;
+    }
+    return 0;
+}
+
+/*
+ * The PPA writes the destination through DMA and the driver invalidates the cache lines of the
+ * whole output buffer, so it must start and end on cache lines and what the CPU drew into it
+ * must be written back first. Only the rows down to the last one drawn are handed over.
+ */
+static bool PrepareOutput(lv_draw_buf_t* buf, int32_t rows, size_t& size) {
+    size_t alignment = 0;
+    uint32_t caps = esp_ptr_external_ram(buf->data) ? MALLOC_CAP_SPIRAM : MALLOC_CAP_DMA;
+    if (esp_cache_get_alignment(caps, &alignment) != ESP_OK || alignment == 0) {
+        alignment = 4;
+    }
+    size = ((size_t)buf->header.stride * rows + alignment - 1) & ~(alignment - 1);
+    if (((uintptr_t)buf->data & (alignment - 1)) != 0 || size > buf->data_size) {
+        return false;
+    }
+    return esp_cache_msync(buf->data, size, ESP_CACHE_MSYNC_FLAG_DIR_C2M) == ESP_OK;
+}
+
+static bool Fill(PpaUnit* unit, lv_draw_task_t* t) {
+    auto dsc = static_cast<const lv_draw_fill_dsc_t*>(t->draw_dsc);
+    lv_layer_t* layer = t->target_layer;
+    lv_draw_buf_t* buf = layer->draw_buf;
+    lv_area_t area;
+    if (!lv_area_intersect(&area, &t->area, &t->clip_area)) {
+        return true;
+    }
+    lv_area_move(&area, -layer->buf_area.x1, -layer->buf_area.y1);
+    size_t size;
+    if (!PrepareOutput(buf, area.y2 + 1, size)) {
+        return false;
+    }
+    ppa_fill_oper_config_t config = {};
+    config.out.buffer = buf->data;
+    config.out.buffer_size = size;
+    config.out.pic_w = buf->header.stride / 2;
+    config.out.pic_h = area.y2 + 1;
+    config.out.block_offset_x = area.x1;
+    config.out.block_offset_y = area.y1;
+    config.out.fill_cm = PPA_FILL_COLOR_MODE_RGB565;
+    config.fill_block_w = lv_area_get_width(&area);
+    config.fill_block_h = lv_area_get_height(&area);
+    config.fill_argb_color.val = 0xFF000000 | (dsc->color.red << 16) | (dsc->color.green << 8) | dsc->color.blue;
+    config.mode = PPA_TRANS_MODE_BLOCKING;
+    return ppa_do_fill(unit->fill_client, &config) == ESP_OK;
+}
+
+static bool Image(PpaUnit* unit, lv_draw_task_t* t) {
+    auto dsc = static_cast<const lv_draw_image_dsc_t*>(t->draw_dsc);
+    auto image = static_cast<const lv_image_dsc_t*>(dsc->src);
+    lv_layer_t* layer = t->target_layer;
+    lv_draw_buf_t* buf = layer->draw_buf;
+    uint32_t src_stride = image->header.stride != 0 ? image->header.stride :
+        lv_draw_buf_width_to_stride(image->header.w, (lv_color_format_t)image->header.cf);
+    int bytes_per_pixel = image->header.cf == LV_COLOR_FORMAT_ARGB8888 ? 4 : 2;
+
+    // An untransformed image is cropped to the clip area, a transformed one lies inside it
+    lv_area_t box;
+    ImageDestination(t, dsc, box);
+    lv_area_t src_area = {0, 0, image->header.w - 1, image->header.h - 1};
+    if (!IsTransformed(dsc)) {
+        lv_area_t clipped;
+        if (!lv_area_intersect(&clipped, &box, &t->clip_area)) {
+            return true;
+        }
+        src_area.x1 = clipped.x1 - box.x1;
+        src_area.y1 = clipped.y1 - box.y1;
+        src_area.x2 = src_area.x1 + lv_area_get_width(&clipped) - 1;
+        src_area.y2 = src_area.y1 + lv_area_get_height(&clipped) - 1;
+        box = clipped;
+    }
+    lv_area_move(&box, -layer->buf_area.x1, -layer->buf_area.y1);
+    size_t size;
+    if (!PrepareOutput(buf, box.y2 + 1, size)) {
+        return false;
+    }
+    // The driver reads the source through DMA as well
+    esp_cache_msync(const_cast<uint8_t*>(image->data), src_stride * image->header.h,
+                    ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED);
+
+    if (image->header.cf == LV_COLOR_FORMAT_RGB565) {
+        ppa_srm_oper_config_t config = {};
+        config.in.buffer = image->data;
+        config.in.pic_w = src_stride / bytes_per_pixel;
+        config.in.pic_h = image->header.h;
+        config.in.block_w = lv_area_get_width(&src_area);
+        config.in.block_h = lv_area_get_height(&src_area);
+        config.in.block_offset_x = src_area.x1;
+        config.in.block_offset_y = src_area.y1;
+        config.in.srm_cm = PPA_SRM_COLOR_MODE_RGB565;
+        config.out.buffer = buf->data;
+        config.out.buffer_size = size;
+        config.out.pic_w = buf->header.stride / 2;
+        config.out.pic_h = box.y2 + 1;
+        config.out.block_offset_x = box.x1;
+        config.out.block_offset_y = box.y1;
+        config.out.srm_cm = PPA_SRM_COLOR_MODE_RGB565;
+        // The PPA turns counterclockwise, LVGL clockwise
+        switch (dsc->rotation) {
+            case 900:
+                config.rotation_angle = PPA_SRM_ROTATION_ANGLE_270;
+                break;
+            case 1800:
+                config.rotation_angle = PPA_SRM_ROTATION_ANGLE_180;
+                break;
+            case 2700:
+                config.rotation_angle = PPA_SRM_ROTATION_ANGLE_90;
+                break;
+            default:
+                config.rotation_angle = PPA_SRM_ROTATION_ANGLE_0;
+                break;
+        }
+        config.scale_x = (float)dsc->scale_x / LV_SCALE_NONE;
+        config.scale_y = (float)dsc->scale_y / LV_SCALE_NONE;
+        config.mode = PPA_TRANS_MODE_BLOCKING;
+        return ppa_do_scale_rotate_mirror(unit->srm_client, &config) == ESP_OK;
+    }
+
+    ppa_blend_oper_config_t config = {};
+    config.in_bg.buffer = buf->data;
+    config.in_bg.pic_w = buf->header.stride / 2;
+    config.in_bg.pic_h = box.y2 + 1;
+    config.in_bg.block_w = lv_area_get_width(&box);
+    config.in_bg.block_h = lv_area_get_height(&box);
+    config.in_bg.block_offset_x = box.x1;
+    config.in_bg.block_offset_y = box.y1;
+    config.in_bg.blend_cm = PPA_BLEND_COLOR_MODE_RGB565;
+    config.in_fg.buffer = image->data;
+    config.in_fg.pic_w = src_stride / bytes_per_pixel;
+    config.in_fg.pic_h = image->header.h;
+    config.in_fg.block_w = lv_area_get_width(&src_area);
+    config.in_fg.block_h = lv_area_get_height(&src_area);
+    config.in_fg.block_offset_x = src_area.x1;
+    config.in_fg.block_offset_y = src_area.y1;
+    config.in_fg.blend_cm = PPA_BLEND_COLOR_MODE_ARGB8888;
+    config.out.buffer = buf->data;
+    config.out.buffer_size = size;
+    config.out.pic_w = buf->header.stride / 2;
+    config.out.pic_h = box.y2 + 1;
+    config.out.block_offset_x = box.x1;
+    config.out.block_offset_y = box.y1;
+    config.out.blend_cm = PPA_BLEND_COLOR_MODE_RGB565;
+    if (dsc->opa < LV_OPA_MAX) {
+        config.fg_alpha_update_mode = PPA_ALPHA_SCALE;
+        config.fg_alpha_scale_ratio = (float)dsc->opa / LV_OPA_COVER;
+    } else {
+        config.fg_alpha_update_mode = PPA_ALPHA_NO_CHANGE;
+    }
+    config.mode = PPA_TRANS_MODE_BLOCKING;
+    return ppa_do_blend(unit->blend_client, &config) == ESP_OK;
+}
+
+static int32_t Dispatch(lv_draw_unit_t* draw_unit, lv_layer_t* layer) {
+    auto unit = reinterpret_cast<PpaUnit*>(draw_unit);
+    if (unit->task_act != nullptr) {
+        return 0;
+    }
+    lv_draw_task_t* t = lv_draw_get_available_task(layer, nullptr, DRAW_UNIT_ID_PPA);
+    if (t == nullptr || t->preferred_draw_unit_id != DRAW_UNIT_ID_PPA) {
+        return LV_DRAW_UNIT_IDLE;
+    }
+    if (lv_draw_layer_alloc_buf(layer) == nullptr) {
+        return LV_DRAW_UNIT_IDLE;
+    }
+    t->state = LV_DRAW_TASK_STATE_IN_PROGRESS;
+    t->draw_unit = draw_unit;
+    unit->task_act = t;
+
+    bool done = t->type == LV_DRAW_TASK_TYPE_FILL ? Fill(unit, t) : Image(unit, t);
+    if (done) {
+        completed_++;
+    } else {
+        // A buffer the DMA cannot use, software draws it as if it never left
+        fallbacks_++;
+        if (t->type == LV_DRAW_TASK_TYPE_FILL) {
+            lv_draw_sw_fill(t, static_cast<lv_draw_fill_dsc_t*>(t->draw_dsc), &t->area);
+        } else {
+            lv_draw_sw_image(t, static_cast<lv_draw_image_dsc_t*>(t->draw_dsc), &t->area);
+        }
+    }
+
+    t->state = LV_DRAW_TASK_STATE_FINISHED;
+    unit->task_act = nullptr;
+    lv_draw_dispatch_request();
+    return 1;
+}
+
+bool PpaDrawUnit::Install() {
+    ppa_client_handle_t clients[3] = {};
+    const ppa_operation_t operations[3] = {PPA_OPERATION_FILL, PPA_OPERATION_SRM, PPA_OPERATION_BLEND};
+    for (int i = 0; i < 3; i++) {
+        ppa_client_config_t config = {};
+        config.oper_type = operations[i];
+        config.max_pending_trans_num = 1;
+        if (ppa_register_client(&config, &clients[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register PPA client %d", i);
+            for (int j = 0; j < i; j++) {
+                ppa_unregister_client(clients[j]);
+            }
+            return false;
+        }
+    }
+    auto unit = static_cast<PpaUnit*>(lv_draw_create_unit(sizeof(PpaUnit)));
+    unit->fill_client = clients[0];
+    unit->srm_client = clients[1];
+    unit->blend_client = clients[2];
+    unit->base_unit.evaluate_cb = Evaluate;
+    unit->base_unit.dispatch_cb = Dispatch;
+    unit->base_unit.name = "PPA";
+    ESP_LOGI(TAG, "PPA draw unit installed");
+    return true;
+}
+
+uint32_t PpaDrawUnit::completed() {
+    return completed_;
+}
+
+uint32_t PpaDrawUnit::fallbacks() {
+    return fallbacks_;
+}
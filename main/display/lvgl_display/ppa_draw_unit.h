@@ -0,0 +1,25 @@
+#ifndef PPA_DRAW_UNIT_H
+#define PPA_DRAW_UNIT_H
+
+#include <cstdint>
+
+/*
+ * An LVGL draw unit that hands large draw tasks to the PPA of the ESP32-P4: opaque rectangle
+ * fills, RGB565 image blits with 90 degree rotations and scaling, and ARGB8888 images alpha
+ * blended onto RGB565. Everything else, and anything small enough that the CPU is faster than
+ * setting up the DMA, stays with the software renderer.
+ *
+ * The PPA runs in blocking mode on the LVGL task, it takes tasks the software renderer would
+ * otherwise spend the most cycles on.
+ */
+class PpaDrawUnit {
+public:
+    // After lv_init(), once
+    static bool Install();
+
+    // Draw tasks done by the PPA and the ones it claimed but handed back to software
+    static uint32_t completed();
+    static uint32_t fallbacks();
+};
+
+#endif // PPA_DRAW_UNIT_H
@@ -0,0 +1,195 @@
+#include "preview_image_loader.h"
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <cstring>
+
+#if !CONFIG_IDF_TARGET_ESP32
+#include "jpg/jpeg_to_image.h"
+#endif
+#if LV_USE_LODEPNG
+extern "C" {
+#include <src/libs/lodepng/lodepng.h>
+}
+#endif
+
+#define TAG "PreviewImageLoader"
+
+PreviewImageLoader::PreviewImageLoader(Callback callback) : callback_(std::move(callback)) {
+    TaskManifest::Create("preview_loader", [](void* arg) {
+        static_cast<PreviewImageLoader*>(arg)->LoaderTask();
+    }, this, &task_);
+}
+
+PreviewImageLoader::~PreviewImageLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        generation_++;
+    }
+    if (task_ != nullptr) {
+        xTaskNotifyGive(task_);
+        // The task clears task_ when it leaves the loop
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (task_ == nullptr) {
+                    break;
+                }
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    heap_caps_free(pending_.data);
+}
+
+void PreviewImageLoader::Load(uint8_t* data, size_t size, int max_width, int max_height) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.data != nullptr) {
+            ESP_LOGD(TAG, "Replacing a pending preview image");
+            heap_caps_free(pending_.data);
+        }
+        pending_ = {data, size, max_width, max_height};
+        generation_++;
+    }
+    xTaskNotifyGive(task_);
+}
+
+void PreviewImageLoader::Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    heap_caps_free(pending_.data);
+    pending_ = {};
+    generation_++;
+}
+
+void PreviewImageLoader::LoaderTask() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        Request request;
+        uint32_t generation;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                break;
+            }
+            request = pending_;
+            pending_ = {};
+            generation = generation_;
+        }
+        if (request.data == nullptr) {
+            continue;
+        }
+
+        auto image = Decode(request);
+        heap_caps_free(request.data);
+        if (image == nullptr) {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (generation != generation_) {
+                ESP_LOGD(TAG, "Dropping a preview image replaced while decoding");
+                continue;
+            }
+        }
+        callback_(std::move(image));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = nullptr;
+    }
+    TaskManifest::Exit();
+}
+
+#if LV_USE_LODEPNG
+// Nearest pixel reduction of an RGBA8888 image by an integer factor into LVGL's ARGB8888 (BGRA in memory)
+static std::unique_ptr<LvglImage> ReducePng(const uint8_t* rgba, unsigned width, unsigned height, uint32_t stride,
+                                            int max_width, int max_height) {
+    unsigned factor = 1;
+    while ((max_width > 0 && width / factor > (unsigned)max_width) ||
+           (max_height > 0 && height / factor > (unsigned)max_height)) {
+        factor++;
+    }
+    unsigned out_width = width / factor;
+    unsigned out_height = height / factor;
+    size_t out_stride = out_width * 4;
+    size_t out_size = out_stride * out_height;
+    auto out = static_cast<uint8_t*>(heap_caps_malloc(out_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (out == nullptr) {
+        out = static_cast<uint8_t*>(heap_caps_malloc(out_size, MALLOC_CAP_8BIT));
+    }
+    if (out == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for the preview image", (unsigned)out_size);
+        return nullptr;
+    }
+    for (unsigned y = 0; y < out_height; y++) {
+        const uint8_t* src = rgba + (size_t)y * factor * stride;
+        uint8_t* dst = out + y * out_stride;
+        for (unsigned x = 0; x < out_width; x++, src += factor * 4, dst += 4) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = src[3];
+        }
+    }
+    return std::make_unique<LvglAllocatedImage>(out, out_size, out_width, out_height, out_stride,
+                                                LV_COLOR_FORMAT_ARGB8888);
+}
+#endif
+
+std::unique_ptr<LvglImage> PreviewImageLoader::Decode(const Request& request) {
+    int64_t start_time = esp_timer_get_time();
+    std::unique_ptr<LvglImage> image;
+
+    if (request.size >= 3 && request.data[0] == 0xFF && request.data[1] == 0xD8 && request.data[2] == 0xFF) {
+#if !CONFIG_IDF_TARGET_ESP32
+        uint8_t* out = nullptr;
+        size_t out_len = 0, width = 0, height = 0, stride = 0;
+        esp_err_t ret = jpeg_to_image_scaled(request.data, request.size, request.max_width, request.max_height,
+                                             &out, &out_len, &width, &height, &stride);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to decode JPEG: %s", esp_err_to_name(ret));
+            heap_caps_free(out);
+            return nullptr;
+        }
+        image = std::make_unique<LvglAllocatedImage>(out, out_len, width, height, stride, LV_COLOR_FORMAT_RGB565);
+#else
+        ESP_LOGE(TAG, "JPEG previews are not supported on this chip");
+        return nullptr;
+#endif
+    } else if (request.size >= 8 && memcmp(request.data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+#if LV_USE_LODEPNG
+        unsigned char* decoded = nullptr;
+        unsigned width = 0, height = 0;
+        unsigned error = lodepng_decode32(&decoded, &width, &height, request.data, request.size);
+        if (error != 0 || decoded == nullptr) {
+            ESP_LOGE(TAG, "Failed to decode PNG: %s", lodepng_error_text(error));
+            return nullptr;
+        }
+        // LVGL's lodepng returns the pixels in a draw buffer
+        auto draw_buf = reinterpret_cast<lv_draw_buf_t*>(decoded);
+        image = ReducePng(draw_buf->data, width, height, draw_buf->header.stride, request.max_width,
+                          request.max_height);
+        lv_draw_buf_destroy(draw_buf);
+#else
+        ESP_LOGE(TAG, "PNG previews are not supported, enable LV_USE_LODEPNG");
+        return nullptr;
+#endif
+    } else {
+        ESP_LOGE(TAG, "Unknown preview image format");
+        return nullptr;
+    }
+
+    if (image != nullptr) {
+        auto header = image->image_dsc()->header;
+        ESP_LOGI(TAG, "Decoded a %dx%d preview in %lld ms", (int)header.w, (int)header.h,
+                 (esp_timer_get_time() - start_time) / 1000);
+    }
+    return image;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "lvgl_image.h"
+#include "small_function.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/**
+ * Decodes compressed preview images (JPEG or PNG) on a low priority task, so neither the
+ * caller nor the LVGL task spends the decode time. Only the latest image matters: a request
+ * still waiting is replaced by a newer one, and a decode that finishes after a newer request
+ * was made is dropped.
+ */
+class PreviewImageLoader {
+public:
+    // Called on the loader task with the decoded image
+    using Callback = SmallFunction<void(std::unique_ptr<LvglImage>), 16>;
+
+    explicit PreviewImageLoader(Callback callback);
+    ~PreviewImageLoader();
+
+    /**
+     * Takes ownership of data (heap_caps_malloc), the image is reduced to fit in
+     * max_width x max_height
+     */
+    void Load(uint8_t* data, size_t size, int max_width, int max_height);
+
+    // Drops the pending request and the result of a running decode
+    void Cancel();
+
+private:
+    struct Request {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        int max_width = 0;
+        int max_height = 0;
+    };
+
+    Callback callback_;
+    std::mutex mutex_;
+    Request pending_;
+    // Bumped by every Load() and Cancel(), a decode is kept only if it did not change
+    uint32_t generation_ = 0;
+    TaskHandle_t task_ = nullptr;
+    bool stopping_ = false;
+
+    void LoaderTask();
+    std::unique_ptr<LvglImage> Decode(const Request& request);
+};
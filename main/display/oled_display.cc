@@ -2,13 +2,17 @@
 #include "assets/lang_config.h"
 #include "lvgl_theme.h"
 #include "lvgl_font.h"
+#include "marquee_label.h"
 
 #include <string>
+#include <cstring>
 #include <algorithm>
+#include <vector>
 
 #include <esp_log.h>
 #include <esp_err.h>
 #include <esp_lvgl_port.h>
+#include <esp_lcd_panel_interface.h>
 #include <font_awesome.h>
 
 #define TAG "OledDisplay"
@@ -17,6 +21,123 @@ LV_FONT_DECLARE(BUILTIN_TEXT_FONT);
 LV_FONT_DECLARE(BUILTIN_ICON_FONT);
 LV_FONT_DECLARE(font_awesome_30_1);
 
+// Unchanged bytes between two changed runs of a page that are still sent with them, cheaper than a new transfer
+#define OLED_DIFF_MERGE_GAP 6
+
+/*
+ * Panel wrapper keeping a copy of the panel's GRAM in the page layout of SSD1306/SH1106, one byte
+ * per 8 vertical pixels. A flush only sends the column runs of each page that differ from the copy,
+ * so small updates such as the clock or an icon hold the shared I2C bus for a few bytes.
+ */
+struct OledShadowPanel {
+    esp_lcd_panel_t base;
+    esp_lcd_panel_handle_t panel;
+    lv_display_t* display = nullptr;
+    int width;
+    int height;
+    std::vector<uint8_t> shadow;
+    // Whether the shadow matches the panel, set by the first full screen flush
+    bool primed = false;
+
+    OledShadowPanel(esp_lcd_panel_handle_t panel, int width, int height)
+        : panel(panel), width(width), height(height), shadow(width * (height / 8)) {
+        base = {};
+        base.reset = [](esp_lcd_panel_t* p) {
+            auto self = __containerof(p, OledShadowPanel, base);
+            self->primed = false;
+            return esp_lcd_panel_reset(self->panel);
+        };
+        base.init = [](esp_lcd_panel_t* p) {
+            auto self = __containerof(p, OledShadowPanel, base);
+            self->primed = false;
+            return esp_lcd_panel_init(self->panel);
+        };
+        base.draw_bitmap = [](esp_lcd_panel_t* p, int x_start, int y_start, int x_end, int y_end, const void* data) {
+            return __containerof(p, OledShadowPanel, base)->DrawBitmap(x_start, y_start, x_end, y_end,
+                static_cast<const uint8_t*>(data));
+        };
+        base.mirror = [](esp_lcd_panel_t* p, bool x_axis, bool y_axis) {
+            auto self = __containerof(p, OledShadowPanel, base);
+            self->primed = false;
+            return esp_lcd_panel_mirror(self->panel, x_axis, y_axis);
+        };
+        base.swap_xy = [](esp_lcd_panel_t* p, bool swap_axes) {
+            auto self = __containerof(p, OledShadowPanel, base);
+            self->primed = false;
+            return esp_lcd_panel_swap_xy(self->panel, swap_axes);
+        };
+        base.set_gap = [](esp_lcd_panel_t* p, int x_gap, int y_gap) {
+            auto self = __containerof(p, OledShadowPanel, base);
+            self->primed = false;
+            return esp_lcd_panel_set_gap(self->panel, x_gap, y_gap);
+        };
+        base.invert_color = [](esp_lcd_panel_t* p, bool invert) {
+            return esp_lcd_panel_invert_color(__containerof(p, OledShadowPanel, base)->panel, invert);
+        };
+        base.disp_on_off = [](esp_lcd_panel_t* p, bool on_off) {
+            return esp_lcd_panel_disp_on_off(__containerof(p, OledShadowPanel, base)->panel, on_off);
+        };
+        base.disp_sleep = [](esp_lcd_panel_t* p, bool sleep) {
+            return esp_lcd_panel_disp_sleep(__containerof(p, OledShadowPanel, base)->panel, sleep);
+        };
+    }
+
+    esp_err_t DrawBitmap(int x_start, int y_start, int x_end, int y_end, const uint8_t* data) {
+        // The LVGL port rounds monochrome areas to whole pages, anything else goes through unchanged
+        if (y_start % 8 != 0 || y_end % 8 != 0 || x_start < 0 || x_end > width || y_start < 0 || y_end > height) {
+            primed = false;
+            return esp_lcd_panel_draw_bitmap(panel, x_start, y_start, x_end, y_end, data);
+        }
+
+        int area_width = x_end - x_start;
+        int pages = (y_end - y_start) / 8;
+        if (!primed) {
+            for (int page = 0; page < pages; page++) {
+                memcpy(&shadow[(y_start / 8 + page) * width + x_start], data + page * area_width, area_width);
+            }
+            primed = x_start == 0 && y_start == 0 && x_end == width && y_end == height;
+            return esp_lcd_panel_draw_bitmap(panel, x_start, y_start, x_end, y_end, data);
+        }
+
+        int transfers = 0;
+        esp_err_t ret = ESP_OK;
+        for (int page = 0; page < pages && ret == ESP_OK; page++) {
+            const uint8_t* row = data + page * area_width;
+            uint8_t* shadow_row = &shadow[(y_start / 8 + page) * width + x_start];
+            int y = y_start + page * 8;
+            int first = -1;
+            int last = -1;
+            for (int x = 0; x < area_width; x++) {
+                if (row[x] == shadow_row[x]) {
+                    continue;
+                }
+                if (first >= 0 && x - last > OLED_DIFF_MERGE_GAP) {
+                    ret = esp_lcd_panel_draw_bitmap(panel, x_start + first, y, x_start + last + 1, y + 8, row + first);
+                    transfers++;
+                    first = x;
+                } else if (first < 0) {
+                    first = x;
+                }
+                last = x;
+            }
+            if (first >= 0 && ret == ESP_OK) {
+                ret = esp_lcd_panel_draw_bitmap(panel, x_start + first, y, x_start + last + 1, y + 8, row + first);
+                transfers++;
+            }
+            memcpy(shadow_row, row, area_width);
+        }
+        if (ret != ESP_OK) {
+            primed = false;
+        }
+
+        // Every transfer completes the flush from the panel IO callback, without one LVGL is told here
+        if (transfers == 0 && display != nullptr) {
+            lv_display_flush_ready(display);
+        }
+        return ret;
+    }
+};
+
 OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
     int width, int height, bool mirror_x, bool mirror_y)
     : panel_io_(panel_io), panel_(panel) {
@@ -46,9 +167,10 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding OLED display");
+    shadow_panel_ = new OledShadowPanel(panel_, width_, height_);
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
-        .panel_handle = panel_,
+        .panel_handle = &shadow_panel_->base,
         .control_handle = nullptr,
         .buffer_size = static_cast<uint32_t>(width_ * height_),
         .double_buffer = false,
@@ -75,6 +197,7 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
         ESP_LOGE(TAG, "Failed to add display");
         return;
     }
+    shadow_panel_->display = display_;
 
     // Note: SetupUI() should be called by Application::Initialize(), not in constructor
     // to ensure lvgl objects are created after the display is fully initialized.
@@ -133,6 +256,7 @@ OledDisplay::~OledDisplay() {
         esp_lcd_panel_io_del(panel_io_);
     }
     lvgl_port_deinit();
+    delete shadow_panel_;
 }
 
 bool OledDisplay::Lock(int timeout_ms) {
@@ -154,12 +278,12 @@ void OledDisplay::SetChatMessage(const char* role, const char* content) {
     std::replace(content_str.begin(), content_str.end(), '\n', ' ');
 
     if (content_right_ == nullptr) {
-        lv_label_set_text(chat_message_label_, content_str.c_str());
+        MarqueeLabel::SetText(chat_message_label_, content_str.c_str());
     } else {
         if (content == nullptr || content[0] == '\0') {
             lv_obj_add_flag(content_right_, LV_OBJ_FLAG_HIDDEN);
         } else {
-            lv_label_set_text(chat_message_label_, content_str.c_str());
+            MarqueeLabel::SetText(chat_message_label_, content_str.c_str());
             lv_obj_remove_flag(content_right_, LV_OBJ_FLAG_HIDDEN);
         }
     }
@@ -236,10 +360,10 @@ void OledDisplay::SetupUI_128x64() {
 
     status_label_ = lv_label_create(status_bar_);
     lv_obj_set_width(status_label_, LV_HOR_RES);
-    lv_label_set_long_mode(status_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_obj_set_style_text_align(status_label_, LV_TEXT_ALIGN_CENTER, 0);
     lv_label_set_text(status_label_, Lang::Strings::INITIALIZING);
     lv_obj_align(status_label_, LV_ALIGN_CENTER, 0, 0);
+    MarqueeLabel::Attach(status_label_);
 
     /* Content */
     content_ = lv_obj_create(container_);
@@ -271,18 +395,18 @@ void OledDisplay::SetupUI_128x64() {
 
     chat_message_label_ = lv_label_create(content_right_);
     lv_label_set_text(chat_message_label_, "");
-    lv_label_set_long_mode(chat_message_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_obj_set_style_text_align(chat_message_label_, LV_TEXT_ALIGN_LEFT, 0);
     lv_obj_set_width(chat_message_label_, width_ - 32);
     lv_obj_set_style_pad_top(chat_message_label_, 14, 0);
 
-    // Start scrolling subtitle after a delay
+    // Start scrolling subtitle after a delay, for text too long for a marquee strip
     static lv_anim_t a;
     lv_anim_init(&a);
     lv_anim_set_delay(&a, 1000);
     lv_anim_set_repeat_count(&a, LV_ANIM_REPEAT_INFINITE);
     lv_obj_set_style_anim(chat_message_label_, &a, LV_PART_MAIN);
     lv_obj_set_style_anim_duration(chat_message_label_, lv_anim_speed_clamped(60, 300, 60000), LV_PART_MAIN);
+    MarqueeLabel::Attach(chat_message_label_);
 
     low_battery_popup_ = lv_obj_create(screen);
     lv_obj_set_scrollbar_mode(low_battery_popup_, LV_SCROLLBAR_MODE_OFF);
@@ -372,16 +496,16 @@ void OledDisplay::SetupUI_128x32() {
     chat_message_label_ = lv_label_create(side_bar_);
     lv_obj_set_size(chat_message_label_, width_ - 32, LV_SIZE_CONTENT);
     lv_obj_set_style_pad_left(chat_message_label_, 2, 0);
-    lv_label_set_long_mode(chat_message_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_label_set_text(chat_message_label_, "");
 
-    // Start scrolling subtitle after a delay
+    // Start scrolling subtitle after a delay, for text too long for a marquee strip
     static lv_anim_t a;
     lv_anim_init(&a);
     lv_anim_set_delay(&a, 1000);
     lv_anim_set_repeat_count(&a, LV_ANIM_REPEAT_INFINITE);
     lv_obj_set_style_anim(chat_message_label_, &a, LV_PART_MAIN);
     lv_obj_set_style_anim_duration(chat_message_label_, lv_anim_speed_clamped(60, 300, 60000), LV_PART_MAIN);
+    MarqueeLabel::Attach(chat_message_label_);
 }
 
 void OledDisplay::SetEmotion(const char* emotion) {
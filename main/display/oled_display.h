@@ -6,11 +6,14 @@
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
 
+struct OledShadowPanel;
 
 class OledDisplay : public LvglDisplay {
 private:
     esp_lcd_panel_io_handle_t panel_io_ = nullptr;
     esp_lcd_panel_handle_t panel_ = nullptr;
+    // Handed to LVGL in place of panel_, forwards only the changed bytes of each flush
+    OledShadowPanel* shadow_panel_ = nullptr;
 
     lv_obj_t* top_bar_ = nullptr;
     lv_obj_t* status_bar_ = nullptr;
@@ -0,0 +1,115 @@
+#include "dns_cache.h"
+#include "settings.h"
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+
+#include <algorithm>
+
+#define TAG "DnsCache"
+
+std::string DnsCache::HostOf(const std::string& url) {
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = url.find_first_of(":/?", start);
+    std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    // Addresses need no lookup
+    struct in_addr addr;
+    if (host.empty() || inet_aton(host.c_str(), &addr)) {
+        return "";
+    }
+    return host;
+}
+
+void DnsCache::AddHost(const std::string& url) {
+    std::string host = HostOf(url);
+    if (host.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (std::find(hosts_.begin(), hosts_.end(), host) != hosts_.end()) {
+            return;
+        }
+        hosts_.push_back(host);
+    }
+    // A host added while connected is resolved right away
+    if (running_ && task_handle_ != nullptr) {
+        xTaskNotifyGive(task_handle_);
+    }
+}
+
+void DnsCache::AddSettingsHosts() {
+    Settings wifi("wifi", false);
+    std::string ota_url = wifi.GetString("ota_url");
+    AddHost(ota_url.empty() ? CONFIG_OTA_URL : ota_url);
+    AddHost(Settings("websocket", false).GetString("url"));
+    AddHost(Settings("mqtt", false).GetString("endpoint"));
+}
+
+void DnsCache::Start() {
+#if CONFIG_DNS_PREFETCH
+    AddSettingsHosts();
+    running_ = true;
+    if (task_handle_ == nullptr) {
+        TaskManifest::Create("dns_cache", [](void* arg) {
+            static_cast<DnsCache*>(arg)->RefreshTask();
+        }, this, &task_handle_);
+    } else {
+        xTaskNotifyGive(task_handle_);
+    }
+#endif
+}
+
+void DnsCache::Stop() {
+    running_ = false;
+}
+
+void DnsCache::RefreshTask() {
+#if CONFIG_DNS_PREFETCH
+    while (true) {
+        if (running_) {
+            ResolveAll();
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_DNS_PREFETCH_REFRESH_S * 1000));
+    }
+#endif
+}
+
+void DnsCache::ResolveAll() {
+    std::vector<std::string> hosts;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hosts = hosts_;
+    }
+    for (const auto& host : hosts) {
+        if (!running_) {
+            return;
+        }
+        struct addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        int64_t start_us = esp_timer_get_time();
+        int err = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+        int elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+        if (err != 0 || result == nullptr) {
+            ESP_LOGW(TAG, "Failed to resolve %s, error %d", host.c_str(), err);
+            continue;
+        }
+        char address[INET6_ADDRSTRLEN] = {};
+        if (result->ai_family == AF_INET) {
+            inet_ntop(AF_INET, &((struct sockaddr_in*)result->ai_addr)->sin_addr, address, sizeof(address));
+        } else if (result->ai_family == AF_INET6) {
+            inet_ntop(AF_INET6, &((struct sockaddr_in6*)result->ai_addr)->sin6_addr, address, sizeof(address));
+        }
+        freeaddrinfo(result);
+        // A lookup answered from the table takes no time, only log the ones that asked the server
+        if (elapsed_ms > 0) {
+            ESP_LOGI(TAG, "Resolved %s to %s in %d ms", host.c_str(), address, elapsed_ms);
+        }
+    }
+}
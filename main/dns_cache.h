@@ -0,0 +1,47 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Resolves the server hostnames (OTA, websocket, MQTT and the camera explain URL) right after
+ * the network connects and again every CONFIG_DNS_PREFETCH_REFRESH_S, so the lwIP DNS table
+ * already holds them when a channel opens and the connect skips the query. lwIP keeps each
+ * entry for its TTL; the refresh only queries the server again for expired ones.
+ *
+ * Boards whose modem resolves names itself do not use lwIP DNS, the queries just fail there.
+ */
+class DnsCache {
+public:
+    static DnsCache& GetInstance() {
+        static DnsCache instance;
+        return instance;
+    }
+
+    // Keeps the host of a URL or host:port resolved, e.g. the explain URL a camera was given
+    void AddHost(const std::string& url);
+    // Resolves now and periodically until Stop(), the hosts of the settings are read again
+    void Start();
+    void Stop();
+
+private:
+    std::mutex mutex_;
+    std::vector<std::string> hosts_;
+    std::atomic<bool> running_{false};
+    TaskHandle_t task_handle_ = nullptr;
+
+    DnsCache() = default;
+
+    static std::string HostOf(const std::string& url);
+    void AddSettingsHosts();
+    void ResolveAll();
+    void RefreshTask();
+};
+
+#endif // DNS_CACHE_H
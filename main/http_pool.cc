@@ -0,0 +1,634 @@
+#include "http_pool.h"
+#include "board.h"
+#include "application.h"
+
+#include <esp_log.h>
+#include <network_interface.h>
+#include <tcp.h>
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#define TAG "HttpPool"
+
+#define HTTP_DEFAULT_TIMEOUT_MS 30000
+// Headers larger than this are a broken response, not a slow one
+#define HTTP_MAX_HEADER_SIZE (8 * 1024)
+
+struct HttpConnection {
+    NetworkInterface* network = nullptr;
+    int connect_id = 0;
+    bool ssl = false;
+    std::string host;
+    int port = 0;
+    int64_t idle_since_us = 0;
+    int requests = 0;
+
+    // Received and not yet parsed, filled by the stream callback of the transport
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::string rx;
+    bool closed = false;
+
+    // Last, so the transport and its callbacks go before the state they use
+    std::unique_ptr<Tcp> tcp;
+};
+
+// Moves the connections matching pred out of the list
+template <typename Pred>
+static std::vector<std::shared_ptr<HttpConnection>> TakeIf(std::vector<std::shared_ptr<HttpConnection>>& list, Pred&& pred) {
+    std::vector<std::shared_ptr<HttpConnection>> taken;
+    size_t kept = 0;
+    for (size_t i = 0; i < list.size(); i++) {
+        if (pred(list[i])) {
+            taken.push_back(std::move(list[i]));
+        } else if (kept != i) {
+            list[kept++] = std::move(list[i]);
+        } else {
+            kept++;
+        }
+    }
+    list.resize(kept);
+    return taken;
+}
+
+static bool EqualsIgnoreCase(const std::string& a, const std::string& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+        [](char x, char y) { return std::tolower((unsigned char)x) == std::tolower((unsigned char)y); });
+}
+
+/*
+ * An HTTP/1.1 client on a pooled connection: the request is sent with Connection: keep-alive and
+ * Close() hands the connection back to the pool once the response was read to its end.
+ * A request on a reused connection the server already closed is sent again on a new one.
+ */
+class KeepAliveHttp : public Http {
+public:
+    explicit KeepAliveHttp(int connect_id) : connect_id_(connect_id) {}
+    ~KeepAliveHttp() override { Close(); }
+
+    void SetTimeout(int timeout_ms) override { timeout_ms_ = timeout_ms; }
+
+    void SetHeader(const std::string& key, const std::string& value) override {
+        for (auto& header : headers_) {
+            if (EqualsIgnoreCase(header.first, key)) {
+                header.second = value;
+                return;
+            }
+        }
+        headers_.emplace_back(key, value);
+    }
+
+    void SetContent(std::string&& content) override { content_ = std::move(content); }
+
+    bool Open(const std::string& method, const std::string& url) override {
+        Close();
+        bool ssl;
+        std::string host, path;
+        int port;
+        if (!ParseUrl(url, ssl, host, port, path)) {
+            ESP_LOGE(TAG, "Invalid URL: %s", url.c_str());
+            last_error_ = -1;
+            return false;
+        }
+        head_request_ = method == "HEAD";
+        // A body without Content-Length is sent by Write() in chunks, ended by Write("", 0)
+        chunked_request_ = false;
+        for (const auto& header : headers_) {
+            if (EqualsIgnoreCase(header.first, "Transfer-Encoding") && header.second == "chunked") {
+                chunked_request_ = true;
+            }
+        }
+        bool implicit_chunked = !chunked_request_ && content_.empty() && (method == "POST" || method == "PUT");
+        chunked_request_ |= implicit_chunked;
+
+        std::string request = method + " " + path + " HTTP/1.1\r\n";
+        request += "Host: " + host + "\r\n";
+        for (const auto& header : headers_) {
+            request += header.first + ": " + header.second + "\r\n";
+        }
+        if (implicit_chunked) {
+            request += "Transfer-Encoding: chunked\r\n";
+        }
+        if (!chunked_request_ && (!content_.empty() || method == "POST" || method == "PUT")) {
+            request += "Content-Length: " + std::to_string(content_.size()) + "\r\n";
+        }
+        request += "Connection: keep-alive\r\n\r\n";
+        request += content_;
+
+        for (int attempt = 0; attempt < 2; attempt++) {
+            bool reused = false;
+            connection_ = HttpPool::GetInstance().Acquire(connect_id_, ssl, host, port, reused);
+            if (connection_ == nullptr) {
+                last_error_ = -1;
+                return false;
+            }
+            ResetResponse();
+            if (connection_->tcp->Send(request) < 0) {
+                Drop();
+                if (reused) {
+                    continue;
+                }
+                last_error_ = -1;
+                return false;
+            }
+            // A chunked body follows, the response can only be awaited after it
+            if (chunked_request_) {
+                return true;
+            }
+            request_done_ = true;
+            if (ReadHeaders()) {
+                return true;
+            }
+            // The server closed the reused connection before answering, the request is sent again
+            bool stale = reused && response_bytes_ == 0;
+            Drop();
+            if (!stale) {
+                return false;
+            }
+            ESP_LOGI(TAG, "Connection to %s was closed by the server, reconnecting", host.c_str());
+        }
+        last_error_ = -1;
+        return false;
+    }
+
+    void Close() override {
+        if (connection_ == nullptr) {
+            return;
+        }
+        if (reusable_ && request_done_ && headers_done_ && DiscardBody()) {
+            connection_->requests++;
+            HttpPool::GetInstance().Release(std::move(connection_));
+        } else {
+            Drop();
+        }
+        connection_.reset();
+    }
+
+    // What arrived of the body, at most buffer_size bytes; 0 at its end
+    int Read(char* buffer, size_t buffer_size) override {
+        if (!ReadHeaders()) {
+            return -1;
+        }
+        if (body_done_ || buffer_size == 0) {
+            return 0;
+        }
+        return ReadBody(buffer, buffer_size);
+    }
+
+    int Write(const char* buffer, size_t buffer_size) override {
+        if (connection_ == nullptr || request_done_) {
+            return -1;
+        }
+        std::string data;
+        if (chunked_request_) {
+            char size[12];
+            snprintf(size, sizeof(size), "%x\r\n", (unsigned)buffer_size);
+            data.reserve(buffer_size + 16);
+            data = size;
+            data.append(buffer, buffer_size);
+            data += "\r\n";
+            request_done_ = buffer_size == 0;
+        } else {
+            data.assign(buffer, buffer_size);
+        }
+        if (connection_->tcp->Send(data) < 0) {
+            Drop();
+            last_error_ = -1;
+            return -1;
+        }
+        return buffer_size;
+    }
+
+    int GetStatusCode() override {
+        if (!ReadHeaders()) {
+            return -1;
+        }
+        return status_code_;
+    }
+
+    std::string GetResponseHeader(const std::string& key) const override {
+        for (const auto& header : response_headers_) {
+            if (EqualsIgnoreCase(header.first, key)) {
+                return header.second;
+            }
+        }
+        return "";
+    }
+
+    size_t GetBodyLength() override {
+        if (!ReadHeaders()) {
+            return 0;
+        }
+        return body_mode_ == kBodyLength ? content_length_ : 0;
+    }
+
+    std::string ReadAll() override {
+        std::string body;
+        char buffer[512];
+        while (true) {
+            int ret = Read(buffer, sizeof(buffer));
+            if (ret <= 0) {
+                break;
+            }
+            body.append(buffer, ret);
+        }
+        return body;
+    }
+
+    int GetLastError() override { return last_error_; }
+
+private:
+    enum BodyMode {
+        kBodyNone,
+        kBodyLength,
+        kBodyChunked,
+        kBodyUntilClose,
+    };
+
+    int connect_id_;
+    int timeout_ms_ = HTTP_DEFAULT_TIMEOUT_MS;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string content_;
+    std::shared_ptr<HttpConnection> connection_;
+    int last_error_ = 0;
+
+    bool head_request_ = false;
+    bool chunked_request_ = false;
+    bool request_done_ = false;
+
+    bool headers_done_ = false;
+    int status_code_ = -1;
+    std::vector<std::pair<std::string, std::string>> response_headers_;
+    BodyMode body_mode_ = kBodyNone;
+    size_t content_length_ = 0;
+    // Left of the current chunk, or of the body with Content-Length
+    size_t body_left_ = 0;
+    bool body_done_ = false;
+    bool reusable_ = false;
+    size_t response_bytes_ = 0;
+
+    static bool ParseUrl(const std::string& url, bool& ssl, std::string& host, int& port, std::string& path) {
+        size_t scheme_end = url.find("://");
+        if (scheme_end == std::string::npos) {
+            return false;
+        }
+        std::string scheme = url.substr(0, scheme_end);
+        if (scheme == "https") {
+            ssl = true;
+            port = 443;
+        } else if (scheme == "http") {
+            ssl = false;
+            port = 80;
+        } else {
+            return false;
+        }
+        size_t host_start = scheme_end + 3;
+        size_t path_start = url.find('/', host_start);
+        std::string authority = url.substr(host_start, path_start == std::string::npos ? std::string::npos : path_start - host_start);
+        path = path_start == std::string::npos ? "/" : url.substr(path_start);
+        size_t colon = authority.rfind(':');
+        if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+            port = atoi(authority.c_str() + colon + 1);
+            authority.resize(colon);
+        }
+        host = authority;
+        return !host.empty() && port > 0;
+    }
+
+    void ResetResponse() {
+        request_done_ = false;
+        headers_done_ = false;
+        status_code_ = -1;
+        response_headers_.clear();
+        body_mode_ = kBodyNone;
+        content_length_ = 0;
+        body_left_ = 0;
+        body_done_ = false;
+        reusable_ = false;
+        response_bytes_ = 0;
+    }
+
+    void Drop() {
+        if (connection_ != nullptr) {
+            connection_->tcp->Disconnect();
+            connection_.reset();
+        }
+    }
+
+    // Waits until the received data holds what `ready` asks for, false on timeout or close
+    template <typename Ready>
+    bool WaitFor(std::unique_lock<std::mutex>& lock, Ready&& ready) {
+        auto& connection = *connection_;
+        bool ok = connection.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms_),
+            [&]() { return ready() || connection.closed; });
+        if (!ok) {
+            ESP_LOGE(TAG, "Timeout waiting for %s", connection.host.c_str());
+            last_error_ = -1;
+            return false;
+        }
+        return ready();
+    }
+
+    bool ReadHeaders() {
+        if (headers_done_) {
+            return true;
+        }
+        if (connection_ == nullptr || !request_done_) {
+            return false;
+        }
+        auto& connection = *connection_;
+        std::unique_lock<std::mutex> lock(connection.mutex);
+        while (true) {
+            size_t end = std::string::npos;
+            bool ok = WaitFor(lock, [&]() {
+                end = connection.rx.find("\r\n\r\n");
+                if (!connection.rx.empty()) {
+                    response_bytes_ = connection.rx.size();
+                }
+                return end != std::string::npos || connection.rx.size() > HTTP_MAX_HEADER_SIZE;
+            });
+            if (!ok || end == std::string::npos) {
+                last_error_ = -1;
+                return false;
+            }
+            std::string head = connection.rx.substr(0, end);
+            connection.rx.erase(0, end + 4);
+            if (!ParseHead(head)) {
+                last_error_ = -1;
+                return false;
+            }
+            // Interim responses come before the real one
+            if (status_code_ < 100 || status_code_ >= 200) {
+                break;
+            }
+            response_headers_.clear();
+        }
+        headers_done_ = true;
+        return true;
+    }
+
+    bool ParseHead(const std::string& head) {
+        size_t line_end = head.find("\r\n");
+        std::string status_line = head.substr(0, line_end);
+        if (status_line.compare(0, 5, "HTTP/") != 0 || status_line.size() < 12) {
+            ESP_LOGE(TAG, "Invalid status line: %s", status_line.c_str());
+            return false;
+        }
+        bool http11 = status_line.compare(0, 8, "HTTP/1.1") == 0;
+        status_code_ = atoi(status_line.c_str() + 9);
+
+        size_t start = line_end == std::string::npos ? head.size() : line_end + 2;
+        while (start < head.size()) {
+            size_t end = head.find("\r\n", start);
+            if (end == std::string::npos) {
+                end = head.size();
+            }
+            size_t colon = head.find(':', start);
+            if (colon != std::string::npos && colon < end) {
+                size_t value_start = head.find_first_not_of(' ', colon + 1);
+                std::string value = value_start == std::string::npos || value_start >= end ? "" : head.substr(value_start, end - value_start);
+                response_headers_.emplace_back(head.substr(start, colon - start), value);
+            }
+            start = end + 2;
+        }
+
+        std::string connection = GetResponseHeader("Connection");
+        reusable_ = http11 ? !EqualsIgnoreCase(connection, "close") : EqualsIgnoreCase(connection, "keep-alive");
+        if (head_request_ || status_code_ == 204 || status_code_ == 304 || status_code_ < 200) {
+            body_mode_ = kBodyNone;
+            body_done_ = true;
+        } else if (EqualsIgnoreCase(GetResponseHeader("Transfer-Encoding"), "chunked")) {
+            body_mode_ = kBodyChunked;
+        } else if (!GetResponseHeader("Content-Length").empty()) {
+            body_mode_ = kBodyLength;
+            content_length_ = strtoul(GetResponseHeader("Content-Length").c_str(), nullptr, 10);
+            body_left_ = content_length_;
+            body_done_ = content_length_ == 0;
+        } else {
+            body_mode_ = kBodyUntilClose;
+            reusable_ = false;
+        }
+        return true;
+    }
+
+    // The next piece of the body, 0 at its end
+    int ReadBody(char* buffer, size_t size) {
+        auto& connection = *connection_;
+        std::unique_lock<std::mutex> lock(connection.mutex);
+        if (body_mode_ == kBodyChunked && body_left_ == 0) {
+            // The size line of the next chunk, the CRLF of the previous one is already consumed
+            size_t end = std::string::npos;
+            if (!WaitFor(lock, [&]() { return (end = connection.rx.find("\r\n")) != std::string::npos; })) {
+                return -1;
+            }
+            body_left_ = strtoul(connection.rx.c_str(), nullptr, 16);
+            connection.rx.erase(0, end + 2);
+            if (body_left_ == 0) {
+                // Trailers end with an empty line
+                if (!WaitFor(lock, [&]() { return (end = connection.rx.find("\r\n")) != std::string::npos; })) {
+                    return -1;
+                }
+                while (end != 0) {
+                    connection.rx.erase(0, end + 2);
+                    if (!WaitFor(lock, [&]() { return (end = connection.rx.find("\r\n")) != std::string::npos; })) {
+                        return -1;
+                    }
+                }
+                connection.rx.erase(0, 2);
+                body_done_ = true;
+                return 0;
+            }
+        }
+
+        if (connection.rx.empty()) {
+            if (!WaitFor(lock, [&]() { return !connection.rx.empty(); })) {
+                if (body_mode_ == kBodyUntilClose && connection.closed) {
+                    body_done_ = true;
+                    return 0;
+                }
+                return -1;
+            }
+        }
+        size_t n = std::min(size, connection.rx.size());
+        if (body_mode_ != kBodyUntilClose) {
+            n = std::min(n, body_left_);
+        }
+        memcpy(buffer, connection.rx.data(), n);
+        connection.rx.erase(0, n);
+        if (body_mode_ != kBodyUntilClose) {
+            body_left_ -= n;
+        }
+        if (body_mode_ == kBodyLength && body_left_ == 0) {
+            body_done_ = true;
+        } else if (body_mode_ == kBodyChunked && body_left_ == 0) {
+            // The CRLF after the chunk data
+            if (!WaitFor(lock, [&]() { return connection.rx.size() >= 2; })) {
+                return -1;
+            }
+            connection.rx.erase(0, 2);
+        }
+        return n;
+    }
+
+    // Skips what the caller did not read of a body with Content-Length that already arrived
+    bool DiscardBody() {
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        if (!body_done_ && body_mode_ == kBodyLength) {
+            size_t n = std::min(body_left_, connection_->rx.size());
+            connection_->rx.erase(0, n);
+            body_left_ -= n;
+            body_done_ = body_left_ == 0;
+        }
+        return body_done_ && connection_->rx.empty() && !connection_->closed;
+    }
+};
+
+HttpPool::HttpPool() {
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void*) {
+            // Closing a modem connection waits for AT replies, not for the timer task
+            Application::GetInstance().Schedule([]() {
+                HttpPool::GetInstance().ExpireIdle();
+            }, kSchedulePriorityLow);
+        },
+        .arg = nullptr,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "http_pool",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&timer_args, &expire_timer_);
+}
+
+HttpPool::~HttpPool() {
+    if (expire_timer_ != nullptr) {
+        esp_timer_stop(expire_timer_);
+        esp_timer_delete(expire_timer_);
+    }
+}
+
+std::unique_ptr<Http> HttpPool::CreateHttp(int connect_id) {
+#if CONFIG_HTTP_KEEPALIVE_IDLE_S > 0
+    return std::make_unique<KeepAliveHttp>(connect_id);
+#else
+    return Board::GetInstance().GetNetwork()->CreateHttp(connect_id);
+#endif
+}
+
+std::unique_ptr<Http> HttpPool::CreateStreamingHttp(int connect_id) {
+    std::vector<std::shared_ptr<HttpConnection>> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing = TakeIf(idle_, [&](const auto& connection) { return connection->connect_id == connect_id; });
+    }
+    CloseConnections(closing);
+    return Board::GetInstance().GetNetwork()->CreateHttp(connect_id);
+}
+
+void HttpPool::CloseIdle() {
+    std::vector<std::shared_ptr<HttpConnection>> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing.swap(idle_);
+    }
+    CloseConnections(closing);
+}
+
+void HttpPool::ExpireIdle() {
+    int64_t now = esp_timer_get_time();
+    std::vector<std::shared_ptr<HttpConnection>> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing = TakeIf(idle_, [&](const auto& connection) {
+            return now - connection->idle_since_us >= CONFIG_HTTP_KEEPALIVE_IDLE_S * 1000000LL;
+        });
+    }
+    CloseConnections(closing);
+}
+
+void HttpPool::CloseConnections(std::vector<std::shared_ptr<HttpConnection>>& connections) {
+    for (auto& connection : connections) {
+        ESP_LOGI(TAG, "Closing idle connection to %s after %d requests", connection->host.c_str(), connection->requests);
+        connection->tcp->Disconnect();
+    }
+    connections.clear();
+}
+
+std::shared_ptr<HttpConnection> HttpPool::Acquire(int connect_id, bool ssl, const std::string& host, int port, bool& reused) {
+    auto network = Board::GetInstance().GetNetwork();
+    int64_t now = esp_timer_get_time();
+    std::shared_ptr<HttpConnection> connection;
+    std::vector<std::shared_ptr<HttpConnection>> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // The connect id is taken either way, an idle connection on it to another host goes
+        auto taken = TakeIf(idle_, [&](const auto& idle) {
+            return idle->connect_id == connect_id || idle->network != network ||
+                now - idle->idle_since_us >= CONFIG_HTTP_KEEPALIVE_IDLE_S * 1000000LL;
+        });
+        for (auto& idle : taken) {
+            bool closed;
+            {
+                std::lock_guard<std::mutex> connection_lock(idle->mutex);
+                closed = idle->closed;
+            }
+            if (connection == nullptr && !closed && idle->connect_id == connect_id && idle->network == network &&
+                idle->ssl == ssl && idle->port == port && idle->host == host &&
+                now - idle->idle_since_us < CONFIG_HTTP_KEEPALIVE_IDLE_S * 1000000LL) {
+                connection = idle;
+            } else {
+                closing.push_back(idle);
+            }
+        }
+    }
+    CloseConnections(closing);
+    if (connection != nullptr) {
+        ESP_LOGD(TAG, "Reusing connection to %s", host.c_str());
+        reused = true;
+        return connection;
+    }
+
+    reused = false;
+    connection = std::make_shared<HttpConnection>();
+    connection->network = network;
+    connection->connect_id = connect_id;
+    connection->ssl = ssl;
+    connection->host = host;
+    connection->port = port;
+    connection->tcp = ssl ? network->CreateSsl(connect_id) : network->CreateTcp(connect_id);
+    if (connection->tcp == nullptr) {
+        ESP_LOGE(TAG, "Failed to create a connection to %s", host.c_str());
+        return nullptr;
+    }
+    auto raw = connection.get();
+    connection->tcp->OnStream([raw](const std::string& data) {
+        std::lock_guard<std::mutex> lock(raw->mutex);
+        raw->rx += data;
+        raw->cv.notify_all();
+    });
+    connection->tcp->OnDisconnected([raw]() {
+        std::lock_guard<std::mutex> lock(raw->mutex);
+        raw->closed = true;
+        raw->cv.notify_all();
+    });
+    if (!connection->tcp->Connect(host, port)) {
+        ESP_LOGE(TAG, "Failed to connect to %s:%d", host.c_str(), port);
+        return nullptr;
+    }
+    return connection;
+}
+
+void HttpPool::Release(std::shared_ptr<HttpConnection> connection) {
+    connection->idle_since_us = esp_timer_get_time();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(std::move(connection));
+    }
+    esp_timer_stop(expire_timer_);
+    esp_timer_start_once(expire_timer_, CONFIG_HTTP_KEEPALIVE_IDLE_S * 1000000LL);
+}
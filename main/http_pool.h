@@ -0,0 +1,56 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <http.h>
+#include <esp_timer.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct HttpConnection;
+class KeepAliveHttp;
+
+/*
+ * Keeps HTTP/1.1 connections of Board::GetNetwork() open for CONFIG_HTTP_KEEPALIVE_IDLE_S after a
+ * request, so the next request to the same host skips the TCP and TLS handshakes, e.g. check
+ * version, activation and the assets download in a row, or several Explain calls. There is at
+ * most one idle connection per connect id, the ids are modem connection slots on 4G boards.
+ *
+ * Long downloads use CreateStreamingHttp(), the client of the network, which closes an idle
+ * connection on the same id first.
+ */
+class HttpPool {
+public:
+    static HttpPool& GetInstance() {
+        static HttpPool instance;
+        return instance;
+    }
+
+    // For request and response exchanges that fit in memory
+    std::unique_ptr<Http> CreateHttp(int connect_id);
+    // For responses read in blocks as they arrive, firmware or assets
+    std::unique_ptr<Http> CreateStreamingHttp(int connect_id);
+    // Closes the idle connections, e.g. after the network switched
+    void CloseIdle();
+
+private:
+    friend class KeepAliveHttp;
+
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<HttpConnection>> idle_;
+    esp_timer_handle_t expire_timer_ = nullptr;
+
+    HttpPool();
+    ~HttpPool();
+
+    // A connection to host:port on the connect id, reused when one is idle
+    std::shared_ptr<HttpConnection> Acquire(int connect_id, bool ssl, const std::string& host, int port, bool& reused);
+    void Release(std::shared_ptr<HttpConnection> connection);
+    // Closes the connections idle for longer than the keep-alive time
+    void ExpireIdle();
+    void CloseConnections(std::vector<std::shared_ptr<HttpConnection>>& connections);
+};
+
+#endif // HTTP_POOL_H
@@ -1,6 +1,7 @@
 #include "circular_strip.h"
 #include "application.h"
 #include <esp_log.h>
+#include <soc/soc_caps.h>
 #include <algorithm>
 
 #define TAG "CircularStrip"
@@ -22,16 +23,26 @@ CircularStrip::CircularStrip(gpio_num_t gpio, uint16_t max_leds) : max_leds_(max
     led_strip_rmt_config_t rmt_config = {};
     rmt_config.resolution_hz = 10 * 1000 * 1000; // 10MHz
 
+#if SOC_RMT_SUPPORT_DMA
+    // Let the RMT DMA stream the whole frame instead of refilling its memory block from interrupts
+    rmt_config.mem_block_symbols = 1024;
+    rmt_config.flags.with_dma = true;
+    if (led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip_) != ESP_OK) {
+        ESP_LOGW(TAG, "No RMT DMA channel, using the memory block");
+        rmt_config.mem_block_symbols = 0;
+        rmt_config.flags.with_dma = false;
+        ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip_));
+    }
+#else
     ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip_));
+#endif
     led_strip_clear(led_strip_);
 
     esp_timer_create_args_t strip_timer_args = {
         .callback = [](void *arg) {
             auto strip = static_cast<CircularStrip*>(arg);
             std::lock_guard<std::mutex> lock(strip->mutex_);
-            if (strip->strip_callback_ != nullptr) {
-                strip->strip_callback_();
-            }
+            strip->ShowFrame();
         },
         .arg = this,
         .dispatch_method = ESP_TIMER_TASK,
@@ -43,149 +54,89 @@ CircularStrip::CircularStrip(gpio_num_t gpio, uint16_t max_leds) : max_leds_(max
 
 CircularStrip::~CircularStrip() {
     esp_timer_stop(strip_timer_);
+    esp_timer_delete(strip_timer_);
     if (led_strip_ != nullptr) {
         led_strip_del(led_strip_);
     }
 }
 
-
-void CircularStrip::SetAllColor(StripColor color) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(strip_timer_);
+void CircularStrip::ShowColors(const StripColor* colors) {
     for (int i = 0; i < max_leds_; i++) {
-        colors_[i] = color;
-        led_strip_set_pixel(led_strip_, i, color.red, color.green, color.blue);
+        colors_[i] = colors[i];
+        led_strip_set_pixel(led_strip_, i, colors[i].red, colors[i].green, colors[i].blue);
     }
     led_strip_refresh(led_strip_);
 }
 
+void CircularStrip::ShowFrame() {
+    if (frame_index_ >= animation_.frame_count()) {
+        return;
+    }
+    ShowColors(animation_.frame(frame_index_));
+    int hold_ms = animation_.hold_ms(frame_index_);
+    frame_index_++;
+    if (frame_index_ >= animation_.frame_count()) {
+        // A single looping frame stays without a timer
+        if (!animation_.loop() || animation_.frame_count() == 1) {
+            return;
+        }
+        frame_index_ = 0;
+    }
+    esp_timer_start_once(strip_timer_, (uint64_t)hold_ms * 1000);
+}
+
+void CircularStrip::Play(StripAnimation&& animation) {
+    if (led_strip_ == nullptr || animation.leds() < max_leds_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    esp_timer_stop(strip_timer_);
+    animation_ = std::move(animation);
+    frame_index_ = 0;
+    ShowFrame();
+}
+
+void CircularStrip::SetAllColor(StripColor color) {
+    Play(StripAnimation::Solid(max_leds_, color));
+}
+
 void CircularStrip::SetSingleColor(uint8_t index, StripColor color) {
     std::lock_guard<std::mutex> lock(mutex_);
     esp_timer_stop(strip_timer_);
+    animation_ = StripAnimation();
     colors_[index] = color;
-    led_strip_set_pixel(led_strip_, index, color.red, color.green, color.blue);
-    led_strip_refresh(led_strip_);
+    ShowColors(colors_.data());
 }
 
 void CircularStrip::SetMultiColors(const std::vector<StripColor>& colors) {
     std::lock_guard<std::mutex> lock(mutex_);
     esp_timer_stop(strip_timer_);
+    animation_ = StripAnimation();
     int count = std::min(max_leds_, static_cast<int>(colors.size()));
-    for (int i = 0; i < count; i++) {
-        colors_[i] = colors[i];
-        led_strip_set_pixel(led_strip_, i, colors[i].red, colors[i].green, colors[i].blue);
-    }
-    led_strip_refresh(led_strip_);
+    std::copy(colors.begin(), colors.begin() + count, colors_.begin());
+    ShowColors(colors_.data());
 }
 
 void CircularStrip::Blink(StripColor color, int interval_ms) {
-    for (int i = 0; i < max_leds_; i++) {
-        colors_[i] = color;
-    }
-    StartStripTask(interval_ms, [this]() {
-        static bool on = true;
-        if (on) {
-            for (int i = 0; i < max_leds_; i++) {
-                led_strip_set_pixel(led_strip_, i, colors_[i].red, colors_[i].green, colors_[i].blue);
-            }
-            led_strip_refresh(led_strip_);
-        } else {
-            led_strip_clear(led_strip_);
-        }
-        on = !on;
-    });
+    Play(StripAnimation::Blink(max_leds_, color, interval_ms));
 }
 
 void CircularStrip::FadeOut(int interval_ms) {
-    StartStripTask(interval_ms, [this]() {
-        bool all_off = true;
-        for (int i = 0; i < max_leds_; i++) {
-            colors_[i].red /= 2;
-            colors_[i].green /= 2;
-            colors_[i].blue /= 2;
-            if (colors_[i].red != 0 || colors_[i].green != 0 || colors_[i].blue != 0) {
-                all_off = false;
-            }
-            led_strip_set_pixel(led_strip_, i, colors_[i].red, colors_[i].green, colors_[i].blue);
-        }
-        if (all_off) {
-            led_strip_clear(led_strip_);
-            esp_timer_stop(strip_timer_);
-        } else {
-            led_strip_refresh(led_strip_);
-        }
-    });
+    std::vector<StripColor> from;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        from = colors_;
+    }
+    Play(StripAnimation::FadeOut(from, interval_ms));
 }
 
 void CircularStrip::Breathe(StripColor low, StripColor high, int interval_ms) {
-    StartStripTask(interval_ms, [this, low, high]() {
-        static bool increase = true;
-        static StripColor color = low;
-        if (increase) {
-            if (color.red < high.red) {
-                color.red++;
-            }
-            if (color.green < high.green) {
-                color.green++;
-            }
-            if (color.blue < high.blue) {
-                color.blue++;
-            }
-            if (color.red == high.red && color.green == high.green && color.blue == high.blue) {
-                increase = false;
-            }
-        } else {
-            if (color.red > low.red) {
-                color.red--;
-            }
-            if (color.green > low.green) {
-                color.green--;
-            }
-            if (color.blue > low.blue) {
-                color.blue--;
-            }
-            if (color.red == low.red && color.green == low.green && color.blue == low.blue) {
-                increase = true;
-            }
-        }
-        for (int i = 0; i < max_leds_; i++) {
-            led_strip_set_pixel(led_strip_, i, color.red, color.green, color.blue);
-        }
-        led_strip_refresh(led_strip_);
-    });
+    Play(StripAnimation::Breathe(max_leds_, low, high, interval_ms));
 }
 
 void CircularStrip::Scroll(StripColor low, StripColor high, int length, int interval_ms) {
-    for (int i = 0; i < max_leds_; i++) {
-        colors_[i] = low;
-    }
-    StartStripTask(interval_ms, [this, low, high, length]() {
-        static int offset = 0;
-        for (int i = 0; i < max_leds_; i++) {
-            colors_[i] = low;
-        }
-        for (int j = 0; j < length; j++) {
-            int i = (offset + j) % max_leds_;
-            colors_[i] = high;
-        }
-        for (int i = 0; i < max_leds_; i++) {
-            led_strip_set_pixel(led_strip_, i, colors_[i].red, colors_[i].green, colors_[i].blue);
-        }
-        led_strip_refresh(led_strip_);
-        offset = (offset + 1) % max_leds_;
-    });
-}
-
-void CircularStrip::StartStripTask(int interval_ms, std::function<void()> cb) {
-    if (led_strip_ == nullptr) {
-        return;
-    }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(strip_timer_);
-    
-    strip_callback_ = cb;
-    esp_timer_start_periodic(strip_timer_, interval_ms * 1000);
+    Play(StripAnimation::Scroll(max_leds_, low, high, length, interval_ms));
 }
 
 void CircularStrip::SetBrightness(uint8_t default_brightness, uint8_t low_brightness) {
@@ -2,6 +2,7 @@
 #define _CIRCULAR_STRIP_H_
 
 #include "led.h"
+#include "strip_animation.h"
 #include <driver/gpio.h>
 #include <led_strip.h>
 #include <esp_timer.h>
@@ -12,10 +13,6 @@
 #define DEFAULT_BRIGHTNESS 32
 #define LOW_BRIGHTNESS 4
 
-struct StripColor {
-    uint8_t red = 0, green = 0, blue = 0;
-};
-
 class CircularStrip : public Led {
 public:
     CircularStrip(gpio_num_t gpio, uint16_t max_leds);
@@ -29,24 +26,28 @@ public:
     void Blink(StripColor color, int interval_ms);
     void Breathe(StripColor low, StripColor high, int interval_ms);
     void Scroll(StripColor low, StripColor high, int length, int interval_ms);
+    // Plays precomputed frames, e.g. a StripAnimation::Mix() of several effects
+    void Play(StripAnimation&& animation);
+    int max_leds() const { return max_leds_; }
 
 private:
     std::mutex mutex_;
-    TaskHandle_t blink_task_ = nullptr;
     led_strip_handle_t led_strip_ = nullptr;
     int max_leds_ = 0;
+    // What the strip shows, where a fade out starts from
     std::vector<StripColor> colors_;
-    int blink_counter_ = 0;
-    int blink_interval_ms_ = 0;
+    // One shot timer, rearmed with the hold of each frame
     esp_timer_handle_t strip_timer_ = nullptr;
-    std::function<void()> strip_callback_ = nullptr;
+    StripAnimation animation_;
+    size_t frame_index_ = 0;
 
     uint8_t default_brightness_ = DEFAULT_BRIGHTNESS;
     uint8_t low_brightness_ = LOW_BRIGHTNESS;
 
-    void StartStripTask(int interval_ms, std::function<void()> cb);
-    void Rainbow(StripColor low, StripColor high, int interval_ms);
     void FadeOut(int interval_ms);
+    // Called with mutex_ held
+    void ShowColors(const StripColor* colors);
+    void ShowFrame();
 };
 
 #endif // _CIRCULAR_STRIP_H_
@@ -1,6 +1,7 @@
 #include "gpio_led.h"
 #include "application.h"
 #include "device_state.h"
+#include "task_manifest.h"
 #include <esp_log.h>
 
 #define TAG "GpioLed"
@@ -82,8 +83,7 @@ GpioLed::GpioLed(gpio_num_t gpio, int output_invert, ledc_timer_t timer_num, led
     };
     ESP_ERROR_CHECK(esp_timer_create(&blink_timer_args, &blink_timer_));
 
-    xTaskCreate(EventTask, "LedEvent", 2048, this, 
-            tskIDLE_PRIORITY + 2, &event_task_handle_);
+    TaskManifest::Create("LedEvent", EventTask, this, &event_task_handle_);
 
     ledc_initialized_ = true;
 }
@@ -0,0 +1,159 @@
+#include "strip_animation.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <set>
+
+// Long breathes take bigger steps, so an animation never needs more frames than this
+#define STRIP_ANIMATION_MAX_BREATHE_FRAMES 64
+// Longest mix of two looping animations with unrelated lengths
+#define STRIP_ANIMATION_MAX_MIX_MS 10000
+
+int StripAnimation::duration_ms() const {
+    return std::accumulate(hold_ms_.begin(), hold_ms_.end(), 0);
+}
+
+void StripAnimation::AddFrame(const StripColor* pixels, int hold_ms) {
+    if (!hold_ms_.empty() && std::equal(pixels, pixels + leds_, pixels_.end() - leds_)) {
+        hold_ms_.back() += hold_ms;
+        return;
+    }
+    pixels_.insert(pixels_.end(), pixels, pixels + leds_);
+    hold_ms_.push_back(hold_ms);
+}
+
+const StripColor* StripAnimation::FrameAt(int time_ms) const {
+    int duration = duration_ms();
+    if (duration <= 0) {
+        return nullptr;
+    }
+    if (loop_) {
+        time_ms %= duration;
+    } else if (time_ms >= duration) {
+        return frame(frame_count() - 1);
+    }
+    for (size_t i = 0; i < frame_count(); i++) {
+        if (time_ms < hold_ms_[i]) {
+            return frame(i);
+        }
+        time_ms -= hold_ms_[i];
+    }
+    return frame(frame_count() - 1);
+}
+
+StripAnimation StripAnimation::Solid(int leds, StripColor color) {
+    StripAnimation animation(leds);
+    std::vector<StripColor> pixels(leds, color);
+    animation.AddFrame(pixels.data(), 1000);
+    return animation;
+}
+
+StripAnimation StripAnimation::Blink(int leds, StripColor color, int interval_ms) {
+    StripAnimation animation(leds);
+    std::vector<StripColor> pixels(leds, color);
+    animation.AddFrame(pixels.data(), interval_ms);
+    std::fill(pixels.begin(), pixels.end(), StripColor{});
+    animation.AddFrame(pixels.data(), interval_ms);
+    return animation;
+}
+
+StripAnimation StripAnimation::Breathe(int leds, StripColor low, StripColor high, int interval_ms) {
+    StripAnimation animation(leds);
+    int delta = std::max({std::abs(high.red - low.red), std::abs(high.green - low.green), std::abs(high.blue - low.blue), 1});
+    int step = (delta + STRIP_ANIMATION_MAX_BREATHE_FRAMES / 2 - 1) / (STRIP_ANIMATION_MAX_BREATHE_FRAMES / 2);
+    auto approach = [step](uint8_t value, uint8_t target) -> uint8_t {
+        if (value < target) {
+            return std::min<int>(value + step, target);
+        }
+        return std::max<int>(value - step, target);
+    };
+
+    std::vector<StripColor> pixels(leds);
+    StripColor color = low;
+    for (const StripColor* target : {&high, &low}) {
+        while (!(color == *target)) {
+            color.red = approach(color.red, target->red);
+            color.green = approach(color.green, target->green);
+            color.blue = approach(color.blue, target->blue);
+            std::fill(pixels.begin(), pixels.end(), color);
+            animation.AddFrame(pixels.data(), interval_ms * step);
+        }
+    }
+    if (animation.frame_count() == 0) {
+        return Solid(leds, low);
+    }
+    return animation;
+}
+
+StripAnimation StripAnimation::Scroll(int leds, StripColor low, StripColor high, int length, int interval_ms) {
+    StripAnimation animation(leds);
+    std::vector<StripColor> pixels(leds);
+    for (int offset = 0; offset < leds; offset++) {
+        std::fill(pixels.begin(), pixels.end(), low);
+        for (int j = 0; j < length; j++) {
+            pixels[(offset + j) % leds] = high;
+        }
+        animation.AddFrame(pixels.data(), interval_ms);
+    }
+    return animation;
+}
+
+StripAnimation StripAnimation::FadeOut(const std::vector<StripColor>& from, int interval_ms) {
+    StripAnimation animation(from.size());
+    animation.set_loop(false);
+    std::vector<StripColor> pixels = from;
+    bool all_off = false;
+    while (!all_off) {
+        all_off = true;
+        for (auto& pixel : pixels) {
+            pixel.red /= 2;
+            pixel.green /= 2;
+            pixel.blue /= 2;
+            if (pixel.red != 0 || pixel.green != 0 || pixel.blue != 0) {
+                all_off = false;
+            }
+        }
+        animation.AddFrame(pixels.data(), interval_ms);
+    }
+    return animation;
+}
+
+StripAnimation StripAnimation::Mix(const StripAnimation& a, const StripAnimation& b) {
+    StripAnimation animation(std::min(a.leds(), b.leds()));
+    animation.set_loop(a.loop() || b.loop());
+    int duration = std::max(a.duration_ms(), b.duration_ms());
+    if (a.loop() && b.loop()) {
+        duration = std::min(std::lcm(a.duration_ms(), b.duration_ms()), STRIP_ANIMATION_MAX_MIX_MS);
+    }
+    if (duration <= 0) {
+        return animation;
+    }
+
+    // Every time either animation changes frame within the mixed duration
+    std::set<int> changes = {0, duration};
+    for (const StripAnimation* source : {&a, &b}) {
+        int time = 0;
+        do {
+            for (size_t i = 0; i < source->frame_count() && time < duration; i++) {
+                time += source->hold_ms(i);
+                changes.insert(std::min(time, duration));
+            }
+        } while (source->loop() && time < duration && source->duration_ms() > 0);
+    }
+
+    std::vector<StripColor> pixels(animation.leds());
+    for (auto it = changes.begin(); std::next(it) != changes.end(); ++it) {
+        const StripColor* frame_a = a.FrameAt(*it);
+        const StripColor* frame_b = b.FrameAt(*it);
+        for (int i = 0; i < animation.leds(); i++) {
+            StripColor pa = frame_a != nullptr ? frame_a[i] : StripColor{};
+            StripColor pb = frame_b != nullptr ? frame_b[i] : StripColor{};
+            pixels[i].red = std::min(pa.red + pb.red, 255);
+            pixels[i].green = std::min(pa.green + pb.green, 255);
+            pixels[i].blue = std::min(pa.blue + pb.blue, 255);
+        }
+        animation.AddFrame(pixels.data(), *std::next(it) - *it);
+    }
+    return animation;
+}
@@ -0,0 +1,55 @@
+#ifndef _STRIP_ANIMATION_H_
+#define _STRIP_ANIMATION_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct StripColor {
+    uint8_t red = 0, green = 0, blue = 0;
+
+    bool operator==(const StripColor& other) const {
+        return red == other.red && green == other.green && blue == other.blue;
+    }
+};
+
+/*
+ * The frames of a strip animation, computed once when the animation is selected. A run of
+ * identical frames is stored as one frame with a longer hold, so the player only wakes up
+ * when the LEDs actually change and a static color costs no timer at all.
+ */
+class StripAnimation {
+public:
+    explicit StripAnimation(int leds = 0) : leds_(leds) {}
+
+    static StripAnimation Solid(int leds, StripColor color);
+    static StripAnimation Blink(int leds, StripColor color, int interval_ms);
+    // From low to high and back by one step per component every interval_ms
+    static StripAnimation Breathe(int leds, StripColor low, StripColor high, int interval_ms);
+    static StripAnimation Scroll(int leds, StripColor low, StripColor high, int length, int interval_ms);
+    // Halves the colors every interval_ms until they are off, plays once
+    static StripAnimation FadeOut(const std::vector<StripColor>& from, int interval_ms);
+    // Saturating sum of both over time, loops when either does
+    static StripAnimation Mix(const StripAnimation& a, const StripAnimation& b);
+
+    void AddFrame(const StripColor* pixels, int hold_ms);
+
+    int leds() const { return leds_; }
+    size_t frame_count() const { return hold_ms_.size(); }
+    const StripColor* frame(size_t index) const { return &pixels_[index * leds_]; }
+    int hold_ms(size_t index) const { return hold_ms_[index]; }
+    bool loop() const { return loop_; }
+    void set_loop(bool loop) { loop_ = loop; }
+    int duration_ms() const;
+
+private:
+    int leds_;
+    bool loop_ = true;
+    std::vector<StripColor> pixels_;
+    std::vector<int> hold_ms_;
+
+    // The frame shown time_ms after the start, repeating or holding the last one past the end
+    const StripColor* FrameAt(int time_ms) const;
+};
+
+#endif // _STRIP_ANIMATION_H_
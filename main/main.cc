@@ -9,11 +9,18 @@
 
 #include "application.h"
 #include "system_info.h"
+#include "boot_profile.h"
+#include "cjson_arena.h"
 
 #define TAG "main"
 
 extern "C" void app_main(void)
 {
+    BootProfile::Mark("app_main");
+
+    // Lets the protocols parse incoming messages into a per-message arena
+    CjsonArenaScope::InstallHooks();
+
     // Initialize NVS flash for WiFi configuration
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -9,18 +9,53 @@
 #include <algorithm>
 #include <cstring>
 #include <esp_pthread.h>
+#include <esp_timer.h>
+#include <memory>
 
 #include "application.h"
 #include "display.h"
 #include "oled_display.h"
 #include "board.h"
 #include "settings.h"
+#include "system_info.h"
+#include "boot_profile.h"
+#include "telemetry.h"
+#include "memory_budget.h"
+#include "power_governor.h"
+#include "task_manifest.h"
+#include "http_pool.h"
 #include "lvgl_theme.h"
 #include "lvgl_display.h"
+#if CONFIG_DISPLAY_BENCHMARK
+#include "display_benchmark.h"
+#endif
+#if CONFIG_CORE_BENCHMARK
+#include "core_benchmark.h"
+#endif
+#if CONFIG_SOAK_TEST
+#include "soak_test.h"
+#endif
 #include "wifi_manager.h"
+#if CONFIG_XIAOZHI_CAMERA_WATCH
+#include "camera_watcher.h"
+#endif
+#if CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+#include "video_channel.h"
+#endif
+#if CONFIG_XIAOZHI_CAMERA_VIEWFINDER
+#include "camera_viewfinder.h"
+#endif
 
 #define TAG "MCP"
 
+#define MCP_WORKER_COUNT 2
+#define MCP_WORKER_QUEUE_SIZE 4
+#define MCP_TOOL_CALL_TIMEOUT_MS 30000
+
+struct VolumeArgs {
+    int volume;
+};
+
 McpServer::McpServer() {
 }
 
@@ -29,6 +64,7 @@ McpServer::~McpServer() {
         delete tool;
     }
     tools_.clear();
+    tool_index_.clear();
 }
 
 void McpServer::AddCommonTools() {
@@ -51,16 +87,14 @@ void McpServer::AddCommonTools() {
         PropertyList(),
         [&board](const PropertyList& properties) -> ReturnValue {
             return board.GetDeviceStatusJson();
-        });
+        }, MCP_GETTER_CACHE_TTL_MS);
 
     AddTool("self.audio_speaker.set_volume", 
         "Set the volume of the audio speaker. If the current volume is unknown, you must call `self.get_device_status` tool first and then call this tool.",
-        PropertyList({
-            Property("volume", kPropertyTypeInteger, 0, 100)
-        }), 
-        [&board](const PropertyList& properties) -> ReturnValue {
+        ToolSignature(ToolArgument("volume", &VolumeArgs::volume, 0, 100)),
+        [&board](const VolumeArgs& args) -> ReturnValue {
             auto codec = board.GetAudioCodec();
-            codec->SetOutputVolume(properties["volume"].value<int>());
+            codec->SetOutputVolume(args.volume);
             return true;
         });
     
@@ -91,7 +125,9 @@ void McpServer::AddCommonTools() {
                 auto& theme_manager = LvglThemeManager::GetInstance();
                 auto theme = theme_manager.GetTheme(theme_name);
                 if (theme != nullptr) {
-                    display->SetTheme(theme);
+                    display->Post([display, theme]() {
+                        display->SetTheme(theme);
+                    });
                     return true;
                 }
                 return false;
@@ -100,25 +136,182 @@ void McpServer::AddCommonTools() {
 
     auto camera = board.GetCamera();
     if (camera) {
-        AddTool("self.camera.take_photo",
+        /* Capture, encode and upload take seconds, keep them off the main task */
+        auto take_photo = new McpTool("self.camera.take_photo",
             "Always remember you have a camera. If the user asks you to see something, use this tool to take a photo and then explain it.\n"
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
+            "  `quality`, `scale`: Leave them at 0, the photo is sized for the network. Set `quality` (1-100) or "
+            "`scale` (1, 2 or 4) only when the user needs fine detail or a quick answer.\n"
             "Return:\n"
             "  A JSON object that provides the photo information.",
             PropertyList({
-                Property("question", kPropertyTypeString)
+                Property("question", kPropertyTypeString),
+                Property("quality", kPropertyTypeInteger, 0, 0, 100),
+                Property("scale", kPropertyTypeInteger, 0, 0, 4)
             }),
             [camera](const PropertyList& properties) -> ReturnValue {
+                auto quality = properties["quality"].value<int>();
+                auto scale = properties["scale"].value<int>();
+                if (scale == 3) {
+                    throw std::invalid_argument("scale must be 1, 2 or 4");
+                }
                 // Lower the priority to do the camera capture
                 TaskPriorityReset priority_reset(1);
+#if CONFIG_XIAOZHI_CAMERA_VIEWFINDER
+                // The photo is what the viewfinder showed, its preview replaces the live view
+                CameraViewfinder::GetInstance().Stop();
+#endif
+#if CONFIG_XIAOZHI_CAMERA_WATCH
+                CameraWatcher::Suspension watch_suspension;
+#endif
 
                 if (!camera->Capture()) {
                     throw std::runtime_error("Failed to capture photo");
                 }
                 auto question = properties["question"].value<std::string>();
+                camera->SetExplainOverride(quality, scale);
                 return camera->Explain(question);
             });
+        take_photo->set_main_thread(false);
+        AddTool(take_photo);
+
+        if (camera->SupportsBurst()) {
+            auto take_burst = new McpTool("self.camera.take_photo_burst",
+                "Take several photos in a row and explain them together. Use it when the user asks about motion or "
+                "what changes, instead of calling take_photo several times.\n"
+                "Args:\n"
+                "  `question`: The question that you want to ask about the photos.\n"
+                "  `count`: The number of photos.\n"
+                "  `interval_ms`: The time between two photos.\n"
+                "Return:\n"
+                "  A JSON object that provides the photo information.",
+                PropertyList({
+                    Property("question", kPropertyTypeString),
+                    Property("count", kPropertyTypeInteger, 3, 2, CONFIG_XIAOZHI_CAMERA_BURST_MAX_FRAMES),
+                    Property("interval_ms", kPropertyTypeInteger, 500, 100, 5000)
+                }),
+                [camera](const PropertyList& properties) -> ReturnValue {
+                    TaskPriorityReset priority_reset(1);
+#if CONFIG_XIAOZHI_CAMERA_VIEWFINDER
+                    CameraViewfinder::GetInstance().Stop();
+#endif
+#if CONFIG_XIAOZHI_CAMERA_WATCH
+                    CameraWatcher::Suspension watch_suspension;
+#endif
+                    auto question = properties["question"].value<std::string>();
+                    return camera->ExplainBurst(question, properties["count"].value<int>(),
+                        properties["interval_ms"].value<int>());
+                });
+            take_burst->set_main_thread(false);
+            AddTool(take_burst);
+        }
+
+#if CONFIG_XIAOZHI_CAMERA_WATCH
+        AddTool("self.camera.start_watch",
+            "Keep watching with the camera on the device. A `notifications/camera_event` is sent to you only when "
+            "something moves, then take a photo to see what it is. It pauses while a photo is taken.\n"
+            "Args:\n"
+            "  `sensitivity`: 1 to 100, higher reports smaller changes.\n"
+            "  `cooldown_s`: The least time between two events.",
+            PropertyList({
+                Property("sensitivity", kPropertyTypeInteger, 50, 1, 100),
+                Property("cooldown_s", kPropertyTypeInteger, 10, 1, 600)
+            }),
+            [camera](const PropertyList& properties) -> ReturnValue {
+#if CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+                VideoChannel::GetInstance().Stop();
+#endif
+#if CONFIG_XIAOZHI_CAMERA_VIEWFINDER
+                CameraViewfinder::GetInstance().Stop();
+#endif
+                if (!CameraWatcher::GetInstance().Start(camera, properties["sensitivity"].value<int>(),
+                        properties["cooldown_s"].value<int>() * 1000)) {
+                    throw std::runtime_error("The camera cannot be watched");
+                }
+                return true;
+            });
+
+        AddTool("self.camera.stop_watch",
+            "Stop watching with the camera.",
+            PropertyList(),
+            [](const PropertyList& properties) -> ReturnValue {
+                CameraWatcher::GetInstance().Stop();
+                return true;
+            });
+#endif
+
+#if CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+        AddTool("self.camera.start_video_stream",
+            "Stream live video from the camera to a websocket URL, hardware encoded. Use it when the user wants "
+            "to show you something that moves or changes. A stream that is running is replaced.\n"
+            "Args:\n"
+            "  `url`: The websocket URL that receives the frames.\n"
+            "  `codec`: `h264` or `jpeg`, H.264 falls back to JPEG if the sensor cannot feed it.",
+            PropertyList({
+                Property("url", kPropertyTypeString),
+                Property("codec", kPropertyTypeString, std::string("h264")),
+                Property("fps", kPropertyTypeInteger, CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM_FPS, 1, 30),
+                Property("bitrate_kbps", kPropertyTypeInteger, CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM_BITRATE_KBPS, 100, 8000)
+            }),
+            [camera](const PropertyList& properties) -> ReturnValue {
+                VideoStreamConfig config;
+                config.codec = properties["codec"].value<std::string>() == "jpeg" ? kVideoCodecJpeg : kVideoCodecH264;
+                config.fps = properties["fps"].value<int>();
+                config.bitrate_kbps = properties["bitrate_kbps"].value<int>();
+                config.keyframe_interval = config.fps * 2;
+                auto url = properties["url"].value<std::string>();
+#if CONFIG_XIAOZHI_CAMERA_WATCH
+                // The video stream takes the camera, the watch ends
+                CameraWatcher::GetInstance().Stop();
+#endif
+#if CONFIG_XIAOZHI_CAMERA_VIEWFINDER
+                CameraViewfinder::GetInstance().Stop();
+#endif
+                if (!VideoChannel::GetInstance().Start(camera, url, config)) {
+                    throw std::runtime_error("Failed to start the video stream");
+                }
+                return true;
+            });
+
+        AddTool("self.camera.stop_video_stream",
+            "Stop the live video stream of the camera.",
+            PropertyList(),
+            [](const PropertyList& properties) -> ReturnValue {
+                VideoChannel::GetInstance().Stop();
+                return true;
+            });
+#endif
+
+#if CONFIG_XIAOZHI_CAMERA_VIEWFINDER
+        auto lvgl_display = dynamic_cast<LvglDisplay*>(board.GetDisplay());
+        if (lvgl_display != nullptr && lvgl_display->HasViewfinder()) {
+            AddTool("self.camera.start_viewfinder",
+                "Show what the camera sees live on the screen, e.g. so the user can aim it before a photo. "
+                "Taking a photo ends it.",
+                PropertyList(),
+                [camera, lvgl_display](const PropertyList& properties) -> ReturnValue {
+#if CONFIG_XIAOZHI_CAMERA_VIDEO_STREAM
+                    VideoChannel::GetInstance().Stop();
+#endif
+#if CONFIG_XIAOZHI_CAMERA_WATCH
+                    CameraWatcher::GetInstance().Stop();
+#endif
+                    if (!CameraViewfinder::GetInstance().Start(camera, lvgl_display, CONFIG_XIAOZHI_CAMERA_VIEWFINDER_FPS)) {
+                        throw std::runtime_error("The camera cannot be shown on the screen");
+                    }
+                    return true;
+                });
+
+            AddTool("self.camera.stop_viewfinder",
+                "Stop showing the camera on the screen.",
+                PropertyList(),
+                [](const PropertyList& properties) -> ReturnValue {
+                    CameraViewfinder::GetInstance().Stop();
+                    return true;
+                });
+        }
+#endif
     }
 #endif
 
@@ -142,7 +335,7 @@ void McpServer::AddCommonTools() {
             cJSON_AddNumberToObject(json, "channel", wifi.GetChannel());
 
             return json;
-        });
+        }, MCP_GETTER_CACHE_TTL_MS);
 
     AddTool("self.network.get_ip",
         "Get the device's IP address.",
@@ -188,7 +381,7 @@ void McpServer::AddCommonTools() {
             }
 
             return std::string("{\"error\":\"Battery information not available\"}");
-        });
+        }, MCP_GETTER_CACHE_TTL_MS);
 
     // Restore the original tools list to the end of the tools list
     tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
@@ -204,6 +397,72 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.power.get_stats",
+        "Time spent in each power state (milliseconds), the idle time and every PM lock with how long it was held.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return PowerGovernor::GetInstance().GetStatsJson();
+        });
+
+    AddUserOnlyTool("self.get_runtime_stats",
+        "Heap usage and the cumulative run time counters of every task. The CPU share of a task over a period "
+        "is the difference of its `run_time` between two calls divided by the difference of the total `run_time` "
+        "times `cores`.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return SystemInfo::GetRuntimeStatsJson();
+        });
+
+    AddUserOnlyTool("self.get_mcp_stats",
+        "Call counts of the MCP tools called since boot, with histograms in microseconds of the argument parsing, "
+        "the wait before the tool runs and its execution. `counts[i]` is the number of calls below "
+        "`bucket_bounds_us[i]`, the last count is everything above.",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return GetStatsJson();
+        });
+
+    AddUserOnlyTool("self.get_boot_profile",
+        "Time in milliseconds since power on at which each cold boot checkpoint was first reached, in the order "
+        "they were reached, e.g. `board_create` to `board` is the board constructor.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return BootProfile::GetJson();
+        });
+
+    AddUserOnlyTool("self.get_memory_budget",
+        "The heaps (internal, DMA, PSRAM) with their free bytes and largest free block, and every cache that "
+        "competes for them with its budget, bytes used and how much was evicted under memory pressure.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return MemoryBudget::GetInstance().GetJson();
+        });
+
+#if CONFIG_TELEMETRY
+    AddUserOnlyTool("self.get_telemetry",
+        "Performance samples of the recent minutes: free heap and largest free block (bytes) of internal, DMA "
+        "and PSRAM memory, CPU load per core (per mille), Wi-Fi RSSI (0 when not on Wi-Fi), audio queue depths "
+        "and the display frames with their average render and flush wait (microseconds) per interval. "
+        "`fields` holds [min, average, max, last] of each, `series` the samples if requested.",
+        PropertyList({
+            Property("series", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            return Telemetry::GetInstance().GetJson(properties["series"].value<bool>());
+        });
+#endif
+
+#if CONFIG_SOAK_TEST
+    AddUserOnlyTool("self.soak.get_report",
+        "Report of the soak test: cycles run and failed, samples of the free heap and largest free block (bytes) "
+        "per capability, the lowest task stack high water mark and the cycle time percentiles, and the trend of "
+        "each field as its least squares slope per 1000 cycles.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return SoakTest::GetInstance().GetReportJson();
+        });
+#endif
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
@@ -255,18 +514,64 @@ void McpServer::AddUserOnlyTools() {
                 return json;
             });
 
+#if CONFIG_DISPLAY_FRAME_TRACE
+        AddUserOnlyTool("self.screen.get_frame_stats",
+            "Average and maximum LVGL render time and flush wait (microseconds) per frame since the last clear.",
+            PropertyList({
+                Property("clear", kPropertyTypeBoolean, false)
+            }),
+            [display](const PropertyList& properties) -> ReturnValue {
+                return display->GetFrameStatsJson(properties["clear"].value<bool>());
+            });
+#endif
+
+#if CONFIG_DISPLAY_BENCHMARK
+        AddUserOnlyTool("self.screen.run_benchmark",
+            "Run the display benchmark while the device is idle. Each phase runs for `phase_ms` and reports "
+            "fps, render and flush wait time (microseconds) and the heap peak (bytes) as JSON.",
+            PropertyList({
+                Property("phase_ms", kPropertyTypeInteger, 3000, 500, 20000)
+            }),
+            [display](const PropertyList& properties) -> ReturnValue {
+                if (Application::GetInstance().GetDeviceState() != kDeviceStateIdle) {
+                    throw std::runtime_error("The benchmark only runs while the device is idle");
+                }
+                DisplayBenchmark benchmark(display);
+                return benchmark.Run(properties["phase_ms"].value<int>());
+            });
+#endif
+
 #if CONFIG_LV_USE_SNAPSHOT
-        AddUserOnlyTool("self.screen.snapshot", "Snapshot the screen and upload it to a specific URL",
+        AddUserOnlyTool("self.screen.snapshot", "Snapshot the screen and upload it to a specific URL.\n"
+            "`scale` reduces the size by 1, 2 or 4. A `width` and `height` above zero snapshot only the area at `x`, `y`.",
             PropertyList({
                 Property("url", kPropertyTypeString),
-                Property("quality", kPropertyTypeInteger, 80, 1, 100)
+                Property("quality", kPropertyTypeInteger, 80, 1, 100),
+                Property("scale", kPropertyTypeInteger, 1, 1, 4),
+                Property("x", kPropertyTypeInteger, 0, 0, 4096),
+                Property("y", kPropertyTypeInteger, 0, 0, 4096),
+                Property("width", kPropertyTypeInteger, 0, 0, 4096),
+                Property("height", kPropertyTypeInteger, 0, 0, 4096)
             }),
             [display](const PropertyList& properties) -> ReturnValue {
                 auto url = properties["url"].value<std::string>();
                 auto quality = properties["quality"].value<int>();
+                auto scale = properties["scale"].value<int>();
+                if (scale == 3) {
+                    throw std::invalid_argument("scale must be 1, 2 or 4");
+                }
+                lv_area_t area;
+                auto width = properties["width"].value<int>();
+                auto height = properties["height"].value<int>();
+                if (width > 0 && height > 0) {
+                    area.x1 = properties["x"].value<int>();
+                    area.y1 = properties["y"].value<int>();
+                    area.x2 = area.x1 + width - 1;
+                    area.y2 = area.y1 + height - 1;
+                }
 
                 std::string jpeg_data;
-                if (!display->SnapshotToJpeg(jpeg_data, quality)) {
+                if (!display->SnapshotToJpeg(jpeg_data, quality, scale, width > 0 && height > 0 ? &area : nullptr)) {
                     throw std::runtime_error("Failed to snapshot screen");
                 }
 
@@ -275,7 +580,7 @@ void McpServer::AddUserOnlyTools() {
                 // 构造multipart/form-data请求体
                 std::string boundary = "----ESP32_SCREEN_SNAPSHOT_BOUNDARY";
                 
-                auto http = Board::GetInstance().GetNetwork()->CreateHttp(3);
+                auto http = HttpPool::GetInstance().CreateHttp(3);
                 http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
                 if (!http->Open("POST", url)) {
                     throw std::runtime_error("Failed to open URL: " + url);
@@ -316,7 +621,7 @@ void McpServer::AddUserOnlyTools() {
             }),
             [display](const PropertyList& properties) -> ReturnValue {
                 auto url = properties["url"].value<std::string>();
-                auto http = Board::GetInstance().GetNetwork()->CreateHttp(3);
+                auto http = HttpPool::GetInstance().CreateStreamingHttp(3);
 
                 if (!http->Open("GET", url)) {
                     throw std::runtime_error("Failed to open URL: " + url);
@@ -345,43 +650,241 @@ void McpServer::AddUserOnlyTools() {
                 }
                 http->Close();
 
-                auto image = std::make_unique<LvglAllocatedImage>(data, content_length);
-                display->SetPreviewImage(std::move(image));
+                // Decoded off this task, the tool returns before the image is shown
+                display->LoadPreviewImage(reinterpret_cast<uint8_t*>(data), total_read);
                 return true;
             });
 #endif // CONFIG_LV_USE_SNAPSHOT
     }
 #endif // HAVE_LVGL
 
+    AddUserOnlyTool("self.audio.set_latency_profile",
+        "Select the audio buffering profile, one of: " + AudioLatencyProfile::Names() + ". low-latency answers "
+        "fastest on a good link, robust rides out a flaky one. The queues, uplink frames and jitter buffer change "
+        "right away, the I2S DMA depth after a reboot. The choice is kept across reboots.",
+        PropertyList({
+            Property("profile", kPropertyTypeString)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto name = properties["profile"].value<std::string>();
+            if (!Application::GetInstance().GetAudioService().SetLatencyProfile(name)) {
+                throw std::runtime_error("Unknown latency profile: " + name);
+            }
+            return true;
+        });
+
+#if CONFIG_AUDIO_STREAM_PLAYER
+    AddTool("self.audio.play_stream",
+        "Play music or a radio station from an Ogg Opus URL. It plays while the device is idle, and pauses while "
+        "you talk with the user. A stream that is playing is replaced.",
+        PropertyList({
+            Property("url", kPropertyTypeString)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto url = properties["url"].value<std::string>();
+            if (!Application::GetInstance().GetAudioService().PlayStream(url)) {
+                throw std::runtime_error("Failed to start the stream");
+            }
+            return true;
+        });
+
+    AddTool("self.audio.stop_stream",
+        "Stop the music or radio stream that is playing.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            Application::GetInstance().GetAudioService().StopStream();
+            return true;
+        });
+
+    AddUserOnlyTool("self.audio.get_stream_status",
+        "State, URL, buffered KB, connection count and underrun count of the music / radio stream.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetAudioService().GetStreamStatusJson();
+        });
+#endif
+
+#if CONFIG_AUDIO_TASK_MONITOR
+    AddUserOnlyTool("self.audio.get_task_stats",
+        "CPU share of one core, peak CPU share and lowest free stack (bytes) of the audio tasks, "
+        "with the I2S input overrun and output underrun counts.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& monitor = Application::GetInstance().GetAudioService().GetTaskMonitor();
+            monitor.Sample();
+            return monitor.GetJson();
+        });
+#endif
+
+#if CONFIG_AEC_DELAY_CALIBRATION
+    if (Board::GetInstance().GetAudioCodec()->input_reference()) {
+        /* Plays and records for about a second, keep it off the main task */
+        auto calibrate_aec = new McpTool("self.audio.calibrate_aec_delay",
+            "Measure how far the echo on the microphones trails the speaker reference by playing a short sweep, "
+            "and store the delay that aligns them for the echo canceller. Run it once in a quiet room while the "
+            "device is idle. Returns whether the echo was found, its lag (ms), the match score and the delay (samples).",
+            PropertyList(),
+            [](const PropertyList& properties) -> ReturnValue {
+                auto& app = Application::GetInstance();
+                if (app.GetDeviceState() != kDeviceStateIdle) {
+                    throw std::runtime_error("The calibration only runs while the device is idle");
+                }
+                return app.GetAudioService().CalibrateAecDelay();
+            });
+        calibrate_aec->set_user_only(true);
+        calibrate_aec->set_main_thread(false);
+        AddTool(calibrate_aec);
+    }
+#endif
+
+#if CONFIG_WAKE_WORD_BENCHMARK
+    /* Feeding the corpus takes seconds, keep it off the main task */
+    auto wake_word_benchmark = new McpTool("self.audio.run_wake_word_benchmark",
+        "Run the wake word benchmark on the labelled clips in the assets while the device is idle. "
+        "`speed` is the multiple of real time, 0 for unthrottled. Stops after `max_seconds`. Returns the detection "
+        "rate, latency (ms), false accepts per hour, CPU share and lowest free heap (bytes) as JSON.",
+        PropertyList({
+            Property("speed", kPropertyTypeInteger, 1, 0, 8),
+            Property("max_seconds", kPropertyTypeInteger, 25, 1, 25)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& app = Application::GetInstance();
+            if (app.GetDeviceState() != kDeviceStateIdle) {
+                throw std::runtime_error("The benchmark only runs while the device is idle");
+            }
+            return app.GetAudioService().RunWakeWordBenchmark(properties["speed"].value<int>(),
+                properties["max_seconds"].value<int>());
+        });
+    wake_word_benchmark->set_user_only(true);
+    wake_word_benchmark->set_main_thread(false);
+    AddTool(wake_word_benchmark);
+#endif
+
+#if CONFIG_AUDIO_LATENCY_BENCHMARK
+    /* A round takes most of a second, keep it off the main task */
+    auto latency_benchmark = new McpTool("self.audio.run_latency_benchmark",
+        "Play a short marker through the speaker `rounds` times while the device is idle and time its echo on the "
+        "microphone. Returns the round trip (us) with its jitter, and the share of the playback queue, the I2S "
+        "output DMA, the acoustic path and the I2S input DMA, as JSON.",
+        PropertyList({
+            Property("rounds", kPropertyTypeInteger, 10, 1, 30)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& app = Application::GetInstance();
+            if (app.GetDeviceState() != kDeviceStateIdle) {
+                throw std::runtime_error("The benchmark only runs while the device is idle");
+            }
+            return app.GetAudioService().RunLatencyBenchmark(properties["rounds"].value<int>());
+        });
+    latency_benchmark->set_user_only(true);
+    latency_benchmark->set_main_thread(false);
+    AddTool(latency_benchmark);
+#endif
+
+#if CONFIG_AUDIO_LATENCY_TRACE
+    AddUserOnlyTool("self.audio.get_latency_stats",
+        "Per-stage audio latency percentiles (microseconds) over the recent frames. `p*_us` is the time since "
+        "the frame entered the pipeline, `step_p*_us` the time since its previous stage.",
+        PropertyList({
+            Property("clear", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& tracer = Application::GetInstance().GetAudioService().GetLatencyTracer();
+            auto json = tracer.GetSummaryJson();
+            if (properties["clear"].value<bool>()) {
+                tracer.Clear();
+            }
+            return json;
+        });
+#endif
+
+#if CONFIG_CORE_BENCHMARK
+    /* Seven cases of `case_ms` each, within the tool call timeout but off the main task */
+    auto core_benchmark = new McpTool("self.run_core_benchmark",
+        "Run the core micro-benchmarks while the device is idle: Opus encode and decode, Ogg demux, queue "
+        "handoff, JSON parse, MCP dispatch and AFSK demodulation. Each case runs for `case_ms` and reports "
+        "the steps, average and maximum time per step (microseconds) and, for audio, the multiple of real time.",
+        PropertyList({
+            Property("case_ms", kPropertyTypeInteger, 1000, 100, 3000)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            if (Application::GetInstance().GetDeviceState() != kDeviceStateIdle) {
+                throw std::runtime_error("The benchmark only runs while the device is idle");
+            }
+            return CoreBenchmark::Run(properties["case_ms"].value<int>());
+        });
+    core_benchmark->set_user_only(true);
+    core_benchmark->set_main_thread(false);
+    AddTool(core_benchmark);
+#endif
+
     // Assets download url
     auto& assets = Assets::GetInstance();
     if (assets.partition_valid()) {
-        AddUserOnlyTool("self.assets.set_download_url", "Set the download url for the assets",
+        AddUserOnlyTool("self.assets.set_download_url",
+            "Download the assets from the url and apply them without a reboot once the device is idle",
             PropertyList({
                 Property("url", kPropertyTypeString)
             }),
             [](const PropertyList& properties) -> ReturnValue {
                 auto url = properties["url"].value<std::string>();
+                // Kept for the next boot in case the device restarts before the update
                 Settings settings("assets", true);
                 settings.SetString("download_url", url);
+                Application::GetInstance().UpdateAssets(url);
                 return true;
             });
+
+        auto languages = assets.GetLanguages();
+        if (!languages.empty()) {
+            std::string codes;
+            for (auto& language : languages) {
+                codes += (codes.empty() ? "" : ", ") + language;
+            }
+            AddUserOnlyTool("self.assets.set_language",
+                "Switch the display language and reboot. Languages in the assets: " + codes,
+                PropertyList({
+                    Property("language", kPropertyTypeString)
+                }),
+                [languages](const PropertyList& properties) -> ReturnValue {
+                    auto language = properties["language"].value<std::string>();
+                    if (std::find(languages.begin(), languages.end(), language) == languages.end()) {
+                        throw std::runtime_error("No string table for language " + language);
+                    }
+                    Settings settings("assets", true);
+                    settings.SetString("language", language);
+                    auto& app = Application::GetInstance();
+                    app.Schedule([&app]() {
+                        ESP_LOGW(TAG, "Rebooting for the language change");
+                        vTaskDelay(pdMS_TO_TICKS(1000));
+                        app.Reboot();
+                    });
+                    return true;
+                });
+        }
     }
 }
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (tool_index_.find(tool->name()) != tool_index_.end()) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
 
     ESP_LOGI(TAG, "Add tool: %s%s", tool->name().c_str(), tool->user_only() ? " [user]" : "");
     tools_.push_back(tool);
+    tool_index_.emplace(tool->name(), tool);
+    for (auto& pages : tools_pages_) {
+        pages.clear();
+    }
 }
 
-void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
-    AddTool(new McpTool(name, description, properties, callback));
+void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+                        int cache_ttl_ms) {
+    auto tool = new McpTool(name, description, properties, callback);
+    tool->set_cache_ttl(cache_ttl_ms);
+    AddTool(tool);
 }
 
 void McpServer::AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
@@ -401,6 +904,10 @@ void McpServer::ParseMessage(const std::string& message) {
 }
 
 void McpServer::ParseCapabilities(const cJSON* capabilities) {
+    if (cJSON_IsTrue(cJSON_GetObjectItem(capabilities, "cbor"))) {
+        Application::GetInstance().SetMcpCbor(true);
+    }
+
     auto vision = cJSON_GetObjectItem(capabilities, "vision");
     if (cJSON_IsObject(vision)) {
         auto url = cJSON_GetObjectItem(vision, "url");
@@ -420,40 +927,64 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
 }
 
 void McpServer::ParseMessage(const cJSON* json) {
+    if (!cJSON_IsArray(json)) {
+        HandleRequest(json, nullptr);
+        return;
+    }
+
+    auto batch = std::make_shared<BatchReply>();
+    cJSON* request;
+    cJSON_ArrayForEach(request, json) {
+        {
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            batch->pending++;
+        }
+        if (!HandleRequest(request, batch)) {
+            FinishBatchRequest(batch);
+        }
+    }
+    // Release the hold taken at creation, the batch is sent once every reply is in
+    FinishBatchRequest(batch);
+}
+
+bool McpServer::HandleRequest(const cJSON* json, const Batch& batch) {
     // Check JSONRPC version
     auto version = cJSON_GetObjectItem(json, "jsonrpc");
     if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
         ESP_LOGE(TAG, "Invalid JSONRPC version: %s", version ? version->valuestring : "null");
-        return;
+        return false;
     }
     
     // Check method
     auto method = cJSON_GetObjectItem(json, "method");
     if (method == nullptr || !cJSON_IsString(method)) {
         ESP_LOGE(TAG, "Missing method");
-        return;
+        return false;
     }
     
     auto method_str = std::string(method->valuestring);
     if (method_str.find("notifications") == 0) {
-        return;
+        return false;
     }
     
     // Check params
     auto params = cJSON_GetObjectItem(json, "params");
     if (params != nullptr && !cJSON_IsObject(params)) {
         ESP_LOGE(TAG, "Invalid params for method: %s", method_str.c_str());
-        return;
+        return false;
     }
 
     auto id = cJSON_GetObjectItem(json, "id");
     if (id == nullptr || !cJSON_IsNumber(id)) {
         ESP_LOGE(TAG, "Invalid id for method: %s", method_str.c_str());
-        return;
+        return false;
     }
     auto id_int = id->valueint;
     
     if (method_str == "initialize") {
+        // A new session starts in JSON and without subscriptions
+        status_notifier_.Reset();
+        Application::GetInstance().SetMcpCbor(false);
         if (cJSON_IsObject(params)) {
             auto capabilities = cJSON_GetObjectItem(params, "capabilities");
             if (cJSON_IsObject(capabilities)) {
@@ -464,7 +995,7 @@ void McpServer::ParseMessage(const cJSON* json) {
         std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
         message += app_desc->version;
         message += "\"}}";
-        ReplyResult(id_int, message);
+        ReplyResult(id_int, message, batch);
     } else if (method_str == "tools/list") {
         std::string cursor_str = "";
         bool list_user_only_tools = false;
@@ -478,68 +1009,141 @@ void McpServer::ParseMessage(const cJSON* json) {
                 list_user_only_tools = with_user_tools->valueint == 1;
             }
         }
-        GetToolsList(id_int, cursor_str, list_user_only_tools);
+        GetToolsList(id_int, cursor_str, list_user_only_tools, batch);
+    } else if (method_str == "device/subscribe") {
+        ReplyResult(id_int, status_notifier_.Subscribe(params), batch);
     } else if (method_str == "tools/call") {
         if (!cJSON_IsObject(params)) {
             ESP_LOGE(TAG, "tools/call: Missing params");
-            ReplyError(id_int, "Missing params");
-            return;
+            ReplyError(id_int, "Missing params", batch);
+            return true;
         }
         auto tool_name = cJSON_GetObjectItem(params, "name");
         if (!cJSON_IsString(tool_name)) {
             ESP_LOGE(TAG, "tools/call: Missing name");
-            ReplyError(id_int, "Missing name");
-            return;
+            ReplyError(id_int, "Missing name", batch);
+            return true;
         }
         auto tool_arguments = cJSON_GetObjectItem(params, "arguments");
         if (tool_arguments != nullptr && !cJSON_IsObject(tool_arguments)) {
             ESP_LOGE(TAG, "tools/call: Invalid arguments");
-            ReplyError(id_int, "Invalid arguments");
-            return;
+            ReplyError(id_int, "Invalid arguments", batch);
+            return true;
         }
-        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments);
+        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, batch);
     } else {
         ESP_LOGE(TAG, "Method not implemented: %s", method_str.c_str());
-        ReplyError(id_int, "Method not implemented: " + method_str);
+        ReplyError(id_int, "Method not implemented: " + method_str, batch);
     }
+    return true;
 }
 
-void McpServer::ReplyResult(int id, const std::string& result) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
+void McpServer::SendReply(std::string payload, const Batch& batch) {
+    if (batch == nullptr) {
+        Application::GetInstance().SendMcpMessage(std::move(payload));
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->replies += batch->replies.empty() ? "[" : ",";
+        batch->replies += payload;
+    }
+    FinishBatchRequest(batch);
+}
+
+void McpServer::FinishBatchRequest(const Batch& batch) {
+    std::string replies;
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        if (--batch->pending > 0) {
+            return;
+        }
+        replies = std::move(batch->replies);
+    }
+    // A batch of notifications only gets no reply at all
+    if (!replies.empty()) {
+        replies += "]";
+        Application::GetInstance().SendMcpMessage(std::move(replies));
+    }
+}
+
+void McpServer::ReplyResult(int id, const std::string& result, const Batch& batch) {
+    std::string payload;
+    payload.reserve(result.size() + 48);
+    payload = "{\"jsonrpc\":\"2.0\",\"id\":";
     payload += std::to_string(id) + ",\"result\":";
     payload += result;
     payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+    SendReply(std::move(payload), batch);
 }
 
-void McpServer::ReplyError(int id, const std::string& message) {
+void McpServer::ReplyError(int id, const std::string& message, const Batch& batch) {
     std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
     payload += std::to_string(id);
     payload += ",\"error\":{\"message\":\"";
     payload += message;
     payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+    SendReply(std::move(payload), batch);
 }
 
-void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools) {
+void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools, const Batch& batch) {
+    auto& pages = tools_pages_[list_user_only_tools ? 1 : 0];
+    if (pages.empty()) {
+        BuildToolsPages(list_user_only_tools);
+    }
+    for (const auto& page : pages) {
+        if (page.cursor == cursor) {
+            ReplyResult(id, page.json, batch);
+            return;
+        }
+    }
+
+    // A cursor that does not start a cached page, or a page that failed to build
+    std::string json;
+    std::string next_cursor;
+    if (!BuildToolsPage(cursor, list_user_only_tools, json, next_cursor)) {
+        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
+        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit", batch);
+        return;
+    }
+    ReplyResult(id, json, batch);
+}
+
+/*
+ * The tools do not change after registration, so every page is serialized once and tools/list
+ * becomes a lookup of the cursor and a single send.
+ */
+void McpServer::BuildToolsPages(bool list_user_only_tools) {
+    auto& pages = tools_pages_[list_user_only_tools ? 1 : 0];
+    std::string cursor;
+    while (true) {
+        ToolsPage page;
+        std::string next_cursor;
+        page.cursor = cursor;
+        if (!BuildToolsPage(cursor, list_user_only_tools, page.json, next_cursor)) {
+            break;
+        }
+        pages.push_back(std::move(page));
+        if (next_cursor.empty()) {
+            break;
+        }
+        cursor = std::move(next_cursor);
+    }
+    ESP_LOGI(TAG, "tools/list: %u pages cached%s", (unsigned)pages.size(), list_user_only_tools ? " [user]" : "");
+}
+
+bool McpServer::BuildToolsPage(const std::string& cursor, bool list_user_only_tools, std::string& json, std::string& next_cursor) {
     const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
+    json = "{\"tools\":[";
+    next_cursor.clear();
+
     auto it = tools_.begin();
-    std::string next_cursor = "";
+    if (!cursor.empty()) {
+        auto index = tool_index_.find(cursor);
+        it = index == tool_index_.end() ? tools_.end() : std::find(tools_.begin(), tools_.end(), index->second);
+    }
     
     while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
-            }
-        }
-
         if (!list_user_only_tools && (*it)->user_only()) {
             ++it;
             continue;
@@ -563,9 +1167,7 @@ void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_o
     
     if (json.back() == '[' && !tools_.empty()) {
         // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
-        return;
+        return false;
     }
 
     if (next_cursor.empty()) {
@@ -573,60 +1175,259 @@ void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_o
     } else {
         json += "],\"nextCursor\":\"" + next_cursor + "\"}";
     }
-    
-    ReplyResult(id, json);
+    return true;
 }
 
-void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, const Batch& batch) {
+    int64_t start_us = esp_timer_get_time();
+    auto tool_iter = tool_index_.find(tool_name);
+    if (tool_iter == tool_index_.end()) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
-        ReplyError(id, "Unknown tool: " + tool_name);
+        ReplyError(id, "Unknown tool: " + tool_name, batch);
         return;
     }
+    McpTool* tool = tool_iter->second;
 
-    PropertyList arguments = (*tool_iter)->properties();
+    PropertyList arguments;
+    McpTool::BoundCall bound_call;
     try {
-        for (auto& argument : arguments) {
-            bool found = false;
-            if (cJSON_IsObject(tool_arguments)) {
-                auto value = cJSON_GetObjectItem(tool_arguments, argument.name().c_str());
-                if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
-                    argument.set_value<bool>(value->valueint == 1);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
-                    argument.set_value<int>(value->valueint);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
-                    argument.set_value<std::string>(value->valuestring);
-                    found = true;
+        if (tool->typed()) {
+            /* Typed tools bind straight into their arguments struct, no PropertyList copies */
+            bound_call = tool->Bind(tool_arguments);
+        } else {
+            arguments = tool->properties();
+            for (auto& argument : arguments) {
+                bool found = false;
+                if (cJSON_IsObject(tool_arguments)) {
+                    auto value = cJSON_GetObjectItem(tool_arguments, argument.name().c_str());
+                    if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
+                        argument.set_value<bool>(value->valueint == 1);
+                        found = true;
+                    } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
+                        argument.set_value<int>(value->valueint);
+                        found = true;
+                    } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
+                        argument.set_value<std::string>(value->valuestring);
+                        found = true;
+                    }
                 }
-            }
 
-            if (!argument.has_default_value() && !found) {
-                ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", argument.name().c_str());
-                ReplyError(id, "Missing valid argument: " + argument.name());
-                return;
+                if (!argument.has_default_value() && !found) {
+                    ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", argument.name().c_str());
+                    RecordCall(tool, esp_timer_get_time() - start_us, 0, 0, 0, true);
+                    ReplyError(id, "Missing valid argument: " + argument.name(), batch);
+                    return;
+                }
             }
         }
     } catch (const std::exception& e) {
         ESP_LOGE(TAG, "tools/call: %s", e.what());
-        ReplyError(id, e.what());
+        RecordCall(tool, esp_timer_get_time() - start_us, 0, 0, 0, true);
+        ReplyError(id, e.what(), batch);
+        return;
+    }
+    int64_t parsed_us = esp_timer_get_time();
+    int64_t parse_us = parsed_us - start_us;
+
+    // The LLM asks the same getters several times in a turn
+    std::string cache_key;
+    uint32_t cache_generation = 0;
+    if (tool->cache_ttl_ms() > 0) {
+        if (cJSON_IsObject(tool_arguments) && tool_arguments->child != nullptr) {
+            char* key = cJSON_PrintUnformatted(tool_arguments);
+            cache_key = key;
+            cJSON_free(key);
+        }
+        std::string cached;
+        if (FindCachedResult(tool, cache_key, cached, cache_generation)) {
+            RecordCall(tool, parse_us, 0, 0, cached.size(), false);
+            ReplyResult(id, cached, batch);
+            return;
+        }
+    } else {
+        DropCachedResults();
+    }
+
+    if (!tool->main_thread()) {
+        StartWorkers();
+        auto call = new WorkerCall{id, tool, std::move(arguments), std::move(bound_call), call_generation_.load(),
+            parsed_us + MCP_TOOL_CALL_TIMEOUT_MS * 1000LL, batch, parse_us, parsed_us, std::move(cache_key), cache_generation};
+        if (xQueueSend(worker_queue_, &call, 0) != pdTRUE) {
+            delete call;
+            ESP_LOGW(TAG, "tools/call: Too many tool calls in progress, %s rejected", tool_name.c_str());
+            RecordCall(tool, parse_us, 0, 0, 0, true);
+            ReplyError(id, "Too many tool calls in progress", batch);
+        }
         return;
     }
 
     // Use main thread to call the tool
     auto& app = Application::GetInstance();
-    app.Schedule([this, id, tool_iter, arguments = std::move(arguments)]() {
+    app.Schedule([this, id, tool, arguments = std::move(arguments), bound_call = std::move(bound_call), batch,
+                  parse_us, parsed_us, cache_key = std::move(cache_key), cache_generation]() mutable {
+        int64_t exec_start_us = esp_timer_get_time();
         try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
+            auto result = bound_call ? tool->Call(bound_call) : tool->Call(arguments);
+            UpdateResultCache(tool, std::move(cache_key), cache_generation, result);
+            RecordCall(tool, parse_us, exec_start_us - parsed_us, esp_timer_get_time() - exec_start_us, result.size(), false);
+            ReplyResult(id, result, batch);
         } catch (const std::exception& e) {
             ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
+            RecordCall(tool, parse_us, exec_start_us - parsed_us, esp_timer_get_time() - exec_start_us, 0, true);
+            ReplyError(id, e.what(), batch);
         }
     });
 }
+
+void McpServer::StartWorkers() {
+    if (worker_queue_ != nullptr) {
+        return;
+    }
+    worker_queue_ = xQueueCreate(MCP_WORKER_QUEUE_SIZE, sizeof(WorkerCall*));
+    for (int i = 0; i < MCP_WORKER_COUNT; i++) {
+        TaskManifest::Create("mcp_worker", [](void* arg) {
+            static_cast<McpServer*>(arg)->WorkerTask();
+        }, this);
+    }
+}
+
+/*
+ * A tool body cannot be interrupted, so the timeout and the cancellation are checked before it
+ * starts and once it returns. A call that is past either only gets an error reply.
+ */
+void McpServer::WorkerTask() {
+    while (true) {
+        WorkerCall* call = nullptr;
+        if (xQueueReceive(worker_queue_, &call, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        std::unique_ptr<WorkerCall> guard(call);
+        const auto& name = call->tool->name();
+        int64_t exec_start_us = esp_timer_get_time();
+        int64_t queue_us = exec_start_us - call->queued_us;
+        if (call->generation != call_generation_.load()) {
+            ESP_LOGI(TAG, "tools/call: %s cancelled before it started", name.c_str());
+            RecordCall(call->tool, call->parse_us, queue_us, 0, 0, true);
+            ReplyError(call->id, "Tool call cancelled", call->batch);
+            continue;
+        }
+        if (exec_start_us > call->deadline_us) {
+            ESP_LOGW(TAG, "tools/call: %s timed out in the queue", name.c_str());
+            RecordCall(call->tool, call->parse_us, queue_us, 0, 0, true);
+            ReplyError(call->id, "Tool call timed out", call->batch);
+            continue;
+        }
+
+        std::string result;
+        try {
+            result = call->bound_call ? call->tool->Call(call->bound_call) : call->tool->Call(call->arguments);
+        } catch (const std::exception& e) {
+            ESP_LOGE(TAG, "tools/call: %s", e.what());
+            RecordCall(call->tool, call->parse_us, queue_us, esp_timer_get_time() - exec_start_us, 0, true);
+            ReplyError(call->id, e.what(), call->batch);
+            continue;
+        }
+
+        int64_t end_us = esp_timer_get_time();
+        if (call->generation != call_generation_.load()) {
+            ESP_LOGI(TAG, "tools/call: %s cancelled, result dropped", name.c_str());
+            RecordCall(call->tool, call->parse_us, queue_us, end_us - exec_start_us, 0, true);
+            ReplyError(call->id, "Tool call cancelled", call->batch);
+        } else if (end_us > call->deadline_us) {
+            ESP_LOGW(TAG, "tools/call: %s took longer than %d ms", name.c_str(), MCP_TOOL_CALL_TIMEOUT_MS);
+            RecordCall(call->tool, call->parse_us, queue_us, end_us - exec_start_us, 0, true);
+            ReplyError(call->id, "Tool call timed out", call->batch);
+        } else {
+            UpdateResultCache(call->tool, std::move(call->cache_key), call->cache_generation, result);
+            RecordCall(call->tool, call->parse_us, queue_us, end_us - exec_start_us, result.size(), false);
+            ReplyResult(call->id, result, call->batch);
+        }
+    }
+}
+
+bool McpServer::FindCachedResult(const McpTool* tool, const std::string& arguments, std::string& result, uint32_t& generation) {
+    std::lock_guard<std::mutex> lock(result_cache_mutex_);
+    generation = result_generation_;
+    auto it = result_cache_.find(tool);
+    if (it == result_cache_.end() || it->second.arguments != arguments || esp_timer_get_time() > it->second.expires_us) {
+        return false;
+    }
+    result = it->second.result;
+    return true;
+}
+
+/*
+ * There is no telling which getters a tool changes, so any tool that is not a getter drops
+ * all the cached results, before it runs and once it is done. A getter result is only kept
+ * if nothing was dropped while it ran.
+ */
+void McpServer::DropCachedResults() {
+    std::lock_guard<std::mutex> lock(result_cache_mutex_);
+    result_cache_.clear();
+    result_generation_++;
+}
+
+void McpServer::UpdateResultCache(const McpTool* tool, std::string&& arguments, uint32_t generation, const std::string& result) {
+    if (tool->cache_ttl_ms() <= 0) {
+        DropCachedResults();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(result_cache_mutex_);
+    if (generation == result_generation_) {
+        result_cache_[tool] = {std::move(arguments), result, esp_timer_get_time() + tool->cache_ttl_ms() * 1000LL};
+    }
+}
+
+void McpServer::CancelToolCalls() {
+    call_generation_++;
+}
+
+void McpServer::RecordCall(const McpTool* tool, int64_t parse_us, int64_t queue_us, int64_t exec_us, size_t reply_bytes, bool error) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    auto& stats = tool_stats_[tool];
+    if (stats == nullptr) {
+        stats = std::make_unique<McpToolStats>();
+    }
+    stats->calls++;
+    if (error) {
+        stats->errors++;
+    }
+    stats->parse_us.Record(parse_us);
+    stats->queue_us.Record(queue_us);
+    stats->exec_us.Record(exec_us);
+    stats->reply_bytes_max = std::max<uint32_t>(stats->reply_bytes_max, reply_bytes);
+    stats->reply_bytes_total += reply_bytes;
+}
+
+std::string McpServer::GetStatsJson() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* bounds = cJSON_CreateArray();
+    for (auto bound : McpLatencyHistogram::kBoundsUs) {
+        cJSON_AddItemToArray(bounds, cJSON_CreateNumber(bound));
+    }
+    cJSON_AddItemToObject(root, "bucket_bounds_us", bounds);
+
+    cJSON* tools = cJSON_CreateArray();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        for (const auto& [tool, stats] : tool_stats_) {
+            cJSON* item = cJSON_CreateObject();
+            cJSON_AddStringToObject(item, "name", tool->name().c_str());
+            cJSON_AddNumberToObject(item, "calls", stats->calls);
+            cJSON_AddNumberToObject(item, "errors", stats->errors);
+            cJSON_AddItemToObject(item, "parse_us", stats->parse_us.ToJson(stats->calls));
+            cJSON_AddItemToObject(item, "queue_us", stats->queue_us.ToJson(stats->calls));
+            cJSON_AddItemToObject(item, "exec_us", stats->exec_us.ToJson(stats->calls));
+            cJSON_AddNumberToObject(item, "reply_bytes_max", stats->reply_bytes_max);
+            cJSON_AddNumberToObject(item, "reply_bytes_avg", (double)(stats->reply_bytes_total / stats->calls));
+            cJSON_AddItemToArray(tools, item);
+        }
+    }
+    cJSON_AddItemToObject(root, "tools", tools);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
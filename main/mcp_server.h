@@ -2,46 +2,80 @@
 #define MCP_SERVER_H
 
 #include <string>
+#include <cstdint>
+#include <algorithm>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <string_view>
+#include <array>
 #include <functional>
 #include <variant>
 #include <optional>
+#include <memory>
 #include <stdexcept>
 #include <thread>
+#include <mutex>
+#include <atomic>
 #include <mbedtls/base64.h>
 
 #include <cJSON.h>
-
+#include <tuple>
+#include <type_traits>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include "small_function.h"
+#include "mcp_status_notifier.h"
+
+/*
+ * An image result of a tool. The data is kept raw and base64 encoded straight into the reply,
+ * so a large JPEG exists once as binary and once in the outgoing message, with no copies between.
+ */
 class ImageContent {
 private:
-    std::string encoded_data_;
+    std::string data_;
     std::string mime_type_;
 
-    static std::string Base64Encode(const std::string& data) {
-        size_t dlen = 0, olen = 0;
-        mbedtls_base64_encode((unsigned char*)nullptr, 0, &dlen, (const unsigned char*)data.data(), data.size());
-        std::string result(dlen, 0);
-        mbedtls_base64_encode((unsigned char*)result.data(), result.size(), &olen, (const unsigned char*)data.data(), data.size());
-        return result;
-    }
+    // Multiple of 3 so every chunk but the last encodes without padding
+    static constexpr size_t kEncodeChunkSize = 3 * 1024;
 
 public:
-    ImageContent(const std::string& mime_type, const std::string& data) {
-        mime_type_ = mime_type;
-        // base64 encode data
-        encoded_data_ = Base64Encode(data);
+    ImageContent(const std::string& mime_type, std::string data)
+        : data_(std::move(data)), mime_type_(mime_type) {}
+
+    // Appends {"type":"image","mimeType":...,"data":...}, with escaped quotes to embed it in a JSON string
+    void AppendJson(std::string& out, bool escaped) const {
+        const char* quote = escaped ? "\\\"" : "\"";
+        out += "{";
+        out += quote; out += "type"; out += quote; out += ":";
+        out += quote; out += "image"; out += quote; out += ",";
+        out += quote; out += "mimeType"; out += quote; out += ":";
+        out += quote; out += mime_type_; out += quote; out += ",";
+        out += quote; out += "data"; out += quote; out += ":";
+        out += quote;
+        for (size_t offset = 0; offset < data_.size(); offset += kEncodeChunkSize) {
+            size_t length = std::min(kEncodeChunkSize, data_.size() - offset);
+            size_t start = out.size();
+            out.resize(start + (length + 2) / 3 * 4 + 1);
+            size_t olen = 0;
+            mbedtls_base64_encode((unsigned char*)out.data() + start, out.size() - start, &olen,
+                (const unsigned char*)data_.data() + offset, length);
+            out.resize(start + olen);
+        }
+        out += quote;
+        out += "}";
+    }
+
+    // Upper bound of the size AppendJson() adds
+    size_t json_size() const {
+        return (data_.size() + 2) / 3 * 4 + mime_type_.size() + 64;
     }
 
     std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        cJSON_AddStringToObject(json, "type", "image");
-        cJSON_AddStringToObject(json, "mimeType", mime_type_.c_str());
-        cJSON_AddStringToObject(json, "data", encoded_data_.c_str());
-        char* json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
+        std::string result;
+        result.reserve(json_size());
+        AppendJson(result, false);
         return result;
     }
 };
@@ -205,6 +239,123 @@ public:
     }
 };
 
+/*
+ * Typed tool arguments, bound from the JSON arguments straight into a struct of the tool:
+ *
+ *     struct VolumeArgs { int volume; };
+ *     AddTool("self.audio_speaker.set_volume", "...",
+ *         ToolSignature(ToolArgument("volume", &VolumeArgs::volume, 0, 100)),
+ *         [](const VolumeArgs& args) -> ReturnValue { ... });
+ *
+ * The schema for tools/list is generated from the same description, so they cannot disagree.
+ */
+template <typename Args, typename T>
+struct ToolArgument {
+    static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int> || std::is_same_v<T, std::string>,
+                  "Tool arguments are bool, int or std::string");
+
+    using ArgsType = Args;
+
+    const char* name;
+    T Args::*member;
+    bool has_default_value = false;
+    T default_value{};
+    bool has_range = false;
+    int min_value = 0;
+    int max_value = 0;
+
+    ToolArgument(const char* name, T Args::*member) : name(name), member(member) {}
+    ToolArgument(const char* name, T Args::*member, T default_value)
+        : name(name), member(member), has_default_value(true), default_value(std::move(default_value)) {}
+    ToolArgument(const char* name, T Args::*member, int min_value, int max_value)
+        : name(name), member(member), has_range(true), min_value(min_value), max_value(max_value) {
+        static_assert(std::is_same_v<T, int>, "Range limits only apply to integer arguments");
+    }
+    ToolArgument(const char* name, T Args::*member, int default_value, int min_value, int max_value)
+        : name(name), member(member), has_default_value(true), default_value(default_value), has_range(true),
+        min_value(min_value), max_value(max_value) {
+        static_assert(std::is_same_v<T, int>, "Range limits only apply to integer arguments");
+        if (default_value < min_value || default_value > max_value) {
+            throw std::invalid_argument("Default value must be within the specified range");
+        }
+    }
+
+    Property ToProperty() const {
+        PropertyType type = std::is_same_v<T, bool> ? kPropertyTypeBoolean :
+                            std::is_same_v<T, int> ? kPropertyTypeInteger : kPropertyTypeString;
+        if constexpr (std::is_same_v<T, int>) {
+            if (has_range) {
+                return has_default_value ? Property(name, type, default_value, min_value, max_value) :
+                                           Property(name, type, min_value, max_value);
+            }
+        }
+        return has_default_value ? Property(name, type, default_value) : Property(name, type);
+    }
+
+    void Bind(const cJSON* arguments, Args& args) const {
+        auto value = cJSON_IsObject(arguments) ? cJSON_GetObjectItem(arguments, name) : nullptr;
+        bool found = false;
+        if constexpr (std::is_same_v<T, bool>) {
+            if (cJSON_IsBool(value)) {
+                args.*member = value->valueint == 1;
+                found = true;
+            }
+        } else if constexpr (std::is_same_v<T, int>) {
+            if (cJSON_IsNumber(value)) {
+                if (has_range && value->valueint < min_value) {
+                    throw std::invalid_argument("Value is below minimum allowed: " + std::to_string(min_value));
+                }
+                if (has_range && value->valueint > max_value) {
+                    throw std::invalid_argument("Value exceeds maximum allowed: " + std::to_string(max_value));
+                }
+                args.*member = value->valueint;
+                found = true;
+            }
+        } else {
+            if (cJSON_IsString(value)) {
+                args.*member = value->valuestring;
+                found = true;
+            }
+        }
+        if (!found) {
+            if (!has_default_value) {
+                throw std::invalid_argument(std::string("Missing valid argument: ") + name);
+            }
+            args.*member = default_value;
+        }
+    }
+};
+
+template <typename Args, typename T, typename... Extra>
+ToolArgument(const char*, T Args::*, Extra...) -> ToolArgument<Args, T>;
+
+template <typename Args, typename... Fields>
+class ToolSignature {
+private:
+    std::tuple<Fields...> fields_;
+
+public:
+    using Callback = std::function<ReturnValue(const Args&)>;
+
+    explicit ToolSignature(Fields... fields) : fields_(std::move(fields)...) {}
+
+    PropertyList ToPropertyList() const {
+        PropertyList properties;
+        std::apply([&properties](const auto&... field) { (properties.AddProperty(field.ToProperty()), ...); }, fields_);
+        return properties;
+    }
+
+    // Throws std::invalid_argument for a missing or out of range argument
+    Args Bind(const cJSON* arguments) const {
+        Args args{};
+        std::apply([arguments, &args](const auto&... field) { (field.Bind(arguments, args), ...); }, fields_);
+        return args;
+    }
+};
+
+template <typename... Fields>
+ToolSignature(Fields...) -> ToolSignature<typename std::tuple_element_t<0, std::tuple<Fields...>>::ArgsType, Fields...>;
+
 class McpTool {
 private:
     std::string name_;
@@ -212,6 +363,16 @@ private:
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
     bool user_only_ = false;
+    bool main_thread_ = true;
+    int cache_ttl_ms_ = 0;
+
+public:
+    // A typed call with its arguments already bound
+    using BoundCall = SmallFunction<ReturnValue(), 32>;
+    using Binder = std::function<BoundCall(const cJSON* arguments)>;
+
+private:
+    Binder binder_;
 
 public:
     McpTool(const std::string& name, 
@@ -224,10 +385,21 @@ public:
         callback_(callback) {}
 
     void set_user_only(bool user_only) { user_only_ = user_only; }
+    void set_binder(Binder binder) { binder_ = std::move(binder); }
+    inline bool typed() const { return binder_ != nullptr; }
+    // Throws std::invalid_argument if the arguments do not match the signature
+    BoundCall Bind(const cJSON* arguments) const { return binder_(arguments); }
+    // Tools that do not touch the display or the audio state can run in the MCP worker pool
+    void set_main_thread(bool main_thread) { main_thread_ = main_thread; }
+    // An idempotent getter: a repeated call with the same arguments within ttl_ms gets the last
+    // result without running the tool again. Any other tool call drops the cached results
+    void set_cache_ttl(int ttl_ms) { cache_ttl_ms_ = ttl_ms; }
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
     inline bool user_only() const { return user_only_; }
+    inline bool main_thread() const { return main_thread_; }
+    inline int cache_ttl_ms() const { return cache_ttl_ms_; }
 
     std::string to_json() const {
         std::vector<std::string> required = properties_.GetRequired();
@@ -270,18 +442,29 @@ public:
     }
 
     std::string Call(const PropertyList& properties) {
-        ReturnValue return_value = callback_(properties);
+        return FormatResult(callback_(properties));
+    }
+
+    std::string Call(BoundCall& call) {
+        return FormatResult(call());
+    }
+
+    static std::string FormatResult(ReturnValue return_value) {
         // 返回结果
         cJSON* result = cJSON_CreateObject();
         cJSON* content = cJSON_CreateArray();
 
         if (std::holds_alternative<ImageContent*>(return_value)) {
-            auto image_content = std::get<ImageContent*>(return_value);
-            cJSON* image = cJSON_CreateObject();
-            cJSON_AddStringToObject(image, "type", "image");
-            cJSON_AddStringToObject(image, "image", image_content->to_json().c_str());
-            cJSON_AddItemToArray(content, image);
-            delete image_content;
+            /* Written out directly, cJSON would hold the encoded image two more times */
+            std::unique_ptr<ImageContent> image_content(std::get<ImageContent*>(return_value));
+            cJSON_Delete(content);
+            cJSON_Delete(result);
+            std::string result_str;
+            result_str.reserve(image_content->json_size() + 96);
+            result_str = "{\"content\":[{\"type\":\"image\",\"image\":\"";
+            image_content->AppendJson(result_str, true);
+            result_str += "\"}],\"isError\":false}";
+            return result_str;
         } else {
             cJSON* text = cJSON_CreateObject();
             cJSON_AddStringToObject(text, "type", "text");
@@ -311,6 +494,61 @@ public:
     }
 };
 
+/*
+ * Fixed-size latency histogram, the bucket upper bounds are kBoundsUs and the last bucket
+ * takes everything above. Counts saturate instead of wrapping.
+ */
+class McpLatencyHistogram {
+public:
+    static constexpr int kBucketCount = 10;
+    static constexpr uint32_t kBoundsUs[kBucketCount - 1] = {
+        100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000
+    };
+
+    void Record(int64_t us) {
+        int bucket = 0;
+        while (bucket < kBucketCount - 1 && us >= kBoundsUs[bucket]) {
+            bucket++;
+        }
+        if (counts_[bucket] < UINT16_MAX) {
+            counts_[bucket]++;
+        }
+        max_us_ = std::max<uint32_t>(max_us_, us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+        total_us_ += us;
+    }
+
+    cJSON* ToJson(uint32_t calls) const {
+        cJSON* json = cJSON_CreateObject();
+        cJSON* counts = cJSON_CreateArray();
+        for (auto count : counts_) {
+            cJSON_AddItemToArray(counts, cJSON_CreateNumber(count));
+        }
+        cJSON_AddItemToObject(json, "counts", counts);
+        cJSON_AddNumberToObject(json, "max", max_us_);
+        cJSON_AddNumberToObject(json, "avg", calls ? (double)(total_us_ / calls) : 0);
+        return json;
+    }
+
+private:
+    uint16_t counts_[kBucketCount] = {};
+    uint32_t max_us_ = 0;
+    uint64_t total_us_ = 0;
+};
+
+// How long the results of the getter tools are reused, about one turn of the conversation
+#define MCP_GETTER_CACHE_TTL_MS 3000
+
+struct McpToolStats {
+    uint32_t calls = 0;
+    uint32_t errors = 0;
+    McpLatencyHistogram parse_us;
+    // From the end of argument parsing to the start of the tool body, in Schedule or the worker queue
+    McpLatencyHistogram queue_us;
+    McpLatencyHistogram exec_us;
+    uint32_t reply_bytes_max = 0;
+    uint64_t reply_bytes_total = 0;
+};
+
 class McpServer {
 public:
     static McpServer& GetInstance() {
@@ -321,10 +559,31 @@ public:
     void AddCommonTools();
     void AddUserOnlyTools();
     void AddTool(McpTool* tool);
-    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    // cache_ttl_ms > 0 declares the tool an idempotent getter, see McpTool::set_cache_ttl()
+    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+                 int cache_ttl_ms = 0);
     void AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+
+    template <typename Args, typename... Fields>
+    void AddTool(const std::string& name, const std::string& description, const ToolSignature<Args, Fields...>& signature,
+                 typename ToolSignature<Args, Fields...>::Callback callback) {
+        auto tool = new McpTool(name, description, signature.ToPropertyList(), nullptr);
+        tool->set_binder([signature, callback = std::move(callback)](const cJSON* arguments) -> McpTool::BoundCall {
+            // The binder lives as long as the tool, the bound call only keeps a pointer to the callback
+            return [callback = &callback, args = signature.Bind(arguments)]() -> ReturnValue {
+                return (*callback)(args);
+            };
+        });
+        AddTool(tool);
+    }
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
+    // Drops the queued worker tool calls and the results of the running ones, e.g. on abort
+    void CancelToolCalls();
+    // Per tool call counts and latency histograms of the tools called so far
+    std::string GetStatsJson();
+    // Pushes the subscribed device status properties that changed, call from the main task
+    void NotifyStatusChanged() { status_notifier_.Check(); }
 
 private:
     McpServer();
@@ -332,13 +591,77 @@ private:
 
     void ParseCapabilities(const cJSON* capabilities);
 
-    void ReplyResult(int id, const std::string& result);
-    void ReplyError(int id, const std::string& message);
-
-    void GetToolsList(int id, const std::string& cursor, bool list_user_only_tools);
-    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments);
+    /*
+     * Replies to the requests of one JSON-RPC batch, sent as a single array once the last
+     * request has been answered. Requests run as they would alone, so the main thread tools
+     * keep their order and the worker tools run in parallel.
+     */
+    struct BatchReply {
+        std::mutex mutex;
+        std::string replies;
+        int pending = 1;
+    };
+    using Batch = std::shared_ptr<BatchReply>;
+
+    bool HandleRequest(const cJSON* json, const Batch& batch);
+    void SendReply(std::string payload, const Batch& batch);
+    void FinishBatchRequest(const Batch& batch);
+
+    void ReplyResult(int id, const std::string& result, const Batch& batch = nullptr);
+    void ReplyError(int id, const std::string& message, const Batch& batch = nullptr);
+
+    void GetToolsList(int id, const std::string& cursor, bool list_user_only_tools, const Batch& batch);
+    bool BuildToolsPage(const std::string& cursor, bool list_user_only_tools, std::string& json, std::string& next_cursor);
+    void BuildToolsPages(bool list_user_only_tools);
+    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, const Batch& batch);
+    void StartWorkers();
+    void WorkerTask();
+
+    struct WorkerCall {
+        int id;
+        McpTool* tool;
+        PropertyList arguments;
+        McpTool::BoundCall bound_call;
+        uint32_t generation;
+        int64_t deadline_us;
+        Batch batch;
+        int64_t parse_us;
+        int64_t queued_us;
+        std::string cache_key;
+        uint32_t cache_generation;
+    };
+    QueueHandle_t worker_queue_ = nullptr;
+    std::atomic<uint32_t> call_generation_{0};
+
+    // Only the tools that have been called get stats
+    std::mutex stats_mutex_;
+    std::unordered_map<const McpTool*, std::unique_ptr<McpToolStats>> tool_stats_;
+    void RecordCall(const McpTool* tool, int64_t parse_us, int64_t queue_us, int64_t exec_us, size_t reply_bytes, bool error);
+
+    struct CachedResult {
+        std::string arguments;
+        std::string result;
+        int64_t expires_us;
+    };
+    std::mutex result_cache_mutex_;
+    std::unordered_map<const McpTool*, CachedResult> result_cache_;
+    // Bumped whenever the cached results are dropped, a getter that ran across it is not kept
+    uint32_t result_generation_ = 0;
+    void DropCachedResults();
+    bool FindCachedResult(const McpTool* tool, const std::string& arguments, std::string& result, uint32_t& generation);
+    void UpdateResultCache(const McpTool* tool, std::string&& arguments, uint32_t generation, const std::string& result);
 
     std::vector<McpTool*> tools_;
+    McpStatusNotifier status_notifier_;
+    // Keyed by views of the names owned by the tools
+    std::unordered_map<std::string_view, McpTool*> tool_index_;
+
+    struct ToolsPage {
+        std::string cursor;
+        std::string json;
+    };
+    // Serialized tools/list results, without and with the user only tools, rebuilt after AddTool
+    std::array<std::vector<ToolsPage>, 2> tools_pages_;
 };
 
 #endif // MCP_SERVER_H
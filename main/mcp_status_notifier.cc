@@ -0,0 +1,191 @@
+#include "mcp_status_notifier.h"
+#include "application.h"
+#include "board.h"
+#include "audio_codec.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "McpStatusNotifier"
+
+#define MCP_STATUS_MIN_INTERVAL_MS 200
+
+static const struct {
+    const char* name;
+    McpStatusProperty property;
+} kPropertyNames[] = {
+    {"volume", kMcpStatusVolume},
+    {"battery", kMcpStatusBattery},
+    {"network", kMcpStatusNetwork},
+    {"state", kMcpStatusState},
+};
+
+McpStatusNotifier::McpStatusNotifier() {
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            auto self = static_cast<McpStatusNotifier*>(arg);
+            Application::GetInstance().Schedule([self]() {
+                self->Check();
+            }, kSchedulePriorityLow);
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "mcp_status_flush",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&timer_args, &flush_timer_);
+}
+
+McpStatusNotifier::~McpStatusNotifier() {
+    if (flush_timer_ != nullptr) {
+        esp_timer_stop(flush_timer_);
+        esp_timer_delete(flush_timer_);
+    }
+}
+
+std::string McpStatusNotifier::Subscribe(const cJSON* params) {
+    uint32_t properties = 0;
+    auto list = cJSON_GetObjectItem(params, "properties");
+    if (cJSON_IsArray(list)) {
+        cJSON* item;
+        cJSON_ArrayForEach(item, list) {
+            if (!cJSON_IsString(item)) {
+                continue;
+            }
+            for (auto& entry : kPropertyNames) {
+                if (strcmp(item->valuestring, entry.name) == 0) {
+                    properties |= entry.property;
+                }
+            }
+        }
+    }
+    int min_interval_ms = 1000;
+    auto interval = cJSON_GetObjectItem(params, "minIntervalMs");
+    if (cJSON_IsNumber(interval)) {
+        min_interval_ms = std::max(interval->valueint, MCP_STATUS_MIN_INTERVAL_MS);
+    }
+
+    /* The reply carries every subscribed value, notifications only the changes from there */
+    auto current = Sample(properties);
+    cJSON* result = cJSON_CreateObject();
+    cJSON* values = cJSON_CreateObject();
+    AddChanges(values, properties, current, nullptr);
+    cJSON_AddItemToObject(result, "status", values);
+    cJSON_AddNumberToObject(result, "minIntervalMs", min_interval_ms);
+    auto json_str = cJSON_PrintUnformatted(result);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(result);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    properties_ = properties;
+    min_interval_ms_ = min_interval_ms;
+    sent_ = current;
+    last_sent_us_ = esp_timer_get_time();
+    ESP_LOGI(TAG, "Subscribed properties 0x%x, interval %d ms", (unsigned)properties, min_interval_ms);
+    return json;
+}
+
+void McpStatusNotifier::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    properties_ = 0;
+    esp_timer_stop(flush_timer_);
+}
+
+McpStatusNotifier::Snapshot McpStatusNotifier::Sample(uint32_t properties) {
+    Snapshot snapshot;
+    auto& board = Board::GetInstance();
+    if (properties & kMcpStatusVolume) {
+        if (auto codec = board.GetAudioCodec()) {
+            snapshot.volume = codec->output_volume();
+        }
+    }
+    if (properties & kMcpStatusBattery) {
+        bool discharging = false;
+        if (!board.GetBatteryLevel(snapshot.battery_level, snapshot.charging, discharging)) {
+            snapshot.battery_level = -1;
+        }
+    }
+    if (properties & kMcpStatusNetwork) {
+        snapshot.network_icon = board.GetNetworkStateIcon();
+    }
+    if (properties & kMcpStatusState) {
+        snapshot.state = Application::GetInstance().GetDeviceState();
+    }
+    return snapshot;
+}
+
+int McpStatusNotifier::AddChanges(cJSON* params, uint32_t properties, const Snapshot& current, const Snapshot* previous) {
+    int count = 0;
+    if ((properties & kMcpStatusVolume) && current.volume >= 0 && (!previous || previous->volume != current.volume)) {
+        cJSON_AddNumberToObject(params, "volume", current.volume);
+        count++;
+    }
+    if ((properties & kMcpStatusBattery) && current.battery_level >= 0 &&
+            (!previous || previous->battery_level != current.battery_level || previous->charging != current.charging)) {
+        cJSON* battery = cJSON_CreateObject();
+        cJSON_AddNumberToObject(battery, "level", current.battery_level);
+        cJSON_AddBoolToObject(battery, "charging", current.charging);
+        cJSON_AddItemToObject(params, "battery", battery);
+        count++;
+    }
+    if ((properties & kMcpStatusNetwork) && (!previous || previous->network_icon != current.network_icon)) {
+        // Only built when the signal changed, the board knows what its network looks like
+        cJSON* status = cJSON_Parse(Board::GetInstance().GetDeviceStatusJson().c_str());
+        cJSON* network = cJSON_DetachItemFromObject(status, "network");
+        if (network != nullptr) {
+            cJSON_AddItemToObject(params, "network", network);
+            count++;
+        }
+        cJSON_Delete(status);
+    }
+    if ((properties & kMcpStatusState) && (!previous || previous->state != current.state)) {
+        cJSON_AddStringToObject(params, "state", DeviceStateMachine::GetStateName((DeviceState)current.state));
+        count++;
+    }
+    return count;
+}
+
+void McpStatusNotifier::Check() {
+    uint32_t properties;
+    Snapshot previous;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (properties_ == 0) {
+            return;
+        }
+        properties = properties_;
+        previous = sent_;
+        int64_t wait_us = last_sent_us_ + min_interval_ms_ * 1000LL - esp_timer_get_time();
+        if (wait_us > 0) {
+            // Merge whatever changes until the end of the interval into one notification
+            if (!esp_timer_is_active(flush_timer_)) {
+                esp_timer_start_once(flush_timer_, wait_us);
+            }
+            return;
+        }
+    }
+
+    auto current = Sample(properties);
+    cJSON* params = cJSON_CreateObject();
+    if (AddChanges(params, properties, current, &previous) == 0) {
+        cJSON_Delete(params);
+        return;
+    }
+    cJSON* notification = cJSON_CreateObject();
+    cJSON_AddStringToObject(notification, "jsonrpc", "2.0");
+    cJSON_AddStringToObject(notification, "method", "notifications/device_status");
+    cJSON_AddItemToObject(notification, "params", params);
+    auto json_str = cJSON_PrintUnformatted(notification);
+    std::string payload(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(notification);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sent_ = current;
+        last_sent_us_ = esp_timer_get_time();
+    }
+    Application::GetInstance().SendMcpMessage(std::move(payload));
+}
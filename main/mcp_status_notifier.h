@@ -0,0 +1,59 @@
+#ifndef MCP_STATUS_NOTIFIER_H
+#define MCP_STATUS_NOTIFIER_H
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+
+#include <esp_timer.h>
+#include <cJSON.h>
+
+enum McpStatusProperty {
+    kMcpStatusVolume = 1 << 0,
+    kMcpStatusBattery = 1 << 1,
+    kMcpStatusNetwork = 1 << 2,
+    kMcpStatusState = 1 << 3,
+};
+
+/*
+ * Pushes `notifications/device_status` to the server when a subscribed property changes,
+ * so it does not have to poll self.get_device_status.
+ *
+ * A notification only carries the properties that changed since the last one, and at most
+ * one is sent per interval, later changes are merged into a notification at the end of it.
+ */
+class McpStatusNotifier {
+public:
+    McpStatusNotifier();
+    ~McpStatusNotifier();
+
+    // Handles the params of `device/subscribe`, returns the result with the current values
+    std::string Subscribe(const cJSON* params);
+    void Reset();
+
+    // Samples the subscribed properties, called from the main task when something may have changed
+    void Check();
+
+private:
+    struct Snapshot {
+        int volume = -1;
+        int battery_level = -1;
+        bool charging = false;
+        // The network icon changes with the connection and the signal strength
+        const char* network_icon = nullptr;
+        int state = -1;
+    };
+
+    std::mutex mutex_;
+    uint32_t properties_ = 0;
+    int min_interval_ms_ = 1000;
+    Snapshot sent_;
+    int64_t last_sent_us_ = 0;
+    esp_timer_handle_t flush_timer_ = nullptr;
+
+    Snapshot Sample(uint32_t properties);
+    // Adds the properties of `current` that differ from `previous`, returns the number added
+    int AddChanges(cJSON* params, uint32_t properties, const Snapshot& current, const Snapshot* previous);
+};
+
+#endif // MCP_STATUS_NOTIFIER_H
@@ -0,0 +1,142 @@
+#include "memory_budget.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <cJSON.h>
+
+#include <algorithm>
+
+#define TAG "MemoryBudget"
+
+static const char* CapsName(uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return "psram";
+    }
+    if (caps & MALLOC_CAP_DMA) {
+        return "dma";
+    }
+    return "internal";
+}
+
+int MemoryBudget::Register(const char* name, uint32_t caps, size_t budget, MemoryPriority priority,
+        UsageCallback usage, EvictCallback evict) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(clients_.begin(), clients_.end(), [priority](const Client& client) {
+        return client.priority > priority;
+    });
+    int id = next_id_++;
+    clients_.insert(it, Client{id, name, caps, budget, priority, std::move(usage), std::move(evict), 0, 0});
+    ESP_LOGD(TAG, "Registered %s, %u bytes of %s", name, (unsigned)budget, CapsName(caps));
+    return id;
+}
+
+void MemoryBudget::Unregister(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clients_.remove_if([id](const Client& client) { return client.id == id; });
+}
+
+size_t MemoryBudget::Evict(uint32_t caps, size_t bytes, MemoryPriority below) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return EvictLocked(caps, bytes, below);
+}
+
+size_t MemoryBudget::EvictLocked(uint32_t caps, size_t bytes, MemoryPriority below) {
+    size_t freed = 0;
+    for (auto& client : clients_) {
+        if (freed >= bytes || client.priority >= below) {
+            break;
+        }
+        if (!(client.caps & caps) || client.evict == nullptr) {
+            continue;
+        }
+        size_t client_freed = client.evict(bytes - freed);
+        if (client_freed > 0) {
+            client.evicted_bytes += client_freed;
+            client.evictions++;
+            freed += client_freed;
+            ESP_LOGI(TAG, "Evicted %u bytes of %s", (unsigned)client_freed, client.name);
+        }
+    }
+    return freed;
+}
+
+bool MemoryBudget::Reserve(uint32_t caps, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The largest block does not grow with every byte freed, so each client is asked in turn
+    for (auto& client : clients_) {
+        if (heap_caps_get_largest_free_block(caps) >= bytes) {
+            return true;
+        }
+        if (client.priority == kMemoryPriorityFixed || !(client.caps & caps) || client.evict == nullptr) {
+            continue;
+        }
+        size_t freed = client.evict(bytes);
+        if (freed > 0) {
+            client.evicted_bytes += freed;
+            client.evictions++;
+            ESP_LOGI(TAG, "Evicted %u bytes of %s for a %u byte block", (unsigned)freed, client.name, (unsigned)bytes);
+        }
+    }
+    return heap_caps_get_largest_free_block(caps) >= bytes;
+}
+
+void MemoryBudget::Check() {
+    struct LowWater {
+        uint32_t caps;
+        size_t bytes;
+    };
+    static const LowWater low_waters[] = {
+        {MALLOC_CAP_INTERNAL, CONFIG_MEMORY_BUDGET_INTERNAL_LOW_WATER_KB * 1024},
+        {MALLOC_CAP_SPIRAM, CONFIG_MEMORY_BUDGET_PSRAM_LOW_WATER_KB * 1024},
+    };
+    for (const auto& low_water : low_waters) {
+        size_t free = heap_caps_get_free_size(low_water.caps);
+        if (free >= low_water.bytes || heap_caps_get_total_size(low_water.caps) == 0) {
+            continue;
+        }
+        size_t freed = Evict(low_water.caps, low_water.bytes - free);
+        if (freed > 0) {
+            ESP_LOGW(TAG, "Low %s memory, %u bytes free, evicted %u", CapsName(low_water.caps),
+                (unsigned)free, (unsigned)freed);
+        }
+    }
+}
+
+std::string MemoryBudget::GetJson() {
+    cJSON* root = cJSON_CreateObject();
+    const uint32_t heaps[] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_DMA, MALLOC_CAP_SPIRAM};
+    for (auto caps : heaps) {
+        if (heap_caps_get_total_size(caps) == 0) {
+            continue;
+        }
+        cJSON* heap = cJSON_CreateObject();
+        cJSON_AddNumberToObject(heap, "total", heap_caps_get_total_size(caps));
+        cJSON_AddNumberToObject(heap, "free", heap_caps_get_free_size(caps));
+        cJSON_AddNumberToObject(heap, "largest_block", heap_caps_get_largest_free_block(caps));
+        cJSON_AddNumberToObject(heap, "minimum_free", heap_caps_get_minimum_free_size(caps));
+        cJSON_AddItemToObject(root, CapsName(caps), heap);
+    }
+
+    cJSON* clients = cJSON_CreateArray();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& client : clients_) {
+            cJSON* item = cJSON_CreateObject();
+            cJSON_AddStringToObject(item, "name", client.name);
+            cJSON_AddStringToObject(item, "heap", CapsName(client.caps));
+            cJSON_AddNumberToObject(item, "priority", client.priority);
+            cJSON_AddNumberToObject(item, "budget", client.budget);
+            cJSON_AddNumberToObject(item, "used", client.usage ? client.usage() : 0);
+            cJSON_AddNumberToObject(item, "evictions", client.evictions);
+            cJSON_AddNumberToObject(item, "evicted_bytes", client.evicted_bytes);
+            cJSON_AddItemToArray(clients, item);
+        }
+    }
+    cJSON_AddItemToObject(root, "clients", clients);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
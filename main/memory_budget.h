@@ -0,0 +1,78 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+
+// Lower priorities are evicted first
+enum MemoryPriority {
+    kMemoryPriorityLow,     // Cheap to rebuild, e.g. decoded GIF frames
+    kMemoryPriorityNormal,  // Costs a decode when missed, e.g. prompt PCM
+    kMemoryPriorityHigh,    // Visible when missed, e.g. glyph bitmaps
+    kMemoryPriorityFixed,   // Reported only, never evicted
+};
+
+/*
+ * The caches of the device that compete for the same heap register here with their budget, how
+ * much they use and how to give memory back. The clock tick calls Check(), which evicts from the
+ * lowest priority caches first while the free heap of a capability is below its low water mark,
+ * and code about to make a big allocation (a camera frame, an OTA) calls Reserve() or Evict()
+ * first. Eviction callbacks run on the calling task and must not call back into the manager.
+ */
+class MemoryBudget {
+public:
+    // Returns the bytes in use
+    using UsageCallback = std::function<size_t()>;
+    // Frees about bytes of entries nobody holds, returns the bytes freed
+    using EvictCallback = std::function<size_t(size_t bytes)>;
+
+    static MemoryBudget& GetInstance() {
+        static MemoryBudget instance;
+        return instance;
+    }
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // caps is where the client allocates, e.g. MALLOC_CAP_SPIRAM. Returns the id for Unregister()
+    int Register(const char* name, uint32_t caps, size_t budget, MemoryPriority priority,
+        UsageCallback usage, EvictCallback evict = nullptr);
+    // Waits for a running eviction, the callbacks are not called afterwards
+    void Unregister(int id);
+
+    // Evicts up to bytes from the clients in caps, lowest priority first. Returns the bytes freed
+    size_t Evict(uint32_t caps, size_t bytes, MemoryPriority below = kMemoryPriorityFixed);
+    // Evicts until a block of bytes can be allocated with caps, false if that is not reached
+    bool Reserve(uint32_t caps, size_t bytes);
+    // Evicts while the free heap is below the low water mark of its capability
+    void Check();
+
+    std::string GetJson();
+
+private:
+    MemoryBudget() = default;
+
+    struct Client {
+        int id;
+        const char* name;
+        uint32_t caps;
+        size_t budget;
+        MemoryPriority priority;
+        UsageCallback usage;
+        EvictCallback evict;
+        size_t evicted_bytes;
+        int evictions;
+    };
+
+    std::mutex mutex_;
+    // Sorted by priority
+    std::list<Client> clients_;
+    int next_id_ = 1;
+
+    size_t EvictLocked(uint32_t caps, size_t bytes, MemoryPriority below);
+};
+
+#endif // MEMORY_BUDGET_H
@@ -1,10 +1,15 @@
 #include "ota.h"
 #include "system_info.h"
 #include "settings.h"
+#include "memory_budget.h"
 #include "assets/lang_config.h"
+#include "task_manifest.h"
+#include "http_pool.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <cJSON.h>
 #include <esp_log.h>
 #include <esp_partition.h>
@@ -13,14 +18,22 @@
 #include <esp_efuse.h>
 #include <esp_efuse_table.h>
 #include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <zlib.h>
+#include <esp_delta_ota.h>
+#include <esp_flash_encrypt.h>
+#include <mbedtls/sha256.h>
 #ifdef SOC_HMAC_SUPPORTED
 #include <esp_hmac.h>
 #endif
 
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
 
 #define TAG "Ota"
 
@@ -54,8 +67,7 @@ std::string Ota::GetCheckVersionUrl() {
 
 std::unique_ptr<Http> Ota::SetupHttp() {
     auto& board = Board::GetInstance();
-    auto network = board.GetNetwork();
-    auto http = network->CreateHttp(0);
+    auto http = HttpPool::GetInstance().CreateHttp(0);
     auto user_agent = SystemInfo::GetUserAgent();
     http->SetHeader("Activation-Version", has_serial_number_ ? "2" : "1");
     http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
@@ -89,6 +101,17 @@ esp_err_t Ota::CheckVersion() {
     }
 
     auto http = SetupHttp();
+    // Patches are made against application.elf_sha256 of the system info
+    http->SetHeader("Ota-Patch-Formats", "detools");
+
+    // The last response is only reused by the firmware it was sent to
+    char elf_sha256[65];
+    esp_app_get_elf_sha256(elf_sha256, sizeof(elf_sha256));
+    Settings ota_settings("ota", true);
+    std::string etag = ota_settings.GetString("etag");
+    if (!etag.empty() && ota_settings.GetString("etag_app") == elf_sha256) {
+        http->SetHeader("If-None-Match", etag);
+    }
 
     std::string data = board.GetSystemInfoJson();
     std::string method = data.length() > 0 ? "POST" : "GET";
@@ -101,11 +124,18 @@ esp_err_t Ota::CheckVersion() {
     }
 
     auto status_code = http->GetStatusCode();
+    if (status_code == 304) {
+        http->Close();
+        ESP_LOGI(TAG, "Version check response unchanged");
+        RestoreCheckVersionResult(ota_settings);
+        return ESP_OK;
+    }
     if (status_code != 200) {
         ESP_LOGE(TAG, "Failed to check version, status code: %d", status_code);
         return status_code;
     }
 
+    etag = http->GetResponseHeader("ETag");
     data = http->ReadAll();
     http->Close();
 
@@ -145,7 +175,9 @@ esp_err_t Ota::CheckVersion() {
 
     has_mqtt_config_ = false;
     cJSON *mqtt = cJSON_GetObjectItem(root, "mqtt");
-    if (cJSON_IsObject(mqtt)) {
+    if (cJSON_IsObject(mqtt) && !SectionChanged(ota_settings, "mqtt_crc", mqtt)) {
+        has_mqtt_config_ = true;
+    } else if (cJSON_IsObject(mqtt)) {
         Settings settings("mqtt", true);
         cJSON *item = NULL;
         cJSON_ArrayForEach(item, mqtt) {
@@ -166,7 +198,9 @@ esp_err_t Ota::CheckVersion() {
 
     has_websocket_config_ = false;
     cJSON *websocket = cJSON_GetObjectItem(root, "websocket");
-    if (cJSON_IsObject(websocket)) {
+    if (cJSON_IsObject(websocket) && !SectionChanged(ota_settings, "ws_crc", websocket)) {
+        has_websocket_config_ = true;
+    } else if (cJSON_IsObject(websocket)) {
         Settings settings("websocket", true);
         cJSON *item = NULL;
         cJSON_ArrayForEach(item, websocket) {
@@ -221,6 +255,27 @@ esp_err_t Ota::CheckVersion() {
         if (cJSON_IsString(url)) {
             firmware_url_ = url->valuestring;
         }
+        // "sha256": "<hex>" of the app image as written to flash, after inflating or patching
+        firmware_sha256_.clear();
+        cJSON *sha256 = cJSON_GetObjectItem(firmware, "sha256");
+        if (cJSON_IsString(sha256)) {
+            firmware_sha256_ = sha256->valuestring;
+        }
+        // "patch": { "format": "detools", "url": "http://", "base_sha256": "<elf_sha256 of the running app>" }
+        patch_url_.clear();
+        cJSON *patch = cJSON_GetObjectItem(firmware, "patch");
+        if (cJSON_IsObject(patch)) {
+            cJSON *format = cJSON_GetObjectItem(patch, "format");
+            cJSON *patch_url = cJSON_GetObjectItem(patch, "url");
+            cJSON *base_sha256 = cJSON_GetObjectItem(patch, "base_sha256");
+            if (cJSON_IsString(format) && strcmp(format->valuestring, "detools") == 0 && cJSON_IsString(patch_url) &&
+                cJSON_IsString(base_sha256) && strcmp(base_sha256->valuestring, elf_sha256) == 0) {
+                patch_url_ = patch_url->valuestring;
+                ESP_LOGI(TAG, "Patch available: %s", patch_url_.c_str());
+            } else {
+                ESP_LOGW(TAG, "Ignoring patch that does not apply to this firmware");
+            }
+        }
 
         if (cJSON_IsString(version) && cJSON_IsString(url)) {
             // Check if the version is newer, for example, 0.1.0 is newer than 0.0.1
@@ -241,9 +296,50 @@ esp_err_t Ota::CheckVersion() {
     }
 
     cJSON_Delete(root);
+
+    // A 304 can only stand in for a response without a pending activation
+    if (!etag.empty() && !has_activation_code_ && !has_activation_challenge_) {
+        ota_settings.SetString("etag", etag);
+        ota_settings.SetString("etag_app", elf_sha256);
+        ota_settings.SetBool("has_mqtt", has_mqtt_config_);
+        ota_settings.SetBool("has_ws", has_websocket_config_);
+        ota_settings.SetString("fw_version", firmware_version_);
+        ota_settings.SetString("fw_url", firmware_url_);
+        ota_settings.SetString("fw_sha256", firmware_sha256_);
+        ota_settings.SetString("patch_url", patch_url_);
+        ota_settings.SetBool("fw_new", has_new_version_);
+    } else {
+        ota_settings.EraseKey("etag");
+    }
     return ESP_OK;
 }
 
+// Compares the section with the CRC stored at key and stores the new one, a changed section is written out again
+bool Ota::SectionChanged(Settings& settings, const char* key, cJSON* section) {
+    char* json = cJSON_PrintUnformatted(section);
+    int32_t crc = (int32_t)crc32(0, (const Bytef*)json, strlen(json));
+    cJSON_free(json);
+    if (settings.GetInt(key) == crc && crc != 0) {
+        return false;
+    }
+    settings.SetInt(key, crc);
+    return true;
+}
+
+// The state the cached response led to, activation and server time are not part of it
+void Ota::RestoreCheckVersionResult(Settings& settings) {
+    has_activation_code_ = false;
+    has_activation_challenge_ = false;
+    has_server_time_ = false;
+    has_mqtt_config_ = settings.GetBool("has_mqtt");
+    has_websocket_config_ = settings.GetBool("has_ws");
+    firmware_version_ = settings.GetString("fw_version");
+    firmware_url_ = settings.GetString("fw_url");
+    firmware_sha256_ = settings.GetString("fw_sha256");
+    patch_url_ = settings.GetString("patch_url");
+    has_new_version_ = settings.GetBool("fw_new");
+}
+
 void Ota::MarkCurrentVersionValid() {
     auto partition = esp_ota_get_running_partition();
     if (strcmp(partition->label, "factory") == 0) {
@@ -264,9 +360,277 @@ void Ota::MarkCurrentVersionValid() {
     }
 }
 
-bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback) {
-    ESP_LOGI(TAG, "Upgrading firmware from %s", firmware_url.c_str());
-    esp_ota_handle_t update_handle = 0;
+#define OTA_BUFFER_COUNT 4
+#define OTA_BUFFER_SIZE (8 * 1024)
+#define OTA_INFLATE_BUFFER_SIZE 4096
+
+// Patches are always made against the running app, the delta reader has no context argument
+static const esp_partition_t* s_patch_base = nullptr;
+
+// The 32 bytes of a hex SHA-256, false if it is not one
+static bool ParseSha256(const std::string& hex, uint8_t digest[32]) {
+    if (hex.size() != 64) {
+        return false;
+    }
+    for (int i = 0; i < 32; i++) {
+        char byte[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
+        char* end;
+        digest[i] = strtoul(byte, &end, 16);
+        if (end != byte + 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Writes the firmware image on its own task, so the next blocks download while the flash is
+ * busy. Images compressed by release.py (a zlib stream) are inflated on the same task, and
+ * detools patches are applied against the running partition there too.
+ *
+ * The image is hashed as it is written, by the SHA peripheral behind mbedtls. When the version
+ * check gave the SHA-256 of the image, End() compares digests instead of reading the partition
+ * back in esp_ota_end(); esp_ota_set_boot_partition() still verifies the image in flash once.
+ */
+class OtaWriter {
+public:
+    OtaWriter(const esp_partition_t* partition, bool patch, const std::string& sha256)
+        : partition_(partition), patch_(patch) {
+        mbedtls_sha256_init(&sha_);
+        mbedtls_sha256_starts(&sha_, 0);
+        if (!sha256.empty()) {
+            has_expected_sha256_ = ParseSha256(sha256, expected_sha256_);
+            if (!has_expected_sha256_) {
+                ESP_LOGW(TAG, "Ignoring malformed image SHA-256: %s", sha256.c_str());
+            }
+        }
+        free_queue_ = xQueueCreate(OTA_BUFFER_COUNT, sizeof(char*));
+        filled_queue_ = xQueueCreate(OTA_BUFFER_COUNT + 1, sizeof(Block));
+        done_ = xSemaphoreCreateBinary();
+        for (int i = 0; i < OTA_BUFFER_COUNT; i++) {
+            buffers_[i] = (char*)heap_caps_malloc(OTA_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (buffers_[i] == nullptr) {
+                buffers_[i] = (char*)heap_caps_malloc(OTA_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            }
+            if (buffers_[i] == nullptr) {
+                ESP_LOGE(TAG, "Failed to allocate buffer");
+                return;
+            }
+            xQueueSend(free_queue_, &buffers_[i], 0);
+        }
+        started_ = TaskManifest::Create("ota_writer", [](void* arg) {
+            static_cast<OtaWriter*>(arg)->WriterTask();
+        }, this) == pdPASS;
+    }
+
+    ~OtaWriter() {
+        Finish();
+        if (begun_ && !ended_) {
+            esp_ota_abort(update_handle_);
+        }
+        if (inflating_) {
+            inflateEnd(&stream_);
+        }
+        if (delta_ != nullptr) {
+            esp_delta_ota_deinit(delta_);
+        }
+        mbedtls_sha256_free(&sha_);
+        heap_caps_free(inflate_buffer_);
+        for (int i = 0; i < OTA_BUFFER_COUNT; i++) {
+            heap_caps_free(buffers_[i]);
+        }
+        vQueueDelete(free_queue_);
+        vQueueDelete(filled_queue_);
+        vSemaphoreDelete(done_);
+    }
+
+    bool valid() const { return started_; }
+    bool failed() const { return failed_; }
+
+    // Waits for a free buffer of OTA_BUFFER_SIZE
+    char* Acquire() {
+        char* buffer = nullptr;
+        xQueueReceive(free_queue_, &buffer, portMAX_DELAY);
+        return buffer;
+    }
+
+    void Submit(char* buffer, size_t length) {
+        Block block = {buffer, length};
+        xQueueSend(filled_queue_, &block, portMAX_DELAY);
+    }
+
+    // Waits for the queued blocks and validates the image
+    esp_err_t End() {
+        Finish();
+        if (failed_) {
+            return ESP_FAIL;
+        }
+        if (delta_ != nullptr && esp_delta_ota_finalize(delta_) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to finish applying the patch");
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        if (!begun_ || (inflating_ && !inflate_done_)) {
+            ESP_LOGE(TAG, "Firmware image is truncated");
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        ended_ = true;
+        if (inflating_) {
+            ESP_LOGI(TAG, "Inflated %lu bytes from %lu", stream_.total_out, stream_.total_in);
+        }
+        if (has_expected_sha256_) {
+            uint8_t digest[32];
+            mbedtls_sha256_finish(&sha_, digest);
+            if (memcmp(digest, expected_sha256_, sizeof(digest)) != 0) {
+                ESP_LOGE(TAG, "Image SHA-256 does not match the version check");
+                esp_ota_abort(update_handle_);
+                return ESP_ERR_OTA_VALIDATE_FAILED;
+            }
+            // Encrypted writes keep a partial block that only esp_ota_end() flushes
+            if (!esp_flash_encryption_enabled()) {
+                ESP_LOGI(TAG, "Image SHA-256 matches");
+                return esp_ota_abort(update_handle_);
+            }
+        }
+        return esp_ota_end(update_handle_);
+    }
+
+private:
+    struct Block {
+        char* data;
+        size_t length;
+    };
+
+    const esp_partition_t* partition_;
+    bool patch_;
+    esp_ota_handle_t update_handle_ = 0;
+    mbedtls_sha256_context sha_;
+    uint8_t expected_sha256_[32] = {};
+    bool has_expected_sha256_ = false;
+    char* buffers_[OTA_BUFFER_COUNT] = {};
+    QueueHandle_t free_queue_;
+    QueueHandle_t filled_queue_;
+    SemaphoreHandle_t done_;
+    bool started_ = false;
+    bool finished_ = false;
+    bool begun_ = false;
+    bool ended_ = false;
+    std::atomic<bool> failed_ = false;
+    bool format_checked_ = false;
+    bool inflating_ = false;
+    bool inflate_done_ = false;
+    z_stream stream_ = {};
+    uint8_t* inflate_buffer_ = nullptr;
+    esp_delta_ota_handle_t delta_ = nullptr;
+
+    void Finish() {
+        if (!started_ || finished_) {
+            return;
+        }
+        finished_ = true;
+        Block block = {nullptr, 0};
+        xQueueSend(filled_queue_, &block, portMAX_DELAY);
+        xSemaphoreTake(done_, portMAX_DELAY);
+    }
+
+    bool Write(const void* data, size_t length) {
+        if (!begun_) {
+            // Begin erases the first sectors, so it waits for the image to arrive
+            if (esp_ota_begin(partition_, OTA_WITH_SEQUENTIAL_WRITES, &update_handle_) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to begin OTA");
+                return false;
+            }
+            begun_ = true;
+        }
+        esp_err_t err = esp_ota_write(update_handle_, data, length);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
+            return false;
+        }
+        mbedtls_sha256_update(&sha_, (const uint8_t*)data, length);
+        return true;
+    }
+
+    bool Inflate(const char* data, size_t length) {
+        stream_.next_in = (Bytef*)data;
+        stream_.avail_in = length;
+        while (stream_.avail_in > 0 && !inflate_done_) {
+            stream_.next_out = inflate_buffer_;
+            stream_.avail_out = OTA_INFLATE_BUFFER_SIZE;
+            int ret = inflate(&stream_, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                ESP_LOGE(TAG, "Failed to inflate firmware image: %d", ret);
+                return false;
+            }
+            inflate_done_ = ret == Z_STREAM_END;
+            size_t produced = OTA_INFLATE_BUFFER_SIZE - stream_.avail_out;
+            if (produced > 0 && !Write(inflate_buffer_, produced)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Patch(const char* data, size_t length) {
+        if (delta_ == nullptr) {
+            s_patch_base = esp_ota_get_running_partition();
+            esp_delta_ota_cfg_t cfg = {};
+            cfg.user_data = this;
+            cfg.read_cb = [](uint8_t* buffer, size_t size, int offset) {
+                return esp_partition_read(s_patch_base, offset, buffer, size);
+            };
+            cfg.write_cb_with_user_data = [](const uint8_t* buffer, size_t size, void* user_data) {
+                return static_cast<OtaWriter*>(user_data)->Write(buffer, size) ? ESP_OK : ESP_FAIL;
+            };
+            delta_ = esp_delta_ota_init(&cfg);
+            if (delta_ == nullptr) {
+                ESP_LOGE(TAG, "Failed to initialize patch");
+                return false;
+            }
+        }
+        if (esp_delta_ota_feed_patch(delta_, (const uint8_t*)data, length) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to apply patch");
+            return false;
+        }
+        return true;
+    }
+
+    bool Process(const char* data, size_t length) {
+        if (patch_) {
+            return Patch(data, length);
+        }
+        if (!format_checked_) {
+            format_checked_ = true;
+            // Plain images start with ESP_IMAGE_HEADER_MAGIC, a zlib stream with 0x78
+            inflating_ = (uint8_t)data[0] == 0x78;
+            if (inflating_) {
+                ESP_LOGI(TAG, "Firmware image is compressed");
+                inflate_buffer_ = (uint8_t*)heap_caps_malloc(OTA_INFLATE_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+                if (inflate_buffer_ == nullptr || inflateInit(&stream_) != Z_OK) {
+                    ESP_LOGE(TAG, "Failed to initialize inflate");
+                    inflating_ = false;
+                    return false;
+                }
+            }
+        }
+        return inflating_ ? Inflate(data, length) : Write(data, length);
+    }
+
+    void WriterTask() {
+        Block block;
+        while (xQueueReceive(filled_queue_, &block, portMAX_DELAY) == pdPASS && block.data != nullptr) {
+            if (!failed_ && block.length > 0 && !Process(block.data, block.length)) {
+                failed_ = true;
+            }
+            xQueueSend(free_queue_, &block.data, portMAX_DELAY);
+        }
+        xSemaphoreGive(done_);
+        TaskManifest::Exit();
+    }
+};
+
+bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback, bool patch,
+    const std::string& sha256, std::function<bool()> pace) {
+    ESP_LOGI(TAG, "Upgrading firmware from %s%s", firmware_url.c_str(), patch ? " (patch)" : "");
     auto update_partition = esp_ota_get_next_update_partition(NULL);
     if (update_partition == NULL) {
         ESP_LOGE(TAG, "Failed to get update partition");
@@ -274,11 +638,10 @@ bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progre
     }
 
     ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
-    bool image_header_checked = false;
-    std::string image_header;
+    // The device restarts after the upgrade, the caches are not needed until then
+    MemoryBudget::GetInstance().Evict(MALLOC_CAP_SPIRAM | MALLOC_CAP_INTERNAL, SIZE_MAX);
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
+    auto http = HttpPool::GetInstance().CreateStreamingHttp(0);
     if (!http->Open("GET", firmware_url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
@@ -295,21 +658,26 @@ bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progre
         return false;
     }
 
-    constexpr size_t PAGE_SIZE = 4096;
-    char* buffer = (char*)heap_caps_malloc(PAGE_SIZE, MALLOC_CAP_INTERNAL);
-    if (buffer == nullptr) {
-        ESP_LOGE(TAG, "Failed to allocate buffer");
+    OtaWriter writer(update_partition, patch, sha256);
+    if (!writer.valid()) {
         return false;
     }
 
-    size_t buffer_offset = 0;  // Current data size in buffer
+    // Fill a block, hand it to the writer and download the next one meanwhile
     size_t total_read = 0, recent_read = 0;
     auto last_calc_time = esp_timer_get_time();
+    char* buffer = writer.Acquire();
+    size_t buffer_offset = 0;
     while (true) {
-        int ret = http->Read(buffer + buffer_offset, PAGE_SIZE - buffer_offset);
+        if (pace && !pace()) {
+            ESP_LOGW(TAG, "Firmware download aborted");
+            writer.Submit(buffer, 0);
+            return false;
+        }
+        int ret = http->Read(buffer + buffer_offset, OTA_BUFFER_SIZE - buffer_offset);
         if (ret < 0) {
             ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            heap_caps_free(buffer);
+            writer.Submit(buffer, 0);
             return false;
         }
 
@@ -327,46 +695,23 @@ bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progre
             recent_read = 0;
         }
 
-        if (!image_header_checked) {
-            image_header.append(buffer, buffer_offset);
-            if (image_header.size() >= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                esp_app_desc_t new_app_info;
-                memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-
-                if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
-                    esp_ota_abort(update_handle);
-                    ESP_LOGE(TAG, "Failed to begin OTA");
-                    heap_caps_free(buffer);
-                    return false;
-                }
-
-                image_header_checked = true;
-                std::string().swap(image_header);
-            }
-        }
-
-        // Write to flash when buffer is full (4KB) or it's the last chunk
         bool is_last_chunk = (ret == 0);
-        if (buffer_offset == PAGE_SIZE || (is_last_chunk && buffer_offset > 0)) {
-            auto err = esp_ota_write(update_handle, buffer, buffer_offset);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
-                esp_ota_abort(update_handle);
-                heap_caps_free(buffer);
+        if (buffer_offset == OTA_BUFFER_SIZE || is_last_chunk) {
+            writer.Submit(buffer, buffer_offset);
+            if (is_last_chunk) {
+                break;
+            }
+            if (writer.failed()) {
                 return false;
             }
-
+            buffer = writer.Acquire();
             buffer_offset = 0;
         }
-
-        if (is_last_chunk) {
-            break;
-        }
     }
     http->Close();
-    heap_caps_free(buffer);
 
-    esp_err_t err = esp_ota_end(update_handle);
+    auto verify_start = esp_timer_get_time();
+    esp_err_t err = writer.End();
     if (err != ESP_OK) {
         if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
             ESP_LOGE(TAG, "Image validation failed, image is corrupted");
@@ -381,13 +726,20 @@ bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progre
         ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
         return false;
     }
+    ESP_LOGI(TAG, "Image verified and activated in %d ms", int((esp_timer_get_time() - verify_start) / 1000));
 
     ESP_LOGI(TAG, "Firmware upgrade successful");
     return true;
 }
 
 bool Ota::StartUpgrade(std::function<void(int progress, size_t speed)> callback) {
-    return Upgrade(firmware_url_, callback);
+    if (!patch_url_.empty()) {
+        if (Upgrade(patch_url_, callback, true, firmware_sha256_)) {
+            return true;
+        }
+        ESP_LOGW(TAG, "Patch upgrade failed, downloading the full image");
+    }
+    return Upgrade(firmware_url_, callback, false, firmware_sha256_);
 }
 
 
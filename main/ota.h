@@ -5,7 +5,9 @@
 #include <string>
 
 #include <esp_err.h>
+#include <cJSON.h>
 #include "board.h"
+#include "settings.h"
 
 class Ota {
 public:
@@ -21,12 +23,20 @@ public:
     bool HasActivationCode() { return has_activation_code_; }
     bool HasServerTime() { return has_server_time_; }
     bool StartUpgrade(std::function<void(int progress, size_t speed)> callback);
-    static bool Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback);
+    // patch: firmware_url is a detools patch against the running app
+    // sha256: hex SHA-256 of the resulting image, checked while it is written instead of reading it back
+    // pace: called before every read, may block to slow the download down, returning false aborts it
+    static bool Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback, bool patch = false,
+        const std::string& sha256 = "", std::function<bool()> pace = nullptr);
     void MarkCurrentVersionValid();
 
     const std::string& GetFirmwareVersion() const { return firmware_version_; }
     const std::string& GetCurrentVersion() const { return current_version_; }
     const std::string& GetFirmwareUrl() const { return firmware_url_; }
+    // Empty unless the version check gave the SHA-256 of the new image
+    const std::string& GetFirmwareSha256() const { return firmware_sha256_; }
+    // Empty unless the server offered a patch for the running firmware
+    const std::string& GetPatchUrl() const { return patch_url_; }
     const std::string& GetActivationMessage() const { return activation_message_; }
     const std::string& GetActivationCode() const { return activation_code_; }
     std::string GetCheckVersionUrl();
@@ -44,6 +54,8 @@ private:
     std::string current_version_;
     std::string firmware_version_;
     std::string firmware_url_;
+    std::string firmware_sha256_;
+    std::string patch_url_;
     std::string activation_challenge_;
     std::string serial_number_;
     int activation_timeout_ms_ = 30000;
@@ -53,6 +65,8 @@ private:
     bool IsNewVersionAvailable(const std::string& currentVersion, const std::string& newVersion);
     std::string GetActivationPayload();
     std::unique_ptr<Http> SetupHttp();
+    bool SectionChanged(Settings& settings, const char* key, cJSON* section);
+    void RestoreCheckVersionResult(Settings& settings);
 };
 
 #endif // _OTA_H
@@ -0,0 +1,122 @@
+#include "json_deflate.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "JsonDeflate"
+
+// Largest message Decompress() returns, a bigger one is taken for corrupt data
+#define JSON_DEFLATE_MAX_MESSAGE (64 * 1024)
+
+/*
+ * Fragments of the messages of both directions. Deflate finds matches nearest the end cheapest,
+ * so the most frequent ones (tts sentences, stt, llm, MCP calls) come last. Changing a byte
+ * breaks every server that uses it, add a new feature revision instead.
+ */
+const char kJsonDeflateDictionary[] =
+    "{\"type\":\"hello\",\"version\":3,\"transport\":\"websocket\",\"features\":{\"mcp\":true},"
+    "\"audio_params\":{\"format\":\"opus\",\"sample_rate\":24000,\"channels\":1,\"frame_duration\":60}}"
+    "{\"inputSchema\":{\"type\":\"object\",\"properties\":{\"type\":\"integer\",\"minimum\":0,\"maximum\":100}},\"required\":[]}"
+    "{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"true\"}],\"isError\":false}}"
+    "{\"type\":\"llm\",\"emotion\":\"neutral\",\"text\":\""
+    "{\"type\":\"listen\",\"state\":\"detect\",\"mode\":\"auto\"}{\"type\":\"stt\",\"text\":\""
+    "{\"type\":\"mcp\",\"payload\":{\"jsonrpc\":\"2.0\",\"method\":\"tools/call\",\"params\":{\"name\":\"self."
+    "{\"session_id\":\"\",\"type\":\"tts\",\"state\":\"sentence_start\",\"text\":\"";
+
+static const uint8_t kSyncFlushTrailer[] = {0x00, 0x00, 0xff, 0xff};
+
+JsonDeflate::JsonDeflate(int window_bits) {
+    auto dictionary = reinterpret_cast<const Bytef*>(kJsonDeflateDictionary);
+    size_t dictionary_size = sizeof(kJsonDeflateDictionary) - 1;
+    // Raw deflate, memLevel 2 keeps the hash table and the symbol buffer at 1 KB each
+    if (deflateInit2(&deflate_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -window_bits, 2, Z_DEFAULT_STRATEGY) == Z_OK) {
+        deflate_ready_ = deflateSetDictionary(&deflate_, dictionary, dictionary_size) == Z_OK;
+    }
+    if (inflateInit2(&inflate_, -window_bits) == Z_OK) {
+        inflate_ready_ = inflateSetDictionary(&inflate_, dictionary, dictionary_size) == Z_OK;
+    }
+    ok_ = deflate_ready_ && inflate_ready_;
+    if (!ok_) {
+        ESP_LOGE(TAG, "Failed to initialize the %d bit window streams", window_bits);
+    }
+}
+
+JsonDeflate::~JsonDeflate() {
+    // Both are no-ops on a stream that never initialized
+    deflateEnd(&deflate_);
+    inflateEnd(&inflate_);
+}
+
+bool JsonDeflate::Compress(const std::string& text, std::string& out) {
+    std::lock_guard<std::mutex> lock(deflate_mutex_);
+    if (!deflate_ready_) {
+        return false;
+    }
+    size_t start = out.size();
+    deflate_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    deflate_.avail_in = text.size();
+    do {
+        size_t used = out.size();
+        size_t room = std::max<size_t>(text.size() / 2, 64);
+        out.resize(used + room);
+        deflate_.next_out = reinterpret_cast<Bytef*>(&out[used]);
+        deflate_.avail_out = room;
+        int ret = deflate(&deflate_, Z_SYNC_FLUSH);
+        out.resize(used + room - deflate_.avail_out);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            // The server's stream has not seen this message, it stays usable, ours does not
+            ESP_LOGE(TAG, "deflate failed: %d", ret);
+            deflate_ready_ = false;
+            out.resize(start);
+            return false;
+        }
+    } while (deflate_.avail_out == 0);
+
+    // The receiver appends the trailer of the sync flush again
+    size_t size = out.size() - start;
+    if (size >= sizeof(kSyncFlushTrailer) &&
+        memcmp(&out[out.size() - sizeof(kSyncFlushTrailer)], kSyncFlushTrailer, sizeof(kSyncFlushTrailer)) == 0) {
+        out.resize(out.size() - sizeof(kSyncFlushTrailer));
+    }
+    raw_bytes_ += text.size();
+    compressed_bytes_ += out.size() - start;
+    return true;
+}
+
+bool JsonDeflate::Inflate(const uint8_t* data, size_t len, std::string& text) {
+    inflate_.next_in = const_cast<Bytef*>(data);
+    inflate_.avail_in = len;
+    do {
+        size_t used = text.size();
+        if (used >= JSON_DEFLATE_MAX_MESSAGE) {
+            ESP_LOGE(TAG, "Message larger than %d bytes", JSON_DEFLATE_MAX_MESSAGE);
+            return false;
+        }
+        size_t room = std::min<size_t>(std::max<size_t>(len * 4, 256), JSON_DEFLATE_MAX_MESSAGE - used);
+        text.resize(used + room);
+        inflate_.next_out = reinterpret_cast<Bytef*>(&text[used]);
+        inflate_.avail_out = room;
+        int ret = inflate(&inflate_, Z_SYNC_FLUSH);
+        text.resize(used + room - inflate_.avail_out);
+        // Z_BUF_ERROR only means there was nothing left to do
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            ESP_LOGE(TAG, "inflate failed: %d", ret);
+            return false;
+        }
+    } while (inflate_.avail_in > 0 || inflate_.avail_out == 0);
+    return true;
+}
+
+bool JsonDeflate::Decompress(const uint8_t* data, size_t len, std::string& text) {
+    text.clear();
+    if (!inflate_ready_) {
+        return false;
+    }
+    if (!Inflate(data, len, text) || !Inflate(kSyncFlushTrailer, sizeof(kSyncFlushTrailer), text)) {
+        // The window is out of step with the server's now, every later message would be garbage
+        inflate_ready_ = false;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef JSON_DEFLATE_H
+#define JSON_DEFLATE_H
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/*
+ * Compression of the JSON messages of one websocket connection, like permessage-deflate
+ * (RFC 7692) but carried in BinaryProtocol3 frames: every message is raw deflate ending in a
+ * sync flush with the 00 00 ff ff trailer removed, and both streams keep their window across
+ * messages, so the keys and values repeated by every tts / llm / MCP message cost a few bits.
+ * Both streams start from kJsonDeflateDictionary. The window is small to bound the RAM.
+ */
+class JsonDeflate {
+public:
+    explicit JsonDeflate(int window_bits);
+    ~JsonDeflate();
+
+    JsonDeflate(const JsonDeflate&) = delete;
+    JsonDeflate& operator=(const JsonDeflate&) = delete;
+
+    bool ok() const { return ok_; }
+    // Appends the compressed message to out, false if the stream broke
+    bool Compress(const std::string& text, std::string& out);
+    // Replaces text with the message compressed in data, false on corrupt data
+    bool Decompress(const uint8_t* data, size_t len, std::string& text);
+
+    // JSON bytes compressed / sent for them, for the log
+    size_t raw_bytes() const { return raw_bytes_; }
+    size_t compressed_bytes() const { return compressed_bytes_; }
+
+private:
+    z_stream deflate_ = {};
+    z_stream inflate_ = {};
+    bool deflate_ready_ = false;
+    bool inflate_ready_ = false;
+    bool ok_ = false;
+    // Compress() runs on the tasks sending messages, Decompress() only on the websocket task
+    std::mutex deflate_mutex_;
+    size_t raw_bytes_ = 0;
+    size_t compressed_bytes_ = 0;
+
+    bool Inflate(const uint8_t* data, size_t len, std::string& text);
+};
+
+// Preset dictionary of both streams, the same bytes on the server
+extern const char kJsonDeflateDictionary[];
+
+#endif // JSON_DEFLATE_H
@@ -0,0 +1,226 @@
+#include "json_scanner.h"
+
+#include <cstdint>
+
+JsonScanner::JsonScanner(std::string_view json) : json_(json) {
+    SkipWhitespace();
+    if (pos_ >= json_.size() || json_[pos_] != '{') {
+        Fail();
+        return;
+    }
+    pos_++;
+}
+
+bool JsonScanner::Fail() {
+    error_ = true;
+    done_ = true;
+    return false;
+}
+
+void JsonScanner::SkipWhitespace() {
+    while (pos_ < json_.size()) {
+        char c = json_[pos_];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        pos_++;
+    }
+}
+
+bool JsonScanner::Next(std::string_view& key, std::string_view& value) {
+    if (done_) {
+        return false;
+    }
+    SkipWhitespace();
+    if (first_ && pos_ < json_.size() && json_[pos_] == '}') {
+        done_ = true;
+        return false;
+    }
+    if (!first_) {
+        if (pos_ >= json_.size() || json_[pos_] != ',') {
+            return Fail();
+        }
+        pos_++;
+        SkipWhitespace();
+    }
+
+    if (!ScanString(key)) {
+        return Fail();
+    }
+    SkipWhitespace();
+    if (pos_ >= json_.size() || json_[pos_] != ':') {
+        return Fail();
+    }
+    pos_++;
+    SkipWhitespace();
+    if (!ScanValue(value)) {
+        return Fail();
+    }
+
+    /* Look ahead so the last member already tells the caller whether the object is complete */
+    SkipWhitespace();
+    if (pos_ < json_.size() && json_[pos_] == '}') {
+        done_ = true;
+    } else if (pos_ >= json_.size() || json_[pos_] != ',') {
+        return Fail();
+    }
+    first_ = false;
+    return true;
+}
+
+bool JsonScanner::ScanString(std::string_view& out) {
+    if (pos_ >= json_.size() || json_[pos_] != '"') {
+        return false;
+    }
+    size_t start = ++pos_;
+    while (pos_ < json_.size()) {
+        char c = json_[pos_];
+        if (c == '\\') {
+            pos_ += 2;
+            continue;
+        }
+        if (c == '"') {
+            out = json_.substr(start, pos_ - start);
+            pos_++;
+            return true;
+        }
+        pos_++;
+    }
+    return false;
+}
+
+bool JsonScanner::ScanValue(std::string_view& out) {
+    if (pos_ >= json_.size()) {
+        return false;
+    }
+    value_is_string_ = json_[pos_] == '"';
+    if (value_is_string_) {
+        return ScanString(out);
+    }
+
+    size_t start = pos_;
+    char c = json_[pos_];
+    if (c == '{' || c == '[') {
+        /* Skip the nested value, brackets inside strings do not count */
+        int depth = 0;
+        while (pos_ < json_.size()) {
+            c = json_[pos_];
+            if (c == '"') {
+                std::string_view ignored;
+                if (!ScanString(ignored)) {
+                    return false;
+                }
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    pos_++;
+                    out = json_.substr(start, pos_ - start);
+                    return true;
+                }
+            }
+            pos_++;
+        }
+        return false;
+    }
+
+    // Number, true, false or null
+    while (pos_ < json_.size()) {
+        c = json_[pos_];
+        if (c == ',' || c == '}' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            break;
+        }
+        pos_++;
+    }
+    if (pos_ == start) {
+        return false;
+    }
+    out = json_.substr(start, pos_ - start);
+    return true;
+}
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static bool ParseHex4(std::string_view raw, size_t pos, uint32_t& out) {
+    if (pos + 4 > raw.size()) {
+        return false;
+    }
+    out = 0;
+    for (size_t i = pos; i < pos + 4; i++) {
+        int value = HexValue(raw[i]);
+        if (value < 0) {
+            return false;
+        }
+        out = (out << 4) | value;
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += (char)code;
+    } else if (code < 0x800) {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    } else {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+std::string JsonScanner::Unescape(std::string_view raw) {
+    if (raw.find('\\') == std::string_view::npos) {
+        return std::string(raw);
+    }
+    std::string out;
+    out.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        char c = raw[i];
+        if (c != '\\' || i + 1 >= raw.size()) {
+            out += c;
+            continue;
+        }
+        c = raw[++i];
+        switch (c) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (!ParseHex4(raw, i + 1, code)) {
+                    break;
+                }
+                i += 4;
+                /* A high surrogate is followed by \uDC00-\uDFFF for characters beyond the BMP */
+                uint32_t low;
+                if (code >= 0xD800 && code < 0xDC00 && i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u' &&
+                        ParseHex4(raw, i + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+                AppendUtf8(out, code);
+                break;
+            }
+            default:
+                // \" \\ \/
+                out += c;
+                break;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,42 @@
+#ifndef JSON_SCANNER_H
+#define JSON_SCANNER_H
+
+#include <string>
+#include <string_view>
+
+/*
+ * Pull scanner for the top-level members of a JSON object, it never allocates.
+ *
+ * Values are views into the input: string values without the quotes and still escaped,
+ * objects, arrays and scalars as their raw JSON text. Nested values are skipped over, so a
+ * large member can be handed to cJSON_ParseWithLength() on its own.
+ */
+class JsonScanner {
+public:
+    explicit JsonScanner(std::string_view json);
+
+    // Moves to the next member, false at the end of the object or on a syntax error
+    bool Next(std::string_view& key, std::string_view& value);
+
+    bool error() const { return error_; }
+    // Whether the value returned by the last Next() was a string
+    bool value_is_string() const { return value_is_string_; }
+
+    // Decodes the escapes of a raw string value to UTF-8
+    static std::string Unescape(std::string_view raw);
+
+private:
+    std::string_view json_;
+    size_t pos_ = 0;
+    bool first_ = true;
+    bool done_ = false;
+    bool error_ = false;
+    bool value_is_string_ = false;
+
+    void SkipWhitespace();
+    bool ScanString(std::string_view& out);
+    bool ScanValue(std::string_view& out);
+    bool Fail();
+};
+
+#endif // JSON_SCANNER_H
@@ -0,0 +1,340 @@
+#include "json_to_cbor.h"
+#include "json_scanner.h"
+
+#include <mbedtls/base64.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Deeper JSON is rejected rather than risking the stack of the caller
+#define MAX_NESTING_DEPTH 32
+
+#define CBOR_MAJOR_UNSIGNED 0
+#define CBOR_MAJOR_NEGATIVE 1
+#define CBOR_MAJOR_BYTES 2
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_TAG 6
+
+#define CBOR_TAG_BASE64 22
+#define CBOR_TAG_EMBEDDED 24
+
+#define CBOR_ARRAY_START 0x9F
+#define CBOR_MAP_START 0xBF
+#define CBOR_BREAK 0xFF
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_NULL 0xF6
+#define CBOR_FLOAT32 0xFA
+#define CBOR_FLOAT64 0xFB
+
+bool JsonToCbor::Convert(std::string_view json, std::string& out) {
+    size_t start = out.size();
+    JsonToCbor converter(json, out, false);
+    if (!converter.Run()) {
+        out.resize(start);
+        return false;
+    }
+    return true;
+}
+
+bool JsonToCbor::Run() {
+    SkipWhitespace();
+    if (!ParseValue(kContextPlain)) {
+        return false;
+    }
+    SkipWhitespace();
+    return pos_ == json_.size();
+}
+
+void JsonToCbor::SkipWhitespace() {
+    while (pos_ < json_.size()) {
+        char c = json_[pos_];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        pos_++;
+    }
+}
+
+void JsonToCbor::AppendHead(uint8_t major, uint64_t value) {
+    major <<= 5;
+    if (value < 24) {
+        out_ += (char)(major | value);
+        return;
+    }
+    int bytes;
+    if (value <= UINT8_MAX) {
+        out_ += (char)(major | 24);
+        bytes = 1;
+    } else if (value <= UINT16_MAX) {
+        out_ += (char)(major | 25);
+        bytes = 2;
+    } else if (value <= UINT32_MAX) {
+        out_ += (char)(major | 26);
+        bytes = 4;
+    } else {
+        out_ += (char)(major | 27);
+        bytes = 8;
+    }
+    for (int i = bytes - 1; i >= 0; i--) {
+        out_ += (char)(value >> (i * 8));
+    }
+}
+
+bool JsonToCbor::ParseValue(Context context) {
+    if (pos_ >= json_.size()) {
+        return false;
+    }
+    char c = json_[pos_];
+    if (c == '{') {
+        return ParseObject();
+    } else if (c == '[') {
+        return ParseArray();
+    } else if (c == '"') {
+        return ParseString(context);
+    } else if (json_.compare(pos_, 4, "true") == 0) {
+        out_ += (char)CBOR_TRUE;
+        pos_ += 4;
+        return true;
+    } else if (json_.compare(pos_, 5, "false") == 0) {
+        out_ += (char)CBOR_FALSE;
+        pos_ += 5;
+        return true;
+    } else if (json_.compare(pos_, 4, "null") == 0) {
+        out_ += (char)CBOR_NULL;
+        pos_ += 4;
+        return true;
+    }
+    return ParseNumber();
+}
+
+bool JsonToCbor::ParseObject() {
+    if (++depth_ > MAX_NESTING_DEPTH) {
+        return false;
+    }
+    pos_++;
+    out_ += (char)CBOR_MAP_START;
+    SkipWhitespace();
+    if (pos_ < json_.size() && json_[pos_] == '}') {
+        pos_++;
+    } else {
+        while (true) {
+            SkipWhitespace();
+            std::string_view key;
+            if (!ScanString(key)) {
+                return false;
+            }
+            AppendText(key);
+            SkipWhitespace();
+            if (pos_ >= json_.size() || json_[pos_] != ':') {
+                return false;
+            }
+            pos_++;
+            SkipWhitespace();
+
+            Context context = kContextPlain;
+            if (in_image_ && key == "data") {
+                context = kContextImageData;
+            } else if (!in_image_ && key == "image") {
+                context = kContextImage;
+            }
+            if (!ParseValue(context)) {
+                return false;
+            }
+            SkipWhitespace();
+            if (pos_ >= json_.size()) {
+                return false;
+            }
+            if (json_[pos_] == '}') {
+                pos_++;
+                break;
+            }
+            if (json_[pos_] != ',') {
+                return false;
+            }
+            pos_++;
+        }
+    }
+    out_ += (char)CBOR_BREAK;
+    depth_--;
+    return true;
+}
+
+bool JsonToCbor::ParseArray() {
+    if (++depth_ > MAX_NESTING_DEPTH) {
+        return false;
+    }
+    pos_++;
+    out_ += (char)CBOR_ARRAY_START;
+    SkipWhitespace();
+    if (pos_ < json_.size() && json_[pos_] == ']') {
+        pos_++;
+    } else {
+        while (true) {
+            SkipWhitespace();
+            if (!ParseValue(kContextPlain)) {
+                return false;
+            }
+            SkipWhitespace();
+            if (pos_ >= json_.size()) {
+                return false;
+            }
+            if (json_[pos_] == ']') {
+                pos_++;
+                break;
+            }
+            if (json_[pos_] != ',') {
+                return false;
+            }
+            pos_++;
+        }
+    }
+    out_ += (char)CBOR_BREAK;
+    depth_--;
+    return true;
+}
+
+bool JsonToCbor::ParseNumber() {
+    size_t start = pos_;
+    bool is_float = false;
+    while (pos_ < json_.size()) {
+        char c = json_[pos_];
+        if (c == '.' || c == 'e' || c == 'E') {
+            is_float = true;
+        } else if (!(c == '-' || c == '+' || (c >= '0' && c <= '9'))) {
+            break;
+        }
+        pos_++;
+    }
+    if (pos_ == start || pos_ - start > 32) {
+        return false;
+    }
+    char text[33];
+    memcpy(text, json_.data() + start, pos_ - start);
+    text[pos_ - start] = '\0';
+    char* end;
+
+    if (!is_float) {
+        errno = 0;
+        long long value = strtoll(text, &end, 10);
+        if (*end == '\0' && errno == 0) {
+            if (value >= 0) {
+                AppendHead(CBOR_MAJOR_UNSIGNED, (uint64_t)value);
+            } else {
+                AppendHead(CBOR_MAJOR_NEGATIVE, (uint64_t)(-1 - value));
+            }
+            return true;
+        }
+        // Out of range integers are sent as a double, like JSON readers see them
+    }
+
+    double value = strtod(text, &end);
+    if (*end != '\0') {
+        return false;
+    }
+    uint64_t bits;
+    int bytes;
+    float single = (float)value;
+    if ((double)single == value) {
+        uint32_t single_bits;
+        memcpy(&single_bits, &single, sizeof(single_bits));
+        out_ += (char)CBOR_FLOAT32;
+        bits = single_bits;
+        bytes = 4;
+    } else {
+        memcpy(&bits, &value, sizeof(bits));
+        out_ += (char)CBOR_FLOAT64;
+        bytes = 8;
+    }
+    for (int i = bytes - 1; i >= 0; i--) {
+        out_ += (char)(bits >> (i * 8));
+    }
+    return true;
+}
+
+bool JsonToCbor::ScanString(std::string_view& raw) {
+    if (pos_ >= json_.size() || json_[pos_] != '"') {
+        return false;
+    }
+    size_t start = ++pos_;
+    while (pos_ < json_.size()) {
+        char c = json_[pos_];
+        if (c == '\\') {
+            pos_ += 2;
+            continue;
+        }
+        if (c == '"') {
+            raw = json_.substr(start, pos_ - start);
+            pos_++;
+            return true;
+        }
+        pos_++;
+    }
+    return false;
+}
+
+void JsonToCbor::AppendText(std::string_view raw) {
+    if (raw.find('\\') == std::string_view::npos) {
+        AppendHead(CBOR_MAJOR_TEXT, raw.size());
+        out_.append(raw);
+        return;
+    }
+    auto text = JsonScanner::Unescape(raw);
+    AppendHead(CBOR_MAJOR_TEXT, text.size());
+    out_ += text;
+}
+
+bool JsonToCbor::ParseString(Context context) {
+    std::string_view raw;
+    if (!ScanString(raw)) {
+        return false;
+    }
+    if (context == kContextImage && AppendEmbeddedImage(raw)) {
+        return true;
+    }
+    if (context == kContextImageData && AppendBase64Bytes(raw)) {
+        return true;
+    }
+    AppendText(raw);
+    return true;
+}
+
+bool JsonToCbor::AppendEmbeddedImage(std::string_view raw) {
+    auto json = JsonScanner::Unescape(raw);
+    if (json.empty() || json[0] != '{') {
+        return false;
+    }
+    std::string item;
+    item.reserve(json.size() * 3 / 4 + 64);
+    JsonToCbor converter(json, item, true);
+    if (!converter.Run()) {
+        return false;
+    }
+    AppendHead(CBOR_MAJOR_TAG, CBOR_TAG_EMBEDDED);
+    AppendHead(CBOR_MAJOR_BYTES, item.size());
+    out_ += item;
+    return true;
+}
+
+bool JsonToCbor::AppendBase64Bytes(std::string_view raw) {
+    if (raw.empty() || raw.size() % 4 != 0) {
+        return false;
+    }
+    size_t padding = raw[raw.size() - 1] == '=' ? (raw[raw.size() - 2] == '=' ? 2 : 1) : 0;
+    size_t length = raw.size() / 4 * 3 - padding;
+
+    size_t start = out_.size();
+    AppendHead(CBOR_MAJOR_TAG, CBOR_TAG_BASE64);
+    AppendHead(CBOR_MAJOR_BYTES, length);
+    size_t offset = out_.size();
+    out_.resize(offset + length);
+    size_t olen = 0;
+    int ret = mbedtls_base64_decode((unsigned char*)out_.data() + offset, length, &olen,
+        (const unsigned char*)raw.data(), raw.size());
+    if (ret != 0 || olen != length) {
+        out_.resize(start);
+        return false;
+    }
+    return true;
+}
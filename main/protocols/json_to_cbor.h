@@ -0,0 +1,50 @@
+#ifndef JSON_TO_CBOR_H
+#define JSON_TO_CBOR_H
+
+#include <string>
+#include <string_view>
+
+/*
+ * Transcodes JSON text to CBOR (RFC 8949) in one pass, without building a cJSON tree.
+ *
+ * Objects and arrays become indefinite-length maps and arrays, so nothing has to be counted
+ * ahead. The `image` string of an MCP image result holds JSON itself: it is sent as an
+ * embedded CBOR item (tag 24), in which the base64 `data` becomes the raw bytes under tag 22
+ * (expected conversion to base64). Converting back to JSON restores the original message.
+ */
+class JsonToCbor {
+public:
+    // Appends the encoding of json to out, false on a syntax error
+    static bool Convert(std::string_view json, std::string& out);
+
+private:
+    enum Context {
+        kContextPlain,
+        kContextImage,      // Value of an `image` member, JSON in a string
+        kContextImageData,  // Value of `data` inside the image JSON, base64
+    };
+
+    JsonToCbor(std::string_view json, std::string& out, bool in_image)
+        : json_(json), out_(out), in_image_(in_image) {}
+
+    std::string_view json_;
+    std::string& out_;
+    size_t pos_ = 0;
+    int depth_ = 0;
+    bool in_image_;
+
+    bool Run();
+    void SkipWhitespace();
+    bool ParseValue(Context context);
+    bool ParseObject();
+    bool ParseArray();
+    bool ParseNumber();
+    bool ScanString(std::string_view& raw);
+    bool ParseString(Context context);
+    void AppendHead(uint8_t major, uint64_t value);
+    void AppendText(std::string_view raw);
+    bool AppendEmbeddedImage(std::string_view raw);
+    bool AppendBase64Bytes(std::string_view raw);
+};
+
+#endif // JSON_TO_CBOR_H
@@ -2,9 +2,15 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "cjson_arena.h"
+#if CONFIG_TTS_CACHE
+#include "tts_cache.h"
+#endif
 
 #include <esp_log.h>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -83,6 +89,8 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     mqtt_->SetKeepAlive(keepalive_interval);
 
     mqtt_->OnDisconnected([this]() {
+        // The server ends the lease with the MQTT session
+        resume_supported_ = false;
         if (on_disconnected_ != nullptr) {
             on_disconnected_();
         }
@@ -98,6 +106,12 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
+        // The message and any reply built while handling it are freed at once
+        CjsonArenaScope arena;
+        if (HandleIncomingMessage(payload)) {
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            return;
+        }
         cJSON* root = cJSON_Parse(payload.c_str());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
@@ -163,39 +177,116 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
-bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool MqttProtocol::SendMcpCbor(std::string& frame) {
+    size_t payload_size = frame.size() - sizeof(BinaryProtocol3);
+    auto bp3 = (BinaryProtocol3*)frame.data();
+    bp3->type = BINARY_PROTOCOL3_TYPE_MCP_CBOR;
+    bp3->reserved = 0;
+    bp3->payload_size = htons(payload_size > UINT16_MAX ? 0 : payload_size);
+    return SendText(frame);
+}
+
+bool MqttProtocol::SendControl(uint8_t opcode, const void* payload, size_t size) {
+    std::string frame(sizeof(BinaryProtocol3) + size, '\0');
+    auto bp3 = (BinaryProtocol3*)frame.data();
+    bp3->type = BINARY_PROTOCOL3_TYPE_CONTROL;
+    bp3->reserved = opcode;
+    bp3->payload_size = htons(size);
+    if (size > 0) {
+        memcpy(bp3->payload, payload, size);
+    }
+    return SendText(frame);
+}
+
+/* The session of a binary control frame is the one of the MQTT client that publishes it */
+void MqttProtocol::SendWakeWordDetected(const std::string& wake_word) {
+    if (!binary_control_) {
+        Protocol::SendWakeWordDetected(wake_word);
+        return;
+    }
+    SendControl(BINARY_CONTROL_LISTEN_DETECT, wake_word.data(), wake_word.size());
+}
+
+void MqttProtocol::SendStartListening(ListeningMode mode) {
+    if (!binary_control_) {
+        Protocol::SendStartListening(mode);
+        return;
+    }
+    uint8_t payload = mode;
+    SendControl(BINARY_CONTROL_LISTEN_START, &payload, sizeof(payload));
+}
+
+void MqttProtocol::SendStopListening() {
+    if (!binary_control_) {
+        Protocol::SendStopListening();
+        return;
+    }
+    SendControl(BINARY_CONTROL_LISTEN_STOP);
+}
+
+void MqttProtocol::SendAbortSpeaking(AbortReason reason, int played_ms) {
+    if (!binary_control_) {
+        Protocol::SendAbortSpeaking(reason, played_ms);
+        return;
+    }
+    uint8_t payload[5] = {(uint8_t)reason};
+    size_t size = 1;
+    if (played_ms >= 0) {
+        uint32_t played = htonl(played_ms);
+        memcpy(&payload[1], &played, sizeof(played));
+        size += sizeof(played);
+    }
+    SendControl(BINARY_CONTROL_ABORT, payload, size);
+}
+
+bool MqttProtocol::SendAudio(AudioStreamPacket& packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
     }
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
+    /* The nonce is the packet header, and the counter block the cipher advances */
+    uint8_t nonce[MQTT_AUDIO_NONCE_SIZE];
+    memcpy(nonce, aes_nonce_.data(), sizeof(nonce));
+    nonce[1] = packet.flags;
+    *(uint16_t*)&nonce[2] = htons(packet.payload_size());
+    *(uint32_t*)&nonce[8] = htonl(packet.timestamp);
     *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
 
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
+    // Reused for every packet, so steady state sending does not allocate
+    send_buffer_.resize(sizeof(nonce) + packet.payload_size());
+    memcpy(send_buffer_.data(), nonce, sizeof(nonce));
 
     size_t nc_off = 0;
     uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet.payload_size(), &nc_off, nonce, stream_block,
+        packet.payload_data(), (uint8_t*)&send_buffer_[sizeof(nonce)]) != 0) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    return udp_->Send(send_buffer_) > 0;
 }
 
 void MqttProtocol::CloseAudioChannel(bool send_goodbye) {
+    /* With a lease only the session ends, the next one resumes on the same UDP channel */
+    bool keep_lease = resume_supported_ && !error_occurred_ && mqtt_ != nullptr && mqtt_->IsConnected();
+    session_open_ = false;
     {
         std::lock_guard<std::mutex> lock(channel_mutex_);
-        udp_.reset();
+        if (!keep_lease) {
+            udp_.reset();
+        }
+        ClearReorderWindow();
+    }
+    if (keep_lease) {
+        lease_expire_us_ = esp_timer_get_time() + lease_seconds_ * 1000000LL;
     }
+    resume_supported_ = keep_lease;
 
-    ESP_LOGI(TAG, "Closing audio channel, send_goodbye: %d", send_goodbye);
+    auto& stats = receive_stats_;
+    ESP_LOGI(TAG, "Closing audio channel, send_goodbye: %d, received: %lu, lost: %lu, late: %lu, reordered: %lu, jitter: %d ms",
+        send_goodbye, stats.received, stats.lost, stats.late, stats.reordered, (int)stats.jitter_ms);
 
     // Only send goodbye when client initiates the close
     // Don't send if server already sent goodbye (to avoid ping-pong)
@@ -203,6 +294,15 @@ void MqttProtocol::CloseAudioChannel(bool send_goodbye) {
         std::string message = "{";
         message += "\"session_id\":\"" + session_id_ + "\",";
         message += "\"type\":\"goodbye\"";
+        if (stats.received > 0) {
+            auto json = CreateReceiveStats();
+            auto json_str = cJSON_PrintUnformatted(json);
+            message += ",\"stats\":";
+            message += json_str;
+            cJSON_free(json_str);
+            cJSON_Delete(json);
+        }
+        AppendLatencyReport(message);
         message += "}";
         SendText(message);
     }
@@ -212,6 +312,44 @@ void MqttProtocol::CloseAudioChannel(bool send_goodbye) {
     }
 }
 
+void MqttProtocol::SwitchNetwork() {
+    // The UDP channel is bound to the old interface, a lease does not survive the switch
+    resume_supported_ = false;
+    if (IsAudioChannelOpened()) {
+        CloseAudioChannel(false);
+    }
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        udp_.reset();
+    }
+    StartMqttClient(false);
+}
+
+bool MqttProtocol::ResumeSession() {
+    error_occurred_ = false;
+    xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+    if (!SendText(GetHelloMessage(true))) {
+        return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(3000));
+    if (!(bits & MQTT_PROTOCOL_SERVER_HELLO_EVENT)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        ClearReorderWindow();
+        receive_stats_ = {};
+        remote_timestamp_ = 0;
+        conceal_run_ = 0;
+    }
+    ESP_LOGI(TAG, "Session resumed on the leased UDP channel");
+    session_open_ = true;
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
 bool MqttProtocol::OpenAudioChannel() {
     if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
         ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
@@ -220,6 +358,14 @@ bool MqttProtocol::OpenAudioChannel() {
         }
     }
 
+    if (resume_supported_ && udp_ != nullptr && esp_timer_get_time() < lease_expire_us_) {
+        if (ResumeSession()) {
+            return true;
+        }
+        ESP_LOGW(TAG, "Failed to resume session, sending a new hello");
+    }
+    resume_supported_ = false;
+
     error_occurred_ = false;
     session_id_ = "";
     xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
@@ -238,6 +384,10 @@ bool MqttProtocol::OpenAudioChannel() {
     }
 
     std::lock_guard<std::mutex> lock(channel_mutex_);
+    ClearReorderWindow();
+    receive_stats_ = {};
+    remote_timestamp_ = 0;
+    conceal_run_ = 0;
     auto network = Board::GetInstance().GetNetwork();
     udp_ = network->CreateUdp(2);
     udp_->OnMessage([this](const std::string& data) {
@@ -246,7 +396,7 @@ bool MqttProtocol::OpenAudioChannel() {
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < MQTT_AUDIO_NONCE_SIZE) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
@@ -254,39 +404,39 @@ bool MqttProtocol::OpenAudioChannel() {
             ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
             return;
         }
-        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
-        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
+        // Between the sessions of a lease
+        if (!session_open_) {
             return;
         }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
-        }
+        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
+        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
 
-        size_t decrypted_size = data.size() - aes_nonce_.size();
+        size_t decrypted_size = data.size() - MQTT_AUDIO_NONCE_SIZE;
         size_t nc_off = 0;
         uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        auto packet = std::make_unique<AudioStreamPacket>();
+        /* The cipher advances the counter block, work on a copy of the header */
+        uint8_t nonce[MQTT_AUDIO_NONCE_SIZE];
+        memcpy(nonce, data.data(), sizeof(nonce));
+        auto encrypted = (const uint8_t*)data.data() + MQTT_AUDIO_NONCE_SIZE;
+        auto& audio_service = Application::GetInstance().GetAudioService();
+        auto packet = audio_service.AcquirePacket();
         packet->sample_rate = server_sample_rate_;
         packet->frame_duration = server_frame_duration_;
         packet->timestamp = timestamp;
+        /* Decrypt straight into the pooled packet */
         packet->payload.resize(decrypted_size);
         int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
         if (ret != 0) {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+            audio_service.ReleasePacket(std::move(packet));
             return;
         }
-        if (on_incoming_audio_ != nullptr) {
-            on_incoming_audio_(std::move(packet));
-        }
-        remote_sequence_ = sequence;
+        ReceiveAudio(sequence, std::move(packet));
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
     udp_->Connect(udp_server_, udp_port_);
+    session_open_ = true;
 
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
@@ -294,24 +444,184 @@ bool MqttProtocol::OpenAudioChannel() {
     return true;
 }
 
-std::string MqttProtocol::GetHelloMessage() {
+/*
+ * Runs on the UDP receive task. Packets ahead of a gap wait in the reorder window, a gap that
+ * is still open when the window is full is counted as lost and concealed by the decoder.
+ */
+void MqttProtocol::ReceiveAudio(uint32_t sequence, std::unique_ptr<AudioStreamPacket> packet) {
+    auto& stats = receive_stats_;
+    if (stats.received++ == 0) {
+        // The server may not start counting at 1
+        remote_sequence_ = sequence - 1;
+        stats.highest_sequence = sequence;
+    }
+    if (packet->timestamp != 0) {
+        int64_t transit_ms = esp_timer_get_time() / 1000 - packet->timestamp;
+        if (stats.has_transit) {
+            float d = (float)std::abs(transit_ms - stats.last_transit_ms);
+            stats.jitter_ms += (d - stats.jitter_ms) / 16;
+        }
+        stats.last_transit_ms = transit_ms;
+        stats.has_transit = true;
+    }
+
+    int32_t behind = (int32_t)(stats.highest_sequence - sequence);
+    if (behind > 0) {
+        stats.max_reorder_depth = std::max<uint32_t>(stats.max_reorder_depth, behind);
+    } else {
+        stats.highest_sequence = sequence;
+    }
+
+    int32_t ahead = (int32_t)(sequence - remote_sequence_ - 1);
+    if (ahead < 0) {
+        ESP_LOGW(TAG, "Drop late audio packet, sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        stats.late++;
+        Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+        return;
+    }
+    if (behind > 0) {
+        stats.reordered++;
+    }
+    if (ahead >= MQTT_REORDER_WINDOW) {
+        SkipReorderWindow(sequence - MQTT_REORDER_WINDOW);
+    }
+    if (sequence == remote_sequence_ + 1) {
+        remote_sequence_ = sequence;
+        DeliverAudio(std::move(packet));
+    } else {
+        auto& slot = reorder_window_[sequence % MQTT_REORDER_WINDOW];
+        if (slot != nullptr) {
+            stats.late++;
+            Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+            return;
+        }
+        slot = std::move(packet);
+        reorder_pending_++;
+    }
+    DrainReorderWindow();
+}
+
+// Give up on the sequences up to and including `sequence`
+void MqttProtocol::SkipReorderWindow(uint32_t sequence) {
+    int32_t count = (int32_t)(sequence - remote_sequence_);
+    ESP_LOGW(TAG, "Skip audio packets %lu-%lu", remote_sequence_ + 1, sequence);
+    /* Only the window can hold packets, the rest of a longer jump is lost */
+    for (int32_t i = 0; i < count && i < MQTT_REORDER_WINDOW; i++) {
+        remote_sequence_++;
+        auto& slot = reorder_window_[remote_sequence_ % MQTT_REORDER_WINDOW];
+        if (slot != nullptr) {
+            reorder_pending_--;
+            DeliverAudio(std::move(slot));
+        } else {
+            ConcealLostFrame();
+        }
+    }
+    if (count > MQTT_REORDER_WINDOW) {
+        receive_stats_.lost += count - MQTT_REORDER_WINDOW;
+        remote_sequence_ = sequence;
+    }
+}
+
+void MqttProtocol::DrainReorderWindow() {
+    while (reorder_pending_ > 0) {
+        auto& slot = reorder_window_[(remote_sequence_ + 1) % MQTT_REORDER_WINDOW];
+        if (slot == nullptr) {
+            return;
+        }
+        remote_sequence_++;
+        reorder_pending_--;
+        DeliverAudio(std::move(slot));
+    }
+}
+
+void MqttProtocol::DeliverAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    conceal_run_ = 0;
+    if (packet->timestamp != 0) {
+        remote_timestamp_ = packet->timestamp;
+    }
+    if (on_incoming_audio_ != nullptr) {
+        on_incoming_audio_(std::move(packet));
+    } else {
+        Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+    }
+}
+
+/* An empty packet in the place of the lost one makes the decoder run PLC */
+void MqttProtocol::ConcealLostFrame() {
+    receive_stats_.lost++;
+    if (remote_timestamp_ != 0) {
+        remote_timestamp_ += server_frame_duration_;
+    }
+    if (conceal_run_ >= MQTT_MAX_CONCEAL_FRAMES || on_incoming_audio_ == nullptr) {
+        return;
+    }
+    conceal_run_++;
+    auto packet = Application::GetInstance().GetAudioService().AcquirePacket();
+    packet->sample_rate = server_sample_rate_;
+    packet->frame_duration = server_frame_duration_;
+    packet->timestamp = remote_timestamp_;
+    packet->payload.clear();
+    on_incoming_audio_(std::move(packet));
+}
+
+void MqttProtocol::ClearReorderWindow() {
+    auto& audio_service = Application::GetInstance().GetAudioService();
+    for (auto& slot : reorder_window_) {
+        if (slot != nullptr) {
+            audio_service.ReleasePacket(std::move(slot));
+        }
+    }
+    reorder_pending_ = 0;
+}
+
+cJSON* MqttProtocol::CreateReceiveStats() const {
+    auto& stats = receive_stats_;
+    cJSON* json = cJSON_CreateObject();
+    uint32_t expected = stats.received - stats.late + stats.lost;
+    cJSON_AddNumberToObject(json, "received", stats.received);
+    cJSON_AddNumberToObject(json, "lost", stats.lost);
+    cJSON_AddNumberToObject(json, "loss_percent", expected > 0 ? (int)(stats.lost * 1000 / expected) / 10.0 : 0);
+    cJSON_AddNumberToObject(json, "late", stats.late);
+    cJSON_AddNumberToObject(json, "reordered", stats.reordered);
+    cJSON_AddNumberToObject(json, "max_reorder_depth", stats.max_reorder_depth);
+    cJSON_AddNumberToObject(json, "jitter_ms", (int)stats.jitter_ms);
+    return json;
+}
+
+std::string MqttProtocol::GetHelloMessage(bool resume) {
     // 发送 hello 消息申请 UDP 通道
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "type", "hello");
     cJSON_AddNumberToObject(root, "version", 3);
     cJSON_AddStringToObject(root, "transport", "udp");
+    if (resume) {
+        /* The UDP channel, key and audio params of the lease stay as they are */
+        cJSON_AddBoolToObject(root, "resume", true);
+        cJSON_AddStringToObject(root, "session_id", session_id_.c_str());
+        auto json_str = cJSON_PrintUnformatted(root);
+        std::string message(json_str);
+        cJSON_free(json_str);
+        cJSON_Delete(root);
+        return message;
+    }
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_MQTT_UDP_SESSION_LEASE
+    cJSON_AddBoolToObject(features, "resume", true);
+#endif
+#if CONFIG_MQTT_BINARY_CONTROL
+    cJSON_AddBoolToObject(features, "binary_control", true);
+#endif
+#if CONFIG_TTS_CACHE
+    if (TtsCache::GetInstance().available()) {
+        cJSON_AddBoolToObject(features, "tts_cache", true);
+    }
+#endif
     cJSON_AddItemToObject(root, "features", features);
-    cJSON* audio_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(audio_params, "format", "opus");
-    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
-    cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
-    cJSON_AddItemToObject(root, "audio_params", audio_params);
+    cJSON_AddItemToObject(root, "audio_params", CreateAudioParams());
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
     cJSON_free(json_str);
@@ -333,23 +643,35 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     }
 
     // Get sample rate from hello message
-    auto audio_params = cJSON_GetObjectItem(root, "audio_params");
-    if (cJSON_IsObject(audio_params)) {
-        auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
-        if (cJSON_IsNumber(sample_rate)) {
-            server_sample_rate_ = sample_rate->valueint;
-        }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (cJSON_IsNumber(frame_duration)) {
-            server_frame_duration_ = frame_duration->valueint;
-        }
-    }
+    ParseAudioParams(cJSON_GetObjectItem(root, "audio_params"));
 
     auto udp = cJSON_GetObjectItem(root, "udp");
     if (!cJSON_IsObject(udp)) {
+        // A resume reply keeps the channel of the lease
+        if (resume_supported_ && udp_ != nullptr) {
+            xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+            return;
+        }
         ESP_LOGE(TAG, "UDP is not specified");
         return;
     }
+#if CONFIG_MQTT_BINARY_CONTROL
+    auto server_features = cJSON_GetObjectItem(root, "features");
+    binary_control_ = cJSON_IsObject(server_features) && cJSON_IsTrue(cJSON_GetObjectItem(server_features, "binary_control"));
+    ESP_LOGI(TAG, "Control messages: %s", binary_control_ ? "binary" : "json");
+#endif
+#if CONFIG_MQTT_UDP_SESSION_LEASE
+    /* A lease is granted with the resume feature, for at most the configured idle time */
+    auto features = cJSON_GetObjectItem(root, "features");
+    if (cJSON_IsObject(features)) {
+        resume_supported_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "resume"));
+        auto lease = cJSON_GetObjectItem(udp, "lease");
+        lease_seconds_ = CONFIG_MQTT_UDP_SESSION_IDLE_S;
+        if (cJSON_IsNumber(lease)) {
+            lease_seconds_ = std::min(lease_seconds_, lease->valueint);
+        }
+    }
+#endif
     udp_server_ = cJSON_GetObjectItem(udp, "server")->valuestring;
     udp_port_ = cJSON_GetObjectItem(udp, "port")->valueint;
     auto key = cJSON_GetObjectItem(udp, "key")->valuestring;
@@ -357,11 +679,21 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
 
     // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
     // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
-    aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
-    local_sequence_ = 0;
-    remote_sequence_ = 0;
+    std::string aes_key = DecodeHexString(key);
+    std::string aes_nonce = DecodeHexString(nonce);
+    if (aes_nonce.size() != MQTT_AUDIO_NONCE_SIZE) {
+        ESP_LOGE(TAG, "Invalid UDP nonce size: %u", aes_nonce.size());
+        return;
+    }
+    /* The counter must not restart under the same key, a resumed lease may repeat it */
+    if (aes_key != aes_key_ || aes_nonce != aes_nonce_) {
+        aes_key_ = aes_key;
+        aes_nonce_ = aes_nonce;
+        mbedtls_aes_init(&aes_ctx_);
+        mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)aes_key_.c_str(), 128);
+        local_sequence_ = 0;
+        remote_sequence_ = 0;
+    }
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
@@ -385,5 +717,5 @@ std::string MqttProtocol::DecodeHexString(const std::string& hex_string) {
 }
 
 bool MqttProtocol::IsAudioChannelOpened() const {
-    return udp_ != nullptr && !error_occurred_ && !IsTimeout();
+    return udp_ != nullptr && session_open_ && !error_occurred_ && !IsTimeout();
 }
@@ -14,6 +14,7 @@
 #include <functional>
 #include <string>
 #include <map>
+#include <array>
 #include <mutex>
 #include <memory>
 #include <atomic>
@@ -22,6 +23,12 @@
 #define MQTT_RECONNECT_INTERVAL_MS 60000
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+// UDP audio header, also the AES-CTR nonce
+#define MQTT_AUDIO_NONCE_SIZE 16
+// Packets held back to put reordered UDP audio back in sequence
+#define MQTT_REORDER_WINDOW 4
+// Longest run of lost frames concealed with PLC, the rest of a longer gap is skipped
+#define MQTT_MAX_CONCEAL_FRAMES 3
 
 class MqttProtocol : public Protocol {
 public:
@@ -29,12 +36,30 @@ public:
     ~MqttProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel(bool send_goodbye = true) override;
     bool IsAudioChannelOpened() const override;
+    void SwitchNetwork() override;
+    void SendWakeWordDetected(const std::string& wake_word) override;
+    void SendStartListening(ListeningMode mode) override;
+    void SendStopListening() override;
+    void SendAbortSpeaking(AbortReason reason, int played_ms = -1) override;
 
 private:
+    // Downlink UDP audio quality of the current session, reported in goodbye
+    struct ReceiveStats {
+        uint32_t received = 0;
+        uint32_t lost = 0;
+        uint32_t late = 0;          // Duplicates and packets that arrived after their gap was skipped
+        uint32_t reordered = 0;     // Packets put back in sequence by the reorder window
+        uint32_t max_reorder_depth = 0;
+        uint32_t highest_sequence = 0;
+        float jitter_ms = 0;        // RFC 3550 interarrival jitter
+        bool has_transit = false;
+        int64_t last_transit_ms = 0;
+    };
+
     // Alive flag for safe scheduled callbacks - set to false in destructor
     std::shared_ptr<std::atomic<bool>> alive_ = std::make_shared<std::atomic<bool>>(true);
     
@@ -45,20 +70,46 @@ private:
     std::mutex channel_mutex_;
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
+    // Session lease: the server accepted "resume", the UDP channel and key outlive the session
+    bool resume_supported_ = false;
+    std::atomic<bool> session_open_{false};
+    int lease_seconds_ = 0;
+    int64_t lease_expire_us_ = 0;
+    // The server accepted binary_control in its hello: control and MCP messages go out as binary frames
+    bool binary_control_ = false;
     mbedtls_aes_context aes_ctx_;
+    std::string aes_key_;
     std::string aes_nonce_;
+    std::string send_buffer_;
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
     uint32_t remote_sequence_;
+    uint32_t remote_timestamp_ = 0;
+    int conceal_run_ = 0;
+    std::array<std::unique_ptr<AudioStreamPacket>, MQTT_REORDER_WINDOW> reorder_window_;
+    int reorder_pending_ = 0;
+    ReceiveStats receive_stats_;
     esp_timer_handle_t reconnect_timer_;
 
     bool StartMqttClient(bool report_error=false);
+    bool ResumeSession();
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
+    void ReceiveAudio(uint32_t sequence, std::unique_ptr<AudioStreamPacket> packet);
+    void SkipReorderWindow(uint32_t sequence);
+    void DrainReorderWindow();
+    void DeliverAudio(std::unique_ptr<AudioStreamPacket> packet);
+    void ConcealLostFrame();
+    void ClearReorderWindow();
+    cJSON* CreateReceiveStats() const;
 
     bool SendText(const std::string& text) override;
-    std::string GetHelloMessage();
+    bool SupportsMcpCbor() const override { return binary_control_; }
+    bool SendMcpCbor(std::string& frame) override;
+    // A BinaryProtocol3 control frame with the opcode and payload
+    bool SendControl(uint8_t opcode, const void* payload = nullptr, size_t size = 0);
+    std::string GetHelloMessage(bool resume = false);
 };
 
 
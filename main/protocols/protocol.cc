@@ -1,6 +1,11 @@
 #include "protocol.h"
+#include "json_scanner.h"
+#include "json_to_cbor.h"
+#include "application.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
 
 #define TAG "Protocol"
 
@@ -8,6 +13,10 @@ void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
+void Protocol::OnIncomingMessage(std::function<void(const IncomingMessage& message)> callback) {
+    on_incoming_message_ = callback;
+}
+
 void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
     on_incoming_audio_ = callback;
 }
@@ -32,6 +41,21 @@ void Protocol::OnDisconnected(std::function<void()> callback) {
     on_disconnected_ = callback;
 }
 
+void Protocol::OnLatencyReport(std::function<std::string()> callback) {
+    on_latency_report_ = callback;
+}
+
+void Protocol::AppendLatencyReport(std::string& message) {
+    if (on_latency_report_ == nullptr) {
+        return;
+    }
+    auto report = on_latency_report_();
+    if (!report.empty()) {
+        message += ",\"latency\":";
+        message += report;
+    }
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -39,15 +63,60 @@ void Protocol::SetError(const std::string& message) {
     }
 }
 
-void Protocol::SendAbortSpeaking(AbortReason reason) {
+/*
+ * Streaming tts / stt / llm events are read in place without building a cJSON tree,
+ * an MCP body is left for the receiver to parse on its own.
+ */
+bool Protocol::HandleIncomingMessage(std::string_view json) {
+    if (on_incoming_message_ == nullptr) {
+        return false;
+    }
+    IncomingMessage message;
+    JsonScanner scanner(json);
+    std::string_view key, value;
+    while (scanner.Next(key, value)) {
+        bool is_string = scanner.value_is_string();
+        if (key == "type" && is_string) {
+            message.type = value;
+        } else if (key == "state" && is_string) {
+            message.state = value;
+        } else if (key == "text" && is_string) {
+            message.text = value;
+        } else if (key == "emotion" && is_string) {
+            message.emotion = value;
+        } else if (key == "payload" && !is_string) {
+            message.payload = value;
+        }
+    }
+    if (scanner.error()) {
+        return false;
+    }
+    if (message.type != "tts" && message.type != "stt" && message.type != "llm" && message.type != "mcp") {
+        return false;
+    }
+    on_incoming_message_(message);
+    return true;
+}
+
+void Protocol::SendAbortSpeaking(AbortReason reason, int played_ms) {
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
         message += ",\"reason\":\"wake_word_detected\"";
     }
+    if (played_ms >= 0) {
+        message += ",\"played_ms\":" + std::to_string(played_ms);
+    }
     message += "}";
     SendText(message);
 }
 
+void Protocol::SendTtsCacheStatus(const std::string& hash, const char* state) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"tts_cache\",\"state\":\"";
+    message += state;
+    message += "\",\"hash\":\"" + hash + "\"}";
+    SendText(message);
+}
+
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
@@ -74,8 +143,77 @@ void Protocol::SendStopListening() {
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
-    SendText(message);
+    if (mcp_cbor_) {
+        /* The session is implied by the connection, only the payload is sent */
+        std::string frame;
+        frame.reserve(sizeof(BinaryProtocol3) + payload.size());
+        frame.resize(sizeof(BinaryProtocol3));
+        if (JsonToCbor::Convert(payload, frame)) {
+            text_queue_.push_back({std::move(frame), esp_timer_get_time(), true});
+            return;
+        }
+        ESP_LOGW(TAG, "MCP payload is not valid JSON, sending it as text");
+    }
+
+    // Reserved up front, a large result such as an image would otherwise be reallocated while appending
+    std::string message;
+    message.reserve(payload.size() + session_id_.size() + 48);
+    message += "{\"session_id\":\"";
+    message += session_id_;
+    message += "\",\"type\":\"mcp\",\"payload\":";
+    message += payload;
+    message += "}";
+    text_queue_.push_back({std::move(message), esp_timer_get_time()});
+}
+
+void Protocol::SetMcpCbor(bool enable) {
+    mcp_cbor_ = enable && SupportsMcpCbor();
+    if (enable && !mcp_cbor_) {
+        ESP_LOGW(TAG, "MCP CBOR requested but the transport has no binary frames for it");
+    }
+    ESP_LOGI(TAG, "MCP encoding: %s", mcp_cbor_ ? "cbor" : "json");
+}
+
+bool Protocol::TransmitAudio(AudioStreamPacket& packet) {
+    size_t size = packet.payload_size();
+    if (!SendAudio(packet)) {
+        return false;
+    }
+    auto& stats = transmit_stats_[kTransmitAudio];
+    stats.messages++;
+    stats.bytes += size;
+    if (!text_queue_.empty()) {
+        audio_preemptions_++;
+    }
+    return true;
+}
+
+/*
+ * A websocket text message cannot be interleaved with binary frames, even when fragmented,
+ * so each message goes out whole and the audio gets its turn in between messages.
+ */
+void Protocol::SendQueuedText() {
+    if (text_queue_.empty()) {
+        return;
+    }
+    auto item = std::move(text_queue_.front());
+    text_queue_.pop_front();
+    auto& stats = transmit_stats_[kTransmitMcp];
+    stats.max_wait_us = std::max(stats.max_wait_us, esp_timer_get_time() - item.queued_us);
+    bool sent = item.cbor ? SendMcpCbor(item.text) : SendText(item.text);
+    if (sent) {
+        stats.messages++;
+        stats.bytes += item.text.size();
+    }
+}
+
+void Protocol::LogTransmitStats() {
+    auto& audio = transmit_stats_[kTransmitAudio];
+    auto& mcp = transmit_stats_[kTransmitMcp];
+    ESP_LOGI(TAG, "Sent audio: %lu frames %lu bytes, mcp: %lu messages %lu bytes, max wait %lld ms, audio preemptions: %lu",
+        audio.messages, audio.bytes, mcp.messages, mcp.bytes, mcp.max_wait_us / 1000, audio_preemptions_);
+    transmit_stats_ = {};
+    audio_preemptions_ = 0;
 }
 
 bool Protocol::IsTimeout() const {
@@ -88,3 +226,59 @@ bool Protocol::IsTimeout() const {
     }
     return timeout;
 }
+
+cJSON* Protocol::CreateAudioParams() {
+    auto settings = Application::GetInstance().GetAudioService().GetEncoderSettings();
+    cJSON* audio_params = cJSON_CreateObject();
+    cJSON_AddStringToObject(audio_params, "format", "opus");
+    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
+    cJSON_AddNumberToObject(audio_params, "channels", 1);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", settings.frame_duration_ms);
+    // Uplink encoder options the server may choose from in its hello (audio_params.uplink)
+    cJSON* uplink = cJSON_CreateObject();
+    int frame_durations[] = {20, 40, 60};
+    cJSON_AddItemToObject(uplink, "frame_durations", cJSON_CreateIntArray(frame_durations, 3));
+    cJSON_AddNumberToObject(uplink, "bitrate", settings.bitrate);
+    cJSON_AddNumberToObject(uplink, "complexity", settings.complexity);
+    cJSON_AddBoolToObject(uplink, "fec", settings.enable_fec);
+    cJSON_AddItemToObject(audio_params, "uplink", uplink);
+    return audio_params;
+}
+
+void Protocol::ParseAudioParams(const cJSON* audio_params) {
+    if (!cJSON_IsObject(audio_params)) {
+        return;
+    }
+    auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
+    if (cJSON_IsNumber(sample_rate)) {
+        server_sample_rate_ = sample_rate->valueint;
+    }
+    auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
+    if (cJSON_IsNumber(frame_duration)) {
+        server_frame_duration_ = frame_duration->valueint;
+    }
+
+    auto uplink = cJSON_GetObjectItem(audio_params, "uplink");
+    if (!cJSON_IsObject(uplink)) {
+        return;
+    }
+    auto& audio_service = Application::GetInstance().GetAudioService();
+    auto settings = audio_service.GetEncoderSettings();
+    auto item = cJSON_GetObjectItem(uplink, "frame_duration");
+    if (cJSON_IsNumber(item)) {
+        settings.frame_duration_ms = item->valueint;
+    }
+    item = cJSON_GetObjectItem(uplink, "bitrate");
+    if (cJSON_IsNumber(item)) {
+        settings.bitrate = item->valueint;
+    }
+    item = cJSON_GetObjectItem(uplink, "complexity");
+    if (cJSON_IsNumber(item)) {
+        settings.complexity = item->valueint;
+    }
+    item = cJSON_GetObjectItem(uplink, "fec");
+    if (cJSON_IsBool(item)) {
+        settings.enable_fec = cJSON_IsTrue(item);
+    }
+    audio_service.SetEncoderSettings(settings);
+}
@@ -6,30 +6,90 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <string_view>
+#include <deque>
+#include <array>
+
+// AudioStreamPacket::flags, sent in the reserved / flags byte of the binary protocols
+#define AUDIO_PACKET_FLAG_END_OF_UTTERANCE 0x01
+// The silence since the previous packet was suppressed by the device, not lost
+#define AUDIO_PACKET_FLAG_SILENCE 0x02
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint8_t flags = 0;
+    // Latency tracing (esp_timer_get_time() of the first / previous pipeline stage)
+    int64_t trace_origin_us = 0;
+    int64_t trace_last_us = 0;
+    // The first `headroom` bytes of payload are reserved, so a protocol header can be written in place
+    size_t headroom = 0;
     std::vector<uint8_t> payload;
+
+    uint8_t* payload_data() { return payload.data() + headroom; }
+    const uint8_t* payload_data() const { return payload.data() + headroom; }
+    size_t payload_size() const { return payload.size() - headroom; }
 };
 
 struct BinaryProtocol2 {
     uint16_t version;
     uint16_t type;          // Message type (0: OPUS, 1: JSON)
-    uint32_t reserved;      // Reserved for future use
+    uint32_t reserved;      // Packet flags (AUDIO_PACKET_FLAG_*)
     uint32_t timestamp;     // Timestamp in milliseconds (used for server-side AEC)
     uint32_t payload_size;  // Payload size in bytes
     uint8_t payload[];      // Payload data
 } __attribute__((packed));
 
+// BinaryProtocol3 type 2: the payload is a sequence of type 0 BinaryProtocol3 packets
+#define BINARY_PROTOCOL3_TYPE_OPUS_BATCH 2
+// BinaryProtocol3 type 3: an MCP payload in CBOR, it runs to the end of the frame
+#define BINARY_PROTOCOL3_TYPE_MCP_CBOR 3
+// BinaryProtocol3 type 4: a control message, reserved holds its BINARY_CONTROL_* opcode
+#define BINARY_PROTOCOL3_TYPE_CONTROL 4
+// BinaryProtocol3 type 5: a JSON message compressed by JsonDeflate, it runs to the end of the frame
+#define BINARY_PROTOCOL3_TYPE_JSON_DEFLATE 5
+
+// Payload: 1 byte ListeningMode
+#define BINARY_CONTROL_LISTEN_START 1
+#define BINARY_CONTROL_LISTEN_STOP 2
+// Payload: the wake word in UTF-8
+#define BINARY_CONTROL_LISTEN_DETECT 3
+// Payload: 1 byte AbortReason, then the played ms as uint32 in network order if known
+#define BINARY_CONTROL_ABORT 4
+
+// Headroom reserved in front of encoded packets, enough for the largest binary protocol header
+#define AUDIO_PACKET_HEADROOM sizeof(BinaryProtocol2)
+
 struct BinaryProtocol3 {
-    uint8_t type;
-    uint8_t reserved;
+    uint8_t type;           // Message type (0: OPUS, 1: JSON, 2: OPUS batch, 3: MCP CBOR)
+    uint8_t reserved;       // Packet flags (AUDIO_PACKET_FLAG_*)
     uint16_t payload_size;
     uint8_t payload[];
 } __attribute__((packed));
 
+// Top-level fields of a frequent control message, viewed in place in the received frame
+struct IncomingMessage {
+    std::string_view type;
+    std::string_view state;
+    std::string_view text;      // Still JSON escaped, see JsonScanner::Unescape()
+    std::string_view emotion;
+    std::string_view payload;   // Raw JSON of an MCP body
+};
+
+// Traffic classes of the transmit scheduler, audio always goes first
+enum TransmitClass {
+    kTransmitAudio,
+    kTransmitMcp,
+    kTransmitClassCount
+};
+
+struct TransmitStats {
+    uint32_t messages = 0;
+    uint32_t bytes = 0;
+    int64_t max_wait_us = 0;    // Longest time a message waited behind audio
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -57,31 +117,54 @@ public:
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // tts, stt, llm and mcp messages, they skip the cJSON tree of OnIncomingJson()
+    void OnIncomingMessage(std::function<void(const IncomingMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
     void OnConnected(std::function<void()> callback);
     void OnDisconnected(std::function<void()> callback);
+    // Asked for the "latency" object of the goodbye message, an empty string leaves it out
+    void OnLatencyReport(std::function<std::string()> callback);
 
     virtual bool Start() = 0;
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel(bool send_goodbye = true) = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    // Drops the connections of the previous network interface, the next ones use Board::GetNetwork()
+    virtual void SwitchNetwork() {}
+    // May write a header into the packet headroom
+    virtual bool SendAudio(AudioStreamPacket& packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
-    virtual void SendAbortSpeaking(AbortReason reason);
+    // played_ms: how much of the reply the user heard, negative if unknown
+    virtual void SendAbortSpeaking(AbortReason reason, int played_ms = -1);
+    // Answers a tts_cache play: "done" once the phrase is queued for playback, "miss" if it has to be streamed
+    virtual void SendTtsCacheStatus(const std::string& hash, const char* state);
+    // Queued for SendQueuedText() so a large tool result never holds up an audio frame
     virtual void SendMcpMessage(const std::string& message);
+    // Negotiated in the MCP initialize, later MCP messages go out as CBOR if the transport has binary frames
+    void SetMcpCbor(bool enable);
+
+    // Audio into the transport, counted in the transmit stats
+    bool TransmitAudio(AudioStreamPacket& packet);
+    bool HasQueuedText() const { return !text_queue_.empty(); }
+    // Sends one queued message, call when no audio is waiting
+    void SendQueuedText();
+    // Logs and resets the transmit stats of the session
+    void LogTransmitStats();
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(const IncomingMessage& message)> on_incoming_message_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
     std::function<void()> on_connected_;
     std::function<void()> on_disconnected_;
+    std::function<std::string()> on_latency_report_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
@@ -89,9 +172,31 @@ protected:
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
+    struct QueuedText {
+        std::string text;
+        int64_t queued_us;
+        bool cbor = false;  // A CBOR MCP frame with sizeof(BinaryProtocol3) bytes reserved in front
+    };
+    std::deque<QueuedText> text_queue_;
+    std::array<TransmitStats, kTransmitClassCount> transmit_stats_;
+    uint32_t audio_preemptions_ = 0;    // Audio frames sent while text was queued
+    bool mcp_cbor_ = false;
+
     virtual bool SendText(const std::string& text) = 0;
+    virtual bool SupportsMcpCbor() const { return false; }
+    // Writes the frame header into the reserved bytes in front of the CBOR
+    virtual bool SendMcpCbor(std::string& frame) { return false; }
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    // Returns false if the message needs cJSON
+    bool HandleIncomingMessage(std::string_view json);
+
+    // Appends ,"latency":{...} to a goodbye message being built
+    void AppendLatencyReport(std::string& message);
+
+    // Shared by the hello messages of all transports
+    cJSON* CreateAudioParams();
+    void ParseAudioParams(const cJSON* audio_params);
 };
 
 #endif // PROTOCOL_H
@@ -0,0 +1,92 @@
+#include "video_channel.h"
+#include "board.h"
+#include "settings.h"
+#include "system_info.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <arpa/inet.h>
+#include <cstring>
+
+#include "linux/videodev2.h"
+
+#define TAG "VideoChannel"
+
+bool VideoChannel::Start(Camera* camera, const std::string& url, const VideoStreamConfig& config) {
+    Stop();
+
+    Settings settings("websocket", false);
+    std::string token = settings.GetString("token");
+
+    auto network = Board::GetInstance().GetNetwork();
+    auto websocket = network->CreateWebSocket(4);
+    if (websocket == nullptr) {
+        ESP_LOGE(TAG, "Failed to create websocket");
+        return false;
+    }
+    if (!token.empty()) {
+        // If token not has a space, add "Bearer " prefix
+        if (token.find(" ") == std::string::npos) {
+            token = "Bearer " + token;
+        }
+        websocket->SetHeader("Authorization", token.c_str());
+    }
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    if (!websocket->Connect(url.c_str())) {
+        ESP_LOGE(TAG, "Failed to connect to %s, code=%d", url.c_str(), websocket->GetLastError());
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        websocket_ = std::move(websocket);
+        start_time_us_ = esp_timer_get_time();
+        sent_ = 0;
+        failed_ = 0;
+    }
+    if (!camera->StartVideoStream(config, [this](const CameraFrame& frame) { SendFrame(frame); })) {
+        ESP_LOGE(TAG, "The camera cannot stream video");
+        std::lock_guard<std::mutex> lock(mutex_);
+        websocket_.reset();
+        return false;
+    }
+    camera_ = camera;
+    ESP_LOGI(TAG, "Video channel open to %s", url.c_str());
+    return true;
+}
+
+void VideoChannel::Stop() {
+    if (camera_ == nullptr) {
+        return;
+    }
+    // No callback runs once StopStreaming() returns
+    camera_->StopStreaming();
+    camera_ = nullptr;
+    std::lock_guard<std::mutex> lock(mutex_);
+    websocket_.reset();
+    send_buffer_.clear();
+    send_buffer_.shrink_to_fit();
+    ESP_LOGI(TAG, "Video channel closed, %lu frames sent, %lu failed", sent_.load(), failed_.load());
+}
+
+void VideoChannel::SendFrame(const CameraFrame& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return;
+    }
+    send_buffer_.resize(sizeof(VideoFrameHeader) + frame.len);
+    auto header = reinterpret_cast<VideoFrameHeader*>(send_buffer_.data());
+    header->codec = frame.format == V4L2_PIX_FMT_H264 ? 1 : 0;
+    header->flags = frame.keyframe ? VIDEO_FRAME_FLAG_KEYFRAME : 0;
+    header->width = htons(frame.width);
+    header->height = htons(frame.height);
+    header->reserved = 0;
+    header->timestamp_ms = htonl((frame.timestamp_us - start_time_us_) / 1000);
+    memcpy(send_buffer_.data() + sizeof(VideoFrameHeader), frame.data, frame.len);
+    if (websocket_->Send(send_buffer_.data(), send_buffer_.size(), true)) {
+        sent_++;
+    } else {
+        failed_++;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef VIDEO_CHANNEL_H
+#define VIDEO_CHANNEL_H
+
+#include <web_socket.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+
+// Ahead of each encoded frame in a binary websocket message, multi-byte fields in network order
+struct VideoFrameHeader {
+    uint8_t codec;          // 0: JPEG, 1: H.264 Annex B
+    uint8_t flags;          // VIDEO_FRAME_FLAG_*
+    uint16_t width;
+    uint16_t height;
+    uint16_t reserved;
+    uint32_t timestamp_ms;  // Capture time since the stream started
+} __attribute__((packed));
+
+#define VIDEO_FRAME_FLAG_KEYFRAME 0x01
+
+/*
+ * A video session on its own websocket, next to the conversation channel: the camera's hardware
+ * encoder output goes to url one frame per binary message, authenticated like the conversation
+ * channel. Frames are sent from the camera's consumer task; while a send is slow the camera
+ * stream drops the frames in between, so the picture stays live rather than falling behind.
+ */
+class VideoChannel {
+public:
+    static VideoChannel& GetInstance() {
+        static VideoChannel instance;
+        return instance;
+    }
+
+    // Main task. Connects to url and starts the camera video stream, replacing a running one
+    bool Start(Camera* camera, const std::string& url, const VideoStreamConfig& config);
+    void Stop();
+    bool active() const { return camera_ != nullptr; }
+
+private:
+    std::mutex mutex_;
+    Camera* camera_ = nullptr;
+    std::unique_ptr<WebSocket> websocket_;
+    std::vector<uint8_t> send_buffer_;  // Consumer task only, reused across frames
+    int64_t start_time_us_ = 0;
+    std::atomic<uint32_t> sent_{0};
+    std::atomic<uint32_t> failed_{0};
+
+    VideoChannel() = default;
+
+    void SendFrame(const CameraFrame& frame);
+};
+
+#endif // VIDEO_CHANNEL_H
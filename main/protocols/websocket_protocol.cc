@@ -3,8 +3,13 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "cjson_arena.h"
+#if CONFIG_TTS_CACHE
+#include "tts_cache.h"
+#endif
 
 #include <cstring>
+#include <cstdint>
 #include <cJSON.h>
 #include <esp_log.h>
 #include <arpa/inet.h>
@@ -14,9 +19,33 @@
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+
+#if CONFIG_WEBSOCKET_PERSISTENT_CONNECTION
+    esp_timer_create_args_t keepalive_timer_args = {
+        .callback = [](void* arg) {
+            auto protocol = (WebsocketProtocol*)arg;
+            auto alive = protocol->alive_;  // Capture alive flag
+            Application::GetInstance().Schedule([protocol, alive]() {
+                if (*alive) {
+                    protocol->SendKeepalive();
+                }
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_keepalive",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&keepalive_timer_args, &keepalive_timer_);
+#endif
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    *alive_ = false;
+    if (keepalive_timer_ != nullptr) {
+        esp_timer_stop(keepalive_timer_);
+        esp_timer_delete(keepalive_timer_);
+    }
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -25,36 +54,102 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool WebsocketProtocol::SendAudio(AudioStreamPacket& packet) {
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
+    if (version_ != 2 && version_ != 3) {
+        return websocket_->Send(packet.payload_data(), packet.payload_size(), true);
+    }
+    if (version_ == 3 && audio_batch_) {
+        return BatchAudio(packet);
+    }
+
+    size_t header_size = version_ == 2 ? sizeof(BinaryProtocol2) : sizeof(BinaryProtocol3);
+    size_t payload_size = packet.payload_size();
+    uint8_t* frame;
+    if (packet.headroom >= header_size) {
+        /* Write the header in front of the payload, the frame is sent without a copy */
+        frame = packet.payload_data() - header_size;
+    } else {
+        /* Packets built without headroom (e.g. the wake word) go through the send buffer */
+        send_buffer_.resize(header_size + payload_size);
+        memcpy(send_buffer_.data() + header_size, packet.payload_data(), payload_size);
+        frame = send_buffer_.data();
+    }
 
     if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
+        auto bp2 = (BinaryProtocol2*)frame;
         bp2->version = htons(version_);
         bp2->type = 0;
-        bp2->reserved = 0;
-        bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp2->reserved = htonl(packet.flags);
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(payload_size);
+    } else {
+        auto bp3 = (BinaryProtocol3*)frame;
         bp3->type = 0;
-        bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
+        bp3->reserved = packet.flags;
+        bp3->payload_size = htons(payload_size);
+    }
+    return websocket_->Send(frame, header_size + payload_size, true);
+}
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+bool WebsocketProtocol::BatchAudio(const AudioStreamPacket& packet) {
+    size_t size = sizeof(BinaryProtocol3) + packet.payload_size();
+    if (sizeof(BinaryProtocol3) + batch_buffer_.size() + size > UINT16_MAX && !FlushAudioBatch()) {
+        return false;
+    }
+    if (batch_buffer_.empty()) {
+        batch_buffer_.resize(sizeof(BinaryProtocol3));
+        batch_duration_ms_ = 0;
+    }
+    size_t offset = batch_buffer_.size();
+    batch_buffer_.resize(offset + size);
+    auto bp3 = (BinaryProtocol3*)(batch_buffer_.data() + offset);
+    bp3->type = 0;
+    bp3->reserved = packet.flags;
+    bp3->payload_size = htons(packet.payload_size());
+    memcpy(bp3->payload, packet.payload_data(), packet.payload_size());
+    batch_duration_ms_ += packet.frame_duration;
+
+    /* The server can finish ASR as soon as the utterance ends, do not hold it back */
+    if (batch_duration_ms_ >= CONFIG_AUDIO_UPLINK_BATCH_MS || (packet.flags & AUDIO_PACKET_FLAG_END_OF_UTTERANCE)) {
+        return FlushAudioBatch();
     }
+    return true;
+}
+
+bool WebsocketProtocol::FlushAudioBatch() {
+    if (batch_buffer_.empty()) {
+        return true;
+    }
+    auto bp3 = (BinaryProtocol3*)batch_buffer_.data();
+    bp3->type = BINARY_PROTOCOL3_TYPE_OPUS_BATCH;
+    bp3->reserved = 0;
+    bp3->payload_size = htons(batch_buffer_.size() - sizeof(BinaryProtocol3));
+    bool sent = websocket_->Send(batch_buffer_.data(), batch_buffer_.size(), true);
+    batch_buffer_.clear();
+    return sent;
+}
+
+bool WebsocketProtocol::SendMcpCbor(std::string& frame) {
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+    FlushAudioBatch();
+
+    /* payload_size is only informative, the payload of an MCP frame runs to the end of the frame */
+    size_t payload_size = frame.size() - sizeof(BinaryProtocol3);
+    auto bp3 = (BinaryProtocol3*)frame.data();
+    bp3->type = BINARY_PROTOCOL3_TYPE_MCP_CBOR;
+    bp3->reserved = 0;
+    bp3->payload_size = htons(payload_size > UINT16_MAX ? 0 : payload_size);
+    if (!websocket_->Send(frame.data(), frame.size(), true)) {
+        ESP_LOGE(TAG, "Failed to send MCP frame of %u bytes", frame.size());
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    return true;
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
@@ -62,7 +157,10 @@ bool WebsocketProtocol::SendText(const std::string& text) {
         return false;
     }
 
-    if (!websocket_->Send(text)) {
+    /* Keep the audio ahead of messages such as listen stop */
+    FlushAudioBatch();
+
+    if (!SendTextFrame(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
@@ -71,16 +169,146 @@ bool WebsocketProtocol::SendText(const std::string& text) {
     return true;
 }
 
+bool WebsocketProtocol::SendTextFrame(const std::string& text) {
+#if CONFIG_WEBSOCKET_JSON_DEFLATE
+    if (json_deflate_ != nullptr) {
+        std::string frame(sizeof(BinaryProtocol3), '\0');
+        if (json_deflate_->Compress(text, frame)) {
+            /* Like MCP frames, payload_size is 0 when the payload does not fit in it */
+            size_t payload_size = frame.size() - sizeof(BinaryProtocol3);
+            auto bp3 = (BinaryProtocol3*)frame.data();
+            bp3->type = BINARY_PROTOCOL3_TYPE_JSON_DEFLATE;
+            bp3->reserved = 0;
+            bp3->payload_size = htons(payload_size > UINT16_MAX ? 0 : payload_size);
+            return websocket_->Send(frame.data(), frame.size(), true);
+        }
+        // Only our stream broke, the server still reads plain text frames
+    }
+#endif
+    return websocket_->Send(text);
+}
+
+void WebsocketProtocol::HandleDeflatedText(const uint8_t* data, size_t len) {
+    if (json_deflate_ == nullptr || !json_deflate_->Decompress(data, len, inflate_buffer_)) {
+        ESP_LOGE(TAG, "Failed to inflate a JSON message of %u bytes", len);
+        SetError(Lang::Strings::SERVER_ERROR);
+        return;
+    }
+    HandleText(inflate_buffer_.data(), inflate_buffer_.size());
+}
+
+void WebsocketProtocol::HandleText(const char* data, size_t len) {
+    // The message and any reply built while handling it are freed at once
+    CjsonArenaScope arena;
+    if (HandleIncomingMessage(std::string_view(data, len))) {
+        return;
+    }
+    // Parse JSON data
+    auto root = cJSON_ParseWithLength(data, len);
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type)) {
+        if (strcmp(type->valuestring, "hello") == 0) {
+            ParseServerHello(root);
+        } else if (strcmp(type->valuestring, "goodbye") == 0 && resume_supported_) {
+            auto alive = alive_;  // Capture alive flag
+            Application::GetInstance().Schedule([this, alive]() {
+                if (*alive) {
+                    // Server initiated goodbye, don't send goodbye back to avoid ping-pong
+                    CloseAudioChannel(false);
+                }
+            });
+        } else {
+            if (on_incoming_json_ != nullptr) {
+                on_incoming_json_(root);
+            }
+        }
+    } else {
+        ESP_LOGE(TAG, "Missing message type, data: %s", data);
+    }
+    cJSON_Delete(root);
+}
+
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    return websocket_ != nullptr && websocket_->IsConnected() && session_open_ && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel(bool send_goodbye) {
-    (void)send_goodbye;  // Websocket doesn't need to send goodbye message
+    batch_buffer_.clear();
+    if (resume_supported_ && websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_) {
+        /* Keep the socket for the next session, only end this one */
+        if (send_goodbye && session_open_) {
+            std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"goodbye\"";
+            AppendLatencyReport(message);
+            message += "}";
+            SendText(message);
+        }
+        bool was_open = session_open_;
+        session_open_ = false;
+        if (was_open && on_audio_channel_closed_ != nullptr) {
+            on_audio_channel_closed_();
+        }
+        return;
+    }
+    // Without a persistent connection the server ends the session when the socket closes
+    session_open_ = false;
+    resume_supported_ = false;
+    if (keepalive_timer_ != nullptr) {
+        esp_timer_stop(keepalive_timer_);
+    }
     websocket_.reset();
+    if (json_deflate_ != nullptr) {
+        ESP_LOGI(TAG, "JSON sent deflated: %u -> %u bytes", json_deflate_->raw_bytes(), json_deflate_->compressed_bytes());
+        json_deflate_.reset();
+    }
+}
+
+void WebsocketProtocol::SwitchNetwork() {
+    // The socket is bound to the old interface, close it even if it is persistent
+    resume_supported_ = false;
+    CloseAudioChannel(false);
+}
+
+bool WebsocketProtocol::ResumeSession() {
+    error_occurred_ = false;
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+    if (!SendText(GetHelloMessage(true))) {
+        return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(3000));
+    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Session resumed on the open connection");
+    session_open_ = true;
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+void WebsocketProtocol::SendKeepalive() {
+    /* Sessions carry their own traffic, only an idle connection needs keeping warm */
+    if (session_open_ || websocket_ == nullptr || !websocket_->IsConnected()) {
+        return;
+    }
+    if (!websocket_->Send("{\"type\":\"keepalive\"}")) {
+        ESP_LOGW(TAG, "Keepalive failed, the next session reconnects");
+        resume_supported_ = false;
+    }
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    if (resume_supported_ && websocket_ != nullptr && websocket_->IsConnected()) {
+        if (ResumeSession()) {
+            return true;
+        }
+        ESP_LOGW(TAG, "Failed to resume session, reconnecting");
+        /* Dropped while resume_supported_ is still set, so no channel closed event fires */
+        websocket_.reset();
+    }
+    resume_supported_ = false;
+    session_open_ = false;
+
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
@@ -90,6 +318,10 @@ bool WebsocketProtocol::OpenAudioChannel() {
     }
 
     error_occurred_ = false;
+    audio_batch_ = false;
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+    batch_buffer_.clear();
+    json_deflate_.reset();
 
     auto network = Board::GetInstance().GetNetwork();
     websocket_ = network->CreateWebSocket(1);
@@ -110,6 +342,13 @@ bool WebsocketProtocol::OpenAudioChannel() {
     websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
+#if CONFIG_WEBSOCKET_JSON_DEFLATE
+        if (binary && version_ == 3 && len >= sizeof(BinaryProtocol3) && data[0] == BINARY_PROTOCOL3_TYPE_JSON_DEFLATE) {
+            HandleDeflatedText((const uint8_t*)data + sizeof(BinaryProtocol3), len - sizeof(BinaryProtocol3));
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            return;
+        }
+#endif
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
                 if (version_ == 2) {
@@ -119,55 +358,45 @@ bool WebsocketProtocol::OpenAudioChannel() {
                     bp2->timestamp = ntohl(bp2->timestamp);
                     bp2->payload_size = ntohl(bp2->payload_size);
                     auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
+                    auto packet = Application::GetInstance().GetAudioService().AcquirePacket();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->timestamp = bp2->timestamp;
+                    packet->payload.assign(payload, payload + bp2->payload_size);
+                    on_incoming_audio_(std::move(packet));
                 } else if (version_ == 3) {
                     BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
                     bp3->type = bp3->type;
                     bp3->payload_size = ntohs(bp3->payload_size);
                     auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
+                    auto packet = Application::GetInstance().GetAudioService().AcquirePacket();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->timestamp = 0;
+                    packet->payload.assign(payload, payload + bp3->payload_size);
+                    on_incoming_audio_(std::move(packet));
                 } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
+                    auto packet = Application::GetInstance().GetAudioService().AcquirePacket();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->timestamp = 0;
+                    packet->payload.assign((uint8_t*)data, (uint8_t*)data + len);
+                    on_incoming_audio_(std::move(packet));
                 }
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
-                    ParseServerHello(root);
-                } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
-                }
-            } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
-            }
-            cJSON_Delete(root);
+            HandleText(data, len);
         }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
     websocket_->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
-        if (on_audio_channel_closed_ != nullptr) {
+        bool was_open = session_open_ || !resume_supported_;
+        session_open_ = false;
+        resume_supported_ = false;
+        // An idle persistent connection has no session to close
+        if (was_open && on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
@@ -193,6 +422,13 @@ bool WebsocketProtocol::OpenAudioChannel() {
         return false;
     }
 
+    session_open_ = true;
+#if CONFIG_WEBSOCKET_PERSISTENT_CONNECTION
+    if (resume_supported_ && keepalive_timer_ != nullptr) {
+        esp_timer_stop(keepalive_timer_);
+        esp_timer_start_periodic(keepalive_timer_, CONFIG_WEBSOCKET_KEEPALIVE_INTERVAL_S * 1000000ULL);
+    }
+#endif
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -200,24 +436,52 @@ bool WebsocketProtocol::OpenAudioChannel() {
     return true;
 }
 
-std::string WebsocketProtocol::GetHelloMessage() {
+std::string WebsocketProtocol::GetHelloMessage(bool resume) {
     // keys: message type, version, audio_params (format, sample_rate, channels)
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "type", "hello");
     cJSON_AddNumberToObject(root, "version", version_);
+    if (resume) {
+        /* The server still has the features and audio params of the previous session */
+        cJSON_AddBoolToObject(root, "resume", true);
+        cJSON_AddStringToObject(root, "session_id", session_id_.c_str());
+        cJSON_AddStringToObject(root, "transport", "websocket");
+        auto json_str = cJSON_PrintUnformatted(root);
+        std::string message(json_str);
+        cJSON_free(json_str);
+        cJSON_Delete(root);
+        return message;
+    }
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_WEBSOCKET_PERSISTENT_CONNECTION
+    cJSON_AddBoolToObject(features, "resume", true);
+#endif
+#if CONFIG_AUDIO_UPLINK_BATCH_MS > 0
+    if (version_ == 3) {
+        cJSON_AddBoolToObject(features, "audio_batch", true);
+    }
+#endif
+    if (version_ == 3) {
+        cJSON_AddBoolToObject(features, "mcp_cbor", true);
+    }
+#if CONFIG_WEBSOCKET_JSON_DEFLATE
+    if (version_ == 3) {
+        /* The window the server's stream must not exceed */
+        cJSON_AddNumberToObject(features, "json_deflate", CONFIG_WEBSOCKET_JSON_DEFLATE_WINDOW_BITS);
+    }
+#endif
+#if CONFIG_TTS_CACHE
+    if (TtsCache::GetInstance().available()) {
+        cJSON_AddBoolToObject(features, "tts_cache", true);
+    }
+#endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
-    cJSON* audio_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(audio_params, "format", "opus");
-    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
-    cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
-    cJSON_AddItemToObject(root, "audio_params", audio_params);
+    cJSON_AddItemToObject(root, "audio_params", CreateAudioParams());
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
     cJSON_free(json_str);
@@ -238,17 +502,33 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
-    auto audio_params = cJSON_GetObjectItem(root, "audio_params");
-    if (cJSON_IsObject(audio_params)) {
-        auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
-        if (cJSON_IsNumber(sample_rate)) {
-            server_sample_rate_ = sample_rate->valueint;
-        }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (cJSON_IsNumber(frame_duration)) {
-            server_frame_duration_ = frame_duration->valueint;
+    ParseAudioParams(cJSON_GetObjectItem(root, "audio_params"));
+
+    auto features = cJSON_GetObjectItem(root, "features");
+#if CONFIG_AUDIO_UPLINK_BATCH_MS > 0
+    if (version_ == 3 && cJSON_IsObject(features)) {
+        audio_batch_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "audio_batch"));
+        ESP_LOGI(TAG, "Uplink audio batching: %s", audio_batch_ ? "on" : "off");
+    }
+#endif
+#if CONFIG_WEBSOCKET_JSON_DEFLATE
+    /* Starts with the next message, a resume reply has no features and keeps the streams */
+    if (version_ == 3 && cJSON_IsObject(features) && cJSON_IsTrue(cJSON_GetObjectItem(features, "json_deflate"))) {
+        json_deflate_ = std::make_unique<JsonDeflate>(CONFIG_WEBSOCKET_JSON_DEFLATE_WINDOW_BITS);
+        if (!json_deflate_->ok()) {
+            json_deflate_.reset();
         }
+        ESP_LOGI(TAG, "JSON deflate: %s", json_deflate_ != nullptr ? "on" : "off");
     }
+#endif
+#if CONFIG_WEBSOCKET_PERSISTENT_CONNECTION
+    /* A resume reply carries no features, the connection keeps what the first hello agreed */
+    if (cJSON_IsObject(features)) {
+        resume_supported_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "resume"));
+    }
+#else
+    (void)features;
+#endif
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
@@ -3,10 +3,14 @@
 
 
 #include "protocol.h"
+#include "json_deflate.h"
 
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <memory>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
@@ -16,19 +20,44 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel(bool send_goodbye = true) override;
     bool IsAudioChannelOpened() const override;
+    void SwitchNetwork() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
+    // Persistent connection: the server accepted "resume", the socket outlives the session
+    bool resume_supported_ = false;
+    bool session_open_ = false;
+    esp_timer_handle_t keepalive_timer_ = nullptr;
+    std::shared_ptr<std::atomic<bool>> alive_ = std::make_shared<std::atomic<bool>>(true);
+    // Uplink packets coalesced into one BINARY_PROTOCOL3_TYPE_OPUS_BATCH frame
+    bool audio_batch_ = false;
+    std::string batch_buffer_;
+    // Header + payload of packets without headroom, reused for every such packet
+    std::vector<uint8_t> send_buffer_;
+    int batch_duration_ms_ = 0;
+    // JSON messages go deflated in both directions, for the lifetime of the connection
+    std::unique_ptr<JsonDeflate> json_deflate_;
+    // Inflated downlink message, only used on the websocket task
+    std::string inflate_buffer_;
 
     void ParseServerHello(const cJSON* root);
+    bool BatchAudio(const AudioStreamPacket& packet);
+    bool FlushAudioBatch();
     bool SendText(const std::string& text) override;
-    std::string GetHelloMessage();
+    bool SendTextFrame(const std::string& text);
+    void HandleText(const char* data, size_t len);
+    void HandleDeflatedText(const uint8_t* data, size_t len);
+    bool SupportsMcpCbor() const override { return version_ == 3; }
+    bool SendMcpCbor(std::string& frame) override;
+    std::string GetHelloMessage(bool resume = false);
+    bool ResumeSession();
+    void SendKeepalive();
 };
 
 #endif
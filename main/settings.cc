@@ -1,108 +1,287 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include <nvs_flash.h>
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 #define TAG "Settings"
 
+// Writes within this time of the first one are committed together
+#define SETTINGS_COMMIT_DELAY_MS 2000
+
+namespace {
+
+struct CachedValue {
+    enum Type { kMissing, kString, kInt, kBool };
+    Type type = kMissing;
+    std::string string_value;
+    int32_t int_value = 0;
+    // Not in NVS yet, a kMissing value is erased
+    bool dirty = false;
+};
+
+class SettingsCache {
+public:
+    static SettingsCache& GetInstance() {
+        static SettingsCache instance;
+        return instance;
+    }
+
+    std::mutex mutex_;
+    std::map<std::string, std::map<std::string, CachedValue>> namespaces_;
+
+    // Called with mutex_ held
+    void ScheduleCommit() {
+        if (commit_timer_ == nullptr) {
+            esp_timer_create_args_t args = {
+                .callback = [](void* arg) {
+                    Settings::Flush();
+                },
+                .arg = nullptr,
+                .dispatch_method = ESP_TIMER_TASK,
+                .name = "settings_commit",
+                .skip_unhandled_events = true,
+            };
+            ESP_ERROR_CHECK(esp_timer_create(&args, &commit_timer_));
+            // Changes still pending at a restart are written first
+            esp_register_shutdown_handler([]() {
+                Settings::Flush();
+            });
+        }
+        if (!esp_timer_is_active(commit_timer_)) {
+            esp_timer_start_once(commit_timer_, SETTINGS_COMMIT_DELAY_MS * 1000);
+        }
+    }
+
+private:
+    esp_timer_handle_t commit_timer_ = nullptr;
+};
+
+}  // namespace
+
 Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
-    nvs_open(ns.c_str(), read_write_ ? NVS_READWRITE : NVS_READONLY, &nvs_handle_);
 }
 
 Settings::~Settings() {
     if (nvs_handle_ != 0) {
-        if (read_write_ && dirty_) {
-            ESP_ERROR_CHECK(nvs_commit(nvs_handle_));
-        }
         nvs_close(nvs_handle_);
     }
 }
 
-std::string Settings::GetString(const std::string& key, const std::string& default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
-    }
-
-    size_t length = 0;
-    if (nvs_get_str(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
-        return default_value;
+// Opened on the first cache miss, 0 when the namespace does not exist yet
+nvs_handle_t Settings::GetHandle() {
+    if (!nvs_opened_) {
+        nvs_opened_ = true;
+        if (nvs_open(ns_.c_str(), NVS_READONLY, &nvs_handle_) != ESP_OK) {
+            nvs_handle_ = 0;
+        }
     }
+    return nvs_handle_;
+}
 
-    std::string value;
-    value.resize(length);
-    ESP_ERROR_CHECK(nvs_get_str(nvs_handle_, key.c_str(), value.data(), &length));
-    while (!value.empty() && value.back() == '\0') {
-        value.pop_back();
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto& values = cache.namespaces_[ns_];
+    auto it = values.find(key);
+    if (it == values.end()) {
+        CachedValue cached;
+        size_t length = 0;
+        auto handle = GetHandle();
+        if (handle != 0 && nvs_get_str(handle, key.c_str(), nullptr, &length) == ESP_OK) {
+            cached.type = CachedValue::kString;
+            cached.string_value.resize(length);
+            ESP_ERROR_CHECK(nvs_get_str(handle, key.c_str(), cached.string_value.data(), &length));
+            while (!cached.string_value.empty() && cached.string_value.back() == '\0') {
+                cached.string_value.pop_back();
+            }
+        }
+        it = values.emplace(key, std::move(cached)).first;
     }
-    return value;
+    return it->second.type == CachedValue::kString ? it->second.string_value : default_value;
 }
 
 void Settings::SetString(const std::string& key, const std::string& value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_str(nvs_handle_, key.c_str(), value.c_str()));
-        dirty_ = true;
-    } else {
+    if (!read_write_) {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+        return;
+    }
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto& cached = cache.namespaces_[ns_][key];
+    if (cached.type == CachedValue::kString && cached.string_value == value) {
+        return;
     }
+    cached.type = CachedValue::kString;
+    cached.string_value = value;
+    cached.dirty = true;
+    cache.ScheduleCommit();
 }
 
 int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
-    }
-
-    int32_t value;
-    if (nvs_get_i32(nvs_handle_, key.c_str(), &value) != ESP_OK) {
-        return default_value;
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto& values = cache.namespaces_[ns_];
+    auto it = values.find(key);
+    if (it == values.end()) {
+        CachedValue cached;
+        auto handle = GetHandle();
+        if (handle != 0 && nvs_get_i32(handle, key.c_str(), &cached.int_value) == ESP_OK) {
+            cached.type = CachedValue::kInt;
+        }
+        it = values.emplace(key, std::move(cached)).first;
     }
-    return value;
+    return it->second.type == CachedValue::kInt ? it->second.int_value : default_value;
 }
 
 void Settings::SetInt(const std::string& key, int32_t value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_i32(nvs_handle_, key.c_str(), value));
-        dirty_ = true;
-    } else {
+    if (!read_write_) {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+        return;
     }
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto& cached = cache.namespaces_[ns_][key];
+    if (cached.type == CachedValue::kInt && cached.int_value == value) {
+        return;
+    }
+    cached.type = CachedValue::kInt;
+    cached.int_value = value;
+    cached.dirty = true;
+    cache.ScheduleCommit();
 }
 
 bool Settings::GetBool(const std::string& key, bool default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
-    }
-
-    uint8_t value;
-    if (nvs_get_u8(nvs_handle_, key.c_str(), &value) != ESP_OK) {
-        return default_value;
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto& values = cache.namespaces_[ns_];
+    auto it = values.find(key);
+    if (it == values.end()) {
+        CachedValue cached;
+        uint8_t value;
+        auto handle = GetHandle();
+        if (handle != 0 && nvs_get_u8(handle, key.c_str(), &value) == ESP_OK) {
+            cached.type = CachedValue::kBool;
+            cached.int_value = value;
+        }
+        it = values.emplace(key, std::move(cached)).first;
     }
-    return value != 0;
+    return it->second.type == CachedValue::kBool ? it->second.int_value != 0 : default_value;
 }
 
 void Settings::SetBool(const std::string& key, bool value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_u8(nvs_handle_, key.c_str(), value ? 1 : 0));
-        dirty_ = true;
-    } else {
+    if (!read_write_) {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+        return;
+    }
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto& cached = cache.namespaces_[ns_][key];
+    if (cached.type == CachedValue::kBool && (cached.int_value != 0) == value) {
+        return;
     }
+    cached.type = CachedValue::kBool;
+    cached.int_value = value ? 1 : 0;
+    cached.dirty = true;
+    cache.ScheduleCommit();
 }
 
 void Settings::EraseKey(const std::string& key) {
-    if (read_write_) {
-        auto ret = nvs_erase_key(nvs_handle_, key.c_str());
-        if (ret != ESP_ERR_NVS_NOT_FOUND) {
-            ESP_ERROR_CHECK(ret);
-        }
-    } else {
+    if (!read_write_) {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+        return;
     }
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto& cached = cache.namespaces_[ns_][key];
+    // An unknown key may still be in NVS, erasing a missing one is harmless
+    cached.type = CachedValue::kMissing;
+    cached.string_value.clear();
+    cached.dirty = true;
+    cache.ScheduleCommit();
 }
 
 void Settings::EraseAll() {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_erase_all(nvs_handle_));
-    } else {
+    if (!read_write_) {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+        return;
     }
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    cache.namespaces_.erase(ns_);
+    nvs_handle_t handle;
+    if (nvs_open(ns_.c_str(), NVS_READWRITE, &handle) == ESP_OK) {
+        ESP_ERROR_CHECK(nvs_erase_all(handle));
+        ESP_ERROR_CHECK(nvs_commit(handle));
+        nvs_close(handle);
+    }
+}
+
+void Settings::Flush() {
+    auto& cache = SettingsCache::GetInstance();
+    // Take the pending values, later writes to the same keys are flushed another time
+    std::vector<std::pair<std::string, std::vector<std::pair<std::string, CachedValue>>>> pending;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex_);
+        for (auto& [ns, values] : cache.namespaces_) {
+            std::vector<std::pair<std::string, CachedValue>> changes;
+            for (auto& [key, cached] : values) {
+                if (cached.dirty) {
+                    changes.emplace_back(key, cached);
+                    cached.dirty = false;
+                }
+            }
+            if (!changes.empty()) {
+                pending.emplace_back(ns, std::move(changes));
+            }
+        }
+    }
+
+    for (auto& [ns, changes] : pending) {
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(ns.c_str(), NVS_READWRITE, &handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to open namespace %s: %s", ns.c_str(), esp_err_to_name(err));
+            continue;
+        }
+        for (auto& [key, cached] : changes) {
+            switch (cached.type) {
+                case CachedValue::kString:
+                    err = nvs_set_str(handle, key.c_str(), cached.string_value.c_str());
+                    break;
+                case CachedValue::kInt:
+                    err = nvs_set_i32(handle, key.c_str(), cached.int_value);
+                    break;
+                case CachedValue::kBool:
+                    err = nvs_set_u8(handle, key.c_str(), cached.int_value);
+                    break;
+                case CachedValue::kMissing:
+                    err = nvs_erase_key(handle, key.c_str());
+                    if (err == ESP_ERR_NVS_NOT_FOUND) {
+                        err = ESP_OK;
+                    }
+                    break;
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to write %s.%s: %s", ns.c_str(), key.c_str(), esp_err_to_name(err));
+            }
+        }
+        err = nvs_commit(handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to commit namespace %s: %s", ns.c_str(), esp_err_to_name(err));
+        }
+        nvs_close(handle);
+        ESP_LOGI(TAG, "Committed %u changes to %s", changes.size(), ns.c_str());
+    }
+}
+
+void Settings::Invalidate() {
+    auto& cache = SettingsCache::GetInstance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    cache.namespaces_.clear();
 }
@@ -4,6 +4,10 @@
 #include <string>
 #include <nvs_flash.h>
 
+/*
+ * Values are cached in RAM per namespace after the first read. Writes update the cache and
+ * reach NVS together after SETTINGS_COMMIT_DELAY_MS, or on Flush() and esp_restart().
+ */
 class Settings {
 public:
     Settings(const std::string& ns, bool read_write = false);
@@ -18,11 +22,18 @@ public:
     void EraseKey(const std::string& key);
     void EraseAll();
 
+    // Writes the pending changes of every namespace now
+    static void Flush();
+    // Drops the cache and the pending changes, call before erasing the NVS partition
+    static void Invalidate();
+
 private:
     std::string ns_;
     nvs_handle_t nvs_handle_ = 0;
+    bool nvs_opened_ = false;
     bool read_write_ = false;
-    bool dirty_ = false;
+
+    nvs_handle_t GetHandle();
 };
 
 #endif
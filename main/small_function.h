@@ -0,0 +1,121 @@
+#ifndef SMALL_FUNCTION_H
+#define SMALL_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Move-only replacement for std::function that keeps callables of up to `Size` bytes inline,
+ * e.g. a lambda capturing `this` and a std::string. Larger callables fall back to the heap.
+ */
+template <typename Signature, size_t Size = 32>
+class SmallFunction;
+
+template <typename R, typename... Args, size_t Size>
+class SmallFunction<R(Args...), Size> {
+public:
+    SmallFunction() = default;
+    SmallFunction(std::nullptr_t) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, SmallFunction> &&
+                                                      std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+    SmallFunction(F&& f) {
+        using Callable = std::decay_t<F>;
+        if constexpr (kFitsInline<Callable>) {
+            new (storage_) Callable(std::forward<F>(f));
+        } else {
+            *reinterpret_cast<Callable**>(storage_) = new Callable(std::forward<F>(f));
+        }
+        ops_ = &kOps<Callable>;
+    }
+
+    SmallFunction(SmallFunction&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    SmallFunction& operator=(SmallFunction&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    SmallFunction(const SmallFunction&) = delete;
+    SmallFunction& operator=(const SmallFunction&) = delete;
+
+    ~SmallFunction() {
+        Reset();
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    R operator()(Args... args) {
+        return ops_->invoke(storage_, std::forward<Args>(args)...);
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        R (*invoke)(void* storage, Args&&... args);
+        // Move constructs into dst and destroys src
+        void (*relocate)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename F>
+    static constexpr bool kFitsInline = sizeof(F) <= Size && alignof(F) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<F>;
+
+    template <typename F>
+    static F* Get(void* storage) {
+        if constexpr (kFitsInline<F>) {
+            return std::launder(reinterpret_cast<F*>(storage));
+        } else {
+            return *reinterpret_cast<F**>(storage);
+        }
+    }
+
+    template <typename F>
+    static inline const Ops kOps = {
+        [](void* storage, Args&&... args) -> R {
+            return (*Get<F>(storage))(std::forward<Args>(args)...);
+        },
+        [](void* dst, void* src) {
+            if constexpr (kFitsInline<F>) {
+                new (dst) F(std::move(*Get<F>(src)));
+                Get<F>(src)->~F();
+            } else {
+                *reinterpret_cast<F**>(dst) = Get<F>(src);
+            }
+        },
+        [](void* storage) {
+            if constexpr (kFitsInline<F>) {
+                Get<F>(storage)->~F();
+            } else {
+                delete Get<F>(storage);
+            }
+        },
+    };
+
+    void MoveFrom(SmallFunction& other) {
+        if (other.ops_ != nullptr) {
+            other.ops_->relocate(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[Size];
+    const Ops* ops_ = nullptr;
+};
+
+#endif // SMALL_FUNCTION_H
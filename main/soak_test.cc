@@ -0,0 +1,257 @@
+#include "soak_test.h"
+#include "application.h"
+#include "task_manifest.h"
+
+#include <algorithm>
+#include <cJSON.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+#define TAG "SoakTest"
+
+// The wake word opens the channel and starts listening within this
+#define SOAK_LISTEN_TIMEOUT_MS 15000
+
+static const uint32_t kCapabilities[] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_DMA, MALLOC_CAP_SPIRAM};
+static const char* const kCapabilityNames[] = {"internal", "dma", "psram"};
+
+void SoakTest::Start() {
+    samples_.reserve(CONFIG_SOAK_TEST_SAMPLES);
+    TaskManifest::Create("soak_test", [](void* arg) {
+        static_cast<SoakTest*>(arg)->Run();
+        TaskManifest::Exit();
+    }, this);
+}
+
+int SoakTest::WaitForState(DeviceState state, int timeout_ms) {
+    auto& app = Application::GetInstance();
+    int64_t start_us = esp_timer_get_time();
+    while (app.GetDeviceState() != state) {
+        int waited_ms = (esp_timer_get_time() - start_us) / 1000;
+        if (waited_ms >= timeout_ms) {
+            return -1;
+        }
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+    return (esp_timer_get_time() - start_us) / 1000;
+}
+
+void SoakTest::Run() {
+    WaitForState(kDeviceStateIdle, INT32_MAX);
+    ESP_LOGI(TAG, "Soak test started, a sample every %d cycles", CONFIG_SOAK_TEST_SAMPLE_CYCLES);
+    // The baseline the trend starts from
+    TakeSample();
+    while (true) {
+        WaitForState(kDeviceStateIdle, INT32_MAX);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SOAK_TEST_IDLE_MS));
+        // Someone else started a conversation meanwhile
+        if (Application::GetInstance().GetDeviceState() != kDeviceStateIdle) {
+            continue;
+        }
+        bool ok = RunCycle();
+        bool sample;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cycles_++;
+            failures_ += ok ? 0 : 1;
+            sample = cycles_ % sample_interval_ == 0;
+        }
+        if (sample) {
+            TakeSample();
+        }
+    }
+}
+
+// One conversation: wake word, the server's session, back to idle after its goodbye
+bool SoakTest::RunCycle() {
+    auto& app = Application::GetInstance();
+    int64_t start_us = esp_timer_get_time();
+    app.Schedule([&app]() {
+        app.WakeWordInvoke("soak");
+    });
+    int listen_ms = WaitForState(kDeviceStateListening, SOAK_LISTEN_TIMEOUT_MS);
+    if (listen_ms < 0) {
+        ESP_LOGW(TAG, "Cycle %lu did not reach listening", cycles_ + 1);
+        return false;
+    }
+    if (WaitForState(kDeviceStateIdle, CONFIG_SOAK_TEST_CYCLE_TIMEOUT * 1000) < 0) {
+        ESP_LOGW(TAG, "Cycle %lu did not end, stopping it", cycles_ + 1);
+        // Like a second wake word: aborts the speech or closes the channel
+        app.Schedule([&app]() {
+            app.WakeWordInvoke("soak");
+        });
+        return false;
+    }
+    listen_ms_.push_back(listen_ms);
+    cycle_ms_.push_back((esp_timer_get_time() - start_us) / 1000);
+    return true;
+}
+
+static uint32_t Percentile(std::vector<uint32_t>& values, int percent) {
+    if (values.empty()) {
+        return 0;
+    }
+    auto nth = values.begin() + (values.size() - 1) * percent / 100;
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+uint32_t SoakTest::SampleStacks() {
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 5;
+    TaskStatus_t* tasks = (TaskStatus_t*)malloc(sizeof(TaskStatus_t) * count);
+    if (tasks == nullptr) {
+        return 0;
+    }
+    count = uxTaskGetSystemState(tasks, count, nullptr);
+    uint32_t lowest = UINT32_MAX;
+    for (UBaseType_t i = 0; i < count; i++) {
+        // In bytes on ESP-IDF
+        uint32_t free_bytes = tasks[i].usStackHighWaterMark;
+        auto it = min_stack_free_.find(tasks[i].pcTaskName);
+        if (it == min_stack_free_.end()) {
+            min_stack_free_.emplace(tasks[i].pcTaskName, free_bytes);
+        } else {
+            it->second = std::min(it->second, free_bytes);
+        }
+        if (free_bytes < lowest) {
+            lowest = free_bytes;
+            min_stack_task_ = tasks[i].pcTaskName;
+        }
+    }
+    free(tasks);
+    return lowest;
+}
+
+void SoakTest::TakeSample() {
+    Sample sample = {};
+    sample.uptime_s = esp_timer_get_time() / 1000000;
+    for (int i = 0; i < kCapabilityCount; i++) {
+        sample.free[i] = heap_caps_get_free_size(kCapabilities[i]);
+        sample.largest[i] = heap_caps_get_largest_free_block(kCapabilities[i]);
+    }
+    sample.minimum_free_internal = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    std::lock_guard<std::mutex> lock(mutex_);
+    sample.min_stack_free = SampleStacks();
+    sample.listen_p50_ms = Percentile(listen_ms_, 50);
+    sample.listen_p95_ms = Percentile(listen_ms_, 95);
+    sample.cycle_p50_ms = Percentile(cycle_ms_, 50);
+    sample.cycle_p95_ms = Percentile(cycle_ms_, 95);
+    listen_ms_.clear();
+    cycle_ms_.clear();
+    sample.cycle = cycles_;
+    sample.failures = failures_;
+
+    if (samples_.size() >= CONFIG_SOAK_TEST_SAMPLES) {
+        // Keep the baseline and every sample on the doubled interval
+        std::vector<Sample> kept = {samples_[0]};
+        for (size_t i = 1; i < samples_.size(); i += 2) {
+            kept.push_back(samples_[i]);
+        }
+        samples_.swap(kept);
+        sample_interval_ *= 2;
+    }
+    samples_.push_back(sample);
+    ESP_LOGI(TAG, "Cycle %lu: internal %lu/%lu, dma %lu/%lu, psram %lu/%lu free/largest, stack %lu (%s), "
+        "cycle p50 %lu ms, %lu failures", sample.cycle, sample.free[kInternal], sample.largest[kInternal],
+        sample.free[kDma], sample.largest[kDma], sample.free[kPsram], sample.largest[kPsram],
+        sample.min_stack_free, min_stack_task_.c_str(), sample.cycle_p50_ms, sample.failures);
+}
+
+std::string SoakTest::GetReportJson() {
+    struct Field {
+        const char* name;
+        uint32_t (*get)(const Sample& sample);
+    };
+    static const Field kFields[] = {
+        {"free_internal", [](const Sample& s) { return s.free[kInternal]; }},
+        {"largest_internal", [](const Sample& s) { return s.largest[kInternal]; }},
+        {"free_dma", [](const Sample& s) { return s.free[kDma]; }},
+        {"largest_dma", [](const Sample& s) { return s.largest[kDma]; }},
+        {"free_psram", [](const Sample& s) { return s.free[kPsram]; }},
+        {"largest_psram", [](const Sample& s) { return s.largest[kPsram]; }},
+        {"minimum_free_internal", [](const Sample& s) { return s.minimum_free_internal; }},
+        {"min_stack_free", [](const Sample& s) { return s.min_stack_free; }},
+        {"listen_p50_ms", [](const Sample& s) { return s.listen_p50_ms; }},
+        {"listen_p95_ms", [](const Sample& s) { return s.listen_p95_ms; }},
+        {"cycle_p50_ms", [](const Sample& s) { return s.cycle_p50_ms; }},
+        {"cycle_p95_ms", [](const Sample& s) { return s.cycle_p95_ms; }},
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "cycles", cycles_);
+    cJSON_AddNumberToObject(root, "failures", failures_);
+    cJSON_AddNumberToObject(root, "sample_interval", sample_interval_);
+
+    /* Least squares slope over the cycle number, per 1000 cycles */
+    cJSON* trend = cJSON_CreateObject();
+    double mean_cycle = 0;
+    for (auto& sample : samples_) {
+        mean_cycle += sample.cycle;
+    }
+    mean_cycle = samples_.empty() ? 0 : mean_cycle / samples_.size();
+    for (auto& field : kFields) {
+        if (samples_.empty()) {
+            break;
+        }
+        double mean = 0;
+        uint32_t lowest = UINT32_MAX;
+        for (auto& sample : samples_) {
+            mean += field.get(sample);
+            lowest = std::min(lowest, field.get(sample));
+        }
+        mean /= samples_.size();
+        double covariance = 0;
+        double variance = 0;
+        for (auto& sample : samples_) {
+            double dx = sample.cycle - mean_cycle;
+            covariance += dx * (field.get(sample) - mean);
+            variance += dx * dx;
+        }
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "first", field.get(samples_.front()));
+        cJSON_AddNumberToObject(item, "last", field.get(samples_.back()));
+        cJSON_AddNumberToObject(item, "min", lowest);
+        cJSON_AddNumberToObject(item, "slope_per_1000_cycles", variance > 0 ? covariance / variance * 1000 : 0);
+        cJSON_AddItemToObject(trend, field.name, item);
+    }
+    cJSON_AddItemToObject(root, "trend", trend);
+
+    // 1 - largest block / free of the last sample, 0 when the free memory is one block
+    if (!samples_.empty()) {
+        cJSON* fragmentation = cJSON_CreateObject();
+        auto& last = samples_.back();
+        for (int i = 0; i < kCapabilityCount; i++) {
+            double value = last.free[i] > 0 ? 1.0 - (double)last.largest[i] / last.free[i] : 0;
+            cJSON_AddNumberToObject(fragmentation, kCapabilityNames[i], value);
+        }
+        cJSON_AddItemToObject(root, "fragmentation", fragmentation);
+    }
+
+    cJSON* stacks = cJSON_CreateObject();
+    for (auto& [name, free_bytes] : min_stack_free_) {
+        cJSON_AddNumberToObject(stacks, name.c_str(), free_bytes);
+    }
+    cJSON_AddItemToObject(root, "min_stack_free", stacks);
+
+    cJSON* samples = cJSON_CreateArray();
+    for (auto& sample : samples_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "cycle", sample.cycle);
+        cJSON_AddNumberToObject(item, "uptime_s", sample.uptime_s);
+        for (auto& field : kFields) {
+            cJSON_AddNumberToObject(item, field.name, field.get(sample));
+        }
+        cJSON_AddNumberToObject(item, "failures", sample.failures);
+        cJSON_AddItemToArray(samples, item);
+    }
+    cJSON_AddItemToObject(root, "samples", samples);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,79 @@
+#ifndef SOAK_TEST_H
+#define SOAK_TEST_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+
+#include "device_state.h"
+
+/*
+ * Long-run soak test for slow heap fragmentation. A low priority task runs synthetic
+ * conversations back to back: while the device is idle it invokes the wake word, the test
+ * server (scripts/protocol_bench/bench_server.py soak) answers with stt, TTS audio, MCP calls,
+ * a camera explain and display updates, and ends the session with a goodbye.
+ *
+ * Every CONFIG_SOAK_TEST_SAMPLE_CYCLES cycles a sample records the free heap and largest free
+ * block per capability, the lowest stack high water mark among the tasks and the percentiles of
+ * the cycle timings. When the ring is full every other sample is dropped and the interval
+ * doubles, so a run of days keeps its start. self.soak.get_report returns the samples with the
+ * least squares trend of each field.
+ */
+class SoakTest {
+public:
+    static SoakTest& GetInstance() {
+        static SoakTest instance;
+        return instance;
+    }
+    SoakTest(const SoakTest&) = delete;
+    SoakTest& operator=(const SoakTest&) = delete;
+
+    // Creates the task, the first cycle waits for the device to be idle
+    void Start();
+    std::string GetReportJson();
+
+private:
+    SoakTest() = default;
+
+    enum Capability { kInternal, kDma, kPsram, kCapabilityCount };
+
+    struct Sample {
+        uint32_t cycle;
+        uint32_t uptime_s;
+        uint32_t free[kCapabilityCount];
+        uint32_t largest[kCapabilityCount];
+        uint32_t minimum_free_internal;
+        // Lowest stack high water mark of all tasks (bytes)
+        uint32_t min_stack_free;
+        // Percentiles of the cycles since the previous sample: wake word to listening, to idle again
+        uint32_t listen_p50_ms;
+        uint32_t listen_p95_ms;
+        uint32_t cycle_p50_ms;
+        uint32_t cycle_p95_ms;
+        uint32_t failures;
+    };
+
+    std::mutex mutex_;
+    std::vector<Sample> samples_;
+    uint32_t sample_interval_ = CONFIG_SOAK_TEST_SAMPLE_CYCLES;
+    uint32_t cycles_ = 0;
+    uint32_t failures_ = 0;
+    // Owned by the task, cleared by every sample
+    std::vector<uint32_t> listen_ms_;
+    std::vector<uint32_t> cycle_ms_;
+    std::map<std::string, uint32_t> min_stack_free_;
+    std::string min_stack_task_;
+
+    void Run();
+    bool RunCycle();
+    void TakeSample();
+    uint32_t SampleStacks();
+    // Waits up to timeout_ms for the device state, returns the milliseconds waited or -1
+    static int WaitForState(DeviceState state, int timeout_ms);
+};
+
+#endif // SOAK_TEST_H
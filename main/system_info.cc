@@ -9,6 +9,9 @@
 #include <esp_app_desc.h>
 #include <esp_ota_ops.h>
 #include <esp_pm.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <cJSON.h>
 #if CONFIG_IDF_TARGET_ESP32P4
 #include "esp_wifi_remote.h"
 #endif
@@ -154,3 +157,43 @@ void SystemInfo::PrintHeapStats() {
 void SystemInfo::PrintPmLocks() {
     esp_pm_dump_locks(stdout);
 }
+
+std::string SystemInfo::GetRuntimeStatsJson() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "uptime_ms", esp_timer_get_time() / 1000);
+
+    cJSON* heap = cJSON_CreateObject();
+    cJSON_AddNumberToObject(heap, "free", esp_get_free_heap_size());
+    cJSON_AddNumberToObject(heap, "minimum_free", esp_get_minimum_free_heap_size());
+    cJSON_AddNumberToObject(heap, "free_sram", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    cJSON_AddNumberToObject(heap, "minimum_free_sram", heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    cJSON_AddNumberToObject(heap, "largest_free_sram_block", heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    cJSON_AddNumberToObject(heap, "free_psram", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    cJSON_AddItemToObject(root, "heap", heap);
+
+    /* Run time counters only grow, the CPU share of a period is the difference of two snapshots */
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 5;
+    TaskStatus_t* tasks = (TaskStatus_t*)malloc(sizeof(TaskStatus_t) * count);
+    if (tasks != nullptr) {
+        configRUN_TIME_COUNTER_TYPE total_run_time;
+        count = uxTaskGetSystemState(tasks, count, &total_run_time);
+        cJSON_AddNumberToObject(root, "cores", CONFIG_FREERTOS_NUMBER_OF_CORES);
+        cJSON_AddNumberToObject(root, "run_time", total_run_time);
+        cJSON* array = cJSON_CreateArray();
+        for (UBaseType_t i = 0; i < count; i++) {
+            cJSON* task = cJSON_CreateObject();
+            cJSON_AddStringToObject(task, "name", tasks[i].pcTaskName);
+            cJSON_AddNumberToObject(task, "run_time", tasks[i].ulRunTimeCounter);
+            cJSON_AddNumberToObject(task, "stack_high_water", tasks[i].usStackHighWaterMark);
+            cJSON_AddItemToArray(array, task);
+        }
+        cJSON_AddItemToObject(root, "tasks", array);
+        free(tasks);
+    }
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -18,6 +18,8 @@ public:
     static void PrintTaskList();
     static void PrintHeapStats();
     static void PrintPmLocks();
+    // Heap usage and the cumulative run time of every task, for comparing two snapshots
+    static std::string GetRuntimeStatsJson();
 };
 
 #endif // _SYSTEM_INFO_H_
@@ -0,0 +1,186 @@
+#include "task_manifest.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <freertos/idf_additions.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#define TAG "TaskManifest"
+
+#define TASK_CORE_ANY tskNO_AFFINITY
+
+static const TaskSpec kDefaultSpecs[] = {
+    // name, stack, priority, core, stack memory, flash access
+#if CONFIG_USE_AUDIO_PROCESSOR
+    {"audio_input", 2048 * 3, 8, 0, kTaskStackInternal, false},
+    {"audio_output", 2048 * 2, 4, TASK_CORE_ANY, kTaskStackInternal, false},
+#else
+    {"audio_input", 2048 * 2, 8, TASK_CORE_ANY, kTaskStackInternal, false},
+    {"audio_output", 2048, 4, TASK_CORE_ANY, kTaskStackInternal, false},
+#endif
+#if CONFIG_AUDIO_SPLIT_OPUS_CODEC_TASKS
+    {"opus_decoder", CONFIG_AUDIO_OPUS_DECODER_TASK_STACK_SIZE, CONFIG_AUDIO_OPUS_DECODER_TASK_PRIORITY,
+        CONFIG_AUDIO_OPUS_DECODER_TASK_CORE, kTaskStackInternal, false},
+    {"opus_encoder", CONFIG_AUDIO_OPUS_ENCODER_TASK_STACK_SIZE, CONFIG_AUDIO_OPUS_ENCODER_TASK_PRIORITY,
+        CONFIG_AUDIO_OPUS_ENCODER_TASK_CORE, kTaskStackInternal, false},
+#else
+    {"opus_codec", 2048 * 12, 2, TASK_CORE_ANY, kTaskStackInternal, false},
+#endif
+    {"audio_communication", 4096, 3, TASK_CORE_ANY, kTaskStackInternal, false},
+    {"audio_detection", 4096, 3, TASK_CORE_ANY, kTaskStackInternal, false},
+    // Wake word audio is encoded off the audio path, a slower stack costs nothing
+    {"encode_wake_word", 4096 * 6, 2, TASK_CORE_ANY, kTaskStackPsram, false},
+    {"preencode_wake", 4096 * 6, 1, TASK_CORE_ANY, kTaskStackPsram, false},
+    {"activation", 4096 * 2, 2, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"apply_assets", 4096 * 2, 3, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"assets_verify", 3072, 1, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"assets_writer", 4096, 4, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"assets_update", 4096 * 2, 2, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"ota_writer", 4096, 4, TASK_CORE_ANY, kTaskStackInternal, true},
+    // Below everything the conversation needs, the writer above still keeps the flash busy
+    {"background_ota", 4096 * 2, 1, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"dns_cache", 3072, 1, TASK_CORE_ANY, kTaskStackInternal, false},
+    {"tts_cache", 3072, 3, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"stream_fetch", 4096 * 2, 3, TASK_CORE_ANY, kTaskStackInternal, false},
+    // Tools may save settings
+    {"mcp_worker", 4096 * 2, 2, TASK_CORE_ANY, kTaskStackInternal, true},
+    {"LedEvent", 2048, tskIDLE_PRIORITY + 2, TASK_CORE_ANY, kTaskStackInternal, false},
+    {"preview_loader", 4096 + 2048, 1, TASK_CORE_ANY, kTaskStackPsram, false},
+    {"fb_mirror", 4096 + 2048, 1, TASK_CORE_ANY, kTaskStackPsram, false},
+    // Opus encoding needs the stack of the encoder task
+    {"core_bench", 4096 * 6, 2, TASK_CORE_ANY, kTaskStackInternal, false},
+    {"bench_producer", 2048, 2, TASK_CORE_ANY, kTaskStackInternal, false},
+    {"soak_test", 4096, 1, TASK_CORE_ANY, kTaskStackInternal, false},
+};
+
+static std::mutex specs_mutex;
+
+std::vector<TaskSpec>& TaskManifest::Specs() {
+    static std::vector<TaskSpec> specs = [] {
+        std::vector<TaskSpec> specs(std::begin(kDefaultSpecs), std::end(kDefaultSpecs));
+        ApplyConfigOverrides(specs);
+        return specs;
+    }();
+    return specs;
+}
+
+/*
+ * CONFIG_TASK_MANIFEST_OVERRIDES: comma separated name:stack:priority:core:memory, an empty
+ * field keeps the entry, core is a number or "any", memory "internal" or "psram"
+ */
+void TaskManifest::ApplyConfigOverrides(std::vector<TaskSpec>& specs) {
+    std::string overrides = CONFIG_TASK_MANIFEST_OVERRIDES;
+    size_t start = 0;
+    while (start < overrides.size()) {
+        size_t end = overrides.find(',', start);
+        if (end == std::string::npos) {
+            end = overrides.size();
+        }
+        std::string entry = overrides.substr(start, end - start);
+        start = end + 1;
+
+        std::string fields[5];
+        size_t field_start = 0;
+        for (int i = 0; i < 5 && field_start <= entry.size(); i++) {
+            size_t field_end = entry.find(':', field_start);
+            if (field_end == std::string::npos) {
+                field_end = entry.size();
+            }
+            fields[i] = entry.substr(field_start, field_end - field_start);
+            field_start = field_end + 1;
+        }
+
+        TaskSpec* spec = nullptr;
+        for (auto& s : specs) {
+            if (fields[0] == s.name) {
+                spec = &s;
+                break;
+            }
+        }
+        if (spec == nullptr) {
+            if (!fields[0].empty()) {
+                ESP_LOGW(TAG, "Override of unknown task %s ignored", fields[0].c_str());
+            }
+            continue;
+        }
+        if (!fields[1].empty()) {
+            spec->stack_size = strtoul(fields[1].c_str(), nullptr, 10);
+        }
+        if (!fields[2].empty()) {
+            spec->priority = strtoul(fields[2].c_str(), nullptr, 10);
+        }
+        if (fields[3] == "any") {
+            spec->core = TASK_CORE_ANY;
+        } else if (!fields[3].empty()) {
+            spec->core = strtol(fields[3].c_str(), nullptr, 10);
+        }
+        if (fields[4] == "psram") {
+            spec->stack_memory = kTaskStackPsram;
+        } else if (fields[4] == "internal") {
+            spec->stack_memory = kTaskStackInternal;
+        }
+    }
+}
+
+TaskSpec TaskManifest::Get(const char* name) {
+    std::lock_guard<std::mutex> lock(specs_mutex);
+    for (const auto& spec : Specs()) {
+        if (strcmp(spec.name, name) == 0) {
+            return spec;
+        }
+    }
+    ESP_LOGE(TAG, "Task %s is not in the manifest", name);
+    return {name, 4096, 2, TASK_CORE_ANY, kTaskStackInternal, true};
+}
+
+void TaskManifest::Override(const TaskSpec& spec) {
+    std::lock_guard<std::mutex> lock(specs_mutex);
+    for (auto& s : Specs()) {
+        if (strcmp(s.name, spec.name) == 0) {
+            s = spec;
+            return;
+        }
+    }
+    Specs().push_back(spec);
+}
+
+BaseType_t TaskManifest::Create(const char* name, TaskFunction_t function, void* arg, TaskHandle_t* handle) {
+    TaskSpec spec = Get(name);
+    BaseType_t core = spec.core;
+    if (core != TASK_CORE_ANY && core >= portNUM_PROCESSORS) {
+        core = TASK_CORE_ANY;
+    }
+
+    UBaseType_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+#if CONFIG_TASK_MANIFEST_PSRAM_STACKS
+    if (spec.stack_memory == kTaskStackPsram) {
+        // Flash operations assert on a stack outside internal RAM
+        if (spec.flash_access) {
+            ESP_LOGW(TAG, "Task %s accesses flash, its stack stays internal", name);
+        } else {
+            caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+        }
+    }
+#endif
+
+    BaseType_t ret = xTaskCreatePinnedToCoreWithCaps(function, name, spec.stack_size, arg, spec.priority,
+        handle, core, caps);
+    if (ret != pdPASS && (caps & MALLOC_CAP_SPIRAM)) {
+        ESP_LOGW(TAG, "No PSRAM for the stack of %s, using internal RAM", name);
+        ret = xTaskCreatePinnedToCoreWithCaps(function, name, spec.stack_size, arg, spec.priority,
+            handle, core, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task %s with %lu bytes of stack", name, spec.stack_size);
+    }
+    return ret;
+}
+
+void TaskManifest::Exit() {
+    // The stack and task buffer are freed once the task is off its stack
+    vTaskDeleteWithCaps(NULL);
+}
@@ -0,0 +1,48 @@
+#ifndef TASK_MANIFEST_H
+#define TASK_MANIFEST_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <vector>
+
+enum TaskStackMemory : uint8_t {
+    kTaskStackInternal,
+    kTaskStackPsram,
+};
+
+struct TaskSpec {
+    const char* name;
+    uint32_t stack_size;
+    UBaseType_t priority;
+    // tskNO_AFFINITY to run on any core
+    BaseType_t core;
+    TaskStackMemory stack_memory;
+    // Writes or maps flash, which needs an internal stack while the cache is off
+    bool flash_access;
+};
+
+/*
+ * The stack, priority, core and stack memory of every task the firmware creates, in one
+ * table instead of at each xTaskCreate call. CONFIG_TASK_MANIFEST_OVERRIDES and boards (through
+ * Override() in their constructor) change entries per SKU, e.g. to balance the cores or to move
+ * stacks nothing accesses by DMA to PSRAM and free internal RAM.
+ *
+ * A task created by Create() ends with TaskManifest::Exit(), not vTaskDelete(NULL), since its
+ * stack may have been allocated with capabilities.
+ */
+class TaskManifest {
+public:
+    // The entry of a task, a default one with an error for unknown names
+    static TaskSpec Get(const char* name);
+    // Replaces or adds the entry of a task, before the task is created
+    static void Override(const TaskSpec& spec);
+    static BaseType_t Create(const char* name, TaskFunction_t function, void* arg, TaskHandle_t* handle = nullptr);
+    static void Exit();
+
+private:
+    static void ApplyConfigOverrides(std::vector<TaskSpec>& specs);
+    static std::vector<TaskSpec>& Specs();
+};
+
+#endif // TASK_MANIFEST_H
@@ -0,0 +1,220 @@
+#include "telemetry.h"
+#include "application.h"
+#include "board.h"
+#include "memory_budget.h"
+#if CONFIG_DISPLAY_FRAME_TRACE
+#include "display/lvgl_display/lvgl_display.h"
+#endif
+
+#include <algorithm>
+#include <climits>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <cJSON.h>
+#include <wifi_manager.h>
+
+#define TAG "Telemetry"
+
+const Telemetry::Field Telemetry::kFields[] = {
+    {"free_internal", [](const Record& r) -> int64_t { return r.free_internal; }},
+    {"largest_internal", [](const Record& r) -> int64_t { return r.largest_internal; }},
+    {"free_dma", [](const Record& r) -> int64_t { return r.free_dma; }},
+    {"largest_dma", [](const Record& r) -> int64_t { return r.largest_dma; }},
+    {"free_psram", [](const Record& r) -> int64_t { return r.free_psram; }},
+    {"largest_psram", [](const Record& r) -> int64_t { return r.largest_psram; }},
+    {"cpu0_load", [](const Record& r) -> int64_t { return r.cpu_load[0]; }},
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+    {"cpu1_load", [](const Record& r) -> int64_t { return r.cpu_load[1]; }},
+#endif
+    {"rssi", [](const Record& r) -> int64_t { return r.rssi; }},
+    {"decode_queue", [](const Record& r) -> int64_t { return r.decode_queue; }},
+    {"encode_queue", [](const Record& r) -> int64_t { return r.encode_queue; }},
+    {"playback_queue", [](const Record& r) -> int64_t { return r.playback_queue; }},
+    {"send_queue", [](const Record& r) -> int64_t { return r.send_queue; }},
+#if CONFIG_DISPLAY_FRAME_TRACE
+    {"frames", [](const Record& r) -> int64_t { return r.frames; }},
+    {"render_avg_us", [](const Record& r) -> int64_t { return r.render_avg_us; }},
+    {"flush_wait_avg_us", [](const Record& r) -> int64_t { return r.flush_wait_avg_us; }},
+#endif
+};
+
+Telemetry::Telemetry() : ring_(CONFIG_TELEMETRY_SAMPLES) {
+    MemoryBudget::GetInstance().Register("telemetry", MALLOC_CAP_INTERNAL, ring_.size() * sizeof(Record),
+        kMemoryPriorityFixed, [this]() { return ring_.size() * sizeof(Record); });
+}
+
+bool Telemetry::Tick() {
+    int64_t now = esp_timer_get_time();
+    if (last_sample_us_ == 0 || now - last_sample_us_ >= CONFIG_TELEMETRY_INTERVAL * 1000000LL) {
+        last_sample_us_ = now;
+        Sample();
+    }
+#if CONFIG_TELEMETRY_UPLOAD_INTERVAL > 0
+    if (now - last_upload_us_ >= CONFIG_TELEMETRY_UPLOAD_INTERVAL * 60 * 1000000LL) {
+        last_upload_us_ = now;
+        return true;
+    }
+#endif
+    return false;
+}
+
+void Telemetry::Sample() {
+    Record record = {};
+    record.uptime_s = esp_timer_get_time() / 1000000;
+    record.free_internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    record.largest_internal = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    record.free_dma = heap_caps_get_free_size(MALLOC_CAP_DMA);
+    record.largest_dma = heap_caps_get_largest_free_block(MALLOC_CAP_DMA);
+    record.free_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    record.largest_psram = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    SampleCpu(record);
+
+    auto& wifi = WifiManager::GetInstance();
+    if (wifi.IsInitialized() && wifi.IsConnected()) {
+        record.rssi = wifi.GetRssi();
+    }
+
+    auto depths = Application::GetInstance().GetAudioService().GetQueueDepths();
+    record.decode_queue = std::min<size_t>(depths.decode, UINT8_MAX);
+    record.encode_queue = std::min<size_t>(depths.encode, UINT8_MAX);
+    record.playback_queue = std::min<size_t>(depths.playback, UINT8_MAX);
+    record.send_queue = std::min<size_t>(depths.send, UINT8_MAX);
+    SampleFrames(record);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ring_[next_] = record;
+    next_ = (next_ + 1) % ring_.size();
+    count_ = std::min(count_ + 1, ring_.size());
+}
+
+void Telemetry::SampleCpu(Record& record) {
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 5;
+    TaskStatus_t* tasks = (TaskStatus_t*)malloc(sizeof(TaskStatus_t) * count);
+    if (tasks == nullptr) {
+        return;
+    }
+    configRUN_TIME_COUNTER_TYPE total_run_time;
+    count = uxTaskGetSystemState(tasks, count, &total_run_time);
+
+    configRUN_TIME_COUNTER_TYPE total_delta = total_run_time - last_total_run_time_;
+    for (int core = 0; core < CONFIG_FREERTOS_NUMBER_OF_CORES; core++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+        for (UBaseType_t i = 0; i < count; i++) {
+            if (tasks[i].xHandle != idle) {
+                continue;
+            }
+            configRUN_TIME_COUNTER_TYPE idle_delta = tasks[i].ulRunTimeCounter - last_idle_run_time_[core];
+            last_idle_run_time_[core] = tasks[i].ulRunTimeCounter;
+            // The first sample has no previous counters and covers the time since boot
+            if (total_delta > 0) {
+                uint64_t idle_permille = std::min<uint64_t>((uint64_t)idle_delta * 1000 / total_delta, 1000);
+                record.cpu_load[core] = 1000 - idle_permille;
+            }
+            break;
+        }
+    }
+    last_total_run_time_ = total_run_time;
+    free(tasks);
+}
+
+void Telemetry::SampleFrames(Record& record) {
+#if CONFIG_DISPLAY_FRAME_TRACE
+    auto display = dynamic_cast<LvglDisplay*>(Board::GetInstance().GetDisplay());
+    if (display == nullptr) {
+        return;
+    }
+    // The stats are cumulative until someone clears them, a clear makes them go back
+    auto stats = display->GetFrameStats(false);
+    if (stats.frames < last_frames_) {
+        last_frames_ = 0;
+        last_render_us_ = 0;
+        last_flush_wait_us_ = 0;
+    }
+    uint32_t frames = stats.frames - last_frames_;
+    record.frames = std::min<uint32_t>(frames, UINT16_MAX);
+    if (frames > 0) {
+        record.render_avg_us = (stats.render_us - last_render_us_) / frames;
+        record.flush_wait_avg_us = (stats.flush_wait_us - last_flush_wait_us_) / frames;
+    }
+    last_frames_ = stats.frames;
+    last_render_us_ = stats.render_us;
+    last_flush_wait_us_ = stats.flush_wait_us;
+#endif
+}
+
+std::string Telemetry::GetJson(bool series) {
+    return BuildJson(series, false);
+}
+
+std::string Telemetry::GetNotification() {
+    return BuildJson(false, true);
+}
+
+std::string Telemetry::BuildJson(bool series, bool notification) {
+    cJSON* root = cJSON_CreateObject();
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t first = (next_ + ring_.size() - count_) % ring_.size();
+    auto record_at = [&](size_t i) -> const Record& { return ring_[(first + i) % ring_.size()]; };
+
+    cJSON_AddNumberToObject(root, "interval_s", CONFIG_TELEMETRY_INTERVAL);
+    cJSON_AddNumberToObject(root, "samples", count_);
+    if (count_ > 0) {
+        cJSON_AddNumberToObject(root, "from_s", record_at(0).uptime_s);
+        cJSON_AddNumberToObject(root, "to_s", record_at(count_ - 1).uptime_s);
+    }
+
+    // [min, average, max, last] of every field
+    cJSON* fields = cJSON_CreateObject();
+    for (const auto& field : kFields) {
+        if (count_ == 0) {
+            break;
+        }
+        int64_t min = INT64_MAX, max = INT64_MIN, sum = 0;
+        for (size_t i = 0; i < count_; i++) {
+            int64_t value = field.get(record_at(i));
+            min = std::min(min, value);
+            max = std::max(max, value);
+            sum += value;
+        }
+        cJSON* values = cJSON_CreateArray();
+        cJSON_AddItemToArray(values, cJSON_CreateNumber(min));
+        cJSON_AddItemToArray(values, cJSON_CreateNumber(sum / (int64_t)count_));
+        cJSON_AddItemToArray(values, cJSON_CreateNumber(max));
+        cJSON_AddItemToArray(values, cJSON_CreateNumber(field.get(record_at(count_ - 1))));
+        cJSON_AddItemToObject(fields, field.name, values);
+    }
+    cJSON_AddItemToObject(root, "fields", fields);
+
+    if (series) {
+        cJSON* samples = cJSON_CreateObject();
+        cJSON* uptime = cJSON_CreateArray();
+        for (size_t i = 0; i < count_; i++) {
+            cJSON_AddItemToArray(uptime, cJSON_CreateNumber(record_at(i).uptime_s));
+        }
+        cJSON_AddItemToObject(samples, "uptime_s", uptime);
+        for (const auto& field : kFields) {
+            cJSON* values = cJSON_CreateArray();
+            for (size_t i = 0; i < count_; i++) {
+                cJSON_AddItemToArray(values, cJSON_CreateNumber(field.get(record_at(i))));
+            }
+            cJSON_AddItemToObject(samples, field.name, values);
+        }
+        cJSON_AddItemToObject(root, "series", samples);
+    }
+
+    if (notification) {
+        cJSON* message = cJSON_CreateObject();
+        cJSON_AddStringToObject(message, "jsonrpc", "2.0");
+        cJSON_AddStringToObject(message, "method", "notifications/telemetry");
+        cJSON_AddItemToObject(message, "params", root);
+        root = message;
+    }
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,88 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+
+/*
+ * Performance samples of the running device in a fixed-size ring, so a regression shows up
+ * without a serial console: the free heap and largest free block per capability (internal,
+ * DMA, PSRAM), the CPU load of each core, the Wi-Fi signal, the depths of the audio queues
+ * and the display frame times.
+ *
+ * Application calls Tick() on its clock tick, a sample is taken at most every
+ * CONFIG_TELEMETRY_INTERVAL seconds (an idle clock ticks once a minute). The MCP tool
+ * self.get_telemetry returns the aggregates and optionally the series, and with
+ * CONFIG_TELEMETRY_UPLOAD_INTERVAL the aggregates are pushed as `notifications/telemetry`.
+ */
+class Telemetry {
+public:
+    static Telemetry& GetInstance() {
+        static Telemetry instance;
+        return instance;
+    }
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+
+    // Main task. Samples when the interval passed, returns true when an upload is due
+    bool Tick();
+
+    // min, average, max and last of every field over the ring, with the samples if series
+    std::string GetJson(bool series);
+    // The aggregates as an MCP notification
+    std::string GetNotification();
+
+private:
+    Telemetry();
+
+    struct Record {
+        uint32_t uptime_s;
+        uint32_t free_internal;
+        uint32_t largest_internal;
+        uint32_t free_dma;
+        uint32_t largest_dma;
+        uint32_t free_psram;
+        uint32_t largest_psram;
+        // Per mille of each core, from the run time of its idle task
+        uint16_t cpu_load[CONFIG_FREERTOS_NUMBER_OF_CORES];
+        int8_t rssi;
+        uint8_t decode_queue;
+        uint8_t encode_queue;
+        uint8_t playback_queue;
+        uint8_t send_queue;
+        uint16_t frames;
+        uint32_t render_avg_us;
+        uint32_t flush_wait_avg_us;
+    };
+
+    struct Field {
+        const char* name;
+        int64_t (*get)(const Record& record);
+    };
+    static const Field kFields[];
+
+    std::mutex mutex_;
+    std::vector<Record> ring_;
+    size_t next_ = 0;
+    size_t count_ = 0;
+    int64_t last_sample_us_ = 0;
+    int64_t last_upload_us_ = 0;
+
+    // Counters of the previous sample, the record holds the differences
+    configRUN_TIME_COUNTER_TYPE last_total_run_time_ = 0;
+    configRUN_TIME_COUNTER_TYPE last_idle_run_time_[CONFIG_FREERTOS_NUMBER_OF_CORES] = {};
+    uint32_t last_frames_ = 0;
+    int64_t last_render_us_ = 0;
+    int64_t last_flush_wait_us_ = 0;
+
+    void Sample();
+    void SampleCpu(Record& record);
+    void SampleFrames(Record& record);
+    std::string BuildJson(bool series, bool notification);
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,93 @@
+#include "turn_latency.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "TurnLatency"
+
+// Upper bounds of the buckets, the last bucket takes the rest
+const uint16_t TurnLatency::kBucketBoundsMs[kBucketCount - 1] = {
+    100, 200, 300, 400, 500, 750, 1000, 1500, 2000, 3000, 5000,
+};
+
+static const char* const kMetricNames[kTurnLatencyMetricCount] = {
+    "stt", "tts_start", "first_audio", "wake_to_channel", "abort_to_silence",
+};
+
+void TurnLatency::Start(std::initializer_list<TurnLatencyMetric> metrics) {
+    int64_t now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto metric : metrics) {
+        start_us_[metric] = now;
+    }
+}
+
+void TurnLatency::MarkSpeechEnd() {
+    Start({kTurnLatencyStt, kTurnLatencyTtsStart, kTurnLatencyFirstAudio});
+}
+
+void TurnLatency::MarkWakeWord() {
+    Start({kTurnLatencyWakeToChannel});
+}
+
+void TurnLatency::MarkAbort() {
+    Start({kTurnLatencyAbortToSilence});
+}
+
+void TurnLatency::Mark(TurnLatencyMetric metric, int64_t time_us) {
+    if (time_us == 0) {
+        time_us = esp_timer_get_time();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t start_us = start_us_[metric];
+    if (start_us == 0) {
+        return;
+    }
+    start_us_[metric] = 0;
+    uint32_t ms = (uint32_t)(std::max<int64_t>(time_us - start_us, 0) / 1000);
+    auto& histogram = histograms_[metric];
+    int bucket = std::upper_bound(kBucketBoundsMs, kBucketBoundsMs + kBucketCount - 1, ms) - kBucketBoundsMs;
+    if (histogram.buckets[bucket] < UINT16_MAX) {
+        histogram.buckets[bucket]++;
+    }
+    histogram.count++;
+    histogram.sum_ms += ms;
+    histogram.max_ms = std::max(histogram.max_ms, ms);
+    ESP_LOGI(TAG, "%s: %lu ms", kMetricNames[metric], ms);
+}
+
+void TurnLatency::EndSession() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::fill(std::begin(start_us_), std::end(start_us_), 0);
+}
+
+std::string TurnLatency::TakeReportJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream json;
+    bool empty = true;
+    json << "{\"bounds_ms\":[";
+    for (int i = 0; i < kBucketCount - 1; i++) {
+        json << (i > 0 ? "," : "") << kBucketBoundsMs[i];
+    }
+    json << "]";
+    for (int metric = 0; metric < kTurnLatencyMetricCount; metric++) {
+        auto& histogram = histograms_[metric];
+        if (histogram.count == 0) {
+            continue;
+        }
+        empty = false;
+        json << ",\"" << kMetricNames[metric] << "\":{\"count\":" << histogram.count
+             << ",\"mean_ms\":" << histogram.sum_ms / histogram.count << ",\"max_ms\":" << histogram.max_ms
+             << ",\"buckets\":[";
+        for (int i = 0; i < kBucketCount; i++) {
+            json << (i > 0 ? "," : "") << histogram.buckets[i];
+        }
+        json << "]}";
+        histogram = Histogram();
+    }
+    json << "}";
+    return empty ? std::string() : json.str();
+}
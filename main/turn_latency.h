@@ -0,0 +1,72 @@
+#ifndef TURN_LATENCY_H
+#define TURN_LATENCY_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+
+/*
+ * The latencies the user hears in a conversation, measured on the device:
+ *
+ *   stt, tts_start, first_audio   from the end of the user's speech (local VAD or stop listening)
+ *                                 to the first stt message, tts start and decoded reply frame
+ *   wake_to_channel               from the wake word detection to the audio channel being ready
+ *   abort_to_silence              from AbortSpeaking() to the speaker running dry
+ *
+ * Each is kept as a histogram over the session and reported in its goodbye, see TakeReportJson().
+ * Marks may come from any task.
+ */
+enum TurnLatencyMetric {
+    kTurnLatencyStt,
+    kTurnLatencyTtsStart,
+    kTurnLatencyFirstAudio,
+    kTurnLatencyWakeToChannel,
+    kTurnLatencyAbortToSilence,
+    kTurnLatencyMetricCount,
+};
+
+class TurnLatency {
+public:
+    static TurnLatency& GetInstance() {
+        static TurnLatency instance;
+        return instance;
+    }
+    TurnLatency(const TurnLatency&) = delete;
+    TurnLatency& operator=(const TurnLatency&) = delete;
+
+    // The user stopped speaking, the reply metrics of the turn count from now
+    void MarkSpeechEnd();
+    void MarkWakeWord();
+    void MarkAbort();
+    // Records the metric once per start mark, at time_us if given
+    void Mark(TurnLatencyMetric metric, int64_t time_us = 0);
+    // Drops the pending measurements, a reply of the next session does not count against this one
+    void EndSession();
+
+    // {"bounds_ms":[...],"stt":{"count","mean_ms","max_ms","buckets"},...} of the metrics recorded
+    // since the last call, which are cleared. Empty when nothing was recorded
+    std::string TakeReportJson();
+
+private:
+    TurnLatency() = default;
+
+    static constexpr int kBucketCount = 12;
+    static const uint16_t kBucketBoundsMs[kBucketCount - 1];
+
+    struct Histogram {
+        uint16_t buckets[kBucketCount] = {};
+        uint32_t count = 0;
+        uint64_t sum_ms = 0;
+        uint32_t max_ms = 0;
+    };
+
+    std::mutex mutex_;
+    Histogram histograms_[kTurnLatencyMetricCount];
+    // Start of the pending measurement of each metric, 0 when none is pending
+    int64_t start_us_[kTurnLatencyMetricCount] = {};
+
+    void Start(std::initializer_list<TurnLatencyMetric> metrics);
+};
+
+#endif // TURN_LATENCY_H
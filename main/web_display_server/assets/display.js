@@ -9,6 +9,9 @@ class DisplayState {
         this.volume = -1;
         this.messages = [];
         this.maxMessages = 40;
+        // Version of the state, sent back on reconnect to resume with the missed deltas
+        this.epoch = null;
+        this.seq = 0;
     }
 
     updateFromFullState(data) {
@@ -28,9 +31,147 @@ class DisplayState {
         }
     }
 
+    appendMessage(role, delta) {
+        const last = this.messages[this.messages.length - 1];
+        if (last && last.role === role) {
+            last.content += delta;
+        } else {
+            this.addMessage(role, delta);
+        }
+    }
+
     clearMessages() {
         this.messages = [];
     }
+
+    applyDeltaFields(delta) {
+        const set = delta.set;
+        if (set.status !== undefined) this.status = set.status;
+        if (set.emotion !== undefined) this.emotion = set.emotion;
+        if (set.theme !== undefined) this.theme = set.theme;
+        if (set.battery !== undefined) this.battery = set.battery;
+        if (set.network !== undefined) this.network = set.network;
+        if (set.volume !== undefined) this.volume = set.volume;
+        this.seq = delta.seq;
+    }
+}
+
+// Decodes a binary delta (CONFIG_WEB_DISPLAY_BINARY_DELTAS) into the JSON form
+function decodeBinaryDelta(buffer) {
+    const view = new DataView(buffer);
+    const decoder = new TextDecoder();
+    let offset = 0;
+    const u8 = () => view.getUint8(offset++);
+    const i8 = () => view.getInt8(offset++);
+    const u32 = () => { const v = view.getUint32(offset, true); offset += 4; return v; };
+    const str = () => {
+        const len = view.getUint16(offset, true);
+        offset += 2;
+        const s = decoder.decode(new Uint8Array(buffer, offset, len));
+        offset += len;
+        return s;
+    };
+
+    if (u8() !== 1) {
+        throw new Error('Unknown binary delta version');
+    }
+    const delta = { type: 'delta', seq: u32(), set: {}, ops: [] };
+    const fields = u8();
+    if (fields & 1) delta.set.status = str();
+    if (fields & 2) delta.set.emotion = str();
+    if (fields & 4) delta.set.theme = str();
+    if (fields & 8) {
+        delta.set.battery = { level: i8(), charging: u8() !== 0 };
+        delta.set.network = str();
+        delta.set.volume = i8();
+    }
+    const count = u8();
+    const names = { 1: 'chat', 2: 'append', 3: 'clear', 4: 'notification' };
+    for (let i = 0; i < count; i++) {
+        const op = { op: names[u8()] };
+        if (op.op === 'chat' || op.op === 'append') {
+            op.role = str();
+            op.content = str();
+        } else if (op.op === 'notification') {
+            op.message = str();
+            op.duration = u32();
+        }
+        delta.ops.push(op);
+    }
+    return delta;
+}
+
+// Draws the framebuffer mirror frames (CONFIG_DISPLAY_MIRROR), see FramebufferMirror for the layout
+class MirrorRenderer {
+    constructor(canvas) {
+        this.canvas = canvas;
+        this.ctx = canvas.getContext('2d');
+        // Frames are drawn one after another, JPEG tiles decode asynchronously
+        this.pending = Promise.resolve();
+    }
+
+    draw(buffer) {
+        this.pending = this.pending.then(() => this.drawFrame(buffer)).catch(e => {
+            console.error('Failed to draw mirror frame:', e);
+        });
+    }
+
+    async drawFrame(buffer) {
+        const view = new DataView(buffer);
+        const width = view.getUint16(1, true);
+        const height = view.getUint16(3, true);
+        const count = view.getUint16(5, true);
+        if (this.canvas.width !== width || this.canvas.height !== height) {
+            this.canvas.width = width;
+            this.canvas.height = height;
+        }
+        this.canvas.hidden = false;
+
+        let offset = 7;
+        for (let i = 0; i < count; i++) {
+            const x = view.getUint16(offset, true);
+            const y = view.getUint16(offset + 2, true);
+            const w = view.getUint16(offset + 4, true);
+            const h = view.getUint16(offset + 6, true);
+            const encoding = view.getUint8(offset + 8);
+            const length = view.getUint32(offset + 9, true);
+            offset += 13;
+            const data = new Uint8Array(buffer, offset, length);
+            offset += length;
+
+            if (encoding === 1) {
+                this.ctx.putImageData(this.decodeRle(data, w, h), x, y);
+            } else if (encoding === 2) {
+                const bitmap = await createImageBitmap(new Blob([data], { type: 'image/jpeg' }));
+                this.ctx.drawImage(bitmap, x, y);
+                bitmap.close();
+            }
+        }
+    }
+
+    decodeRle(data, w, h) {
+        const image = this.ctx.createImageData(w, h);
+        const out = image.data;
+        let pos = 0;
+        const put = (lo, hi) => {
+            const v = lo | (hi << 8);
+            out[pos++] = ((v >> 11) & 0x1f) * 255 / 31;
+            out[pos++] = ((v >> 5) & 0x3f) * 255 / 63;
+            out[pos++] = (v & 0x1f) * 255 / 31;
+            out[pos++] = 255;
+        };
+        let i = 0;
+        while (i < data.length && pos < out.length) {
+            const header = data[i++];
+            if (header < 128) {
+                for (let n = 0; n <= header; n++, i += 2) put(data[i], data[i + 1]);
+            } else {
+                for (let n = 0; n < header - 126; n++) put(data[i], data[i + 1]);
+                i += 2;
+            }
+        }
+        return image;
+    }
 }
 
 // WebSocket connection manager
@@ -43,14 +184,18 @@ class WebSocketManager {
         this.reconnectDelay = 2000;
         this.isConnected = false;
         this.onMessage = null;
+        this.onMirrorFrame = null;
         this.onConnectionChange = null;
     }
 
     connect() {
-        console.log('Connecting to WebSocket:', this.url);
+        // The URL may be a function, it carries the sequence to resume from
+        const url = typeof this.url === 'function' ? this.url() : this.url;
+        console.log('Connecting to WebSocket:', url);
 
         try {
-            this.ws = new WebSocket(this.url);
+            this.ws = new WebSocket(url);
+            this.ws.binaryType = 'arraybuffer';
 
             this.ws.onopen = () => {
                 console.log('WebSocket connected');
@@ -62,8 +207,15 @@ class WebSocketManager {
             };
 
             this.ws.onmessage = (event) => {
+                if (event.data instanceof ArrayBuffer && new Uint8Array(event.data)[0] === 0x4d) {
+                    if (this.onMirrorFrame) {
+                        this.onMirrorFrame(event.data);
+                    }
+                    return;
+                }
                 try {
-                    const message = JSON.parse(event.data);
+                    const message = event.data instanceof ArrayBuffer ?
+                        decodeBinaryDelta(event.data) : JSON.parse(event.data);
                     if (this.onMessage) {
                         this.onMessage(message);
                     }
@@ -774,6 +926,19 @@ class UIRenderer {
         this.scrollToBottom();
     }
 
+    appendMessage(role, delta) {
+        if (!this.elements.chatMessages) return;
+
+        const last = this.elements.chatMessages.lastElementChild;
+        if (last && last.classList.contains(role)) {
+            // Adds a text node, the text already shown is left alone
+            last.append(delta);
+            this.scrollToBottom();
+        } else {
+            this.addMessage(role, delta);
+        }
+    }
+
     clearMessages() {
         if (this.elements.chatMessages) {
             this.elements.chatMessages.innerHTML = '';
@@ -833,7 +998,30 @@ class DisplayApp {
         const protocol = window.location.protocol === 'https:' ? 'wss:' : 'ws:';
         const wsUrl = `${protocol}//${window.location.host}/ws/display`;
 
-        this.wsManager = new WebSocketManager(wsUrl);
+        this.mirror = new MirrorRenderer(document.getElementById('mirrorCanvas'));
+        this.mirrorEnabled = false;
+
+        this.wsManager = new WebSocketManager(() => {
+            const mirror = this.mirrorEnabled ? '&mirror=1' : '';
+            if (this.state.epoch === null) {
+                return `${wsUrl}?enc=bin${mirror}`;
+            }
+            return `${wsUrl}?epoch=${this.state.epoch}&seq=${this.state.seq}&enc=bin${mirror}`;
+        });
+        this.wsManager.onMirrorFrame = (buffer) => this.mirror.draw(buffer);
+
+        const mirrorButton = document.getElementById('btnMirror');
+        if (mirrorButton) {
+            mirrorButton.addEventListener('click', () => {
+                this.mirrorEnabled = !this.mirrorEnabled;
+                mirrorButton.classList.toggle('active', this.mirrorEnabled);
+                if (!this.mirrorEnabled) {
+                    this.mirror.canvas.hidden = true;
+                }
+                // The server learns about the mirror from the URL, reconnecting resumes the state
+                this.wsManager.disconnect();
+            });
+        }
         this.wsManager.onMessage = (msg) => this.handleMessage(msg);
         this.wsManager.onConnectionChange = (connected) => {
             this.renderer.setConnectionStatus(connected);
@@ -852,14 +1040,25 @@ class DisplayApp {
         switch (message.type) {
             case 'full_state':
                 this.state.updateFromFullState(message.data);
+                this.state.epoch = message.epoch !== undefined ? message.epoch : null;
+                this.state.seq = message.seq || 0;
                 this.render();
                 break;
 
+            case 'delta':
+                this.handleDelta(message);
+                break;
+
             case 'chat_message':
                 this.state.addMessage(message.role, message.content);
                 this.renderer.addMessage(message.role, message.content);
                 break;
 
+            case 'chat_delta':
+                this.state.appendMessage(message.role, message.content);
+                this.renderer.appendMessage(message.role, message.content);
+                break;
+
             case 'state_update':
                 if (message.field === 'status') {
                     this.state.status = message.value;
@@ -887,6 +1086,46 @@ class DisplayApp {
         }
     }
 
+    handleDelta(delta) {
+        if (delta.seq <= this.state.seq) {
+            // Already part of the state or of the deltas we resumed with
+            return;
+        }
+        if (delta.seq !== this.state.seq + 1) {
+            // A delta went missing, reconnecting resumes from the last one applied
+            console.warn(`Delta ${delta.seq} after ${this.state.seq}, resyncing`);
+            this.wsManager.disconnect();
+            return;
+        }
+        this.state.applyDeltaFields(delta);
+
+        const set = delta.set;
+        if (set.status !== undefined) this.renderer.renderStatus(this.state.status);
+        if (set.emotion !== undefined) this.renderer.renderEmotion(this.state.emotion);
+        if (set.battery !== undefined) {
+            this.renderer.updateStatusBar(this.state.battery, this.state.network, this.state.volume);
+        }
+        delta.ops.forEach(op => {
+            switch (op.op) {
+                case 'chat':
+                    this.state.addMessage(op.role, op.content);
+                    this.renderer.addMessage(op.role, op.content);
+                    break;
+                case 'append':
+                    this.state.appendMessage(op.role, op.content);
+                    this.renderer.appendMessage(op.role, op.content);
+                    break;
+                case 'clear':
+                    this.state.clearMessages();
+                    this.renderer.clearMessages();
+                    break;
+                case 'notification':
+                    if (op.message) this.operations.showNotification(op.message, 'info');
+                    break;
+            }
+        });
+    }
+
     render() {
         this.renderer.renderStatus(this.state.status);
         this.renderer.renderEmotion(this.state.emotion);
@@ -1,12 +1,19 @@
 #include "display_bridge.h"
 #include <esp_timer.h>
 #include <esp_log.h>
+#include <esp_random.h>
+#include <algorithm>
 #include <sstream>
 
 static const char* TAG = "DisplayBridge";
 
+// Flushed deltas kept for resuming clients
+static constexpr size_t DELTA_HISTORY_SIZE = 32;
+// Version of the binary delta layout, its first byte
+static constexpr uint8_t BINARY_DELTA_VERSION = 1;
+
 DisplayBridge::DisplayBridge(Display* wrapped, WebDisplayServer* server)
-    : wrapped_display_(wrapped), web_server_(server) {
+    : wrapped_display_(wrapped), web_server_(server), epoch_(esp_random()) {
     if (wrapped_display_) {
         width_ = wrapped_display_->width();
         height_ = wrapped_display_->height();
@@ -22,6 +29,13 @@ DisplayBridge::DisplayBridge(Display* wrapped, WebDisplayServer* server)
     current_state_.battery_charging = false;
     current_state_.network_status = "unknown";
     current_state_.volume = -1;
+
+    if (web_server_) {
+        web_server_->SetFlushCallback([this]() {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            FlushDelta();
+        });
+    }
 }
 
 DisplayBridge::~DisplayBridge() {
@@ -36,10 +50,10 @@ void DisplayBridge::SetStatus(const char* status) {
     }
 
     std::lock_guard<std::mutex> lock(state_mutex_);
-    current_state_.status = status ? status : "";
-
-    if (web_server_) {
-        web_server_->BroadcastStateUpdate("status", current_state_.status);
+    std::string value = status ? status : "";
+    if (current_state_.status != value) {
+        current_state_.status = std::move(value);
+        MarkChanged(kDisplayDeltaStatus);
     }
 }
 
@@ -52,12 +66,7 @@ void DisplayBridge::ShowNotification(const char* notification, int duration_ms)
     current_state_.notification = notification ? notification : "";
     current_state_.notification_expire_time = esp_timer_get_time() + (duration_ms * 1000LL);
 
-    if (web_server_) {
-        std::string escaped = EscapeJson(current_state_.notification);
-        std::string msg = "{\"type\":\"notification\",\"message\":\"" + escaped +
-                         "\",\"duration\":" + std::to_string(duration_ms) + "}";
-        web_server_->BroadcastFullState(msg);
-    }
+    AddOp({DisplayDeltaOp::kNotification, "", current_state_.notification, duration_ms});
 }
 
 void DisplayBridge::ShowNotification(const std::string& notification, int duration_ms) {
@@ -70,10 +79,10 @@ void DisplayBridge::SetEmotion(const char* emotion) {
     }
 
     std::lock_guard<std::mutex> lock(state_mutex_);
-    current_state_.emotion = emotion ? emotion : "neutral";
-
-    if (web_server_) {
-        web_server_->BroadcastStateUpdate("emotion", current_state_.emotion);
+    std::string value = emotion ? emotion : "neutral";
+    if (current_state_.emotion != value) {
+        current_state_.emotion = std::move(value);
+        MarkChanged(kDisplayDeltaEmotion);
     }
 }
 
@@ -94,9 +103,32 @@ void DisplayBridge::SetChatMessage(const char* role, const char* content) {
         current_state_.messages.erase(current_state_.messages.begin());
     }
 
-    if (web_server_) {
-        web_server_->BroadcastChatMessage(msg.role, msg.content);
+    AddOp({DisplayDeltaOp::kChat, msg.role, msg.content});
+}
+
+void DisplayBridge::AppendChatMessage(const char* role, const char* delta) {
+    if (wrapped_display_) {
+        wrapped_display_->AppendChatMessage(role, delta);
+    }
+
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    std::string role_str = role ? role : "";
+    std::string delta_str = delta ? delta : "";
+    auto& messages = current_state_.messages;
+    if (!messages.empty() && messages.back().role == role_str) {
+        messages.back().content += delta_str;
+    } else {
+        ChatMessage msg;
+        msg.role = role_str;
+        msg.content = delta_str;
+        messages.push_back(msg);
+        if (messages.size() > max_messages_) {
+            messages.erase(messages.begin());
+        }
     }
+
+    // Clients only receive the new text, not the whole message again
+    AddOp({DisplayDeltaOp::kAppend, role_str, delta_str});
 }
 
 void DisplayBridge::ClearChatMessages() {
@@ -106,10 +138,7 @@ void DisplayBridge::ClearChatMessages() {
 
     std::lock_guard<std::mutex> lock(state_mutex_);
     current_state_.messages.clear();
-
-    if (web_server_) {
-        web_server_->BroadcastClearMessages();
-    }
+    AddOp({DisplayDeltaOp::kClear});
 }
 
 void DisplayBridge::SetTheme(Theme* theme) {
@@ -120,10 +149,18 @@ void DisplayBridge::SetTheme(Theme* theme) {
     current_theme_ = theme;
 
     std::lock_guard<std::mutex> lock(state_mutex_);
-    current_state_.theme = theme ? theme->name() : "dark";
+    std::string value = theme ? theme->name() : "dark";
+    if (current_state_.theme != value) {
+        current_state_.theme = std::move(value);
+        MarkChanged(kDisplayDeltaTheme);
+    }
+}
 
-    if (web_server_) {
-        web_server_->BroadcastStateUpdate("theme", current_state_.theme);
+void DisplayBridge::Post(DisplayCommand&& command, DisplayCommandKey key) {
+    if (wrapped_display_) {
+        wrapped_display_->Post(std::move(command), key);
+    } else {
+        command();
     }
 }
 
@@ -138,19 +175,7 @@ void DisplayBridge::UpdateStatusBar(bool update_all) {
 
     // Update cached status bar info
     std::lock_guard<std::mutex> lock(state_mutex_);
-    UpdateBatteryStatus();
-    UpdateNetworkStatus();
-    UpdateVolumeStatus();
-
-    // Broadcast full status bar update
-    if (web_server_) {
-        std::ostringstream json;
-        json << "{\"type\":\"status_bar\",\"battery\":{\"level\":" << current_state_.battery_level
-             << ",\"charging\":" << (current_state_.battery_charging ? "true" : "false")
-             << "},\"network\":\"" << current_state_.network_status
-             << "\",\"volume\":" << current_state_.volume << "}";
-        web_server_->BroadcastFullState(json.str());
-    }
+    RefreshStatusBarState();
 }
 
 void DisplayBridge::SetPowerSaveMode(bool on) {
@@ -159,6 +184,12 @@ void DisplayBridge::SetPowerSaveMode(bool on) {
     }
 }
 
+void DisplayBridge::SetFrameRate(DisplayFrameRate rate) {
+    if (wrapped_display_) {
+        wrapped_display_->SetFrameRate(rate);
+    }
+}
+
 void DisplayBridge::SetupUI() {
     if (wrapped_display_) {
         wrapped_display_->SetupUI();
@@ -182,12 +213,12 @@ std::string DisplayBridge::GetFullStateJson() {
     std::lock_guard<std::mutex> lock(state_mutex_);
 
     // Update latest status
-    UpdateBatteryStatus();
-    UpdateNetworkStatus();
-    UpdateVolumeStatus();
+    RefreshStatusBarState();
+    // The state must match seq_ exactly, so the pending changes get their number first
+    FlushDelta();
 
     std::ostringstream json;
-    json << "{\"type\":\"full_state\",\"data\":{";
+    json << "{\"type\":\"full_state\",\"epoch\":" << epoch_ << ",\"seq\":" << seq_ << ",\"data\":{";
     json << "\"status\":\"" << EscapeJson(current_state_.status) << "\",";
     json << "\"emotion\":\"" << EscapeJson(current_state_.emotion) << "\",";
     json << "\"theme\":\"" << current_state_.theme << "\",";
@@ -207,6 +238,197 @@ std::string DisplayBridge::GetFullStateJson() {
     return json.str();
 }
 
+void DisplayBridge::RefreshStatusBarState() {
+    int battery_level = current_state_.battery_level;
+    bool battery_charging = current_state_.battery_charging;
+    std::string network_status = current_state_.network_status;
+    int volume = current_state_.volume;
+    UpdateBatteryStatus();
+    UpdateNetworkStatus();
+    UpdateVolumeStatus();
+    if (battery_level != current_state_.battery_level || battery_charging != current_state_.battery_charging ||
+        network_status != current_state_.network_status || volume != current_state_.volume) {
+        MarkChanged(kDisplayDeltaStatusBar);
+    }
+}
+
+bool DisplayBridge::GetDeltasSince(uint32_t epoch, uint32_t seq, bool binary, std::vector<std::string>& frames) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    FlushDelta();
+    if (epoch != epoch_ || seq > seq_) {
+        return false;
+    }
+    if (seq < seq_ && (history_.empty() || history_.front().seq > seq + 1)) {
+        return false;
+    }
+    for (auto& delta : history_) {
+        if (delta.seq > seq) {
+            frames.push_back(binary ? delta.binary : delta.json);
+        }
+    }
+    return true;
+}
+
+void DisplayBridge::MarkChanged(uint8_t fields) {
+    pending_fields_ |= fields;
+    // The delta is built and sent on the httpd task, the caller only records the change. Everything
+    // changed until that task gets to it goes out as one delta. While the server is stopped the
+    // changes pile up in the pending delta, the first client flushes them with the full state
+    if (!flush_scheduled_ && web_server_) {
+        flush_scheduled_ = web_server_->ScheduleFlush();
+    }
+}
+
+void DisplayBridge::AddOp(DisplayDeltaOp&& op) {
+    if (op.type == DisplayDeltaOp::kClear) {
+        // Messages cleared in the same delta need not be sent at all
+        pending_ops_.erase(std::remove_if(pending_ops_.begin(), pending_ops_.end(), [](const DisplayDeltaOp& o) {
+            return o.type == DisplayDeltaOp::kChat || o.type == DisplayDeltaOp::kAppend;
+        }), pending_ops_.end());
+    } else if (op.type == DisplayDeltaOp::kAppend && !pending_ops_.empty()) {
+        // Streamed text of one role becomes one append, or extends the message it was added to
+        auto& last = pending_ops_.back();
+        if ((last.type == DisplayDeltaOp::kAppend || last.type == DisplayDeltaOp::kChat) && last.role == op.role) {
+            last.content += op.content;
+            MarkChanged(0);
+            return;
+        }
+    }
+    if (pending_ops_.size() == UINT8_MAX) {
+        // The binary encoding counts the ops in a byte
+        FlushDelta();
+    }
+    pending_ops_.push_back(std::move(op));
+    MarkChanged(0);
+}
+
+void DisplayBridge::FlushDelta() {
+    flush_scheduled_ = false;
+    if (pending_fields_ == 0 && pending_ops_.empty()) {
+        return;
+    }
+    DisplayDelta delta;
+    delta.seq = ++seq_;
+    delta.json = BuildDeltaJson();
+#if CONFIG_WEB_DISPLAY_BINARY_DELTAS
+    delta.binary = BuildDeltaBinary();
+#endif
+    pending_fields_ = 0;
+    pending_ops_.clear();
+
+    if (web_server_) {
+        web_server_->BroadcastDelta(delta.json, delta.binary);
+    }
+    history_.push_back(std::move(delta));
+    if (history_.size() > DELTA_HISTORY_SIZE) {
+        history_.pop_front();
+    }
+}
+
+std::string DisplayBridge::BuildDeltaJson() {
+    std::ostringstream json;
+    json << "{\"type\":\"delta\",\"seq\":" << seq_ << ",\"set\":{";
+    const char* separator = "";
+    if (pending_fields_ & kDisplayDeltaStatus) {
+        json << separator << "\"status\":\"" << EscapeJson(current_state_.status) << "\"";
+        separator = ",";
+    }
+    if (pending_fields_ & kDisplayDeltaEmotion) {
+        json << separator << "\"emotion\":\"" << EscapeJson(current_state_.emotion) << "\"";
+        separator = ",";
+    }
+    if (pending_fields_ & kDisplayDeltaTheme) {
+        json << separator << "\"theme\":\"" << current_state_.theme << "\"";
+        separator = ",";
+    }
+    if (pending_fields_ & kDisplayDeltaStatusBar) {
+        json << separator << "\"battery\":{\"level\":" << current_state_.battery_level
+             << ",\"charging\":" << (current_state_.battery_charging ? "true" : "false")
+             << "},\"network\":\"" << current_state_.network_status
+             << "\",\"volume\":" << current_state_.volume;
+    }
+    json << "},\"ops\":[";
+    separator = "";
+    for (auto& op : pending_ops_) {
+        json << separator;
+        separator = ",";
+        switch (op.type) {
+            case DisplayDeltaOp::kChat:
+            case DisplayDeltaOp::kAppend:
+                json << "{\"op\":\"" << (op.type == DisplayDeltaOp::kChat ? "chat" : "append")
+                     << "\",\"role\":\"" << EscapeJson(op.role) << "\",\"content\":\"" << EscapeJson(op.content) << "\"}";
+                break;
+            case DisplayDeltaOp::kClear:
+                json << "{\"op\":\"clear\"}";
+                break;
+            case DisplayDeltaOp::kNotification:
+                json << "{\"op\":\"notification\",\"message\":\"" << EscapeJson(op.content)
+                     << "\",\"duration\":" << op.duration_ms << "}";
+                break;
+        }
+    }
+    json << "]}";
+    return json.str();
+}
+
+static void AppendU16(std::string& out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+static void AppendU32(std::string& out, uint32_t value) {
+    AppendU16(out, value & 0xffff);
+    AppendU16(out, value >> 16);
+}
+
+static void AppendString(std::string& out, const std::string& str) {
+    size_t len = std::min<size_t>(str.size(), UINT16_MAX);
+    AppendU16(out, len);
+    out.append(str, 0, len);
+}
+
+/*
+ * Little endian: u8 version, u32 seq, u8 field mask, then the fields of the mask in bit order
+ * (strings are u16 length + UTF-8, the status bar is i8 battery level, u8 charging, network,
+ * i8 volume), u8 op count and the ops (u8 type, then role and content for chat and append,
+ * message and u32 duration for notifications).
+ */
+std::string DisplayBridge::BuildDeltaBinary() {
+    std::string out;
+    out.push_back(BINARY_DELTA_VERSION);
+    AppendU32(out, seq_);
+    out.push_back(pending_fields_);
+    if (pending_fields_ & kDisplayDeltaStatus) {
+        AppendString(out, current_state_.status);
+    }
+    if (pending_fields_ & kDisplayDeltaEmotion) {
+        AppendString(out, current_state_.emotion);
+    }
+    if (pending_fields_ & kDisplayDeltaTheme) {
+        AppendString(out, current_state_.theme);
+    }
+    if (pending_fields_ & kDisplayDeltaStatusBar) {
+        out.push_back((int8_t)current_state_.battery_level);
+        out.push_back(current_state_.battery_charging ? 1 : 0);
+        AppendString(out, current_state_.network_status);
+        out.push_back((int8_t)current_state_.volume);
+    }
+    size_t count = std::min<size_t>(pending_ops_.size(), UINT8_MAX);
+    out.push_back(count);
+    for (size_t i = 0; i < count; i++) {
+        auto& op = pending_ops_[i];
+        out.push_back(op.type);
+        if (op.type == DisplayDeltaOp::kChat || op.type == DisplayDeltaOp::kAppend) {
+            AppendString(out, op.role);
+            AppendString(out, op.content);
+        } else if (op.type == DisplayDeltaOp::kNotification) {
+            AppendString(out, op.content);
+            AppendU32(out, op.duration_ms);
+        }
+    }
+    return out;
+}
+
 void DisplayBridge::UpdateBatteryStatus() {
     // This will be populated from Board battery info in a future update
     // For now, set default values
@@ -5,6 +5,7 @@
 #include "web_display_server.h"
 #include <string>
 #include <vector>
+#include <deque>
 #include <mutex>
 
 struct ChatMessage {
@@ -25,6 +26,42 @@ struct DisplayState {
     int64_t notification_expire_time = 0;
 };
 
+// Fields of DisplayState carried by a delta
+enum DisplayDeltaField : uint8_t {
+    kDisplayDeltaStatus = 1 << 0,
+    kDisplayDeltaEmotion = 1 << 1,
+    kDisplayDeltaTheme = 1 << 2,
+    kDisplayDeltaStatusBar = 1 << 3,
+};
+
+// Ordered changes of a delta that are not a field value
+struct DisplayDeltaOp {
+    enum Type : uint8_t {
+        kChat = 1,
+        kAppend = 2,
+        kClear = 3,
+        kNotification = 4,
+    };
+    Type type;
+    std::string role;
+    std::string content;
+    int duration_ms = 0;
+};
+
+// A flushed delta in both encodings, kept so reconnecting clients can resume from a sequence
+struct DisplayDelta {
+    uint32_t seq;
+    std::string json;
+    std::string binary;
+};
+
+/*
+ * Mirrors the wrapped display to the web clients as a versioned state. Every change is recorded
+ * in a pending delta, and the changes made until the httpd task flushes it go out as one frame
+ * numbered by seq_ (a delta carries the latest value of the fields it touched and its ops in
+ * order). The full state carries the epoch and sequence it matches, so a client that lost its
+ * connection for a short while resumes with the deltas it missed instead of the full state.
+ */
 class DisplayBridge : public Display {
 public:
     DisplayBridge(Display* wrapped, WebDisplayServer* server);
@@ -36,15 +73,20 @@ public:
     void ShowNotification(const std::string& notification, int duration_ms = 3000) override;
     void SetEmotion(const char* emotion) override;
     void SetChatMessage(const char* role, const char* content) override;
+    void AppendChatMessage(const char* role, const char* delta) override;
     void ClearChatMessages() override;
     void SetTheme(Theme* theme) override;
     Theme* GetTheme() override;
     void UpdateStatusBar(bool update_all = false) override;
     void SetPowerSaveMode(bool on) override;
+    void SetFrameRate(DisplayFrameRate rate) override;
     void SetupUI() override;
+    void Post(DisplayCommand&& command, DisplayCommandKey key = kDisplayCommandKeyNone) override;
 
     // Get current state for new clients
     std::string GetFullStateJson();
+    // The deltas after seq in frames, false when the client has to take the full state instead
+    bool GetDeltasSince(uint32_t epoch, uint32_t seq, bool binary, std::vector<std::string>& frames);
 
 protected:
     bool Lock(int timeout_ms = 0) override;
@@ -57,6 +99,23 @@ private:
     std::mutex state_mutex_;
     int max_messages_ = 40;
 
+    // Changes every boot, so a client never resumes against another boot's sequence
+    const uint32_t epoch_;
+    uint32_t seq_ = 0;
+    uint8_t pending_fields_ = 0;
+    std::vector<DisplayDeltaOp> pending_ops_;
+    bool flush_scheduled_ = false;
+    std::deque<DisplayDelta> history_;
+
+    // Called with state_mutex_ held
+    // Updates the status bar fields, the clients only hear of them when they changed
+    void RefreshStatusBarState();
+    void MarkChanged(uint8_t fields);
+    void AddOp(DisplayDeltaOp&& op);
+    void FlushDelta();
+    std::string BuildDeltaJson();
+    std::string BuildDeltaBinary();
+
     // Helper methods
     void UpdateBatteryStatus();
     void UpdateNetworkStatus();
@@ -3,17 +3,68 @@
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <sys/param.h>
+#include <cstdlib>
 #include <cstring>
 
 static const char* TAG = "WebDisplay";
 
-// External declarations for embedded assets
-extern const uint8_t index_html_start[] asm("_binary_index_html_start");
-extern const uint8_t index_html_end[] asm("_binary_index_html_end");
-extern const uint8_t display_css_start[] asm("_binary_display_css_start");
-extern const uint8_t display_css_end[] asm("_binary_display_css_end");
-extern const uint8_t display_js_start[] asm("_binary_display_js_start");
-extern const uint8_t display_js_end[] asm("_binary_display_js_end");
+// Frames a client may have waiting before it is resynced with the full state
+static constexpr size_t WS_CLIENT_QUEUE_DEPTH = 16;
+// Mirror frames a client may have waiting, the rest of the queue is kept for the deltas
+static constexpr size_t WS_CLIENT_MIRROR_DEPTH = WS_CLIENT_QUEUE_DEPTH / 2;
+// Audio monitor frames a client may have waiting, about half a second of both directions
+static constexpr size_t WS_CLIENT_AUDIO_DEPTH = 16;
+
+// External declarations for embedded assets, gzipped by scripts/gzip_web_assets.py
+extern const uint8_t index_html_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_end[] asm("_binary_index_html_gz_end");
+extern const uint8_t display_css_start[] asm("_binary_display_css_gz_start");
+extern const uint8_t display_css_end[] asm("_binary_display_css_gz_end");
+extern const uint8_t display_js_start[] asm("_binary_display_js_gz_start");
+extern const uint8_t display_js_end[] asm("_binary_display_js_gz_end");
+
+/*
+ * An embedded asset with a strong ETag of its content, so a reload only costs a 304. The page
+ * always revalidates, it names the stylesheet and script by fixed URLs that an OTA may change,
+ * which is why those are only cached for a day.
+ */
+struct StaticAsset {
+    const uint8_t* start;
+    const uint8_t* end;
+    const char* type;
+    const char* cache_control;
+    char etag[20];
+};
+
+static StaticAsset index_asset = {index_html_start, index_html_end, "text/html", "no-cache", {}};
+static StaticAsset css_asset = {display_css_start, display_css_end, "text/css", "public, max-age=86400", {}};
+static StaticAsset js_asset = {display_js_start, display_js_end, "application/javascript", "public, max-age=86400", {}};
+
+static void InitializeAssetEtag(StaticAsset& asset) {
+    // FNV-1a of the compressed bytes
+    uint64_t hash = 14695981039346656037ULL;
+    for (const uint8_t* p = asset.start; p < asset.end; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    snprintf(asset.etag, sizeof(asset.etag), "\"%016llx\"", (unsigned long long)hash);
+}
+
+static esp_err_t SendStaticAsset(httpd_req_t* req, const StaticAsset& asset) {
+    httpd_resp_set_hdr(req, "ETag", asset.etag);
+    httpd_resp_set_hdr(req, "Cache-Control", asset.cache_control);
+
+    char if_none_match[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, asset.etag) != nullptr) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    httpd_resp_set_type(req, asset.type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    return httpd_resp_send(req, (const char*)asset.start, asset.end - asset.start);
+}
 
 WebDisplayServer::WebDisplayServer() {
 }
@@ -28,6 +79,10 @@ bool WebDisplayServer::Start(int port) {
         return true;
     }
 
+    InitializeAssetEtag(index_asset);
+    InitializeAssetEtag(css_asset);
+    InitializeAssetEtag(js_asset);
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = port;
     config.max_open_sockets = 7;
@@ -62,6 +117,20 @@ bool WebDisplayServer::Start(int port) {
         .user_ctx = this
     };
 
+    httpd_uri_t api_mcp_stats_uri = {
+        .uri = "/api/mcp/stats",
+        .method = HTTP_GET,
+        .handler = ApiMcpStatsHandler,
+        .user_ctx = this
+    };
+
+    httpd_uri_t audio_capture_uri = {
+        .uri = "/api/audio/capture.wav",
+        .method = HTTP_GET,
+        .handler = AudioCaptureHandler,
+        .user_ctx = this
+    };
+
     httpd_uri_t ws_uri = {
         .uri = "/ws/display",
         .method = HTTP_GET,
@@ -75,6 +144,8 @@ bool WebDisplayServer::Start(int port) {
         httpd_register_uri_handler(server_, &css_uri);
         httpd_register_uri_handler(server_, &js_uri);
         httpd_register_uri_handler(server_, &api_state_uri);
+        httpd_register_uri_handler(server_, &api_mcp_stats_uri);
+        httpd_register_uri_handler(server_, &audio_capture_uri);
         httpd_register_uri_handler(server_, &ws_uri);
         ESP_LOGI(TAG, "Web Display Server started on port %d", port);
         return true;
@@ -90,26 +161,23 @@ void WebDisplayServer::Stop() {
         server_ = nullptr;
         std::lock_guard<std::mutex> lock(clients_mutex_);
         clients_.clear();
+        audio_clients_ = 0;
+        // Queued work items die with the server
+        drain_scheduled_ = false;
         ESP_LOGI(TAG, "Web Display Server stopped");
     }
 }
 
 esp_err_t WebDisplayServer::IndexHandler(httpd_req_t* req) {
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, (const char*)index_html_start, index_html_end - index_html_start);
-    return ESP_OK;
+    return SendStaticAsset(req, index_asset);
 }
 
 esp_err_t WebDisplayServer::CssHandler(httpd_req_t* req) {
-    httpd_resp_set_type(req, "text/css");
-    httpd_resp_send(req, (const char*)display_css_start, display_css_end - display_css_start);
-    return ESP_OK;
+    return SendStaticAsset(req, css_asset);
 }
 
 esp_err_t WebDisplayServer::JsHandler(httpd_req_t* req) {
-    httpd_resp_set_type(req, "application/javascript");
-    httpd_resp_send(req, (const char*)display_js_start, display_js_end - display_js_start);
-    return ESP_OK;
+    return SendStaticAsset(req, js_asset);
 }
 
 esp_err_t WebDisplayServer::ApiStateHandler(httpd_req_t* req) {
@@ -127,6 +195,39 @@ esp_err_t WebDisplayServer::ApiStateHandler(httpd_req_t* req) {
     return ESP_OK;
 }
 
+esp_err_t WebDisplayServer::ApiMcpStatsHandler(httpd_req_t* req) {
+    WebDisplayServer* server = GetServerFromReq(req);
+    if (!server || !server->get_mcp_stats_callback_) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    std::string stats = server->get_mcp_stats_callback_();
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, stats.c_str(), stats.size());
+    return ESP_OK;
+}
+
+esp_err_t WebDisplayServer::AudioCaptureHandler(httpd_req_t* req) {
+    WebDisplayServer* server = GetServerFromReq(req);
+    if (!server || !server->audio_capture_callback_) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "audio/wav");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"capture.wav\"");
+    bool ok = server->audio_capture_callback_([req](const void* data, size_t len) {
+        return httpd_resp_send_chunk(req, static_cast<const char*>(data), len) == ESP_OK;
+    });
+    if (!ok) {
+        ESP_LOGW(TAG, "Audio capture download aborted");
+        return ESP_FAIL;
+    }
+    httpd_resp_send_chunk(req, nullptr, 0);
+    return ESP_OK;
+}
+
 esp_err_t WebDisplayServer::WsHandler(httpd_req_t* req) {
     WebDisplayServer* server = GetServerFromReq(req);
     if (!server) {
@@ -134,25 +235,50 @@ esp_err_t WebDisplayServer::WsHandler(httpd_req_t* req) {
     }
 
     if (req->method == HTTP_GET) {
-        // New WebSocket connection
+        // New WebSocket connection, /ws/display?epoch=&seq=&enc=bin resumes after the last delta seen
         int fd = httpd_req_to_sockfd(req);
-        ESP_LOGI(TAG, "WebSocket handshake for fd %d", fd);
-        server->AddClient(fd);
-
-        // Send initial state to the new client
-        if (server->get_state_callback_) {
-            std::string state = server->get_state_callback_();
-
-            httpd_ws_frame_t ws_pkt;
-            memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-            ws_pkt.type = HTTPD_WS_TYPE_TEXT;
-            ws_pkt.payload = (uint8_t*)state.c_str();
-            ws_pkt.len = state.length();
-
-            esp_err_t ret = httpd_ws_send_frame_async(server->server_, fd, &ws_pkt);
-            if (ret != ESP_OK) {
-                ESP_LOGW(TAG, "Failed to send initial state to new client fd=%d: %d", fd, ret);
+        char query[64] = {0};
+        char value[16];
+        bool resume = false;
+        uint32_t epoch = 0;
+        uint32_t seq = 0;
+        bool binary = false;
+        bool mirror = false;
+        bool audio = false;
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+            if (httpd_query_key_value(query, "epoch", value, sizeof(value)) == ESP_OK) {
+                epoch = strtoul(value, nullptr, 10);
+                if (httpd_query_key_value(query, "seq", value, sizeof(value)) == ESP_OK) {
+                    seq = strtoul(value, nullptr, 10);
+                    resume = true;
+                }
+            }
+#if CONFIG_WEB_DISPLAY_BINARY_DELTAS
+            binary = httpd_query_key_value(query, "enc", value, sizeof(value)) == ESP_OK && strcmp(value, "bin") == 0;
+#endif
+#if CONFIG_DISPLAY_MIRROR
+            mirror = httpd_query_key_value(query, "mirror", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0;
+#endif
+#if CONFIG_WEB_AUDIO_MONITOR
+            audio = httpd_query_key_value(query, "audio", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0;
+#endif
+        }
+        ESP_LOGI(TAG, "WebSocket handshake for fd %d%s", fd, resume ? ", resuming" : "");
+        server->AddClient(fd, binary, mirror, audio);
+
+        // Deltas broadcast from here on are queued for the client too, it skips those it already has
+        std::vector<std::string> frames;
+        if (resume && server->resume_callback_ && server->resume_callback_(epoch, seq, binary, frames)) {
+            ESP_LOGI(TAG, "Client fd=%d resumed from seq %u with %d deltas", fd, (unsigned)seq, (int)frames.size());
+            for (auto& frame : frames) {
+                server->SendFrame(fd, frame, binary);
             }
+        } else if (server->get_state_callback_) {
+            // Send initial state to the new client
+            server->SendFrame(fd, server->get_state_callback_(), false);
+        }
+        if (mirror && server->mirror_callback_) {
+            server->mirror_callback_(true);
         }
 
         return ESP_OK;
@@ -206,7 +332,7 @@ esp_err_t WebDisplayServer::WsHandler(httpd_req_t* req) {
     return ESP_OK;
 }
 
-void WebDisplayServer::AddClient(int fd) {
+void WebDisplayServer::AddClient(int fd, bool binary, bool mirror, bool audio) {
     std::lock_guard<std::mutex> lock(clients_mutex_);
 
     if (clients_.size() >= max_clients_) {
@@ -217,79 +343,219 @@ void WebDisplayServer::AddClient(int fd) {
     WebSocketClient client;
     client.fd = fd;
     client.last_ping_time = esp_timer_get_time();
+    client.binary = binary;
+    client.mirror = mirror;
+    client.audio = audio;
     clients_.push_back(client);
+    if (audio) {
+        audio_clients_++;
+    }
     ESP_LOGI(TAG, "Client connected: fd=%d, total=%d", fd, (int)clients_.size());
 }
 
 void WebDisplayServer::RemoveClient(int fd) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
+    bool stop_mirror = false;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
 
-    auto it = std::remove_if(clients_.begin(), clients_.end(),
-                             [fd](const WebSocketClient& c) { return c.fd == fd; });
-    if (it != clients_.end()) {
+        auto it = std::remove_if(clients_.begin(), clients_.end(),
+                                 [fd](const WebSocketClient& c) { return c.fd == fd; });
+        if (it == clients_.end()) {
+            return;
+        }
+        bool removed_mirror = std::any_of(it, clients_.end(), [](const WebSocketClient& c) { return c.mirror; });
+        audio_clients_ -= std::count_if(it, clients_.end(), [](const WebSocketClient& c) { return c.audio; });
         clients_.erase(it, clients_.end());
         ESP_LOGI(TAG, "Client removed: fd=%d, total=%d", fd, (int)clients_.size());
+        stop_mirror = removed_mirror &&
+            std::none_of(clients_.begin(), clients_.end(), [](const WebSocketClient& c) { return c.mirror; });
+    }
+    // The mirror callback takes the display lock, never call it with clients_mutex_ held
+    if (stop_mirror && mirror_callback_) {
+        mirror_callback_(false);
     }
 }
 
-void WebDisplayServer::BroadcastToClients(const std::string& message) {
-    if (!server_) {
+void WebDisplayServer::EnqueueFrame(WebSocketClient& client, const std::string& payload, bool binary) {
+    if (client.resync) {
+        // The full state about to be sent covers this frame
         return;
     }
+    if (client.queue.size() >= WS_CLIENT_QUEUE_DEPTH) {
+        // Skipping a delta breaks the sequence, so the client gets the full state instead
+        ESP_LOGW(TAG, "Send queue of client fd=%d overflowed, resyncing", client.fd);
+        client.queue.erase(std::remove_if(client.queue.begin(), client.queue.end(),
+                                          [](const OutboundFrame& f) { return !f.mirror; }),
+                           client.queue.end());
+        client.resync = true;
+        return;
+    }
+    client.queue.push_back({payload, binary, false});
+}
 
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-
-    ESP_LOGI(TAG, "Broadcasting to %d clients, msg_len=%d", (int)clients_.size(), (int)message.length());
-
+void WebDisplayServer::SendFrame(int fd, const std::string& payload, bool binary) {
     httpd_ws_frame_t ws_pkt;
     memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-    ws_pkt.type = HTTPD_WS_TYPE_TEXT;
-    ws_pkt.payload = (uint8_t*)message.c_str();
-    ws_pkt.len = message.length();
+    ws_pkt.type = binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT;
+    ws_pkt.payload = (uint8_t*)payload.data();
+    ws_pkt.len = payload.length();
+
+    esp_err_t ret = httpd_ws_send_frame_async(server_, fd, &ws_pkt);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send to client fd=%d: %d", fd, ret);
+        RemoveClient(fd);
+    }
+}
+
+void WebDisplayServer::BroadcastDelta(const std::string& json, const std::string& binary) {
+    if (!server_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    if (clients_.empty()) {
+        return;
+    }
+    ESP_LOGD(TAG, "Broadcasting to %d clients, msg_len=%d", (int)clients_.size(), (int)json.length());
 
     for (auto& client : clients_) {
-        esp_err_t ret = httpd_ws_send_frame_async(server_, client.fd, &ws_pkt);
-        if (ret != ESP_OK) {
-            ESP_LOGW(TAG, "Failed to send to client fd=%d: %d", client.fd, ret);
+        if (client.binary && !binary.empty()) {
+            EnqueueFrame(client, binary, true);
+        } else {
+            EnqueueFrame(client, json, false);
         }
     }
+    ScheduleDrain();
 }
 
-void WebDisplayServer::BroadcastFullState(const std::string& json) {
-    BroadcastToClients(json);
+void WebDisplayServer::BroadcastMirrorFrame(const std::string& frame) {
+    if (!server_) {
+        return;
+    }
+
+    bool missed = false;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        for (auto& client : clients_) {
+            if (!client.mirror) {
+                continue;
+            }
+            size_t pending = std::count_if(client.queue.begin(), client.queue.end(),
+                                           [](const OutboundFrame& f) { return f.mirror; });
+            if (pending >= WS_CLIENT_MIRROR_DEPTH || client.queue.size() >= WS_CLIENT_QUEUE_DEPTH) {
+                // The tiles of this frame are lost to the client, a full frame makes up for them
+                missed = true;
+                continue;
+            }
+            client.queue.push_back({frame, true, true});
+        }
+        ScheduleDrain();
+    }
+    if (missed && mirror_callback_) {
+        mirror_callback_(true);
+    }
 }
 
-void WebDisplayServer::BroadcastChatMessage(const std::string& role, const std::string& content) {
-    ESP_LOGI(TAG, "BroadcastChatMessage: role=%s, content_len=%d", role.c_str(), (int)content.length());
-
-    // Escape JSON strings
-    std::string escaped_content;
-    for (char c : content) {
-        switch (c) {
-            case '"': escaped_content += "\\\""; break;
-            case '\\': escaped_content += "\\\\"; break;
-            case '\n': escaped_content += "\\n"; break;
-            case '\r': escaped_content += "\\r"; break;
-            case '\t': escaped_content += "\\t"; break;
-            default: escaped_content += c; break;
+void WebDisplayServer::BroadcastAudioFrame(bool uplink, int sample_rate, int frame_duration, const uint8_t* opus, size_t len) {
+    if (!server_ || audio_clients_ == 0) {
+        return;
+    }
+
+    // 'A', direction (0 uplink, 1 downlink), u16 frame duration in ms, u32 sample rate, the Opus packet
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(8 + len);
+    frame->push_back('A');
+    frame->push_back(uplink ? 0 : 1);
+    frame->push_back(frame_duration & 0xff);
+    frame->push_back((frame_duration >> 8) & 0xff);
+    for (int i = 0; i < 4; i++) {
+        frame->push_back((sample_rate >> (i * 8)) & 0xff);
+    }
+    frame->append(reinterpret_cast<const char*>(opus), len);
+
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    for (auto& client : clients_) {
+        if (!client.audio) {
+            continue;
+        }
+        if (client.audio_queue.size() >= WS_CLIENT_AUDIO_DEPTH) {
+            // Late audio is worth less than the next packet, playback resumes with a gap
+            client.audio_queue.pop_front();
+            if (client.audio_dropped++ % 50 == 0) {
+                ESP_LOGW(TAG, "Client fd=%d is behind, %lu audio frames dropped", client.fd, client.audio_dropped);
+            }
         }
+        client.audio_queue.push_back(frame);
     }
+    ScheduleDrain();
+}
 
-    std::string msg = "{\"type\":\"chat_message\",\"role\":\"" + role +
-                     "\",\"content\":\"" + escaped_content + "\"}";
-    BroadcastToClients(msg);
+bool WebDisplayServer::ScheduleFlush() {
+    if (!server_ || !flush_callback_) {
+        return false;
+    }
+    esp_err_t ret = httpd_queue_work(server_, [](void* arg) {
+        static_cast<WebDisplayServer*>(arg)->flush_callback_();
+    }, this);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to queue flush work: %d", ret);
+        return false;
+    }
+    return true;
 }
 
-void WebDisplayServer::BroadcastStateUpdate(const std::string& field, const std::string& value) {
-    ESP_LOGI(TAG, "BroadcastStateUpdate: field=%s, value=%s", field.c_str(), value.c_str());
-    std::string msg = "{\"type\":\"state_update\",\"field\":\"" + field +
-                     "\",\"value\":\"" + value + "\"}";
-    BroadcastToClients(msg);
+void WebDisplayServer::ScheduleDrain() {
+    if (!drain_scheduled_) {
+        esp_err_t ret = httpd_queue_work(server_, [](void* arg) {
+            static_cast<WebDisplayServer*>(arg)->DrainClients();
+        }, this);
+        if (ret == ESP_OK) {
+            drain_scheduled_ = true;
+        } else {
+            // The frames stay queued for the next broadcast
+            ESP_LOGW(TAG, "Failed to queue send work: %d", ret);
+        }
+    }
 }
 
-void WebDisplayServer::BroadcastClearMessages() {
-    std::string msg = "{\"type\":\"clear_messages\"}";
-    BroadcastToClients(msg);
+void WebDisplayServer::DrainClients() {
+    // One frame of each client per round, so a client with a long queue does not starve the others
+    while (true) {
+        std::vector<std::pair<int, OutboundFrame>> round;
+        std::vector<int> resync_fds;
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            for (auto& client : clients_) {
+                if (client.resync) {
+                    client.resync = false;
+                    resync_fds.push_back(client.fd);
+                } else if (!client.queue.empty()) {
+                    round.emplace_back(client.fd, std::move(client.queue.front()));
+                    client.queue.pop_front();
+                } else if (!client.audio_queue.empty()) {
+                    OutboundFrame frame{std::string(), true, false, std::move(client.audio_queue.front())};
+                    round.emplace_back(client.fd, std::move(frame));
+                    client.audio_queue.pop_front();
+                }
+            }
+            if (round.empty() && resync_fds.empty()) {
+                drain_scheduled_ = false;
+                return;
+            }
+        }
+
+        if (!resync_fds.empty() && get_state_callback_) {
+            // Deltas queued while the state is fetched are skipped by the clients by their seq
+            std::string state = get_state_callback_();
+            for (int fd : resync_fds) {
+                round.emplace_back(fd, OutboundFrame{state, false, false});
+            }
+        }
+
+        for (auto& [fd, frame] : round) {
+            SendFrame(fd, frame.shared ? *frame.shared : frame.payload, frame.binary);
+        }
+    }
 }
 
 WebDisplayServer* WebDisplayServer::GetServerFromReq(httpd_req_t* req) {
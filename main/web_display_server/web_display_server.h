@@ -4,14 +4,39 @@
 #include <esp_http_server.h>
 #include <esp_log.h>
 #include <vector>
+#include <deque>
 #include <string>
 #include <mutex>
 #include <functional>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+
+struct OutboundFrame {
+    std::string payload;
+    bool binary;
+    // A framebuffer mirror frame, it may be dropped
+    bool mirror;
+    // An audio monitor frame, one copy shared by every client, sent in place of payload
+    std::shared_ptr<const std::string> shared = nullptr;
+};
 
 struct WebSocketClient {
     int fd;
     uint64_t last_ping_time;
+    // Asked for binary deltas with ?enc=bin
+    bool binary = false;
+    // Asked for the framebuffer mirror with ?mirror=1
+    bool mirror = false;
+    // Asked for the audio monitor with ?audio=1
+    bool audio = false;
+    // Frames waiting for the httpd task, bounded by WS_CLIENT_QUEUE_DEPTH
+    std::deque<OutboundFrame> queue;
+    // Audio monitor frames, kept apart so they never push the deltas into a resync
+    std::deque<std::shared_ptr<const std::string>> audio_queue;
+    uint32_t audio_dropped = 0;
+    // The queue overflowed, the client gets the full state in place of what it missed
+    bool resync = false;
 };
 
 class WebDisplayServer {
@@ -28,30 +53,80 @@ public:
         get_state_callback_ = callback;
     }
 
-    // Broadcast methods for display updates
-    void BroadcastFullState(const std::string& json);
-    void BroadcastChatMessage(const std::string& role, const std::string& content);
-    void BroadcastStateUpdate(const std::string& field, const std::string& value);
-    void BroadcastClearMessages();
+    // Set callback to get the deltas after a sequence for a client resuming with ?epoch=&seq=,
+    // it returns false when the client has to take the full state instead
+    using ResumeCallback = std::function<bool(uint32_t epoch, uint32_t seq, bool binary, std::vector<std::string>& frames)>;
+    void SetResumeCallback(ResumeCallback callback) {
+        resume_callback_ = callback;
+    }
+
+    // Set callback to start the framebuffer mirror or send it whole again (true), for a new mirror
+    // client or one that missed frames, and to stop it when the last mirror client left (false)
+    void SetMirrorCallback(std::function<void(bool wanted)> callback) {
+        mirror_callback_ = callback;
+    }
+
+    // Set callback that builds and broadcasts the pending display changes, run on the httpd task
+    void SetFlushCallback(std::function<void()> callback) {
+        flush_callback_ = callback;
+    }
+    // Queues one run of the flush callback on the httpd task, false while the server is stopped
+    bool ScheduleFlush();
+
+    // Set callback to get the MCP tool stats served at /api/mcp/stats
+    void SetGetMcpStatsCallback(std::function<std::string()> callback) {
+        get_mcp_stats_callback_ = callback;
+    }
+
+    // Set the writer of /api/audio/capture.wav, it streams the file through write
+    using ChunkWriter = std::function<bool(const void* data, size_t len)>;
+    void SetAudioCaptureCallback(std::function<bool(const ChunkWriter& write)> callback) {
+        audio_capture_callback_ = callback;
+    }
+
+    // Queues a state delta for every client in the encoding it asked for, never blocks on a client
+    // binary is empty when CONFIG_WEB_DISPLAY_BINARY_DELTAS is off
+    void BroadcastDelta(const std::string& json, const std::string& binary);
+    // Queues a framebuffer mirror frame for the mirror clients, dropped for a client that is behind
+    void BroadcastMirrorFrame(const std::string& frame);
+    // Queues an Opus packet for the audio monitor clients, the oldest is dropped for a client that
+    // is behind. Any task, it returns at once while no audio client is connected
+    void BroadcastAudioFrame(bool uplink, int sample_rate, int frame_duration, const uint8_t* opus, size_t len);
 
 private:
     httpd_handle_t server_ = nullptr;
     std::vector<WebSocketClient> clients_;
     std::mutex clients_mutex_;
+    // Clients with ?audio=1, read without the lock on every audio packet
+    std::atomic<int> audio_clients_{0};
+    // A DrainClients() work item is queued on the httpd task
+    bool drain_scheduled_ = false;
     int max_clients_ = CONFIG_WEB_DISPLAY_MAX_CLIENTS;
     std::function<std::string()> get_state_callback_;
+    ResumeCallback resume_callback_;
+    std::function<void(bool wanted)> mirror_callback_;
+    std::function<void()> flush_callback_;
+    std::function<std::string()> get_mcp_stats_callback_;
+    std::function<bool(const ChunkWriter& write)> audio_capture_callback_;
 
     // HTTP handlers
     static esp_err_t IndexHandler(httpd_req_t* req);
     static esp_err_t CssHandler(httpd_req_t* req);
     static esp_err_t JsHandler(httpd_req_t* req);
     static esp_err_t ApiStateHandler(httpd_req_t* req);
+    static esp_err_t ApiMcpStatsHandler(httpd_req_t* req);
+    static esp_err_t AudioCaptureHandler(httpd_req_t* req);
     static esp_err_t WsHandler(httpd_req_t* req);
 
     // WebSocket helpers
-    void AddClient(int fd);
+    void AddClient(int fd, bool binary, bool mirror, bool audio);
     void RemoveClient(int fd);
-    void BroadcastToClients(const std::string& message);
+    void EnqueueFrame(WebSocketClient& client, const std::string& payload, bool binary);
+    void SendFrame(int fd, const std::string& payload, bool binary);
+    // Runs on the httpd task and sends the queued frames of every client
+    void DrainClients();
+    // Queues the drain work unless it is queued already, called with clients_mutex_ held
+    void ScheduleDrain();
 
     // Helper to get server instance from request
     static WebDisplayServer* GetServerFromReq(httpd_req_t* req);
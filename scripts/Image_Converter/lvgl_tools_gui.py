@@ -38,6 +38,7 @@ class ImageConverterApp:
         self.resolution = tk.StringVar(value="128x128")
         self.color_format = tk.StringVar(value="自动识别")
         self.compress_method = tk.StringVar(value="NONE")
+        self.output_format = tk.StringVar(value="C")
 
         # 创建UI组件
         self.create_widgets()
@@ -61,7 +62,12 @@ class ImageConverterApp:
         # 压缩方式
         ttk.Label(settings_frame, text="压缩方式:").grid(row=0, column=4, padx=2)
         ttk.Combobox(settings_frame, textvariable=self.compress_method,
-                    values=["NONE", "RLE"], width=8).grid(row=0, column=5, padx=2)
+                    values=["NONE", "RLE", "LZ4"], width=8).grid(row=0, column=5, padx=2)
+
+        # 输出格式: C数组编译进固件, BIN放入assets分区
+        ttk.Label(settings_frame, text="输出格式:").grid(row=0, column=6, padx=2)
+        ttk.Combobox(settings_frame, textvariable=self.output_format,
+                    values=["C", "BIN"], width=6).grid(row=0, column=7, padx=2)
 
         # 文件操作框架
         file_frame = ttk.LabelFrame(self.root, text="选取文件")
@@ -187,7 +193,7 @@ class ImageConverterApp:
         
         # 解析转换参数
         width, height = map(int, self.resolution.get().split('x'))
-        compress = CompressMethod.RLE if self.compress_method.get() == "RLE" else CompressMethod.NONE
+        compress = CompressMethod[self.compress_method.get()]
 
         # 执行转换
         self.convert_images(input_files, width, height, compress)
@@ -233,14 +239,18 @@ class ImageConverterApp:
                         temp_path = tmpfile.name
                         img.save(temp_path, 'PNG')
 
-                    # 转换为LVGL C数组
+                    # 转换为LVGL C数组或二进制
                     lvgl_img = LVGLImage().from_png(temp_path, cf=cf)
-                    output_c_path = os.path.join(self.output_dir.get(), f"{base_name}.c")
-                    lvgl_img.to_c_array(output_c_path, compress=compress)
+                    if self.output_format.get() == "BIN":
+                        output_name = f"{base_name}.bin"
+                        lvgl_img.to_bin(os.path.join(self.output_dir.get(), output_name), compress=compress)
+                    else:
+                        output_name = f"{base_name}.c"
+                        lvgl_img.to_c_array(os.path.join(self.output_dir.get(), output_name), compress=compress)
 
                     success_count += 1
                     os.unlink(temp_path)
-                    print(f"成功转换: {base_name}.c\n")
+                    print(f"成功转换: {output_name}\n")
 
             except Exception as e:
                 print(f"转换失败: {str(e)}\n")
@@ -0,0 +1,282 @@
+/*
+ * Host benchmark of the AFSK Wi-Fi provisioning demodulator (main/boards/common/afsk_demod.cc).
+ *
+ * Frames are modulated like sonic_wifi_config.html does: start bytes, "ssid\npassword",
+ * checksum, end bytes, MSB first. Each trial adds white noise at the given SNR, shifts both
+ * tones by the frequency offset, stretches the bits by the clock drift and starts after a
+ * random silence. The samples go through the device's AudioSignalProcessor and AudioDataBuffer
+ * in 30 ms chunks, as ReceiveWifiCredentialsFromAudio() feeds them.
+ *
+ * Build, from the repository root:
+ *     g++ -O2 -std=c++17 -Iscripts/acoustic_check/host -Imain/boards/common \
+ *         scripts/acoustic_check/afsk_bench.cc main/boards/common/afsk_demod.cc -o afsk_bench
+ */
+
+#include "afsk_demod.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace audio_wifi_config;
+
+namespace {
+
+struct Options {
+    std::vector<int> bit_rates = {100, 160, 200, 250, 320, 400};
+    std::vector<double> snrs = {30, 20, 12, 6, 3};
+    std::vector<double> offsets = {0, 20};
+    double drift_ppm = 0;
+    int mark = kMarkFrequency;
+    int space = kSpaceFrequency;
+    int trials = 20;
+    int length = 32;
+    unsigned seed = 1;
+    const char* json = nullptr;
+};
+
+struct Result {
+    int bit_rate;
+    double snr;
+    double offset;
+    int decoded = 0;
+    size_t bit_errors = 0;
+    size_t bits = 0;
+    double audio_seconds = 0;
+    double decode_seconds = 0;
+    double frame_seconds = 0;
+};
+
+const size_t kChunkSamples = 480;  // 30 ms at 16 kHz, the device's read size
+const double kAmplitude = 0.5 * 32767;
+
+std::vector<double> ParseList(const char* text) {
+    std::vector<double> values;
+    const char* p = text;
+    while (*p != '\0') {
+        char* end;
+        values.push_back(strtod(p, &end));
+        if (end == p) {
+            fprintf(stderr, "Bad number list: %s\n", text);
+            exit(1);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+void Usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --bit-rates 100,200,...   bit rates to test (default 100,160,200,250,320,400)\n"
+        "  --snr 30,20,...           signal to noise ratios in dB (default 30,20,12,6,3)\n"
+        "  --offsets 0,20,...        tone frequency offsets in Hz (default 0,20)\n"
+        "  --drift-ppm N             sender clock faster by N ppm (default 0)\n"
+        "  --mark HZ --space HZ      tone frequencies (default %d, %d)\n"
+        "  --trials N                frames per case (default 20)\n"
+        "  --length N                SSID and password bytes per frame (default 32)\n"
+        "  --seed N                  random seed (default 1)\n"
+        "  --json FILE               also write the results as JSON\n",
+        name, (int)kMarkFrequency, (int)kSpaceFrequency);
+    exit(1);
+}
+
+Options ParseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+        }
+        const char* value = argv[++i];
+        if (strcmp(arg, "--bit-rates") == 0) {
+            options.bit_rates.clear();
+            for (double rate : ParseList(value)) {
+                options.bit_rates.push_back((int)rate);
+            }
+        } else if (strcmp(arg, "--snr") == 0) {
+            options.snrs = ParseList(value);
+        } else if (strcmp(arg, "--offsets") == 0) {
+            options.offsets = ParseList(value);
+        } else if (strcmp(arg, "--drift-ppm") == 0) {
+            options.drift_ppm = atof(value);
+        } else if (strcmp(arg, "--mark") == 0) {
+            options.mark = atoi(value);
+        } else if (strcmp(arg, "--space") == 0) {
+            options.space = atoi(value);
+        } else if (strcmp(arg, "--trials") == 0) {
+            options.trials = std::max(1, atoi(value));
+        } else if (strcmp(arg, "--length") == 0) {
+            options.length = std::clamp(atoi(value), 2, 90);
+        } else if (strcmp(arg, "--seed") == 0) {
+            options.seed = (unsigned)atoi(value);
+        } else if (strcmp(arg, "--json") == 0) {
+            options.json = value;
+        } else {
+            Usage(argv[0]);
+        }
+    }
+    return options;
+}
+
+// "ssid\npassword" of printable ASCII
+std::string RandomCredentials(std::mt19937& rng, int length) {
+    std::uniform_int_distribution<int> character(33, 126);
+    std::string text;
+    int ssid_length = std::max(1, length / 3);
+    for (int i = 0; i < length; i++) {
+        text += i == ssid_length ? '\n' : (char)character(rng);
+    }
+    return text;
+}
+
+std::vector<uint8_t> FrameBits(const std::string& text) {
+    std::vector<uint8_t> bytes = {0x01, 0x02};
+    bytes.insert(bytes.end(), text.begin(), text.end());
+    bytes.push_back(AudioDataBuffer::CalculateChecksum(text));
+    bytes.push_back(0x03);
+    bytes.push_back(0x04);
+    std::vector<uint8_t> bits;
+    for (uint8_t byte : bytes) {
+        for (int i = 7; i >= 0; i--) {
+            bits.push_back((byte >> i) & 1);
+        }
+    }
+    return bits;
+}
+
+// Silence, the frame and a short tail, with noise throughout
+std::vector<int16_t> Modulate(const std::vector<uint8_t>& bits, const Options& options, int bit_rate,
+    double snr, double offset, std::mt19937& rng) {
+    std::uniform_real_distribution<double> lead(0.1, 0.4);
+    std::uniform_real_distribution<double> phase(0, 1);
+    double noise_sigma = kAmplitude / std::sqrt(2.0) / std::pow(10.0, snr / 20);
+    std::normal_distribution<double> noise(0, noise_sigma);
+
+    // A sender clock that runs fast makes the bits shorter for the receiver
+    double bit_seconds = 1.0 / bit_rate / (1 + options.drift_ppm * 1e-6);
+    size_t lead_samples = (size_t)(lead(rng) * kAudioSampleRate);
+    size_t frame_samples = (size_t)(bits.size() * bit_seconds * kAudioSampleRate);
+    size_t tail_samples = kAudioSampleRate / 10;
+    double time_offset = phase(rng);
+
+    std::vector<int16_t> samples(lead_samples + frame_samples + tail_samples);
+    for (size_t n = 0; n < samples.size(); n++) {
+        double value = noise(rng);
+        if (n >= lead_samples && n < lead_samples + frame_samples) {
+            double t = (double)(n - lead_samples) / kAudioSampleRate;
+            size_t bit = std::min(bits.size() - 1, (size_t)(t / bit_seconds));
+            double frequency = (bits[bit] ? options.mark : options.space) + offset;
+            // Absolute time like the web page, the phase jumps at tone changes
+            value += kAmplitude * std::sin(2 * M_PI * frequency * (t + time_offset));
+        }
+        samples[n] = (int16_t)std::clamp(std::lround(value), -32768L, 32767L);
+    }
+    return samples;
+}
+
+// Bit errors of the frame at the best matching position in the demodulated bits
+size_t CountBitErrors(const std::vector<uint8_t>& received, const std::vector<uint8_t>& sent) {
+    if (received.size() < sent.size()) {
+        return sent.size();
+    }
+    size_t best = sent.size();
+    for (size_t offset = 0; offset + sent.size() <= received.size(); offset++) {
+        size_t errors = 0;
+        for (size_t i = 0; i < sent.size() && errors < best; i++) {
+            errors += received[offset + i] != sent[i];
+        }
+        best = std::min(best, errors);
+    }
+    return best;
+}
+
+Result RunCase(const Options& options, int bit_rate, double snr, double offset, std::mt19937& rng) {
+    Result result = {bit_rate, snr, offset};
+    std::vector<float> probabilities;
+    for (int trial = 0; trial < options.trials; trial++) {
+        std::string text = RandomCredentials(rng, options.length);
+        auto bits = FrameBits(text);
+        auto samples = Modulate(bits, options, bit_rate, snr, offset, rng);
+        result.frame_seconds = (double)bits.size() / bit_rate;
+        result.audio_seconds += (double)samples.size() / kAudioSampleRate;
+
+        AudioSignalProcessor processor(kAudioSampleRate, options.mark, options.space, bit_rate);
+        AudioDataBuffer buffer;
+        std::vector<uint8_t> received;
+        bool decoded = false;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < samples.size(); i += kChunkSamples) {
+            size_t frames = std::min(kChunkSamples, samples.size() - i);
+            processor.ProcessAudioSamples(samples.data() + i, frames, 1, probabilities);
+            if (buffer.ProcessProbabilityData(probabilities, 0.5f) && buffer.decoded_text == text) {
+                decoded = true;
+            }
+            for (float probability : probabilities) {
+                received.push_back(probability > 0.5f);
+            }
+        }
+        result.decode_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.decoded += decoded;
+        result.bit_errors += CountBitErrors(received, bits);
+        result.bits += bits.size();
+    }
+    return result;
+}
+
+void WriteJson(const char* path, const Options& options, const std::vector<Result>& results) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return;
+    }
+    fprintf(file, "{\"mark\":%d,\"space\":%d,\"drift_ppm\":%g,\"trials\":%d,\"length\":%d,\"results\":[\n",
+        options.mark, options.space, options.drift_ppm, options.trials, options.length);
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        fprintf(file, "  {\"bit_rate\":%d,\"snr_db\":%g,\"offset_hz\":%g,\"frames\":%d,\"decoded\":%d,"
+            "\"ber\":%.6f,\"frame_ms\":%.0f,\"decode_us_per_s\":%.1f}%s\n",
+            r.bit_rate, r.snr, r.offset, options.trials, r.decoded, (double)r.bit_errors / r.bits,
+            r.frame_seconds * 1000, r.decode_seconds / r.audio_seconds * 1e6, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options = ParseOptions(argc, argv);
+    std::mt19937 rng(options.seed);
+    std::vector<Result> results;
+
+    printf("mark %d Hz, space %d Hz, %d byte credentials, %d frames per case, drift %g ppm\n",
+        options.mark, options.space, options.length, options.trials, options.drift_ppm);
+    printf("%8s %7s %9s %9s %9s %10s %12s\n", "bit/s", "SNR dB", "offset Hz", "decoded", "BER", "frame ms",
+        "decode us/s");
+    for (int bit_rate : options.bit_rates) {
+        if (bit_rate <= 0 || kAudioSampleRate % bit_rate != 0) {
+            fprintf(stderr, "Skipping %d bit/s, 16 kHz is not a multiple of it\n", bit_rate);
+            continue;
+        }
+        for (double offset : options.offsets) {
+            for (double snr : options.snrs) {
+                auto result = RunCase(options, bit_rate, snr, offset, rng);
+                printf("%8d %7g %9g %6d/%-2d %9.5f %10.0f %12.1f\n", bit_rate, snr, offset, result.decoded,
+                    options.trials, (double)result.bit_errors / result.bits, result.frame_seconds * 1000,
+                    result.decode_seconds / result.audio_seconds * 1e6);
+                results.push_back(result);
+            }
+        }
+    }
+    if (options.json != nullptr) {
+        WriteJson(options.json, options, results);
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Report the internal RAM the audio hot path placement (CONFIG_AUDIO_HOT_PATH_IN_IRAM) costs.
+
+Reads the linker map of the build and lists, per object of libmain.a, the bytes placed in IRAM
+and DRAM with the largest functions, so the cost can be compared with the option off.
+"""
+import argparse
+import re
+import sys
+from collections import defaultdict
+
+# Output sections in internal RAM, .iram0.text also covers the P4 L2MEM on that target
+INTERNAL_SECTIONS = {
+    ".iram0.text": "iram",
+    ".iram0.data": "iram",
+    ".iram0.bss": "iram",
+    ".dram0.data": "dram",
+    ".dram0.bss": "dram",
+}
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)\s")
+INPUT_SECTION = re.compile(r"^ (\.\S+)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S+))?\s*$")
+WRAPPED_INPUT = re.compile(r"^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S+)\s*$")
+SYMBOL = re.compile(r"^\s+0x[0-9a-f]+\s+(\S.*)$")
+
+
+def parse_map(path, archive):
+    """Yields (region, object, input section, size, symbols) of the archive in internal RAM."""
+    region = None
+    pending = None
+    current = None
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            match = OUTPUT_SECTION.match(line)
+            if match:
+                if current:
+                    yield current
+                current = None
+                region = INTERNAL_SECTIONS.get(match.group(1))
+                continue
+            if region is None:
+                continue
+
+            # A long input section name puts address, size and object on the next line
+            if pending is not None:
+                match = WRAPPED_INPUT.match(line)
+                name, pending = pending, None
+                if match:
+                    if current:
+                        yield current
+                    current = make_entry(region, name, match.group(2), match.group(3), archive)
+                    continue
+            match = INPUT_SECTION.match(line)
+            if match:
+                if current:
+                    yield current
+                current = None
+                if match.group(2) is None:
+                    pending = match.group(1)
+                else:
+                    current = make_entry(region, match.group(1), match.group(3), match.group(4), archive)
+                continue
+            match = SYMBOL.match(line)
+            if match and current and "=" not in match.group(1):
+                current[4].append(match.group(1).strip())
+    if current:
+        yield current
+
+
+def make_entry(region, section, size, origin, archive):
+    match = re.match(r".*?([^/]+\.a)\((.+)\)$", origin)
+    if not match or match.group(1) != archive:
+        return None
+    size = int(size, 16)
+    if size == 0:
+        return None
+    return [region, match.group(2), section, size, []]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Report IRAM and DRAM use of the audio hot path")
+    parser.add_argument("map", help="Linker map, build/<project>.map")
+    parser.add_argument("--archive", default="libmain.a", help="Archive to report")
+    parser.add_argument("--top", type=int, default=5, help="Largest sections listed per object")
+    parser.add_argument("--filter", default="", help="Only objects containing this text, e.g. audio")
+    args = parser.parse_args()
+
+    totals = defaultdict(lambda: {"iram": 0, "dram": 0})
+    sections = defaultdict(list)
+    for region, obj, section, size, symbols in filter(None, parse_map(args.map, args.archive)):
+        if args.filter not in obj:
+            continue
+        totals[obj][region] += size
+        sections[obj].append((size, region, symbols[0] if symbols else section))
+
+    if not totals:
+        print(f"Nothing of {args.archive} in internal RAM")
+        return 0
+
+    print(f"{'object':<40} {'iram':>8} {'dram':>8}")
+    iram_sum = dram_sum = 0
+    for obj in sorted(totals, key=lambda o: -(totals[o]["iram"] + totals[o]["dram"])):
+        iram, dram = totals[obj]["iram"], totals[obj]["dram"]
+        iram_sum += iram
+        dram_sum += dram
+        print(f"{obj:<40} {iram:>8} {dram:>8}")
+        for size, region, name in sorted(sections[obj], reverse=True)[:args.top]:
+            print(f"    {size:>6} {region}  {name}")
+    print(f"{'total':<40} {iram_sum:>8} {dram_sum:>8}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -17,6 +17,7 @@ import shutil
 import sys
 import json
 import struct
+import zlib
 from datetime import datetime
 
 
@@ -202,25 +203,305 @@ def process_sr_models(wakenet_model_dirs, multinet_model_dirs, build_dir, assets
         return None
 
 
-def process_text_font(text_font_file, assets_dir):
+def process_text_font(text_font_file, assets_dir, subset_characters=None):
     """Process text_font parameter"""
     if not text_font_file:
         return None
     
-    # Copy input file to build/assets directory
     font_filename = os.path.basename(text_font_file)
     font_dst = os.path.join(assets_dir, font_filename)
+    if subset_characters:
+        try:
+            with open(text_font_file, 'rb') as f:
+                font_data = f.read()
+            subset, kept, total = subset_cbin_font(font_data, subset_characters)
+            with open(font_dst, 'wb') as f:
+                f.write(subset)
+            print(f"Subset font: {font_filename} {kept}/{total} glyphs, {len(font_data)} -> {len(subset)} bytes")
+            return font_filename
+        except (ValueError, struct.error) as e:
+            print(f"Warning: Cannot subset {text_font_file}: {e}, keeping the full font")
+
+    # Copy input file to build/assets directory
     if copy_file(text_font_file, font_dst):
         return font_filename
     return None
 
 
-def process_emoji_collection(emoji_collection_dir, assets_dir):
+# =============================================================================
+# Font subsetting of lv_font_conv binary fonts (the cbin fonts of xiaozhi-fonts)
+# =============================================================================
+
+CMAP_FORMAT0_FULL = 0
+CMAP_SPARSE_FULL = 1
+CMAP_FORMAT0_TINY = 2
+CMAP_SPARSE_TINY = 3
+# Offset of indexToLocFormat in the head table, after its size and label
+HEAD_LOCA_FORMAT_OFFSET = 8 + 26
+
+
+def read_font_tables(data):
+    """Split the font into its tables, a dict of label -> table bytes including the header"""
+    tables = {}
+    order = []
+    pos = 0
+    while pos + 8 <= len(data):
+        size, label = struct.unpack_from('<I4s', data, pos)
+        if size < 8 or pos + size > len(data):
+            raise ValueError(f"bad table size {size} at {pos}")
+        label = label.decode('ascii', 'replace')
+        tables[label] = data[pos:pos + size]
+        order.append(label)
+        pos += size
+    for label in ('head', 'cmap', 'loca', 'glyf'):
+        if label not in tables:
+            raise ValueError(f"no {label} table")
+    if order[0] != 'head':
+        raise ValueError("head is not the first table")
+    return tables, order
+
+
+def read_font_cmap(cmap):
+    """Map codepoints to glyph ids"""
+    mapping = {}
+    count = struct.unpack_from('<I', cmap, 8)[0]
+    for i in range(count):
+        offset, start, length, glyph_start, entries, fmt = struct.unpack_from('<IIHHHB', cmap, 12 + i * 16)
+        if fmt == CMAP_FORMAT0_TINY:
+            for rcp in range(length):
+                mapping[start + rcp] = glyph_start + rcp
+        elif fmt == CMAP_FORMAT0_FULL:
+            deltas = struct.unpack_from(f'<{entries}B', cmap, offset)
+            for rcp, delta in enumerate(deltas):
+                mapping[start + rcp] = glyph_start + delta
+        elif fmt == CMAP_SPARSE_TINY:
+            codes = struct.unpack_from(f'<{entries}H', cmap, offset)
+            for index, code in enumerate(codes):
+                mapping[start + code] = glyph_start + index
+        elif fmt == CMAP_SPARSE_FULL:
+            codes = struct.unpack_from(f'<{entries}H', cmap, offset)
+            glyphs = struct.unpack_from(f'<{entries}H', cmap, offset + entries * 2)
+            for code, glyph in zip(codes, glyphs):
+                mapping[start + code] = glyph_start + glyph
+        else:
+            raise ValueError(f"unknown cmap format {fmt}")
+    return mapping
+
+
+def read_font_glyphs(head, loca, glyf):
+    """The bytes of each glyph, every glyph starts on a byte boundary"""
+    loca_format = head[HEAD_LOCA_FORMAT_OFFSET]
+    count = struct.unpack_from('<I', loca, 8)[0]
+    offsets = struct.unpack_from(f"<{count}{'I' if loca_format else 'H'}", loca, 12)
+    glyphs = []
+    for i, offset in enumerate(offsets):
+        end = offsets[i + 1] if i + 1 < count else len(glyf)
+        if offset > end or end > len(glyf):
+            raise ValueError(f"bad offset of glyph {i}")
+        glyphs.append(glyf[offset:end])
+    return glyphs
+
+
+def pack_font_table(label, payload):
+    payload += b'\0' * (-len(payload) % 4)
+    return struct.pack('<I4s', len(payload) + 8, label.encode('ascii')) + payload
+
+
+def subset_cbin_font(data, characters):
+    """
+    Keep only the glyphs of characters, returns (font, glyphs kept, glyphs before). Glyphs are
+    copied as they are, the cmap becomes sparse ranges and the kerning table is dropped, since
+    it refers to the old glyph ids
+    """
+    tables, order = read_font_tables(data)
+    mapping = read_font_cmap(tables['cmap'])
+    glyphs = read_font_glyphs(tables['head'], tables['loca'], tables['glyf'])
+
+    codepoints = sorted(set(ord(char) for char in characters) & set(mapping))
+    if not codepoints:
+        raise ValueError("none of the characters is in the font")
+
+    # Glyph 0 is reserved, the kept glyphs are renumbered in codepoint order
+    new_glyphs = [glyphs[0]] + [glyphs[mapping[code]] for code in codepoints]
+
+    # Sparse tiny ranges: codepoint deltas only, glyph ids run on from glyph_id_start
+    ranges = []
+    for index, code in enumerate(codepoints, start=1):
+        if ranges and code - ranges[-1][0] <= 0xFFFF and len(ranges[-1][2]) < 0xFFFF:
+            ranges[-1][2].append(code - ranges[-1][0])
+        else:
+            ranges.append((code, index, [0]))
+    headers = b''
+    range_data = b''
+    data_start = 12 + 16 * len(ranges)
+    for start, glyph_start, deltas in ranges:
+        offset = data_start + len(range_data)
+        headers += struct.pack('<IIHHHBx', offset, start, deltas[-1] + 1, glyph_start, len(deltas), CMAP_SPARSE_TINY)
+        range_data += struct.pack(f'<{len(deltas)}H', *deltas)
+        range_data += b'\0' * (-len(range_data) % 4)
+    cmap = pack_font_table('cmap', struct.pack('<I', len(ranges)) + headers + range_data)
+
+    glyf_payload = b''
+    offsets = []
+    for glyph in new_glyphs:
+        offsets.append(8 + len(glyf_payload))
+        glyf_payload += glyph
+    glyf = pack_font_table('glyf', glyf_payload)
+    loca_format = 1 if offsets[-1] > 0xFFFF else 0
+    loca = pack_font_table('loca', struct.pack(f"<I{len(offsets)}{'I' if loca_format else 'H'}", len(offsets), *offsets))
+
+    head = bytearray(tables['head'])
+    head[HEAD_LOCA_FORMAT_OFFSET] = loca_format
+    kept_tables = [label for label in order if label in ('head', 'cmap', 'loca', 'glyf')]
+    # The table count follows the version
+    struct.pack_into('<H', head, 12, len(kept_tables))
+    rebuilt = {'head': bytes(head), 'cmap': cmap, 'loca': loca, 'glyf': glyf}
+    font = b''.join(rebuilt[label] for label in kept_tables)
+
+    # Read it back, every kept character must resolve to the same glyph bytes
+    check_tables, _ = read_font_tables(font)
+    check_mapping = read_font_cmap(check_tables['cmap'])
+    check_glyphs = read_font_glyphs(check_tables['head'], check_tables['loca'], check_tables['glyf'])
+    for code in codepoints:
+        if check_glyphs[check_mapping[code]] != glyphs[mapping[code]]:
+            raise ValueError(f"subset check failed for U+{code:04X}")
+    return font, len(codepoints), len(glyphs) - 1
+
+
+# Most frequent characters of modern Chinese text, in descending order
+COMMON_CHINESE_CHARACTERS = (
+    "的一是不了人我在有他这中大来上个国到说们为子和你地出道也时年得就那要下以生会自着去之过家学对可她里后小"
+    "么心多天而能好都然没日于起还发成事只作当想看文无开手十用主行方又如前所本见经头面公同三已老从动两长知民样"
+    "现分将外但身些与高意进把法此实回二理美点月明其种声全工己话儿者向情部正名定女问力机给等几很业最间新什打便"
+    "位因重被走电四第门相次东政海口使教西再平真听世气信北少关并内加化由却代军产入先山五太水万市眼体别处总才场"
+    "师书比住员九笑性通目华报立马命张活难神数件安表原车白应路期叫死常提感金何更反合放做系计或司利受光王果亲界"
+    "及今京务制解各任至清物台象记边共风战干接它许八特觉望直服毛林题建南度统色字请交爱让认算论百吃义科怎元社术"
+)
+
+
+def read_language_from_sdkconfig(sdkconfig_path):
+    """
+    Read the selected language from sdkconfig
+    Returns the locale directory name (e.g. zh-CN) or None
+    """
+    if not os.path.exists(sdkconfig_path):
+        return None
+
+    with io.open(sdkconfig_path, "r") as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('CONFIG_LANGUAGE_') and line.endswith('=y'):
+                code = line[len('CONFIG_LANGUAGE_'):-2].split('_')
+                if len(code) == 2:
+                    return f"{code[0].lower()}-{code[1].upper()}"
+    return None
+
+
+def read_ui_characters(language, project_root):
+    """The characters of the UI strings of the language, most frequent first"""
+    counts = {}
+    language_file = os.path.join(project_root, "main", "assets", "locales", language or "", "language.json")
+    if language and os.path.exists(language_file):
+        with open(language_file, 'r', encoding='utf-8') as f:
+            for text in json.load(f).get("strings", {}).values():
+                for char in text:
+                    counts[char] = counts.get(char, 0) + 1
+    return sorted(counts, key=lambda char: -counts[char])
+
+
+def read_charset_file(charset_file):
+    """A UTF-8 text file of characters, most frequent first, whitespace is ignored"""
+    if not charset_file:
+        return []
+    if not os.path.exists(charset_file):
+        print(f"Warning: Charset file not found: {charset_file}")
+        return []
+    with open(charset_file, 'r', encoding='utf-8') as f:
+        return [char for char in f.read() if not char.isspace()]
+
+
+def unique_characters(characters, max_chars=None):
+    selected = []
+    seen = set()
+    for char in characters:
+        if char.isspace() or char in seen:
+            continue
+        seen.add(char)
+        selected.append(char)
+        if max_chars is not None and len(selected) >= max_chars:
+            break
+    return selected
+
+
+def font_subset_characters(language, max_chars, charset_file, project_root):
+    """
+    The characters a subset text font keeps: every UI string character, printable ASCII and
+    Latin-1, common punctuation, then the frequency list of the language up to max_chars
+    """
+    characters = read_ui_characters(language, project_root)
+    characters += [chr(code) for code in range(0x20, 0x7F)]
+    characters += [chr(code) for code in range(0xA0, 0x100)]
+    characters += [chr(code) for code in range(0x2010, 0x2027)]
+    characters += [chr(code) for code in range(0x3000, 0x3011)]
+    characters += [chr(code) for code in range(0xFF01, 0xFF5F)]
+    required = unique_characters(characters)
+    frequent = read_charset_file(charset_file)
+    if language == "zh-CN":
+        frequent += COMMON_CHINESE_CHARACTERS
+    return unique_characters(required + frequent, max(max_chars, len(required)))
+
+
+def generate_glyph_warmup(language, max_chars, assets_dir, project_root):
+    """
+    Write the most frequent characters of the language to glyph_warmup.txt, the firmware
+    rasterizes them into its glyph cache when the text font is loaded
+    """
+    # UI strings first, then common text of the language, then ASCII
+    characters = read_ui_characters(language, project_root)
+    if language == "zh-CN":
+        characters += COMMON_CHINESE_CHARACTERS
+    characters += [chr(code) for code in range(0x21, 0x7F)]
+    selected = unique_characters(characters, max_chars)
+
+    filename = "glyph_warmup.txt"
+    with open(os.path.join(assets_dir, filename), 'w', encoding='utf-8') as f:
+        f.write(''.join(selected))
+    print(f"Generated: {filename} ({len(selected)} characters for {language or 'unknown language'})")
+    return filename
+
+
+def load_image_converter():
+    """Import LVGLImage.py from scripts/Image_Converter, None if its packages are missing"""
+    converter_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "Image_Converter")
+    if converter_dir not in sys.path:
+        sys.path.insert(0, converter_dir)
+    try:
+        import LVGLImage
+    except ImportError as e:
+        print(f"Warning: {e}, PNG emojis are kept uncompressed")
+        return None
+    return LVGLImage
+
+
+def convert_png_to_lvgl_bin(converter, src_file, dst_file, compress):
+    """Convert a PNG into a compressed LVGL binary image, RGB565A8 if it has alpha"""
+    info = converter.png.Reader(filename=src_file).read()[3]
+    palette = info.get('palette', [])
+    has_alpha = info.get('alpha', False) or 'transparent' in info or any(len(c) == 4 for c in palette)
+    cf = converter.ColorFormat.RGB565A8 if has_alpha else converter.ColorFormat.RGB565
+    image = converter.LVGLImage().from_png(src_file, cf=cf)
+    image.to_bin(dst_file, compress=converter.CompressMethod[compress])
+
+
+def process_emoji_collection(emoji_collection_dir, assets_dir, image_compress=None):
     """Process emoji_collection parameter"""
     if not emoji_collection_dir:
         return []
     
     emoji_list = []
+    converter = load_image_converter() if image_compress else None
+    png_bytes = 0
+    bin_bytes = 0
     
     # Check if this is otto-gif collection
     is_otto_gif = 'otto-emoji-gif-component' in emoji_collection_dir or emoji_collection_dir.endswith('otto-gif')
@@ -239,10 +520,22 @@ def process_emoji_collection(emoji_collection_dir, assets_dir):
     for root, dirs, files in os.walk(emoji_collection_dir):
         for file in files:
             if file.lower().endswith(('.png', '.gif')):
-                # Copy file
                 src_file = os.path.join(root, file)
+                converted = False
+                if converter and file.lower().endswith('.png'):
+                    # Decoded once into the image cache instead of by the PNG decoder on every miss
+                    bin_name = os.path.splitext(file)[0] + '.bin'
+                    try:
+                        convert_png_to_lvgl_bin(converter, src_file, os.path.join(assets_dir, bin_name), image_compress)
+                        png_bytes += os.path.getsize(src_file)
+                        bin_bytes += os.path.getsize(os.path.join(assets_dir, bin_name))
+                        file = bin_name
+                        converted = True
+                    except Exception as e:
+                        print(f"Warning: Failed to convert {src_file}: {e}, keeping the PNG")
+                # Copy file
                 dst_file = os.path.join(assets_dir, file)
-                if copy_file(src_file, dst_file):
+                if converted or copy_file(src_file, dst_file):
                     # Get filename without extension
                     filename_without_ext = os.path.splitext(file)[0]
                     
@@ -260,6 +553,8 @@ def process_emoji_collection(emoji_collection_dir, assets_dir):
                                 "file": file
                             })
     
+    if png_bytes > 0:
+        print(f"Converted PNG emojis to {image_compress} LVGL binaries: {png_bytes} -> {bin_bytes} bytes")
     return emoji_list
 
 
@@ -293,7 +588,56 @@ def process_extra_files(extra_files_dir, assets_dir):
     return extra_files_list
 
 
-def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files=None, multinet_model_info=None):
+def process_sounds(sound_files, assets_dir):
+    """Copy the prompt sounds, the firmware looks them up by file name.
+    Each copy gets a packet index so the firmware does not parse its Ogg pages."""
+    from ogg_packet_index import add_packet_index
+
+    sounds_list = []
+    indexed = 0
+    for src_file in sound_files:
+        file = os.path.basename(src_file)
+        if file in sounds_list:
+            print(f"Warning: Duplicate sound skipped: {src_file}")
+            continue
+        dst_file = os.path.join(assets_dir, file)
+        if copy_file(src_file, dst_file):
+            sounds_list.append(file)
+            if add_packet_index(dst_file, quiet=True):
+                indexed += 1
+    
+    if sounds_list:
+        print(f"Processed {len(sounds_list)} sounds, {indexed} indexed")
+    
+    return sounds_list
+
+
+def process_locales(languages, assets_dir, project_root):
+    """Pack the string table of each language, the firmware switches to one at runtime"""
+    import gen_lang
+    locales_dir = os.path.join(project_root, "main", "assets", "locales")
+    if not languages:
+        languages = sorted(code for code in os.listdir(locales_dir)
+                           if os.path.exists(os.path.join(locales_dir, code, "language.json")))
+    locales = {}
+    total = 0
+    for code in languages:
+        try:
+            table = gen_lang.pack_string_table(code, os.path.join(project_root, "main", "assets"))
+        except (OSError, ValueError) as e:
+            print(f"Warning: Skipping the string table of {code}: {e}")
+            continue
+        filename = f"lang_{code}.bin"
+        with open(os.path.join(assets_dir, filename), 'wb') as f:
+            f.write(table)
+        locales[code] = filename
+        total += len(table)
+    if locales:
+        print(f"Packed {len(locales)} string tables, {total} bytes")
+    return locales
+
+
+def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files=None, multinet_model_info=None, glyph_warmup=None, sounds=None, locales=None):
     """Generate index.json file"""
     index_data = {
         "version": 1
@@ -305,12 +649,21 @@ def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra
     if text_font:
         index_data["text_font"] = text_font
     
+    if glyph_warmup:
+        index_data["glyph_warmup"] = glyph_warmup
+    
     if emoji_collection:
         index_data["emoji_collection"] = emoji_collection
     
     if extra_files:
         index_data["extra_files"] = extra_files
     
+    if sounds:
+        index_data["sounds"] = sounds
+    
+    if locales:
+        index_data["locales"] = locales
+    
     if multinet_model_info:
         index_data["multinet_model"] = multinet_model_info
     
@@ -355,14 +708,17 @@ def generate_config_json(build_dir, assets_dir):
 # Simplified SPIFFS assets generation (from spiffs_assets_gen.py)
 # =============================================================================
 
+ASSET_CHECKSUMS_FILE = 'asset_checksums.bin'
+
+
 def compute_checksum(data):
     checksum = sum(data) & 0xFFFF
     return checksum
 
 
 def sort_key(filename):
-    basename, extension = os.path.splitext(filename)
-    return extension, basename
+    # Byte order of the stored names, the firmware binary searches the table by name
+    return filename.encode('utf-8')[:32]
 
 
 def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32):
@@ -377,25 +733,32 @@ def pack_assets_simple(target_path, include_path, out_file, assets_path, max_nam
     os.makedirs(os.path.dirname(out_file), exist_ok=True)
     os.makedirs(include_path, exist_ok=True)
 
-    file_list = sorted(os.listdir(target_path), key=sort_key)
-    for filename in file_list:
-        if filename in skip_files:
+    files = {}
+    for filename in os.listdir(target_path):
+        if filename in skip_files or filename == ASSET_CHECKSUMS_FILE:
             continue
 
         file_path = os.path.join(target_path, filename)
         if not os.path.isfile(file_path):
             continue
-            
-        file_name = os.path.basename(file_path)
-        file_size = os.path.getsize(file_path)
 
-        file_info_list.append((file_name, len(merged_data), file_size, 0, 0))
+        with open(file_path, 'rb') as bin_file:
+            files[os.path.basename(file_path)] = bin_file.read()
+
+    # One CRC32 per table entry, the firmware checks each asset when it is first used and
+    # keeps unchanged assets across updates
+    file_list = sorted(list(files) + [ASSET_CHECKSUMS_FILE], key=sort_key)
+    checksums = bytearray()
+    for file_name in file_list:
+        checksum = zlib.crc32(files[file_name]) & 0xFFFFFFFF if file_name in files else 0
+        checksums.extend(checksum.to_bytes(4, byteorder='little'))
+    files[ASSET_CHECKSUMS_FILE] = bytes(checksums)
+
+    for file_name in file_list:
+        bin_data = files[file_name]
+        file_info_list.append((file_name, len(merged_data), len(bin_data), 0, 0))
         # Add 0x5A5A prefix to merged_data
         merged_data.extend(b'\x5A' * 2)
-
-        with open(file_path, 'rb') as bin_file:
-            bin_data = bin_file.read()
-
         merged_data.extend(bin_data)
 
     total_files = len(file_info_list)
@@ -747,7 +1110,7 @@ def get_emoji_collection_path(default_emoji_collection, xiaozhi_fonts_path, proj
     return None
 
 
-def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None):
+def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None, glyph_warmup_config=None, sound_files=None, image_compress=None, font_subset_config=None, locales_config=None):
     """
     Build assets using integrated functions (no external dependencies)
     """
@@ -766,12 +1129,25 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font
         
         # Process each component
         srmodels = process_sr_models(wakenet_model_paths, multinet_model_paths, temp_build_dir, assets_dir) if (wakenet_model_paths or multinet_model_paths) else None
-        text_font = process_text_font(text_font_path, assets_dir) if text_font_path else None
-        emoji_collection = process_emoji_collection(emoji_collection_path, assets_dir) if emoji_collection_path else None
+        subset_characters = None
+        if text_font_path and font_subset_config:
+            subset_characters = font_subset_characters(font_subset_config['language'], font_subset_config['max_chars'],
+                                                       font_subset_config['charset_file'], font_subset_config['project_root'])
+        text_font = process_text_font(text_font_path, assets_dir, subset_characters) if text_font_path else None
+        emoji_collection = process_emoji_collection(emoji_collection_path, assets_dir, image_compress) if emoji_collection_path else None
         extra_files = process_extra_files(extra_files_path, assets_dir) if extra_files_path else None
+        sounds = process_sounds(sound_files, assets_dir) if sound_files else None
+        locales = None
+        if locales_config:
+            locales = process_locales(locales_config['languages'], assets_dir, locales_config['project_root'])
+        glyph_warmup = None
+        if text_font and glyph_warmup_config:
+            glyph_warmup = generate_glyph_warmup(glyph_warmup_config['language'], glyph_warmup_config['max_chars'],
+                                                 assets_dir, glyph_warmup_config['project_root'])
         
         # Generate index.json
-        generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files, multinet_model_info)
+        generate_index_json(assets_dir, srmodels, text_font, emoji_collection, extra_files, multinet_model_info, glyph_warmup, sounds,
+                            locales)
         
         # Generate config.json for packing
         config_path = generate_config_json(temp_build_dir, assets_dir)
@@ -817,6 +1193,20 @@ def main():
     parser.add_argument('--esp_sr_model_path', help='Path to ESP-SR model directory')
     parser.add_argument('--xiaozhi_fonts_path', help='Path to xiaozhi-fonts component directory')
     parser.add_argument('--extra_files', help='Path to extra files directory to be included in assets')
+    parser.add_argument('--glyph_warmup_chars', type=int, default=0,
+                        help='Number of frequent characters of the language to pre-rasterize into the glyph cache')
+    parser.add_argument('--font_subset_chars', type=int, default=0,
+                        help='Subset the text font to the UI strings and this many frequent characters, 0 keeps it whole')
+    parser.add_argument('--font_subset_charset',
+                        help='UTF-8 text file of characters in descending frequency for the font subset')
+    parser.add_argument('--languages', nargs='?', const='',
+                        help='Pack the string tables of these comma separated languages, all of them when empty')
+    parser.add_argument('--image_compress', choices=['RLE', 'LZ4'],
+                        help='Convert the PNG emojis into LVGL binaries compressed with this method')
+    parser.add_argument('--sounds',
+                        help='Comma separated .ogg prompt files to be included in assets')
+    parser.add_argument('--local_commands',
+                        help='JSON file with extra multinet commands: [{"command", "text", "action", "threshold"}]')
     
     args = parser.parse_args()
     
@@ -909,10 +1299,25 @@ def main():
         print(f"  custom wake word: {custom_wake_word_config['wake_word']} ({custom_wake_word_config['display']})")
         print(f"  wake word language: {language}")
         print(f"  wake word threshold: {custom_wake_word_config['threshold']}")
+
+        # Local commands run on the device without the server, matched by their action
+        if args.local_commands:
+            with open(args.local_commands, 'r', encoding='utf-8') as f:
+                for command in json.load(f):
+                    if not all(key in command for key in ('command', 'text', 'action')):
+                        print(f"Warning: skipping local command without command, text or action: {command}")
+                        continue
+                    multinet_model_info["commands"].append(command)
+                    print(f"  local command: {command['command']} -> {command['action']}")
+    
+    # Prompt sounds of the language, with the en-US fallbacks already resolved by the build
+    sound_files = [f for f in args.sounds.split(',') if f] if args.sounds else []
+    if sound_files:
+        print(f"  sounds: {len(sound_files)} files")
     
     # Check if we have anything to build
-    if not wakenet_model_paths and not multinet_model_paths and not text_font_path and not emoji_collection_path and not extra_files_path and not multinet_model_info:
-        print("Warning: No assets to build (no SR models, text font, emoji collection, extra files, or custom wake word)")
+    if not wakenet_model_paths and not multinet_model_paths and not text_font_path and not emoji_collection_path and not extra_files_path and not multinet_model_info and not sound_files and args.languages is None:
+        print("Warning: No assets to build (no SR models, text font, emoji collection, extra files, sounds, or custom wake word)")
         # Create an empty assets.bin file
         os.makedirs(os.path.dirname(args.output), exist_ok=True)
         with open(args.output, 'wb') as f:
@@ -920,9 +1325,37 @@ def main():
         print(f"Created empty assets.bin: {args.output}")
         return
     
+    glyph_warmup_config = None
+    if args.glyph_warmup_chars > 0:
+        glyph_warmup_config = {
+            "language": read_language_from_sdkconfig(args.sdkconfig),
+            "max_chars": args.glyph_warmup_chars,
+            "project_root": project_root,
+        }
+
+    font_subset_config = None
+    if args.font_subset_chars > 0:
+        charset_file = args.font_subset_charset
+        if charset_file and not os.path.isabs(charset_file):
+            charset_file = os.path.join(project_root, charset_file)
+        font_subset_config = {
+            "language": read_language_from_sdkconfig(args.sdkconfig),
+            "max_chars": args.font_subset_chars,
+            "charset_file": charset_file,
+            "project_root": project_root,
+        }
+
+    locales_config = None
+    if args.languages is not None:
+        locales_config = {
+            "languages": [code for code in args.languages.split(',') if code],
+            "project_root": project_root,
+        }
+
     # Build the assets
     success = build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, 
-                                     extra_files_path, args.output, multinet_model_info)
+                                     extra_files_path, args.output, multinet_model_info, glyph_warmup_config, sound_files,
+                                     args.image_compress, font_subset_config, locales_config)
     
     if not success:
         sys.exit(1)
@@ -2,11 +2,13 @@
 import argparse
 import json
 import os
+import struct
 
 HEADER_TEMPLATE = """// Auto-generated language config
 // Language: {lang_code} with en-US fallback
 #pragma once
 
+#include <cstddef>
 #include <string_view>
 
 #ifndef {lang_code_for_font}
@@ -14,14 +16,39 @@ HEADER_TEMPLATE = """// Auto-generated language config
 #endif
 
 namespace Lang {{
-    // 语言元数据
-    constexpr const char* CODE = "{lang_code}";
+    // 音效：asset 为资源分区中的文件名，builtin 为固件内置的副本（可能为空）
+    struct Sound {{
+        const char* asset;
+        std::string_view builtin;
+        // 优先使用资源分区中的音效，缺失时回退到内置副本，定义在 assets.cc
+        operator std::string_view() const;
+    }};
+
+    // 语言元数据：BUILTIN_CODE 为编译进固件的语言，CODE 为当前使用的语言
+    constexpr const char* BUILTIN_CODE = "{lang_code}";
+    inline const char* CODE = BUILTIN_CODE;
 
     // 字符串资源 (en-US as fallback for missing keys)
+    // 资源分区中有所选语言的字符串表时，指针在运行时改指向映射的资源分区
     namespace Strings {{
 {strings}
     }}
 
+    // 按键名排序，供 LoadStrings 查找
+    struct StringEntry {{
+        const char* key;
+        const char** value;
+        const char* builtin;
+    }};
+    inline StringEntry STRING_TABLE[] = {{
+{string_table}
+    }};
+
+    // 切换到资源分区中 gen_lang.py 打包的字符串表，表须保持映射。定义在 assets.cc
+    bool LoadStrings(const void* table, size_t size);
+    // 恢复内置字符串，资源分区取消映射之前调用
+    void ResetStrings();
+
     // 音效资源 (en-US as fallback for missing audio files)
     namespace Sounds {{
 {sounds}
@@ -44,13 +71,59 @@ def load_base_language(assets_dir):
         print("Warning: en-US base language file not found, fallback mechanism disabled")
     return {'strings': {}}
 
+# 字符串表：magic, version, count, code_offset, count × (key_offset, value_offset), 以 \0 结尾的 UTF-8 字符串
+STRING_TABLE_MAGIC = 0x4254534C  # "LSTB"
+STRING_TABLE_VERSION = 1
+
+def load_merged_strings(lang_code, assets_dir):
+    """以 en-US 为基准，用户语言覆盖"""
+    input_path = os.path.join(assets_dir, 'locales', lang_code, 'language.json')
+    with open(input_path, 'r', encoding='utf-8') as f:
+        data = json.load(f)
+    if 'language' not in data or 'strings' not in data:
+        raise ValueError(f"Invalid JSON structure: {input_path}")
+    merged = load_base_language(assets_dir).get('strings', {}).copy()
+    merged.update(data['strings'])
+    return merged
+
+def pack_string_table(lang_code, assets_dir):
+    """打包一个语言的字符串表，固件通过映射的指针直接使用"""
+    strings = load_merged_strings(lang_code, assets_dir)
+    keys = sorted(strings)
+    pool = bytearray()
+    offsets = {}
+    base = 12 + 8 * len(keys)
+
+    def add(text):
+        if text not in offsets:
+            offsets[text] = base + len(pool)
+            pool.extend(text.encode('utf-8') + b'\0')
+        return offsets[text]
+
+    code_offset = add(lang_code)
+    entries = b''.join(struct.pack('<II', add(key), add(strings[key])) for key in keys)
+    return struct.pack('<IHHI', STRING_TABLE_MAGIC, STRING_TABLE_VERSION, len(keys), code_offset) + entries + bytes(pool)
+
 def get_sound_files(directory):
     """获取目录中的音效文件列表"""
     if not os.path.exists(directory):
         return []
     return [f for f in os.listdir(directory) if f.endswith('.ogg')]
 
-def generate_header(lang_code, output_path):
+def sound_constant(base_name, builtin):
+    """生成音效常量，未内置的音效只能从资源分区中读取"""
+    if not builtin:
+        return f'''
+        static const Sound OGG_{base_name.upper()} {{"{base_name}.ogg", {{}}}};'''
+    return f'''
+        extern const char ogg_{base_name}_start[] asm("_binary_{base_name}_ogg_start");
+        extern const char ogg_{base_name}_end[] asm("_binary_{base_name}_ogg_end");
+        static const Sound OGG_{base_name.upper()} {{"{base_name}.ogg", {{
+        static_cast<const char*>(ogg_{base_name}_start),
+        static_cast<size_t>(ogg_{base_name}_end - ogg_{base_name}_start)
+        }}}};'''
+
+def generate_header(lang_code, output_path, builtin_sounds=None):
     # 从输出路径推导项目结构
     # output_path 通常是 main/assets/lang_config.h
     main_dir = os.path.dirname(output_path)  # main/assets
@@ -100,10 +173,14 @@ def generate_header(lang_code, output_path):
 
     # 生成字符串常量
     strings = []
+    string_table = []
     sounds = []
     for key, value in merged_strings.items():
         value = value.replace('"', '\\"')
-        strings.append(f'        constexpr const char* {key.upper()} = "{value}";')
+        strings.append(f'        inline const char* {key.upper()} = "{value}";')
+    for key in sorted(merged_strings):
+        value = merged_strings[key].replace('"', '\\"')
+        string_table.append(f'        {{"{key}", &Strings::{key.upper()}, "{value}"}},')
 
     # 收集音效文件：以 en-US 为基准，用户语言覆盖
     current_lang_dir = os.path.join(assets_dir, 'locales', lang_code)
@@ -141,30 +218,19 @@ def generate_header(lang_code, output_path):
         else:
             sound_lang = 'en_us'
             
-        sounds.append(f'''
-        extern const char ogg_{base_name}_start[] asm("_binary_{base_name}_ogg_start");
-        extern const char ogg_{base_name}_end[] asm("_binary_{base_name}_ogg_end");
-        static const std::string_view OGG_{base_name.upper()} {{
-        static_cast<const char*>(ogg_{base_name}_start),
-        static_cast<size_t>(ogg_{base_name}_end - ogg_{base_name}_start)
-        }};''')
+        sounds.append(sound_constant(base_name, builtin_sounds is None or file in builtin_sounds))
     
     # 生成公共音效常量
     for file in sorted(common_sounds):
         base_name = os.path.splitext(file)[0]
-        sounds.append(f'''
-        extern const char ogg_{base_name}_start[] asm("_binary_{base_name}_ogg_start");
-        extern const char ogg_{base_name}_end[] asm("_binary_{base_name}_ogg_end");
-        static const std::string_view OGG_{base_name.upper()} {{
-        static_cast<const char*>(ogg_{base_name}_start),
-        static_cast<size_t>(ogg_{base_name}_end - ogg_{base_name}_start)
-        }};''')
+        sounds.append(sound_constant(base_name, builtin_sounds is None or file in builtin_sounds))
 
     # 填充模板
     content = HEADER_TEMPLATE.format(
         lang_code=lang_code,
         lang_code_for_font=lang_code.replace('-', '_').lower(),
         strings="\n".join(sorted(strings)),
+        string_table="\n".join(string_table),
         sounds="\n".join(sorted(sounds))
     )
 
@@ -177,10 +243,13 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Generate language configuration header file with en-US fallback")
     parser.add_argument("--language", required=True, help="Language code (e.g: zh-CN, en-US, ja-JP)")
     parser.add_argument("--output", required=True, help="Output header file path")
+    parser.add_argument("--builtin_sounds",
+                        help="Comma separated sounds embedded in the firmware, all of them when omitted")
     args = parser.parse_args()
 
     try:
-        generate_header(args.language, args.output)
+        builtin_sounds = set(args.builtin_sounds.split(',')) if args.builtin_sounds else None
+        generate_header(args.language, args.output, builtin_sounds)
         print(f"Successfully generated language config file: {args.output}")
     except Exception as e:
         print(f"Error: {e}")
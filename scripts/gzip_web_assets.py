@@ -0,0 +1,27 @@
+#!/usr/bin/env python3
+"""Gzip the web display assets for embedding, served with Content-Encoding: gzip."""
+import argparse
+import gzip
+import os
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Gzip web assets")
+    parser.add_argument("--output-dir", required=True, help="Directory for the .gz files")
+    parser.add_argument("files", nargs="+", help="Assets to compress")
+    args = parser.parse_args()
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    for path in args.files:
+        with open(path, "rb") as f:
+            data = f.read()
+        output = os.path.join(args.output_dir, os.path.basename(path) + ".gz")
+        # mtime=0 keeps the output, and so the ETag, identical for identical input
+        compressed = gzip.compress(data, compresslevel=9, mtime=0)
+        with open(output, "wb") as f:
+            f.write(compressed)
+        print(f"{os.path.basename(path)}: {len(data)} -> {len(compressed)} bytes")
+
+
+if __name__ == "__main__":
+    main()
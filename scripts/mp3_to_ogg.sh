@@ -1,3 +1,5 @@
 #!/bin/sh
-# mp3_to_ogg.sh <input_mp3_file> <output_ogg_file>
-ffmpeg -i $1 -c:a libopus -b:a 16k -ac 1 -ar 16000 -frame_duration 60 $2
+# mp3_to_ogg.sh <input_mp3_file> <output_ogg_file> [sample_rate]
+# sample_rate: AUDIO_OUTPUT_SAMPLE_RATE of the board (16000, 24000 or 48000), 16000 by default
+ffmpeg -i "$1" -c:a libopus -b:a 16k -ac 1 -ar "${3:-16000}" -frame_duration 60 "$2" &&
+python3 "$(dirname "$0")/ogg_packet_index.py" "$2"
@@ -3,13 +3,35 @@ from tkinter import ttk, filedialog, messagebox
 import os
 import threading
 import sys
+import re
+import glob
 import ffmpeg
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+from ogg_packet_index import add_packet_index
+
+BOARDS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "main", "boards")
+# Opus的采样率，设备按和音频编解码器输出一致的采样率解码，无需重采样
+OPUS_SAMPLE_RATES = (16000, 24000, 48000)
+# 设备按60ms一帧解码提示音
+FRAME_DURATION_MS = 60
+
+
+def board_output_sample_rates():
+    """各开发板config.h中的AUDIO_OUTPUT_SAMPLE_RATE"""
+    rates = {}
+    for config in glob.glob(os.path.join(BOARDS_DIR, "*", "config.h")):
+        with open(config, encoding="utf-8", errors="ignore") as f:
+            match = re.search(r"#define\s+AUDIO_OUTPUT_SAMPLE_RATE\s+(\d+)", f.read())
+        if match:
+            rates[os.path.basename(os.path.dirname(config))] = int(match.group(1))
+    return dict(sorted(rates.items()))
+
 class AudioConverterApp:
     def __init__(self, master):
         self.master = master
         master.title("小智AI OGG音频批量转换工具")
-        master.geometry("680x600")  # 调整窗口高度
+        master.geometry("760x600")  # 调整窗口高度
 
         # 初始化变量
         self.mode = tk.StringVar(value="audio_to_ogg")
@@ -17,6 +39,9 @@ class AudioConverterApp:
         self.output_dir.set(os.path.abspath("output"))
         self.enable_loudnorm = tk.BooleanVar(value=True)
         self.target_lufs = tk.DoubleVar(value=-16.0)
+        self.sample_rate = tk.IntVar(value=24000)
+        self.board = tk.StringVar()
+        self.board_rates = board_output_sample_rates()
 
         # 创建UI组件
         self.create_widgets()
@@ -45,6 +70,16 @@ class AudioConverterApp:
                  width=6).grid(row=0, column=1, padx=2)
         ttk.Label(self.loudnorm_frame, text="LUFS").grid(row=0, column=2, padx=2)
 
+        # 采样率和开发板一致，开发板的音频输出采样率见其config.h
+        ttk.Label(self.loudnorm_frame, text="采样率").grid(row=0, column=3, padx=(15, 2))
+        ttk.Combobox(self.loudnorm_frame, textvariable=self.sample_rate, values=OPUS_SAMPLE_RATES,
+                     state="readonly", width=7).grid(row=0, column=4, padx=2)
+        ttk.Label(self.loudnorm_frame, text="开发板").grid(row=0, column=5, padx=(15, 2))
+        board_box = ttk.Combobox(self.loudnorm_frame, textvariable=self.board,
+                                 values=list(self.board_rates), state="readonly", width=24)
+        board_box.grid(row=0, column=6, padx=2)
+        board_box.bind("<<ComboboxSelected>>", self.on_board_selected)
+
         # 文件选择
         file_frame = ttk.LabelFrame(self.master, text="输入文件")
         file_frame.grid(row=2, column=0, padx=10, pady=5, sticky="nsew")
@@ -105,6 +140,11 @@ class AudioConverterApp:
         else:
             self.loudnorm_frame.grid_remove()
 
+    def on_board_selected(self, event):
+        rate = self.board_rates.get(self.board.get())
+        # 不是Opus采样率的输出由设备从48kHz重采样
+        self.sample_rate.set(rate if rate in OPUS_SAMPLE_RATES else 48000)
+
     def select_files(self):
         file_types = [
             ("音频文件", "*.wav *.mogg *.ogg *.flac") if self.mode.get() == "audio_to_ogg" 
@@ -195,12 +235,17 @@ class AudioConverterApp:
                 output_path = os.path.join(self.output_dir.get(), f"{base_name}.ogg")
                 
                 print(f"正在转换: {filename}")
+                stream = ffmpeg.input(input_path)
+                if target_lufs is not None:
+                    stream = stream.filter('loudnorm', I=target_lufs)
                 (
-                    ffmpeg
-                    .input(input_path)
-                    .output(output_path, acodec='libopus', audio_bitrate='16k', ac=1, ar=16000, frame_duration=60)
+                    stream
+                    .output(output_path, acodec='libopus', audio_bitrate='16k', ac=1, ar=self.sample_rate.get(),
+                            frame_duration=FRAME_DURATION_MS)
                     .run(overwrite_output=True)
                 )
+                # 附加包索引，设备播放时不再解析Ogg页
+                add_packet_index(output_path)
                 print(f"转换成功: {filename}\n")
             except Exception as e:
                 print(f"转换失败: {str(e)}\n")
@@ -211,13 +256,13 @@ class AudioConverterApp:
             try:
                 filename = os.path.basename(input_path)
                 base_name = os.path.splitext(filename)[0]
-                output_path = os.path.join(self.output_dir.get(), f"{base_name}.ogg")
+                output_path = os.path.join(self.output_dir.get(), f"{base_name}.wav")
                 
                 print(f"正在转换: {filename}")
                 (
                     ffmpeg
                     .input(input_path)
-                    .output(output_path, acodec='libopus', audio_bitrate='16k', ac=1, ar=16000, frame_duration=60)
+                    .output(output_path, acodec='pcm_s16le')
                     .run(overwrite_output=True)
                 )
                 print(f"转换成功: {filename}\n")
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Append a packet index to Ogg Opus prompts.
+
+The index sits after the last Ogg page, so players that stop at the end of the stream
+ignore it. The firmware (OggDemuxer::FindPacketIndex) takes the Opus packets straight
+by offset with it and never parses a page of the file.
+
+Layout, little endian:
+    count x (u32 offset, u16 length)    audio packets, OpusHead and OpusTags excluded
+    u32 sample_rate                     input sample rate of the OpusHead
+    u32 count
+    u16 version                         1
+    u16 frame_duration_ms               duration of every packet
+    "OPIX"
+
+Only a stream whose audio packets all lie within one page and last the same can be indexed.
+
+Usage:
+    python ogg_packet_index.py file.ogg [file.ogg ...]
+"""
+
+import struct
+import sys
+
+PACKET_INDEX_MAGIC = b"OPIX"
+PACKET_INDEX_VERSION = 1
+PACKET_INDEX_FOOTER = struct.Struct("<IIHH4s")
+PACKET_INDEX_ENTRY = struct.Struct("<IH")
+
+
+def opus_packet_duration_ms(packet):
+    """Duration of an Opus packet from its TOC byte (RFC 6716 3.1), 0 if it has none"""
+    if not packet:
+        return 0
+    config = packet[0] >> 3
+    if config < 12:
+        samples = (480, 960, 1920, 2880)[config & 3]
+    elif config < 16:
+        samples = (480, 960)[config & 1]
+    else:
+        samples = (120, 240, 480, 960)[config & 3]
+    code = packet[0] & 3
+    frames = 1 if code == 0 else 2 if code in (1, 2) else (packet[1] & 0x3F if len(packet) > 1 else 0)
+    return samples * frames // 48
+
+
+def strip_packet_index(data):
+    """The Ogg data without a packet index appended earlier"""
+    if len(data) < PACKET_INDEX_FOOTER.size:
+        return data
+    _, count, version, _, magic = PACKET_INDEX_FOOTER.unpack_from(data, len(data) - PACKET_INDEX_FOOTER.size)
+    trailer_size = PACKET_INDEX_FOOTER.size + count * PACKET_INDEX_ENTRY.size
+    if magic != PACKET_INDEX_MAGIC or version != PACKET_INDEX_VERSION or trailer_size > len(data):
+        return data
+    return data[:len(data) - trailer_size]
+
+
+def parse_ogg_packets(data):
+    """(offset, length) of every packet, None for packets continued across pages"""
+    packets = []
+    pos = 0
+    continued = False
+    while pos + 27 <= len(data):
+        if data[pos:pos + 4] != b"OggS":
+            raise ValueError(f"no Ogg page at offset {pos}")
+        if bool(data[pos + 5] & 0x01) != continued:
+            raise ValueError(f"broken packet continuation at offset {pos}")
+        seg_count = data[pos + 26]
+        segments = data[pos + 27:pos + 27 + seg_count]
+        offset = pos + 27 + seg_count
+        length = 0
+        for seg in segments:
+            length += seg
+            if seg < 255:
+                packets.append(None if continued else (offset, length))
+                offset += length
+                length = 0
+                continued = False
+        # A packet that does not end on this page goes on in the next one
+        if length > 0:
+            continued = True
+        pos = offset + length
+    if pos != len(data):
+        raise ValueError("trailing data after the last Ogg page")
+    return packets
+
+
+def build_packet_index(data):
+    """The index of the Ogg Opus stream in data, raises ValueError if it can not have one"""
+    packets = parse_ogg_packets(data)
+    if len(packets) < 3 or packets[0] is None:
+        raise ValueError("not an Ogg Opus stream")
+    head_offset, head_length = packets[0]
+    head = data[head_offset:head_offset + head_length]
+    if head_length < 19 or head[:8] != b"OpusHead":
+        raise ValueError("no OpusHead")
+    if head[9] != 1:
+        raise ValueError(f"{head[9]} channels, the prompts are mono")
+    sample_rate = struct.unpack_from("<I", head, 12)[0]
+
+    audio = packets[2:]
+    if None in audio:
+        raise ValueError("audio packets continue across pages")
+    durations = {opus_packet_duration_ms(data[offset:offset + length]) for offset, length in audio}
+    if len(durations) != 1:
+        raise ValueError(f"mixed packet durations {sorted(durations)} ms")
+    frame_duration = durations.pop()
+    if any(length > 0xFFFF for _, length in audio):
+        raise ValueError("packet too large")
+
+    entries = b"".join(PACKET_INDEX_ENTRY.pack(offset, length) for offset, length in audio)
+    footer = PACKET_INDEX_FOOTER.pack(sample_rate, len(audio), PACKET_INDEX_VERSION, frame_duration, PACKET_INDEX_MAGIC)
+    return entries + footer, sample_rate, len(audio), frame_duration
+
+
+def add_packet_index(path, quiet=False):
+    """Append the index to the file at path, replacing an earlier one. Returns False if it can not have one"""
+    with open(path, "rb") as f:
+        data = strip_packet_index(f.read())
+    try:
+        index, sample_rate, count, frame_duration = build_packet_index(data)
+    except (ValueError, struct.error) as e:
+        print(f"Warning: {path} is not indexed: {e}")
+        return False
+    with open(path, "wb") as f:
+        f.write(data + index)
+    if not quiet:
+        print(f"Indexed {path}: {count} packets of {frame_duration} ms at {sample_rate} Hz")
+    return True
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(__doc__.strip())
+        sys.exit(1)
+    ok = all([add_packet_index(path) for path in sys.argv[1:]])
+    sys.exit(0 if ok else 1)
@@ -8,7 +8,10 @@ import numpy as np
 import argparse
 import pyloudnorm as pyln
 
-def encode_audio_to_opus(input_file, output_file, target_lufs=None):
+# Opus sample rates, match the AUDIO_OUTPUT_SAMPLE_RATE of the board so it decodes without resampling
+OPUS_SAMPLE_RATES = (8000, 12000, 16000, 24000, 48000)
+
+def encode_audio_to_opus(input_file, output_file, target_lufs=None, target_sample_rate=16000):
     # Load audio file using librosa
     audio, sample_rate = librosa.load(input_file, sr=None, mono=False, dtype=np.float32)
     
@@ -26,8 +29,7 @@ def encode_audio_to_opus(input_file, output_file, target_lufs=None):
         audio = pyln.normalize.loudness(audio, current_loudness, target_lufs)
         print(f"Adjusted loudness: {current_loudness:.1f} LUFS -> {target_lufs} LUFS")
 
-    # Convert sample rate to 16000Hz if necessary
-    target_sample_rate = 16000
+    # Convert to the target sample rate if necessary
     if sample_rate != target_sample_rate:
         audio = librosa.resample(audio, orig_sr=sample_rate, target_sr=target_sample_rate)
         sample_rate = target_sample_rate
@@ -42,7 +44,10 @@ def encode_audio_to_opus(input_file, output_file, target_lufs=None):
     with open(output_file, 'wb') as f:
         duration = 60  # 60ms per frame
         frame_size = int(sample_rate * duration / 1000)
-        for i in tqdm.tqdm(range(0, len(audio) - frame_size, frame_size)):
+        # The device decodes whole 60 ms frames, the tail is padded with silence
+        if len(audio) % frame_size:
+            audio = np.pad(audio, (0, frame_size - len(audio) % frame_size))
+        for i in tqdm.tqdm(range(0, len(audio), frame_size)):
             frame = audio[i:i + frame_size]
             opus_data = encoder.encode(frame.tobytes(), frame_size=frame_size)
             packet = struct.pack('>BBH', 0, 0, len(opus_data)) + opus_data
@@ -56,7 +61,9 @@ if __name__ == "__main__":
                        help='Target loudness in LUFS (default: -16)')
     parser.add_argument('-d', '--disable-loudnorm', action='store_true',
                        help='Disable loudness normalization')
+    parser.add_argument('-r', '--sample-rate', type=int, default=16000, choices=OPUS_SAMPLE_RATES,
+                       help='Sample rate, the AUDIO_OUTPUT_SAMPLE_RATE of the board (default: 16000)')
     args = parser.parse_args()
 
     target_lufs = None if args.disable_loudnorm else args.lufs
-    encode_audio_to_opus(args.input_file, args.output_file, target_lufs)
\ No newline at end of file
+    encode_audio_to_opus(args.input_file, args.output_file, target_lufs, args.sample_rate)
\ No newline at end of file
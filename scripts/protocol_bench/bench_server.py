@@ -0,0 +1,576 @@
+#!/usr/bin/env python3
+'''
+  Loopback WebSocket server for benchmarking the device protocol stack.
+
+  serve   Play a synthetic session: hello, MCP initialize, a TTS stream from a P3 file, MCP calls
+  record  Proxy a device to a real server and save everything the server sent
+  replay  Play a recorded session back with its original timing
+  soak    Answer the conversations of a CONFIG_SOAK_TEST device for days and log the heap trend
+
+  Every session ends with a JSON report: hello time, time to the first uplink audio frame,
+  uplink frame jitter, MCP round trips, turnaround after TTS and the heap / CPU usage of the
+  device taken from the `self.get_runtime_stats` MCP tool before and after the session.
+'''
+import argparse
+import asyncio
+import base64
+import json
+import statistics
+import struct
+import time
+import uuid
+import zlib
+
+import websockets
+
+FRAME_DURATION_MS = 60
+SAMPLE_RATE = 16000
+# MCP request ids from the harness, above the ids a recorded server uses
+HARNESS_MCP_ID = 90000
+# kJsonDeflateDictionary of main/protocols/json_deflate.cc
+JSON_DEFLATE_DICTIONARY = (
+    b'{"type":"hello","version":3,"transport":"websocket","features":{"mcp":true},'
+    b'"audio_params":{"format":"opus","sample_rate":24000,"channels":1,"frame_duration":60}}'
+    b'{"inputSchema":{"type":"object","properties":{"type":"integer","minimum":0,"maximum":100}},"required":[]}'
+    b'{"jsonrpc":"2.0","id":1,"result":{"content":[{"type":"text","text":"true"}],"isError":false}}'
+    b'{"type":"llm","emotion":"neutral","text":"'
+    b'{"type":"listen","state":"detect","mode":"auto"}{"type":"stt","text":"'
+    b'{"type":"mcp","payload":{"jsonrpc":"2.0","method":"tools/call","params":{"name":"self.'
+    b'{"session_id":"","type":"tts","state":"sentence_start","text":"'
+)
+BINARY_PROTOCOL3_TYPE_JSON_DEFLATE = 5
+SYNC_FLUSH_TRAILER = b'\x00\x00\xff\xff'
+
+
+def now_ms():
+    return time.monotonic() * 1000
+
+
+def request_headers(ws):
+    request = getattr(ws, 'request', None)
+    if request is not None:
+        return request.headers
+    return ws.request_headers
+
+
+def read_p3(path):
+    '''P3 is a sequence of protocol v3 packets: |type 1u|reserved 1u|payload_size 2u|payload|'''
+    frames = []
+    with open(path, 'rb') as f:
+        data = f.read()
+    offset = 0
+    while offset + 4 <= len(data):
+        _, _, size = struct.unpack('>BBH', data[offset:offset + 4])
+        frames.append(data[offset + 4:offset + 4 + size])
+        offset += 4 + size
+    return frames
+
+
+def frame_audio(version, opus, timestamp=0):
+    if version == 2:
+        return struct.pack('>HHIII', 2, 0, 0, timestamp, len(opus)) + opus
+    if version == 3:
+        return struct.pack('>BBH', 0, 0, len(opus)) + opus
+    return opus
+
+
+def unframe_audio(version, data):
+    '''Returns the Opus packets of one binary message'''
+    if version == 2:
+        _, _, _, _, size = struct.unpack('>HHIII', data[:16])
+        return [data[16:16 + size]]
+    if version == 3:
+        packets = []
+        msg_type, _, size = struct.unpack('>BBH', data[:4])
+        payload = data[4:4 + size]
+        if msg_type != 2:
+            return [payload]
+        # Batch: the payload is a sequence of type 0 packets
+        offset = 0
+        while offset + 4 <= len(payload):
+            _, _, size = struct.unpack('>BBH', payload[offset:offset + 4])
+            packets.append(payload[offset + 4:offset + 4 + size])
+            offset += 4 + size
+        return packets
+    return [data]
+
+
+class JsonDeflate:
+    '''Both streams of a "json_deflate" connection, window_bits is the one the device offered'''
+    def __init__(self, window_bits):
+        self.compressor = zlib.compressobj(9, zlib.DEFLATED, -window_bits, 8, zdict=JSON_DEFLATE_DICTIONARY)
+        self.decompressor = zlib.decompressobj(-15, zdict=JSON_DEFLATE_DICTIONARY)
+        self.bytes = {'downlink_json': 0, 'downlink_sent': 0, 'uplink_json': 0, 'uplink_received': 0}
+
+    def frame(self, text):
+        data = text.encode()
+        payload = self.compressor.compress(data) + self.compressor.flush(zlib.Z_SYNC_FLUSH)
+        payload = payload[:-len(SYNC_FLUSH_TRAILER)]
+        self.bytes['downlink_json'] += len(data)
+        self.bytes['downlink_sent'] += len(payload) + 4
+        return struct.pack('>BBH', BINARY_PROTOCOL3_TYPE_JSON_DEFLATE, 0, min(len(payload), 0xFFFF)) + payload
+
+    def unframe(self, data):
+        text = self.decompressor.decompress(data[4:] + SYNC_FLUSH_TRAILER)
+        self.bytes['uplink_json'] += len(text)
+        self.bytes['uplink_received'] += len(data)
+        return text.decode()
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    index = min(len(values) - 1, int(round(p / 100 * (len(values) - 1))))
+    return values[index]
+
+
+class Session:
+    def __init__(self, ws, version):
+        self.ws = ws
+        self.version = version
+        self.session_id = str(uuid.uuid4())
+        self.opened_ms = now_ms()
+        self.hello_ms = None
+        self.server_hello_ms = None
+        self.first_uplink_ms = None
+        self.uplink_times = []
+        self.uplink_frames = 0
+        self.uplink_bytes = 0
+        self.downlink_frames = 0
+        self.downlink_late_ms = []
+        self.mcp_rtt = []
+        self.turnaround_ms = []
+        self.runtime = {}
+        self.pending_mcp = {}
+        self.listen_start = asyncio.Event()
+        self.next_mcp_id = HARNESS_MCP_ID
+        self.closed = False
+        self.deflate = None
+
+    async def send_json(self, message):
+        text = json.dumps(message, ensure_ascii=False)
+        await self.ws.send(self.deflate.frame(text) if self.deflate is not None else text)
+
+    async def send_server_hello(self, hello=None, features=None):
+        if hello is None:
+            hello = {
+                'type': 'hello',
+                'transport': 'websocket',
+                'session_id': self.session_id,
+                'audio_params': {
+                    'format': 'opus',
+                    'sample_rate': SAMPLE_RATE,
+                    'channels': 1,
+                    'frame_duration': FRAME_DURATION_MS,
+                },
+            }
+            if features:
+                hello['features'] = features
+        self.session_id = hello.get('session_id', self.session_id)
+        await self.send_json(hello)
+        self.server_hello_ms = now_ms()
+
+    def on_binary(self, data):
+        if self.deflate is not None and data[:1] == bytes([BINARY_PROTOCOL3_TYPE_JSON_DEFLATE]):
+            self.on_text(json.loads(self.deflate.unframe(data)))
+            return
+        t = now_ms()
+        if self.first_uplink_ms is None and self.server_hello_ms is not None:
+            self.first_uplink_ms = t - self.server_hello_ms
+        self.uplink_times.append(t)
+        self.uplink_frames += len(unframe_audio(self.version, data))
+        self.uplink_bytes += len(data)
+
+    def on_text(self, message):
+        msg_type = message.get('type')
+        if msg_type == 'mcp':
+            payload = message.get('payload', {})
+            future = self.pending_mcp.pop(payload.get('id'), None)
+            if future is not None and not future.done():
+                future.set_result(payload)
+        elif msg_type == 'listen' and message.get('state') in ('start', 'detect'):
+            self.listen_start.set()
+
+    async def mcp_call(self, method, params=None, timeout=10):
+        self.next_mcp_id += 1
+        request_id = self.next_mcp_id
+        future = asyncio.get_running_loop().create_future()
+        self.pending_mcp[request_id] = future
+        payload = {'jsonrpc': '2.0', 'id': request_id, 'method': method}
+        if params is not None:
+            payload['params'] = params
+        start = now_ms()
+        await self.send_json({'session_id': self.session_id, 'type': 'mcp', 'payload': payload})
+        try:
+            result = await asyncio.wait_for(future, timeout)
+        except asyncio.TimeoutError:
+            self.pending_mcp.pop(request_id, None)
+            print(f'MCP {method} timed out')
+            return None
+        name = params.get('name', method) if params else method
+        self.mcp_rtt.append({'method': name, 'rtt_ms': round(now_ms() - start, 1),
+                             'bytes': len(json.dumps(result))})
+        return result
+
+    async def runtime_stats(self):
+        result = await self.mcp_call('tools/call', {'name': 'self.get_runtime_stats', 'arguments': {}})
+        try:
+            return json.loads(result['result']['content'][0]['text'])
+        except (TypeError, KeyError, IndexError, ValueError):
+            return None
+
+    async def stream_tts(self, frames, text='Benchmark'):
+        await self.send_json({'session_id': self.session_id, 'type': 'tts', 'state': 'start'})
+        await self.send_json({'session_id': self.session_id, 'type': 'tts', 'state': 'sentence_start', 'text': text})
+        start = now_ms()
+        for i, opus in enumerate(frames):
+            # Pace at real time like a TTS server, the device buffers the rest
+            due = start + i * FRAME_DURATION_MS
+            delay = due - now_ms()
+            if delay > 0:
+                await asyncio.sleep(delay / 1000)
+            elif delay < -5:
+                self.downlink_late_ms.append(-delay)
+            await self.ws.send(frame_audio(self.version, opus, i * FRAME_DURATION_MS))
+            self.downlink_frames += 1
+        await self.send_json({'session_id': self.session_id, 'type': 'tts', 'state': 'stop'})
+        await self.wait_turnaround()
+
+    async def wait_turnaround(self, timeout=5):
+        '''After tts stop the device plays out its buffer and starts listening again'''
+        self.listen_start.clear()
+        stop_ms = now_ms()
+        try:
+            await asyncio.wait_for(self.listen_start.wait(), timeout)
+            self.turnaround_ms.append(round(now_ms() - stop_ms, 1))
+        except asyncio.TimeoutError:
+            pass
+
+    def report(self):
+        intervals = [b - a for a, b in zip(self.uplink_times, self.uplink_times[1:])]
+        report = {
+            'protocol_version': self.version,
+            'hello_ms': round(self.hello_ms, 1) if self.hello_ms is not None else None,
+            'first_uplink_audio_ms': round(self.first_uplink_ms, 1) if self.first_uplink_ms is not None else None,
+            'uplink': {
+                'messages': len(self.uplink_times),
+                'frames': self.uplink_frames,
+                'bytes': self.uplink_bytes,
+                'interval_mean_ms': round(statistics.mean(intervals), 1) if intervals else None,
+                'interval_stdev_ms': round(statistics.pstdev(intervals), 1) if intervals else None,
+                'interval_p95_ms': round(percentile(intervals, 95), 1) if intervals else None,
+                'interval_max_ms': round(max(intervals), 1) if intervals else None,
+            },
+            'downlink': {
+                'frames': self.downlink_frames,
+                'late_sends': len(self.downlink_late_ms),
+                'max_late_ms': round(max(self.downlink_late_ms), 1) if self.downlink_late_ms else 0,
+            },
+            'turnaround_ms': self.turnaround_ms,
+            'mcp': self.mcp_rtt,
+        }
+        if self.deflate is not None:
+            report['json_deflate'] = self.deflate.bytes
+        report.update(runtime_report(self.runtime.get('before'), self.runtime.get('after')))
+        return report
+
+
+def runtime_report(before, after):
+    if not before or not after:
+        return {}
+    report = {
+        'heap': {
+            'free_before': before['heap']['free'],
+            'free_after': after['heap']['free'],
+            'minimum_free': after['heap']['minimum_free'],
+            'minimum_free_sram': after['heap']['minimum_free_sram'],
+        },
+    }
+    elapsed = (after.get('run_time', 0) - before.get('run_time', 0)) * after.get('cores', 1)
+    if elapsed > 0:
+        start = {task['name']: task['run_time'] for task in before.get('tasks', [])}
+        usage = []
+        for task in after.get('tasks', []):
+            if task['name'] in start:
+                share = (task['run_time'] - start[task['name']]) * 100 / elapsed
+                usage.append((task['name'], round(share, 1)))
+        usage.sort(key=lambda item: item[1], reverse=True)
+        report['cpu_percent'] = dict(usage[:10])
+    return report
+
+
+async def reader(session):
+    try:
+        async for data in session.ws:
+            if isinstance(data, bytes):
+                session.on_binary(data)
+            else:
+                try:
+                    session.on_text(json.loads(data))
+                except ValueError:
+                    print(f'Invalid JSON from device: {data[:100]}')
+    except websockets.ConnectionClosed:
+        pass
+    session.closed = True
+
+
+async def accept(ws):
+    headers = request_headers(ws)
+    version = int(headers.get('Protocol-Version', '1'))
+    session = Session(ws, version)
+    print(f'Device {headers.get("Device-Id")} connected, protocol version {version}')
+    hello = json.loads(await ws.recv())
+    if hello.get('type') != 'hello':
+        raise ValueError(f'Expected hello, got {hello}')
+    session.hello_ms = now_ms() - session.opened_ms
+    return session, hello
+
+
+async def run_synthetic(ws, args):
+    session, hello = await accept(ws)
+    window_bits = hello.get('features', {}).get('json_deflate')
+    if args.json_deflate and session.version == 3 and window_bits:
+        # The server hello still goes as text, both directions are deflated after it
+        await session.send_server_hello(features={'json_deflate': True})
+        session.deflate = JsonDeflate(window_bits)
+    else:
+        await session.send_server_hello()
+    read_task = asyncio.create_task(reader(session))
+
+    await session.mcp_call('initialize', {'capabilities': {}})
+    session.runtime['before'] = await session.runtime_stats()
+    await session.mcp_call('tools/call', {'name': 'self.get_device_status', 'arguments': {}})
+    await session.mcp_call('tools/list', {'cursor': '', 'withUserTools': True})
+
+    frames = read_p3(args.p3) if args.p3 else []
+    for _ in range(args.repeat):
+        # Let the device stream some uplink audio first
+        await asyncio.sleep(args.listen_ms / 1000)
+        if frames:
+            await session.stream_tts(frames)
+
+    session.runtime['after'] = await session.runtime_stats()
+    await session.send_json({'session_id': session.session_id, 'type': 'goodbye'})
+    await ws.close()
+    await read_task
+    return session.report()
+
+
+async def run_record(ws, args):
+    '''Proxy to the real server, the session file holds the server side of the conversation'''
+    headers = request_headers(ws)
+    upstream_headers = {key: headers[key] for key in ('Authorization', 'Protocol-Version', 'Device-Id', 'Client-Id')
+                        if key in headers}
+    try:
+        upstream = await websockets.connect(args.upstream, additional_headers=upstream_headers)
+    except TypeError:
+        # websockets < 14
+        upstream = await websockets.connect(args.upstream, extra_headers=upstream_headers)
+    version = int(headers.get('Protocol-Version', '1'))
+    start = now_ms()
+    records = [{'version': version}]
+
+    async def up():
+        async for data in ws:
+            await upstream.send(data)
+
+    async def down():
+        async for data in upstream:
+            record = {'t': round(now_ms() - start, 1)}
+            if isinstance(data, bytes):
+                record['binary'] = base64.b64encode(data).decode()
+            else:
+                record['text'] = data
+            records.append(record)
+            await ws.send(data)
+
+    tasks = [asyncio.create_task(up()), asyncio.create_task(down())]
+    await asyncio.wait(tasks, return_when=asyncio.FIRST_COMPLETED)
+    for task in tasks:
+        task.cancel()
+    await upstream.close()
+    with open(args.output, 'w') as f:
+        for record in records:
+            f.write(json.dumps(record, ensure_ascii=False) + '\n')
+    print(f'Saved {len(records) - 1} server messages to {args.output}')
+    return None
+
+
+async def run_replay(ws, args):
+    with open(args.session) as f:
+        records = [json.loads(line) for line in f if line.strip()]
+    recorded_version = records[0].get('version', 1)
+
+    session, _ = await accept(ws)
+    read_task = asyncio.create_task(reader(session))
+    before_task = None
+
+    start = now_ms()
+    for record in records[1:]:
+        delay = start + record['t'] - now_ms()
+        if delay > 0:
+            await asyncio.sleep(delay / 1000)
+        if session.closed:
+            break
+        if 'text' in record:
+            message = json.loads(record['text'])
+            if message.get('type') == 'hello':
+                await session.send_server_hello(message)
+                # Do not hold up the recorded timeline for the reply
+                before_task = asyncio.create_task(session.runtime_stats())
+                continue
+            await ws.send(record['text'])
+            if message.get('type') == 'tts' and message.get('state') == 'stop':
+                asyncio.create_task(session.wait_turnaround())
+        else:
+            # Re-frame the audio in case the device speaks another protocol version
+            for opus in unframe_audio(recorded_version, base64.b64decode(record['binary'])):
+                await ws.send(frame_audio(session.version, opus))
+                session.downlink_frames += 1
+
+    if before_task is not None:
+        session.runtime['before'] = await before_task
+    if not session.closed:
+        session.runtime['after'] = await session.runtime_stats()
+        await ws.close()
+    await read_task
+    return session.report()
+
+
+# Across the sessions of a soak run
+soak_state = {'sessions': 0, 'tools': None}
+
+
+async def list_tools(session):
+    names = []
+    cursor = ''
+    while cursor is not None:
+        result = await session.mcp_call('tools/list', {'cursor': cursor, 'withUserTools': True})
+        try:
+            names += [tool['name'] for tool in result['result']['tools']]
+            cursor = result['result'].get('nextCursor') or None
+        except (TypeError, KeyError):
+            break
+    return names
+
+
+async def call_tool(session, name, arguments=None):
+    result = await session.mcp_call('tools/call', {'name': name, 'arguments': arguments or {}}, timeout=30)
+    try:
+        return result['result']['content'][0]['text']
+    except (TypeError, KeyError, IndexError):
+        return None
+
+
+async def run_soak(ws, args):
+    '''One conversation of the soak test: the device woke itself and opens a session'''
+    session, _ = await accept(ws)
+    await session.send_server_hello()
+    read_task = asyncio.create_task(reader(session))
+    soak_state['sessions'] += 1
+    number = soak_state['sessions']
+
+    await session.mcp_call('initialize', {'capabilities': {}})
+    if soak_state['tools'] is None:
+        soak_state['tools'] = await list_tools(session)
+        print(f'Device tools: {", ".join(soak_state["tools"])}')
+    tools = soak_state['tools']
+
+    try:
+        await asyncio.wait_for(session.listen_start.wait(), 10)
+    except asyncio.TimeoutError:
+        print(f'Session {number}: the device did not start listening')
+    await asyncio.sleep(args.listen_ms / 1000)
+    await session.send_json({'session_id': session.session_id, 'type': 'stt', 'text': f'Soak cycle {number}'})
+    await session.send_json({'session_id': session.session_id, 'type': 'llm', 'emotion': 'happy'})
+
+    await call_tool(session, 'self.get_device_status')
+    if 'self.screen.set_theme' in tools:
+        await call_tool(session, 'self.screen.set_theme', {'theme': 'dark' if number % 2 else 'light'})
+    if number % args.camera_every == 0 and 'self.camera.take_photo' in tools:
+        await call_tool(session, 'self.camera.take_photo', {'question': 'What do you see?'})
+
+    frames = read_p3(args.p3) if args.p3 else []
+    if frames:
+        await session.stream_tts(frames, text=f'Soak cycle {number}')
+
+    if number % args.report_every == 0 and 'self.soak.get_report' in tools:
+        report = await call_tool(session, 'self.soak.get_report')
+        if report:
+            print_soak_trend(number, json.loads(report))
+            if args.report:
+                with open(args.report, 'w') as f:
+                    f.write(report)
+
+    await session.send_json({'session_id': session.session_id, 'type': 'goodbye'})
+    await ws.close()
+    await read_task
+    return None
+
+
+def print_soak_trend(number, report):
+    print(f'Session {number}: {report.get("cycles")} device cycles, {report.get("failures")} failed')
+    for name, trend in report.get('trend', {}).items():
+        print(f'  {name:24} first {trend["first"]:>9} last {trend["last"]:>9} min {trend["min"]:>9} '
+              f'slope {trend["slope_per_1000_cycles"]:>+10.1f} / 1000 cycles')
+    fragmentation = report.get('fragmentation', {})
+    if fragmentation:
+        print('  fragmentation ' + ', '.join(f'{k} {v:.2f}' for k, v in fragmentation.items()))
+
+
+async def main(args):
+    runners = {'serve': run_synthetic, 'record': run_record, 'replay': run_replay, 'soak': run_soak}
+    runner = runners[args.command]
+    reports = []
+    done = asyncio.Event()
+
+    async def handler(ws, *unused):
+        report = await runner(ws, args)
+        if report is not None:
+            reports.append(report)
+            print(json.dumps(report, indent=2, ensure_ascii=False))
+        if len(reports) >= args.sessions or args.command == 'record':
+            done.set()
+        if args.command == 'soak' and args.cycles and soak_state['sessions'] >= args.cycles:
+            done.set()
+
+    async with websockets.serve(handler, args.host, args.port, max_size=None):
+        print(f'Listening on ws://{args.host}:{args.port}/')
+        await done.wait()
+
+    if args.report and reports:
+        with open(args.report, 'w') as f:
+            json.dump({'sessions': reports}, f, indent=2, ensure_ascii=False)
+        print(f'Report saved to {args.report}')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='设备协议基准测试服务器')
+    parser.add_argument('--host', default='0.0.0.0')
+    parser.add_argument('--port', type=int, default=8000)
+    parser.add_argument('--sessions', type=int, default=1, help='结束前等待的会话数 (默认: 1)')
+    parser.add_argument('--report', help='保存 JSON 报告的路径')
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    serve = commands.add_parser('serve', help='播放合成会话')
+    serve.add_argument('--p3', help='下行 TTS 使用的 P3 文件 (16 kHz, 60 ms)')
+    serve.add_argument('--repeat', type=int, default=3, help='TTS 轮数 (默认: 3)')
+    serve.add_argument('--listen-ms', type=int, default=3000, help='每轮 TTS 前等待上行音频的时间 (默认: 3000)')
+    serve.add_argument('--json-deflate', action='store_true', help='接受设备的 json_deflate, 压缩双向 JSON 消息')
+
+    record = commands.add_parser('record', help='代理到真实服务器并录制会话')
+    record.add_argument('--upstream', required=True, help='真实服务器的 WebSocket URL')
+    record.add_argument('--output', default='session.jsonl')
+
+    replay = commands.add_parser('replay', help='按原始时序回放录制的会话')
+    replay.add_argument('--session', default='session.jsonl')
+
+    soak = commands.add_parser('soak', help='应答 CONFIG_SOAK_TEST 设备的合成对话并记录堆趋势')
+    soak.add_argument('--p3', help='下行 TTS 使用的 P3 文件 (16 kHz, 60 ms)')
+    soak.add_argument('--listen-ms', type=int, default=2000, help='回复前等待上行音频的时间 (默认: 2000)')
+    soak.add_argument('--camera-every', type=int, default=5, help='每隔多少轮调用一次拍照解释 (默认: 5)')
+    soak.add_argument('--report-every', type=int, default=50, help='每隔多少轮获取一次浸泡报告 (默认: 50)')
+    soak.add_argument('--cycles', type=int, default=0, help='运行的轮数, 0 为一直运行 (默认: 0)')
+
+    asyncio.run(main(parser.parse_args()))
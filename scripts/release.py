@@ -2,6 +2,7 @@ import sys
 import os
 import json
 import zipfile
+import zlib
 import argparse
 from pathlib import Path
 from typing import Optional
@@ -57,6 +58,21 @@ def zip_bin(name: str, version: str) -> None:
         zipf.write("build/merged-binary.bin", arcname="merged-binary.bin")
     print(f"zip bin to {output_path} done")
 
+
+def compress_app_bin(name: str, version: str) -> None:
+    """Compress build/xiaozhi.bin to releases/v{version}_{name}.ota.bin, a zlib stream the OTA inflates"""
+    app_path = Path("build/xiaozhi.bin")
+    if not app_path.exists():
+        print(f"[WARN] {app_path} 不存在，跳过压缩固件")
+        return
+    out_dir = Path("releases")
+    out_dir.mkdir(exist_ok=True)
+    output_path = out_dir / f"v{version}_{name}.ota.bin"
+    data = app_path.read_bytes()
+    compressed = zlib.compress(data, 9)
+    output_path.write_bytes(compressed)
+    print(f"compress app bin to {output_path} done, {len(data)} -> {len(compressed)} bytes")
+
 def _get_manufacturer(cfg: dict) -> Optional[str]:
     """Read manufacturer from config.json"""
     m = cfg.get("manufacturer")
@@ -258,6 +274,7 @@ def release(board_type: str, config_filename: str = "config.json", *, filter_nam
 
         # Zip
         zip_bin(final_name, project_version)
+        compress_app_bin(final_name, project_version)
 
 ################################################################################
 # CLI entry
@@ -292,6 +309,7 @@ if __name__ == "__main__":
             sys.exit(1)
         project_ver = get_project_version()
         zip_bin(curr_board_type, project_ver)
+        compress_app_bin(curr_board_type, project_ver)
         sys.exit(0)
 
     # Compile mode